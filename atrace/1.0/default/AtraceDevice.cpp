@@ -14,8 +14,17 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <set>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
 
 #include "AtraceDevice.h"
 
@@ -51,6 +60,18 @@ const std::map<std::string, TracingConfig> kTracingMap = {
         },
 };
 
+// Writes to different enable files are issued from up to this many threads.
+static constexpr size_t kMaxWriteThreads = 4;
+
+AtraceDevice::AtraceDevice() {
+    for (auto& c : kTracingMap) {
+        for (auto& p : c.second.paths) {
+            EnableFile& file = mEnableFiles[p.first];
+            file.required = file.required || p.second;
+        }
+    }
+}
+
 // Methods from ::android::hardware::atrace::V1_0::IAtraceDevice follow.
 Return<void> AtraceDevice::listCategories(listCategories_cb _hidl_cb) {
     hidl_vec<TracingCategory> categories;
@@ -70,38 +91,115 @@ Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::enableCategories
     if (!categories.size()) {
         return Status::ERROR_INVALID_ARGUMENT;
     }
+    auto start = std::chrono::steady_clock::now();
+    // Categories may share tracing points; each one is written once.
+    std::set<std::string> paths;
     for (auto& c : categories) {
-        if (kTracingMap.count(c)) {
-            for (auto& p : kTracingMap.at(c).paths) {
-                if (!android::base::WriteStringToFile("1", p.first)) {
-                    LOG(ERROR) << "Failed to enable tracing on: " << p.first;
-                    if (p.second) {
-                        // disable before return
-                        disableAllCategories();
-                        return Status::ERROR_TRACING_POINT;
-                    }
-                }
-            }
-        } else {
+        auto it = kTracingMap.find(c);
+        if (it == kTracingMap.end()) {
             return Status::ERROR_INVALID_ARGUMENT;
         }
+        for (auto& p : it->second.paths) {
+            paths.insert(p.first);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!writeEnableFilesLocked(std::vector<std::string>(paths.begin(), paths.end()), true)) {
+        // disable before return
+        std::vector<std::string> all;
+        for (auto& file : mEnableFiles) {
+            all.push_back(file.first);
+        }
+        writeEnableFilesLocked(all, false);
+        return Status::ERROR_TRACING_POINT;
     }
+    mLastEnableDuration = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+    LOG(INFO) << "Tracing active " << mLastEnableDuration.count() << " us after enabling "
+              << categories.size() << " categories";
     return Status::SUCCESS;
 }
 
 Return<::android::hardware::atrace::V1_0::Status> AtraceDevice::disableAllCategories() {
-    auto ret = Status::SUCCESS;
-    for (auto& c : kTracingMap) {
-        for (auto& p : c.second.paths) {
-            if (!android::base::WriteStringToFile("0", p.first)) {
-                LOG(ERROR) << "Failed to enable tracing on: " << p.first;
-                if (p.second) {
-                    ret = Status::ERROR_TRACING_POINT;
-                }
+    std::lock_guard<std::mutex> lock(mLock);
+    std::vector<std::string> all;
+    for (auto& file : mEnableFiles) {
+        all.push_back(file.first);
+    }
+    return writeEnableFilesLocked(all, false) ? Status::SUCCESS : Status::ERROR_TRACING_POINT;
+}
+
+Return<void> AtraceDevice::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    std::string out = android::base::StringPrintf("last enable: %lld us\n",
+                                                  (long long)mLastEnableDuration.count());
+    for (auto& file : mEnableFiles) {
+        const char* state = file.second.state == EnableFile::State::ENABLED    ? "enabled"
+                            : file.second.state == EnableFile::State::DISABLED ? "disabled"
+                                                                               : "unknown";
+        out += android::base::StringPrintf("%s: %s\n", file.first.c_str(), state);
+    }
+    android::base::WriteStringToFd(out, fd->data[0]);
+    return Void();
+}
+
+std::chrono::microseconds AtraceDevice::lastEnableDuration() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mLastEnableDuration;
+}
+
+bool AtraceDevice::writeEnableFile(const std::string& path, EnableFile* file, bool enable) {
+    if (file->fd.get() < 0) {
+        // tracefs may not have been mounted yet when the service started, so the file is only
+        // opened on its first write.
+        file->fd.reset(TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CLOEXEC)));
+    }
+    if (file->fd.get() < 0 ||
+        TEMP_FAILURE_RETRY(pwrite(file->fd.get(), enable ? "1" : "0", 1, 0)) != 1) {
+        PLOG(ERROR) << "Failed to " << (enable ? "enable" : "disable")
+                    << " tracing on: " << path;
+        file->state = EnableFile::State::UNKNOWN;
+        return false;
+    }
+    file->state = enable ? EnableFile::State::ENABLED : EnableFile::State::DISABLED;
+    return true;
+}
+
+bool AtraceDevice::writeEnableFilesLocked(const std::vector<std::string>& paths, bool enable) {
+    auto wanted = enable ? EnableFile::State::ENABLED : EnableFile::State::DISABLED;
+    std::vector<std::pair<const std::string*, EnableFile*>> writes;
+    for (auto& path : paths) {
+        EnableFile& file = mEnableFiles[path];
+        if (file.state != wanted) {
+            writes.emplace_back(&path, &file);
+        }
+    }
+
+    // Each write goes to its own file, so the workers share nothing but the index.
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    auto work = [&] {
+        for (size_t i = next++; i < writes.size(); i = next++) {
+            if (!writeEnableFile(*writes[i].first, writes[i].second, enable) &&
+                writes[i].second->required) {
+                ok = false;
             }
         }
+    };
+    size_t threads = std::min(kMaxWriteThreads, writes.size());
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.push_back(std::async(std::launch::async, work));
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.get();
     }
-    return ret;
+    return ok;
 }
 
 }  // namespace implementation
@@ -17,6 +17,13 @@
 #ifndef ANDROID_HARDWARE_ATRACE_V1_0_ATRACEDEVICE_H
 #define ANDROID_HARDWARE_ATRACE_V1_0_ATRACEDEVICE_H
 
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
 #include <android/hardware/atrace/1.0/IAtraceDevice.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
@@ -29,6 +36,7 @@ namespace implementation {
 
 using ::android::sp;
 using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
@@ -36,6 +44,8 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 
 struct AtraceDevice : public IAtraceDevice {
+    AtraceDevice();
+
     // Methods from ::android::hardware::atrace::V1_0::IAtraceDevice follow.
     Return<void> listCategories(listCategories_cb _hidl_cb) override;
     Return<::android::hardware::atrace::V1_0::Status> enableCategories(
@@ -43,6 +53,30 @@ struct AtraceDevice : public IAtraceDevice {
     Return<::android::hardware::atrace::V1_0::Status> disableAllCategories() override;
 
     // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
+    // Time the last successful enableCategories took to make tracing active.
+    std::chrono::microseconds lastEnableDuration();
+
+  private:
+    // An enable file of a tracing point, kept open. state is what was last written to it, or
+    // UNKNOWN before the first write and after a failed one.
+    struct EnableFile {
+        enum class State { UNKNOWN, DISABLED, ENABLED };
+
+        android::base::unique_fd fd;
+        State state = State::UNKNOWN;
+        bool required = false;
+    };
+
+    // Writes the enable files that are not in the wanted state yet, concurrently. Returns false
+    // if a required one failed.
+    bool writeEnableFilesLocked(const std::vector<std::string>& paths, bool enable);
+    bool writeEnableFile(const std::string& path, EnableFile* file, bool enable);
+
+    std::mutex mLock;
+    std::map<std::string, EnableFile> mEnableFiles;
+    std::chrono::microseconds mLastEnableDuration{0};
 };
 
 }  // namespace implementation
@@ -227,10 +227,15 @@ void HidlUtils::audioPortConfigsFromHal(unsigned int numHalConfigs,
 std::unique_ptr<audio_port_config[]> HidlUtils::audioPortConfigsToHal(
     const hidl_vec<AudioPortConfig>& configs) {
     std::unique_ptr<audio_port_config[]> halConfigs(new audio_port_config[configs.size()]);
+    audioPortConfigsToHal(configs, halConfigs.get());
+    return halConfigs;
+}
+
+void HidlUtils::audioPortConfigsToHal(const hidl_vec<AudioPortConfig>& configs,
+                                      struct audio_port_config* halConfigs) {
     for (size_t i = 0; i < configs.size(); ++i) {
         audioPortConfigToHal(configs[i], &halConfigs[i]);
     }
-    return halConfigs;
 }
 
 void HidlUtils::audioPortFromHal(const struct audio_port& halPort, AudioPort* port) {
@@ -59,6 +59,9 @@ class HidlUtils {
                                         hidl_vec<AudioPortConfig>* configs);
     static std::unique_ptr<audio_port_config[]> audioPortConfigsToHal(
         const hidl_vec<AudioPortConfig>& configs);
+    // Converts into halConfigs, which must hold at least configs.size() elements.
+    static void audioPortConfigsToHal(const hidl_vec<AudioPortConfig>& configs,
+                                      struct audio_port_config* halConfigs);
     static void audioPortFromHal(const struct audio_port& halPort, AudioPort* port);
     static void audioPortToHal(const AudioPort& port, struct audio_port* halPort);
     static void uuidFromHal(const audio_uuid_t& halUuid, Uuid* uuid);
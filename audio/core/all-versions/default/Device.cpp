@@ -39,7 +39,36 @@ namespace implementation {
 
 using ::android::hardware::audio::common::CPP_VERSION::implementation::HidlUtils;
 
-Device::Device(audio_hw_device_t* device) : mDevice(device) {}
+namespace {
+
+// Legacy port configs of one side of a patch. Patches of up to AUDIO_PATCH_PORTS_MAX ports,
+// which is all the framework creates, are converted without allocating.
+class HalPortConfigs {
+   public:
+    explicit HalPortConfigs(const hidl_vec<AudioPortConfig>& configs) {
+        if (configs.size() > AUDIO_PATCH_PORTS_MAX) {
+            mHeapConfigs.reset(new audio_port_config[configs.size()]);
+            mConfigs = mHeapConfigs.get();
+        }
+        HidlUtils::audioPortConfigsToHal(configs, mConfigs);
+    }
+
+    audio_port_config* get() { return mConfigs; }
+
+   private:
+    audio_port_config mInlineConfigs[AUDIO_PATCH_PORTS_MAX];
+    std::unique_ptr<audio_port_config[]> mHeapConfigs;
+    audio_port_config* mConfigs = mInlineConfigs;
+};
+
+}  // namespace
+
+Device::Device(audio_hw_device_t* device) : mDevice(device) {
+    // Settings that only change when the framework sets them, but that it reads often
+    enableParamCache({AudioParameter::keyBtNrec, AUDIO_PARAMETER_KEY_BT_SCO_WB,
+                      AUDIO_PARAMETER_KEY_TTY_MODE, AUDIO_PARAMETER_KEY_HAC,
+                      AUDIO_PARAMETER_KEY_HFP_ENABLE});
+}
 
 Device::~Device() {
     int status = audio_hw_device_close(mDevice);
@@ -260,12 +289,13 @@ Return<void> Device::createAudioPatch(const hidl_vec<AudioPortConfig>& sources,
     Result retval(Result::NOT_SUPPORTED);
     AudioPatchHandle patch = 0;
     if (version() >= AUDIO_DEVICE_API_VERSION_3_0) {
-        std::unique_ptr<audio_port_config[]> halSources(HidlUtils::audioPortConfigsToHal(sources));
-        std::unique_ptr<audio_port_config[]> halSinks(HidlUtils::audioPortConfigsToHal(sinks));
+        HalPortConfigs halSources(sources);
+        HalPortConfigs halSinks(sinks);
         audio_patch_handle_t halPatch = AUDIO_PATCH_HANDLE_NONE;
-        retval = analyzeStatus("create_audio_patch",
-                               mDevice->create_audio_patch(mDevice, sources.size(), &halSources[0],
-                                                           sinks.size(), &halSinks[0], &halPatch));
+        retval = analyzeStatus(
+            "create_audio_patch",
+            mDevice->create_audio_patch(mDevice, sources.size(), halSources.get(), sinks.size(),
+                                        halSinks.get(), &halPatch));
         if (retval == Result::OK) {
             patch = static_cast<AudioPatchHandle>(halPatch);
         }
@@ -287,11 +317,32 @@ Return<void> Device::getAudioPort(const AudioPort& port, getAudioPort_cb _hidl_c
     audio_port halPort;
     HidlUtils::audioPortToHal(port, &halPort);
     Result retval = analyzeStatus("get_audio_port", mDevice->get_audio_port(mDevice, &halPort));
-    AudioPort resultPort = port;
-    if (retval == Result::OK) {
-        HidlUtils::audioPortFromHal(halPort, &resultPort);
+    if (retval != Result::OK) {
+        _hidl_cb(retval, port);
+        return Void();
+    }
+
+    std::shared_ptr<const CachedAudioPort> cached;
+    {
+        std::lock_guard<std::mutex> lock(mAudioPortCacheLock);
+        auto it = mAudioPortCache.find(halPort.id);
+        if (it != mAudioPortCache.end()) {
+            cached = it->second;
+        }
+    }
+    // audioPortToHal zeroes the whole struct, so equal ports compare equal bytewise.
+    if (cached == nullptr || memcmp(&cached->halPort, &halPort, sizeof(halPort)) != 0) {
+        auto entry = std::make_shared<CachedAudioPort>();
+        entry->halPort = halPort;
+        entry->port = port;
+        HidlUtils::audioPortFromHal(halPort, &entry->port);
+        // audioPortFromHal refers to the name in halPort, which is on the stack.
+        entry->port.name = halPort.name;
+        cached = std::move(entry);
+        std::lock_guard<std::mutex> lock(mAudioPortCacheLock);
+        mAudioPortCache[halPort.id] = cached;
     }
-    _hidl_cb(retval, resultPort);
+    _hidl_cb(retval, cached->port);
     return Void();
 }
 
@@ -30,6 +30,18 @@ namespace audio {
 namespace CPP_VERSION {
 namespace implementation {
 
+DevicesFactory::DevicesFactory() {
+    // Only the libraries are loaded, the devices are opened when the client asks for them.
+    // Modules missing on the device fail here silently, openDevice reports them.
+    for (const char* moduleName : {AUDIO_HARDWARE_MODULE_ID_PRIMARY, AUDIO_HARDWARE_MODULE_ID_A2DP,
+                                   AUDIO_HARDWARE_MODULE_ID_USB}) {
+        mModulePreloads.push_back(std::async(std::launch::async, [moduleName] {
+            const hw_module_t* mod;
+            (void)hw_get_module_by_class(AUDIO_HARDWARE_MODULE_ID, moduleName, &mod);
+        }));
+    }
+}
+
 #if MAJOR_VERSION == 2
 Return<void> DevicesFactory::openDevice(IDevicesFactory::Device device, openDevice_cb _hidl_cb) {
     switch (device) {
@@ -18,6 +18,8 @@
 #include "core/default/Conversions.h"
 #include "core/default/Util.h"
 
+#include <stdio.h>
+
 #include <system/audio.h>
 
 namespace android {
@@ -59,23 +61,46 @@ Result ParametersUtil::getParam(const char* name, bool* value) {
 }
 
 Result ParametersUtil::getParam(const char* name, int* value) {
-    const String8 halName(name);
-    AudioParameter keys;
-    keys.addKey(halName);
-    std::unique_ptr<AudioParameter> params = getParams(keys);
-    return getHalStatusToResult(params->getInt(halName, *value));
+    String8 halValue;
+    Result retval = getParam(name, &halValue);
+    *value = 0;
+    // Same conversion as AudioParameter::getInt
+    if (retval == Result::OK && sscanf(halValue.string(), "%d", value) != 1) {
+        return getHalStatusToResult(INVALID_OPERATION);
+    }
+    return retval;
 }
 
 Result ParametersUtil::getParam(const char* name, String8* value, AudioParameter context) {
     const String8 halName(name);
+    const bool cacheable = context.size() == 0;
+    CachedParam cached;
+    uint64_t generation = 0;
+    if (cacheable && getCachedParam(name, &cached, &generation)) {
+        *value = cached.value;
+        return getHalStatusToResult(cached.status);
+    }
     context.addKey(halName);
     std::unique_ptr<AudioParameter> params = getParams(context);
+    if (cacheable) {
+        updateCachedParams({name}, *params, generation);
+    }
     return getHalStatusToResult(params->get(halName, *value));
 }
 
 void ParametersUtil::getParametersImpl(
     const hidl_vec<ParameterValue>& context, const hidl_vec<hidl_string>& keys,
     std::function<void(Result retval, const hidl_vec<ParameterValue>& parameters)> cb) {
+    const bool cacheable = context.size() == 0 && keys.size() != 0;
+    uint64_t generation = 0;
+    if (cacheable) {
+        hidl_vec<ParameterValue> result;
+        if (getCachedParams(keys, &result, &generation)) {
+            cb(result.size() != 0 ? Result::OK : Result::NOT_SUPPORTED, result);
+            return;
+        }
+    }
+
     AudioParameter halKeys;
     for (auto& pair : context) {
         halKeys.add(String8(pair.key.c_str()), String8(pair.value.c_str()));
@@ -84,6 +109,10 @@ void ParametersUtil::getParametersImpl(
         halKeys.addKey(String8(keys[i].c_str()));
     }
     std::unique_ptr<AudioParameter> halValues = getParams(halKeys);
+    if (cacheable) {
+        updateCachedParams(std::set<std::string>(keys.begin(), keys.end()), *halValues,
+                           generation);
+    }
     Result retval =
         (keys.size() == 0 || halValues->size() != 0) ? Result::OK : Result::NOT_SUPPORTED;
     hidl_vec<ParameterValue> result;
@@ -157,9 +186,73 @@ Result ParametersUtil::setParam(const char* name, const DeviceAddress& address)
 
 Result ParametersUtil::setParams(const AudioParameter& param) {
     int halStatus = halSetParameters(param.toString().string());
+    // Even a failed set may have changed some of the values
+    invalidateCachedParams(param);
     return util::analyzeStatus(halStatus);
 }
 
+void ParametersUtil::enableParamCache(std::initializer_list<const char*> keys) {
+    mCacheableParams.insert(keys.begin(), keys.end());
+}
+
+bool ParametersUtil::getCachedParam(const std::string& key, CachedParam* param,
+                                    uint64_t* generation) {
+    if (mCacheableParams.count(key) == 0) return false;
+    std::lock_guard<std::mutex> lock(mParamCacheLock);
+    *generation = mParamCacheGeneration;
+    auto it = mParamCache.find(key);
+    if (it == mParamCache.end()) return false;
+    *param = it->second;
+    return true;
+}
+
+bool ParametersUtil::getCachedParams(const hidl_vec<hidl_string>& keys,
+                                     hidl_vec<ParameterValue>* values, uint64_t* generation) {
+    for (const auto& key : keys) {
+        if (mCacheableParams.count(key) == 0) return false;
+    }
+    std::lock_guard<std::mutex> lock(mParamCacheLock);
+    *generation = mParamCacheGeneration;
+    std::vector<const std::pair<const std::string, CachedParam>*> found;
+    for (const auto& key : keys) {
+        auto it = mParamCache.find(key);
+        if (it == mParamCache.end()) return false;
+        // Keys the HAL didn't return are left out of the reply, as they would be by the HAL
+        if (it->second.status == OK) found.push_back(&*it);
+    }
+    values->resize(found.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        (*values)[i].key = found[i]->first;
+        (*values)[i].value = found[i]->second.value.string();
+    }
+    return true;
+}
+
+void ParametersUtil::updateCachedParams(const std::set<std::string>& keys,
+                                        const AudioParameter& halValues, uint64_t generation) {
+    if (mCacheableParams.empty()) return;
+    std::lock_guard<std::mutex> lock(mParamCacheLock);
+    if (generation != mParamCacheGeneration) return;
+    for (const auto& key : keys) {
+        if (mCacheableParams.count(key) == 0) continue;
+        CachedParam param;
+        param.status = halValues.get(String8(key.c_str()), param.value);
+        mParamCache[key] = param;
+    }
+}
+
+void ParametersUtil::invalidateCachedParams(const AudioParameter& param) {
+    if (mCacheableParams.empty()) return;
+    std::lock_guard<std::mutex> lock(mParamCacheLock);
+    mParamCacheGeneration++;
+    String8 key;
+    for (size_t i = 0; i < param.size(); ++i) {
+        if (param.getAt(i, key) == OK) {
+            mParamCache.erase(key.string());
+        }
+    }
+}
+
 }  // namespace implementation
 }  // namespace CPP_VERSION
 }  // namespace audio
@@ -27,7 +27,9 @@
 #include <android/log.h>
 #include <hardware/audio.h>
 #include <utils/Trace.h>
+#include <chrono>
 #include <memory>
+#include <thread>
 #include <cmath>
 
 namespace android {
@@ -38,6 +40,11 @@ namespace implementation {
 
 namespace {
 
+// A READ is nearly always followed by a position query. Instead of going back to sleep on the
+// event flag right after replying, the thread polls the command queue that long for it, unless
+// the client has not been sending it right away, see util::FollowUpPollBackoff.
+constexpr auto kFollowUpCommandPollTime = std::chrono::microseconds(50);
+
 class ReadThread : public Thread {
    public:
     // ReadThread's lifespan never exceeds StreamIn's lifespan.
@@ -49,12 +56,8 @@ class ReadThread : public Thread {
           mCommandMQ(commandMQ),
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mEfGroup(efGroup) {}
+    bool init() { return mDataMQ->getQuantumCount() > 0; }
     virtual ~ReadThread() {}
 
    private:
@@ -64,14 +67,21 @@ class ReadThread : public Thread {
     StreamIn::DataMQ* mDataMQ;
     StreamIn::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
     IStreamIn::ReadParameters mParameters;
     IStreamIn::ReadStatus mStatus;
+    // Result of the capture position fetched after the last READ, valid until the next command.
+    Result mPrefetchedRetval;
+    IStreamIn::ReadStatus::Reply::CapturePosition mPrefetchedPosition;
+    bool mHasPrefetchedPosition = false;
+
+    util::FollowUpPollBackoff mPollBackoff;
 
     bool threadLoop() override;
+    bool pollForCommand();
 
     void doGetCapturePosition();
     void doRead();
+    void prefetchCapturePosition();
 };
 
 void ReadThread::doRead() {
@@ -84,35 +94,73 @@ void ReadThread::doRead() {
             (int32_t)requestedToRead, (int32_t)availableToWrite);
         requestedToRead = availableToWrite;
     }
-    ssize_t readResult = mStream->read(mStream, &mBuffer[0], requestedToRead);
     mStatus.retval = Result::OK;
-    if (readResult >= 0) {
-        mStatus.reply.read = readResult;
-        if (!mDataMQ->write(&mBuffer[0], readResult)) {
-            ALOGW("data message queue write failed");
+    mStatus.reply.read = 0;
+    StreamIn::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginWrite(requestedToRead, &tx)) {
+        ALOGW("data message queue write failed");
+        return;
+    }
+    // Read straight into the queue memory instead of copying it in afterwards. The space takes
+    // two regions if it wraps around the end of the queue.
+    const StreamIn::DataMQ::MemRegion regions[] = {tx.getFirstRegion(), tx.getSecondRegion()};
+    for (const auto& region : regions) {
+        if (region.getLength() == 0) continue;
+        ssize_t readResult = mStream->read(mStream, region.getAddress(), region.getLength());
+        if (readResult < 0) {
+            if (mStatus.reply.read == 0) {
+                mStatus.retval = Stream::analyzeStatus("read", readResult);
+            }
+            break;
         }
-    } else {
-        mStatus.retval = Stream::analyzeStatus("read", readResult);
+        mStatus.reply.read += readResult;
+        if (static_cast<size_t>(readResult) < region.getLength()) break;
+    }
+    if (mStatus.reply.read > 0 && !mDataMQ->commitWrite(mStatus.reply.read)) {
+        ALOGW("data message queue write failed");
     }
 }
 
 void ReadThread::doGetCapturePosition() {
+    if (mHasPrefetchedPosition) {
+        mStatus.retval = mPrefetchedRetval;
+        mStatus.reply.capturePosition = mPrefetchedPosition;
+        return;
+    }
     mStatus.retval = StreamIn::getCapturePositionImpl(
         mStream, &mStatus.reply.capturePosition.frames, &mStatus.reply.capturePosition.time);
 }
 
+// The legacy HAL advances the capture position as frames are read, so the position fetched right
+// after replying to a READ is still current when the query following it is picked up by the
+// poll. Fetching it while the client consumes the data takes the HAL call off the query's reply.
+void ReadThread::prefetchCapturePosition() {
+    mPrefetchedRetval = StreamIn::getCapturePositionImpl(mStream, &mPrefetchedPosition.frames,
+                                                         &mPrefetchedPosition.time);
+    mHasPrefetchedPosition = true;
+}
+
 bool ReadThread::threadLoop() {
     // This implementation doesn't return control back to the Thread until it
     // decides to stop,
     // as the Thread uses mutexes, and this can lead to priority inversion.
+    bool expectFollowUp = false;
     while (!std::atomic_load_explicit(mStop, std::memory_order_acquire)) {
-        uint32_t efState = 0;
-        mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
-        if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL))) {
-            continue;  // Nothing to do.
+        const bool poll = expectFollowUp && mPollBackoff.shouldPoll();
+        if (poll) {
+            prefetchCapturePosition();
         }
-        if (!mCommandMQ->read(&mParameters)) {
-            continue;  // Nothing to do.
+        if (!poll || !pollForCommand()) {
+            // A command the client had to wake the thread for may come much later.
+            mHasPrefetchedPosition = false;
+            uint32_t efState = 0;
+            mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL), &efState);
+            if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL))) {
+                continue;  // Nothing to do.
+            }
+            if (!mCommandMQ->read(&mParameters)) {
+                continue;  // Nothing to do.
+            }
         }
         mStatus.replyTo = mParameters.command;
         switch (mParameters.command) {
@@ -131,11 +179,27 @@ bool ReadThread::threadLoop() {
             ALOGW("status message queue write failed");
         }
         mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY));
+        expectFollowUp = mParameters.command == IStreamIn::ReadCommand::READ;
     }
 
     return false;
 }
 
+bool ReadThread::pollForCommand() {
+    // The client also wakes the event flag for this command. The bit stays set, so the next
+    // wait returns right away and finds the command queue empty, without a futex wait.
+    const auto deadline = std::chrono::steady_clock::now() + kFollowUpCommandPollTime;
+    do {
+        if (mCommandMQ->read(&mParameters)) {
+            mPollBackoff.onPollResult(true);
+            return true;
+        }
+        std::this_thread::yield();
+    } while (std::chrono::steady_clock::now() < deadline);
+    mPollBackoff.onPollResult(false);
+    return false;
+}
+
 }  // namespace
 
 StreamIn::StreamIn(const sp<Device>& device, audio_stream_in_t* stream)
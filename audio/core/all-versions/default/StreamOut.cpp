@@ -22,7 +22,9 @@
 //#define LOG_NDEBUG 0
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <chrono>
 #include <memory>
+#include <thread>
 
 #include <android/log.h>
 #include <hardware/audio.h>
@@ -36,12 +38,18 @@ namespace implementation {
 
 namespace {
 
+// A WRITE is nearly always followed by a position query. Instead of going back to sleep on the
+// event flag right after replying, the thread polls the command queue that long for it, unless
+// the client has not been sending it right away, see util::FollowUpPollBackoff.
+constexpr auto kFollowUpCommandPollTime = std::chrono::microseconds(50);
+
 class WriteThread : public Thread {
    public:
     // WriteThread's lifespan never exceeds StreamOut's lifespan.
     WriteThread(std::atomic<bool>* stop, audio_stream_out_t* stream,
                 StreamOut::CommandMQ* commandMQ, StreamOut::DataMQ* dataMQ,
-                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup)
+                StreamOut::StatusMQ* statusMQ, EventFlag* efGroup,
+                ::android::hardware::metrics::Registry* metrics)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mStream(stream),
@@ -49,11 +57,9 @@ class WriteThread : public Thread {
           mDataMQ(dataMQ),
           mStatusMQ(statusMQ),
           mEfGroup(efGroup),
-          mBuffer(nullptr) {}
-    bool init() {
-        mBuffer.reset(new (std::nothrow) uint8_t[mDataMQ->getQuantumCount()]);
-        return mBuffer != nullptr;
-    }
+          mWriteLatency(metrics->histogram("hal_write")),
+          mQueuedBytes(metrics->counter("data_queue_bytes")) {}
+    bool init() { return mDataMQ->getQuantumCount() > 0; }
     virtual ~WriteThread() {}
 
    private:
@@ -63,10 +69,14 @@ class WriteThread : public Thread {
     StreamOut::DataMQ* mDataMQ;
     StreamOut::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
-    std::unique_ptr<uint8_t[]> mBuffer;
+    ::android::hardware::metrics::Histogram* mWriteLatency;
+    ::android::hardware::metrics::Counter* mQueuedBytes;
     IStreamOut::WriteStatus mStatus;
 
+    util::FollowUpPollBackoff mPollBackoff;
+
     bool threadLoop() override;
+    bool pollForCommand();
 
     void doGetLatency();
     void doGetPresentationPosition();
@@ -75,16 +85,31 @@ class WriteThread : public Thread {
 
 void WriteThread::doWrite() {
     const size_t availToRead = mDataMQ->availableToRead();
+    mQueuedBytes->set(availToRead);
     mStatus.retval = Result::OK;
     mStatus.reply.written = 0;
-    if (mDataMQ->read(&mBuffer[0], availToRead)) {
-        ssize_t writeResult = mStream->write(mStream, &mBuffer[0], availToRead);
-        if (writeResult >= 0) {
-            mStatus.reply.written = writeResult;
-        } else {
-            mStatus.retval = Stream::analyzeStatus("write", writeResult);
+    StreamOut::DataMQ::MemTransaction tx;
+    if (!mDataMQ->beginRead(availToRead, &tx)) {
+        return;
+    }
+    // Write straight from the queue memory instead of copying it out first. The data takes
+    // two regions if it wraps around the end of the queue.
+    const StreamOut::DataMQ::MemRegion regions[] = {tx.getFirstRegion(), tx.getSecondRegion()};
+    ::android::hardware::metrics::ScopedTimer timer(mWriteLatency);
+    for (const auto& region : regions) {
+        if (region.getLength() == 0) continue;
+        ssize_t writeResult = mStream->write(mStream, region.getAddress(), region.getLength());
+        if (writeResult < 0) {
+            if (mStatus.reply.written == 0) {
+                mStatus.retval = Stream::analyzeStatus("write", writeResult);
+            }
+            break;
         }
+        mStatus.reply.written += writeResult;
+        if (static_cast<size_t>(writeResult) < region.getLength()) break;
     }
+    // Like a read into a buffer, this consumes all the data even if the HAL took less of it
+    mDataMQ->commitRead(availToRead);
 }
 
 void WriteThread::doGetPresentationPosition() {
@@ -102,14 +127,18 @@ bool WriteThread::threadLoop() {
     // This implementation doesn't return control back to the Thread until it
     // decides to stop,
     // as the Thread uses mutexes, and this can lead to priority inversion.
+    bool expectFollowUp = false;
     while (!std::atomic_load_explicit(mStop, std::memory_order_acquire)) {
-        uint32_t efState = 0;
-        mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY), &efState);
-        if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY))) {
-            continue;  // Nothing to do.
-        }
-        if (!mCommandMQ->read(&mStatus.replyTo)) {
-            continue;  // Nothing to do.
+        const bool poll = expectFollowUp && mPollBackoff.shouldPoll();
+        if (!poll || !pollForCommand()) {
+            uint32_t efState = 0;
+            mEfGroup->wait(static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY), &efState);
+            if (!(efState & static_cast<uint32_t>(MessageQueueFlagBits::NOT_EMPTY))) {
+                continue;  // Nothing to do.
+            }
+            if (!mCommandMQ->read(&mStatus.replyTo)) {
+                continue;  // Nothing to do.
+            }
         }
         switch (mStatus.replyTo) {
             case IStreamOut::WriteCommand::WRITE:
@@ -130,11 +159,27 @@ bool WriteThread::threadLoop() {
             ALOGE("status message queue write failed");
         }
         mEfGroup->wake(static_cast<uint32_t>(MessageQueueFlagBits::NOT_FULL));
+        expectFollowUp = mStatus.replyTo == IStreamOut::WriteCommand::WRITE;
     }
 
     return false;
 }
 
+bool WriteThread::pollForCommand() {
+    // The client also wakes the event flag for this command. The bit stays set, so the next
+    // wait returns right away and finds the command queue empty, without a futex wait.
+    const auto deadline = std::chrono::steady_clock::now() + kFollowUpCommandPollTime;
+    do {
+        if (mCommandMQ->read(&mStatus.replyTo)) {
+            mPollBackoff.onPollResult(true);
+            return true;
+        }
+        std::this_thread::yield();
+    } while (std::chrono::steady_clock::now() < deadline);
+    mPollBackoff.onPollResult(false);
+    return false;
+}
+
 }  // namespace
 
 StreamOut::StreamOut(const sp<Device>& device, audio_stream_out_t* stream)
@@ -372,7 +417,8 @@ Return<void> StreamOut::prepareForWriting(uint32_t frameSize, uint32_t framesCou
     // Create and launch the thread.
     auto tempWriteThread =
         std::make_unique<WriteThread>(&mStopWriteThread, mStream, tempCommandMQ.get(),
-                                      tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get());
+                                      tempDataMQ.get(), tempStatusMQ.get(), tempElfGroup.get(),
+                                      &mMetrics);
     if (!tempWriteThread->init()) {
         ALOGW("failed to start writer thread: %s", strerror(-status));
         sendError(Result::INVALID_ARGUMENTS);
@@ -542,7 +588,11 @@ Return<void> StreamOut::getMmapPosition(getMmapPosition_cb _hidl_cb) {
 }
 
 Return<void> StreamOut::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) {
-    return mStreamCommon->debug(fd, options);
+    mStreamCommon->debug(fd, options);
+    if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
+        mMetrics.dump(fd->data[0]);
+    }
+    return Void();
 }
 
 #if MAJOR_VERSION >= 4
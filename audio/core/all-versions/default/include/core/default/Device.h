@@ -22,6 +22,8 @@
 #include "ParametersUtil.h"
 
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include <hardware/audio.h>
 #include <media/AudioParameter.h>
@@ -125,7 +127,17 @@ struct Device : public IDevice, public ParametersUtil {
     audio_hw_device_t* device() const { return mDevice; }
 
    private:
+    // A port as last returned by get_audio_port, and its conversion.
+    struct CachedAudioPort {
+        audio_port halPort;
+        AudioPort port;
+    };
+
     audio_hw_device_t* mDevice;
+    // Ports rarely change, so getAudioPort hands out the conversion of the previous query of a
+    // port as long as the HAL returns the same port.
+    std::mutex mAudioPortCacheLock;
+    std::unordered_map<int32_t, std::shared_ptr<const CachedAudioPort>> mAudioPortCache;
 
     virtual ~Device();
 
@@ -24,6 +24,10 @@
 #include <hidl/Status.h>
 
 #include <hidl/MQDescriptor.h>
+
+#include <future>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace audio {
@@ -38,6 +42,8 @@ using ::android::hardware::Void;
 using namespace ::android::hardware::audio::CPP_VERSION;
 
 struct DevicesFactory : public IDevicesFactory {
+    DevicesFactory();
+
 #if MAJOR_VERSION == 2
     Return<void> openDevice(IDevicesFactory::Device device, openDevice_cb _hidl_cb) override;
 #elif MAJOR_VERSION >= 4
@@ -51,6 +57,10 @@ struct DevicesFactory : public IDevicesFactory {
     Return<void> openDevice(const char* moduleName, openDevice_cb _hidl_cb);
 
     static int loadAudioInterface(const char* if_name, audio_hw_device_t** dev);
+
+    // Loading of the usual modules, started in parallel at construction so that the first
+    // openDevice of each doesn't wait for its library to load
+    std::vector<std::future<void>> mModulePreloads;
 };
 
 extern "C" IDevicesFactory* HIDL_FETCH_IDevicesFactory(const char* name);
@@ -20,7 +20,12 @@
 #include PATH(android/hardware/audio/FILE_VERSION/types.h)
 
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 #include <media/AudioParameter.h>
@@ -57,8 +62,35 @@ class ParametersUtil {
    protected:
     virtual ~ParametersUtil() {}
 
+    /** Caches the values of these keys, as returned by the HAL, until they are set again.
+     * Only keys whose value the HAL doesn't change by itself may be cached.
+     * Values queried together with a context are never cached.
+     */
+    void enableParamCache(std::initializer_list<const char*> keys);
+
     virtual char* halGetParameters(const char* keys) = 0;
     virtual int halSetParameters(const char* keysAndValues) = 0;
+
+   private:
+    struct CachedParam {
+        status_t status;  // of AudioParameter::get on the HAL reply
+        String8 value;
+    };
+
+    bool getCachedParam(const std::string& key, CachedParam* param, uint64_t* generation);
+    // Returns false unless all keys are cached
+    bool getCachedParams(const hidl_vec<hidl_string>& keys, hidl_vec<ParameterValue>* values,
+                         uint64_t* generation);
+    void updateCachedParams(const std::set<std::string>& keys, const AudioParameter& halValues,
+                            uint64_t generation);
+    void invalidateCachedParams(const AudioParameter& param);
+
+    std::set<std::string> mCacheableParams;  // Set once at construction of the subclass
+    std::mutex mParamCacheLock;
+    // Guarded by mParamCacheLock. The generation changes with every set, so that a value read
+    // from the HAL before a set isn't cached after it.
+    std::map<std::string, CachedParam> mParamCache;
+    uint64_t mParamCacheGeneration = 0;
 };
 
 }  // namespace implementation
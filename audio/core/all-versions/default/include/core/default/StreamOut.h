@@ -27,6 +27,7 @@
 
 #include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
+#include <hal-metrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <utils/Thread.h>
@@ -138,6 +139,8 @@ struct StreamOut : public IStreamOut {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopWriteThread;
     sp<Thread> mWriteThread;
+    // Write path metrics, dumped by debug().
+    ::android::hardware::metrics::Registry mMetrics{"audio.out"};
 
     virtual ~StreamOut();
 
@@ -70,6 +70,39 @@ static inline Result analyzeStatus(const char* className, const char* funcName,
     return analyzeStatus(status);
 }
 
+/**
+ * Decides whether a stream thread polls its command queue for the command that usually
+ * follows a data transfer, instead of going back to sleep. Polling only pays off with clients
+ * that send it right away, so each poll that times out doubles the number of transfers after
+ * which the thread sleeps without polling, up to kMaxSkips. A poll that finds the command
+ * resets it.
+ */
+class FollowUpPollBackoff {
+   public:
+    static constexpr uint32_t kMaxSkips = 64;
+
+    bool shouldPoll() {
+        if (mSkipsLeft > 0) {
+            mSkipsLeft--;
+            return false;
+        }
+        return true;
+    }
+
+    void onPollResult(bool found) {
+        if (found) {
+            mSkips = 0;
+        } else {
+            mSkips = mSkips == 0 ? 1 : (mSkips * 2 > kMaxSkips ? kMaxSkips : mSkips * 2);
+            mSkipsLeft = mSkips;
+        }
+    }
+
+   private:
+    uint32_t mSkips = 0;
+    uint32_t mSkipsLeft = 0;
+};
+
 }  // namespace util
 }  // namespace implementation
 }  // namespace CPP_VERSION
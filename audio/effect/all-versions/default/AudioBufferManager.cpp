@@ -26,28 +26,48 @@ ANDROID_SINGLETON_STATIC_INSTANCE(AudioBufferManager);
 
 bool AudioBufferManager::wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper) {
     // Check if we have this buffer already
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(buffer.id);
-    if (idx >= 0) {
-        *wrapper = mBuffers[idx].promote();
-        if (*wrapper != nullptr) {
-            (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
-            return true;
-        }
-        mBuffers.removeItemsAt(idx);
+    Shard& shard = getShard(buffer.id);
+    *wrapper = findBuffer(shard, buffer.id);
+    if (*wrapper != nullptr) {
+        (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
+        return true;
     }
+
     // Need to create and init a new AudioBufferWrapper.
     sp<AudioBufferWrapper> tempBuffer(new AudioBufferWrapper(buffer));
     if (!tempBuffer->init()) return false;
+
+    std::lock_guard<std::mutex> lock(shard.lock);
+    // Another thread may have mapped the same buffer meanwhile
+    *wrapper = findBuffer(shard, buffer.id);
+    if (*wrapper != nullptr) {
+        (*wrapper)->getHalBuffer()->frameCount = buffer.frameCount;
+        return true;
+    }
+    auto buffers = std::make_shared<BufferMap>(*std::atomic_load(&shard.buffers));
+    (*buffers)[buffer.id] = tempBuffer;
+    std::atomic_store(&shard.buffers, std::shared_ptr<const BufferMap>(std::move(buffers)));
     *wrapper = tempBuffer;
-    mBuffers.add(buffer.id, *wrapper);
     return true;
 }
 
-void AudioBufferManager::removeEntry(uint64_t id) {
-    std::lock_guard<std::mutex> lock(mLock);
-    ssize_t idx = mBuffers.indexOfKey(id);
-    if (idx >= 0) mBuffers.removeItemsAt(idx);
+// static
+sp<AudioBufferWrapper> AudioBufferManager::findBuffer(const Shard& shard, uint64_t id) {
+    auto buffers = std::atomic_load(&shard.buffers);
+    auto it = buffers->find(id);
+    return it != buffers->end() ? it->second.promote() : nullptr;
+}
+
+void AudioBufferManager::removeEntry(uint64_t id, AudioBufferWrapper* wrapper) {
+    Shard& shard = getShard(id);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto buffers = std::atomic_load(&shard.buffers);
+    auto it = buffers->find(id);
+    // The entry may already refer to a new wrapper of the same buffer
+    if (it == buffers->end() || it->second.unsafe_get() != wrapper) return;
+    auto newBuffers = std::make_shared<BufferMap>(*buffers);
+    newBuffers->erase(id);
+    std::atomic_store(&shard.buffers, std::shared_ptr<const BufferMap>(std::move(newBuffers)));
 }
 
 namespace hardware {
@@ -60,7 +80,7 @@ AudioBufferWrapper::AudioBufferWrapper(const AudioBuffer& buffer)
     : mHidlBuffer(buffer), mHalBuffer{0, {nullptr}} {}
 
 AudioBufferWrapper::~AudioBufferWrapper() {
-    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id);
+    AudioBufferManager::getInstance().removeEntry(mHidlBuffer.id, this);
 }
 
 bool AudioBufferWrapper::init() {
@@ -19,11 +19,12 @@
 
 #include PATH(android/hardware/audio/effect/FILE_VERSION/types.h)
 
+#include <memory>
 #include <mutex>
+#include <unordered_map>
 
 #include <android/hidl/memory/1.0/IMemory.h>
 #include <system/audio_effect.h>
-#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 
@@ -65,6 +66,11 @@ using ::android::hardware::audio::effect::CPP_VERSION::implementation::AudioBuff
 namespace android {
 
 // This class needs to be in 'android' ns because Singleton macros require that.
+//
+// Buffers are kept in shards by id. Looking up a buffer that is already mapped doesn't take
+// any lock: each shard publishes an immutable map of its buffers, and only adding or removing
+// a buffer copies it. A buffer seen for the first time is mapped before the shard is locked,
+// so mapping doesn't hold up effects using other buffers.
 class AudioBufferManager : public Singleton<AudioBufferManager> {
    public:
     bool wrap(const AudioBuffer& buffer, sp<AudioBufferWrapper>* wrapper);
@@ -72,11 +78,24 @@ class AudioBufferManager : public Singleton<AudioBufferManager> {
    private:
     friend class hardware::audio::effect::CPP_VERSION::implementation::AudioBufferWrapper;
 
-    // Called by AudioBufferWrapper.
-    void removeEntry(uint64_t id);
+    static constexpr size_t kNumShards = 16;
 
-    std::mutex mLock;
-    KeyedVector<uint64_t, wp<AudioBufferWrapper>> mBuffers;
+    using BufferMap = std::unordered_map<uint64_t, wp<AudioBufferWrapper>>;
+
+    struct Shard {
+        std::mutex lock;  // Serializes updates of buffers
+        // Only accessed with std::atomic_load/std::atomic_store
+        std::shared_ptr<const BufferMap> buffers = std::make_shared<BufferMap>();
+    };
+
+    Shard& getShard(uint64_t id) { return mShards[id % kNumShards]; }
+    // Returns the live wrapper of the buffer with that id, or nullptr
+    static sp<AudioBufferWrapper> findBuffer(const Shard& shard, uint64_t id);
+
+    // Called by AudioBufferWrapper. Removes the entry of id if it still refers to wrapper.
+    void removeEntry(uint64_t id, AudioBufferWrapper* wrapper);
+
+    Shard mShards[kNumShards];
 };
 
 }  // namespace android
@@ -27,8 +27,13 @@
 
 #define ATRACE_TAG ATRACE_TAG_AUDIO
 
+#include <stdio.h>
+
+#include <string>
+
 #include <android/log.h>
 #include <media/EffectsFactoryApi.h>
+#include <utils/Timers.h>
 #include <utils/Trace.h>
 
 #include "VersionUtils.h"
@@ -44,12 +49,17 @@ using ::android::hardware::audio::common::CPP_VERSION::implementation::AudioChan
 
 namespace {
 
+// Each effect has its own ProcessThread. The client drives processing one effect at a time:
+// it raises REQUEST_PROCESS on the effect's event flag, waits for DONE_PROCESSING and reads
+// the result from that effect's status queue. Between two effects of a chain it may mix or
+// skip buffers, so one thread can't process several effects ahead of their requests without
+// a request for the whole chain in the IEffect interface.
 class ProcessThread : public Thread {
    public:
     // ProcessThread's lifespan never exceeds Effect's lifespan.
     ProcessThread(std::atomic<bool>* stop, effect_handle_t effect,
                   std::atomic<audio_buffer_t*>* inBuffer, std::atomic<audio_buffer_t*>* outBuffer,
-                  Effect::StatusMQ* statusMQ, EventFlag* efGroup)
+                  Effect::StatusMQ* statusMQ, EventFlag* efGroup, EffectProcessStats* stats)
         : Thread(false /*canCallJava*/),
           mStop(stop),
           mEffect(effect),
@@ -57,7 +67,15 @@ class ProcessThread : public Thread {
           mInBuffer(inBuffer),
           mOutBuffer(outBuffer),
           mStatusMQ(statusMQ),
-          mEfGroup(efGroup) {}
+          mEfGroup(efGroup),
+          mStats(stats) {
+        effect_descriptor_t halDescriptor;
+        if ((*mEffect)->get_descriptor(mEffect, &halDescriptor) == OK) {
+            mTraceCounterName = std::string("effect ") + halDescriptor.name + " process ns";
+        } else {
+            mTraceCounterName = "effect process ns";
+        }
+    }
     virtual ~ProcessThread() {}
 
    private:
@@ -68,6 +86,8 @@ class ProcessThread : public Thread {
     std::atomic<audio_buffer_t*>* mOutBuffer;
     Effect::StatusMQ* mStatusMQ;
     EventFlag* mEfGroup;
+    EffectProcessStats* mStats;
+    std::string mTraceCounterName;
 
     bool threadLoop() override;
 };
@@ -97,12 +117,16 @@ bool ProcessThread::threadLoop() {
             audio_buffer_t* outBuffer =
                 std::atomic_load_explicit(mOutBuffer, std::memory_order_relaxed);
             if (inBuffer != nullptr && outBuffer != nullptr) {
+                const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
                 if (efState & static_cast<uint32_t>(MessageQueueFlagBits::REQUEST_PROCESS)) {
                     processResult = (*mEffect)->process(mEffect, inBuffer, outBuffer);
                 } else {
                     processResult = (*mEffect)->process_reverse(mEffect, inBuffer, outBuffer);
                 }
                 std::atomic_thread_fence(std::memory_order_release);
+                const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+                mStats->record(duration, inBuffer->frameCount);
+                ATRACE_INT64(mTraceCounterName.c_str(), duration);
             } else {
                 ALOGE("processing buffers were not set before calling 'process'");
                 processResult = -ENODEV;
@@ -132,6 +156,14 @@ bool ProcessThread::threadLoop() {
 
 }  // namespace
 
+void EffectProcessStats::record(int64_t durationNs, size_t frameCount) {
+    processTime->record(std::chrono::nanoseconds(durationNs));
+    const uint32_t rate = sampleRateHz.load(std::memory_order_relaxed);
+    if (rate != 0 && durationNs > static_cast<int64_t>(frameCount * 1000000000ULL / rate)) {
+        deadlineMisses->increment();
+    }
+}
+
 // static
 const char* Effect::sContextResultOfCommand = "returned status";
 const char* Effect::sContextCallToCommand = "error";
@@ -372,7 +404,8 @@ Return<void> Effect::prepareForProcessing(prepareForProcessing_cb _hidl_cb) {
 
     // Create and launch the thread.
     mProcessThread = new ProcessThread(&mStopProcessThread, mHandle, &mHalInBufferPtr,
-                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup);
+                                       &mHalOutBufferPtr, tempStatusMQ.get(), mEfGroup,
+                                       &mProcessStats);
     status = mProcessThread->run("effect", PRIORITY_URGENT_AUDIO);
     if (status != OK) {
         ALOGW("failed to start effect processing thread: %s", strerror(-status));
@@ -471,8 +504,13 @@ Result Effect::setConfigImpl(int commandCode, const char* commandName, const Eff
     if (outputBufferProvider != 0) {
         LOG_FATAL("Using output buffer provider is not supported");
     }
-    return sendCommandReturningStatus(commandCode, commandName, sizeof(effect_config_t),
-                                      &halConfig);
+    Result retval = sendCommandReturningStatus(commandCode, commandName,
+                                               sizeof(effect_config_t), &halConfig);
+    if (retval == Result::OK && commandCode == EFFECT_CMD_SET_CONFIG) {
+        mProcessStats.sampleRateHz.store(config.inputCfg.samplingRateHz,
+                                         std::memory_order_relaxed);
+    }
+    return retval;
 }
 
 Result Effect::setParameterImpl(uint32_t paramSize, const void* paramData, uint32_t valueSize,
@@ -714,6 +752,7 @@ Return<void> Effect::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /
     if (fd.getNativeHandle() != nullptr && fd->numFds == 1) {
         uint32_t cmdData = fd->data[0];
         (void)sendCommand(EFFECT_CMD_DUMP, "DUMP", sizeof(cmdData), &cmdData);
+        mProcessStats.metrics.dump(fd->data[0]);
     }
     return Void();
 }
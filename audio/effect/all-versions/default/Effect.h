@@ -27,6 +27,7 @@
 
 #include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
+#include <hal-metrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <utils/Thread.h>
@@ -51,6 +52,24 @@ using ::android::hardware::audio::common::CPP_VERSION::implementation::AudioDevi
 using namespace ::android::hardware::audio::common::CPP_VERSION;
 using namespace ::android::hardware::audio::effect::CPP_VERSION;
 
+/**
+ * Timing of the process() and process_reverse() calls of an effect. Recorded by its processing
+ * thread, dumped by Effect::debug.
+ */
+struct EffectProcessStats {
+    EffectProcessStats()
+        : processTime(metrics.histogram("process")),
+          deadlineMisses(metrics.counter("process_deadline_misses")) {}
+
+    std::atomic<uint32_t> sampleRateHz{0};  // of the input, set by setConfig
+    ::android::hardware::metrics::Registry metrics{"audio.effect"};
+    ::android::hardware::metrics::Histogram* const processTime;
+    // Calls longer than the buffer duration
+    ::android::hardware::metrics::Counter* const deadlineMisses;
+
+    void record(int64_t durationNs, size_t frameCount);
+};
+
 struct Effect : public IEffect {
     typedef MessageQueue<Result, kSynchronizedReadWrite> StatusMQ;
     using GetParameterSuccessCallback =
@@ -180,6 +199,7 @@ struct Effect : public IEffect {
     EventFlag* mEfGroup;
     std::atomic<bool> mStopProcessThread;
     sp<Thread> mProcessThread;
+    EffectProcessStats mProcessStats;
 
     virtual ~Effect();
 
@@ -85,8 +85,11 @@ sp<IEffect> EffectsFactory::dispatchEffectInstanceCreation(const effect_descript
     return new Effect(handle);
 }
 
-// Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
-Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb) {
+EffectsFactory::EffectsFactory()
+    : mDescriptorsQuery(std::async(std::launch::async, &EffectsFactory::queryAllDescriptors)) {}
+
+// static
+std::shared_ptr<const EffectsFactory::DescriptorTable> EffectsFactory::queryAllDescriptors() {
     Result retval(Result::OK);
     hidl_vec<EffectDescriptor> result;
     uint32_t numEffects;
@@ -129,7 +132,25 @@ restart:
     }
 
 exit:
-    _hidl_cb(retval, result);
+    return std::make_shared<const DescriptorTable>(DescriptorTable{retval, std::move(result)});
+}
+
+std::shared_ptr<const EffectsFactory::DescriptorTable> EffectsFactory::getDescriptorTable() {
+    std::lock_guard<std::mutex> lock(mDescriptorsLock);
+    if (mDescriptorsQuery.valid()) {
+        mDescriptors = mDescriptorsQuery.get();
+    }
+    if (mDescriptors == nullptr || mDescriptors->retval != Result::OK) {
+        // Failures aren't kept, the libraries may not have been ready yet
+        mDescriptors = queryAllDescriptors();
+    }
+    return mDescriptors;
+}
+
+// Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
+Return<void> EffectsFactory::getAllDescriptors(getAllDescriptors_cb _hidl_cb) {
+    std::shared_ptr<const DescriptorTable> table = getDescriptorTable();
+    _hidl_cb(table->retval, table->descriptors);
     return Void();
 }
 
@@ -28,6 +28,10 @@
 
 #include <hidl/Status.h>
 
+#include <future>
+#include <memory>
+#include <mutex>
+
 #include <hidl/MQDescriptor.h>
 namespace android {
 namespace hardware {
@@ -45,6 +49,8 @@ using namespace ::android::hardware::audio::common::CPP_VERSION;
 using namespace ::android::hardware::audio::effect::CPP_VERSION;
 
 struct EffectsFactory : public IEffectsFactory {
+    EffectsFactory();
+
     // Methods from ::android::hardware::audio::effect::CPP_VERSION::IEffectsFactory follow.
     Return<void> getAllDescriptors(getAllDescriptors_cb _hidl_cb) override;
     Return<void> getDescriptor(const Uuid& uid, getDescriptor_cb _hidl_cb) override;
@@ -55,8 +61,24 @@ struct EffectsFactory : public IEffectsFactory {
     Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
    private:
+    struct DescriptorTable {
+        Result retval;
+        hidl_vec<EffectDescriptor> descriptors;
+    };
+
     static sp<IEffect> dispatchEffectInstanceCreation(const effect_descriptor_t& halDescriptor,
                                                       effect_handle_t handle);
+    // Loads the effect libraries if needed, and queries the descriptors of all effects
+    static std::shared_ptr<const DescriptorTable> queryAllDescriptors();
+    std::shared_ptr<const DescriptorTable> getDescriptorTable();
+
+    std::mutex mDescriptorsLock;
+    // The libraries are loaded and queried in the background from the construction of the
+    // factory, the first call to getDescriptorTable() waits for it
+    std::future<std::shared_ptr<const DescriptorTable>> mDescriptorsQuery;
+    // Guarded by mDescriptorsLock. The effect list of the libraries doesn't change once they
+    // are loaded, so a successful query is kept.
+    std::shared_ptr<const DescriptorTable> mDescriptors;
 };
 
 extern "C" IEffectsFactory* HIDL_FETCH_IEffectsFactory(const char* name);
@@ -32,17 +32,42 @@ static const unsigned sContextCount = sContextMapSize - 1;  // Less one for the
 static const unsigned sContextNumberMax = sContextCount;    // contextNumber is counted from 1
 
 
-AudioControl::AudioControl() {
+static std::shared_ptr<const ContextBusSnapshot> loadContextBuses() {
+    auto snapshot = std::make_shared<ContextBusSnapshot>();
+    snapshot->version = 1;
+    snapshot->buses.setToExternal(sContextToBusMap, sContextMapSize);
+    return snapshot;
+}
+
+
+AudioControl::AudioControl()
+    : mContextBuses(loadContextBuses()),
+      mApplyThread(&AudioControl::applyLoop, this) {
 };
 
 
+AudioControl::~AudioControl() {
+    {
+        std::lock_guard<std::mutex> lock(mGainLock);
+        mExiting = true;
+    }
+    mGainCond.notify_one();
+    mApplyThread.join();
+}
+
+
+std::shared_ptr<const ContextBusSnapshot> AudioControl::getContextBusSnapshot() const {
+    return mContextBuses;
+}
+
+
 Return<int32_t> AudioControl::getBusForContext(ContextNumber ctxt) {
     unsigned contextNumber = static_cast<unsigned>(ctxt);
     if (contextNumber > sContextNumberMax) {
         ALOGE("Unexpected context number %d (max expected is %d)", contextNumber, sContextCount);
         return -1;
     } else {
-        return sContextToBusMap[contextNumber];
+        return mContextBuses->buses[contextNumber];
     }
 }
 
@@ -52,8 +77,8 @@ Return<void> AudioControl::setBalanceTowardRight(float value) {
     if ((value > 1.0f) || (value < -1.0f)) {
         ALOGE("Balance value out of range -1 to 1 at %0.2f", value);
     } else {
-        // Just log in this default mock implementation
-        ALOGI("Balance set to %0.2f", value);
+        std::lock_guard<std::mutex> lock(mGainLock);
+        queueLocked(&mBalance, value);
     }
     return Void();
 }
@@ -64,12 +89,57 @@ Return<void> AudioControl::setFadeTowardFront(float value) {
     if ((value > 1.0f) || (value < -1.0f)) {
         ALOGE("Fader value out of range -1 to 1 at %0.2f", value);
     } else {
-        // Just log in this default mock implementation
-        ALOGI("Fader set to %0.2f", value);
+        std::lock_guard<std::mutex> lock(mGainLock);
+        queueLocked(&mFade, value);
     }
     return Void();
 }
 
+
+void AudioControl::setBalanceAndFade(float balance, float fade) {
+    if ((balance > 1.0f) || (balance < -1.0f) || (fade > 1.0f) || (fade < -1.0f)) {
+        ALOGE("Balance %0.2f or fader %0.2f value out of range -1 to 1", balance, fade);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mGainLock);
+    queueLocked(&mBalance, balance);
+    queueLocked(&mFade, fade);
+}
+
+
+void AudioControl::queueLocked(Gain* gain, float value) {
+    // Replaces any value pending from earlier in the period.
+    gain->pending = true;
+    gain->value = value;
+    mGainCond.notify_one();
+}
+
+
+void AudioControl::applyLoop() {
+    std::unique_lock<std::mutex> lock(mGainLock);
+    while (!mExiting) {
+        if (!mBalance.pending && !mFade.pending) {
+            mGainCond.wait(lock);
+            continue;
+        }
+        auto deadline = mLastApply + kGainUpdatePeriod;
+        if (std::chrono::steady_clock::now() < deadline) {
+            mGainCond.wait_until(lock, deadline);
+            continue;
+        }
+        // Just log in this default mock implementation
+        if (mBalance.pending) {
+            ALOGI("Balance set to %0.2f", mBalance.value);
+            mBalance.pending = false;
+        }
+        if (mFade.pending) {
+            ALOGI("Fader set to %0.2f", mFade.value);
+            mFade.pending = false;
+        }
+        mLastApply = std::chrono::steady_clock::now();
+    }
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace audiocontrol
@@ -1,6 +1,12 @@
 #ifndef ANDROID_HARDWARE_AUTOMOTIVE_AUDIOCONTROL_V1_0_AUDIOCONTROL_H
 #define ANDROID_HARDWARE_AUTOMOTIVE_AUDIOCONTROL_V1_0_AUDIOCONTROL_H
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <android/hardware/automotive/audiocontrol/1.0/IAudioControl.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
@@ -20,6 +26,13 @@ using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::sp;
 
+// The buses of all contexts, indexed by ContextNumber, with -1 for INVALID. A snapshot never
+// changes; a reloaded table comes as a new snapshot with a higher version.
+struct ContextBusSnapshot {
+    uint32_t version;
+    hidl_vec<int32_t> buses;
+};
+
 struct AudioControl : public IAudioControl {
 public:
     // Methods from ::android::hardware::automotive::audiocontrol::V1_0::IAudioControl follow.
@@ -27,8 +40,36 @@ public:
     Return<void> setBalanceTowardRight(float value) override;
     Return<void> setFadeTowardFront(float value) override;
 
+    // Not part of the HIDL interface: the whole context to bus table in one call.
+    std::shared_ptr<const ContextBusSnapshot> getContextBusSnapshot() const;
+    // Not part of the HIDL interface: sets both balance and fade in one update.
+    void setBalanceAndFade(float balance, float fade);
+
     // Implementation details
     AudioControl();
+    ~AudioControl();
+
+private:
+    // Slider updates are applied at most once per period, with the last value of the period.
+    static constexpr std::chrono::milliseconds kGainUpdatePeriod{10};
+
+    struct Gain {
+        bool pending = false;
+        float value = 0.0f;
+    };
+
+    void queueLocked(Gain* gain, float value);
+    void applyLoop();
+
+    const std::shared_ptr<const ContextBusSnapshot> mContextBuses;
+
+    std::mutex mGainLock;
+    std::condition_variable mGainCond;
+    Gain mBalance;
+    Gain mFade;
+    std::chrono::steady_clock::time_point mLastApply;
+    bool mExiting = false;
+    std::thread mApplyThread;
 };
 
 }  // namespace implementation
@@ -19,6 +19,7 @@
 #include "EvsCamera.h"
 #include "EvsEnumerator.h"
 
+#include <cutils/properties.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
@@ -35,15 +36,23 @@ namespace implementation {
 const char EvsCamera::kCameraName_Backup[]    = "backup";
 
 
-// Arbitrary limit on number of graphics buffers allowed to be allocated
-// Safeguards against unreasonable resource consumption and provides a testable limit
-const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
+// Number of buffers used by a stream if the client never calls setMaxFramesInFlight
+const char kDefaultFramesInFlightProperty[] = "vendor.evs.camera.frames_in_flight";
+
+// We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
+const int kTargetFrameRate = 12;
+const nsecs_t kTargetFrameTimeUs = 1000*1000 / kTargetFrameRate;
+
+// Marks the first row pixels 2 and 3 as the SYSTEM_TIME_MONOTONIC fill time (low word first)
+// so clients can measure capture to display latency
+const uint32_t kTimestampMagic = 0x54535645;   // "EVST"
 
 
 EvsCamera::EvsCamera(const char *id) :
         mFramesAllowed(0),
         mFramesInUse(0),
-        mStreamState(STOPPED) {
+        mStreamState(STOPPED),
+        mWaitingForFrameReturn(false) {
 
     ALOGD("EvsCamera instantiated");
 
@@ -60,8 +69,10 @@ EvsCamera::EvsCamera(const char *id) :
     }
 
     mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+    // Every frame is written by the CPU through a mapping held for the buffer lifetime, so
+    // ask for write-often buffers (which gralloc keeps coherent without lock/unlock)
     mUsage  = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_CAMERA_WRITE |
-              GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY;
+              GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_OFTEN;
 }
 
 
@@ -86,17 +97,23 @@ void EvsCamera::forceShutdown()
     std::lock_guard <std::mutex> lock(mAccessLock);
 
     // Drop all the graphics buffers we've been using
-    if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
-                ALOGE("Error - releasing buffer despite remote ownership");
-            }
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+    for (auto&& rec : mBuffers) {
+        BufferState state = rec.state.exchange(EMPTY);
+        if (state == EMPTY) {
+            continue;
+        }
+        if (state == IN_USE) {
+            ALOGE("Error - releasing buffer despite remote ownership");
         }
-        mBuffers.clear();
+        mapper.unlock(rec.handle);
+        alloc.free(rec.handle);
+        rec.handle = nullptr;
+        rec.pixels = nullptr;
     }
+    mFramesAllowed = 0;
+    mFramesInUse = 0;
 
     // Put this object into an unrecoverable error state since somebody else
     // is going to own the underlying camera now
@@ -153,9 +170,14 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
         return EvsResult::STREAM_ALREADY_RUNNING;
     }
 
-    // If the client never indicated otherwise, configure ourselves for a single streaming buffer
+    // If the client never indicated otherwise, configure ourselves for the default number of
+    // streaming buffers
     if (mFramesAllowed < 1) {
-        if (!setAvailableFrames_Locked(1)) {
+        int32_t defaultFrames = property_get_int32(kDefaultFramesInFlightProperty, 1);
+        if (defaultFrames < 1) {
+            defaultFrames = 1;
+        }
+        if (!setAvailableFrames_Locked(defaultFrames)) {
             ALOGE("Failed to start stream because we couldn't get a graphics buffer");
             return EvsResult::BUFFER_NOT_AVAILABLE;
         }
@@ -174,33 +196,24 @@ Return<EvsResult> EvsCamera::startVideoStream(const ::android::sp<IEvsCameraStre
 
 Return<void> EvsCamera::doneWithFrame(const BufferDesc& buffer)  {
     ALOGD("doneWithFrame");
-    {  // lock context
-        std::lock_guard <std::mutex> lock(mAccessLock);
-
-        if (buffer.memHandle == nullptr) {
-            ALOGE("ignoring doneWithFrame called with null handle");
-        } else if (buffer.bufferId >= mBuffers.size()) {
-            ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
-                  buffer.bufferId, mBuffers.size()-1);
-        } else if (!mBuffers[buffer.bufferId].inUse) {
+    if (buffer.memHandle == nullptr) {
+        ALOGE("ignoring doneWithFrame called with null handle");
+    } else if (buffer.bufferId >= MAX_BUFFERS_IN_FLIGHT) {
+        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %u)",
+              buffer.bufferId, MAX_BUFFERS_IN_FLIGHT - 1);
+    } else {
+        // Mark the frame as available
+        BufferState expected = IN_USE;
+        if (!mBuffers[buffer.bufferId].state.compare_exchange_strong(expected, FREE)) {
             ALOGE("ignoring doneWithFrame called on frame %d which is already free",
                   buffer.bufferId);
         } else {
-            // Mark the frame as available
-            mBuffers[buffer.bufferId].inUse = false;
             mFramesInUse--;
 
-            // If this frame's index is high in the array, try to move it down
-            // to improve locality after mFramesAllowed has been reduced.
-            if (buffer.bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[buffer.bufferId].handle;
-                        mBuffers[buffer.bufferId].handle = nullptr;
-                        break;
-                    }
-                }
+            // Wake up the capture thread if it is waiting for a buffer
+            if (mWaitingForFrameReturn) {
+                std::lock_guard<std::mutex> lock(mFrameReturnLock);
+                mFrameReturnSignal.notify_one();
             }
         }
     }
@@ -216,6 +229,10 @@ Return<void> EvsCamera::stopVideoStream()  {
     if (mStreamState == RUNNING) {
         // Tell the GenerateFrames loop we want it to stop
         mStreamState = STOPPING;
+        {
+            std::lock_guard<std::mutex> returnLock(mFrameReturnLock);
+            mFrameReturnSignal.notify_one();
+        }
 
         // Block outside the mutex until the "stop" flag has been acknowledged
         // We won't send any more frames, but the client might still get some already in flight
@@ -306,10 +323,21 @@ bool EvsCamera::setAvailableFrames_Locked(unsigned bufferCount) {
 unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
     // Acquire the graphics buffer allocator
     GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+    GraphicBufferMapper &mapper(GraphicBufferMapper::get());
 
     unsigned added = 0;
+    unsigned slot = 0;
 
     while (added < numToAdd) {
+        // Find a place to store the new buffer
+        while (slot < MAX_BUFFERS_IN_FLIGHT && mBuffers[slot].state != EMPTY) {
+            slot++;
+        }
+        if (slot >= MAX_BUFFERS_IN_FLIGHT) {
+            ALOGE("No free slot left for a new graphics buffer");
+            break;
+        }
+
         buffer_handle_t memHandle = nullptr;
         status_t result = alloc.allocate(mWidth, mHeight, mFormat, 1, mUsage,
                                          &memHandle, &mStride, 0, "EvsCamera");
@@ -322,22 +350,23 @@ unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
             break;
         }
 
-        // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
+        // Map the buffer once here rather than for every frame we write to it
+        uint32_t *pixels = nullptr;
+        mapper.lock(memHandle,
+                    GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                    android::Rect(mWidth, mHeight),
+                    (void **) &pixels);
+        if (!pixels) {
+            ALOGE("Camera failed to gain access to image buffer for writing");
+            alloc.free(memHandle);
+            break;
         }
 
+        // Publish the buffer to the capture thread
+        mBuffers[slot].handle = memHandle;
+        mBuffers[slot].pixels = pixels;
+        mBuffers[slot].state = FREE;
+
         mFramesAllowed++;
         added++;
     }
@@ -349,15 +378,20 @@ unsigned EvsCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
 unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
     // Acquire the graphics buffer allocator
     GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
+    GraphicBufferMapper &mapper(GraphicBufferMapper::get());
 
     unsigned removed = 0;
 
     for (auto&& rec : mBuffers) {
         // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
+        // The capture thread may be claiming it at the same time.
+        BufferState expected = FREE;
+        if (rec.state.compare_exchange_strong(expected, EMPTY)) {
             // Release buffer and update the record so we can recognize it as "empty"
+            mapper.unlock(rec.handle);
             alloc.free(rec.handle);
             rec.handle = nullptr;
+            rec.pixels = nullptr;
 
             mFramesAllowed--;
             removed++;
@@ -377,45 +411,58 @@ unsigned EvsCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 void EvsCamera::generateFrames() {
     ALOGD("Frame generation loop started");
 
-    unsigned idx;
+    unsigned idx = 0;
 
     while (true) {
         bool timeForFrame = false;
+        bool waitedForFrame = false;
         nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
-        // Lock scope for updating shared state
-        {
-            std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mStreamState != RUNNING) {
+            // Break out of our main thread loop
+            break;
+        }
 
+        // Are we allowed to issue another buffer?
+        if (mFramesInUse >= mFramesAllowed) {
+            // Apply backpressure: rather than dropping this frame right away, give the client
+            // up to a frame time to return one of the buffers it holds.
+            std::unique_lock<std::mutex> lock(mFrameReturnLock);
+            mWaitingForFrameReturn = true;
+            mFrameReturnSignal.wait_for(lock, std::chrono::microseconds(kTargetFrameTimeUs),
+                    [this]() {
+                        return mFramesInUse < mFramesAllowed || mStreamState != RUNNING;
+                    });
+            mWaitingForFrameReturn = false;
+            waitedForFrame = true;
             if (mStreamState != RUNNING) {
-                // Break out of our main thread loop
                 break;
             }
+        }
 
-            // Are we allowed to issue another buffer?
-            if (mFramesInUse >= mFramesAllowed) {
-                // Can't do anything right now -- skip this frame
-                ALOGW("Skipped a frame because too many are in flight\n");
-            } else {
-                // Identify an available buffer to fill
-                for (idx = 0; idx < mBuffers.size(); idx++) {
-                    if (!mBuffers[idx].inUse) {
-                        if (mBuffers[idx].handle != nullptr) {
-                            // Found an available record, so stop looking
-                            break;
-                        }
-                    }
-                }
-                if (idx >= mBuffers.size()) {
-                    // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                    ALOGE("Failed to find an available buffer slot\n");
-                } else {
-                    // We're going to make the frame busy
-                    mBuffers[idx].inUse = true;
-                    mFramesInUse++;
+        if (mFramesInUse >= mFramesAllowed) {
+            // Can't do anything right now -- skip this frame
+            if (mFramesSkipped++ % kTargetFrameRate == 0) {
+                ALOGW("Skipped %u frames because too many are in flight", mFramesSkipped);
+            }
+        } else {
+            // Claim the next available buffer of the ring
+            for (unsigned i = 0; i < MAX_BUFFERS_IN_FLIGHT; i++) {
+                idx = (mNextBuffer + i) % MAX_BUFFERS_IN_FLIGHT;
+                BufferState expected = FREE;
+                if (mBuffers[idx].state.compare_exchange_strong(expected, IN_USE)) {
                     timeForFrame = true;
+                    break;
                 }
             }
+            if (!timeForFrame) {
+                // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
+                ALOGE("Failed to find an available buffer slot\n");
+            } else {
+                // We're going to make the frame busy
+                mFramesInUse++;
+                mNextBuffer = (idx + 1) % MAX_BUFFERS_IN_FLIGHT;
+            }
         }
 
         if (timeForFrame) {
@@ -429,8 +476,8 @@ void EvsCamera::generateFrames() {
             buff.bufferId   = idx;
             buff.memHandle  = mBuffers[idx].handle;
 
-            // Write test data into the image buffer
-            fillTestFrame(buff);
+            // Write test data straight into the mapped image buffer
+            fillTestFrame(buff, mBuffers[idx].pixels);
 
             // Issue the (asynchronous) callback to the client -- can't be holding the lock
             auto result = mStream->deliverFrame(buff);
@@ -444,17 +491,17 @@ void EvsCamera::generateFrames() {
                 ALOGE("Frame delivery call failed in the transport layer.");
 
                 // Since we didn't actually deliver it, mark the frame as available
-                std::lock_guard<std::mutex> lock(mAccessLock);
-                mBuffers[idx].inUse = false;
+                mBuffers[idx].state = FREE;
                 mFramesInUse--;
 
                 break;
             }
         }
 
-        // We arbitrarily choose to generate frames at 12 fps to ensure we pass the 10fps test requirement
-        static const int kTargetFrameRate = 12;
-        static const nsecs_t kTargetFrameTimeUs = 1000*1000 / kTargetFrameRate;
+        // A frame time has already passed if we waited for a buffer
+        if (waitedForFrame) {
+            continue;
+        }
         const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
         const nsecs_t workTimeUs = (now - startTime) / 1000;
         const nsecs_t sleepDurationUs = kTargetFrameTimeUs - workTimeUs;
@@ -474,19 +521,8 @@ void EvsCamera::generateFrames() {
 }
 
 
-void EvsCamera::fillTestFrame(const BufferDesc& buff) {
-    // Lock our output buffer for writing
-    uint32_t *pixels = nullptr;
-    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-    mapper.lock(buff.memHandle,
-                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                android::Rect(buff.width, buff.height),
-                (void **) &pixels);
-
-    // If we failed to lock the pixel buffer, we're about to crash, but log it first
-    if (!pixels) {
-        ALOGE("Camera failed to gain access to image buffer for writing");
-    }
+void EvsCamera::fillTestFrame(const BufferDesc& buff, uint32_t* pixels) {
+    uint32_t* firstRow = pixels;
 
     // Fill in the test pixels
     for (unsigned row = 0; row < buff.height; row++) {
@@ -512,8 +548,13 @@ void EvsCamera::fillTestFrame(const BufferDesc& buff) {
         pixels = pixels + buff.stride;
     }
 
-    // Release our output buffer
-    mapper.unlock(buff.memHandle);
+    // Embed the capture time right after the frame signature
+    if (buff.width >= 4) {
+        const uint64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        firstRow[1] = kTimestampMagic;
+        firstRow[2] = static_cast<uint32_t>(now);
+        firstRow[3] = static_cast<uint32_t>(now >> 32);
+    }
 }
 
 
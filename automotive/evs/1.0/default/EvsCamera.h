@@ -21,6 +21,9 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 
@@ -63,7 +66,7 @@ private:
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
 
     void generateFrames();
-    void fillTestFrame(const BufferDesc& buff);
+    void fillTestFrame(const BufferDesc& buff, uint32_t* pixels);
 
     sp<EvsEnumerator> mEnumerator;  // The enumerator object that created this camera
 
@@ -79,16 +82,30 @@ private:
 
     sp <IEvsCameraStream> mStream = nullptr;  // The callback used to deliver each frame
 
+    // Arbitrary limit on number of graphics buffers allowed to be allocated
+    // Safeguards against unreasonable resource consumption and provides a testable limit
+    static const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
+
+    // Slots are only filled and emptied under mAccessLock. Handing a FREE buffer to the
+    // client and taking it back are done with atomic state changes, so the capture thread
+    // and doneWithFrame() never need the lock.
+    enum BufferState {
+        EMPTY,      // no buffer allocated
+        FREE,       // buffer allocated and available for the next frame
+        IN_USE,     // buffer being filled or held by the client
+    };
     struct BufferRecord {
-        buffer_handle_t handle;
-        bool inUse;
-
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+        buffer_handle_t handle = nullptr;
+        uint32_t* pixels = nullptr;    // CPU mapping, kept while the buffer is allocated
+        std::atomic<BufferState> state {EMPTY};
     };
 
-    std::vector <BufferRecord> mBuffers;           // Graphics buffers to transfer images
-    unsigned mFramesAllowed;     // How many buffers are we currently using
-    unsigned mFramesInUse;       // How many buffers are currently outstanding
+    // Fixed size so records never move while other threads use them
+    BufferRecord mBuffers[MAX_BUFFERS_IN_FLIGHT];   // Graphics buffers to transfer images
+    std::atomic<unsigned> mFramesAllowed;     // How many buffers are we currently using
+    std::atomic<unsigned> mFramesInUse;       // How many buffers are currently outstanding
+    unsigned mNextBuffer = 0;       // Where the capture thread starts looking for a FREE buffer
+    unsigned mFramesSkipped = 0;    // Frames not generated because the client held all buffers
 
     enum StreamStateValues {
         STOPPED,
@@ -96,7 +113,13 @@ private:
         STOPPING,
         DEAD,
     };
-    StreamStateValues mStreamState;
+    std::atomic<StreamStateValues> mStreamState;
+
+    // Lets the capture thread wait for a frame to be returned when the client holds all of
+    // them. doneWithFrame() only takes mFrameReturnLock while the capture thread is waiting.
+    std::mutex mFrameReturnLock;
+    std::condition_variable mFrameReturnSignal;
+    std::atomic<bool> mWaitingForFrameReturn;
 
     // Synchronization necessary to deconflict mCaptureThread from the main service thread
     std::mutex mAccessLock;
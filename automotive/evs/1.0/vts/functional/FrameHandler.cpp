@@ -22,6 +22,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <cstdlib>
+
 #include <android/log.h>
 #include <cutils/native_handle.h>
 #include <ui/GraphicBuffer.h>
@@ -156,7 +159,8 @@ Return<void> FrameHandler::deliverFrame(const BufferDesc& bufferArg) {
                 ALOGE("Didn't get requested output buffer -- skipping this frame.");
             } else {
                 // Copy the contents of the of buffer.memHandle into tgtBuffer
-                copyBufferContents(tgtBuffer, bufferArg);
+                nsecs_t captureTime = 0;
+                copyBufferContents(tgtBuffer, bufferArg, &captureTime);
 
                 // Send the target buffer back for display
                 Return <EvsResult> result = mDisplay->returnTargetBufferForDisplay(tgtBuffer);
@@ -172,8 +176,12 @@ Return<void> FrameHandler::deliverFrame(const BufferDesc& bufferArg) {
                 } else {
                     // Everything looks good!
                     // Keep track so tests or watch dogs can monitor progress
+                    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
                     mLock.lock();
                     mFramesDisplayed++;
+                    if (captureTime > 0 && captureTime <= now) {
+                        mDisplayLatencies.push_back(now - captureTime);
+                    }
                     mLock.unlock();
                 }
             }
@@ -213,8 +221,10 @@ Return<void> FrameHandler::deliverFrame(const BufferDesc& bufferArg) {
 
 
 bool FrameHandler::copyBufferContents(const BufferDesc& tgtBuffer,
-                                      const BufferDesc& srcBuffer) {
+                                      const BufferDesc& srcBuffer,
+                                      nsecs_t* captureTime) {
     bool success = true;
+    *captureTime = 0;
 
     // Make sure we don't run off the end of either buffer
     const unsigned width     = std::min(tgtBuffer.width,
@@ -239,6 +249,16 @@ bool FrameHandler::copyBufferContents(const BufferDesc& tgtBuffer,
     uint32_t* tgtPixels = nullptr;
     tgt->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, (void**)&tgtPixels);
 
+    // The reference camera embeds its capture time in the first row of RGBA frames
+    static const uint32_t kTimestampMagic = 0x54535645;   // "EVST"
+    if (srcPixels && srcBuffer.format == HAL_PIXEL_FORMAT_RGBA_8888 && srcBuffer.width >= 4) {
+        const uint32_t* firstRow = reinterpret_cast<const uint32_t*>(srcPixels);
+        if (firstRow[1] == kTimestampMagic) {
+            *captureTime = static_cast<nsecs_t>(
+                    (static_cast<uint64_t>(firstRow[3]) << 32) | firstRow[2]);
+        }
+    }
+
     if (srcPixels && tgtPixels) {
         if (tgtBuffer.format == HAL_PIXEL_FORMAT_RGBA_8888) {
             if (srcBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
@@ -313,3 +333,29 @@ void FrameHandler::getFrameDimension(unsigned* width, unsigned* height) {
         *height = mFrameHeight;
     }
 }
+
+unsigned FrameHandler::getDisplayLatency(nsecs_t* p50, nsecs_t* p99, nsecs_t* jitter) {
+    std::vector<nsecs_t> latencies;
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        latencies = mDisplayLatencies;
+    }
+
+    *p50 = *p99 = *jitter = 0;
+    if (latencies.empty()) {
+        return 0;
+    }
+
+    nsecs_t totalDelta = 0;
+    for (size_t i = 1; i < latencies.size(); i++) {
+        totalDelta += std::abs(latencies[i] - latencies[i - 1]);
+    }
+    if (latencies.size() > 1) {
+        *jitter = totalDelta / (latencies.size() - 1);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    *p50 = latencies[latencies.size() * 50 / 100];
+    *p99 = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    return latencies.size();
+}
@@ -18,6 +18,9 @@
 #define EVS_VTS_FRAMEHANDLER_H
 
 #include <queue>
+#include <vector>
+
+#include <utils/Timers.h>
 
 #include <android/hardware/automotive/evs/1.0/IEvsCameraStream.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
@@ -63,12 +66,19 @@ public:
     void getFramesCounters(unsigned* received, unsigned* displayed);
     void getFrameDimension(unsigned* width, unsigned* height);
 
+    // Latency from the capture time embedded in frames by the reference camera to the
+    // return of returnTargetBufferForDisplay. Jitter is the mean difference between
+    // consecutive latencies. Returns the number of frames measured.
+    unsigned getDisplayLatency(nsecs_t* p50, nsecs_t* p99, nsecs_t* jitter);
+
 private:
     // Implementation for ::android::hardware::automotive::evs::V1_0::ICarCameraStream
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
     // Local implementation details
-    bool copyBufferContents(const BufferDesc& tgtBuffer, const BufferDesc& srcBuffer);
+    // captureTime is set to the capture time embedded in srcBuffer, or 0 if there's none
+    bool copyBufferContents(const BufferDesc& tgtBuffer, const BufferDesc& srcBuffer,
+                            nsecs_t* captureTime);
 
     // Values initialized as startup
     android::sp <IEvsCamera>    mCamera;
@@ -88,6 +98,7 @@ private:
     unsigned                    mFramesDisplayed = 0;   // Simple counter -- rolls over eventually!
     unsigned                    mFrameWidth = 0;
     unsigned                    mFrameHeight = 0;
+    std::vector<nsecs_t>        mDisplayLatencies;
 };
 
 
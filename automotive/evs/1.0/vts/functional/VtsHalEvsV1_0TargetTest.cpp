@@ -512,6 +512,79 @@ TEST_F(EvsHidlTest, CameraToDisplayRoundTrip) {
 }
 
 
+/*
+ * CameraToDisplayLatency:
+ * Measure the latency from frame capture to returnTargetBufferForDisplay for each reported
+ * camera (and so each resolution it streams at) and several buffer counts. Only cameras
+ * embedding their capture time in frames, like the reference implementation, are measured.
+ */
+TEST_F(EvsHidlTest, CameraToDisplayLatency) {
+    ALOGI("Starting CameraToDisplayLatency test");
+
+    // Get the camera list
+    loadCameraList();
+
+    // Request exclusive access to the EVS display
+    sp<IEvsDisplay> pDisplay = pEnumerator->openDisplay();
+    ASSERT_NE(pDisplay, nullptr);
+
+    static const unsigned kBufferCounts[] = {1, 2, 4};
+    static const int kSecondsToWait = 3;
+
+    for (auto&& cam: cameraInfo) {
+        for (unsigned bufferCount : kBufferCounts) {
+            sp <IEvsCamera> pCam = pEnumerator->openCamera(cam.cameraId);
+            ASSERT_NE(pCam, nullptr);
+
+            Return<EvsResult> result = pCam->setMaxFramesInFlight(bufferCount);
+            EXPECT_EQ(EvsResult::OK, result);
+
+            sp<FrameHandler> frameHandler = new FrameHandler(pCam, cam,
+                                                             pDisplay,
+                                                             FrameHandler::eAutoReturn);
+
+            // Activate the display
+            pDisplay->setDisplayState(DisplayState::VISIBLE_ON_NEXT_FRAME);
+
+            // Start the camera's video stream and let the data flow
+            bool startResult = frameHandler->startStream();
+            ASSERT_TRUE(startResult);
+            sleep(kSecondsToWait);
+
+            nsecs_t p50 = 0, p99 = 0, jitter = 0;
+            unsigned measured = frameHandler->getDisplayLatency(&p50, &p99, &jitter);
+            unsigned width = 0, height = 0;
+            frameHandler->getFrameDimension(&width, &height);
+            if (measured > 0) {
+                printf("Camera %s %ux%u, %u buffers: %u frames, latency p50 %0.2f ms, "
+                       "p99 %0.2f ms, jitter %0.2f ms\n",
+                       cam.cameraId.c_str(), width, height, bufferCount, measured,
+                       p50 * kNanoToMilliseconds, p99 * kNanoToMilliseconds,
+                       jitter * kNanoToMilliseconds);
+                ALOGI("Camera %s %ux%u, %u buffers: %u frames, latency p50 %0.2f ms, "
+                      "p99 %0.2f ms, jitter %0.2f ms",
+                      cam.cameraId.c_str(), width, height, bufferCount, measured,
+                      p50 * kNanoToMilliseconds, p99 * kNanoToMilliseconds,
+                      jitter * kNanoToMilliseconds);
+            } else {
+                printf("Camera %s doesn't embed capture times, latency not measured\n",
+                       cam.cameraId.c_str());
+            }
+
+            // Turn off the display and shut down the streamer
+            pDisplay->setDisplayState(DisplayState::NOT_VISIBLE);
+            frameHandler->shutdown();
+
+            // Explicitly release the camera
+            pEnumerator->closeCamera(pCam);
+        }
+    }
+
+    // Explicitly release the display
+    pEnumerator->closeDisplay(pDisplay);
+}
+
+
 /*
  * MultiCameraStream:
  * Verify that each client can start and stop video streams on the same
@@ -17,11 +17,19 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 #define android_hardware_automotive_vehicle_V2_0_ConcurrentQueue_H_
 
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 #include <queue>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <thread>
 #include <condition_variable>
 #include <iostream>
+#include <vector>
 
 namespace android {
 
@@ -84,7 +92,193 @@ private:
     std::queue<T> mQueue;
 };
 
+/* What BoundedMpscQueue::push does when the queue is full */
+enum class QueueOverflowPolicy {
+    DROP_NEWEST = 0,  // The pushed item is dropped and counted
+    BLOCK = 1,        // The producer yields until the consumer makes room
+};
+
+/*
+ * Bounded multi-producer, single-consumer ring with the same interface as ConcurrentQueue.
+ *
+ * push() is lock-free: producers claim a slot with a CAS on the write position and publish it
+ * through a per-slot sequence number. The consumer sleeps on an eventfd that producers only
+ * write to when the consumer is actually waiting, so a busy queue doesn't cost a syscall per
+ * item. waitForItems() and flush() must only be called from one thread.
+ */
 template<typename T>
+class BoundedMpscQueue {
+public:
+    /* capacity is rounded up to a power of two */
+    BoundedMpscQueue(size_t capacity, QueueOverflowPolicy overflowPolicy)
+        : mPolicy(overflowPolicy),
+          mMask(roundUpToPowerOfTwo(capacity) - 1),
+          mSlots(mMask + 1),
+          mEventFd(eventfd(0, EFD_CLOEXEC)) {
+        for (size_t i = 0; i <= mMask; i++) {
+            mSlots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~BoundedMpscQueue() {
+        if (mEventFd >= 0) {
+            close(mEventFd);
+        }
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue &) = delete;
+    BoundedMpscQueue &operator=(const BoundedMpscQueue &) = delete;
+
+    void waitForItems() {
+        while (mIsActive.load()) {
+            mConsumerWaiting.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!isEmpty() || !mIsActive.load()) {
+                mConsumerWaiting.store(false);
+                return;
+            }
+            uint64_t count;
+            if (read(mEventFd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                // Fall back to polling rather than spinning on a broken eventfd
+                mConsumerWaiting.store(false);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    std::vector<T> flush() {
+        std::vector<T> items;
+        if (!mIsActive.load()) {
+            return items;
+        }
+        while (true) {
+            Slot& slot = mSlots[mReadPos & mMask];
+            if (slot.seq.load(std::memory_order_acquire) != mReadPos + 1) {
+                break;
+            }
+            items.push_back(std::move(slot.item));
+            slot.seq.store(mReadPos + mMask + 1, std::memory_order_release);
+            mReadPos++;
+        }
+        return items;
+    }
+
+    /* Returns false if the item was dropped, because the queue is full under DROP_NEWEST or
+     * deactivated */
+    bool push(T&& item) {
+        if (!mIsActive.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        size_t pos = mWritePos.load(std::memory_order_relaxed);
+        Slot* slot;
+        bool blocked = false;
+        while (true) {
+            slot = &mSlots[pos & mMask];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mWritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Full
+                if (mPolicy == QueueOverflowPolicy::DROP_NEWEST) {
+                    mDroppedCount.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                if (!blocked) {
+                    blocked = true;
+                    mBlockedCount.fetch_add(1, std::memory_order_relaxed);
+                }
+                std::this_thread::yield();
+                if (!mIsActive.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                pos = mWritePos.load(std::memory_order_relaxed);
+            } else {
+                pos = mWritePos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->item = std::move(item);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        mPushedCount.fetch_add(1, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mConsumerWaiting.load(std::memory_order_relaxed) && mConsumerWaiting.exchange(false)) {
+            wakeConsumer();
+        }
+        return true;
+    }
+
+    /* Deactivates the queue, thus no one can push items to it, also
+     * notifies the waiting consumer.
+     */
+    void deactivate() {
+        mIsActive.store(false);
+        wakeConsumer();
+    }
+
+    size_t capacity() const { return mMask + 1; }
+    QueueOverflowPolicy overflowPolicy() const { return mPolicy; }
+    /* Number of items pushed, dropped because the queue was full, and push attempts that had
+     * to wait for room */
+    uint64_t pushedCount() const { return mPushedCount.load(std::memory_order_relaxed); }
+    uint64_t droppedCount() const { return mDroppedCount.load(std::memory_order_relaxed); }
+    uint64_t blockedCount() const { return mBlockedCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    static size_t roundUpToPowerOfTwo(size_t n) {
+        size_t result = 1;
+        while (result < n) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    bool isEmpty() const {
+        return mSlots[mReadPos & mMask].seq.load(std::memory_order_acquire) != mReadPos + 1;
+    }
+
+    void wakeConsumer() {
+        uint64_t one = 1;
+        if (mEventFd >= 0) {
+            ssize_t res;
+            do {
+                res = write(mEventFd, &one, sizeof(one));
+            } while (res < 0 && errno == EINTR);
+        }
+    }
+
+    const QueueOverflowPolicy mPolicy;
+    const size_t mMask;
+    std::vector<Slot> mSlots;
+    const int mEventFd;
+
+    std::atomic<bool> mIsActive { true };
+    std::atomic<bool> mConsumerWaiting { false };
+    // Producers and the consumer on separate cache lines
+    alignas(64) std::atomic<size_t> mWritePos { 0 };
+    alignas(64) size_t mReadPos = 0;  // Only accessed by the consumer
+
+    std::atomic<uint64_t> mPushedCount { 0 };
+    std::atomic<uint64_t> mDroppedCount { 0 };
+    std::atomic<uint64_t> mBlockedCount { 0 };
+};
+
+/*
+ * Consumes items of a ConcurrentQueue or BoundedMpscQueue in batches on its own thread.
+ *
+ * After the first item of a batch arrives the consumer waits for a batching window before
+ * flushing the queue. With an adaptive window the length follows the measured event rate:
+ * sparse events are delivered right away, and the window grows up to the max interval once
+ * enough events arrive to merge several of them into one batch.
+ */
+template<typename T, typename Queue = ConcurrentQueue<T>>
 class BatchingConsumer {
 private:
     enum class State {
@@ -102,14 +296,26 @@ public:
 
     using OnBatchReceivedFunc = std::function<void(const std::vector<T>& vec)>;
 
-    void run(ConcurrentQueue<T>* queue,
+    /* Batches with a fixed batchInterval window */
+    void run(Queue* queue,
              std::chrono::nanoseconds batchInterval,
              const OnBatchReceivedFunc& func) {
+        run(queue, batchInterval, batchInterval, func);
+    }
+
+    /* Batches with a window between minBatchInterval and maxBatchInterval picked from
+     * the event rate */
+    void run(Queue* queue,
+             std::chrono::nanoseconds minBatchInterval,
+             std::chrono::nanoseconds maxBatchInterval,
+             const OnBatchReceivedFunc& func) {
         mQueue = queue;
-        mBatchInterval = batchInterval;
+        mMinBatchInterval = minBatchInterval;
+        mMaxBatchInterval = maxBatchInterval;
+        mBatchInterval = maxBatchInterval.count();
 
         mWorkerThread = std::thread(
-            &BatchingConsumer<T>::runInternal, this, func);
+            &BatchingConsumer<T, Queue>::runInternal, this, func);
     }
 
     void requestStop() {
@@ -122,18 +328,54 @@ public:
         }
     }
 
+    /* Current batching window and measured event rate, for debugging */
+    std::chrono::nanoseconds getBatchInterval() const {
+        return std::chrono::nanoseconds(mBatchInterval.load(std::memory_order_relaxed));
+    }
+    float getEventRate() const { return mEventRate.load(std::memory_order_relaxed); }
+
 private:
+    // Number of events per window from which the window is at its max
+    static constexpr float kFullBatchEvents = 4;
+    // Weight of the latest batch in the event rate average
+    static constexpr float kRateSmoothing = 0.25f;
+
+    void updateBatchInterval(size_t numItems, std::chrono::nanoseconds elapsed) {
+        if (mMinBatchInterval == mMaxBatchInterval || elapsed.count() <= 0) {
+            return;
+        }
+        float rate = numItems * 1e9f / elapsed.count();
+        float avgRate = mEventRate.load(std::memory_order_relaxed);
+        avgRate = avgRate == 0 ? rate : avgRate + kRateSmoothing * (rate - avgRate);
+        mEventRate.store(avgRate, std::memory_order_relaxed);
+
+        // Events expected in a max window. Waiting is only worth it if more than one is.
+        float expected = avgRate * mMaxBatchInterval.count() / 1e9f;
+        float scale = std::min(1.f, std::max(0.f, (expected - 1) / (kFullBatchEvents - 1)));
+        int64_t interval = static_cast<int64_t>(mMaxBatchInterval.count() * scale);
+        mBatchInterval.store(std::max<int64_t>(interval, mMinBatchInterval.count()),
+                             std::memory_order_relaxed);
+    }
+
     void runInternal(const OnBatchReceivedFunc& onBatchReceived) {
         if (mState.exchange(State::RUNNING) == State::INIT) {
+            auto lastFlush = std::chrono::steady_clock::now();
             while (State::RUNNING == mState) {
                 mQueue->waitForItems();
                 if (State::STOP_REQUESTED == mState) break;
 
-                std::this_thread::sleep_for(mBatchInterval);
+                auto batchInterval = getBatchInterval();
+                if (batchInterval.count() > 0) {
+                    std::this_thread::sleep_for(batchInterval);
+                }
                 if (State::STOP_REQUESTED == mState) break;
 
                 std::vector<T> items = mQueue->flush();
 
+                auto now = std::chrono::steady_clock::now();
+                updateBatchInterval(items.size(), now - lastFlush);
+                lastFlush = now;
+
                 if (items.size() > 0) {
                     onBatchReceived(items);
                 }
@@ -147,8 +389,11 @@ private:
     std::thread mWorkerThread;
 
     std::atomic<State> mState;
-    std::chrono::nanoseconds mBatchInterval;
-    ConcurrentQueue<T>* mQueue;
+    std::chrono::nanoseconds mMinBatchInterval;
+    std::chrono::nanoseconds mMaxBatchInterval;
+    std::atomic<int64_t> mBatchInterval { 0 };  // in ns
+    std::atomic<float> mEventRate { 0 };  // events per second
+    Queue* mQueue;
 };
 
 }  // namespace android
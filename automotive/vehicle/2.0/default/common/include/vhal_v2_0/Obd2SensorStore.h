@@ -17,6 +17,8 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_Obd2SensorStore_H_
 #define android_hardware_automotive_vehicle_V2_0_Obd2SensorStore_H_
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
@@ -31,6 +33,12 @@ namespace V2_0 {
 // It allows storing sensor values, setting appropriate bitmasks as needed,
 // and returning appropriately laid out storage of sensor values suitable
 // for being returned via a VehicleHal implementation.
+//
+// Sensor values are stored directly in a ready-to-send frame, so setting a sensor only updates
+// its slot and bit, and filling a VehiclePropValue is a copy of the frame vectors. Frames handed
+// out by getFrame() are never modified: the next sensor update copies the frame first.
+//
+// This class is not thread-safe, but frames returned by getFrame() may be read from any thread.
 class Obd2SensorStore {
    public:
     // Creates a sensor storage with a given number of vendor-specific sensors.
@@ -47,32 +55,27 @@ class Obd2SensorStore {
     StatusCode setFloatSensor(size_t index, float value);
 
     // Returns a vector that contains all integer sensors stored.
-    const std::vector<int32_t>& getIntegerSensors() const;
+    const hidl_vec<int32_t>& getIntegerSensors() const;
     // Returns a vector that contains all float sensors stored.
-    const std::vector<float>& getFloatSensors() const;
+    const hidl_vec<float>& getFloatSensors() const;
     // Returns a vector that contains a bitmask for all stored sensors.
-    const std::vector<uint8_t>& getSensorsBitmask() const;
+    const hidl_vec<uint8_t>& getSensorsBitmask() const;
 
-    // Given a stringValue, fill in a VehiclePropValue
+    // Returns the current frame, with sensor values, bitmask and the time of the last sensor
+    // update filled in. The returned frame doesn't change when sensors are set afterwards.
+    std::shared_ptr<const VehiclePropValue> getFrame() const;
+
+    // Given a stringValue, fill in a VehiclePropValue. Vectors of propValue that already have
+    // the frame size are reused.
     void fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const;
 
    private:
-    class BitmaskInVector {
-       public:
-        BitmaskInVector(size_t numBits = 0);
-        void resize(size_t numBits);
-        bool get(size_t index) const;
-        void set(size_t index, bool value);
-
-        const std::vector<uint8_t>& getBitmask() const;
-
-       private:
-        std::vector<uint8_t> mStorage;
-    };
+    // Returns the frame to update, copying it first if it was handed out by getFrame()
+    VehiclePropValue* getMutableFrame();
+    static void setBit(hidl_vec<uint8_t>* bitmask, size_t index);
 
-    std::vector<int32_t> mIntegerSensors;
-    std::vector<float> mFloatSensors;
-    BitmaskInVector mSensorsBitmask;
+    size_t mNumIntegerSensors;
+    std::shared_ptr<VehiclePropValue> mFrame;
 };
 
 }  // namespace V2_0
@@ -17,6 +17,7 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 #define android_hardware_automotive_vehicle_V2_0_RecurrentTimer_H_
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -31,6 +32,10 @@
 /**
  * This class allows to specify multiple time intervals to receive
  * notifications. A single thread is used internally.
+ *
+ * Events are kept in a hashed timer wheel: each slot holds the events due on ticks that map
+ * to it, so registering, unregistering and rescheduling an event is O(1). Events due on the
+ * same tick are reported to the action in one call. Event times are rounded up to the tick.
  */
 class RecurrentTimer {
 private:
@@ -40,7 +45,11 @@ private:
 public:
     using Action = std::function<void(const std::vector<int32_t>& cookies)>;
 
-    RecurrentTimer(const Action& action) : mAction(action) {
+    static constexpr std::chrono::milliseconds kDefaultTick { 1 };
+
+    RecurrentTimer(const Action& action, Nanos tick = kDefaultTick)
+        : mTick(tick), mAction(action), mWheel(kWheelSize) {
+        mLastTick = toTickFloor(Clock::now());
         mTimerThread = std::thread(&RecurrentTimer::loop, this, action);
     }
 
@@ -61,7 +70,11 @@ public:
 
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap[cookie] = { interval, cookie, absoluteTime };
+            removeEventLocked(cookie);
+            EventList newEvent { { interval, cookie, absoluteTime, 0 } };
+            mCookieToEventsMap[cookie] = newEvent.begin();
+            scheduleLocked(newEvent.begin(), &newEvent);
+            mScheduleChanged = true;
         }
         mCond.notify_one();
     }
@@ -69,18 +82,22 @@ public:
     void unregisterRecurrentEvent(int32_t cookie) {
         {
             std::lock_guard<std::mutex> g(mLock);
-            mCookieToEventsMap.erase(cookie);
+            removeEventLocked(cookie);
         }
-        mCond.notify_one();
+        // No need to wake up the timer thread, it will find nothing to do on its next tick.
     }
 
 
 private:
+    // Number of slots of the wheel, events more than this many ticks ahead stay in their slot
+    // for the following turns.
+    static constexpr uint64_t kWheelSize = 1024;
 
     struct RecurrentEvent {
         Nanos interval;
         int32_t cookie;
         TimePoint absoluteTime;  // Absolute time of the next event.
+        uint64_t tick;  // Tick of absoluteTime, rounded up
 
         void updateNextEventTime(TimePoint now) {
             // We want to move time to next event by adding some number of intervals (usually 1)
@@ -91,6 +108,76 @@ private:
         }
     };
 
+    using EventList = std::list<RecurrentEvent>;
+
+    // Events are put on the tick rounded up from their time so they are never reported early,
+    // and a tick is processed once the current time rounded down reaches it.
+    uint64_t toTickCeil(TimePoint time) const {
+        return (time.time_since_epoch().count() + mTick.count() - 1) / mTick.count();
+    }
+
+    uint64_t toTickFloor(TimePoint time) const {
+        return time.time_since_epoch().count() / mTick.count();
+    }
+
+    TimePoint toTimePoint(uint64_t tick) const {
+        return TimePoint(Nanos(tick * mTick.count()));
+    }
+
+    // Moves the event from the from slot to the slot of its absoluteTime. Events can't be
+    // scheduled on ticks that were already processed.
+    void scheduleLocked(EventList::iterator eventIt, EventList* from) {
+        eventIt->tick = std::max(toTickCeil(eventIt->absoluteTime), mLastTick + 1);
+        EventList& to = mWheel[eventIt->tick % kWheelSize];
+        to.splice(to.end(), *from, eventIt);
+    }
+
+    void removeEventLocked(int32_t cookie) {
+        auto it = mCookieToEventsMap.find(cookie);
+        if (it != mCookieToEventsMap.end()) {
+            mWheel[it->second->tick % kWheelSize].erase(it->second);
+            mCookieToEventsMap.erase(it);
+        }
+    }
+
+    // Reports every event due up to nowTick into cookies and reschedules it
+    void processTicksLocked(TimePoint now, uint64_t nowTick, std::vector<int32_t>* cookies) {
+        if (nowTick <= mLastTick) {
+            return;
+        }
+        uint64_t firstTick = mLastTick + 1;
+        if (nowTick - mLastTick > kWheelSize) {
+            // Overslept, visiting every slot once is enough to find all due events.
+            firstTick = nowTick - kWheelSize + 1;
+        }
+        mLastTick = nowTick;
+
+        for (uint64_t tick = firstTick; tick <= nowTick; tick++) {
+            EventList& slot = mWheel[tick % kWheelSize];
+            for (auto it = slot.begin(); it != slot.end();) {
+                auto next = std::next(it);
+                // Events of later turns of the wheel share this slot
+                if (it->tick <= nowTick) {
+                    cookies->push_back(it->cookie);
+                    it->updateNextEventTime(now);
+                    scheduleLocked(it, &slot);
+                }
+                it = next;
+            }
+        }
+    }
+
+    // Returns the tick of the first non empty slot after nowTick, or nowTick + kWheelSize if
+    // only events of later turns are left.
+    uint64_t findNextTickLocked(uint64_t nowTick) const {
+        for (uint64_t tick = nowTick + 1; tick < nowTick + kWheelSize; tick++) {
+            if (!mWheel[tick % kWheelSize].empty()) {
+                return tick;
+            }
+        }
+        return nowTick + kWheelSize;
+    }
+
     void loop(const Action& action) {
         static constexpr auto kInvalidTime = TimePoint(Nanos::max());
 
@@ -104,17 +191,12 @@ private:
             {
                 std::unique_lock<std::mutex> g(mLock);
 
-                for (auto&& it : mCookieToEventsMap) {
-                    RecurrentEvent& event = it.second;
-                    if (event.absoluteTime <= now) {
-                        event.updateNextEventTime(now);
-                        cookies.push_back(event.cookie);
-                    }
-
-                    if (nextEventTime > event.absoluteTime) {
-                        nextEventTime = event.absoluteTime;
-                    }
+                uint64_t nowTick = toTickFloor(now);
+                processTicksLocked(now, nowTick, &cookies);
+                if (!mCookieToEventsMap.empty()) {
+                    nextEventTime = toTimePoint(findNextTickLocked(nowTick));
                 }
+                mScheduleChanged = false;
             }
 
             if (cookies.size() != 0) {
@@ -122,15 +204,21 @@ private:
             }
 
             std::unique_lock<std::mutex> g(mLock);
-            mCond.wait_until(g, nextEventTime);  // nextEventTime can be nanoseconds::max()
+            // nextEventTime can be nanoseconds::max()
+            mCond.wait_until(g, nextEventTime, [this] {
+                return mScheduleChanged || mStopRequested;
+            });
         }
     }
 
     void stop() {
-        mStopRequested = true;
         {
             std::lock_guard<std::mutex> g(mLock);
+            mStopRequested = true;
             mCookieToEventsMap.clear();
+            for (auto& slot : mWheel) {
+                slot.clear();
+            }
         }
         mCond.notify_one();
         if (mTimerThread.joinable()) {
@@ -138,12 +226,16 @@ private:
         }
     }
 private:
+    const Nanos mTick;
     mutable std::mutex mLock;
     std::thread mTimerThread;
     std::condition_variable mCond;
     std::atomic_bool mStopRequested { false };
+    bool mScheduleChanged = false;  // Set when an event was registered during a wait
     Action mAction;
-    std::unordered_map<int32_t, RecurrentEvent> mCookieToEventsMap;
+    std::vector<EventList> mWheel;
+    uint64_t mLastTick;  // Last tick processed by the timer thread
+    std::unordered_map<int32_t, EventList::iterator> mCookieToEventsMap;
 };
 
 
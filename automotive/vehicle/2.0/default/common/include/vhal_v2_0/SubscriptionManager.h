@@ -17,10 +17,13 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_SubscriptionManager_H_
 #define android_hardware_automotive_vehicle_V2_0_SubscriptionManager_H_
 
+#include <atomic>
 #include <memory>
 #include <map>
 #include <set>
 #include <list>
+#include <unordered_map>
+#include <vector>
 
 #include <android/log.h>
 #include <hidl/HidlSupport.h>
@@ -50,6 +53,8 @@ public:
 
     void addOrUpdateSubscription(const SubscribeOptions &opts);
     bool isSubscribed(int32_t propId, SubscribeFlags flags);
+    // Returns nullptr if the client isn't subscribed to propId
+    const SubscribeOptions* getSubscribeOptions(int32_t propId) const;
     std::vector<int32_t> getSubscribedProperties() const;
 
 private:
@@ -75,7 +80,7 @@ public:
 
 struct HalClientValues {
     sp<HalClient> client;
-    std::list<VehiclePropValue *> values;
+    std::vector<VehiclePropValue *> values;
 };
 
 using ClientId = uint64_t;
@@ -95,7 +100,7 @@ public:
                     std::bind(&SubscriptionManager::onCallbackDead, this, std::placeholders::_1)))
     {}
 
-    ~SubscriptionManager() = default;
+    ~SubscriptionManager();
 
     /**
      * Updates subscription. Returns the vector of properties subscription that
@@ -107,12 +112,23 @@ public:
                                        std::list<SubscribeOptions>* outUpdatedOptions);
 
     /**
-     * Returns a list of IVehicleCallback -> list of VehiclePropValue ready for
-     * dispatching to its clients.
+     * Fills outClientValues with IVehicleCallback -> list of VehiclePropValue
+     * ready for dispatching to its clients. Entries of clients that didn't get
+     * any value are left with empty values and should be skipped.
+     *
+     * Global (areaId 0) values of continuous properties are decimated to each
+     * client's sample rate using VehiclePropValue::timestamp, so a client
+     * subscribed at a lower rate than the HAL isn't sent every event.
+     *
+     * outClientValues is meant to be reused across calls: once its vectors
+     * have grown to the usual batch size no heap allocation is done. This call
+     * doesn't take mLock, it reads the routing table published by the last
+     * subscription change.
      */
-    std::list<HalClientValues> distributeValuesToClients(
+    void distributeValuesToClients(
             const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-            SubscribeFlags flags) const;
+            SubscribeFlags flags,
+            std::vector<HalClientValues>* outClientValues) const;
 
     std::list<sp<HalClient>> getSubscribedClients(int32_t propId, SubscribeFlags flags) const;
     /**
@@ -135,7 +151,33 @@ private:
 
     void onCallbackDead(uint64_t cookie);
 
+    // Rebuilds the routing table from mPropToClients and publishes it to
+    // distributeValuesToClients. Must be called after every change of mPropToClients.
+    void rebuildRoutingTableLocked();
+
 private:
+    // Immutable snapshot of mPropToClients used on the event path
+    struct RoutingTable {
+        struct Route {
+            size_t clientIndex;  // index in clients
+            SubscribeFlags flags;
+            int64_t minIntervalNs;  // 0 if events are not decimated for this client
+            size_t stateIndex;  // index in nextTimestamps
+        };
+        std::vector<sp<HalClient>> clients;
+        std::unordered_map<int32_t, std::vector<Route>> routes;
+        // Earliest timestamp of the next value delivered through each route. Carried over
+        // to the next table so rebuilding it doesn't reset decimation.
+        std::unique_ptr<std::atomic<int64_t>[]> nextTimestamps;
+
+        // Returns true if a value with the given timestamp should be sent through route
+        bool shouldDeliver(const Route& route, int64_t timestamp) const;
+    };
+
+    // Decimation state of client for propId in table, or 0 if it has none
+    static int64_t getNextTimestamp(const RoutingTable* table, int32_t propId,
+                                    const HalClient* client);
+
     using OnClientDead = std::function<void(uint64_t)>;
 
     class DeathRecipient : public hidl_death_recipient {
@@ -166,6 +208,13 @@ private:
 
     OnPropertyUnsubscribed mOnPropertyUnsubscribed;
     sp<DeathRecipient> mCallbackDeathRecipient;
+
+    // Read-copy-update of the routing table: readers register in the counter of the
+    // current epoch before loading mRoutingTable. A writer publishes the new table, flips
+    // the epoch and frees the old table once no reader is left in the previous epoch.
+    std::atomic<const RoutingTable*> mRoutingTable { nullptr };
+    std::atomic<uint32_t> mRoutingEpoch { 0 };
+    mutable std::atomic<uint32_t> mRoutingReaders[2] {};
 };
 
 
@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <chrono>
 #include <list>
 #include <map>
 #include <memory>
@@ -33,6 +34,7 @@
 #include "VehicleHal.h"
 #include "VehicleObjectPool.h"
 #include "VehiclePropConfigIndex.h"
+#include "VehiclePropertyWriteCoalescer.h"
 
 namespace android {
 namespace hardware {
@@ -48,10 +50,29 @@ namespace V2_0 {
  */
 class VehicleHalManager : public IVehicle {
 public:
-    VehicleHalManager(VehicleHal* vehicleHal)
+    static constexpr size_t kDefaultEventQueueCapacity = 1024;
+
+    /**
+     * @param eventQueueCapacity - max number of HAL events waiting to be dispatched to clients
+     * @param overflowPolicy - what to do with HAL events when that many are already waiting.
+     *        By default the HAL thread waits for room, so that no event is lost. DROP_NEWEST
+     *        must be opted into: ON_CHANGE events are not resent, so a dropped one leaves
+     *        every subscriber of the property with a stale value. Each drop is logged and
+     *        counted in debugDump.
+     */
+    VehicleHalManager(VehicleHal* vehicleHal,
+                      size_t eventQueueCapacity = kDefaultEventQueueCapacity,
+                      QueueOverflowPolicy overflowPolicy = QueueOverflowPolicy::BLOCK)
         : mHal(vehicleHal),
           mSubscriptionManager(std::bind(&VehicleHalManager::onAllClientsUnsubscribed,
-                                         this, std::placeholders::_1)) {
+                                         this, std::placeholders::_1)),
+          mEventQueue(eventQueueCapacity, overflowPolicy),
+          mWriteCoalescer([vehicleHal](const VehiclePropValue& value) {
+                              return vehicleHal->set(value);
+                          },
+                          std::bind(&VehicleHalManager::onHalPropertySetError, this,
+                                    std::placeholders::_1, std::placeholders::_2,
+                                    std::placeholders::_3)) {
         init();
     }
 
@@ -73,6 +94,25 @@ public:
                                    int32_t propId)  override;
     Return<void> debugDump(debugDump_cb _hidl_cb = nullptr) override;
 
+    // ---------------------------------------------------------------------------------------------
+    // Not part of IVehicle, which is frozen
+
+    /**
+     * Sets several values at once. Every value is checked before any is set; the batch is
+     * rejected as a whole if one of them cannot be set. Set subscribers are notified in a single
+     * pass over the batch, once per property and area, of its last value in the batch, and only
+     * that value is written.
+     *
+     * @return the first error of the writes, which are all attempted, or StatusCode::OK.
+     */
+    StatusCode setBatch(const hidl_vec<VehiclePropValue>& values);
+
+    /**
+     * Holds the writes to the vehicle for the given window, so that only the latest value of a
+     * property and area within the window is written. Zero, the default, writes right away.
+     */
+    void setWriteCoalescingWindow(std::chrono::milliseconds window);
+
 private:
     using VehiclePropValuePtr = VehicleHal::VehiclePropValuePtr;
     // Returns true if needs to call again shortly.
@@ -88,7 +128,10 @@ private:
     // This method will be called from BatchingConsumer thread
     void onBatchHalEvent(const std::vector<VehiclePropValuePtr >& values);
 
-    void handlePropertySetEvent(const VehiclePropValue& value);
+    // Notifies the set subscribers of the values of a set or a batch, looking up the subscribers
+    // of each property once. The values of a property must be next to each other.
+    void handlePropertySetEvents(const std::vector<const VehiclePropValue*>& values);
+    StatusCode checkSettable(const VehiclePropValue& value) const;
 
     const VehiclePropConfig* getPropConfigOrNull(int32_t prop) const;
 
@@ -108,10 +151,15 @@ private:
     SubscriptionManager mSubscriptionManager;
 
     hidl_vec<VehiclePropValue> mHidlVecOfVehiclePropValuePool;
+    // Reused by onBatchHalEvent for every batch, only accessed on the batching consumer thread
+    std::vector<HalClientValues> mBatchClientValues;
 
-    ConcurrentQueue<VehiclePropValuePtr> mEventQueue;
-    BatchingConsumer<VehiclePropValuePtr> mBatchingConsumer;
+    BoundedMpscQueue<VehiclePropValuePtr> mEventQueue;
+    BatchingConsumer<VehiclePropValuePtr, BoundedMpscQueue<VehiclePropValuePtr>>
+            mBatchingConsumer;
     VehiclePropValuePool mValueObjectPool;
+    // Last, so that it writes its held values before the rest is destroyed.
+    VehiclePropertyWriteCoalescer mWriteCoalescer;
 };
 
 }  // namespace V2_0
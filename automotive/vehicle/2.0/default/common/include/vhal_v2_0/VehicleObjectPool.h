@@ -18,9 +18,12 @@
 #ifndef android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 #define android_hardware_automotive_vehicle_V2_0_VehicleObjectPool_H_
 
+#include <atomic>
 #include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/types.h>
 
@@ -144,6 +147,11 @@ private:
  * synchornization penalty for these objects since we do not store them in the
  * pool.
  *
+ * Recycable objects are kept per (value type, vector size) class. Each thread
+ * caches a few objects of every class it uses, and threads exchange objects
+ * through a bounded lock-free depot per class, so neither obtain(...) nor
+ * recycling takes a lock. Objects that don't fit in the depot are deleted.
+ *
  * This class is thread-safe. Users can obtain an object in one thread and pass
  * it to another.
  *
@@ -162,6 +170,18 @@ class VehiclePropValuePool {
 public:
     using RecyclableType = recyclable_ptr<VehiclePropValue>;
 
+    struct Stats {
+        uint64_t hits = 0;       // Recycable objects obtained from a cache or the depot
+        uint64_t misses = 0;     // Recycable objects that had to be created
+        uint64_t overflows = 0;  // Recycled objects deleted because the depot was full
+    };
+
+    // Objects cached per thread and class. Half of them are moved to or from the depot when
+    // the cache is full or runs dry.
+    static constexpr size_t kThreadCacheSize = 16;
+    // Free objects shared between threads per class
+    static constexpr size_t kDepotSize = 256;
+
     /**
      * Creates VehiclePropValuePool
      *
@@ -173,8 +193,8 @@ public:
      * returning back to the object pool.
      *
      */
-    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4) :
-        mMaxRecyclableVectorSize(maxRecyclableVectorSize) {};
+    VehiclePropValuePool(size_t maxRecyclableVectorSize = 4);
+    ~VehiclePropValuePool();
 
     RecyclableType obtain(VehiclePropertyType type);
 
@@ -187,6 +207,9 @@ public:
     RecyclableType obtainString(const char* cstr);
     RecyclableType obtainComplex();
 
+    /* Statistics summed over all value types and vector sizes */
+    Stats getStats() const;
+
     VehiclePropValuePool(VehiclePropValuePool& ) = delete;
     VehiclePropValuePool& operator=(VehiclePropValuePool&) = delete;
 private:
@@ -200,29 +223,53 @@ private:
     RecyclableType obtainRecylable(VehiclePropertyType type,
                                    size_t vecSize);
 
-    class InternalPool: public ObjectPool<VehiclePropValue> {
+    class InternalPool {
     public:
-        InternalPool(VehiclePropertyType type, size_t vectorSize)
-            : mPropType(type), mVectorSize(vectorSize) {}
+        InternalPool(VehiclePropertyType type, size_t vectorSize, uint64_t id);
+        ~InternalPool();
 
-        RecyclableType obtain() {
-            return ObjectPool<VehiclePropValue>::obtain();
-        }
-    protected:
-        VehiclePropValue* createObject() override;
-        void recycle(VehiclePropValue* o) override;
+        RecyclableType obtain();
+        void addStats(Stats* stats) const;
+
+        InternalPool(const InternalPool&) = delete;
+        InternalPool& operator=(const InternalPool&) = delete;
     private:
+        VehiclePropValue* createObject();
+        void recycle(VehiclePropValue* o);
         bool check(VehiclePropValue::RawValue* v);
 
         template <typename VecType>
         bool check(hidl_vec<VecType>* vec, bool expected) {
             return vec->size() == (expected ? mVectorSize : 0);
         }
+
+        // Bounded multi-producer, multi-consumer FIFO of free objects, see
+        // BoundedMpscQueue in ConcurrentQueue.h for the sequence number scheme.
+        bool pushToDepot(VehiclePropValue* o);
+        VehiclePropValue* popFromDepot();
     private:
+        struct DepotSlot {
+            std::atomic<size_t> seq;
+            VehiclePropValue* object;
+        };
+
         VehiclePropertyType mPropType;
         size_t mVectorSize;
+        const uint64_t mId;  // Identifies this pool in the thread caches
+        const Deleter<VehiclePropValue> mDeleter;
+
+        std::unique_ptr<DepotSlot[]> mDepot;
+        alignas(64) std::atomic<size_t> mDepotPushPos { 0 };
+        alignas(64) std::atomic<size_t> mDepotPopPos { 0 };
+
+        std::atomic<uint64_t> mHits { 0 };
+        std::atomic<uint64_t> mMisses { 0 };
+        std::atomic<uint64_t> mOverflows { 0 };
     };
 
+    // Returns nullptr if objects of this type aren't recycled
+    InternalPool* getPoolOrNull(VehiclePropertyType type, size_t vecSize) const;
+
 private:
     const Deleter<VehiclePropValue> mDisposableDeleter {
         [] (VehiclePropValue* v) {
@@ -231,9 +278,9 @@ private:
     };
 
 private:
-    mutable std::mutex mLock;
     const size_t mMaxRecyclableVectorSize;
-    std::map<int32_t, std::unique_ptr<InternalPool>> mValueTypePools;
+    // Indexed by value type and vector size, see getPoolOrNull
+    std::vector<std::unique_ptr<InternalPool>> mValueTypePools;
 };
 
 }  // namespace V2_0
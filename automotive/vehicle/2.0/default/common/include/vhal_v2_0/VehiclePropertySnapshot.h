@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VehiclePropertySnapshot_H_
+#define android_hardware_automotive_vehicle_V2_0_VehiclePropertySnapshot_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Snapshot of property values kept in an ashmem region that clients map read-only, so they can
+ * read every value without a binder transaction per property.
+ *
+ * The region starts with a SnapshotHeader followed by dataSize bytes of records, each one a
+ * SnapshotRecord followed by its int32, int64, float, bytes and string payload in that order and
+ * padded to 8 bytes. Values are updated in place when the new payload fits in the record,
+ * otherwise the record is marked removed and a new one is appended. When the region is full the
+ * removed records are compacted away and generation is incremented.
+ *
+ * The single writer makes sequence odd while it updates the region, readers copy the region and
+ * retry if sequence was odd or changed meanwhile (see read()).
+ *
+ * The writer side of this class is thread-safe.
+ */
+class VehiclePropertySnapshot {
+public:
+    static constexpr uint32_t kMagic = 0x53534856;  // "VHSS"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kDefaultCapacity = 256 * 1024;
+
+    struct SnapshotHeader {
+        uint32_t magic;
+        uint32_t version;
+        std::atomic<uint32_t> sequence;
+        uint32_t generation;
+        uint32_t recordCount;  // including removed records
+        uint32_t dataSize;     // bytes of records following the header
+    };
+
+    enum RecordFlags : uint32_t {
+        RECORD_REMOVED = 1 << 0,
+    };
+
+    struct SnapshotRecord {
+        int32_t prop;
+        int32_t areaId;
+        int32_t status;
+        uint32_t flags;
+        int64_t timestamp;
+        int64_t token;  // VehiclePropertyStore token of the value, 0 for most properties
+        uint32_t int32Count;
+        uint32_t int64Count;
+        uint32_t floatCount;
+        uint32_t bytesCount;
+        uint32_t stringLength;
+        uint32_t capacity;  // payload bytes reserved after this record
+    };
+
+    explicit VehiclePropertySnapshot(size_t capacity = kDefaultCapacity);
+    ~VehiclePropertySnapshot();
+
+    /* Creates and maps the ashmem region. Returns false if that fails. */
+    bool init();
+
+    /* Returns the fd of the ashmem region for clients to mmap read-only, or -1 before init(). */
+    int getFd() const { return mFd; }
+    size_t getSize() const { return mSize; }
+
+    void writeValue(const VehiclePropValue& value, int64_t token = 0);
+    void removeValue(int32_t prop, int32_t areaId, int64_t token = 0);
+    void removeValuesForProperty(int32_t prop);
+
+    /**
+     * Reads all values of a snapshot region mapped by a client.
+     *
+     * @return false if region isn't a snapshot of a supported version or the writer kept
+     *         updating it while reading.
+     */
+    static bool read(const void* region, size_t size, std::vector<VehiclePropValue>* outValues);
+
+    VehiclePropertySnapshot(const VehiclePropertySnapshot&) = delete;
+    VehiclePropertySnapshot& operator=(const VehiclePropertySnapshot&) = delete;
+
+private:
+    using RecordKey = std::tuple<int32_t /* prop */, int32_t /* areaId */, int64_t /* token */>;
+
+    SnapshotHeader* header() const { return reinterpret_cast<SnapshotHeader*>(mBase); }
+    uint8_t* data() const { return mBase + sizeof(SnapshotHeader); }
+
+    void beginUpdateLocked();
+    void endUpdateLocked();
+    // Returns false if there's no room for the record even after compacting
+    bool appendRecordLocked(const RecordKey& key, const VehiclePropValue& value);
+    void markRemovedLocked(std::map<RecordKey, size_t>::iterator it);
+    void compactLocked();
+
+    static size_t getPayloadSize(const VehiclePropValue& value);
+    static void writeRecord(uint8_t* dest, const VehiclePropValue& value, int64_t token,
+                            uint32_t capacity);
+
+private:
+    const size_t mSize;
+    int mFd = -1;
+    uint8_t* mBase = nullptr;
+
+    std::mutex mLock;
+    std::map<RecordKey, size_t /* offset in data() */> mRecords;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VehiclePropertySnapshot_H_
@@ -18,12 +18,17 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_PropertyDb_H_
 
 #include <cstdint>
+#include <functional>
+#include <map>
 #include <unordered_map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
+#include "VehiclePropertySnapshot.h"
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -34,10 +39,13 @@ namespace V2_0 {
  * Encapsulates work related to storing and accessing configuration, storing and modifying
  * vehicle property values.
  *
- * VehiclePropertyValues stored in a sorted map thus it makes easier to get range of values, e.g.
- * to get value for all areas for particular property.
+ * Each registered property gets its own shard, found through a dense index from property ID
+ * to shard slot. Values of a shard are kept in an immutable map sorted by area and token that
+ * writers replace copy-on-write, so readers never wait for writers or for each other: they
+ * atomically load the current index and value map and copy from them. Writers of the same
+ * property are serialized by the shard lock, writers of different properties don't contend.
  *
- * This class is thread-safe, however it uses blocking synchronization across all methods.
+ * This class is thread-safe.
  */
 class VehiclePropertyStore {
 public:
@@ -45,13 +53,7 @@ public:
     using TokenFunction = std::function<int64_t(const VehiclePropValue& value)>;
 
 private:
-    struct RecordConfig {
-        VehiclePropConfig propConfig;
-        TokenFunction tokenFunction;
-    };
-
     struct RecordId {
-        int32_t prop;
         int32_t area;
         int64_t token;
 
@@ -59,10 +61,28 @@ private:
         bool operator<(const RecordId& other) const;
     };
 
-    using PropertyMap = std::map<RecordId, VehiclePropValue>;
-    using PropertyMapRange = std::pair<PropertyMap::const_iterator, PropertyMap::const_iterator>;
+    using ValueMap = std::map<RecordId, VehiclePropValue>;  // Values of one property
+
+    struct Shard {
+        Shard(const VehiclePropConfig& config, TokenFunction tokenFunc)
+            : propConfig(config), tokenFunction(tokenFunc), values(std::make_shared<ValueMap>()) {}
+
+        const VehiclePropConfig propConfig;
+        const TokenFunction tokenFunction;
+
+        std::mutex writeLock;  // Serializes writers of this shard
+        // Current values, only accessed with std::atomic_load/std::atomic_store
+        std::shared_ptr<const ValueMap> values;
+    };
+
+    struct ShardIndex {
+        std::unordered_map<int32_t /* VehicleProperty */, size_t> slots;
+        std::vector<std::shared_ptr<Shard>> shards;
+    };
 
 public:
+    VehiclePropertyStore() : mIndex(std::make_shared<ShardIndex>()) {}
+
     void registerProperty(const VehiclePropConfig& config, TokenFunction tokenFunc = nullptr);
 
     /* Stores provided value. Returns true if value was written returns false if config for
@@ -78,21 +98,28 @@ public:
     std::unique_ptr<VehiclePropValue> readValueOrNull(int32_t prop, int32_t area = 0,
                                                       int64_t token = 0) const;
 
+    /* Writes all values to snapshot and keeps it updated with every later change. Pass
+     * nullptr to stop updating the current snapshot. */
+    void setSnapshot(std::shared_ptr<VehiclePropertySnapshot> snapshot);
+
     std::vector<VehiclePropConfig> getAllConfigs() const;
     const VehiclePropConfig* getConfigOrNull(int32_t propId) const;
     const VehiclePropConfig* getConfigOrDie(int32_t propId) const;
 
 private:
-    RecordId getRecordIdLocked(const VehiclePropValue& valuePrototype) const;
-    const VehiclePropValue* getValueOrNullLocked(const RecordId& recId) const;
-    PropertyMapRange findRangeLocked(int32_t propId) const;
+    // Returns nullptr if propId wasn't registered. Shards live as long as the store.
+    Shard* getShardOrNull(int32_t propId) const;
+    static RecordId getRecordId(const Shard& shard, const VehiclePropValue& valuePrototype);
+    static std::unique_ptr<VehiclePropValue> findValue(const Shard& shard,
+                                                       const RecordId& recId);
 
 private:
     using MuxGuard = std::lock_guard<std::mutex>;
-    mutable std::mutex mLock;
-    std::unordered_map<int32_t /* VehicleProperty */, RecordConfig> mConfigs;
-
-    PropertyMap mPropertyValues;  // Sorted map of RecordId : VehiclePropValue.
+    std::mutex mRegisterLock;  // Serializes registerProperty
+    // Only accessed with std::atomic_load/std::atomic_store
+    std::shared_ptr<const ShardIndex> mIndex;
+    // Only accessed with std::atomic_load/std::atomic_store, updated under the shard lock
+    std::shared_ptr<VehiclePropertySnapshot> mSnapshot;
 };
 
 }  // namespace V2_0
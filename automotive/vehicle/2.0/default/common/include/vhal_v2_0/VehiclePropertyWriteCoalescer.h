@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VehiclePropertyWriteCoalescer_H_
+#define android_hardware_automotive_vehicle_V2_0_VehiclePropertyWriteCoalescer_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+/**
+ * Coalesces the property writes sent to the vehicle.
+ *
+ * With a zero window (the default) every write goes to the writer right away. With a non-zero
+ * window, a write is held until the window after the first held write ends, and a later write of
+ * the same property and area replaces it, so a burst of writes (e.g. a slider being dragged)
+ * reaches the vehicle as its latest value only. Held writes are passed to the writer from the
+ * coalescer's thread; as the client's set() has already returned by then, their errors go to
+ * the error callback.
+ *
+ * This class is thread-safe.
+ */
+class VehiclePropertyWriteCoalescer {
+public:
+    using Writer = std::function<StatusCode(const VehiclePropValue&)>;
+    using ErrorCallback = std::function<void(StatusCode, int32_t property, int32_t areaId)>;
+
+    VehiclePropertyWriteCoalescer(Writer writer, ErrorCallback onError);
+    /* Writes the held values before returning. */
+    ~VehiclePropertyWriteCoalescer();
+
+    void setWindow(std::chrono::milliseconds window);
+
+    /**
+     * Returns the status of the writer when the value is written right away, StatusCode::OK when
+     * it is held.
+     */
+    StatusCode write(const VehiclePropValue& value);
+
+    /* Writes the held values now. */
+    void flush();
+
+    /* Number of writes replaced by a later write of the same property and area. */
+    uint64_t getCoalescedCount();
+
+    VehiclePropertyWriteCoalescer(const VehiclePropertyWriteCoalescer&) = delete;
+    VehiclePropertyWriteCoalescer& operator=(const VehiclePropertyWriteCoalescer&) = delete;
+
+private:
+    void threadLoop();
+
+    const Writer mWriter;
+    const ErrorCallback mOnError;
+    // Held while writing, so that the writes of a property keep their order.
+    std::mutex mWriteLock;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::chrono::milliseconds mWindow{0};
+    // Held values by property and area.
+    std::map<std::pair<int32_t, int32_t>, VehiclePropValue> mPending;
+    std::chrono::steady_clock::time_point mDeadline;
+    uint64_t mCoalescedCount = 0;
+    bool mExit = false;
+    std::thread mThread;
+};
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VehiclePropertyWriteCoalescer_H_
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_VmsSubscriptionIndex_H_
+#define android_hardware_automotive_vehicle_V2_0_VmsSubscriptionIndex_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+#include "VmsUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+// Layers that got or lost subscribers when a subscriptions state was applied.
+struct VmsSubscriptionsDelta {
+    std::vector<VmsLayer> added_layers;
+    std::vector<VmsLayer> removed_layers;
+    std::vector<VmsLayerAndPublisher> added_layer_publishers;
+    std::vector<VmsLayerAndPublisher> removed_layer_publishers;
+};
+
+// VmsSubscriptionIndex keeps the latest VmsSubscriptionsState received from the VMS service
+// indexed by layer and by (layer, publisher), so that publishers in the HAL can look up whether a
+// layer has subscribers and the HAL can drop data messages nobody subscribed to, without parsing
+// the subscriptions message for every data message.
+//
+// Readers never block: the index is kept in an immutable state that a new subscriptions message
+// replaces. This class is thread-safe.
+class VmsSubscriptionIndex {
+  public:
+    VmsSubscriptionIndex();
+
+    // Applies a message of type VmsMessageType.SUBSCRIPTIONS_CHANGE or
+    // VmsMessageType.SUBSCRIPTIONS_RESPONSE if its sequence number is newer than the last
+    // applied one. Returns false if the message was ignored. If applied and delta is not null,
+    // it's set to the layers that got or lost subscribers.
+    bool applySubscriptionsState(const VehiclePropValue& subscriptions_state,
+                                 VmsSubscriptionsDelta* delta = nullptr);
+
+    // Returns true if the layer has subscribers for data of the given publisher.
+    bool isSubscribed(const VmsLayer& layer, int publisher_id) const;
+
+    // Returns false if value is a message of type VmsMessageType.DATA for a layer and publisher
+    // without subscribers. All other messages, and every message until a subscriptions state
+    // was applied, should be forwarded.
+    bool shouldForward(const VehiclePropValue& value) const;
+
+    // Same as getSubscribedLayers() in VmsUtils.h, for the last applied subscriptions state.
+    std::vector<VmsLayer> getSubscribedLayers(const VmsOffers& offers) const;
+
+    // Returns the sequence number of the last applied subscriptions state, -1 if none.
+    int getSequenceNumber() const;
+
+  private:
+    struct State {
+        int sequence_number = -1;
+        std::unordered_set<VmsLayer, VmsLayer::VmsLayerHashFunction> layers;
+        std::unordered_set<VmsLayerAndPublisher,
+                           VmsLayerAndPublisher::VmsLayerAndPublisherHashFunction>
+                layer_publishers;
+    };
+
+    // Returns nullptr if the message is malformed
+    static std::unique_ptr<State> parseState(const VehiclePropValue& subscriptions_state);
+    static void computeDelta(const State& old_state, const State& new_state,
+                             VmsSubscriptionsDelta* delta);
+
+    std::mutex mApplyLock;  // Serializes applySubscriptionsState
+    // Only accessed with std::atomic_load/std::atomic_store
+    std::shared_ptr<const State> mState;
+};
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_VmsSubscriptionIndex_H_
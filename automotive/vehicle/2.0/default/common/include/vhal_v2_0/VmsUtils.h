@@ -53,8 +53,9 @@ struct VmsLayer {
       public:
         // Hash of the variables is returned.
         size_t operator()(const VmsLayer& layer) const {
-            return std::hash<int>()(layer.type) ^ std::hash<int>()(layer.type) ^
-                   std::hash<int>()(layer.type);
+            size_t hash = std::hash<int>()(layer.type);
+            hash = hash * 31 + std::hash<int>()(layer.subtype);
+            return hash * 31 + std::hash<int>()(layer.version);
         }
     };
 };
@@ -64,6 +65,18 @@ struct VmsLayerAndPublisher {
         : layer(layer), publisher_id(publisher_id) {}
     VmsLayer layer;
     int publisher_id;
+    bool operator==(const VmsLayerAndPublisher& other) const {
+        return this->layer == other.layer && this->publisher_id == other.publisher_id;
+    }
+
+    // Class for hash function
+    class VmsLayerAndPublisherHashFunction {
+      public:
+        size_t operator()(const VmsLayerAndPublisher& layer_publisher) const {
+            return VmsLayer::VmsLayerHashFunction()(layer_publisher.layer) * 31 +
+                   std::hash<int>()(layer_publisher.publisher_id);
+        }
+    };
 };
 
 // A VmsAssociatedLayer is used by subscribers to specify which publisher IDs
@@ -16,6 +16,7 @@
 
 #include "Obd2SensorStore.h"
 
+#include <string.h>
 #include <utils/SystemClock.h>
 #include "VehicleUtils.h"
 
@@ -25,41 +26,33 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
-Obd2SensorStore::BitmaskInVector::BitmaskInVector(size_t numBits) {
-    resize(numBits);
-}
-
-void Obd2SensorStore::BitmaskInVector::resize(size_t numBits) {
-    mStorage = std::vector<uint8_t>((numBits + 7) / 8, 0);
-}
+namespace {
 
-void Obd2SensorStore::BitmaskInVector::set(size_t index, bool value) {
-    const size_t byteIndex = index / 8;
-    const size_t bitIndex = index % 8;
-    const uint8_t byte = mStorage[byteIndex];
-    uint8_t newValue = value ? (byte | (1 << bitIndex)) : (byte & ~(1 << bitIndex));
-    mStorage[byteIndex] = newValue;
+template <typename T>
+void copyVector(const hidl_vec<T>& src, hidl_vec<T>* dest) {
+    if (dest->size() != src.size()) {
+        dest->resize(src.size());
+    }
+    if (src.size() > 0) {
+        memcpy(dest->data(), src.data(), src.size() * sizeof(T));
+    }
 }
 
-bool Obd2SensorStore::BitmaskInVector::get(size_t index) const {
-    const size_t byteIndex = index / 8;
-    const size_t bitIndex = index % 8;
-    const uint8_t byte = mStorage[byteIndex];
-    return (byte & (1 << bitIndex)) != 0;
-}
+}  // namespace
 
-const std::vector<uint8_t>& Obd2SensorStore::BitmaskInVector::getBitmask() const {
-    return mStorage;
-}
-
-Obd2SensorStore::Obd2SensorStore(size_t numVendorIntegerSensors, size_t numVendorFloatSensors) {
+Obd2SensorStore::Obd2SensorStore(size_t numVendorIntegerSensors, size_t numVendorFloatSensors)
+    : mFrame(std::make_shared<VehiclePropValue>()) {
     // because the last index is valid *inclusive*
     const size_t numSystemIntegerSensors =
         toInt(DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX) + 1;
     const size_t numSystemFloatSensors = toInt(DiagnosticFloatSensorIndex::LAST_SYSTEM_INDEX) + 1;
-    mIntegerSensors = std::vector<int32_t>(numSystemIntegerSensors + numVendorIntegerSensors, 0);
-    mFloatSensors = std::vector<float>(numSystemFloatSensors + numVendorFloatSensors, 0);
-    mSensorsBitmask.resize(mIntegerSensors.size() + mFloatSensors.size());
+    mNumIntegerSensors = numSystemIntegerSensors + numVendorIntegerSensors;
+    const size_t numFloatSensors = numSystemFloatSensors + numVendorFloatSensors;
+
+    auto& v = mFrame->value;
+    v.int32Values = std::vector<int32_t>(mNumIntegerSensors, 0);
+    v.floatValues = std::vector<float>(numFloatSensors, 0);
+    v.bytes = std::vector<uint8_t>((mNumIntegerSensors + numFloatSensors + 7) / 8, 0);
 }
 
 StatusCode Obd2SensorStore::setIntegerSensor(DiagnosticIntegerSensorIndex index, int32_t value) {
@@ -70,37 +63,55 @@ StatusCode Obd2SensorStore::setFloatSensor(DiagnosticFloatSensorIndex index, flo
 }
 
 StatusCode Obd2SensorStore::setIntegerSensor(size_t index, int32_t value) {
-    mIntegerSensors[index] = value;
-    mSensorsBitmask.set(index, true);
+    VehiclePropValue* frame = getMutableFrame();
+    frame->value.int32Values[index] = value;
+    setBit(&frame->value.bytes, index);
     return StatusCode::OK;
 }
 
 StatusCode Obd2SensorStore::setFloatSensor(size_t index, float value) {
-    mFloatSensors[index] = value;
-    mSensorsBitmask.set(index + mIntegerSensors.size(), true);
+    VehiclePropValue* frame = getMutableFrame();
+    frame->value.floatValues[index] = value;
+    setBit(&frame->value.bytes, index + mNumIntegerSensors);
     return StatusCode::OK;
 }
 
-const std::vector<int32_t>& Obd2SensorStore::getIntegerSensors() const {
-    return mIntegerSensors;
+const hidl_vec<int32_t>& Obd2SensorStore::getIntegerSensors() const {
+    return mFrame->value.int32Values;
 }
 
-const std::vector<float>& Obd2SensorStore::getFloatSensors() const {
-    return mFloatSensors;
+const hidl_vec<float>& Obd2SensorStore::getFloatSensors() const {
+    return mFrame->value.floatValues;
 }
 
-const std::vector<uint8_t>& Obd2SensorStore::getSensorsBitmask() const {
-    return mSensorsBitmask.getBitmask();
+const hidl_vec<uint8_t>& Obd2SensorStore::getSensorsBitmask() const {
+    return mFrame->value.bytes;
+}
+
+std::shared_ptr<const VehiclePropValue> Obd2SensorStore::getFrame() const {
+    return mFrame;
 }
 
 void Obd2SensorStore::fillPropValue(const std::string& dtc, VehiclePropValue* propValue) const {
     propValue->timestamp = elapsedRealtimeNano();
-    propValue->value.int32Values = getIntegerSensors();
-    propValue->value.floatValues = getFloatSensors();
-    propValue->value.bytes = getSensorsBitmask();
+    copyVector(getIntegerSensors(), &propValue->value.int32Values);
+    copyVector(getFloatSensors(), &propValue->value.floatValues);
+    copyVector(getSensorsBitmask(), &propValue->value.bytes);
     propValue->value.stringValue = dtc;
 }
 
+VehiclePropValue* Obd2SensorStore::getMutableFrame() {
+    if (mFrame.use_count() > 1) {
+        mFrame = std::make_shared<VehiclePropValue>(*mFrame);
+    }
+    mFrame->timestamp = elapsedRealtimeNano();
+    return mFrame.get();
+}
+
+void Obd2SensorStore::setBit(hidl_vec<uint8_t>* bitmask, size_t index) {
+    (*bitmask)[index / 8] |= 1 << (index % 8);
+}
+
 }  // namespace V2_0
 }  // namespace vehicle
 }  // namespace automotive
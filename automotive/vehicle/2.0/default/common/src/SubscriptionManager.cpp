@@ -20,6 +20,7 @@
 
 #include <cmath>
 #include <inttypes.h>
+#include <thread>
 
 #include <android/log.h>
 
@@ -31,6 +32,14 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+// Decimated values are accepted slightly early so timestamp jitter doesn't make a
+// client skip a whole source interval
+constexpr int64_t kDecimationTolerancePercent = 10;
+
+}  // namespace
+
 bool mergeSubscribeOptions(const SubscribeOptions &oldOpts,
                            const SubscribeOptions &newOpts,
                            SubscribeOptions *outResult) {
@@ -74,6 +83,11 @@ bool HalClient::isSubscribed(int32_t propId,
     return res;
 }
 
+const SubscribeOptions* HalClient::getSubscribeOptions(int32_t propId) const {
+    auto it = mSubscriptions.find(propId);
+    return it == mSubscriptions.end() ? nullptr : &it->second;
+}
+
 std::vector<int32_t> HalClient::getSubscribedProperties() const {
     std::vector<int32_t> props;
     for (const auto& subscription : mSubscriptions) {
@@ -114,34 +128,157 @@ StatusCode SubscriptionManager::addOrUpdateSubscription(
         }
     }
 
+    rebuildRoutingTableLocked();
+
     return StatusCode::OK;
 }
 
-std::list<HalClientValues> SubscriptionManager::distributeValuesToClients(
+SubscriptionManager::~SubscriptionManager() {
+    delete mRoutingTable.load();
+}
+
+void SubscriptionManager::distributeValuesToClients(
         const std::vector<recyclable_ptr<VehiclePropValue>>& propValues,
-        SubscribeFlags flags) const {
-    std::map<sp<HalClient>, std::list<VehiclePropValue*>> clientValuesMap;
+        SubscribeFlags flags,
+        std::vector<HalClientValues>* outClientValues) const {
+    // Retry if a writer flipped the epoch before we registered, it may not wait for us.
+    uint32_t epoch;
+    do {
+        epoch = mRoutingEpoch.load();
+        mRoutingReaders[epoch & 1]++;
+        if (mRoutingEpoch.load() == epoch) {
+            break;
+        }
+        mRoutingReaders[epoch & 1]--;
+    } while (true);
+    const RoutingTable* table = mRoutingTable.load();
 
-    {
-        MuxGuard g(mLock);
-        for (const auto& propValue: propValues) {
+    size_t numClients = table == nullptr ? 0 : table->clients.size();
+    if (outClientValues->size() < numClients) {
+        outClientValues->resize(numClients);
+    }
+    for (size_t i = 0; i < outClientValues->size(); i++) {
+        HalClientValues& cv = (*outClientValues)[i];
+        cv.values.clear();
+        if (i < numClients) {
+            cv.client = table->clients[i];
+        } else {
+            cv.client.clear();
+        }
+    }
+
+    if (table != nullptr) {
+        for (const auto& propValue : propValues) {
             VehiclePropValue* v = propValue.get();
-            auto clients = getSubscribedClientsLocked(v->prop, flags);
-            for (const auto& client : clients) {
-                clientValuesMap[client].push_back(v);
+            auto it = table->routes.find(v->prop);
+            if (it == table->routes.end()) {
+                continue;
+            }
+            for (const auto& route : it->second) {
+                if ((route.flags & flags) &&
+                        (route.minIntervalNs == 0 || v->areaId != 0 ||
+                         table->shouldDeliver(route, v->timestamp))) {
+                    (*outClientValues)[route.clientIndex].values.push_back(v);
+                }
             }
         }
     }
 
-    std::list<HalClientValues> clientValues;
-    for (const auto& entry : clientValuesMap) {
-        clientValues.push_back(HalClientValues {
-            .client = entry.first,
-            .values = entry.second
-        });
+    mRoutingReaders[epoch & 1]--;
+}
+
+bool SubscriptionManager::RoutingTable::shouldDeliver(const Route& route,
+                                                      int64_t timestamp) const {
+    std::atomic<int64_t>& next = nextTimestamps[route.stateIndex];
+    int64_t nextTimestamp = next.load(std::memory_order_relaxed);
+    int64_t tolerance = route.minIntervalNs * kDecimationTolerancePercent / 100;
+    if (timestamp < nextTimestamp - tolerance) {
+        // Also deliver if the timestamp went backwards, e.g. after the source was reset.
+        if (timestamp >= nextTimestamp - 2 * route.minIntervalNs) {
+            return false;
+        }
+        nextTimestamp = timestamp;
+    }
+    // Advance by whole intervals so the tolerance doesn't raise the delivered rate
+    nextTimestamp += route.minIntervalNs;
+    if (nextTimestamp <= timestamp) {
+        nextTimestamp = timestamp + route.minIntervalNs;
     }
+    next.store(nextTimestamp, std::memory_order_relaxed);
+    return true;
+}
 
-    return clientValues;
+int64_t SubscriptionManager::getNextTimestamp(const RoutingTable* table, int32_t propId,
+                                              const HalClient* client) {
+    if (table == nullptr) {
+        return 0;
+    }
+    auto it = table->routes.find(propId);
+    if (it == table->routes.end()) {
+        return 0;
+    }
+    for (const auto& route : it->second) {
+        if (table->clients[route.clientIndex].get() == client) {
+            return table->nextTimestamps[route.stateIndex].load(std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+void SubscriptionManager::rebuildRoutingTableLocked() {
+    const RoutingTable* currentTable = mRoutingTable.load();
+    RoutingTable* table = nullptr;
+    if (!mPropToClients.empty()) {
+        table = new RoutingTable();
+        std::map<HalClient*, size_t> clientIndices;
+        size_t numRoutes = 0;
+        for (const auto& propClients : mPropToClients) {
+            numRoutes += propClients.second->size();
+        }
+        table->nextTimestamps.reset(new std::atomic<int64_t>[numRoutes]);
+
+        size_t stateIndex = 0;
+        for (const auto& propClients : mPropToClients) {
+            int32_t propId = propClients.first;
+            // The HAL produces events at the highest rate requested by any client
+            auto halOptsIt = mHalEventSubscribeOptions.find(propId);
+            float halRate = halOptsIt == mHalEventSubscribeOptions.end()
+                    ? 0 : halOptsIt->second.sampleRate;
+
+            auto& routes = table->routes[propId];
+            for (size_t i = 0; i < propClients.second->size(); i++) {
+                const sp<HalClient>& client = propClients.second->itemAt(i);
+                auto indexIt = clientIndices.find(client.get());
+                if (indexIt == clientIndices.end()) {
+                    indexIt = clientIndices.emplace(client.get(), table->clients.size()).first;
+                    table->clients.push_back(client);
+                }
+
+                const SubscribeOptions* opts = client->getSubscribeOptions(propId);
+                RoutingTable::Route route {
+                    .clientIndex = indexIt->second,
+                    .flags = opts == nullptr ? SubscribeFlags::UNDEFINED : opts->flags,
+                    .minIntervalNs = 0,
+                    .stateIndex = stateIndex++,
+                };
+                if (opts != nullptr && opts->sampleRate > 0 && opts->sampleRate < halRate) {
+                    route.minIntervalNs = static_cast<int64_t>(1000000000L / opts->sampleRate);
+                }
+                table->nextTimestamps[route.stateIndex] =
+                        getNextTimestamp(currentTable, propId, client.get());
+                routes.push_back(route);
+            }
+        }
+    }
+
+    const RoutingTable* oldTable = mRoutingTable.exchange(table);
+    // Readers that may have loaded oldTable are registered in the current epoch. Readers
+    // registering after the flip can only see the new table.
+    uint32_t oldEpoch = mRoutingEpoch++ & 1;
+    while (mRoutingReaders[oldEpoch].load() != 0) {
+        std::this_thread::yield();
+    }
+    delete oldTable;
 }
 
 std::list<sp<HalClient>> SubscriptionManager::getSubscribedClients(int32_t propId,
@@ -265,6 +402,8 @@ void SubscriptionManager::unsubscribe(ClientId clientId,
         }
     }
 
+    rebuildRoutingTableLocked();
+
     if (propertyClients == nullptr || propertyClients->isEmpty()) {
         mHalEventSubscribeOptions.erase(propId);
         mOnPropertyUnsubscribed(propId);
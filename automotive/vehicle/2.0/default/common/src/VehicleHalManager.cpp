@@ -20,6 +20,7 @@
 
 #include <cmath>
 #include <fstream>
+#include <stdio.h>
 
 #include <android/log.h>
 #include <android/hardware/automotive/vehicle/2.0/BpHwVehicleCallback.h>
@@ -34,6 +35,8 @@ namespace V2_0 {
 
 using namespace std::placeholders;
 
+// The batching window adapts to the event rate between these bounds
+constexpr std::chrono::milliseconds kHalEventBatchingMinTimeWindow(0);
 constexpr std::chrono::milliseconds kHalEventBatchingTimeWindow(10);
 
 const VehiclePropValue kEmptyValue{};
@@ -99,6 +102,54 @@ Return<void> VehicleHalManager::get(const VehiclePropValue& requestedPropValue,
 }
 
 Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
+    auto status = checkSettable(value);
+    if (status != StatusCode::OK) {
+        return status;
+    }
+
+    handlePropertySetEvents({&value});
+
+    status = mWriteCoalescer.write(value);
+
+    return Return<StatusCode>(status);
+}
+
+StatusCode VehicleHalManager::setBatch(const hidl_vec<VehiclePropValue>& values) {
+    for (const auto& value : values) {
+        auto status = checkSettable(value);
+        if (status != StatusCode::OK) {
+            return status;
+        }
+    }
+
+    // Index of the last value of each property and area.
+    std::map<std::pair<int32_t, int32_t>, size_t> lastValues;
+    for (size_t i = 0; i < values.size(); i++) {
+        lastValues[std::make_pair(values[i].prop, values[i].areaId)] = i;
+    }
+
+    std::vector<const VehiclePropValue*> valuesToSet;
+    valuesToSet.reserve(lastValues.size());
+    for (const auto& lastValue : lastValues) {
+        valuesToSet.push_back(&values[lastValue.second]);
+    }
+    handlePropertySetEvents(valuesToSet);
+
+    auto result = StatusCode::OK;
+    for (const VehiclePropValue* value : valuesToSet) {
+        auto status = mWriteCoalescer.write(*value);
+        if (result == StatusCode::OK) {
+            result = status;
+        }
+    }
+    return result;
+}
+
+void VehicleHalManager::setWriteCoalescingWindow(std::chrono::milliseconds window) {
+    mWriteCoalescer.setWindow(window);
+}
+
+StatusCode VehicleHalManager::checkSettable(const VehiclePropValue& value) const {
     auto prop = value.prop;
     const auto* config = getPropConfigOrNull(prop);
     if (config == nullptr) {
@@ -109,12 +160,7 @@ Return<StatusCode> VehicleHalManager::set(const VehiclePropValue &value) {
     if (!checkWritePermission(*config)) {
         return StatusCode::ACCESS_DENIED;
     }
-
-    handlePropertySetEvent(value);
-
-    auto status = mHal->set(value);
-
-    return Return<StatusCode>(status);
+    return StatusCode::OK;
 }
 
 Return<StatusCode> VehicleHalManager::subscribe(const sp<IVehicleCallback> &callback,
@@ -168,7 +214,20 @@ Return<StatusCode> VehicleHalManager::unsubscribe(const sp<IVehicleCallback>& ca
 }
 
 Return<void> VehicleHalManager::debugDump(IVehicle::debugDump_cb _hidl_cb) {
-    _hidl_cb("");
+    VehiclePropValuePool::Stats poolStats = mValueObjectPool.getStats();
+    char buf[384];
+    snprintf(buf, sizeof(buf),
+             "HAL event queue: capacity %zu, overflow policy %s, pushed %" PRIu64
+             ", dropped %" PRIu64 ", blocked %" PRIu64 "\n"
+             "HAL event batching: window %" PRId64 "us, rate %.1f events/s\n"
+             "Value pool: hits %" PRIu64 ", misses %" PRIu64 ", overflows %" PRIu64 "\n",
+             mEventQueue.capacity(),
+             mEventQueue.overflowPolicy() == QueueOverflowPolicy::BLOCK ? "block" : "drop newest",
+             mEventQueue.pushedCount(), mEventQueue.droppedCount(), mEventQueue.blockedCount(),
+             static_cast<int64_t>(mBatchingConsumer.getBatchInterval().count() / 1000),
+             mBatchingConsumer.getEventRate(),
+             poolStats.hits, poolStats.misses, poolStats.overflows);
+    _hidl_cb(buf);
     return Void();
 }
 
@@ -179,6 +238,7 @@ void VehicleHalManager::init() {
 
 
     mBatchingConsumer.run(&mEventQueue,
+                          kHalEventBatchingMinTimeWindow,
                           kHalEventBatchingTimeWindow,
                           std::bind(&VehicleHalManager::onBatchHalEvent,
                                     this, _1));
@@ -209,7 +269,13 @@ VehicleHalManager::~VehicleHalManager() {
 }
 
 void VehicleHalManager::onHalEvent(VehiclePropValuePtr v) {
-    mEventQueue.push(std::move(v));
+    int32_t prop = v->prop;
+    int32_t areaId = v->areaId;
+    if (!mEventQueue.push(std::move(v)) &&
+        mEventQueue.overflowPolicy() == QueueOverflowPolicy::DROP_NEWEST) {
+        ALOGW("HAL event queue full, dropped event of property 0x%x area 0x%x (%" PRIu64
+              " dropped)", prop, areaId, mEventQueue.droppedCount());
+    }
 }
 
 void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
@@ -224,11 +290,14 @@ void VehicleHalManager::onHalPropertySetError(StatusCode errorCode,
 }
 
 void VehicleHalManager::onBatchHalEvent(const std::vector<VehiclePropValuePtr>& values) {
-    const auto& clientValues =
-        mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR);
+    mSubscriptionManager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR,
+                                                   &mBatchClientValues);
 
-    for (const HalClientValues& cv : clientValues) {
+    for (const HalClientValues& cv : mBatchClientValues) {
         auto vecSize = cv.values.size();
+        if (vecSize == 0) {
+            continue;
+        }
         hidl_vec<VehiclePropValue> vec;
         if (vecSize < kMaxHidlVecOfVehiclPropValuePoolSize) {
             vec.setToExternal(&mHidlVecOfVehiclePropValuePool[0], vecSize);
@@ -309,11 +378,19 @@ bool VehicleHalManager::checkReadPermission(const VehiclePropConfig &config) con
     }
 }
 
-void VehicleHalManager::handlePropertySetEvent(const VehiclePropValue& value) {
-    auto clients =
-        mSubscriptionManager.getSubscribedClients(value.prop, SubscribeFlags::EVENTS_FROM_ANDROID);
-    for (const auto& client : clients) {
-        client->getCallback()->onPropertySet(value);
+void VehicleHalManager::handlePropertySetEvents(
+        const std::vector<const VehiclePropValue*>& values) {
+    std::list<sp<HalClient>> clients;
+    for (size_t i = 0; i < values.size(); i++) {
+        const VehiclePropValue& value = *values[i];
+        // The areas of a property are next to each other, and share its subscribers
+        if (i == 0 || value.prop != values[i - 1]->prop) {
+            clients = mSubscriptionManager.getSubscribedClients(
+                    value.prop, SubscribeFlags::EVENTS_FROM_ANDROID);
+        }
+        for (const auto& client : clients) {
+            client->getCallback()->onPropertySet(value);
+        }
     }
 }
 
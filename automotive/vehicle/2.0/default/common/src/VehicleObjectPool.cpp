@@ -28,6 +28,84 @@ namespace automotive {
 namespace vehicle {
 namespace V2_0 {
 
+namespace {
+
+constexpr size_t kThreadCacheSize = VehiclePropValuePool::kThreadCacheSize;
+// Number of pools a thread caches objects of at the same time. Pools of one
+// VehiclePropValuePool get consecutive ids so they don't evict each other.
+constexpr size_t kThreadCacheEntries = 64;
+constexpr size_t kDepotSize = VehiclePropValuePool::kDepotSize;
+
+const VehiclePropertyType kRecyclableTypes[] = {
+    VehiclePropertyType::BOOLEAN,
+    VehiclePropertyType::INT32,
+    VehiclePropertyType::INT32_VEC,
+    VehiclePropertyType::INT64,
+    VehiclePropertyType::INT64_VEC,
+    VehiclePropertyType::FLOAT,
+    VehiclePropertyType::FLOAT_VEC,
+    VehiclePropertyType::BYTES,
+};
+constexpr size_t kNumRecyclableTypes = sizeof(kRecyclableTypes) / sizeof(kRecyclableTypes[0]);
+
+std::atomic<uint64_t> sNextPoolId { 1 };
+
+struct ThreadCache {
+    struct Entry {
+        uint64_t poolId = 0;
+        size_t count = 0;
+        VehiclePropValue* objects[kThreadCacheSize];
+    };
+
+    ~ThreadCache() {
+        for (auto& entry : entries) {
+            clear(&entry);
+        }
+    }
+
+    // Returns the entry of the given pool. Objects cached for another pool are deleted
+    // since that pool may not exist anymore.
+    Entry& get(uint64_t poolId) {
+        Entry& entry = entries[poolId % kThreadCacheEntries];
+        if (entry.poolId != poolId) {
+            clear(&entry);
+            entry.poolId = poolId;
+        }
+        return entry;
+    }
+
+    static void clear(Entry* entry) {
+        for (size_t i = 0; i < entry->count; i++) {
+            delete entry->objects[i];
+        }
+        entry->count = 0;
+    }
+
+    Entry entries[kThreadCacheEntries];
+};
+
+thread_local ThreadCache tThreadCache;
+
+}  // namespace
+
+constexpr size_t VehiclePropValuePool::kThreadCacheSize;
+constexpr size_t VehiclePropValuePool::kDepotSize;
+
+VehiclePropValuePool::VehiclePropValuePool(size_t maxRecyclableVectorSize)
+        : mMaxRecyclableVectorSize(maxRecyclableVectorSize) {
+    size_t numPools = kNumRecyclableTypes * (maxRecyclableVectorSize + 1);
+    uint64_t firstId = sNextPoolId.fetch_add(numPools);
+    mValueTypePools.reserve(numPools);
+    for (size_t i = 0; i < kNumRecyclableTypes; i++) {
+        for (size_t vecSize = 0; vecSize <= maxRecyclableVectorSize; vecSize++) {
+            mValueTypePools.push_back(std::make_unique<InternalPool>(
+                    kRecyclableTypes[i], vecSize, firstId + mValueTypePools.size()));
+        }
+    }
+}
+
+VehiclePropValuePool::~VehiclePropValuePool() = default;
+
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
         VehiclePropertyType type, size_t vecSize) {
     return isDisposable(type, vecSize)
@@ -88,18 +166,29 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainComplex() {
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainRecylable(
         VehiclePropertyType type, size_t vecSize) {
-    // VehiclePropertyType is not overlapping with vectorSize.
-    int32_t key = static_cast<int32_t>(type)
-                  | static_cast<int32_t>(vecSize);
+    InternalPool* pool = getPoolOrNull(type, vecSize);
+    return pool != nullptr ? pool->obtain() : obtainDisposable(type, vecSize);
+}
 
-    std::lock_guard<std::mutex> g(mLock);
-    auto it = mValueTypePools.find(key);
+VehiclePropValuePool::InternalPool* VehiclePropValuePool::getPoolOrNull(
+        VehiclePropertyType type, size_t vecSize) const {
+    if (vecSize > mMaxRecyclableVectorSize) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < kNumRecyclableTypes; i++) {
+        if (kRecyclableTypes[i] == type) {
+            return mValueTypePools[i * (mMaxRecyclableVectorSize + 1) + vecSize].get();
+        }
+    }
+    return nullptr;
+}
 
-    if (it == mValueTypePools.end()) {
-        auto newPool(std::make_unique<InternalPool>(type, vecSize));
-        it = mValueTypePools.emplace(key, std::move(newPool)).first;
+VehiclePropValuePool::Stats VehiclePropValuePool::getStats() const {
+    Stats stats;
+    for (const auto& pool : mValueTypePools) {
+        pool->addStats(&stats);
     }
-    return it->second->obtain();
+    return stats;
 }
 
 VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtainBoolean(
@@ -121,6 +210,93 @@ VehiclePropValuePool::RecyclableType VehiclePropValuePool::obtain(
 }
 
 
+VehiclePropValuePool::InternalPool::InternalPool(VehiclePropertyType type, size_t vectorSize,
+                                                 uint64_t id)
+        : mPropType(type),
+          mVectorSize(vectorSize),
+          mId(id),
+          mDeleter(std::bind(&InternalPool::recycle, this, std::placeholders::_1)),
+          mDepot(new DepotSlot[kDepotSize]) {
+    for (size_t i = 0; i < kDepotSize; i++) {
+        mDepot[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+VehiclePropValuePool::InternalPool::~InternalPool() {
+    while (VehiclePropValue* o = popFromDepot()) {
+        delete o;
+    }
+}
+
+VehiclePropValuePool::RecyclableType VehiclePropValuePool::InternalPool::obtain() {
+    INC_METRIC_IF_DEBUG(Obtained)
+    ThreadCache::Entry& entry = tThreadCache.get(mId);
+    if (entry.count == 0) {
+        while (entry.count < kThreadCacheSize / 2) {
+            VehiclePropValue* o = popFromDepot();
+            if (o == nullptr) break;
+            entry.objects[entry.count++] = o;
+        }
+    }
+
+    VehiclePropValue* o;
+    if (entry.count > 0) {
+        o = entry.objects[--entry.count];
+        mHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        INC_METRIC_IF_DEBUG(Created)
+        o = createObject();
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+    return RecyclableType { o, mDeleter };
+}
+
+void VehiclePropValuePool::InternalPool::addStats(Stats* stats) const {
+    stats->hits += mHits.load(std::memory_order_relaxed);
+    stats->misses += mMisses.load(std::memory_order_relaxed);
+    stats->overflows += mOverflows.load(std::memory_order_relaxed);
+}
+
+bool VehiclePropValuePool::InternalPool::pushToDepot(VehiclePropValue* o) {
+    size_t pos = mDepotPushPos.load(std::memory_order_relaxed);
+    while (true) {
+        DepotSlot& slot = mDepot[pos % kDepotSize];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (mDepotPushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                slot.object = o;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = mDepotPushPos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+VehiclePropValue* VehiclePropValuePool::InternalPool::popFromDepot() {
+    size_t pos = mDepotPopPos.load(std::memory_order_relaxed);
+    while (true) {
+        DepotSlot& slot = mDepot[pos % kDepotSize];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (mDepotPopPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                VehiclePropValue* o = slot.object;
+                slot.seq.store(pos + kDepotSize, std::memory_order_release);
+                return o;
+            }
+        } else if (diff < 0) {
+            return nullptr;  // Empty
+        } else {
+            pos = mDepotPopPos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
 void VehiclePropValuePool::InternalPool::recycle(VehiclePropValue* o) {
     if (o == nullptr) {
         ALOGE("Attempt to recycle nullptr");
@@ -133,9 +309,26 @@ void VehiclePropValuePool::InternalPool::recycle(VehiclePropValue* o) {
                   "Expected type: %d, vector size: %zu",
               o->prop, mPropType, mVectorSize);
         delete o;
-    } else {
-        ObjectPool<VehiclePropValue>::recycle(o);
+        return;
+    }
+
+    INC_METRIC_IF_DEBUG(Recycled)
+    ThreadCache::Entry& entry = tThreadCache.get(mId);
+    if (entry.count == kThreadCacheSize) {
+        // Move the least recently cached half to the depot for other threads
+        const size_t half = kThreadCacheSize / 2;
+        for (size_t i = 0; i < half; i++) {
+            if (!pushToDepot(entry.objects[i])) {
+                delete entry.objects[i];
+                mOverflows.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = half; i < kThreadCacheSize; i++) {
+            entry.objects[i - half] = entry.objects[i];
+        }
+        entry.count -= half;
     }
+    entry.objects[entry.count++] = o;
 }
 
 bool VehiclePropValuePool::InternalPool::check(VehiclePropValue::RawValue* v) {
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "VehiclePropertySnapshot"
+
+#include <cutils/ashmem.h>
+#include <errno.h>
+#include <log/log.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <thread>
+
+#include "VehiclePropertySnapshot.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr int kMaxReadRetries = 64;
+
+static_assert(sizeof(VehiclePropertySnapshot::SnapshotHeader) % 8 == 0,
+              "records must stay 8 byte aligned");
+static_assert(sizeof(VehiclePropertySnapshot::SnapshotRecord) % 8 == 0,
+              "records must stay 8 byte aligned");
+
+size_t alignTo8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+template <typename T>
+uint8_t* copyOut(uint8_t* dest, const hidl_vec<T>& vec) {
+    size_t numBytes = vec.size() * sizeof(T);
+    if (numBytes > 0) {
+        memcpy(dest, vec.data(), numBytes);
+    }
+    return dest + numBytes;
+}
+
+template <typename T>
+const uint8_t* copyIn(const uint8_t* src, uint32_t count, hidl_vec<T>* vec) {
+    vec->resize(count);
+    if (count > 0) {
+        memcpy(vec->data(), src, count * sizeof(T));
+    }
+    return src + count * sizeof(T);
+}
+
+}  // namespace
+
+VehiclePropertySnapshot::VehiclePropertySnapshot(size_t capacity)
+    : mSize(sizeof(SnapshotHeader) + alignTo8(capacity)) {}
+
+VehiclePropertySnapshot::~VehiclePropertySnapshot() {
+    if (mBase != nullptr) {
+        munmap(mBase, mSize);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool VehiclePropertySnapshot::init() {
+    mFd = ashmem_create_region("vehicle_property_snapshot", mSize);
+    if (mFd < 0) {
+        ALOGE("%s: failed to create ashmem region of %zu bytes", __func__, mSize);
+        return false;
+    }
+    void* base = mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("%s: failed to map ashmem region: %s", __func__, strerror(errno));
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+    // Only this mapping may write, clients can map the region read-only
+    if (ashmem_set_prot_region(mFd, PROT_READ) != 0) {
+        ALOGW("%s: failed to restrict ashmem region to PROT_READ", __func__);
+    }
+
+    mBase = static_cast<uint8_t*>(base);
+    header()->magic = kMagic;
+    header()->version = kVersion;
+    header()->sequence.store(0, std::memory_order_relaxed);
+    header()->generation = 0;
+    header()->recordCount = 0;
+    header()->dataSize = 0;
+    return true;
+}
+
+void VehiclePropertySnapshot::writeValue(const VehiclePropValue& value, int64_t token) {
+    std::lock_guard<std::mutex> g(mLock);
+    if (mBase == nullptr) return;
+
+    RecordKey key { value.prop, value.areaId, token };
+    beginUpdateLocked();
+    auto it = mRecords.find(key);
+    if (it != mRecords.end()) {
+        auto record = reinterpret_cast<SnapshotRecord*>(data() + it->second);
+        if (getPayloadSize(value) <= record->capacity) {
+            writeRecord(data() + it->second, value, token, record->capacity);
+            endUpdateLocked();
+            return;
+        }
+        markRemovedLocked(it);
+    }
+    if (!appendRecordLocked(key, value)) {
+        ALOGE("%s: no room for property: 0x%x, area: 0x%x in %zu bytes", __func__, value.prop,
+              value.areaId, mSize);
+    }
+    endUpdateLocked();
+}
+
+void VehiclePropertySnapshot::removeValue(int32_t prop, int32_t areaId, int64_t token) {
+    std::lock_guard<std::mutex> g(mLock);
+    auto it = mRecords.find(RecordKey { prop, areaId, token });
+    if (it == mRecords.end()) return;
+
+    beginUpdateLocked();
+    markRemovedLocked(it);
+    endUpdateLocked();
+}
+
+void VehiclePropertySnapshot::removeValuesForProperty(int32_t prop) {
+    std::lock_guard<std::mutex> g(mLock);
+    auto it = mRecords.lower_bound(RecordKey { prop, INT32_MIN, INT64_MIN });
+    if (it == mRecords.end() || std::get<0>(it->first) != prop) return;
+
+    beginUpdateLocked();
+    while (it != mRecords.end() && std::get<0>(it->first) == prop) {
+        auto next = std::next(it);
+        markRemovedLocked(it);
+        it = next;
+    }
+    endUpdateLocked();
+}
+
+bool VehiclePropertySnapshot::read(const void* region, size_t size,
+                                   std::vector<VehiclePropValue>* outValues) {
+    if (size < sizeof(SnapshotHeader)) return false;
+    auto h = static_cast<const SnapshotHeader*>(region);
+    auto recordData = static_cast<const uint8_t*>(region) + sizeof(SnapshotHeader);
+
+    std::vector<uint8_t> copy;
+    for (int attempt = 0; attempt < kMaxReadRetries; attempt++) {
+        uint32_t sequence = h->sequence.load(std::memory_order_acquire);
+        if (h->magic != kMagic || h->version != kVersion) {
+            ALOGE("%s: unsupported snapshot, magic: 0x%x, version: %u", __func__, h->magic,
+                  h->version);
+            return false;
+        }
+        uint32_t dataSize = h->dataSize;
+        if ((sequence & 1) == 0 && dataSize <= size - sizeof(SnapshotHeader)) {
+            copy.assign(recordData, recordData + dataSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (h->sequence.load(std::memory_order_relaxed) == sequence) {
+                break;
+            }
+        }
+        copy.clear();
+        if (attempt == kMaxReadRetries - 1) {
+            ALOGW("%s: snapshot kept changing while reading", __func__);
+            return false;
+        }
+        std::this_thread::yield();
+    }
+
+    outValues->clear();
+    size_t offset = 0;
+    while (offset + sizeof(SnapshotRecord) <= copy.size()) {
+        SnapshotRecord record;
+        memcpy(&record, copy.data() + offset, sizeof(record));
+        const uint8_t* payload = copy.data() + offset + sizeof(record);
+        offset += sizeof(record) + record.capacity;
+        if (offset > copy.size()) {
+            ALOGE("%s: record of property: 0x%x exceeds the snapshot", __func__, record.prop);
+            return false;
+        }
+        if (record.flags & RECORD_REMOVED) continue;
+
+        size_t payloadSize = record.int32Count * sizeof(int32_t) +
+                             record.int64Count * sizeof(int64_t) +
+                             record.floatCount * sizeof(float) +
+                             record.bytesCount + record.stringLength;
+        if (payloadSize > record.capacity) {
+            ALOGE("%s: payload of property: 0x%x exceeds its record", __func__, record.prop);
+            return false;
+        }
+
+        VehiclePropValue value;
+        value.prop = record.prop;
+        value.areaId = record.areaId;
+        value.status = static_cast<VehiclePropertyStatus>(record.status);
+        value.timestamp = record.timestamp;
+        payload = copyIn(payload, record.int32Count, &value.value.int32Values);
+        payload = copyIn(payload, record.int64Count, &value.value.int64Values);
+        payload = copyIn(payload, record.floatCount, &value.value.floatValues);
+        payload = copyIn(payload, record.bytesCount, &value.value.bytes);
+        if (record.stringLength > 0) {
+            value.value.stringValue =
+                std::string(reinterpret_cast<const char*>(payload), record.stringLength);
+        }
+        outValues->push_back(std::move(value));
+    }
+    return true;
+}
+
+void VehiclePropertySnapshot::beginUpdateLocked() {
+    uint32_t sequence = header()->sequence.load(std::memory_order_relaxed);
+    header()->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void VehiclePropertySnapshot::endUpdateLocked() {
+    uint32_t sequence = header()->sequence.load(std::memory_order_relaxed);
+    header()->sequence.store(sequence + 1, std::memory_order_release);
+}
+
+bool VehiclePropertySnapshot::appendRecordLocked(const RecordKey& key,
+                                                 const VehiclePropValue& value) {
+    size_t capacity = alignTo8(getPayloadSize(value));
+    size_t recordSize = sizeof(SnapshotRecord) + capacity;
+    size_t maxDataSize = mSize - sizeof(SnapshotHeader);
+    if (header()->dataSize + recordSize > maxDataSize) {
+        compactLocked();
+        if (header()->dataSize + recordSize > maxDataSize) {
+            return false;
+        }
+    }
+
+    size_t offset = header()->dataSize;
+    writeRecord(data() + offset, value, std::get<2>(key), capacity);
+    header()->dataSize += recordSize;
+    header()->recordCount++;
+    mRecords[key] = offset;
+    return true;
+}
+
+void VehiclePropertySnapshot::markRemovedLocked(std::map<RecordKey, size_t>::iterator it) {
+    reinterpret_cast<SnapshotRecord*>(data() + it->second)->flags |= RECORD_REMOVED;
+    mRecords.erase(it);
+}
+
+void VehiclePropertySnapshot::compactLocked() {
+    std::vector<uint8_t> live;
+    live.reserve(header()->dataSize);
+    mRecords.clear();
+
+    size_t offset = 0;
+    while (offset < header()->dataSize) {
+        auto record = reinterpret_cast<const SnapshotRecord*>(data() + offset);
+        size_t recordSize = sizeof(SnapshotRecord) + record->capacity;
+        if (!(record->flags & RECORD_REMOVED)) {
+            mRecords[RecordKey { record->prop, record->areaId, record->token }] = live.size();
+            live.insert(live.end(), data() + offset, data() + offset + recordSize);
+        }
+        offset += recordSize;
+    }
+
+    memcpy(data(), live.data(), live.size());
+    header()->dataSize = live.size();
+    header()->recordCount = mRecords.size();
+    header()->generation++;
+}
+
+size_t VehiclePropertySnapshot::getPayloadSize(const VehiclePropValue& value) {
+    const auto& v = value.value;
+    return v.int32Values.size() * sizeof(int32_t) + v.int64Values.size() * sizeof(int64_t) +
+           v.floatValues.size() * sizeof(float) + v.bytes.size() + v.stringValue.size();
+}
+
+void VehiclePropertySnapshot::writeRecord(uint8_t* dest, const VehiclePropValue& value,
+                                          int64_t token, uint32_t capacity) {
+    const auto& v = value.value;
+    auto record = reinterpret_cast<SnapshotRecord*>(dest);
+    record->prop = value.prop;
+    record->areaId = value.areaId;
+    record->status = static_cast<int32_t>(value.status);
+    record->flags = 0;
+    record->timestamp = value.timestamp;
+    record->token = token;
+    record->int32Count = v.int32Values.size();
+    record->int64Count = v.int64Values.size();
+    record->floatCount = v.floatValues.size();
+    record->bytesCount = v.bytes.size();
+    record->stringLength = v.stringValue.size();
+    record->capacity = capacity;
+
+    uint8_t* payload = dest + sizeof(SnapshotRecord);
+    payload = copyOut(payload, v.int32Values);
+    payload = copyOut(payload, v.int64Values);
+    payload = copyOut(payload, v.floatValues);
+    payload = copyOut(payload, v.bytes);
+    if (v.stringValue.size() > 0) {
+        memcpy(payload, v.stringValue.c_str(), v.stringValue.size());
+    }
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -26,71 +26,111 @@ namespace vehicle {
 namespace V2_0 {
 
 bool VehiclePropertyStore::RecordId::operator==(const VehiclePropertyStore::RecordId& other) const {
-    return prop == other.prop && area == other.area && token == other.token;
+    return area == other.area && token == other.token;
 }
 
 bool VehiclePropertyStore::RecordId::operator<(const VehiclePropertyStore::RecordId& other) const  {
-    return prop < other.prop
-           || (prop == other.prop && area < other.area)
-           || (prop == other.prop && area == other.area && token < other.token);
+    return area < other.area || (area == other.area && token < other.token);
 }
 
 void VehiclePropertyStore::registerProperty(const VehiclePropConfig& config,
                                             VehiclePropertyStore::TokenFunction tokenFunc) {
-    MuxGuard g(mLock);
-    mConfigs.insert({ config.prop, RecordConfig { config, tokenFunc } });
+    MuxGuard g(mRegisterLock);
+    auto index = std::atomic_load(&mIndex);
+    if (index->slots.count(config.prop)) return;
+
+    auto newIndex = std::make_shared<ShardIndex>(*index);
+    newIndex->slots.insert({ config.prop, newIndex->shards.size() });
+    newIndex->shards.push_back(std::make_shared<Shard>(config, tokenFunc));
+    std::atomic_store(&mIndex, std::shared_ptr<const ShardIndex>(std::move(newIndex)));
 }
 
 bool VehiclePropertyStore::writeValue(const VehiclePropValue& propValue,
                                         bool updateStatus) {
-    MuxGuard g(mLock);
-    if (!mConfigs.count(propValue.prop)) return false;
-
-    RecordId recId = getRecordIdLocked(propValue);
-    VehiclePropValue* valueToUpdate = const_cast<VehiclePropValue*>(getValueOrNullLocked(recId));
-    if (valueToUpdate == nullptr) {
-        mPropertyValues.insert({ recId, propValue });
+    Shard* shard = getShardOrNull(propValue.prop);
+    if (shard == nullptr) return false;
+
+    RecordId recId = getRecordId(*shard, propValue);
+    MuxGuard g(shard->writeLock);
+    auto newValues = std::make_shared<ValueMap>(*std::atomic_load(&shard->values));
+    auto it = newValues->find(recId);
+    if (it == newValues->end()) {
+        it = newValues->insert({ recId, propValue }).first;
     } else {
+        VehiclePropValue* valueToUpdate = &it->second;
         valueToUpdate->timestamp = propValue.timestamp;
         valueToUpdate->value = propValue.value;
         if (updateStatus) {
             valueToUpdate->status = propValue.status;
         }
     }
+    auto snapshot = std::atomic_load(&mSnapshot);
+    if (snapshot != nullptr) {
+        snapshot->writeValue(it->second, recId.token);
+    }
+    std::atomic_store(&shard->values, std::shared_ptr<const ValueMap>(std::move(newValues)));
     return true;
 }
 
 void VehiclePropertyStore::removeValue(const VehiclePropValue& propValue) {
-    MuxGuard g(mLock);
-    RecordId recId = getRecordIdLocked(propValue);
-    auto it = mPropertyValues.find(recId);
-    if (it != mPropertyValues.end()) {
-        mPropertyValues.erase(it);
+    Shard* shard = getShardOrNull(propValue.prop);
+    if (shard == nullptr) return;
+
+    RecordId recId = getRecordId(*shard, propValue);
+    MuxGuard g(shard->writeLock);
+    auto values = std::atomic_load(&shard->values);
+    if (values->find(recId) != values->end()) {
+        auto newValues = std::make_shared<ValueMap>(*values);
+        newValues->erase(recId);
+        auto snapshot = std::atomic_load(&mSnapshot);
+        if (snapshot != nullptr) {
+            snapshot->removeValue(propValue.prop, recId.area, recId.token);
+        }
+        std::atomic_store(&shard->values, std::shared_ptr<const ValueMap>(std::move(newValues)));
     }
 }
 
 void VehiclePropertyStore::removeValuesForProperty(int32_t propId) {
-    MuxGuard g(mLock);
-    auto range = findRangeLocked(propId);
-    mPropertyValues.erase(range.first, range.second);
+    Shard* shard = getShardOrNull(propId);
+    if (shard == nullptr) return;
+
+    MuxGuard g(shard->writeLock);
+    auto snapshot = std::atomic_load(&mSnapshot);
+    if (snapshot != nullptr) {
+        snapshot->removeValuesForProperty(propId);
+    }
+    std::atomic_store(&shard->values, std::shared_ptr<const ValueMap>(std::make_shared<ValueMap>()));
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readAllValues() const {
-    MuxGuard g(mLock);
+    auto index = std::atomic_load(&mIndex);
+    std::vector<std::shared_ptr<const ValueMap>> shardValues;
+    shardValues.reserve(index->shards.size());
+    size_t numValues = 0;
+    for (const auto& shard : index->shards) {
+        shardValues.push_back(std::atomic_load(&shard->values));
+        numValues += shardValues.back()->size();
+    }
+
     std::vector<VehiclePropValue> allValues;
-    allValues.reserve(mPropertyValues.size());
-    for (auto&& it : mPropertyValues) {
-        allValues.push_back(it.second);
+    allValues.reserve(numValues);
+    for (const auto& values : shardValues) {
+        for (auto&& it : *values) {
+            allValues.push_back(it.second);
+        }
     }
     return allValues;
 }
 
 std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_t propId) const {
     std::vector<VehiclePropValue> values;
-    MuxGuard g(mLock);
-    auto range = findRangeLocked(propId);
-    for (auto it = range.first; it != range.second; ++it) {
-        values.push_back(it->second);
+    Shard* shard = getShardOrNull(propId);
+    if (shard == nullptr) return values;
+
+    auto shardValues = std::atomic_load(&shard->values);
+    values.reserve(shardValues->size());
+    for (auto&& it : *shardValues) {
+        values.push_back(it.second);
     }
 
     return values;
@@ -98,35 +138,46 @@ std::vector<VehiclePropValue> VehiclePropertyStore::readValuesForProperty(int32_
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         const VehiclePropValue& request) const {
-    MuxGuard g(mLock);
-    RecordId recId = getRecordIdLocked(request);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
-    return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
+    Shard* shard = getShardOrNull(request.prop);
+    return shard ? findValue(*shard, getRecordId(*shard, request)) : nullptr;
 }
 
 std::unique_ptr<VehiclePropValue> VehiclePropertyStore::readValueOrNull(
         int32_t prop, int32_t area, int64_t token) const {
-    RecordId recId = {prop, isGlobalProp(prop) ? 0 : area, token };
-    MuxGuard g(mLock);
-    const VehiclePropValue* internalValue = getValueOrNullLocked(recId);
-    return internalValue ? std::make_unique<VehiclePropValue>(*internalValue) : nullptr;
+    Shard* shard = getShardOrNull(prop);
+    return shard ? findValue(*shard, RecordId { isGlobalProp(prop) ? 0 : area, token })
+                 : nullptr;
+}
+
+void VehiclePropertyStore::setSnapshot(std::shared_ptr<VehiclePropertySnapshot> snapshot) {
+    std::atomic_store(&mSnapshot, snapshot);
+    if (snapshot == nullptr) return;
+
+    // Writers update the snapshot from now on. Holding each shard lock while copying its
+    // values makes sure a concurrent write isn't overwritten with an older value.
+    auto index = std::atomic_load(&mIndex);
+    for (const auto& shard : index->shards) {
+        MuxGuard g(shard->writeLock);
+        auto values = std::atomic_load(&shard->values);
+        for (auto&& it : *values) {
+            snapshot->writeValue(it.second, it.first.token);
+        }
+    }
 }
 
-
 std::vector<VehiclePropConfig> VehiclePropertyStore::getAllConfigs() const {
-    MuxGuard g(mLock);
+    auto index = std::atomic_load(&mIndex);
     std::vector<VehiclePropConfig> configs;
-    configs.reserve(mConfigs.size());
-    for (auto&& recordConfigIt: mConfigs) {
-        configs.push_back(recordConfigIt.second.propConfig);
+    configs.reserve(index->shards.size());
+    for (auto&& shard : index->shards) {
+        configs.push_back(shard->propConfig);
     }
     return configs;
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrNull(int32_t propId) const {
-    MuxGuard g(mLock);
-    auto recordConfigIt = mConfigs.find(propId);
-    return recordConfigIt != mConfigs.end() ? &recordConfigIt->second.propConfig : nullptr;
+    Shard* shard = getShardOrNull(propId);
+    return shard != nullptr ? &shard->propConfig : nullptr;
 }
 
 const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) const {
@@ -138,35 +189,32 @@ const VehiclePropConfig* VehiclePropertyStore::getConfigOrDie(int32_t propId) co
     return cfg;
 }
 
-VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordIdLocked(
-        const VehiclePropValue& valuePrototype) const {
+VehiclePropertyStore::Shard* VehiclePropertyStore::getShardOrNull(int32_t propId) const {
+    auto index = std::atomic_load(&mIndex);
+    auto it = index->slots.find(propId);
+    // Shards are shared by every later index and mIndex is never reset, so the
+    // shard outlives this index snapshot.
+    return it == index->slots.end() ? nullptr : index->shards[it->second].get();
+}
+
+VehiclePropertyStore::RecordId VehiclePropertyStore::getRecordId(
+        const Shard& shard, const VehiclePropValue& valuePrototype) {
     RecordId recId = {
-        .prop = valuePrototype.prop,
         .area = isGlobalProp(valuePrototype.prop) ? 0 : valuePrototype.areaId,
         .token = 0
     };
 
-    auto it = mConfigs.find(recId.prop);
-    if (it == mConfigs.end()) return {};
-
-    if (it->second.tokenFunction != nullptr) {
-        recId.token = it->second.tokenFunction(valuePrototype);
+    if (shard.tokenFunction != nullptr) {
+        recId.token = shard.tokenFunction(valuePrototype);
     }
     return recId;
 }
 
-const VehiclePropValue* VehiclePropertyStore::getValueOrNullLocked(
-        const VehiclePropertyStore::RecordId& recId) const  {
-    auto it = mPropertyValues.find(recId);
-    return it == mPropertyValues.end() ? nullptr : &it->second;
-}
-
-VehiclePropertyStore::PropertyMapRange VehiclePropertyStore::findRangeLocked(int32_t propId) const {
-    // Based on the fact that mPropertyValues is a sorted map by RecordId.
-    auto beginIt = mPropertyValues.lower_bound( RecordId { propId, INT32_MIN, 0 });
-    auto endIt = mPropertyValues.lower_bound( RecordId { propId + 1, INT32_MIN, 0 });
-
-    return  PropertyMapRange { beginIt, endIt };
+std::unique_ptr<VehiclePropValue> VehiclePropertyStore::findValue(
+        const Shard& shard, const VehiclePropertyStore::RecordId& recId) {
+    auto values = std::atomic_load(&shard.values);
+    auto it = values->find(recId);
+    return it == values->end() ? nullptr : std::make_unique<VehiclePropValue>(it->second);
 }
 
 }  // namespace V2_0
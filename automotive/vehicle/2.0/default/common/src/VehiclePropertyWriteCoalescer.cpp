@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "VehiclePropertyWriteCoalescer"
+
+#include "VehiclePropertyWriteCoalescer.h"
+
+#include <log/log.h>
+
+#include "VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+VehiclePropertyWriteCoalescer::VehiclePropertyWriteCoalescer(Writer writer, ErrorCallback onError)
+    : mWriter(std::move(writer)), mOnError(std::move(onError)) {}
+
+VehiclePropertyWriteCoalescer::~VehiclePropertyWriteCoalescer() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCond.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    flush();
+}
+
+void VehiclePropertyWriteCoalescer::setWindow(std::chrono::milliseconds window) {
+    flush();
+    std::lock_guard<std::mutex> lock(mLock);
+    mWindow = window;
+    if (mWindow.count() > 0 && !mThread.joinable()) {
+        mThread = std::thread(&VehiclePropertyWriteCoalescer::threadLoop, this);
+    }
+}
+
+StatusCode VehiclePropertyWriteCoalescer::write(const VehiclePropValue& value) {
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mWindow.count() == 0) {
+        lock.unlock();
+        std::lock_guard<std::mutex> writeLock(mWriteLock);
+        return mWriter(value);
+    }
+
+    if (mPending.empty()) {
+        mDeadline = std::chrono::steady_clock::now() + mWindow;
+        mCond.notify_one();
+    }
+    auto result = mPending.emplace(std::make_pair(value.prop, value.areaId), value);
+    if (!result.second) {
+        result.first->second = value;
+        mCoalescedCount++;
+    }
+    return StatusCode::OK;
+}
+
+void VehiclePropertyWriteCoalescer::flush() {
+    std::lock_guard<std::mutex> writeLock(mWriteLock);
+    std::map<std::pair<int32_t, int32_t>, VehiclePropValue> pending;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        pending.swap(mPending);
+    }
+    for (const auto& entry : pending) {
+        const VehiclePropValue& value = entry.second;
+        StatusCode status = mWriter(value);
+        if (status != StatusCode::OK) {
+            ALOGW("Failed to write property 0x%x area 0x%x: %d", value.prop, value.areaId,
+                  toInt(status));
+            mOnError(status, value.prop, value.areaId);
+        }
+    }
+}
+
+uint64_t VehiclePropertyWriteCoalescer::getCoalescedCount() {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mCoalescedCount;
+}
+
+void VehiclePropertyWriteCoalescer::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExit) {
+        if (mPending.empty()) {
+            mCond.wait(lock);
+            continue;
+        }
+        if (std::chrono::steady_clock::now() < mDeadline) {
+            mCond.wait_until(lock, mDeadline);
+            continue;
+        }
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+}
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
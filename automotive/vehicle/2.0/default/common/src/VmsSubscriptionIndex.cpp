@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VmsSubscriptionIndex"
+
+#include "VmsSubscriptionIndex.h"
+
+#include <log/log.h>
+
+#include <common/include/vhal_v2_0/VehicleUtils.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+static constexpr int kLayerSize = 3;
+static constexpr int kLayerAndPublisherSize = 4;
+
+VmsSubscriptionIndex::VmsSubscriptionIndex() : mState(std::make_shared<State>()) {}
+
+bool VmsSubscriptionIndex::applySubscriptionsState(const VehiclePropValue& subscriptions_state,
+                                                   VmsSubscriptionsDelta* delta) {
+    if (!isValidVmsMessage(subscriptions_state)) return false;
+    VmsMessageType type = parseMessageType(subscriptions_state);
+    if (type != VmsMessageType::SUBSCRIPTIONS_CHANGE &&
+        type != VmsMessageType::SUBSCRIPTIONS_RESPONSE) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> g(mApplyLock);
+    auto old_state = std::atomic_load(&mState);
+    std::unique_ptr<State> new_state = parseState(subscriptions_state);
+    if (new_state == nullptr) {
+        ALOGE("%s: malformed subscriptions state", __func__);
+        return false;
+    }
+    if (new_state->sequence_number <= old_state->sequence_number) return false;
+
+    if (delta != nullptr) {
+        computeDelta(*old_state, *new_state, delta);
+    }
+    std::atomic_store(&mState, std::shared_ptr<const State>(std::move(new_state)));
+    return true;
+}
+
+bool VmsSubscriptionIndex::isSubscribed(const VmsLayer& layer, int publisher_id) const {
+    auto state = std::atomic_load(&mState);
+    return state->layers.count(layer) ||
+           state->layer_publishers.count(VmsLayerAndPublisher(layer, publisher_id));
+}
+
+bool VmsSubscriptionIndex::shouldForward(const VehiclePropValue& value) const {
+    if (!isValidVmsMessage(value) || parseMessageType(value) != VmsMessageType::DATA) {
+        return true;
+    }
+    const auto& v = value.value.int32Values;
+    auto state = std::atomic_load(&mState);
+    if (v.size() < 1 + kLayerAndPublisherSize || state->sequence_number < 0) return true;
+
+    int index = toInt(VmsMessageWithLayerIntegerValuesIndex::LAYER_TYPE);
+    VmsLayer layer(v[index], v[index + 1], v[index + 2]);
+    int publisher_id =
+            v[toInt(VmsMessageWithLayerAndPublisherIdIntegerValuesIndex::PUBLISHER_ID)];
+    return state->layers.count(layer) ||
+           state->layer_publishers.count(VmsLayerAndPublisher(layer, publisher_id));
+}
+
+std::vector<VmsLayer> VmsSubscriptionIndex::getSubscribedLayers(const VmsOffers& offers) const {
+    auto state = std::atomic_load(&mState);
+    std::vector<VmsLayer> subscribed_layers;
+    for (const auto& offer : offers.offerings) {
+        if (state->layers.count(offer.layer) ||
+            state->layer_publishers.count(VmsLayerAndPublisher(offer.layer, offers.publisher_id))) {
+            subscribed_layers.push_back(offer.layer);
+        }
+    }
+    return subscribed_layers;
+}
+
+int VmsSubscriptionIndex::getSequenceNumber() const {
+    return std::atomic_load(&mState)->sequence_number;
+}
+
+std::unique_ptr<VmsSubscriptionIndex::State> VmsSubscriptionIndex::parseState(
+        const VehiclePropValue& subscriptions_state) {
+    const auto& v = subscriptions_state.value.int32Values;
+    size_t index = toInt(VmsSubscriptionsStateIntegerValuesIndex::SUBSCRIPTIONS_START);
+    if (v.size() < index) return nullptr;
+
+    auto state = std::make_unique<State>();
+    state->sequence_number = v[toInt(VmsSubscriptionsStateIntegerValuesIndex::SEQUENCE_NUMBER)];
+    const int32_t num_of_layers =
+            v[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_LAYERS)];
+    const int32_t num_of_associated_layers =
+            v[toInt(VmsSubscriptionsStateIntegerValuesIndex::NUMBER_OF_ASSOCIATED_LAYERS)];
+    if (num_of_layers < 0 || num_of_associated_layers < 0) return nullptr;
+
+    state->layers.reserve(num_of_layers);
+    for (int32_t i = 0; i < num_of_layers; i++) {
+        if (index + kLayerSize > v.size()) return nullptr;
+        state->layers.insert(VmsLayer(v[index], v[index + 1], v[index + 2]));
+        index += kLayerSize;
+    }
+    for (int32_t i = 0; i < num_of_associated_layers; i++) {
+        if (index + kLayerSize + 1 > v.size()) return nullptr;
+        VmsLayer layer(v[index], v[index + 1], v[index + 2]);
+        const int32_t num_of_publisher_ids = v[index + kLayerSize];
+        index += kLayerSize + 1;
+        if (num_of_publisher_ids < 0 || index + num_of_publisher_ids > v.size()) return nullptr;
+        for (int32_t j = 0; j < num_of_publisher_ids; j++) {
+            state->layer_publishers.insert(VmsLayerAndPublisher(layer, v[index++]));
+        }
+    }
+    return state;
+}
+
+void VmsSubscriptionIndex::computeDelta(const State& old_state, const State& new_state,
+                                        VmsSubscriptionsDelta* delta) {
+    *delta = {};
+    for (const auto& layer : new_state.layers) {
+        if (!old_state.layers.count(layer)) delta->added_layers.push_back(layer);
+    }
+    for (const auto& layer : old_state.layers) {
+        if (!new_state.layers.count(layer)) delta->removed_layers.push_back(layer);
+    }
+    for (const auto& layer_publisher : new_state.layer_publishers) {
+        if (!old_state.layer_publishers.count(layer_publisher)) {
+            delta->added_layer_publishers.push_back(layer_publisher);
+        }
+    }
+    for (const auto& layer_publisher : old_state.layer_publishers) {
+        if (!new_state.layer_publishers.count(layer_publisher)) {
+            delta->removed_layer_publishers.push_back(layer_publisher);
+        }
+    }
+}
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
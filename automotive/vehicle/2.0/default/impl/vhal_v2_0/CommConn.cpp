@@ -22,6 +22,7 @@
 #include <log/log.h>
 
 #include "CommConn.h"
+#include "EmulatorBinaryFrame.h"
 
 namespace android {
 namespace hardware {
@@ -52,15 +53,26 @@ void CommConn::sendMessage(emulator::EmulatorMessage const& msg) {
     write(buffer);
 }
 
+bool CommConn::readInto(std::vector<uint8_t>* buffer) {
+    *buffer = read();
+    return buffer->size() != 0;
+}
+
 void CommConn::readThread() {
+    // Kept across messages so that receiving doesn't allocate once it has grown to the
+    // largest message size.
     std::vector<uint8_t> buffer;
     while (isOpen()) {
-        buffer = read();
-        if (buffer.size() == 0) {
+        if (!readInto(&buffer) || buffer.size() == 0) {
             ALOGI("%s: Read returned empty message, exiting read loop.", __func__);
             break;
         }
 
+        if (isBinaryFrame(buffer.data(), buffer.size())) {
+            mMessageProcessor->processBinaryFrame(buffer.data(), buffer.size());
+            continue;
+        }
+
         emulator::EmulatorMessage rxMsg;
         if (rxMsg.ParseFromArray(buffer.data(), static_cast<int32_t>(buffer.size()))) {
             emulator::EmulatorMessage respMsg;
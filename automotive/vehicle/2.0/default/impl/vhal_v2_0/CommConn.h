@@ -46,6 +46,12 @@ class MessageProcessor {
      */
     virtual void processMessage(emulator::EmulatorMessage const& rxMsg,
                                 emulator::EmulatorMessage& respMsg) = 0;
+
+    /**
+     * Process a binary frame (see EmulatorBinaryFrame.h) received over a CommConn. Binary frames
+     * get no reply.
+     */
+    virtual void processBinaryFrame(const uint8_t* data, size_t size) = 0;
 };
 
 /**
@@ -81,6 +87,13 @@ class CommConn {
      */
     virtual std::vector<uint8_t> read() = 0;
 
+    /**
+     * Same as read(), but reuses the memory of buffer to receive the message.
+     *
+     * @return bool False if the connection was closed or some other error occurred.
+     */
+    virtual bool readInto(std::vector<uint8_t>* buffer);
+
     /**
      * Transmits a string of data to the emulator.
      *
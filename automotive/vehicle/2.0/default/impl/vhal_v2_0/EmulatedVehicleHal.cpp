@@ -87,13 +87,19 @@ static std::unique_ptr<Obd2SensorStore> fillDefaultObd2Frame(size_t numVendorInt
     return sensorStore;
 }
 
+// Fake data events due within this window are sent together, and up to kFakeDataThreads
+// generators (e.g. JSON replay files) produce events in parallel.
+static constexpr Nanos kFakeDataBatchWindow = std::chrono::milliseconds(1);
+static constexpr size_t kFakeDataThreads = 2;
+
 EmulatedVehicleHal::EmulatedVehicleHal(VehiclePropertyStore* propStore)
     : mPropStore(propStore),
       mHvacPowerProps(std::begin(kHvacPowerProperties), std::end(kHvacPowerProperties)),
       mRecurrentTimer(
           std::bind(&EmulatedVehicleHal::onContinuousPropertyTimer, this, std::placeholders::_1)),
       mGeneratorHub(
-          std::bind(&EmulatedVehicleHal::onFakeValueGenerated, this, std::placeholders::_1)) {
+          std::bind(&EmulatedVehicleHal::onFakeValuesGenerated, this, std::placeholders::_1),
+          kFakeDataBatchWindow, kFakeDataThreads) {
     initStaticConfig();
     for (size_t i = 0; i < arraysize(kVehicleProperties); i++) {
         mPropStore->registerProperty(kVehicleProperties[i].config);
@@ -153,8 +159,9 @@ StatusCode EmulatedVehicleHal::set(const VehiclePropValue& propValue) {
             case OBD2_FREEZE_FRAME_CLEAR:
                 return clearObd2FreezeFrames(propValue);
             case VEHICLE_MAP_SERVICE:
-                // Placeholder for future implementation of VMS property in the default hal. For
-                // now, just returns OK; otherwise, hal clients crash with property not supported.
+                // Only subscription states are handled by the default hal. For other messages,
+                // just returns OK; otherwise, hal clients crash with property not supported.
+                mVmsSubscriptions.applySubscriptionsState(propValue);
                 return StatusCode::OK;
             case AP_POWER_STATE_REPORT:
                 switch (propValue.value.int32Values[0]) {
@@ -326,6 +333,11 @@ bool EmulatedVehicleHal::isContinuousProperty(int32_t propId) const {
 bool EmulatedVehicleHal::setPropertyFromVehicle(const VehiclePropValue& propValue) {
     static constexpr bool shouldUpdateStatus = true;
 
+    if (propValue.prop == VEHICLE_MAP_SERVICE && !mVmsSubscriptions.shouldForward(propValue)) {
+        // Nobody subscribed to this layer, no need to send it to the VMS service
+        return true;
+    }
+
     if (propValue.prop == kGenerateFakeDataControllingProperty) {
         StatusCode status = handleGenerateFakeDataRequest(propValue);
         if (status != StatusCode::OK) {
@@ -341,6 +353,29 @@ bool EmulatedVehicleHal::setPropertyFromVehicle(const VehiclePropValue& propValu
     }
 }
 
+bool EmulatedVehicleHal::setPropertyFromVehicle(VehiclePropValuePtr propValue) {
+    static constexpr bool shouldUpdateStatus = true;
+
+    if (propValue->prop == VEHICLE_MAP_SERVICE && !mVmsSubscriptions.shouldForward(*propValue)) {
+        return true;
+    }
+
+    if (propValue->prop == kGenerateFakeDataControllingProperty) {
+        StatusCode status = handleGenerateFakeDataRequest(*propValue);
+        if (status != StatusCode::OK) {
+            return false;
+        }
+    }
+
+    if (mPropStore->writeValue(*propValue, shouldUpdateStatus)) {
+        // The store keeps its own copy, so the value itself can go to the clients
+        doHalEvent(std::move(propValue));
+        return true;
+    } else {
+        return false;
+    }
+}
+
 std::vector<VehiclePropValue> EmulatedVehicleHal::getAllProperties() const  {
     return mPropStore->readAllValues();
 }
@@ -449,6 +484,12 @@ VehicleHal::VehiclePropValuePtr EmulatedVehicleHal::createHwInputKeyProp(
     return keyEvent;
 }
 
+void EmulatedVehicleHal::onFakeValuesGenerated(const std::vector<VehiclePropValue>& values) {
+    for (const auto& value : values) {
+        onFakeValueGenerated(value);
+    }
+}
+
 void EmulatedVehicleHal::onFakeValueGenerated(const VehiclePropValue& value) {
     ALOGD("%s: %s", __func__, toString(value).c_str());
     static constexpr bool shouldUpdateStatus = false;
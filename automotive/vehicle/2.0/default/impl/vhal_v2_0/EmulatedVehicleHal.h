@@ -28,6 +28,7 @@
 #include <vhal_v2_0/RecurrentTimer.h>
 #include <vhal_v2_0/VehicleHal.h>
 #include "vhal_v2_0/VehiclePropertyStore.h"
+#include "vhal_v2_0/VmsSubscriptionIndex.h"
 
 #include "DefaultConfig.h"
 #include "GeneratorHub.h"
@@ -58,6 +59,7 @@ public:
 
     //  Methods from EmulatedVehicleHalIface
     bool setPropertyFromVehicle(const VehiclePropValue& propValue) override;
+    bool setPropertyFromVehicle(VehiclePropValuePtr propValue) override;
     std::vector<VehiclePropValue> getAllProperties() const override;
 
 private:
@@ -67,6 +69,7 @@ private:
 
     StatusCode handleGenerateFakeDataRequest(const VehiclePropValue& request);
     void onFakeValueGenerated(const VehiclePropValue& value);
+    void onFakeValuesGenerated(const std::vector<VehiclePropValue>& values);
     VehiclePropValuePtr createApPowerStateReq(VehicleApPowerStateReq req, int32_t param);
     VehiclePropValuePtr createHwInputKeyProp(VehicleHwKeyInputAction action, int32_t keyCode,
                                              int32_t targetDisplay);
@@ -86,6 +89,8 @@ private:
     std::unordered_set<int32_t> mHvacPowerProps;
     RecurrentTimer mRecurrentTimer;
     GeneratorHub mGeneratorHub;
+    // Subscriptions last reported by the VMS service, used to drop VMS data nobody subscribed to
+    vms::VmsSubscriptionIndex mVmsSubscriptions;
 };
 
 }  // impl
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits>
+
+#include <string.h>
+
+#include "EmulatorBinaryFrame.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+template <typename T>
+void appendArray(const T* values, size_t count, std::vector<uint8_t>* out) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+    out->insert(out->end(), bytes, bytes + count * sizeof(T));
+}
+
+template <typename T>
+bool copyArray(const uint8_t* data, size_t size, size_t* offset, size_t count, hidl_vec<T>* out) {
+    size_t numBytes = count * sizeof(T);
+    if (numBytes > size - *offset) {
+        return false;
+    }
+    if (out->size() != count) {
+        out->resize(count);
+    }
+    if (numBytes > 0) {
+        memcpy(out->data(), data + *offset, numBytes);
+    }
+    *offset += numBytes;
+    return true;
+}
+
+}  // namespace
+
+bool encodeBinaryValue(const VehiclePropValue& propValue, std::vector<uint8_t>* out) {
+    const auto& v = propValue.value;
+    constexpr size_t kMaxCount = std::numeric_limits<uint16_t>::max();
+    if (v.int32Values.size() > kMaxCount || v.int64Values.size() > kMaxCount ||
+        v.floatValues.size() > kMaxCount || v.bytes.size() > kMaxCount ||
+        v.stringValue.size() > kMaxCount) {
+        return false;
+    }
+
+    BinaryValueHeader header = {
+        .prop = propValue.prop,
+        .areaId = propValue.areaId,
+        .status = static_cast<int32_t>(propValue.status),
+        .timestamp = propValue.timestamp,
+        .int32Count = static_cast<uint16_t>(v.int32Values.size()),
+        .int64Count = static_cast<uint16_t>(v.int64Values.size()),
+        .floatCount = static_cast<uint16_t>(v.floatValues.size()),
+        .bytesCount = static_cast<uint16_t>(v.bytes.size()),
+        .stringLength = static_cast<uint16_t>(v.stringValue.size()),
+    };
+    appendArray(&header, 1, out);
+    appendArray(v.int32Values.data(), v.int32Values.size(), out);
+    appendArray(v.int64Values.data(), v.int64Values.size(), out);
+    appendArray(v.floatValues.data(), v.floatValues.size(), out);
+    appendArray(v.bytes.data(), v.bytes.size(), out);
+    appendArray(v.stringValue.c_str(), v.stringValue.size(), out);
+    return true;
+}
+
+bool decodeBinaryValue(const uint8_t* data, size_t size, size_t* offset,
+                       VehiclePropValue* propValue) {
+    BinaryValueHeader header;
+    if (sizeof(header) > size - *offset) {
+        return false;
+    }
+    memcpy(&header, data + *offset, sizeof(header));
+    size_t newOffset = *offset + sizeof(header);
+
+    propValue->prop = header.prop;
+    propValue->areaId = header.areaId;
+    propValue->status = static_cast<VehiclePropertyStatus>(header.status);
+    propValue->timestamp = header.timestamp;
+
+    auto& v = propValue->value;
+    if (!copyArray(data, size, &newOffset, header.int32Count, &v.int32Values) ||
+        !copyArray(data, size, &newOffset, header.int64Count, &v.int64Values) ||
+        !copyArray(data, size, &newOffset, header.floatCount, &v.floatValues) ||
+        !copyArray(data, size, &newOffset, header.bytesCount, &v.bytes) ||
+        header.stringLength > size - newOffset) {
+        return false;
+    }
+    if (header.stringLength > 0 || v.stringValue.size() > 0) {
+        v.stringValue =
+            std::string(reinterpret_cast<const char*>(data + newOffset), header.stringLength);
+    }
+    *offset = newOffset + header.stringLength;
+    return true;
+}
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
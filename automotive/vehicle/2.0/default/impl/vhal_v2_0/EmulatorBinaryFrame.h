@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_automotive_vehicle_V2_0_impl_EmulatorBinaryFrame_H_
+#define android_hardware_automotive_vehicle_V2_0_impl_EmulatorBinaryFrame_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <android/hardware/automotive/vehicle/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+/**
+ * Binary framing used by host tools to inject property values at high rates without protobuf
+ * encoding. A binary frame is sent in place of a serialized EmulatorMessage, over the same
+ * socket or pipe framing, and sets any number of property values from the vehicle side. No
+ * response is sent for binary frames.
+ *
+ * All fields are little endian and packed, the frame layout is:
+ *
+ *   BinaryFrameHeader
+ *   BinaryValueHeader, followed by its int32Count int32 values, int64Count int64 values,
+ *                      floatCount float values, bytesCount bytes and stringLength chars
+ *   ... repeated valueCount times
+ *
+ * The magic can't start a valid protobuf message (0x56 encodes the invalid wire type 6), so
+ * both framings can be mixed on one connection.
+ */
+constexpr uint8_t kBinaryFrameMagic[4] = { 'V', 'H', 'B', '1' };
+
+struct __attribute__((packed)) BinaryFrameHeader {
+    uint8_t magic[4];
+    uint32_t valueCount;
+};
+
+struct __attribute__((packed)) BinaryValueHeader {
+    int32_t prop;
+    int32_t areaId;
+    int32_t status;
+    int64_t timestamp;  // elapsedRealtimeNano(), 0 to use the receive time
+    uint16_t int32Count;
+    uint16_t int64Count;
+    uint16_t floatCount;
+    uint16_t bytesCount;
+    uint16_t stringLength;
+};
+
+inline bool isBinaryFrame(const uint8_t* data, size_t size) {
+    return size >= sizeof(BinaryFrameHeader) && data[0] == kBinaryFrameMagic[0] &&
+           data[1] == kBinaryFrameMagic[1] && data[2] == kBinaryFrameMagic[2] &&
+           data[3] == kBinaryFrameMagic[3];
+}
+
+/**
+ * Appends propValue encoded as a BinaryValueHeader followed by its payload to out. Returns false
+ * if a vector of propValue is too long to be encoded.
+ */
+bool encodeBinaryValue(const VehiclePropValue& propValue, std::vector<uint8_t>* out);
+
+/**
+ * Decodes the BinaryValueHeader at *offset of data and its payload into propValue, reusing the
+ * memory of its vectors, then advances *offset past the value. Returns false if the value doesn't
+ * fit in size.
+ */
+bool decodeBinaryValue(const uint8_t* data, size_t size, size_t* offset,
+                       VehiclePropValue* propValue);
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_automotive_vehicle_V2_0_impl_EmulatorBinaryFrame_H_
@@ -17,6 +17,7 @@
 #define LOG_TAG "GeneratorHub"
 
 #include <log/log.h>
+#include <algorithm>
 
 #include "GeneratorHub.h"
 
@@ -29,71 +30,121 @@ namespace V2_0 {
 namespace impl {
 
 GeneratorHub::GeneratorHub(const OnHalEvent& onHalEvent)
-    : mOnHalEvent(onHalEvent), mThread(&GeneratorHub::run, this) {}
+    : GeneratorHub(
+          [onHalEvent](const std::vector<VehiclePropValue>& events) {
+              for (const auto& event : events) {
+                  onHalEvent(event);
+              }
+          },
+          Nanos(0)) {}
+
+GeneratorHub::GeneratorHub(const OnHalEventBatch& onHalEventBatch, Nanos batchWindow,
+                           size_t numThreads)
+    : mOnHalEventBatch(onHalEventBatch), mBatchWindow(batchWindow) {
+    for (size_t i = 0; i < std::max(numThreads, static_cast<size_t>(1)); i++) {
+        mShards.push_back(std::make_unique<Shard>());
+    }
+    // Start threads once all shards exist, run() doesn't look at other shards
+    for (auto& shard : mShards) {
+        shard->thread = std::thread(&GeneratorHub::run, this, shard.get());
+    }
+}
+
+GeneratorHub::~GeneratorHub() {
+    mExit = true;
+    for (auto& shard : mShards) {
+        {
+            std::lock_guard<std::mutex> g(shard->lock);
+        }
+        shard->cond.notify_one();
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+}
 
 void GeneratorHub::registerGenerator(int32_t cookie, FakeValueGeneratorPtr generator) {
+    Shard* shard = getShard(cookie);
     {
-        std::lock_guard<std::mutex> g(mLock);
+        std::lock_guard<std::mutex> g(shard->lock);
         // Register only if the generator can produce event
         if (generator->hasNext()) {
             // Push the next event if it is a new generator
-            if (mGenerators.find(cookie) == mGenerators.end()) {
+            if (shard->generators.find(cookie) == shard->generators.end()) {
                 ALOGI("%s: Registering new generator, cookie: %d", __func__, cookie);
-                mEventQueue.push({cookie, generator->nextEvent()});
+                shard->eventQueue.push({cookie, generator->nextEvent()});
             }
-            mGenerators[cookie] = std::move(generator);
+            shard->generators[cookie] = std::move(generator);
             ALOGI("%s: Registered generator, cookie: %d", __func__, cookie);
         }
     }
-    mCond.notify_one();
+    shard->cond.notify_one();
 }
 
 void GeneratorHub::unregisterGenerator(int32_t cookie) {
+    Shard* shard = getShard(cookie);
     {
-        std::lock_guard<std::mutex> g(mLock);
-        mGenerators.erase(cookie);
+        std::lock_guard<std::mutex> g(shard->lock);
+        shard->generators.erase(cookie);
     }
-    mCond.notify_one();
+    shard->cond.notify_one();
     ALOGI("%s: Unregistered generator, cookie: %d", __func__, cookie);
 }
 
-void GeneratorHub::run() {
-    while (true) {
-        std::unique_lock<std::mutex> g(mLock);
+void GeneratorHub::run(Shard* shard) {
+    std::vector<VehiclePropValue> batch;
+    auto& queue = shard->eventQueue;
+    while (!mExit) {
+        std::unique_lock<std::mutex> g(shard->lock);
         // Pop events whose generator does not exist (may be already unregistered)
-        while (!mEventQueue.empty()
-               && mGenerators.find(mEventQueue.top().cookie) == mGenerators.end()) {
-             mEventQueue.pop();
+        while (!queue.empty()
+               && shard->generators.find(queue.top().cookie) == shard->generators.end()) {
+             queue.pop();
         }
         // Wait until event queue is not empty
-        mCond.wait(g, [this] { return !mEventQueue.empty(); });
-
-        const VhalEvent& curEvent = mEventQueue.top();
+        shard->cond.wait(g, [this, &queue] { return mExit || !queue.empty(); });
+        if (mExit) break;
 
-        TimePoint eventTime(Nanos(curEvent.val.timestamp));
+        TimePoint eventTime(Nanos(queue.top().val.timestamp));
         // Wait until the soonest event happen
-        if (mCond.wait_until(g, eventTime) != std::cv_status::timeout) {
+        if (shard->cond.wait_until(g, eventTime) != std::cv_status::timeout) {
         // It is possible that a new generator is registered and produced a sooner event, or current
         // generator is unregistered, in this case the thread will re-evaluate the soonest event
             ALOGI("Something happened while waiting");
             continue;
         }
-        // Now it's time to handle current event.
-        mOnHalEvent(curEvent.val);
-        // Update queue by popping current event and producing next event from the same generator
-        int32_t cookie = curEvent.cookie;
-        mEventQueue.pop();
-        if (hasNext(cookie)) {
-            mEventQueue.push({cookie, mGenerators[cookie]->nextEvent()});
-        } else {
-            ALOGI("%s: Generator ended, unregister it, cookie: %d", __func__, cookie);
-            mGenerators.erase(cookie);
+        // Now it's time to handle current event and the ones due within the batch window. The
+        // queue is updated by popping each event and producing next event from the same generator
+        const int64_t batchEnd = queue.top().val.timestamp + mBatchWindow.count();
+        while (!queue.empty() && queue.top().val.timestamp <= batchEnd &&
+               batch.size() < kMaxBatchSize) {
+            int32_t cookie = queue.top().cookie;
+            if (shard->generators.find(cookie) != shard->generators.end()) {
+                batch.push_back(queue.top().val);
+            }
+            queue.pop();
+            if (hasNext(shard, cookie)) {
+                queue.push({cookie, shard->generators[cookie]->nextEvent()});
+            } else if (shard->generators.erase(cookie)) {
+                ALOGI("%s: Generator ended, unregister it, cookie: %d", __func__, cookie);
+            }
+        }
+        g.unlock();
+
+        if (!batch.empty()) {
+            mOnHalEventBatch(batch);
+            batch.clear();
         }
     }
 }
 
-bool GeneratorHub::hasNext(int32_t cookie) {
-    return mGenerators.find(cookie) != mGenerators.end() && mGenerators[cookie]->hasNext();
+GeneratorHub::Shard* GeneratorHub::getShard(int32_t cookie) const {
+    return mShards[static_cast<uint32_t>(cookie) % mShards.size()].get();
+}
+
+bool GeneratorHub::hasNext(Shard* shard, int32_t cookie) {
+    auto it = shard->generators.find(cookie);
+    return it != shard->generators.end() && it->second->hasNext();
 }
 
 }  // namespace impl
@@ -20,10 +20,14 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "FakeValueGenerator.h"
 
@@ -37,9 +41,13 @@ namespace impl {
 
 /**
  * This is the scheduler for all VHAL event generators. It manages all generators and uses priority
- * queue to maintain generated events ordered by timestamp. The scheduler uses a single thread to
- * keep querying and updating the event queue to make sure events from all generators are produced
- * in order.
+ * queue to maintain generated events ordered by timestamp. Generators are spread over one or more
+ * threads by cookie, each thread keeps querying and updating its own event queue to make sure
+ * events from its generators are produced in order.
+ *
+ * When the soonest event of a thread is due, all events of that thread due within the batch window
+ * after it are delivered together, outside of the lock, so dense traces don't cost one wakeup per
+ * event.
  */
 class GeneratorHub {
 private:
@@ -55,10 +63,33 @@ private:
     };
 
     using OnHalEvent = std::function<void(const VehiclePropValue& event)>;
+    using OnHalEventBatch = std::function<void(const std::vector<VehiclePropValue>& events)>;
+
+    // Generators handled by one thread
+    struct Shard {
+        std::priority_queue<VhalEvent, std::vector<VhalEvent>, GreaterByTime> eventQueue;
+        std::unordered_map<int32_t, FakeValueGeneratorPtr> generators;
+
+        std::mutex lock;
+        std::condition_variable cond;
+        std::thread thread;
+    };
 
 public:
+    // Upper bound of events delivered in one batch, so a generator with a fixed timestamp can't
+    // keep its thread busy forever.
+    static constexpr size_t kMaxBatchSize = 256;
+
+    /* Delivers events one by one, as soon as they are due, from a single thread */
     GeneratorHub(const OnHalEvent& onHalEvent);
-    ~GeneratorHub() = default;
+    /**
+     * @param batchWindow - events due within this time after the soonest event are delivered
+     *                      with it
+     * @param numThreads - number of threads producing events, generators are assigned to them by
+     *                     cookie
+     */
+    GeneratorHub(const OnHalEventBatch& onHalEventBatch, Nanos batchWindow, size_t numThreads = 1);
+    ~GeneratorHub();
 
     /**
      * Register a new generator. The generator will be discarded if it could not produce next event.
@@ -70,20 +101,18 @@ public:
 
 private:
     /**
-     * Main loop of the single thread to producing event and updating event queue.
+     * Main loop of the thread of a shard producing events and updating its event queue.
      */
-    void run();
+    void run(Shard* shard);
 
-    bool hasNext(int32_t cookie);
+    Shard* getShard(int32_t cookie) const;
+    static bool hasNext(Shard* shard, int32_t cookie);
 
 private:
-    std::priority_queue<VhalEvent, std::vector<VhalEvent>, GreaterByTime> mEventQueue;
-    std::unordered_map<int32_t, FakeValueGeneratorPtr> mGenerators;
-    OnHalEvent mOnHalEvent;
-
-    mutable std::mutex mLock;
-    std::condition_variable mCond;
-    std::thread mThread;
+    const OnHalEventBatch mOnHalEventBatch;
+    const Nanos mBatchWindow;
+    std::atomic<bool> mExit { false };
+    std::vector<std::unique_ptr<Shard>> mShards;
 };
 
 }  // namespace impl
@@ -16,13 +16,21 @@
 
 #define LOG_TAG "JsonFakeValueGenerator"
 
-#include <fstream>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <type_traits>
 #include <typeinfo>
 
 #include <log/log.h>
 #include <vhal_v2_0/VehicleUtils.h>
 
+#include "EmulatorBinaryFrame.h"
 #include "JsonFakeValueGenerator.h"
 
 namespace android {
@@ -35,17 +43,19 @@ namespace impl {
 
 JsonFakeValueGenerator::JsonFakeValueGenerator(const VehiclePropValue& request) {
     const auto& v = request.value;
-    const char* file = v.stringValue.c_str();
-    std::ifstream ifs(file);
-    if (!ifs) {
-        ALOGE("%s: couldn't open %s for parsing.", __func__, file);
-    }
-    mGenCfg = {
-        .index = 0,
-        .events = parseFakeValueJson(ifs),
-    };
+    const std::string file = v.stringValue;
     // Iterate infinitely if repetition number is not provided
     mNumOfIterations = v.int32Values.size() < 2 ? -1 : v.int32Values[1];
+    if (!openTrace(file)) {
+        ALOGE("%s: couldn't open %s for parsing.", __func__, file.c_str());
+    } else {
+        // Converting only pays off if there is a next pass
+        mRecording = mNumOfIterations != 1;
+    }
+}
+
+JsonFakeValueGenerator::~JsonFakeValueGenerator() {
+    closeTrace();
 }
 
 VehiclePropValue JsonFakeValueGenerator::nextEvent() {
@@ -53,90 +63,258 @@ VehiclePropValue JsonFakeValueGenerator::nextEvent() {
     if (!hasNext()) {
         return generatedValue;
     }
+    generatedValue = std::move(mLookahead.front());
+    mLookahead.pop_front();
+
     TimePoint eventTime = Clock::now();
-    if (mGenCfg.index != 0) {
+    if (!mFirstEventOfPass) {
         // All events (start from 2nd one) are supposed to happen in the future with a delay
         // equals to the duration between previous and current event.
-        eventTime += Nanos(mGenCfg.events[mGenCfg.index].timestamp -
-                           mGenCfg.events[mGenCfg.index - 1].timestamp);
+        eventTime += Nanos(generatedValue.timestamp - mLastTraceTimestamp);
     }
-    generatedValue = mGenCfg.events[mGenCfg.index];
+    mFirstEventOfPass = false;
+    mLastTraceTimestamp = generatedValue.timestamp;
     generatedValue.timestamp = eventTime.time_since_epoch().count();
+    return generatedValue;
+}
+
+bool JsonFakeValueGenerator::hasNext() {
+    if (mNumOfIterations == 0) {
+        return false;
+    }
+    fillLookahead();
+    if (!mLookahead.empty()) {
+        return true;
+    }
+
+    // Reached the end of the trace
+    if (mEventsInPass == 0) {
+        return false;
+    }
+    finishBinaryTrace();
+    if (mNumOfIterations > 0 && --mNumOfIterations == 0) {
+        return false;
+    }
+    mReadOffset = mDataStart;
+    mEventsInPass = 0;
+    mFirstEventOfPass = true;
+    fillLookahead();
+    return !mLookahead.empty();
+}
+
+bool JsonFakeValueGenerator::openTrace(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    const size_t size = st.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the fd is closed
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        ALOGE("%s: failed to map %s: %s", __func__, path.c_str(), strerror(errno));
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    // A JSON trace is an array of events
+    const char* json = static_cast<const char*>(mapping);
+    size_t pos = 0;
+    while (pos < size && isspace(json[pos])) pos++;
+    if (pos == size || json[pos] != '[') {
+        ALOGE("%s: Failed to parse fake data JSON file %s, expected an array", __func__,
+              path.c_str());
+        munmap(mapping, size);
+        return false;
+    }
+
+    closeTrace();
+    mData = static_cast<const uint8_t*>(mapping);
+    mSize = size;
+    mIsBinary = false;
+    mDataStart = pos + 1;
+    mReadOffset = mDataStart;
+    return true;
+}
+
+void JsonFakeValueGenerator::closeTrace() {
+    if (mData != nullptr && !mIsBinary) {
+        munmap(const_cast<uint8_t*>(mData), mSize);
+    }
+    mData = nullptr;
+    mSize = 0;
+    mDataStart = 0;
+    mReadOffset = 0;
+}
 
-    mGenCfg.index++;
-    if (mGenCfg.index == mGenCfg.events.size()) {
-        mGenCfg.index = 0;
-        if (mNumOfIterations > 0) {
-            mNumOfIterations--;
+void JsonFakeValueGenerator::finishBinaryTrace() {
+    if (!mRecording) return;
+
+    mRecording = false;
+    closeTrace();
+    mData = mBinaryTrace.data();
+    mSize = mBinaryTrace.size();
+    mIsBinary = true;
+    mDataStart = 0;
+    mReadOffset = 0;
+    ALOGI("%s: converted trace to %zu bytes", __func__, mSize);
+}
+
+void JsonFakeValueGenerator::fillLookahead() {
+    while (mLookahead.size() < kMaxParseAheadEvents &&
+           (mLookahead.empty() ||
+            mLookahead.back().timestamp - mLookahead.front().timestamp < kParseAheadNanos)) {
+        VehiclePropValue event;
+        if (!readNextEvent(&event)) {
+            break;
         }
+        mLookahead.push_back(std::move(event));
     }
-    return generatedValue;
 }
 
-bool JsonFakeValueGenerator::hasNext() {
-    return mNumOfIterations != 0 && mGenCfg.events.size() > 0;
+bool JsonFakeValueGenerator::readNextEvent(VehiclePropValue* event) {
+    while (true) {
+        ReadResult result = mIsBinary ? readNextBinaryEvent(event) : readNextJsonEvent(event);
+        if (result == ReadResult::END) {
+            return false;
+        }
+        if (result == ReadResult::SKIPPED) {
+            continue;
+        }
+        mEventsInPass++;
+        if (mRecording && !encodeBinaryValue(*event, &mBinaryTrace)) {
+            ALOGW("%s: failed to convert event of property: 0x%x", __func__, event->prop);
+            mRecording = false;
+            std::vector<uint8_t>().swap(mBinaryTrace);
+        }
+        return true;
+    }
 }
 
-std::vector<VehiclePropValue> JsonFakeValueGenerator::parseFakeValueJson(std::istream& is) {
-    std::vector<VehiclePropValue> fakeVhalEvents;
+JsonFakeValueGenerator::ReadResult JsonFakeValueGenerator::readNextJsonEvent(
+        VehiclePropValue* event) {
+    const char* json = reinterpret_cast<const char*>(mData);
+    size_t pos = mReadOffset;
+    while (pos < mSize && (isspace(json[pos]) || json[pos] == ',')) pos++;
+    if (pos >= mSize || json[pos] == ']') {
+        mReadOffset = mSize;
+        return ReadResult::END;
+    }
+    size_t end = findJsonValueEnd(json, pos, mSize);
+    mReadOffset = end;
 
     Json::Reader reader;
-    Json::Value rawEvents;
-    if (!reader.parse(is, rawEvents)) {
+    Json::Value rawEvent;
+    if (!reader.parse(json + pos, json + end, rawEvent, false /* collectComments */)) {
         ALOGE("%s: Failed to parse fake data JSON file. Error: %s", __func__,
               reader.getFormattedErrorMessages().c_str());
-        return fakeVhalEvents;
+        // Nothing after a value that doesn't parse can be trusted
+        mReadOffset = mSize;
+        return ReadResult::END;
     }
+    return parseFakeValueJson(rawEvent, event) ? ReadResult::EVENT : ReadResult::SKIPPED;
+}
 
-    for (Json::Value::ArrayIndex i = 0; i < rawEvents.size(); i++) {
-        Json::Value rawEvent = rawEvents[i];
-        if (!rawEvent.isObject()) {
-            ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
-                  rawEvent.toStyledString().c_str());
-            continue;
-        }
-        if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
-            rawEvent["timestamp"].empty()) {
-            ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
-                  rawEvent.toStyledString().c_str());
+JsonFakeValueGenerator::ReadResult JsonFakeValueGenerator::readNextBinaryEvent(
+        VehiclePropValue* event) {
+    if (mReadOffset >= mSize) {
+        return ReadResult::END;
+    }
+    if (!decodeBinaryValue(mData, mSize, &mReadOffset, event)) {
+        ALOGE("%s: truncated binary trace", __func__);
+        mReadOffset = mSize;
+        return ReadResult::END;
+    }
+    return ReadResult::EVENT;
+}
+
+size_t JsonFakeValueGenerator::findJsonValueEnd(const char* data, size_t pos, size_t size) {
+    int depth = 0;
+    bool inString = false;
+    for (size_t i = pos; i < size; i++) {
+        char c = data[i];
+        if (inString) {
+            if (c == '\\') {
+                i++;
+            } else if (c == '"') {
+                inString = false;
+            }
             continue;
         }
-        VehiclePropValue event = {.prop = rawEvent["prop"].asInt(),
-                                  .areaId = rawEvent["areaId"].asInt(),
-                                  .timestamp = rawEvent["timestamp"].asInt64()};
-
-        Json::Value rawEventValue = rawEvent["value"];
-        auto& value = event.value;
-        switch (getPropType(event.prop)) {
-            case VehiclePropertyType::BOOLEAN:
-            case VehiclePropertyType::INT32:
-                value.int32Values.resize(1);
-                value.int32Values[0] = rawEventValue.asInt();
-                break;
-            case VehiclePropertyType::INT64:
-                value.int64Values.resize(1);
-                value.int64Values[0] = rawEventValue.asInt64();
+        switch (c) {
+            case '"':
+                inString = true;
                 break;
-            case VehiclePropertyType::FLOAT:
-                value.floatValues.resize(1);
-                value.floatValues[0] = rawEventValue.asFloat();
+            case '{':
+            case '[':
+                depth++;
                 break;
-            case VehiclePropertyType::STRING:
-                value.stringValue = rawEventValue.asString();
+            case '}':
+            case ']':
+                if (depth == 0) return i;  // end of the enclosing array
+                if (--depth == 0) return i + 1;
                 break;
-            case VehiclePropertyType::MIXED:
-                copyMixedValueJson(value, rawEventValue);
-                if (isDiagnosticProperty(event.prop)) {
-                    value.bytes = generateDiagnosticBytes(value);
-                }
+            case ',':
+                if (depth == 0) return i;
                 break;
-            default:
-                ALOGE("%s: unsupported type for property: 0x%x", __func__, event.prop);
-                continue;
         }
-        fakeVhalEvents.push_back(event);
     }
-    return fakeVhalEvents;
+    return size;
+}
+
+bool JsonFakeValueGenerator::parseFakeValueJson(const Json::Value& rawEvent,
+                                                VehiclePropValue* outEvent) {
+    if (!rawEvent.isObject()) {
+        ALOGE("%s: VHAL JSON event should be an object, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    if (rawEvent["prop"].empty() || rawEvent["areaId"].empty() || rawEvent["value"].empty() ||
+        rawEvent["timestamp"].empty()) {
+        ALOGE("%s: VHAL JSON event has missing fields, skip it, %s", __func__,
+              rawEvent.toStyledString().c_str());
+        return false;
+    }
+    VehiclePropValue event = {.prop = rawEvent["prop"].asInt(),
+                              .areaId = rawEvent["areaId"].asInt(),
+                              .timestamp = rawEvent["timestamp"].asInt64()};
+
+    Json::Value rawEventValue = rawEvent["value"];
+    auto& value = event.value;
+    switch (getPropType(event.prop)) {
+        case VehiclePropertyType::BOOLEAN:
+        case VehiclePropertyType::INT32:
+            value.int32Values.resize(1);
+            value.int32Values[0] = rawEventValue.asInt();
+            break;
+        case VehiclePropertyType::INT64:
+            value.int64Values.resize(1);
+            value.int64Values[0] = rawEventValue.asInt64();
+            break;
+        case VehiclePropertyType::FLOAT:
+            value.floatValues.resize(1);
+            value.floatValues[0] = rawEventValue.asFloat();
+            break;
+        case VehiclePropertyType::STRING:
+            value.stringValue = rawEventValue.asString();
+            break;
+        case VehiclePropertyType::MIXED:
+            copyMixedValueJson(value, rawEventValue);
+            if (isDiagnosticProperty(event.prop)) {
+                value.bytes = generateDiagnosticBytes(value);
+            }
+            break;
+        default:
+            ALOGE("%s: unsupported type for property: 0x%x", __func__, event.prop);
+            return false;
+    }
+    *outEvent = std::move(event);
+    return true;
 }
 
 void JsonFakeValueGenerator::copyMixedValueJson(VehiclePropValue::RawValue& dest,
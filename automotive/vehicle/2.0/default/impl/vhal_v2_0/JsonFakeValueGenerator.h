@@ -18,7 +18,10 @@
 #define android_hardware_automotive_vehicle_V2_0_impl_JsonFakeValueGenerator_H_
 
 #include <chrono>
+#include <deque>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <json/json.h>
 
@@ -32,23 +35,42 @@ namespace V2_0 {
 
 namespace impl {
 
+/**
+ * Replays a trace of VHAL events from a JSON file.
+ *
+ * The trace file is memory mapped and events are parsed incrementally, at most kParseAheadNanos of
+ * trace time ahead of the playback. When the trace is replayed more than once, the first pass also
+ * encodes its events into a binary trace in memory, and the following passes replay that one,
+ * which doesn't need parsing. Nothing is written next to the JSON file, which may be read-only.
+ */
 class JsonFakeValueGenerator : public FakeValueGenerator {
-private:
-    struct GeneratorCfg {
-        size_t index;
-        std::vector<VehiclePropValue> events;
-    };
-
 public:
+    static constexpr int64_t kParseAheadNanos = 1000000000;  // 1s
+    static constexpr size_t kMaxParseAheadEvents = 1024;
+
     JsonFakeValueGenerator(const VehiclePropValue& request);
-    ~JsonFakeValueGenerator() = default;
+    ~JsonFakeValueGenerator();
 
     VehiclePropValue nextEvent();
 
     bool hasNext();
 
 private:
-    std::vector<VehiclePropValue> parseFakeValueJson(std::istream& is);
+    enum class ReadResult { EVENT, SKIPPED, END };
+
+    // Maps the JSON trace at path. Returns false if it can't be replayed.
+    bool openTrace(const std::string& path);
+    void closeTrace();
+    // Switches to the binary trace once the whole JSON trace was read into it
+    void finishBinaryTrace();
+
+    void fillLookahead();
+    bool readNextEvent(VehiclePropValue* event);
+    ReadResult readNextJsonEvent(VehiclePropValue* event);
+    ReadResult readNextBinaryEvent(VehiclePropValue* event);
+    static size_t findJsonValueEnd(const char* data, size_t pos, size_t size);
+
+    bool parseFakeValueJson(const Json::Value& rawEvent, VehiclePropValue* event);
     void copyMixedValueJson(VehiclePropValue::RawValue& dest, const Json::Value& jsonValue);
 
     template <typename T>
@@ -59,8 +81,24 @@ private:
     void setBit(hidl_vec<uint8_t>& bytes, size_t idx);
 
 private:
-    GeneratorCfg mGenCfg;
+    // The mapped JSON trace, or mBinaryTrace once it is complete
+    const uint8_t* mData = nullptr;
+    size_t mSize = 0;
+    bool mIsBinary = false;
+    size_t mDataStart = 0;   // offset of the first event of the trace
+    size_t mReadOffset = 0;  // offset of the next event to parse
+
+    // Parsed events with their trace timestamps, in trace order
+    std::deque<VehiclePropValue> mLookahead;
+    size_t mEventsInPass = 0;  // events parsed since the trace was last rewound
+    bool mFirstEventOfPass = true;
+    int64_t mLastTraceTimestamp = 0;
     int32_t mNumOfIterations;
+
+    // The events of the JSON trace in the encoding of encodeBinaryValue(), with their trace
+    // timestamps, recorded during the first pass
+    bool mRecording = false;
+    std::vector<uint8_t> mBinaryTrace;
 };
 
 }  // namespace impl
@@ -58,23 +58,32 @@ void PipeComm::stop() {
 }
 
 std::vector<uint8_t> PipeComm::read() {
+    std::vector<uint8_t> msg;
+    if (!readInto(&msg)) {
+        msg.clear();
+    }
+    return msg;
+}
+
+bool PipeComm::readInto(std::vector<uint8_t>* buffer) {
     static constexpr int MAX_RX_MSG_SZ = 2048;
-    std::vector<uint8_t> msg = std::vector<uint8_t>(MAX_RX_MSG_SZ);
+    // Only allocates on the first call when buffer is reused
+    buffer->resize(MAX_RX_MSG_SZ);
     int numBytes;
 
-    numBytes = qemu_pipe_frame_recv(mPipeFd, msg.data(), msg.size());
+    numBytes = qemu_pipe_frame_recv(mPipeFd, buffer->data(), buffer->size());
 
     if (numBytes == MAX_RX_MSG_SZ) {
         ALOGE("%s: Received max size = %d", __FUNCTION__, MAX_RX_MSG_SZ);
     } else if (numBytes > 0) {
-        msg.resize(numBytes);
-        return msg;
+        buffer->resize(numBytes);
+        return true;
     } else {
         ALOGD("%s: Connection terminated on pipe %d, numBytes=%d", __FUNCTION__, mPipeFd, numBytes);
         mPipeFd = -1;
     }
 
-    return std::vector<uint8_t>();
+    return false;
 }
 
 int PipeComm::write(const std::vector<uint8_t>& data) {
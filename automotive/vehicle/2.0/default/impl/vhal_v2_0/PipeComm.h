@@ -44,6 +44,7 @@ class PipeComm : public CommConn {
     void stop() override;
 
     std::vector<uint8_t> read() override;
+    bool readInto(std::vector<uint8_t>* buffer) override;
     int write(const std::vector<uint8_t>& data) override;
 
     inline bool isOpen() override { return mPipeFd > 0; }
@@ -19,6 +19,7 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 #include <android/log.h>
 #include <arpa/inet.h>
+#include <errno.h>
 #include <log/log.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
@@ -140,47 +141,54 @@ SocketConn::SocketConn(MessageProcessor* messageProcessor, int sfd)
     : CommConn(messageProcessor), mSockFd(sfd) {}
 
 /**
- * Reads, in a loop, exactly numBytes from the given fd. If the connection is closed, returns
- * an empty buffer, otherwise will return exactly the given number of bytes.
+ * Reads, in a loop, exactly numBytes from the given fd into data. Returns false if the
+ * connection is closed or on error.
  */
-std::vector<uint8_t> readExactly(int fd, int numBytes) {
-    std::vector<uint8_t> buffer(numBytes);
-    int totalRead = 0;
-    int offset = 0;
-    while (totalRead < numBytes) {
-        int numRead = ::read(fd, &buffer.data()[offset], numBytes - offset);
-        if (numRead == 0) {
-            buffer.resize(0);
-            return buffer;
+static bool readExactly(int fd, uint8_t* data, size_t numBytes) {
+    size_t offset = 0;
+    while (offset < numBytes) {
+        ssize_t numRead = ::read(fd, data + offset, numBytes - offset);
+        if (numRead < 0 && errno == EINTR) {
+            continue;
         }
-
-        totalRead += numRead;
+        if (numRead <= 0) {
+            return false;
+        }
+        offset += numRead;
     }
-    return buffer;
+    return true;
 }
 
 /**
  * Reads an int, guaranteed to be non-zero, from the given fd. If the connection is closed, returns
  * -1.
  */
-int32_t readInt(int fd) {
-    std::vector<uint8_t> buffer = readExactly(fd, sizeof(int32_t));
-    if (buffer.size() == 0) {
+static int32_t readInt(int fd) {
+    int32_t value;
+    if (!readExactly(fd, reinterpret_cast<uint8_t*>(&value), sizeof(value))) {
         return -1;
     }
-
-    int32_t value = *reinterpret_cast<int32_t*>(buffer.data());
     return ntohl(value);
 }
 
 std::vector<uint8_t> SocketConn::read() {
+    std::vector<uint8_t> buffer;
+    if (!readInto(&buffer)) {
+        buffer.clear();
+    }
+    return buffer;
+}
+
+bool SocketConn::readInto(std::vector<uint8_t>* buffer) {
     int32_t msgSize = readInt(mSockFd);
     if (msgSize <= 0) {
         ALOGD("%s: Connection terminated on socket %d", __FUNCTION__, mSockFd);
-        return std::vector<uint8_t>();
+        return false;
     }
 
-    return readExactly(mSockFd, msgSize);
+    // Doesn't reallocate unless the message is larger than any before
+    buffer->resize(msgSize);
+    return readExactly(mSockFd, buffer->data(), msgSize);
 }
 
 void SocketConn::stop() {
@@ -92,6 +92,7 @@ class SocketConn : public CommConn {
      *              an empty vector if the connection was closed or some other error occurred.
      */
     std::vector<uint8_t> read() override;
+    bool readInto(std::vector<uint8_t>* buffer) override;
 
     /**
      * Closes a connection if it is open.
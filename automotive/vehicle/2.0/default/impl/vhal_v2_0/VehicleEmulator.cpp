@@ -23,6 +23,7 @@
 
 #include <vhal_v2_0/VehicleUtils.h>
 
+#include "EmulatorBinaryFrame.h"
 #include "PipeComm.h"
 #include "SocketComm.h"
 
@@ -212,6 +213,75 @@ void VehicleEmulator::processMessage(emulator::EmulatorMessage const& rxMsg,
     }
 }
 
+VehicleHal::VehiclePropValuePtr VehicleEmulator::decodeBinaryValue(const uint8_t* data,
+                                                                   size_t size, size_t* offset) {
+    BinaryValueHeader header;
+    if (sizeof(header) > size - *offset) {
+        return nullptr;
+    }
+    memcpy(&header, data + *offset, sizeof(header));
+
+    // Obtain a value of the pool matching the property type so that it gets recycled, values
+    // carrying fields outside of their type are disposable.
+    size_t totalCount = header.int32Count + header.int64Count + header.floatCount +
+                        header.bytesCount + header.stringLength;
+    size_t vecSize = 0;
+    VehiclePropertyType type = getPropType(header.prop);
+    switch (type) {
+        case VehiclePropertyType::INT32:
+        case VehiclePropertyType::INT32_VEC:
+        case VehiclePropertyType::BOOLEAN:
+            vecSize = header.int32Count;
+            break;
+        case VehiclePropertyType::INT64:
+        case VehiclePropertyType::INT64_VEC:
+            vecSize = header.int64Count;
+            break;
+        case VehiclePropertyType::FLOAT:
+        case VehiclePropertyType::FLOAT_VEC:
+            vecSize = header.floatCount;
+            break;
+        case VehiclePropertyType::BYTES:
+            vecSize = header.bytesCount;
+            break;
+        default:
+            break;
+    }
+    VehicleHal::VehiclePropValuePtr value = vecSize == totalCount
+                                        ? mHal->getValuePool()->obtain(type, vecSize)
+                                        : mHal->getValuePool()->obtainComplex();
+
+    if (!impl::decodeBinaryValue(data, size, offset, value.get())) {
+        return nullptr;
+    }
+    if (value->timestamp == 0) {
+        value->timestamp = elapsedRealtimeNano();
+    }
+    return value;
+}
+
+void VehicleEmulator::processBinaryFrame(const uint8_t* data, size_t size) {
+    BinaryFrameHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.valueCount; i++) {
+        VehicleHal::VehiclePropValuePtr value = decodeBinaryValue(data, size, &offset);
+        if (value == nullptr) {
+            ALOGW("%s: Truncated binary frame, decoded %u of %u values", __func__, i,
+                  header.valueCount);
+            return;
+        }
+        int32_t prop = value->prop;
+        if (!mHal->setPropertyFromVehicle(std::move(value))) {
+            ALOGW("%s: Failed to set value of property 0x%x", __func__, prop);
+        }
+    }
+    if (offset != size) {
+        ALOGW("%s: %zu trailing bytes in binary frame", __func__, size - offset);
+    }
+}
+
 void VehicleEmulator::populateProtoVehicleConfig(emulator::VehiclePropConfig* protoCfg,
                                                  const VehiclePropConfig& cfg) {
     protoCfg->set_prop(cfg.prop);
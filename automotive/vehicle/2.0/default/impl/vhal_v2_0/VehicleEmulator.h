@@ -43,6 +43,10 @@ class VehicleEmulator;  // Forward declaration.
 class EmulatedVehicleHalIface : public VehicleHal {
 public:
     virtual bool setPropertyFromVehicle(const VehiclePropValue& propValue) = 0;
+    /** Same as above, but propValue may be handed over to clients without a copy. */
+    virtual bool setPropertyFromVehicle(VehiclePropValuePtr propValue) {
+        return setPropertyFromVehicle(*propValue);
+    }
     virtual std::vector<VehiclePropValue> getAllProperties() const = 0;
 
     void registerEmulator(VehicleEmulator* emulator) {
@@ -74,6 +78,7 @@ class VehicleEmulator : public MessageProcessor {
     void doSetValueFromClient(const VehiclePropValue& propValue);
     void processMessage(emulator::EmulatorMessage const& rxMsg,
                         emulator::EmulatorMessage& respMsg) override;
+    void processBinaryFrame(const uint8_t* data, size_t size) override;
 
    private:
     friend class ConnectionThread;
@@ -88,6 +93,10 @@ class VehicleEmulator : public MessageProcessor {
                                     const VehiclePropConfig& cfg);
     void populateProtoVehiclePropValue(emulator::VehiclePropValue* protoVal,
                                        const VehiclePropValue* val);
+    // Decodes one value of a binary frame at *offset and advances it. Returns nullptr if the
+    // value doesn't fit in size.
+    VehicleHal::VehiclePropValuePtr decodeBinaryValue(const uint8_t* data, size_t size,
+                                                      size_t* offset);
 
 private:
     EmulatedVehicleHalIface* mHal;
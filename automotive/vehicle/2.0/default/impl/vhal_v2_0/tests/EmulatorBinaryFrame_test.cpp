@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/EmulatorBinaryFrame.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+VehiclePropValue makeValue() {
+    VehiclePropValue value = {};
+    value.prop = 0x11400400;
+    value.areaId = 7;
+    value.status = VehiclePropertyStatus::UNAVAILABLE;
+    value.timestamp = 123456789012345;
+    value.value.int32Values = std::vector<int32_t>{1, -2, 3};
+    value.value.int64Values = std::vector<int64_t>{-4000000000000};
+    value.value.floatValues = std::vector<float>{0.5f, 1.5f};
+    value.value.bytes = std::vector<uint8_t>{0xde, 0xad};
+    value.value.stringValue = "cruise";
+    return value;
+}
+
+void expectEqual(const VehiclePropValue& expected, const VehiclePropValue& actual) {
+    EXPECT_EQ(expected.prop, actual.prop);
+    EXPECT_EQ(expected.areaId, actual.areaId);
+    EXPECT_EQ(expected.status, actual.status);
+    EXPECT_EQ(expected.timestamp, actual.timestamp);
+    EXPECT_EQ(expected.value.int32Values, actual.value.int32Values);
+    EXPECT_EQ(expected.value.int64Values, actual.value.int64Values);
+    EXPECT_EQ(expected.value.floatValues, actual.value.floatValues);
+    EXPECT_EQ(expected.value.bytes, actual.value.bytes);
+    EXPECT_EQ(expected.value.stringValue, actual.value.stringValue);
+}
+
+TEST(EmulatorBinaryFrameTest, RecognizesTheMagic) {
+    uint8_t frame[sizeof(BinaryFrameHeader)] = {'V', 'H', 'B', '1', 1, 0, 0, 0};
+    EXPECT_TRUE(isBinaryFrame(frame, sizeof(frame)));
+    EXPECT_FALSE(isBinaryFrame(frame, sizeof(frame) - 1));
+
+    frame[3] = '2';
+    EXPECT_FALSE(isBinaryFrame(frame, sizeof(frame)));
+
+    // A serialized EmulatorMessage starts with the tag of a field
+    const uint8_t message[sizeof(BinaryFrameHeader)] = {0x08, 0x01, 0x10, 0x00, 0, 0, 0, 0};
+    EXPECT_FALSE(isBinaryFrame(message, sizeof(message)));
+}
+
+TEST(EmulatorBinaryFrameTest, EncodesAPackedLittleEndianLayout) {
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(encodeBinaryValue(makeValue(), &out));
+    ASSERT_EQ(sizeof(BinaryValueHeader) + 3 * 4 + 8 + 2 * 4 + 2 + 6, out.size());
+
+    const uint8_t prop[] = {0x00, 0x04, 0x40, 0x11};
+    EXPECT_EQ(0, memcmp(prop, out.data(), sizeof(prop)));
+    // The header is followed by the first int32 value
+    const uint8_t first[] = {1, 0, 0, 0};
+    EXPECT_EQ(0, memcmp(first, out.data() + sizeof(BinaryValueHeader), sizeof(first)));
+    // And the string comes last
+    EXPECT_EQ(0, memcmp("cruise", out.data() + out.size() - 6, 6));
+}
+
+TEST(EmulatorBinaryFrameTest, RoundTrips) {
+    std::vector<uint8_t> out;
+    VehiclePropValue empty = {};
+    empty.prop = 1;
+    ASSERT_TRUE(encodeBinaryValue(makeValue(), &out));
+    ASSERT_TRUE(encodeBinaryValue(empty, &out));
+
+    size_t offset = 0;
+    VehiclePropValue decoded;
+    ASSERT_TRUE(decodeBinaryValue(out.data(), out.size(), &offset, &decoded));
+    expectEqual(makeValue(), decoded);
+
+    // Reusing the value clears what the next one doesn't have
+    ASSERT_TRUE(decodeBinaryValue(out.data(), out.size(), &offset, &decoded));
+    expectEqual(empty, decoded);
+    EXPECT_EQ(out.size(), offset);
+
+    EXPECT_FALSE(decodeBinaryValue(out.data(), out.size(), &offset, &decoded));
+    EXPECT_EQ(out.size(), offset);
+}
+
+TEST(EmulatorBinaryFrameTest, RejectsTruncatedValues) {
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(encodeBinaryValue(makeValue(), &out));
+
+    for (size_t size = 0; size < out.size(); size++) {
+        SCOPED_TRACE(size);
+        size_t offset = 0;
+        VehiclePropValue decoded;
+        EXPECT_FALSE(decodeBinaryValue(out.data(), size, &offset, &decoded));
+        EXPECT_EQ(0u, offset);
+    }
+}
+
+TEST(EmulatorBinaryFrameTest, RejectsCountsPastTheEnd) {
+    std::vector<uint8_t> out;
+    ASSERT_TRUE(encodeBinaryValue(makeValue(), &out));
+
+    BinaryValueHeader header;
+    memcpy(&header, out.data(), sizeof(header));
+    header.bytesCount = 0xffff;
+    memcpy(out.data(), &header, sizeof(header));
+
+    size_t offset = 0;
+    VehiclePropValue decoded;
+    EXPECT_FALSE(decodeBinaryValue(out.data(), out.size(), &offset, &decoded));
+    EXPECT_EQ(0u, offset);
+}
+
+TEST(EmulatorBinaryFrameTest, RejectsVectorsTooLongToEncode) {
+    VehiclePropValue value = makeValue();
+    value.value.int32Values = std::vector<int32_t>(0x10000);
+    std::vector<uint8_t> out;
+    EXPECT_FALSE(encodeBinaryValue(value, &out));
+
+    value.value.int32Values = std::vector<int32_t>(0xffff);
+    EXPECT_TRUE(encodeBinaryValue(value, &out));
+}
+
+}  // namespace
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/GeneratorHub.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+using std::chrono::milliseconds;
+
+constexpr milliseconds kTimeout(5000);
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<Nanos>(Clock::now().time_since_epoch()).count();
+}
+
+int64_t inMs(int64_t ms) {
+    return nowNs() + std::chrono::duration_cast<Nanos>(milliseconds(ms)).count();
+}
+
+// Produces events for prop at the given timestamps, then ends. An empty list of timestamps and
+// repeatEveryMs > 0 produces events forever.
+class ListGenerator : public FakeValueGenerator {
+public:
+    ListGenerator(int32_t prop, std::deque<int64_t> timestamps, int64_t repeatEveryMs = 0)
+        : mProp(prop), mTimestamps(std::move(timestamps)), mRepeatEveryMs(repeatEveryMs) {}
+
+    VehiclePropValue nextEvent() override {
+        VehiclePropValue value = {};
+        value.prop = mProp;
+        if (mRepeatEveryMs > 0) {
+            value.timestamp = inMs(mRepeatEveryMs);
+        } else {
+            value.timestamp = mTimestamps.front();
+            mTimestamps.pop_front();
+        }
+        return value;
+    }
+
+    bool hasNext() override { return mRepeatEveryMs > 0 || !mTimestamps.empty(); }
+
+private:
+    const int32_t mProp;
+    std::deque<int64_t> mTimestamps;
+    const int64_t mRepeatEveryMs;
+};
+
+// Records the batches delivered by a hub
+class Recorder {
+public:
+    void onBatch(const std::vector<VehiclePropValue>& events) {
+        std::lock_guard<std::mutex> g(mLock);
+        mBatches.push_back(events);
+        mCond.notify_all();
+    }
+
+    std::vector<VehiclePropValue> waitForEvents(size_t count) {
+        std::unique_lock<std::mutex> g(mLock);
+        EXPECT_TRUE(mCond.wait_for(g, kTimeout, [&] { return countLocked() >= count; }));
+        std::vector<VehiclePropValue> events;
+        for (const auto& batch : mBatches) {
+            events.insert(events.end(), batch.begin(), batch.end());
+        }
+        return events;
+    }
+
+    std::vector<std::vector<VehiclePropValue>> batches() {
+        std::lock_guard<std::mutex> g(mLock);
+        return mBatches;
+    }
+
+    size_t count() {
+        std::lock_guard<std::mutex> g(mLock);
+        return countLocked();
+    }
+
+private:
+    size_t countLocked() const {
+        size_t count = 0;
+        for (const auto& batch : mBatches) {
+            count += batch.size();
+        }
+        return count;
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<std::vector<VehiclePropValue>> mBatches;
+};
+
+TEST(GeneratorHubTest, deliversTheEventsOfAllGeneratorsInOrder) {
+    Recorder recorder;
+    GeneratorHub hub([&](const VehiclePropValue& event) { recorder.onBatch({event}); });
+
+    hub.registerGenerator(1, std::make_unique<ListGenerator>(
+                                     1, std::deque<int64_t>{inMs(20), inMs(60), inMs(100)}));
+    hub.registerGenerator(2, std::make_unique<ListGenerator>(
+                                     2, std::deque<int64_t>{inMs(40), inMs(80)}));
+
+    auto events = recorder.waitForEvents(5);
+    ASSERT_EQ(5u, events.size());
+    std::vector<int32_t> props;
+    for (size_t i = 0; i < events.size(); i++) {
+        props.push_back(events[i].prop);
+        if (i > 0) {
+            EXPECT_LE(events[i - 1].timestamp, events[i].timestamp);
+        }
+    }
+    EXPECT_EQ(std::vector<int32_t>({1, 2, 1, 2, 1}), props);
+    // One event per call without a batch window
+    EXPECT_EQ(5u, recorder.batches().size());
+}
+
+TEST(GeneratorHubTest, batchesTheEventsDueWithinTheWindow) {
+    Recorder recorder;
+    GeneratorHub hub([&](const std::vector<VehiclePropValue>& events) { recorder.onBatch(events); },
+                     milliseconds(100));
+
+    hub.registerGenerator(1, std::make_unique<ListGenerator>(
+                                     1, std::deque<int64_t>{inMs(10), inMs(30), inMs(500)}));
+    hub.registerGenerator(2, std::make_unique<ListGenerator>(2, std::deque<int64_t>{inMs(20)}));
+
+    recorder.waitForEvents(4);
+    auto batches = recorder.batches();
+    ASSERT_EQ(2u, batches.size());
+    ASSERT_EQ(3u, batches[0].size());
+    EXPECT_EQ(1, batches[0][0].prop);
+    EXPECT_EQ(2, batches[0][1].prop);
+    EXPECT_EQ(1, batches[0][2].prop);
+    ASSERT_EQ(1u, batches[1].size());
+}
+
+TEST(GeneratorHubTest, limitsTheBatchSize) {
+    Recorder recorder;
+    GeneratorHub hub([&](const std::vector<VehiclePropValue>& events) { recorder.onBatch(events); },
+                     milliseconds(100));
+
+    const size_t count = 2 * GeneratorHub::kMaxBatchSize + 1;
+    const int64_t timestamp = inMs(10);
+    hub.registerGenerator(
+            1, std::make_unique<ListGenerator>(1, std::deque<int64_t>(count, timestamp)));
+
+    recorder.waitForEvents(count);
+    auto batches = recorder.batches();
+    ASSERT_EQ(3u, batches.size());
+    EXPECT_EQ(GeneratorHub::kMaxBatchSize, batches[0].size());
+    EXPECT_EQ(GeneratorHub::kMaxBatchSize, batches[1].size());
+    EXPECT_EQ(1u, batches[2].size());
+}
+
+TEST(GeneratorHubTest, discardsGeneratorsWithoutEvents) {
+    Recorder recorder;
+    GeneratorHub hub([&](const VehiclePropValue& event) { recorder.onBatch({event}); });
+
+    hub.registerGenerator(1, std::make_unique<ListGenerator>(1, std::deque<int64_t>{}));
+    hub.registerGenerator(2, std::make_unique<ListGenerator>(2, std::deque<int64_t>{inMs(10)}));
+    recorder.waitForEvents(1);
+
+    // The generator of cookie 2 ended, so the cookie can take a new one
+    hub.registerGenerator(2, std::make_unique<ListGenerator>(3, std::deque<int64_t>{inMs(10)}));
+    auto events = recorder.waitForEvents(2);
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(2, events[0].prop);
+    EXPECT_EQ(3, events[1].prop);
+}
+
+TEST(GeneratorHubTest, unregisteredGeneratorStops) {
+    Recorder recorder;
+    GeneratorHub hub([&](const VehiclePropValue& event) { recorder.onBatch({event}); });
+
+    hub.registerGenerator(1, std::make_unique<ListGenerator>(1, std::deque<int64_t>{}, 10));
+    recorder.waitForEvents(2);
+    hub.unregisterGenerator(1);
+
+    // An event already taken from the queue may still be delivered
+    std::this_thread::sleep_for(milliseconds(50));
+    size_t count = recorder.count();
+    std::this_thread::sleep_for(milliseconds(100));
+    EXPECT_EQ(count, recorder.count());
+}
+
+TEST(GeneratorHubTest, threadsDeliverTheirEventsIndependently) {
+    std::mutex lock;
+    std::condition_variable cond;
+    bool released = false;
+    Recorder recorder;
+    GeneratorHub hub(
+            [&](const std::vector<VehiclePropValue>& events) {
+                if (events[0].prop == 0) {
+                    // Holds the thread of cookie 0
+                    std::unique_lock<std::mutex> g(lock);
+                    cond.wait_for(g, kTimeout, [&] { return released; });
+                }
+                recorder.onBatch(events);
+            },
+            Nanos(0), 2);
+
+    hub.registerGenerator(0, std::make_unique<ListGenerator>(0, std::deque<int64_t>{inMs(10)}));
+    hub.registerGenerator(
+            1, std::make_unique<ListGenerator>(1, std::deque<int64_t>{inMs(20), inMs(30)}));
+
+    auto events = recorder.waitForEvents(2);
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(1, events[0].prop);
+    EXPECT_EQ(1, events[1].prop);
+
+    {
+        std::lock_guard<std::mutex> g(lock);
+        released = true;
+    }
+    cond.notify_all();
+    events = recorder.waitForEvents(3);
+    ASSERT_EQ(3u, events.size());
+    EXPECT_EQ(0, events[2].prop);
+}
+
+}  // namespace
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
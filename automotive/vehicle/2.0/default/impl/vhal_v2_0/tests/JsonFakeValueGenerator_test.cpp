@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/JsonFakeValueGenerator.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace impl {
+
+namespace {
+
+const int32_t kSpeed = toInt(VehicleProperty::PERF_VEHICLE_SPEED);
+const int32_t kGear = toInt(VehicleProperty::GEAR_SELECTION);
+const int32_t kVin = toInt(VehicleProperty::INFO_VIN);
+
+std::string jsonEvent(int32_t prop, const std::string& value, int64_t timestamp) {
+    return "{\"prop\": " + std::to_string(prop) + ", \"areaId\": 0, \"value\": " + value +
+           ", \"timestamp\": " + std::to_string(timestamp) + "}";
+}
+
+// 1.5s between the first two events, more than the parse-ahead window
+const std::string kTrace = "[\n" + jsonEvent(kSpeed, "10.5", 1000000000) + ",\n" +
+                           jsonEvent(kGear, "4", 2500000000) + ",\n" +
+                           jsonEvent(kVin, "\"VIN123\"", 2500000001) + "\n]";
+
+class JsonFakeValueGeneratorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mPath = std::string(mDir.path) + "/trace.json";
+    }
+
+    void writeTrace(const std::string& json) {
+        ASSERT_TRUE(android::base::WriteStringToFile(json, mPath));
+    }
+
+    VehiclePropValue request(int32_t iterations) {
+        VehiclePropValue request = {};
+        request.value.stringValue = mPath;
+        if (iterations != 0) {
+            request.value.int32Values = {0, iterations};
+        }
+        return request;
+    }
+
+    static std::vector<VehiclePropValue> readAll(JsonFakeValueGenerator* generator,
+                                                 size_t max = 100) {
+        std::vector<VehiclePropValue> events;
+        while (events.size() < max && generator->hasNext()) {
+            events.push_back(generator->nextEvent());
+        }
+        return events;
+    }
+
+    std::vector<std::string> filesInDir() {
+        std::vector<std::string> files;
+        DIR* dir = opendir(mDir.path);
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") files.push_back(name);
+        }
+        closedir(dir);
+        return files;
+    }
+
+    TemporaryDir mDir;
+    std::string mPath;
+};
+
+TEST_F(JsonFakeValueGeneratorTest, parsesTheEventsOfEachType) {
+    writeTrace(kTrace);
+    JsonFakeValueGenerator generator(request(1));
+
+    auto events = readAll(&generator);
+    ASSERT_EQ(3u, events.size());
+    EXPECT_EQ(kSpeed, events[0].prop);
+    ASSERT_EQ(1u, events[0].value.floatValues.size());
+    EXPECT_FLOAT_EQ(10.5f, events[0].value.floatValues[0]);
+    EXPECT_EQ(kGear, events[1].prop);
+    ASSERT_EQ(1u, events[1].value.int32Values.size());
+    EXPECT_EQ(4, events[1].value.int32Values[0]);
+    EXPECT_EQ(kVin, events[2].prop);
+    EXPECT_EQ("VIN123", std::string(events[2].value.stringValue));
+}
+
+TEST_F(JsonFakeValueGeneratorTest, keepsTheDelaysBetweenEvents) {
+    writeTrace(kTrace);
+    JsonFakeValueGenerator generator(request(1));
+
+    const int64_t start = Clock::now().time_since_epoch().count();
+    auto events = readAll(&generator);
+    ASSERT_EQ(3u, events.size());
+    // Each event is due when taken, delayed by its distance to the previous one in the trace
+    EXPECT_GE(events[0].timestamp, start);
+    EXPECT_LT(events[0].timestamp, start + 1000000000);
+    EXPECT_GE(events[1].timestamp, start + 1500000000);
+    EXPECT_LT(events[1].timestamp, start + 2500000000);
+    EXPECT_GT(events[2].timestamp, start);
+    EXPECT_LT(events[2].timestamp, start + 1000000000);
+}
+
+TEST_F(JsonFakeValueGeneratorTest, replaysTheGivenNumberOfIterations) {
+    writeTrace(kTrace);
+    JsonFakeValueGenerator generator(request(3));
+
+    auto events = readAll(&generator);
+    ASSERT_EQ(9u, events.size());
+    // The later passes replay the events recorded during the first one
+    for (size_t i = 3; i < events.size(); i++) {
+        EXPECT_EQ(events[i % 3].prop, events[i].prop);
+        EXPECT_EQ(events[i % 3].value, events[i].value);
+    }
+}
+
+TEST_F(JsonFakeValueGeneratorTest, iteratesForeverWithoutACount) {
+    writeTrace(kTrace);
+    JsonFakeValueGenerator generator(request(0));
+
+    auto events = readAll(&generator, 30);
+    ASSERT_EQ(30u, events.size());
+    EXPECT_EQ(kVin, events[29].prop);
+    EXPECT_TRUE(generator.hasNext());
+}
+
+TEST_F(JsonFakeValueGeneratorTest, writesNothingNextToTheTrace) {
+    writeTrace(kTrace);
+    {
+        JsonFakeValueGenerator generator(request(2));
+        EXPECT_EQ(6u, readAll(&generator).size());
+    }
+    EXPECT_EQ(std::vector<std::string>({"trace.json"}), filesInDir());
+}
+
+TEST_F(JsonFakeValueGeneratorTest, skipsEventsWithMissingFieldsOrUnknownTypes) {
+    writeTrace("[{\"prop\": " + std::to_string(kSpeed) + ", \"areaId\": 0, \"timestamp\": 1},\n" +
+               "\"not an event\",\n" + jsonEvent(0, "1", 2) + ",\n" + jsonEvent(kGear, "4", 3) +
+               "]");
+    JsonFakeValueGenerator generator(request(2));
+
+    auto events = readAll(&generator);
+    ASSERT_EQ(2u, events.size());
+    EXPECT_EQ(kGear, events[0].prop);
+    EXPECT_EQ(kGear, events[1].prop);
+}
+
+TEST_F(JsonFakeValueGeneratorTest, stopsAtAnEventThatDoesNotParse) {
+    writeTrace("[" + jsonEvent(kGear, "4", 1) + ",\n" + jsonEvent(kGear, "", 2) + ",\n" +
+               jsonEvent(kGear, "5", 3) + "]");
+    JsonFakeValueGenerator generator(request(1));
+
+    auto events = readAll(&generator);
+    ASSERT_EQ(1u, events.size());
+    EXPECT_EQ(4, events[0].value.int32Values[0]);
+}
+
+TEST_F(JsonFakeValueGeneratorTest, hasNothingToReplayWithoutATrace) {
+    JsonFakeValueGenerator missing(request(0));
+    EXPECT_FALSE(missing.hasNext());
+
+    writeTrace(jsonEvent(kGear, "4", 1));
+    JsonFakeValueGenerator notAnArray(request(0));
+    EXPECT_FALSE(notAnArray.hasNext());
+
+    writeTrace("[]");
+    JsonFakeValueGenerator empty(request(0));
+    EXPECT_FALSE(empty.hasNext());
+}
+
+}  // namespace
+
+}  // namespace impl
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/ConcurrentQueue.h"
+
+namespace {
+
+using android::BatchingConsumer;
+using android::BoundedMpscQueue;
+using android::QueueOverflowPolicy;
+using std::chrono::milliseconds;
+
+using IntQueue = BoundedMpscQueue<std::unique_ptr<int>>;
+
+TEST(BoundedMpscQueueTest, dropNewestWhenFull) {
+    IntQueue queue(5, QueueOverflowPolicy::DROP_NEWEST);
+    ASSERT_EQ(8u, queue.capacity());
+
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(i < 8, queue.push(std::make_unique<int>(i)));
+    }
+    ASSERT_EQ(8u, queue.pushedCount());
+    ASSERT_EQ(2u, queue.droppedCount());
+
+    auto items = queue.flush();
+    ASSERT_EQ(8u, items.size());
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(i, *items[i]);
+    }
+    ASSERT_TRUE(queue.flush().empty());
+
+    // Room was made by the flush
+    ASSERT_TRUE(queue.push(std::make_unique<int>(42)));
+    items = queue.flush();
+    ASSERT_EQ(1u, items.size());
+    ASSERT_EQ(42, *items[0]);
+}
+
+TEST(BoundedMpscQueueTest, multipleProducers) {
+    constexpr int kNumProducers = 4;
+    constexpr int kItemsPerProducer = 10000;
+
+    IntQueue queue(1024, QueueOverflowPolicy::BLOCK);
+    std::atomic<int> received { 0 };
+    BatchingConsumer<std::unique_ptr<int>, IntQueue> consumer;
+    consumer.run(&queue, milliseconds(0), milliseconds(10),
+                 [&received](const std::vector<std::unique_ptr<int>>& items) {
+        received += items.size();
+    });
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < kNumProducers; i++) {
+        producers.emplace_back([&queue]() {
+            for (int j = 0; j < kItemsPerProducer; j++) {
+                queue.push(std::make_unique<int>(j));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    std::this_thread::sleep_for(milliseconds(100));
+
+    consumer.requestStop();
+    queue.deactivate();
+    consumer.waitStopped();
+
+    ASSERT_EQ(kNumProducers * kItemsPerProducer, received.load());
+    ASSERT_EQ(0u, queue.droppedCount());
+}
+
+TEST(BoundedMpscQueueTest, deactivateUnblocksConsumer) {
+    IntQueue queue(4, QueueOverflowPolicy::DROP_NEWEST);
+    std::thread consumer([&queue]() { queue.waitForItems(); });
+    std::this_thread::sleep_for(milliseconds(10));
+    queue.deactivate();
+    consumer.join();
+
+    ASSERT_FALSE(queue.push(std::make_unique<int>(1)));
+    ASSERT_EQ(0u, queue.pushedCount());
+}
+
+}  // namespace anonymous
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/Obd2SensorStore.h"
+#include "vhal_v2_0/VehicleUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+constexpr size_t kNumVendorIntegerSensors = 2;
+constexpr size_t kNumVendorFloatSensors = 1;
+
+const size_t kNumIntegerSensors =
+    toInt(DiagnosticIntegerSensorIndex::LAST_SYSTEM_INDEX) + 1 + kNumVendorIntegerSensors;
+const size_t kNumFloatSensors =
+    toInt(DiagnosticFloatSensorIndex::LAST_SYSTEM_INDEX) + 1 + kNumVendorFloatSensors;
+
+bool isBitSet(const hidl_vec<uint8_t>& bitmask, size_t index) {
+    return (bitmask[index / 8] & (1 << (index % 8))) != 0;
+}
+
+size_t countBits(const hidl_vec<uint8_t>& bitmask) {
+    size_t count = 0;
+    for (uint8_t byte : bitmask) {
+        count += __builtin_popcount(byte);
+    }
+    return count;
+}
+
+class Obd2SensorStoreTest : public ::testing::Test {
+protected:
+    Obd2SensorStore store{kNumVendorIntegerSensors, kNumVendorFloatSensors};
+};
+
+TEST_F(Obd2SensorStoreTest, startsEmpty) {
+    ASSERT_EQ(kNumIntegerSensors, store.getIntegerSensors().size());
+    ASSERT_EQ(kNumFloatSensors, store.getFloatSensors().size());
+    ASSERT_EQ((kNumIntegerSensors + kNumFloatSensors + 7) / 8, store.getSensorsBitmask().size());
+    ASSERT_EQ(0u, countBits(store.getSensorsBitmask()));
+}
+
+TEST_F(Obd2SensorStoreTest, setIntegerSensor) {
+    ASSERT_EQ(StatusCode::OK, store.setIntegerSensor(
+                                  DiagnosticIntegerSensorIndex::MALFUNCTION_INDICATOR_LIGHT_ON, 1));
+    // The last vendor sensor
+    ASSERT_EQ(StatusCode::OK, store.setIntegerSensor(kNumIntegerSensors - 1, -7));
+
+    ASSERT_EQ(1, store.getIntegerSensors()[1]);
+    ASSERT_EQ(-7, store.getIntegerSensors()[kNumIntegerSensors - 1]);
+    ASSERT_TRUE(isBitSet(store.getSensorsBitmask(), 1));
+    ASSERT_TRUE(isBitSet(store.getSensorsBitmask(), kNumIntegerSensors - 1));
+    ASSERT_EQ(2u, countBits(store.getSensorsBitmask()));
+}
+
+TEST_F(Obd2SensorStoreTest, floatSensorBitsFollowTheIntegerSensors) {
+    ASSERT_EQ(StatusCode::OK,
+              store.setFloatSensor(DiagnosticFloatSensorIndex::CALCULATED_ENGINE_LOAD, 0.25f));
+    ASSERT_EQ(StatusCode::OK, store.setFloatSensor(kNumFloatSensors - 1, 42.5f));
+
+    ASSERT_EQ(0.25f, store.getFloatSensors()[0]);
+    ASSERT_EQ(42.5f, store.getFloatSensors()[kNumFloatSensors - 1]);
+    ASSERT_TRUE(isBitSet(store.getSensorsBitmask(), kNumIntegerSensors));
+    ASSERT_TRUE(isBitSet(store.getSensorsBitmask(), kNumIntegerSensors + kNumFloatSensors - 1));
+    ASSERT_EQ(2u, countBits(store.getSensorsBitmask()));
+}
+
+TEST_F(Obd2SensorStoreTest, settingASensorAgainKeepsItsBit) {
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_SYSTEM_STATUS, 1);
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_SYSTEM_STATUS, 2);
+
+    ASSERT_EQ(2, store.getIntegerSensors()[0]);
+    ASSERT_EQ(1u, countBits(store.getSensorsBitmask()));
+}
+
+TEST_F(Obd2SensorStoreTest, getFrameIsASnapshot) {
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_SYSTEM_STATUS, 1);
+    auto frame = store.getFrame();
+    ASSERT_EQ(frame, store.getFrame());
+
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::FUEL_SYSTEM_STATUS, 2);
+    store.setFloatSensor(DiagnosticFloatSensorIndex::ENGINE_COOLANT_TEMPERATURE, 90.0f);
+
+    ASSERT_EQ(1, frame->value.int32Values[0]);
+    ASSERT_EQ(0.0f, frame->value.floatValues[1]);
+    ASSERT_EQ(1u, countBits(frame->value.bytes));
+
+    auto updated = store.getFrame();
+    ASSERT_NE(frame, updated);
+    ASSERT_EQ(2, updated->value.int32Values[0]);
+    ASSERT_EQ(90.0f, updated->value.floatValues[1]);
+    ASSERT_EQ(2u, countBits(updated->value.bytes));
+    ASSERT_GE(updated->timestamp, frame->timestamp);
+}
+
+TEST_F(Obd2SensorStoreTest, fillPropValue) {
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::IGNITION_MONITORS_SUPPORTED, 3);
+    store.setFloatSensor(DiagnosticFloatSensorIndex::FUEL_PRESSURE, 1.5f);
+
+    VehiclePropValue propValue;
+    // Left over from a previous frame of another size
+    propValue.value.int32Values = std::vector<int32_t>(3, 9);
+    store.fillPropValue("P0010", &propValue);
+
+    ASSERT_EQ(store.getIntegerSensors(), propValue.value.int32Values);
+    ASSERT_EQ(store.getFloatSensors(), propValue.value.floatValues);
+    ASSERT_EQ(store.getSensorsBitmask(), propValue.value.bytes);
+    ASSERT_EQ("P0010", std::string(propValue.value.stringValue));
+    ASSERT_GT(propValue.timestamp, 0);
+
+    // Refilling reuses the vectors, which now have the frame size
+    const int32_t* int32Data = propValue.value.int32Values.data();
+    store.setIntegerSensor(DiagnosticIntegerSensorIndex::IGNITION_MONITORS_SUPPORTED, 4);
+    store.fillPropValue("", &propValue);
+    ASSERT_EQ(int32Data, propValue.value.int32Values.data());
+    ASSERT_EQ(4, propValue.value.int32Values[2]);
+    ASSERT_EQ("", std::string(propValue.value.stringValue));
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -70,4 +70,30 @@ TEST(RecurrentTimerTest, multipleIntervals) {
     ASSERT_EQ_WITH_TOLERANCE(20, counter5ms.load(), 5);
 }
 
+TEST(RecurrentTimerTest, coalesceEventsOfSameTick) {
+    std::atomic<int64_t> calls { 0L };
+    std::atomic<int64_t> uncoalescedCalls { 0L };
+    auto callsRef = std::ref(calls);
+    auto uncoalescedCallsRef = std::ref(uncoalescedCalls);
+    RecurrentTimer timer([&callsRef, &uncoalescedCallsRef](const std::vector<int32_t>& cookies) {
+        callsRef.get()++;
+        if (cookies.size() != 2) {
+            uncoalescedCallsRef.get()++;
+        }
+    });
+
+    timer.registerRecurrentEvent(milliseconds(2), 0xdead);
+    timer.registerRecurrentEvent(milliseconds(2), 0xbeef);
+    std::this_thread::sleep_for(milliseconds(100));
+    ASSERT_EQ_WITH_TOLERANCE(50, calls.load(), 10);
+    // The first call may only have the first registered event
+    ASSERT_GE(1, uncoalescedCalls.load());
+
+    timer.unregisterRecurrentEvent(0xdead);
+    timer.unregisterRecurrentEvent(0xbeef);
+    int64_t callsAfterUnregister = calls.load();
+    std::this_thread::sleep_for(milliseconds(20));
+    ASSERT_GE(callsAfterUnregister + 1, calls.load());
+}
+
 }  // anonymous namespace
@@ -16,6 +16,7 @@
 
 #include <functional>
 #include <iostream>
+#include <map>
 #include <unordered_map>
 
 #include <gtest/gtest.h>
@@ -188,6 +189,88 @@ TEST_F(SubscriptionManagerTest, unsubscribe) {
     assertLastUnsubscribedProperty(PROP1);
 }
 
+TEST_F(SubscriptionManagerTest, distributeValuesToClients) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(1, cb1, subscrToProp1, &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(3, cb3, subscrToProp1and2, &updatedOptions));
+
+    VehiclePropValuePool valuePool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    values.push_back(valuePool.obtain(VehiclePropertyType::INT32));
+    values.back()->prop = PROP1;
+    values.push_back(valuePool.obtain(VehiclePropertyType::INT32));
+    values.back()->prop = PROP2;
+
+    auto valuesOf = [](const std::vector<HalClientValues>& clientValues,
+                       const sp<IVehicleCallback>& callback) {
+        for (const auto& cv : clientValues) {
+            if (cv.client != nullptr && cv.client->getCallback() == callback) {
+                return cv.values.size();
+            }
+        }
+        return (size_t) 0;
+    };
+
+    std::vector<HalClientValues> clientValues;
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+    ASSERT_EQ((size_t) 1, valuesOf(clientValues, cb1));
+    ASSERT_EQ((size_t) 2, valuesOf(clientValues, cb3));
+
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_ANDROID, &clientValues);
+    ASSERT_EQ((size_t) 0, valuesOf(clientValues, cb1));
+    ASSERT_EQ((size_t) 0, valuesOf(clientValues, cb3));
+
+    // Routing table is updated on unsubscribe and the buffer is reused.
+    manager.unsubscribe(3, PROP1);
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+    ASSERT_EQ((size_t) 1, valuesOf(clientValues, cb1));
+    ASSERT_EQ((size_t) 1, valuesOf(clientValues, cb3));
+
+    manager.unsubscribe(1, PROP1);
+    manager.unsubscribe(3, PROP2);
+    manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR, &clientValues);
+    ASSERT_EQ((size_t) 0, valuesOf(clientValues, cb1));
+    ASSERT_EQ((size_t) 0, valuesOf(clientValues, cb3));
+}
+
+TEST_F(SubscriptionManagerTest, decimateToClientSampleRate) {
+    std::list<SubscribeOptions> updatedOptions;
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(
+                  1, cb1, {SubscribeOptions{.propId = PROP1, .sampleRate = 100,
+                                            .flags = SubscribeFlags::EVENTS_FROM_CAR}},
+                  &updatedOptions));
+    ASSERT_EQ(StatusCode::OK,
+              manager.addOrUpdateSubscription(
+                  2, cb2, {SubscribeOptions{.propId = PROP1, .sampleRate = 10,
+                                            .flags = SubscribeFlags::EVENTS_FROM_CAR}},
+                  &updatedOptions));
+
+    VehiclePropValuePool valuePool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    values.push_back(valuePool.obtain(VehiclePropertyType::INT32));
+    values.back()->prop = PROP1;
+
+    std::vector<HalClientValues> clientValues;
+    std::map<sp<IVehicleCallback>, size_t> eventCounts;
+    // One second of 100Hz events
+    for (int i = 0; i < 100; i++) {
+        values.back()->timestamp = 100000000L + i * 10000000L;
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR,
+                                          &clientValues);
+        for (const auto& cv : clientValues) {
+            if (cv.client != nullptr) {
+                eventCounts[cv.client->getCallback()] += cv.values.size();
+            }
+        }
+    }
+
+    ASSERT_EQ((size_t) 100, eventCounts[cb1]);
+    ASSERT_EQ((size_t) 10, eventCounts[cb2]);
+}
+
 }  // namespace anonymous
 
 }  // namespace V2_0
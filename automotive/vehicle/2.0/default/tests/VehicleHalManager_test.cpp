@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <map>
 #include <unordered_map>
 #include <iostream>
 
@@ -101,6 +102,7 @@ public:
             return StatusCode::TRY_AGAIN;
         }
 
+        setCount++;
         mValues[makeKey(propValue)] = propValue;
         return StatusCode::OK;
     }
@@ -125,6 +127,7 @@ public:
 public:
     int fuelCapacityAttemptsLeft = kRetriablePropMockedAttempts;
     int mirrorFoldAttemptsLeft = kRetriablePropMockedAttempts;
+    int setCount = 0;
 
 private:
     int64_t makeKey(const VehiclePropValue& v) const {
@@ -437,6 +440,96 @@ TEST_F(VehicleHalManagerTest, set_Retriable) {
     ASSERT_TRUE(actualValue.value.int32Values[0]);
 }
 
+TEST_F(VehicleHalManagerTest, setBatch_LastValueWins) {
+    const auto PROP = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const auto AREA1 = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const auto AREA2 = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    hidl_vec<VehiclePropValue> values(3);
+    values[0].prop = values[1].prop = values[2].prop = PROP;
+    values[0].areaId = values[2].areaId = AREA1;
+    values[1].areaId = AREA2;
+    values[0].value.int32Values = hidl_vec<int32_t> { 1 };
+    values[1].value.int32Values = hidl_vec<int32_t> { 2 };
+    values[2].value.int32Values = hidl_vec<int32_t> { 3 };
+
+    ASSERT_EQ(StatusCode::OK, manager->setBatch(values));
+    ASSERT_EQ(2, hal->setCount);
+
+    invokeGet(PROP, AREA1);
+    ASSERT_EQ(StatusCode::OK, actualStatusCode);
+    ASSERT_EQ(3, actualValue.value.int32Values[0]);
+
+    invokeGet(PROP, AREA2);
+    ASSERT_EQ(StatusCode::OK, actualStatusCode);
+    ASSERT_EQ(2, actualValue.value.int32Values[0]);
+}
+
+TEST_F(VehicleHalManagerTest, setBatch_NotifiesSetSubscribersOfTheLastValues) {
+    const auto FAN = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const auto BRIGHTNESS = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    const auto AREA1 = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    const auto AREA2 = toInt(VehicleAreaSeat::ROW_1_RIGHT);
+
+    sp<MockedVehicleCallback> cb = new MockedVehicleCallback();
+    hidl_vec<SubscribeOptions> options = {
+        SubscribeOptions{.propId = FAN, .flags = SubscribeFlags::EVENTS_FROM_ANDROID},
+    };
+    ASSERT_EQ(StatusCode::OK, manager->subscribe(cb, options));
+
+    hidl_vec<VehiclePropValue> values(4);
+    values[0].prop = values[2].prop = values[3].prop = FAN;
+    values[0].areaId = values[3].areaId = AREA1;
+    values[2].areaId = AREA2;
+    values[1].prop = BRIGHTNESS;
+    values[0].value.int32Values = hidl_vec<int32_t> { 1 };
+    values[1].value.int32Values = hidl_vec<int32_t> { 7 };
+    values[2].value.int32Values = hidl_vec<int32_t> { 2 };
+    values[3].value.int32Values = hidl_vec<int32_t> { 3 };
+    ASSERT_EQ(StatusCode::OK, manager->setBatch(values));
+
+    // One notification per area of the subscribed property, of its last value.
+    auto sets = cb->getReceivedSets();
+    ASSERT_EQ(2u, sets.size());
+    std::map<int32_t, int32_t> setValues;
+    for (const auto& set : sets) {
+        ASSERT_EQ(FAN, set.prop);
+        setValues[set.areaId] = set.value.int32Values[0];
+    }
+    ASSERT_EQ((std::map<int32_t, int32_t> {{AREA1, 3}, {AREA2, 2}}), setValues);
+}
+
+TEST_F(VehicleHalManagerTest, setBatch_RejectedAsAWhole) {
+    hidl_vec<VehiclePropValue> values(2);
+    values[0].prop = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+    values[0].value.int32Values = hidl_vec<int32_t> { 7 };
+    values[1].prop = toInt(VehicleProperty::INFO_MAKE);  // Read only.
+
+    ASSERT_EQ(StatusCode::ACCESS_DENIED, manager->setBatch(values));
+    ASSERT_EQ(0, hal->setCount);
+}
+
+TEST_F(VehicleHalManagerTest, set_Coalesced) {
+    const auto PROP = toInt(VehicleProperty::DISPLAY_BRIGHTNESS);
+
+    manager->setWriteCoalescingWindow(std::chrono::hours(1));
+    for (int32_t val = 1; val <= 3; val++) {
+        auto v = hal->getValuePool()->obtainInt32(val);
+        v->prop = PROP;
+        v->areaId = 0;
+        ASSERT_EQ(StatusCode::OK, manager->set(*v.get()));
+    }
+    ASSERT_EQ(0, hal->setCount);
+
+    // Changing the window writes the held values.
+    manager->setWriteCoalescingWindow(std::chrono::milliseconds(0));
+    ASSERT_EQ(1, hal->setCount);
+
+    invokeGet(PROP, 0);
+    ASSERT_EQ(StatusCode::OK, actualStatusCode);
+    ASSERT_EQ(3, actualValue.value.int32Values[0]);
+}
+
 TEST(HalClientVectorTest, basic) {
     HalClientVector clients;
     sp<IVehicleCallback> callback1 = new MockedVehicleCallback();
@@ -102,7 +102,9 @@ public:
         mEventCond.notify_one();
         return Return<void>();
     }
-    Return<void> onPropertySet(const VehiclePropValue& /* value */) override {
+    Return<void> onPropertySet(const VehiclePropValue& value) override {
+        MuxGuard g(mLock);
+        mReceivedSets.push_back(value);
         return Return<void>();
     }
     Return<void> onPropertySetError(StatusCode /* errorCode */,
@@ -136,10 +138,17 @@ public:
         return mReceivedEvents;
     }
 
+    // onPropertySet is called synchronously by the HAL manager, no need to wait for it.
+    std::vector<VehiclePropValue> getReceivedSets() {
+        MuxGuard g(mLock);
+        return mReceivedSets;
+    }
+
 private:
     std::mutex mLock;
     std::condition_variable mEventCond;
     std::vector<HidlVecOfValues> mReceivedEvents;
+    std::vector<VehiclePropValue> mReceivedSets;
 };
 
 template<typename T>
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "vhal_v2_0/RecurrentTimer.h"
+#include "vhal_v2_0/SubscriptionManager.h"
+#include "vhal_v2_0/VehicleHalManager.h"
+#include "vhal_v2_0/VehicleObjectPool.h"
+#include "vhal_v2_0/VehiclePropertyStore.h"
+
+#include "VehicleHalTestUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+// Property counts to run the benchmarks with: the default HAL has about 200 properties, the
+// next platforms are expected to have up to 2000.
+constexpr int kMinProperties = 200;
+constexpr int kMaxProperties = 2000;
+
+constexpr int kMinClients = 1;
+constexpr int kMaxClients = 16;
+
+int32_t getVendorProperty(int index) {
+    return toInt(VehiclePropertyGroup::VENDOR) | toInt(VehicleArea::GLOBAL) |
+           toInt(VehiclePropertyType::INT32) | (0x100 + index);
+}
+
+std::vector<VehiclePropConfig> createConfigs(int numProperties) {
+    std::vector<VehiclePropConfig> configs(numProperties);
+    for (int i = 0; i < numProperties; i++) {
+        configs[i].prop = getVendorProperty(i);
+        configs[i].access = VehiclePropertyAccess::READ_WRITE;
+        configs[i].changeMode = VehiclePropertyChangeMode::ON_CHANGE;
+    }
+    return configs;
+}
+
+VehiclePropValue createInt32Value(int32_t prop, int32_t value) {
+    VehiclePropValue propValue;
+    propValue.prop = prop;
+    propValue.value.int32Values = hidl_vec<int32_t>{value};
+    return propValue;
+}
+
+// A VehicleHal backed by VehiclePropertyStore, like the emulated HAL but without its threads
+class StoreBackedVehicleHal : public VehicleHal {
+public:
+    StoreBackedVehicleHal(int numProperties) : mConfigs(createConfigs(numProperties)) {
+        for (const auto& config : mConfigs) {
+            mStore.registerProperty(config);
+            mStore.writeValue(createInt32Value(config.prop, 0), true);
+        }
+    }
+
+    std::vector<VehiclePropConfig> listProperties() override { return mConfigs; }
+
+    VehiclePropValuePtr get(const VehiclePropValue& requestedPropValue,
+                            StatusCode* outStatus) override {
+        auto value = mStore.readValueOrNull(requestedPropValue);
+        if (value == nullptr) {
+            *outStatus = StatusCode::INVALID_ARG;
+            return nullptr;
+        }
+        *outStatus = StatusCode::OK;
+        return getValuePool()->obtain(*value);
+    }
+
+    StatusCode set(const VehiclePropValue& propValue) override {
+        return mStore.writeValue(propValue, true) ? StatusCode::OK : StatusCode::INVALID_ARG;
+    }
+
+    StatusCode subscribe(int32_t /* property */, float /* sampleRate */) override {
+        return StatusCode::OK;
+    }
+
+    StatusCode unsubscribe(int32_t /* property */) override { return StatusCode::OK; }
+
+private:
+    std::vector<VehiclePropConfig> mConfigs;
+    VehiclePropertyStore mStore;
+};
+
+class NoopVehicleCallback : public IVehicleCallback {
+public:
+    Return<void> onPropertyEvent(const hidl_vec<VehiclePropValue>& /* values */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySet(const VehiclePropValue& /* value */) override {
+        return Return<void>();
+    }
+    Return<void> onPropertySetError(StatusCode /* errorCode */, int32_t /* propId */,
+                                    int32_t /* areaId */) override {
+        return Return<void>();
+    }
+};
+
+void BM_VehicleHalManager_get(benchmark::State& state) {
+    const int numProperties = state.range(0);
+    StoreBackedVehicleHal hal(numProperties);
+    VehicleHalManager manager(&hal);
+
+    VehiclePropValue request;
+    int i = 0;
+    for (auto _ : state) {
+        request.prop = getVendorProperty(i++ % numProperties);
+        manager.get(request, [](StatusCode status, const VehiclePropValue& value) {
+            benchmark::DoNotOptimize(status);
+            benchmark::DoNotOptimize(value.value.int32Values.data());
+        });
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VehicleHalManager_get)->Arg(kMinProperties)->Arg(kMaxProperties);
+
+void BM_VehicleHalManager_set(benchmark::State& state) {
+    const int numProperties = state.range(0);
+    StoreBackedVehicleHal hal(numProperties);
+    VehicleHalManager manager(&hal);
+
+    int i = 0;
+    for (auto _ : state) {
+        auto value = createInt32Value(getVendorProperty(i % numProperties), i);
+        benchmark::DoNotOptimize(manager.set(value));
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VehicleHalManager_set)->Arg(kMinProperties)->Arg(kMaxProperties);
+
+// Args: number of properties, number of clients each subscribed to all of them
+void BM_SubscriptionManager_distributeValuesToClients(benchmark::State& state) {
+    const int numProperties = state.range(0);
+    const int numClients = state.range(1);
+    SubscriptionManager manager([](int32_t /* propId */) {});
+
+    hidl_vec<SubscribeOptions> options;
+    options.resize(numProperties);
+    for (int i = 0; i < numProperties; i++) {
+        options[i] = {.propId = getVendorProperty(i), .flags = SubscribeFlags::EVENTS_FROM_CAR};
+    }
+    for (int c = 0; c < numClients; c++) {
+        std::list<SubscribeOptions> updatedOptions;
+        manager.addOrUpdateSubscription(c, new NoopVehicleCallback(), options, &updatedOptions);
+    }
+
+    // One batch as the HAL would send it: a value for every property
+    VehiclePropValuePool pool;
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int i = 0; i < numProperties; i++) {
+        auto value = pool.obtainInt32(i);
+        value->prop = getVendorProperty(i);
+        values.push_back(std::move(value));
+    }
+
+    std::vector<HalClientValues> clientValues;
+    for (auto _ : state) {
+        manager.distributeValuesToClients(values, SubscribeFlags::EVENTS_FROM_CAR,
+                                          &clientValues);
+        benchmark::DoNotOptimize(clientValues.data());
+    }
+    state.SetItemsProcessed(state.iterations() * numProperties);
+}
+BENCHMARK(BM_SubscriptionManager_distributeValuesToClients)
+        ->RangeMultiplier(4)
+        ->Ranges({{kMinProperties, kMaxProperties}, {kMinClients, kMaxClients}});
+
+void BM_VehiclePropValuePool_obtain(benchmark::State& state) {
+    static VehiclePropValuePool pool;
+    for (auto _ : state) {
+        auto value = pool.obtain(VehiclePropertyType::INT32_VEC, 3);
+        benchmark::DoNotOptimize(value.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VehiclePropValuePool_obtain)->ThreadRange(1, 8)->UseRealTime();
+
+// Threads write to the same store, argument is the number of properties they spread over
+void BM_VehiclePropertyStore_writeValue(benchmark::State& state) {
+    static VehiclePropertyStore* store;
+    const int numProperties = state.range(0);
+    if (state.thread_index == 0) {
+        store = new VehiclePropertyStore();
+        for (const auto& config : createConfigs(numProperties)) {
+            store->registerProperty(config);
+        }
+    }
+
+    // Distinct start per thread so that threads don't all hit the same property
+    int i = state.thread_index * numProperties / state.threads;
+    for (auto _ : state) {
+        auto value = createInt32Value(getVendorProperty(i % numProperties), i);
+        benchmark::DoNotOptimize(store->writeValue(value, true));
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index == 0) {
+        delete store;
+    }
+}
+BENCHMARK(BM_VehiclePropertyStore_writeValue)
+        ->Arg(kMinProperties)
+        ->Arg(kMaxProperties)
+        ->ThreadRange(1, 8)
+        ->UseRealTime();
+
+// Time to register, then unregister, the recurrent events of that many continuous properties
+void BM_RecurrentTimer_registerRecurrentEvent(benchmark::State& state) {
+    const int numEvents = state.range(0);
+    RecurrentTimer timer([](const std::vector<int32_t>& /* cookies */) {});
+    for (auto _ : state) {
+        for (int i = 0; i < numEvents; i++) {
+            // Sample rates from 1 to 100 Hz
+            timer.registerRecurrentEvent(std::chrono::milliseconds(10 * (1 + i % 100)), i);
+        }
+        for (int i = 0; i < numEvents; i++) {
+            timer.unregisterRecurrentEvent(i);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * numEvents);
+}
+BENCHMARK(BM_RecurrentTimer_registerRecurrentEvent)->Arg(kMinProperties)->Arg(kMaxProperties);
+
+// Cookies delivered per second with that many events due on every 10ms tick
+void BM_RecurrentTimer_dispatch(benchmark::State& state) {
+    const int numEvents = state.range(0);
+    std::mutex lock;
+    std::condition_variable cond;
+    int64_t dispatched = 0;
+    int64_t actions = 0;
+
+    RecurrentTimer timer([&](const std::vector<int32_t>& cookies) {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            dispatched += cookies.size();
+            actions++;
+        }
+        cond.notify_one();
+    });
+    for (int i = 0; i < numEvents; i++) {
+        timer.registerRecurrentEvent(std::chrono::milliseconds(10), i);
+    }
+
+    for (auto _ : state) {
+        std::unique_lock<std::mutex> g(lock);
+        int64_t target = actions + 1;
+        cond.wait(g, [&] { return actions >= target; });
+    }
+
+    std::lock_guard<std::mutex> g(lock);
+    state.SetItemsProcessed(dispatched);
+}
+BENCHMARK(BM_RecurrentTimer_dispatch)
+        ->Arg(kMinProperties)
+        ->Arg(kMaxProperties)
+        ->Iterations(100)
+        ->UseRealTime();
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -81,6 +81,63 @@ TEST_F(VehicleObjectPoolTest, valuePoolStrings) {
     ASSERT_EQ(0u, stats->Obtained);
 }
 
+TEST_F(VehicleObjectPoolTest, valuePoolStats) {
+    auto v = valuePool->obtain(VehiclePropertyType::INT32_VEC, 3);
+    v.reset();
+    valuePool->obtain(VehiclePropertyType::INT32_VEC, 3);
+    // Not recycled
+    valuePool->obtain(VehiclePropertyType::INT32_VEC, 5);
+
+    VehiclePropValuePool::Stats poolStats = valuePool->getStats();
+    ASSERT_EQ(1u, poolStats.hits);
+    ASSERT_EQ(1u, poolStats.misses);
+    ASSERT_EQ(0u, poolStats.overflows);
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolRecycleOnOtherThread) {
+    std::thread([this]() {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        // Enough values to go through the shared depot
+        for (int i = 0; i < 100; i++) {
+            values.push_back(valuePool->obtain(VehiclePropertyType::FLOAT));
+        }
+    }).join();
+
+    // Values recycled by the other thread are reused here
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (int i = 0; i < 100; i++) {
+        values.push_back(valuePool->obtain(VehiclePropertyType::FLOAT));
+    }
+    ASSERT_LT(0u, valuePool->getStats().hits);
+}
+
+TEST_F(VehicleObjectPoolTest, valuePoolDepot) {
+    // A multiple of half the thread cache, so that the cache ends up full
+    const size_t N = VehiclePropValuePool::kDepotSize + 2 * VehiclePropValuePool::kThreadCacheSize;
+    std::thread([this]() {
+        std::vector<recyclable_ptr<VehiclePropValue>> values;
+        for (size_t i = 0; i < N; i++) {
+            values.push_back(valuePool->obtain(VehiclePropertyType::FLOAT));
+        }
+    }).join();
+
+    // The other thread cached kThreadCacheSize values, filled the depot and deleted the rest
+    VehiclePropValuePool::Stats poolStats = valuePool->getStats();
+    ASSERT_EQ(0u, poolStats.hits);
+    ASSERT_EQ(N, poolStats.misses);
+    ASSERT_EQ(N - VehiclePropValuePool::kThreadCacheSize - VehiclePropValuePool::kDepotSize,
+              poolStats.overflows);
+
+    // All of the depot is reused here, then values have to be created again
+    std::vector<recyclable_ptr<VehiclePropValue>> values;
+    for (size_t i = 0; i < VehiclePropValuePool::kDepotSize + 1; i++) {
+        values.push_back(valuePool->obtain(VehiclePropertyType::FLOAT));
+    }
+    poolStats = valuePool->getStats();
+    ASSERT_EQ(VehiclePropValuePool::kDepotSize, poolStats.hits);
+    ASSERT_EQ(N + 1, poolStats.misses);
+}
+
 TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
     // In this test we have T threads that concurrently in C cycles
     // obtain and release O VehiclePropValue objects of FLOAT / INT32 types.
@@ -114,8 +171,15 @@ TEST_F(VehicleObjectPoolTest, valuePoolMultithreadedBenchmark) {
 
     ASSERT_EQ(static_cast<uint32_t>(T * C * O), stats->Obtained);
     ASSERT_EQ(static_cast<uint32_t>(T * C * O), stats->Recycled);
-    // Created less than obtained.
-    ASSERT_GE(static_cast<uint32_t>(T * O), stats->Created);
+    // Created less than obtained. A value is only created when the thread cache and the
+    // depot are empty, so besides the T * O values held at once, at most the caches of the
+    // other threads, for both types, hold values that can't be reused.
+    const uint32_t maxCreated = T * O + 2 * (T - 1) * VehiclePropValuePool::kThreadCacheSize;
+    ASSERT_GE(maxCreated, stats->Created);
+    // The depot is big enough for all the values of a type
+    static_assert(T * O / 2 + T * VehiclePropValuePool::kThreadCacheSize <=
+                  VehiclePropValuePool::kDepotSize, "depot too small for the benchmark");
+    ASSERT_EQ(0u, valuePool->getStats().overflows);
 
     auto elapsedMs = (finish - start) / 1000000;
     ASSERT_GE(1000, elapsedMs);  // Less a second to access 100K objects.
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+
+#include <gtest/gtest.h>
+
+#include "vhal_v2_0/VehiclePropertySnapshot.h"
+#include "vhal_v2_0/VehiclePropertyStore.h"
+
+#include "VehicleHalTestUtils.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+
+namespace {
+
+class VehiclePropertySnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const auto& config : kVehicleProperties) {
+            store.registerProperty(config);
+        }
+    }
+
+    void TearDown() override {
+        if (region != nullptr) {
+            munmap(region, regionSize);
+        }
+    }
+
+    // Maps the snapshot the way a client would and reads all of its values
+    std::vector<VehiclePropValue> readSnapshot(const VehiclePropertySnapshot& snapshot) {
+        if (region == nullptr) {
+            regionSize = snapshot.getSize();
+            region = mmap(nullptr, regionSize, PROT_READ, MAP_SHARED, snapshot.getFd(), 0);
+            EXPECT_NE(MAP_FAILED, region);
+        }
+        std::vector<VehiclePropValue> values;
+        EXPECT_TRUE(VehiclePropertySnapshot::read(region, regionSize, &values));
+        return values;
+    }
+
+    static VehiclePropValue createInt32Value(int32_t prop, int32_t areaId, size_t count) {
+        VehiclePropValue value;
+        value.prop = prop;
+        value.areaId = areaId;
+        value.timestamp = 1000 + count;
+        for (size_t i = 0; i < count; i++) {
+            value.value.int32Values.push_back(static_cast<int32_t>(i * 10));
+        }
+        return value;
+    }
+
+    static void assertContains(const std::vector<VehiclePropValue>& values,
+                               const VehiclePropValue& expected) {
+        for (const auto& value : values) {
+            if (value.prop == expected.prop && value.areaId == expected.areaId) {
+                ASSERT_EQ(toString(expected), toString(value));
+                return;
+            }
+        }
+        FAIL() << "missing " << toString(expected);
+    }
+
+public:
+    VehiclePropertyStore store;
+    void* region = nullptr;
+    size_t regionSize = 0;
+};
+
+TEST_F(VehiclePropertySnapshotTest, fullSnapshotThenDeltas) {
+    const int32_t prop = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t area = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    VehiclePropValue stringValue;
+    stringValue.prop = toInt(VehicleProperty::INFO_MAKE);
+    stringValue.value.stringValue = "Example";
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, area, 1), true));
+    ASSERT_TRUE(store.writeValue(stringValue, true));
+
+    auto snapshot = std::make_shared<VehiclePropertySnapshot>();
+    ASSERT_TRUE(snapshot->init());
+    store.setSnapshot(snapshot);
+
+    auto values = readSnapshot(*snapshot);
+    ASSERT_EQ(2u, values.size());
+    assertContains(values, createInt32Value(prop, area, 1));
+    assertContains(values, stringValue);
+
+    // Fits in the existing record
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, area, 1), true));
+    // Needs a new record
+    ASSERT_TRUE(store.writeValue(createInt32Value(prop, area, 3), true));
+    store.removeValue(stringValue);
+
+    values = readSnapshot(*snapshot);
+    ASSERT_EQ(1u, values.size());
+    assertContains(values, createInt32Value(prop, area, 3));
+}
+
+TEST_F(VehiclePropertySnapshotTest, compactWhenFull) {
+    const int32_t prop = toInt(VehicleProperty::HVAC_FAN_SPEED);
+    const int32_t area = toInt(VehicleAreaSeat::ROW_1_LEFT);
+    VehiclePropertySnapshot snapshot(1024);
+    ASSERT_TRUE(snapshot.init());
+
+    // Every value is larger than the last, so each one appends a record
+    for (size_t i = 1; i <= 32; i++) {
+        snapshot.writeValue(createInt32Value(prop, area, i));
+    }
+
+    auto values = readSnapshot(snapshot);
+    ASSERT_EQ(1u, values.size());
+    assertContains(values, createInt32Value(prop, area, 32));
+
+    snapshot.removeValuesForProperty(prop);
+    ASSERT_EQ(0u, readSnapshot(snapshot).size());
+}
+
+TEST_F(VehiclePropertySnapshotTest, rejectsOtherRegions) {
+    std::vector<uint8_t> region(sizeof(VehiclePropertySnapshot::SnapshotHeader), 0);
+    std::vector<VehiclePropValue> values;
+    ASSERT_FALSE(VehiclePropertySnapshot::read(region.data(), region.size(), &values));
+    ASSERT_FALSE(VehiclePropertySnapshot::read(region.data(), 4, &values));
+}
+
+}  // namespace anonymous
+
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
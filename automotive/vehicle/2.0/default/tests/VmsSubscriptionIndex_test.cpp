@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <gtest/gtest.h>
+
+#include "VehicleHalTestUtils.h"
+#include "vhal_v2_0/VmsSubscriptionIndex.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace vehicle {
+namespace V2_0 {
+namespace vms {
+
+namespace {
+
+std::unique_ptr<VehiclePropValue> createSubscriptionsChange(int sequence_number,
+                                                            bool with_associated_layer) {
+    auto message = createBaseVmsMessage(0);
+    message->value.int32Values = hidl_vec<int32_t>{toInt(VmsMessageType::SUBSCRIPTIONS_CHANGE),
+                                                   sequence_number,
+                                                   1,  // number of layers
+                                                   with_associated_layer ? 1 : 0,
+                                                   1,  // layer
+                                                   0,
+                                                   1};
+    if (with_associated_layer) {
+        std::vector<int32_t> values = message->value.int32Values;
+        values.insert(values.end(), {2,  // associated layer
+                                     0,
+                                     1,
+                                     1,      // number of publisher IDs
+                                     123});  // publisher ID
+        message->value.int32Values = values;
+    }
+    return message;
+}
+
+TEST(VmsSubscriptionIndexTest, forwardEverythingBeforeFirstState) {
+    VmsSubscriptionIndex index;
+    EXPECT_EQ(-1, index.getSequenceNumber());
+    EXPECT_TRUE(index.shouldForward(
+            *createDataMessageWithLayerPublisherInfo(VmsLayerAndPublisher(VmsLayer(3, 0, 1), 1),
+                                                     "data")));
+}
+
+TEST(VmsSubscriptionIndexTest, routeDataByLayerAndPublisher) {
+    VmsSubscriptionIndex index;
+    ASSERT_TRUE(index.applySubscriptionsState(*createSubscriptionsChange(1, true)));
+
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(1, 0, 1), 456));
+    EXPECT_TRUE(index.isSubscribed(VmsLayer(2, 0, 1), 123));
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(2, 0, 1), 456));
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(1, 0, 2), 123));
+
+    auto subscribed = createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(2, 0, 1), 123), "data");
+    auto unsubscribed = createDataMessageWithLayerPublisherInfo(
+            VmsLayerAndPublisher(VmsLayer(2, 0, 1), 456), "data");
+    EXPECT_TRUE(index.shouldForward(*subscribed));
+    EXPECT_FALSE(index.shouldForward(*unsubscribed));
+    // Not a data message
+    EXPECT_TRUE(index.shouldForward(*createAvailabilityRequest()));
+
+    VmsOffers offers = {123, {VmsLayerOffering(VmsLayer(2, 0, 1)),
+                              VmsLayerOffering(VmsLayer(4, 0, 1))}};
+    auto layers = index.getSubscribedLayers(offers);
+    ASSERT_EQ(1u, layers.size());
+    EXPECT_EQ(VmsLayer(2, 0, 1), layers[0]);
+}
+
+TEST(VmsSubscriptionIndexTest, applyDeltas) {
+    VmsSubscriptionIndex index;
+    VmsSubscriptionsDelta delta;
+    ASSERT_TRUE(index.applySubscriptionsState(*createSubscriptionsChange(1, true), &delta));
+    EXPECT_EQ(1u, delta.added_layers.size());
+    EXPECT_EQ(1u, delta.added_layer_publishers.size());
+
+    ASSERT_TRUE(index.applySubscriptionsState(*createSubscriptionsChange(2, false), &delta));
+    EXPECT_TRUE(delta.added_layers.empty());
+    EXPECT_TRUE(delta.removed_layers.empty());
+    EXPECT_TRUE(delta.added_layer_publishers.empty());
+    ASSERT_EQ(1u, delta.removed_layer_publishers.size());
+    EXPECT_TRUE(VmsLayerAndPublisher(VmsLayer(2, 0, 1), 123) == delta.removed_layer_publishers[0]);
+
+    // Older sequence numbers are ignored
+    EXPECT_FALSE(index.applySubscriptionsState(*createSubscriptionsChange(1, true)));
+    EXPECT_FALSE(index.isSubscribed(VmsLayer(2, 0, 1), 123));
+    EXPECT_EQ(2, index.getSequenceNumber());
+}
+
+TEST(VmsSubscriptionIndexTest, ignoreMalformedState) {
+    VmsSubscriptionIndex index;
+    auto message = createSubscriptionsChange(1, true);
+    std::vector<int32_t> values = message->value.int32Values;
+    values.pop_back();  // missing publisher ID
+    message->value.int32Values = values;
+    EXPECT_FALSE(index.applySubscriptionsState(*message));
+    EXPECT_EQ(-1, index.getSequenceNumber());
+}
+
+}  // namespace
+
+}  // namespace vms
+}  // namespace V2_0
+}  // namespace vehicle
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
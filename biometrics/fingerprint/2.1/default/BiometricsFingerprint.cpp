@@ -23,6 +23,7 @@
 #include "BiometricsFingerprint.h"
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <unistd.h>
 
 namespace android {
@@ -40,7 +41,13 @@ using RequestStatus =
 
 BiometricsFingerprint *BiometricsFingerprint::sInstance = nullptr;
 
-BiometricsFingerprint::BiometricsFingerprint() : mClientCallback(nullptr), mDevice(nullptr) {
+BiometricsFingerprint::BiometricsFingerprint()
+    : mClientCallback(nullptr),
+      mDevice(nullptr),
+      mFingerDownToAcquired(mMetrics.histogram("finger_down_to_acquired")),
+      mAcquiredToAuthenticated(mMetrics.histogram("acquired_to_authenticated")),
+      mFingerDownToAuthenticated(mMetrics.histogram("finger_down_to_authenticated")),
+      mAuthenticateCount(mMetrics.counter("authenticate_calls")) {
     sInstance = this; // keep track of the most recent instance
     mDevice = openHal();
     if (!mDevice) {
@@ -174,6 +181,10 @@ Return<uint64_t> BiometricsFingerprint::getAuthenticatorId() {
 }
 
 Return<RequestStatus> BiometricsFingerprint::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mTimingMutex);
+        mAuthenticating = false;
+    }
     return ErrorFilter(mDevice->cancel(mDevice));
 }
 
@@ -201,9 +212,61 @@ Return<RequestStatus> BiometricsFingerprint::setActiveGroup(uint32_t gid,
 
 Return<RequestStatus> BiometricsFingerprint::authenticate(uint64_t operationId,
         uint32_t gid) {
+    {
+        std::lock_guard<std::mutex> lock(mTimingMutex);
+        mAuthenticating = true;
+        mFingerDownTime = mAcquiredTime = std::chrono::steady_clock::time_point();
+        mAuthenticateCount->increment();
+    }
     return ErrorFilter(mDevice->authenticate(mDevice, operationId, gid));
 }
 
+void BiometricsFingerprint::recordTiming(const fingerprint_msg_t *msg) {
+    std::lock_guard<std::mutex> lock(mTimingMutex);
+    if (!mAuthenticating) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto unset = std::chrono::steady_clock::time_point();
+    switch (msg->type) {
+        case FINGERPRINT_ACQUIRED:
+            if (mFingerDownTime == unset) {
+                mFingerDownTime = now;
+            }
+            if (msg->data.acquired.acquired_info == FINGERPRINT_ACQUIRED_GOOD &&
+                    mAcquiredTime == unset) {
+                mAcquiredTime = now;
+                mFingerDownToAcquired->record(mAcquiredTime - mFingerDownTime);
+            }
+            break;
+        case FINGERPRINT_AUTHENTICATED:
+            if (mAcquiredTime != unset) {
+                mAcquiredToAuthenticated->record(now - mAcquiredTime);
+            }
+            if (mFingerDownTime != unset) {
+                mFingerDownToAuthenticated->record(now - mFingerDownTime);
+            }
+            // The legacy HAL keeps authenticating after a rejected finger.
+            mFingerDownTime = mAcquiredTime = unset;
+            break;
+        case FINGERPRINT_ERROR:
+            mAuthenticating = false;
+            break;
+        default:
+            break;
+    }
+}
+
+Return<void> BiometricsFingerprint::debug(const hidl_handle& handle,
+        const hidl_vec<hidl_string>& /* args */) {
+    if (handle == nullptr || handle->numFds < 1) {
+        return Void();
+    }
+    int fd = handle->data[0];
+    mMetrics.dump(fd);
+    return Void();
+}
+
 IBiometricsFingerprint* BiometricsFingerprint::getInstance() {
     if (!sInstance) {
       sInstance = new BiometricsFingerprint();
@@ -260,6 +323,7 @@ fingerprint_device_t* BiometricsFingerprint::openHal() {
 void BiometricsFingerprint::notify(const fingerprint_msg_t *msg) {
     BiometricsFingerprint* thisPtr = static_cast<BiometricsFingerprint*>(
             BiometricsFingerprint::getInstance());
+    thisPtr->recordTiming(msg);
     std::lock_guard<std::mutex> lock(thisPtr->mClientCallbackMutex);
     if (thisPtr == nullptr || thisPtr->mClientCallback == nullptr) {
         ALOGE("Receiving callbacks before the client callback is registered.");
@@ -17,10 +17,13 @@
 #ifndef ANDROID_HARDWARE_BIOMETRICS_FINGERPRINT_V2_1_BIOMETRICSFINGERPRINT_H
 #define ANDROID_HARDWARE_BIOMETRICS_FINGERPRINT_V2_1_BIOMETRICSFINGERPRINT_H
 
+#include <chrono>
+#include <mutex>
 #include <log/log.h>
 #include <android/log.h>
 #include <hardware/hardware.h>
 #include <hardware/fingerprint.h>
+#include <hal-metrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <android/hardware/biometrics/fingerprint/2.1/IBiometricsFingerprint.h>
@@ -37,6 +40,7 @@ using ::android::hardware::biometrics::fingerprint::V2_1::IBiometricsFingerprint
 using ::android::hardware::biometrics::fingerprint::V2_1::RequestStatus;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
 using ::android::sp;
@@ -61,7 +65,13 @@ public:
     Return<RequestStatus> setActiveGroup(uint32_t gid, const hidl_string& storePath) override;
     Return<RequestStatus> authenticate(uint64_t operationId, uint32_t gid) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>& args) override;
+
 private:
+    // Tracks the stages of an authentication for the latency histograms.
+    void recordTiming(const fingerprint_msg_t *msg);
+
     static fingerprint_device_t* openHal();
     static void notify(const fingerprint_msg_t *msg); /* Static callback for legacy HAL implementation */
     static Return<RequestStatus> ErrorFilter(int32_t error);
@@ -72,6 +82,18 @@ private:
     std::mutex mClientCallbackMutex;
     sp<IBiometricsFingerprintClientCallback> mClientCallback;
     fingerprint_device_t *mDevice;
+
+    std::mutex mTimingMutex;
+    bool mAuthenticating = false;
+    // Time of the first acquired message (finger down) and of ACQUIRED_GOOD, or zero.
+    std::chrono::steady_clock::time_point mFingerDownTime;
+    std::chrono::steady_clock::time_point mAcquiredTime;
+    // Authentication latencies, dumped by debug()
+    ::android::hardware::metrics::Registry mMetrics{"fingerprint"};
+    ::android::hardware::metrics::Histogram* mFingerDownToAcquired;
+    ::android::hardware::metrics::Histogram* mAcquiredToAuthenticated;
+    ::android::hardware::metrics::Histogram* mFingerDownToAuthenticated;
+    ::android::hardware::metrics::Counter* mAuthenticateCount;
 };
 
 }  // namespace implementation
@@ -27,11 +27,16 @@
 #include <thread>
 #include <vector>
 #include "fcntl.h"
-#include "sys/select.h"
+#include "sys/epoll.h"
+#include "sys/eventfd.h"
 #include "unistd.h"
 
 static const int INVALID_FD = -1;
 
+// Ready file descriptors handled per epoll_wait(), more are picked up by the
+// next call.
+static const int MAX_EPOLL_EVENTS = 8;
+
 static const int BT_RT_PRIORITY = 1;
 
 namespace android {
@@ -44,7 +49,14 @@ int AsyncFdWatcher::WatchFdForNonBlockingReads(
   // Add file descriptor and callback
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
+    bool added = watched_fds_.count(file_descriptor) == 0;
     watched_fds_[file_descriptor] = on_read_fd_ready_callback;
+    // A running thread picks the new fd up without being woken.
+    if (added && epoll_fd_ != INVALID_FD &&
+        addToEpoll(file_descriptor) != 0) {
+      watched_fds_.erase(file_descriptor);
+      return -1;
+    }
   }
 
   // Start the thread if not started yet
@@ -74,12 +86,19 @@ AsyncFdWatcher::~AsyncFdWatcher() {}
 int AsyncFdWatcher::tryStartThread() {
   if (std::atomic_exchange(&running_, true)) return 0;
 
-  // Set up the communication channel
-  int pipe_fds[2];
-  if (pipe2(pipe_fds, O_NONBLOCK)) return -1;
+  {
+    std::unique_lock<std::mutex> guard(internal_mutex_);
+    // Set up the communication channel
+    notification_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notification_fd_ < 0) return -1;
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) return -1;
 
-  notification_listen_fd_ = pipe_fds[0];
-  notification_write_fd_ = pipe_fds[1];
+    if (addToEpoll(notification_fd_) != 0) return -1;
+    for (auto& it : watched_fds_) {
+      if (addToEpoll(it.first) != 0) return -1;
+    }
+  }
 
   thread_ = std::thread([this]() { ThreadRoutine(); });
   if (!thread_.joinable()) return -1;
@@ -98,6 +117,8 @@ int AsyncFdWatcher::stopThread() {
   {
     std::unique_lock<std::mutex> guard(internal_mutex_);
     watched_fds_.clear();
+    close(epoll_fd_);
+    epoll_fd_ = INVALID_FD;
   }
 
   {
@@ -105,15 +126,28 @@ int AsyncFdWatcher::stopThread() {
     timeout_cb_ = nullptr;
   }
 
-  close(notification_listen_fd_);
-  close(notification_write_fd_);
+  close(notification_fd_);
+  notification_fd_ = INVALID_FD;
 
   return 0;
 }
 
 int AsyncFdWatcher::notifyThread() {
-  uint8_t buffer[] = {0};
-  if (TEMP_FAILURE_RETRY(write(notification_write_fd_, &buffer, 1)) < 0) {
+  if (TEMP_FAILURE_RETRY(eventfd_write(notification_fd_, 1)) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+int AsyncFdWatcher::addToEpoll(int file_descriptor) {
+  // Level triggered: the read callbacks may leave data in the fd for the next
+  // wake up.
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = file_descriptor;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, file_descriptor, &event) < 0) {
+    ALOGE("%s unable to watch fd %d, error %s", __func__, file_descriptor,
+          strerror(errno));
     return -1;
   }
   return 0;
@@ -129,26 +163,17 @@ void AsyncFdWatcher::ThreadRoutine() {
   }
 
   while (running_) {
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(notification_listen_fd_, &read_fds);
-    int max_read_fd = INVALID_FD;
-    for (auto& it : watched_fds_) {
-      FD_SET(it.first, &read_fds);
-      max_read_fd = std::max(max_read_fd, it.first);
-    }
-
-    struct timeval timeout;
-    struct timeval* timeout_ptr = NULL;
-    if (timeout_ms_ > std::chrono::milliseconds(0)) {
-      timeout.tv_sec = timeout_ms_.count() / 1000;
-      timeout.tv_usec = (timeout_ms_.count() % 1000) * 1000;
-      timeout_ptr = &timeout;
+    int timeout = -1;
+    {
+      std::unique_lock<std::mutex> guard(timeout_mutex_);
+      if (timeout_ms_ > std::chrono::milliseconds(0)) {
+        timeout = timeout_ms_.count();
+      }
     }
 
     // Wait until there is data available to read on some FD.
-    int nfds = std::max(notification_listen_fd_, max_read_fd);
-    int retval = select(nfds + 1, &read_fds, NULL, NULL, timeout_ptr);
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int retval = epoll_wait(epoll_fd_, events, MAX_EPOLL_EVENTS, timeout);
 
     // There was some error.
     if (retval < 0) continue;
@@ -165,20 +190,21 @@ void AsyncFdWatcher::ThreadRoutine() {
       continue;
     }
 
-    // Read data from the notification FD.
-    if (FD_ISSET(notification_listen_fd_, &read_fds)) {
-      char buffer[] = {0};
-      TEMP_FAILURE_RETRY(read(notification_listen_fd_, buffer, 1));
-      continue;
-    }
-
-    // Invoke the data ready callbacks if appropriate.
+    // Invoke the data ready callbacks of the ready FDs only.
     {
       // Hold the mutex to make sure that the callbacks are still valid.
       std::unique_lock<std::mutex> guard(internal_mutex_);
-      for (auto& it : watched_fds_) {
-        if (FD_ISSET(it.first, &read_fds)) {
-          it.second(it.first);
+      for (int i = 0; i < retval && running_; i++) {
+        int fd = events[i].data.fd;
+        if (fd == notification_fd_) {
+          // Read data from the notification FD.
+          eventfd_t value;
+          eventfd_read(notification_fd_, &value);
+          continue;
+        }
+        auto it = watched_fds_.find(fd);
+        if (it != watched_fds_.end()) {
+          it->second(fd);
         }
       }
     }
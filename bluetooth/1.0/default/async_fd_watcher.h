@@ -46,6 +46,7 @@ class AsyncFdWatcher {
   int tryStartThread();
   int stopThread();
   int notifyThread();
+  int addToEpoll(int file_descriptor);
   void ThreadRoutine();
 
   std::atomic_bool running_{false};
@@ -54,10 +55,13 @@ class AsyncFdWatcher {
   std::mutex timeout_mutex_;
 
   std::map<int, ReadCallback> watched_fds_;
-  int notification_listen_fd_;
-  int notification_write_fd_;
+  // The epoll instance watching notification_fd_ and watched_fds_, valid while
+  // the thread is running. Guarded by internal_mutex_.
+  int epoll_fd_ = -1;
+  // eventfd used to wake the thread up when the timeout changes or it stops
+  int notification_fd_ = -1;
   TimeoutCallback timeout_cb_;
-  std::chrono::milliseconds timeout_ms_;
+  std::chrono::milliseconds timeout_ms_{0};
 };
 
 }  // namespace async
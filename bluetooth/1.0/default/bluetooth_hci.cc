@@ -19,6 +19,7 @@
 
 #include <log/log.h>
 
+#include "hci_stats.h"
 #include "vendor_interface.h"
 
 namespace android {
@@ -31,6 +32,20 @@ static const uint8_t HCI_DATA_TYPE_COMMAND = 1;
 static const uint8_t HCI_DATA_TYPE_ACL = 2;
 static const uint8_t HCI_DATA_TYPE_SCO = 3;
 
+using ::android::hardware::bluetooth::hci::HciStats;
+
+// Accounts for a received packet and times its delivery to the stack
+template <typename Dispatch>
+static void DispatchPacket(HciPacketType type, const hidl_vec<uint8_t>& packet,
+                           Dispatch dispatch) {
+  HciStats& stats = HciStats::Get();
+  stats.OnPacket(HciStats::RX, type, packet.size());
+  if (type == HCI_PACKET_TYPE_EVENT) stats.OnEventReceived(packet);
+  int64_t start_ns = HciStats::Now();
+  dispatch();
+  stats.OnDispatched(type, HciStats::Now() - start_ns);
+}
+
 class BluetoothDeathRecipient : public hidl_death_recipient {
  public:
   BluetoothDeathRecipient(const sp<IBluetoothHci> hci) : mHci(hci) {}
@@ -73,22 +88,28 @@ Return<void> BluetoothHci::initialize(
         }
       },
       [cb](const hidl_vec<uint8_t>& packet) {
-        auto hidl_status = cb->hciEventReceived(packet);
-        if (!hidl_status.isOk()) {
-          ALOGE("VendorInterface -> Unable to call hciEventReceived()");
-        }
+        DispatchPacket(HCI_PACKET_TYPE_EVENT, packet, [&cb, &packet]() {
+          auto hidl_status = cb->hciEventReceived(packet);
+          if (!hidl_status.isOk()) {
+            ALOGE("VendorInterface -> Unable to call hciEventReceived()");
+          }
+        });
       },
       [cb](const hidl_vec<uint8_t>& packet) {
-        auto hidl_status = cb->aclDataReceived(packet);
-        if (!hidl_status.isOk()) {
-          ALOGE("VendorInterface -> Unable to call aclDataReceived()");
-        }
+        DispatchPacket(HCI_PACKET_TYPE_ACL_DATA, packet, [&cb, &packet]() {
+          auto hidl_status = cb->aclDataReceived(packet);
+          if (!hidl_status.isOk()) {
+            ALOGE("VendorInterface -> Unable to call aclDataReceived()");
+          }
+        });
       },
       [cb](const hidl_vec<uint8_t>& packet) {
-        auto hidl_status = cb->scoDataReceived(packet);
-        if (!hidl_status.isOk()) {
-          ALOGE("VendorInterface -> Unable to call scoDataReceived()");
-        }
+        DispatchPacket(HCI_PACKET_TYPE_SCO_DATA, packet, [&cb, &packet]() {
+          auto hidl_status = cb->scoDataReceived(packet);
+          if (!hidl_status.isOk()) {
+            ALOGE("VendorInterface -> Unable to call scoDataReceived()");
+          }
+        });
       });
   if (!rc) {
     auto hidl_status = cb->initializationComplete(Status::INITIALIZATION_ERROR);
@@ -120,7 +141,11 @@ Return<void> BluetoothHci::sendHciCommand(const hidl_vec<uint8_t>& command) {
 }
 
 Return<void> BluetoothHci::sendAclData(const hidl_vec<uint8_t>& data) {
-  sendDataToController(HCI_DATA_TYPE_ACL, data);
+  HciStats::Get().OnPacket(HciStats::TX, HCI_PACKET_TYPE_ACL_DATA, data.size());
+  // ACL data may be coalesced with the following packets, commands and SCO
+  // data are latency sensitive and always written right away.
+  VendorInterface::get()->SendBuffered(HCI_DATA_TYPE_ACL, data.data(),
+                                       data.size());
   return Void();
 }
 
@@ -131,9 +156,20 @@ Return<void> BluetoothHci::sendScoData(const hidl_vec<uint8_t>& data) {
 
 void BluetoothHci::sendDataToController(const uint8_t type,
                                         const hidl_vec<uint8_t>& data) {
+  HciStats& stats = HciStats::Get();
+  stats.OnPacket(HciStats::TX, static_cast<HciPacketType>(type), data.size());
+  if (type == HCI_DATA_TYPE_COMMAND) stats.OnCommandSent(data);
   VendorInterface::get()->Send(type, data.data(), data.size());
 }
 
+Return<void> BluetoothHci::debug(const hidl_handle& fd,
+                                 const hidl_vec<hidl_string>& /* options */) {
+  if (fd.getNativeHandle() != nullptr && fd->numFds > 0) {
+    HciStats::Get().Dump(fd->data[0]);
+  }
+  return Void();
+}
+
 IBluetoothHci* HIDL_FETCH_IBluetoothHci(const char* /* name */) {
   return new BluetoothHci();
 }
@@ -29,22 +29,99 @@ namespace hardware {
 namespace bluetooth {
 namespace hci {
 
+// Buffered bytes that are written right away instead of waiting for the
+// window to end
+static const size_t TX_BUFFER_SIZE_MAX = 4096;
+
+H4Protocol::H4Protocol(int fd, PacketReadCallback event_cb,
+                       PacketReadCallback acl_cb, PacketReadCallback sco_cb,
+                       std::chrono::microseconds tx_window)
+    : uart_fd_(fd),
+      event_cb_(event_cb),
+      acl_cb_(acl_cb),
+      sco_cb_(sco_cb),
+      hci_packetizer_([this]() { OnPacketReady(); }),
+      tx_window_(tx_window) {
+  if (tx_window_ > std::chrono::microseconds(0)) {
+    tx_buffer_.reserve(TX_BUFFER_SIZE_MAX);
+    tx_running_ = true;
+    tx_thread_ = std::thread([this]() { TxThreadRoutine(); });
+  }
+}
+
+H4Protocol::~H4Protocol() {
+  {
+    std::unique_lock<std::mutex> guard(tx_mutex_);
+    if (!tx_running_) return;
+    tx_running_ = false;
+  }
+  tx_cond_.notify_one();
+  tx_thread_.join();
+}
+
 size_t H4Protocol::Send(uint8_t type, const uint8_t* data, size_t length) {
-  struct iovec iov[] = {{&type, sizeof(type)},
+  std::unique_lock<std::mutex> guard(tx_mutex_);
+  return FlushLocked(&type, data, length);
+}
+
+size_t H4Protocol::SendBuffered(uint8_t type, const uint8_t* data,
+                                size_t length) {
+  if (tx_window_ <= std::chrono::microseconds(0)) {
+    return Send(type, data, length);
+  }
+  std::unique_lock<std::mutex> guard(tx_mutex_);
+  if (tx_buffer_.size() + 1 + length > TX_BUFFER_SIZE_MAX) {
+    return FlushLocked(&type, data, length);
+  }
+  if (tx_buffer_.empty()) {
+    tx_deadline_ = std::chrono::steady_clock::now() + tx_window_;
+    tx_cond_.notify_one();
+  }
+  tx_buffer_.push_back(type);
+  tx_buffer_.insert(tx_buffer_.end(), data, data + length);
+  return length + 1;
+}
+
+size_t H4Protocol::FlushLocked(const uint8_t* type, const uint8_t* data,
+                               size_t length) {
+  struct iovec iov[] = {{tx_buffer_.data(), tx_buffer_.size()},
+                        {const_cast<uint8_t*>(type), type ? 1u : 0u},
                         {const_cast<uint8_t*>(data), length}};
+  size_t buffered = tx_buffer_.size();
+  size_t expected = buffered + (type ? 1 : 0) + length;
+  if (expected == 0) return 0;
+
   ssize_t ret = 0;
   do {
     ret =
         TEMP_FAILURE_RETRY(writev(uart_fd_, iov, sizeof(iov) / sizeof(iov[0])));
   } while (-1 == ret && EAGAIN == errno);
+  tx_buffer_.clear();
 
   if (ret == -1) {
     ALOGE("%s error writing to UART (%s)", __func__, strerror(errno));
-  } else if (ret < static_cast<ssize_t>(length + 1)) {
+  } else if (ret < static_cast<ssize_t>(expected)) {
     ALOGE("%s: %d / %d bytes written - something went wrong...", __func__,
-          static_cast<int>(ret), static_cast<int>(length + 1));
+          static_cast<int>(ret), static_cast<int>(expected));
+  }
+  // Report what was written of the caller's packet only.
+  if (ret <= static_cast<ssize_t>(buffered)) return ret < 0 ? ret : 0;
+  return ret - buffered;
+}
+
+void H4Protocol::TxThreadRoutine() {
+  std::unique_lock<std::mutex> guard(tx_mutex_);
+  while (tx_running_) {
+    if (tx_buffer_.empty()) {
+      tx_cond_.wait(guard);
+      continue;
+    }
+    if (tx_cond_.wait_until(guard, tx_deadline_) == std::cv_status::timeout &&
+        !tx_buffer_.empty()) {
+      FlushLocked(nullptr, nullptr, 0);
+    }
   }
-  return ret;
+  FlushLocked(nullptr, nullptr, 0);
 }
 
 void H4Protocol::OnPacketReady() {
@@ -67,32 +144,33 @@ void H4Protocol::OnPacketReady() {
 }
 
 void H4Protocol::OnDataReady(int fd) {
-  if (hci_packet_type_ == HCI_PACKET_TYPE_UNKNOWN) {
-    uint8_t buffer[1] = {0};
-    ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer, 1));
-    if (bytes_read != 1) {
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the packet type!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      } else if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read packet type error: %s", __func__,
-                         strerror(errno));
-      } else {
-        LOG_ALWAYS_FATAL("%s: More bytes read than expected (%u)!", __func__,
-                         static_cast<unsigned int>(bytes_read));
+  // Read as much as is available, it may hold several packets.
+  ssize_t bytes_read =
+      TEMP_FAILURE_RETRY(read(fd, rx_buffer_, sizeof(rx_buffer_)));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading the UART!", __func__);
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  } else if (bytes_read < 0) {
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+
+  size_t offset = 0;
+  while (offset < static_cast<size_t>(bytes_read)) {
+    if (hci_packet_type_ == HCI_PACKET_TYPE_UNKNOWN) {
+      hci_packet_type_ = static_cast<HciPacketType>(rx_buffer_[offset++]);
+      if (hci_packet_type_ != HCI_PACKET_TYPE_ACL_DATA &&
+          hci_packet_type_ != HCI_PACKET_TYPE_SCO_DATA &&
+          hci_packet_type_ != HCI_PACKET_TYPE_EVENT) {
+        LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
+                         static_cast<int>(hci_packet_type_));
       }
+    } else {
+      // OnPacketReady() resets the type once a packet is complete.
+      offset += hci_packetizer_.OnDataReceived(
+          hci_packet_type_, rx_buffer_ + offset, bytes_read - offset);
     }
-    hci_packet_type_ = static_cast<HciPacketType>(buffer[0]);
-    if (hci_packet_type_ != HCI_PACKET_TYPE_ACL_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_SCO_DATA &&
-        hci_packet_type_ != HCI_PACKET_TYPE_EVENT) {
-      LOG_ALWAYS_FATAL("%s: Unimplemented packet type %d", __func__,
-                       static_cast<int>(hci_packet_type_));
-    }
-  } else {
-    hci_packetizer_.OnDataReady(fd, hci_packet_type_);
   }
 }
 
@@ -16,6 +16,12 @@
 
 #pragma once
 
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <hidl/HidlSupport.h>
 
 #include "async_fd_watcher.h"
@@ -30,21 +36,26 @@ namespace hci {
 
 class H4Protocol : public HciProtocol {
  public:
+  // tx_window is how long SendBuffered() may hold packets back, 0 disables
+  // the batching.
   H4Protocol(int fd, PacketReadCallback event_cb, PacketReadCallback acl_cb,
-             PacketReadCallback sco_cb)
-      : uart_fd_(fd),
-        event_cb_(event_cb),
-        acl_cb_(acl_cb),
-        sco_cb_(sco_cb),
-        hci_packetizer_([this]() { OnPacketReady(); }) {}
+             PacketReadCallback sco_cb,
+             std::chrono::microseconds tx_window = std::chrono::microseconds(0));
+  ~H4Protocol();
 
+  // Writes the packet, and the buffered ones in front of it, right away.
   size_t Send(uint8_t type, const uint8_t* data, size_t length);
+  size_t SendBuffered(uint8_t type, const uint8_t* data, size_t length);
 
   void OnPacketReady();
 
   void OnDataReady(int fd);
 
  private:
+  // Writes tx_buffer_ followed by the packet, if any. tx_mutex_ must be held.
+  size_t FlushLocked(const uint8_t* type, const uint8_t* data, size_t length);
+  void TxThreadRoutine();
+
   int uart_fd_;
 
   PacketReadCallback event_cb_;
@@ -53,6 +64,16 @@ class H4Protocol : public HciProtocol {
 
   HciPacketType hci_packet_type_{HCI_PACKET_TYPE_UNKNOWN};
   hci::HciPacketizer hci_packetizer_;
+  uint8_t rx_buffer_[HCI_RX_BUFFER_SIZE];
+
+  const std::chrono::microseconds tx_window_;
+  std::mutex tx_mutex_;
+  std::condition_variable tx_cond_;
+  // Buffered packets, each one preceded by its type byte
+  std::vector<uint8_t> tx_buffer_;
+  std::chrono::steady_clock::time_point tx_deadline_;
+  bool tx_running_{false};
+  std::thread tx_thread_;
 };
 
 }  // namespace hci
@@ -45,5 +45,9 @@ const size_t HCI_LENGTH_OFFSET_EVT = 1;
 
 const size_t HCI_PREAMBLE_SIZE_MAX = HCI_ACL_PREAMBLE_SIZE;
 
-// Event codes (Volume 2, Part E, 7.7.14)
+// Bytes read from the controller with one read() call
+const size_t HCI_RX_BUFFER_SIZE = 4096;
+
+// Event codes (Volume 2, Part E, 7.7.14 and 7.7.15)
 const uint8_t HCI_COMMAND_COMPLETE_EVENT = 0x0E;
+const uint8_t HCI_COMMAND_STATUS_EVENT = 0x0F;
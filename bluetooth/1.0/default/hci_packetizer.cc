@@ -20,10 +20,15 @@
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <utils/Log.h>
 
+#include <algorithm>
+
+#include "hci_stats.h"
+
 namespace {
 
 const size_t preamble_size_for_type[] = {
@@ -49,59 +54,74 @@ namespace hci {
 const hidl_vec<uint8_t>& HciPacketizer::GetPacket() const { return packet_; }
 
 void HciPacketizer::OnDataReady(int fd, HciPacketType packet_type) {
-  switch (state_) {
-    case HCI_PREAMBLE: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(
-          read(fd, preamble_ + bytes_read_,
-               preamble_size_for_type[packet_type] - bytes_read_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the header!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read header error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_read_ += bytes_read;
-      if (bytes_read_ == preamble_size_for_type[packet_type]) {
-        size_t packet_length =
-            HciGetPacketLengthForType(packet_type, preamble_);
-        packet_.resize(preamble_size_for_type[packet_type] + packet_length);
-        memcpy(packet_.data(), preamble_, preamble_size_for_type[packet_type]);
-        bytes_remaining_ = packet_length;
-        state_ = HCI_PAYLOAD;
-        bytes_read_ = 0;
-      }
-      break;
-    }
+  ssize_t bytes_read =
+      TEMP_FAILURE_RETRY(read(fd, rx_buffer_, sizeof(rx_buffer_)));
+  if (bytes_read == 0) {
+    // This is only expected if the UART got closed when shutting down.
+    ALOGE("%s: Unexpected EOF reading the %s!", __func__,
+          state_ == HCI_PREAMBLE ? "header" : "payload");
+    sleep(5);  // Expect to be shut down within 5 seconds.
+    return;
+  }
+  if (bytes_read < 0) {
+    LOG_ALWAYS_FATAL("%s: Read error: %s", __func__, strerror(errno));
+  }
+  size_t offset = 0;
+  while (offset < static_cast<size_t>(bytes_read)) {
+    offset += OnDataReceived(packet_type, rx_buffer_ + offset,
+                             bytes_read - offset);
+  }
+}
 
-    case HCI_PAYLOAD: {
-      ssize_t bytes_read = TEMP_FAILURE_RETRY(read(
-          fd,
-          packet_.data() + preamble_size_for_type[packet_type] + bytes_read_,
-          bytes_remaining_));
-      if (bytes_read == 0) {
-        // This is only expected if the UART got closed when shutting down.
-        ALOGE("%s: Unexpected EOF reading the payload!", __func__);
-        sleep(5);  // Expect to be shut down within 5 seconds.
-        return;
-      }
-      if (bytes_read < 0) {
-        LOG_ALWAYS_FATAL("%s: Read payload error: %s", __func__,
-                         strerror(errno));
-      }
-      bytes_remaining_ -= bytes_read;
-      bytes_read_ += bytes_read;
-      if (bytes_remaining_ == 0) {
+size_t HciPacketizer::OnDataReceived(HciPacketType packet_type,
+                                     const uint8_t* data, size_t length) {
+  const size_t preamble_size = preamble_size_for_type[packet_type];
+  size_t consumed = 0;
+
+  if (state_ == HCI_PREAMBLE) {
+    // A packet that was read in one piece is handed up in place.
+    if (bytes_read_ == 0 && length >= preamble_size) {
+      size_t packet_size =
+          preamble_size + HciGetPacketLengthForType(packet_type, data);
+      if (length >= packet_size) {
+        packet_.setToExternal(const_cast<uint8_t*>(data), packet_size);
         packet_ready_cb_();
-        state_ = HCI_PREAMBLE;
-        bytes_read_ = 0;
+        return packet_size;
       }
-      break;
     }
+
+    if (bytes_read_ == 0) packet_start_ns_ = HciStats::Now();
+    size_t bytes = std::min(length, preamble_size - bytes_read_);
+    memcpy(preamble_ + bytes_read_, data, bytes);
+    bytes_read_ += bytes;
+    consumed += bytes;
+    if (bytes_read_ < preamble_size) return consumed;
+
+    size_t packet_length = HciGetPacketLengthForType(packet_type, preamble_);
+    if (packet_buffer_.size() < preamble_size + packet_length) {
+      packet_buffer_.resize(preamble_size + packet_length);
+    }
+    memcpy(packet_buffer_.data(), preamble_, preamble_size);
+    packet_.setToExternal(packet_buffer_.data(), preamble_size + packet_length);
+    bytes_remaining_ = packet_length;
+    state_ = HCI_PAYLOAD;
+    bytes_read_ = 0;
+  }
+
+  size_t bytes = std::min(length - consumed, bytes_remaining_);
+  memcpy(packet_buffer_.data() + preamble_size + bytes_read_, data + consumed,
+         bytes);
+  bytes_remaining_ -= bytes;
+  bytes_read_ += bytes;
+  consumed += bytes;
+  if (bytes_remaining_ == 0) {
+    HciStats::Get().OnPacketizerStall(packet_type,
+                                      HciStats::Now() - packet_start_ns_);
+    packet_ready_cb_();
+    state_ = HCI_PREAMBLE;
+    bytes_read_ = 0;
   }
+  return consumed;
 }
 
 }  // namespace hci
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include <hidl/HidlSupport.h>
 
@@ -34,7 +35,15 @@ class HciPacketizer {
  public:
   HciPacketizer(HciPacketReadyCallback packet_cb)
       : packet_ready_cb_(packet_cb){};
+  // Reads what is available on fd, which only carries packet_type packets,
+  // and calls packet_cb for every complete packet.
   void OnDataReady(int fd, HciPacketType packet_type);
+  // Frames bytes already read from the controller. Consumes data up to the
+  // end of the packet being framed and returns the number of bytes used, so
+  // that a transport with per-packet type bytes can stop at packet borders.
+  size_t OnDataReceived(HciPacketType packet_type, const uint8_t* data,
+                        size_t length);
+  // The packet is only valid in packet_cb, it may point into the read buffer.
   const hidl_vec<uint8_t>& GetPacket() const;
 
  protected:
@@ -42,9 +51,14 @@ class HciPacketizer {
   State state_{HCI_PREAMBLE};
   uint8_t preamble_[HCI_PREAMBLE_SIZE_MAX];
   hidl_vec<uint8_t> packet_;
+  // Storage for packets split across reads, reused from packet to packet
+  std::vector<uint8_t> packet_buffer_;
   size_t bytes_remaining_{0};
   size_t bytes_read_{0};
+  // When the first bytes of a packet split across reads arrived
+  int64_t packet_start_ns_{0};
   HciPacketReadyCallback packet_ready_cb_;
+  uint8_t rx_buffer_[HCI_RX_BUFFER_SIZE];
 };
 
 }  // namespace hci
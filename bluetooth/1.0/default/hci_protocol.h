@@ -39,6 +39,14 @@ class HciProtocol {
   // Protocol-specific implementation of sending packets.
   virtual size_t Send(uint8_t type, const uint8_t* data, size_t length) = 0;
 
+  // Like Send(), but the protocol may hold the packet back for a short while
+  // to write it together with the next ones. Packets are still written in
+  // the order of the Send() and SendBuffered() calls.
+  virtual size_t SendBuffered(uint8_t type, const uint8_t* data,
+                              size_t length) {
+    return Send(type, data, length);
+  }
+
  protected:
   static size_t WriteSafely(int fd, const uint8_t* data, size_t length);
 };
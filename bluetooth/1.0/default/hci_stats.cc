@@ -0,0 +1,259 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "hci_stats.h"
+
+#define LOG_TAG "android.hardware.bluetooth-hci-stats"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <chrono>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace hci {
+
+namespace {
+
+const char* const kPacketTypeNames[] = {"unknown", "command", "acl", "sco",
+                                        "event"};
+
+// Dispatches taking longer than this go into the ring
+const int64_t kSlowDispatchNs = 1000000;
+
+uint16_t GetOpcode(const hidl_vec<uint8_t>& packet, size_t offset) {
+  return packet[offset] | (packet[offset + 1] << 8);
+}
+
+std::chrono::nanoseconds ToDuration(int64_t ns) {
+  return std::chrono::nanoseconds(ns);
+}
+
+// Same format as the histograms of the registry dump
+void DumpHistogram(int fd, const char* name,
+                   const ::android::hardware::metrics::Histogram& histogram) {
+  ::android::hardware::metrics::Histogram::Snapshot snapshot =
+      histogram.snapshot();
+  if (snapshot.count == 0) return;
+  dprintf(fd,
+          "  %s: %" PRIu64 " samples, mean %" PRId64 "us, p50 %" PRId64
+          "us, p99 %" PRId64 "us, max %" PRId64 "us\n",
+          name, snapshot.count,
+          static_cast<int64_t>(snapshot.total.count() / 1000 /
+                               static_cast<int64_t>(snapshot.count)),
+          static_cast<int64_t>(snapshot.percentile(50).count()),
+          static_cast<int64_t>(snapshot.percentile(99).count()),
+          static_cast<int64_t>(snapshot.max.count() / 1000));
+}
+
+}  // namespace
+
+HciStats::HciStats() : start_ns_(Now()), last_dump_ns_(start_ns_) {
+  for (size_t type = 0; type < kPacketTypes; type++) {
+    std::string name = kPacketTypeNames[type];
+    bytes_[TX][type] = registry_.counter("tx." + name + ".bytes");
+    packets_[TX][type] = registry_.counter("tx." + name + ".packets");
+    bytes_[RX][type] = registry_.counter("rx." + name + ".bytes");
+    packets_[RX][type] = registry_.counter("rx." + name + ".packets");
+    stall_[type] = registry_.histogram(name + ".packetizer_stall");
+    dispatch_[type] = registry_.histogram(name + ".dispatch");
+  }
+  command_latency_ = registry_.histogram("command.round_trip");
+}
+
+HciStats& HciStats::Get() {
+  static HciStats stats;
+  return stats;
+}
+
+int64_t HciStats::Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void HciStats::OnPacket(Direction direction, HciPacketType type,
+                        size_t length) {
+  if (type >= kPacketTypes) return;
+  bytes_[direction][type]->increment(length);
+  packets_[direction][type]->increment();
+}
+
+void HciStats::OnCommandSent(const hidl_vec<uint8_t>& packet) {
+  if (packet.size() < HCI_COMMAND_PREAMBLE_SIZE) return;
+  uint32_t opcode = GetOpcode(packet, 0) + 1;
+  int64_t now = Now();
+  // The stack has one outstanding command at a time in practice, a full
+  // table just drops the measurement.
+  for (auto& pending : pending_) {
+    uint32_t free_slot = 0;
+    if (pending.opcode.compare_exchange_strong(free_slot, opcode,
+                                               std::memory_order_acquire)) {
+      pending.sent_ns.store(now, std::memory_order_release);
+      return;
+    }
+  }
+}
+
+void HciStats::OnEventReceived(const hidl_vec<uint8_t>& packet) {
+  size_t opcode_offset;
+  if (packet.size() < HCI_EVENT_PREAMBLE_SIZE) return;
+  if (packet[0] == HCI_COMMAND_COMPLETE_EVENT) {
+    opcode_offset = HCI_EVENT_PREAMBLE_SIZE + 1;  // Skip num packets.
+  } else if (packet[0] == HCI_COMMAND_STATUS_EVENT) {
+    opcode_offset = HCI_EVENT_PREAMBLE_SIZE + 2;  // Skip status, num packets.
+  } else {
+    return;
+  }
+  if (packet.size() < opcode_offset + 2) return;
+  uint16_t opcode = GetOpcode(packet, opcode_offset);
+  if (opcode == 0) return;  // Only updates the number of allowed commands.
+
+  int64_t now = Now();
+  for (auto& pending : pending_) {
+    uint32_t expected = opcode + 1u;
+    if (pending.opcode.load(std::memory_order_relaxed) != expected) continue;
+    int64_t sent_ns = pending.sent_ns.load(std::memory_order_acquire);
+    if (pending.opcode.compare_exchange_strong(expected, 0,
+                                               std::memory_order_relaxed)) {
+      RecordCommandLatency(opcode, now - sent_ns);
+      AddRecord(RECORD_COMMAND, opcode, now - sent_ns);
+      return;
+    }
+  }
+}
+
+void HciStats::RecordCommandLatency(uint16_t opcode, int64_t latency_ns) {
+  command_latency_->record(ToDuration(latency_ns));
+  uint32_t key = opcode + 1u;
+  for (auto& slot : command_latency_by_opcode_) {
+    uint32_t slot_key = slot.opcode.load(std::memory_order_relaxed);
+    // A free slot is claimed for good, the opcode never moves afterwards.
+    if (slot_key == 0 &&
+        slot.opcode.compare_exchange_strong(slot_key, key,
+                                            std::memory_order_relaxed)) {
+      slot_key = key;
+    }
+    if (slot_key == key) {
+      slot.latency.record(ToDuration(latency_ns));
+      return;
+    }
+  }
+  other_command_latency_.record(ToDuration(latency_ns));
+}
+
+void HciStats::OnPacketizerStall(HciPacketType type, int64_t stall_ns) {
+  if (type >= kPacketTypes) return;
+  stall_[type]->record(ToDuration(stall_ns));
+  AddRecord(RECORD_STALL, type, stall_ns);
+}
+
+void HciStats::OnDispatched(HciPacketType type, int64_t dispatch_ns) {
+  if (type >= kPacketTypes) return;
+  dispatch_[type]->record(ToDuration(dispatch_ns));
+  if (dispatch_ns >= kSlowDispatchNs) {
+    AddRecord(RECORD_DISPATCH, type, dispatch_ns);
+  }
+  // On the UART reader thread, after the packet went to the stack
+  registry_.maybeTraceHistograms();
+}
+
+void HciStats::AddRecord(RecordKind kind, uint16_t key, int64_t duration_ns) {
+  // A dump racing with a writer may print a mixed up record, which is fine
+  // for debugging and keeps the writers wait-free.
+  Record& record =
+      records_[next_record_.fetch_add(1, std::memory_order_relaxed) % kRecords];
+  record.kind.store(RECORD_NONE, std::memory_order_relaxed);
+  record.key.store(key, std::memory_order_relaxed);
+  record.time_ns.store(Now(), std::memory_order_relaxed);
+  record.duration_ns.store(duration_ns, std::memory_order_relaxed);
+  record.kind.store(kind, std::memory_order_release);
+}
+
+void HciStats::Dump(int fd) {
+  std::lock_guard<std::mutex> guard(dump_mutex_);
+  int64_t now = Now();
+  double interval_s = (now - last_dump_ns_) / 1e9;
+  dprintf(fd, "HCI statistics over %.3f s, rates since the last dump (%.3f s)\n",
+          (now - start_ns_) / 1e9, interval_s);
+  for (int direction = TX; direction <= RX; direction++) {
+    for (size_t type = HCI_PACKET_TYPE_COMMAND; type < kPacketTypes; type++) {
+      uint64_t bytes = bytes_[direction][type]->value();
+      uint64_t packets = packets_[direction][type]->value();
+      if (packets == 0) continue;
+      double rate = interval_s > 0
+                        ? (bytes - last_dump_bytes_[direction][type]) /
+                              interval_s
+                        : 0;
+      dprintf(fd, "  %s %-7s %10" PRIu64 " packets %12" PRIu64
+                  " bytes %10.0f bytes/s\n",
+              direction == TX ? "tx" : "rx", kPacketTypeNames[type], packets,
+              bytes, rate);
+      last_dump_bytes_[direction][type] = bytes;
+    }
+  }
+  last_dump_ns_ = now;
+
+  dprintf(fd, "Metrics:\n");
+  registry_.dump(fd);
+
+  dprintf(fd, "Command round trip by opcode:\n");
+  for (const auto& slot : command_latency_by_opcode_) {
+    uint32_t key = slot.opcode.load(std::memory_order_relaxed);
+    if (key == 0) break;
+    char name[16];
+    snprintf(name, sizeof(name), "0x%04x", key - 1);
+    DumpHistogram(fd, name, slot.latency);
+  }
+  DumpHistogram(fd, "other", other_command_latency_);
+
+  dprintf(fd, "Latest records (CLOCK_MONOTONIC s, duration ms):\n");
+  uint32_t end = next_record_.load(std::memory_order_relaxed);
+  uint32_t begin = end > kRecords ? end - kRecords : 0;
+  for (uint32_t i = begin; i < end; i++) {
+    const Record& record = records_[i % kRecords];
+    uint8_t kind = record.kind.load(std::memory_order_acquire);
+    uint16_t key = record.key.load(std::memory_order_relaxed);
+    double time_s = record.time_ns.load(std::memory_order_relaxed) / 1e9;
+    double duration_ms =
+        record.duration_ns.load(std::memory_order_relaxed) / 1e6;
+    switch (kind) {
+      case RECORD_COMMAND:
+        dprintf(fd, "  %.6f command 0x%04x round trip %.3f\n", time_s, key,
+                duration_ms);
+        break;
+      case RECORD_STALL:
+        dprintf(fd, "  %.6f %s packetizer stall %.3f\n", time_s,
+                kPacketTypeNames[key < kPacketTypes ? key : 0], duration_ms);
+        break;
+      case RECORD_DISPATCH:
+        dprintf(fd, "  %.6f %s slow dispatch %.3f\n", time_s,
+                kPacketTypeNames[key < kPacketTypes ? key : 0], duration_ms);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+}  // namespace hci
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,122 @@
+//
+// Copyright 2018 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <hal-metrics/Metrics.h>
+#include <hidl/HidlSupport.h>
+
+#include "hci_internals.h"
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace hci {
+
+using ::android::hardware::hidl_vec;
+
+// HCI timing and throughput metrics of the process, dumped by
+// IBluetoothHci::debug(). Everything is recorded with atomics so that the
+// UART and HIDL threads never wait on each other or on a dump.
+class HciStats {
+ public:
+  enum Direction { TX = 0, RX = 1 };
+
+  static HciStats& Get();
+
+  // Called for every packet sent to or received from the controller
+  void OnPacket(Direction direction, HciPacketType type, size_t length);
+  // Starts the round trip of the command in packet
+  void OnCommandSent(const hidl_vec<uint8_t>& packet);
+  // Ends the round trip of the command an event completes, if any
+  void OnEventReceived(const hidl_vec<uint8_t>& packet);
+  // A packet took several reads of the UART, waiting stall_ns for its end
+  void OnPacketizerStall(HciPacketType type, int64_t stall_ns);
+  // A received packet took dispatch_ns to be handed to the stack
+  void OnDispatched(HciPacketType type, int64_t dispatch_ns);
+
+  void Dump(int fd);
+
+  static int64_t Now();
+
+ private:
+  HciStats();
+
+  enum RecordKind : uint8_t {
+    RECORD_NONE = 0,
+    RECORD_COMMAND,
+    RECORD_STALL,
+    RECORD_DISPATCH
+  };
+  void AddRecord(RecordKind kind, uint16_t key, int64_t duration_ns);
+  void RecordCommandLatency(uint16_t opcode, int64_t latency_ns);
+
+  // Commands waiting for their Command Complete or Command Status event
+  static const size_t kPendingCommands = 8;
+  struct PendingCommand {
+    std::atomic<uint32_t> opcode{0};  // opcode + 1, 0 when the slot is free
+    std::atomic<int64_t> sent_ns{0};
+  };
+  PendingCommand pending_[kPendingCommands];
+
+  // Round trips by opcode, in the order the opcodes were first completed.
+  // The stack uses a few dozen opcodes; once the table is full the others
+  // share other_command_latency_.
+  static const size_t kCommandOpcodes = 32;
+  struct CommandLatency {
+    std::atomic<uint32_t> opcode{0};  // opcode + 1, 0 when the slot is free
+    ::android::hardware::metrics::Histogram latency;
+  };
+  CommandLatency command_latency_by_opcode_[kCommandOpcodes];
+  ::android::hardware::metrics::Histogram other_command_latency_;
+
+  // Ring of the latest round trips, stalls and slow dispatches
+  static const size_t kRecords = 128;
+  struct Record {
+    std::atomic<uint8_t> kind{RECORD_NONE};
+    std::atomic<uint16_t> key{0};
+    std::atomic<int64_t> time_ns{0};
+    std::atomic<int64_t> duration_ns{0};
+  };
+  Record records_[kRecords];
+  std::atomic<uint32_t> next_record_{0};
+
+  // Looked up once, the registry keeps them for the life of the process
+  ::android::hardware::metrics::Registry registry_{"bluetooth.hci"};
+  // Indexed by HciPacketType
+  static const size_t kPacketTypes = HCI_PACKET_TYPE_EVENT + 1;
+  ::android::hardware::metrics::Counter* bytes_[2][kPacketTypes];
+  ::android::hardware::metrics::Counter* packets_[2][kPacketTypes];
+  ::android::hardware::metrics::Histogram* command_latency_;
+  ::android::hardware::metrics::Histogram* stall_[kPacketTypes];
+  ::android::hardware::metrics::Histogram* dispatch_[kPacketTypes];
+
+  const int64_t start_ns_;
+  // Only guards the dump state below, the counters are never locked
+  std::mutex dump_mutex_;
+  int64_t last_dump_ns_;
+  uint64_t last_dump_bytes_[2][kPacketTypes] = {};
+};
+
+}  // namespace hci
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
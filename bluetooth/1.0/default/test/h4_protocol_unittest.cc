@@ -118,10 +118,6 @@ class H4ProtocolTest : public ::testing::Test {
     preamble[3] = length & 0xFF;
     preamble[4] = (length >> 8) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -134,6 +130,10 @@ class H4ProtocolTest : public ::testing::Test {
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
     {
       std::unique_lock<std::mutex> lock(mutex);
+      // Write with the lock held so the callback can't notify before the wait.
+      ALOGD("%s writing", __func__);
+      TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+      TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
       done.wait_until(lock, timeout_time);
     }
   }
@@ -143,10 +143,6 @@ class H4ProtocolTest : public ::testing::Test {
     char preamble[4] = {HCI_PACKET_TYPE_SCO_DATA, 20, 17, 0};
     preamble[3] = strlen(payload) & 0xFF;
 
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -159,6 +155,10 @@ class H4ProtocolTest : public ::testing::Test {
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
     {
       std::unique_lock<std::mutex> lock(mutex);
+      // Write with the lock held so the callback can't notify before the wait.
+      ALOGD("%s writing", __func__);
+      TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+      TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
       done.wait_until(lock, timeout_time);
     }
   }
@@ -167,10 +167,6 @@ class H4ProtocolTest : public ::testing::Test {
     // h4 type[1] + event_code[1] + size[1]
     char preamble[3] = {HCI_PACKET_TYPE_EVENT, 9, 0};
     preamble[2] = strlen(payload) & 0xFF;
-    ALOGD("%s writing", __func__);
-    TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
-    TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
-
     ALOGD("%s waiting", __func__);
     std::mutex mutex;
     std::condition_variable done;
@@ -180,6 +176,10 @@ class H4ProtocolTest : public ::testing::Test {
 
     {
       std::unique_lock<std::mutex> lock(mutex);
+      // Write with the lock held so the callback can't notify before the wait.
+      ALOGD("%s writing", __func__);
+      TEMP_FAILURE_RETRY(write(fake_uart_, preamble, sizeof(preamble)));
+      TEMP_FAILURE_RETRY(write(fake_uart_, payload, strlen(payload)));
       done.wait(lock);
     }
   }
@@ -199,6 +199,50 @@ TEST_F(H4ProtocolTest, TestSends) {
   SendAndReadUartOutbound(HCI_PACKET_TYPE_SCO_DATA, sample_data3);
 }
 
+// Test buffered sends are written in order, and within the window
+TEST_F(H4ProtocolTest, TestBufferedSends) {
+  int sockfd[2];
+  socketpair(AF_LOCAL, SOCK_STREAM, 0, sockfd);
+  H4Protocol buffered_hci(sockfd[0], event_cb_.AsStdFunction(),
+                          acl_cb_.AsStdFunction(), sco_cb_.AsStdFunction(),
+                          std::chrono::milliseconds(20));
+  std::vector<char> expected;
+  auto send = [&](uint8_t type, char* data, bool buffered) {
+    size_t length = strlen(data);
+    size_t sent =
+        buffered ? buffered_hci.SendBuffered(type, (uint8_t*)data, length)
+                 : buffered_hci.Send(type, (uint8_t*)data, length);
+    EXPECT_EQ(length + 1, sent);
+    expected.push_back(type);
+    expected.insert(expected.end(), data, data + length);
+  };
+  auto read_all = [&]() {
+    std::vector<char> uart(expected.size());
+    size_t read_bytes = 0;
+    while (read_bytes < uart.size()) {
+      ssize_t n = TEMP_FAILURE_RETRY(
+          read(sockfd[1], uart.data() + read_bytes, uart.size() - read_bytes));
+      ASSERT_GT(n, 0);
+      read_bytes += n;
+    }
+    EXPECT_EQ(expected, uart);
+    expected.clear();
+  };
+
+  // Flushed by the packet that can't wait
+  send(HCI_PACKET_TYPE_ACL_DATA, sample_data1, true);
+  send(HCI_PACKET_TYPE_ACL_DATA, sample_data2, true);
+  send(HCI_PACKET_TYPE_COMMAND, sample_data3, false);
+  read_all();
+
+  // Flushed when the window ends
+  send(HCI_PACKET_TYPE_ACL_DATA, acl_data, true);
+  read_all();
+
+  close(sockfd[0]);
+  close(sockfd[1]);
+}
+
 // Ensure we properly parse data coming from the UART
 TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundAclData(acl_data);
@@ -206,6 +250,48 @@ TEST_F(H4ProtocolTest, TestReads) {
   WriteAndExpectInboundEvent(event_data);
 }
 
+// Ensure packets that arrive in a single read, or split across reads, are
+// all delivered
+TEST_F(H4ProtocolTest, TestReadsBackToBack) {
+  char event_preamble[2] = {9, static_cast<char>(strlen(event_data))};
+  char acl_preamble[4] = {19, 92, static_cast<char>(strlen(acl_data)), 0};
+  std::vector<char> uart;
+  uart.push_back(HCI_PACKET_TYPE_EVENT);
+  uart.insert(uart.end(), event_preamble, event_preamble + 2);
+  uart.insert(uart.end(), event_data, event_data + strlen(event_data));
+  uart.push_back(HCI_PACKET_TYPE_ACL_DATA);
+  uart.insert(uart.end(), acl_preamble, acl_preamble + 4);
+  uart.insert(uart.end(), acl_data, acl_data + strlen(acl_data));
+  // The second event is split in the middle of its preamble.
+  uart.push_back(HCI_PACKET_TYPE_EVENT);
+  uart.push_back(event_preamble[0]);
+  size_t split = uart.size();
+  uart.push_back(event_preamble[1]);
+  uart.insert(uart.end(), event_data, event_data + strlen(event_data));
+
+  std::mutex mutex;
+  std::condition_variable done;
+  {
+    ::testing::InSequence sequence;
+    EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble, 2, event_data)));
+    EXPECT_CALL(acl_cb_, Call(HidlVecMatches(acl_preamble, 4, acl_data)));
+    EXPECT_CALL(event_cb_, Call(HidlVecMatches(event_preamble, 2, event_data)))
+        .WillOnce(Notify(&mutex, &done));
+  }
+
+  // Fail if it takes longer than 100 ms.
+  auto timeout_time =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    TEMP_FAILURE_RETRY(write(fake_uart_, uart.data(), split));
+    usleep(10000);
+    TEMP_FAILURE_RETRY(
+        write(fake_uart_, uart.data() + split, uart.size() - split));
+    done.wait_until(lock, timeout_time);
+  }
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace bluetooth
@@ -0,0 +1,89 @@
+//
+// Copyright 2019 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#define LOG_TAG "bt_hci_stats_unittest"
+
+#include "hci_stats.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace bluetooth {
+namespace V1_0 {
+namespace implementation {
+
+using hci::HciStats;
+
+namespace {
+
+void CompleteCommand(uint16_t opcode) {
+  uint8_t low = opcode & 0xff;
+  uint8_t high = opcode >> 8;
+  hidl_vec<uint8_t> command = {low, high, 0};
+  // Command Complete: num packets, opcode, status
+  hidl_vec<uint8_t> event = {HCI_COMMAND_COMPLETE_EVENT, 4, 1, low, high, 0};
+  HciStats::Get().OnCommandSent(command);
+  HciStats::Get().OnEventReceived(event);
+}
+
+std::string Dump() {
+  FILE* file = tmpfile();
+  if (file == nullptr) return "";
+  HciStats::Get().Dump(fileno(file));
+  std::string dump;
+  rewind(file);
+  char buffer[256];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    dump.append(buffer, length);
+  }
+  fclose(file);
+  return dump;
+}
+
+}  // namespace
+
+// HciStats is a process singleton, so this is one test in a known order.
+TEST(HciStatsTest, CommandLatencyByOpcode) {
+  CompleteCommand(0x0c03);
+  CompleteCommand(0x1001);
+  CompleteCommand(0x0c03);
+
+  std::string dump = Dump();
+  EXPECT_NE(std::string::npos, dump.find("  0x0c03: 2 samples")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("  0x1001: 1 samples")) << dump;
+  EXPECT_EQ(std::string::npos, dump.find("  other:")) << dump;
+
+  // More opcodes than the table holds share the other bucket
+  for (uint16_t opcode = 0xfc00; opcode < 0xfc40; opcode++) {
+    CompleteCommand(opcode);
+  }
+  CompleteCommand(0x0c03);
+
+  dump = Dump();
+  EXPECT_NE(std::string::npos, dump.find("  0x0c03: 3 samples")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("  0xfc00: 1 samples")) << dump;
+  EXPECT_NE(std::string::npos, dump.find("  other: 34 samples")) << dump;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace bluetooth
+}  // namespace hardware
+}  // namespace android
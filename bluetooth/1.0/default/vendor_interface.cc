@@ -33,6 +33,11 @@ static const char* VENDOR_LIBRARY_SYMBOL_NAME =
 
 static const int INVALID_FD = -1;
 
+// How long, in microseconds, ACL data can be held back to be written to the
+// UART with the next packets. 0 (the default) writes every packet right away.
+static const char* HCI_TX_WINDOW_PROPERTY =
+    "persist.vendor.bluetooth.hci_tx_window_us";
+
 namespace {
 
 using android::hardware::hidl_vec;
@@ -248,7 +253,9 @@ bool VendorInterface::Open(InitializeCompleteCallback initialize_complete_cb,
 
   if (fd_count == 1) {
     hci::H4Protocol* h4_hci =
-        new hci::H4Protocol(fd_list[0], intercept_events, acl_cb, sco_cb);
+        new hci::H4Protocol(fd_list[0], intercept_events, acl_cb, sco_cb,
+                            std::chrono::microseconds(property_get_int32(
+                                HCI_TX_WINDOW_PROPERTY, 0)));
     fd_watcher_.WatchFdForNonBlockingReads(
         fd_list[0], [h4_hci](int fd) { h4_hci->OnDataReady(fd); });
     hci_ = h4_hci;
@@ -310,6 +317,18 @@ void VendorInterface::Close() {
 
 size_t VendorInterface::Send(uint8_t type, const uint8_t* data, size_t length) {
   std::unique_lock<std::mutex> lock(wakeup_mutex_);
+  WakeForTransmitLocked(data);
+  return hci_->Send(type, data, length);
+}
+
+size_t VendorInterface::SendBuffered(uint8_t type, const uint8_t* data,
+                                     size_t length) {
+  std::unique_lock<std::mutex> lock(wakeup_mutex_);
+  WakeForTransmitLocked(data);
+  return hci_->SendBuffered(type, data, length);
+}
+
+void VendorInterface::WakeForTransmitLocked(const uint8_t* data) {
   recent_activity_flag = true;
 
   if (lpm_wake_deasserted == true) {
@@ -322,8 +341,6 @@ size_t VendorInterface::Send(uint8_t type, const uint8_t* data, size_t length) {
     lib_interface_->op(BT_VND_OP_LPM_WAKE_SET_STATE, &wakeState);
     ALOGV("%s: Sent wake before (%02x)", __func__, data[0] | (data[1] << 8));
   }
-
-  return hci_->Send(type, data, length);
 }
 
 void VendorInterface::OnFirmwareConfigured(uint8_t result) {
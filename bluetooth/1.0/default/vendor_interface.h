@@ -43,6 +43,8 @@ class VendorInterface {
   static VendorInterface* get();
 
   size_t Send(uint8_t type, const uint8_t* data, size_t length);
+  // For packets that can wait for a few more to be written along with them
+  size_t SendBuffered(uint8_t type, const uint8_t* data, size_t length);
 
   void OnFirmwareConfigured(uint8_t result);
 
@@ -55,6 +57,8 @@ class VendorInterface {
   void Close();
 
   void OnTimeout();
+  // Asserts the LPM wake if needed, wakeup_mutex_ must be held.
+  void WakeForTransmitLocked(const uint8_t* data);
 
   void HandleIncomingEvent(const hidl_vec<uint8_t>& hci_packet);
 
@@ -14,8 +14,17 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "android.hardware.bluetooth.a2dp@1.0-impl"
+
 #include "BluetoothAudioOffload.h"
 
+#include <stdio.h>
+
+#include <cinttypes>
+#include <utility>
+
+#include <log/log.h>
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
@@ -23,34 +32,109 @@ namespace a2dp {
 namespace V1_0 {
 namespace implementation {
 
+namespace {
+
+// Whether two codec configurations set the platform up the same way. Only the
+// codec specific information of the codec in use is compared, the rest of the
+// union being undefined.
+bool sameCodecConfig(const CodecConfiguration& a, const CodecConfiguration& b) {
+  if (a.codecType != b.codecType || a.sampleRate != b.sampleRate ||
+      a.bitsPerSample != b.bitsPerSample || a.channelMode != b.channelMode ||
+      a.encodedAudioBitrate != b.encodedAudioBitrate ||
+      a.peerMtu != b.peerMtu) {
+    return false;
+  }
+  switch (a.codecType) {
+    case CodecType::SBC:
+      return a.codecSpecific.sbcData.codecParameters ==
+                 b.codecSpecific.sbcData.codecParameters &&
+             a.codecSpecific.sbcData.minBitpool ==
+                 b.codecSpecific.sbcData.minBitpool &&
+             a.codecSpecific.sbcData.maxBitpool ==
+                 b.codecSpecific.sbcData.maxBitpool;
+    case CodecType::LDAC:
+      return a.codecSpecific.ldacData.bitrateIndex ==
+             b.codecSpecific.ldacData.bitrateIndex;
+    default:
+      return true;
+  }
+}
+
+int64_t toMicroseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+}  // namespace
+
 IBluetoothAudioOffload* HIDL_FETCH_IBluetoothAudioOffload(
     const char* /* name */) {
   return new BluetoothAudioOffload();
 }
 
+void BluetoothAudioOffload::StartStats::add(std::chrono::nanoseconds latency) {
+  count++;
+  total += latency;
+  if (latency > max) {
+    max = latency;
+  }
+}
+
 // Methods from
 // ::android::hardware::bluetooth::a2dp::V1_0::IBluetoothAudioOffload follow.
 Return<::android::hardware::bluetooth::a2dp::V1_0::Status>
 BluetoothAudioOffload::startSession(
     const sp<::android::hardware::bluetooth::a2dp::V1_0::IBluetoothAudioHost>&
-        hostIf __unused,
+        hostIf,
     const ::android::hardware::bluetooth::a2dp::V1_0::CodecConfiguration&
-        codecConfig __unused) {
+        codecConfig) {
   /**
    * Initialize the audio platform if codecConfiguration is supported.
    * Save the the IBluetoothAudioHost interface, so that it can be used
    * later to send stream control commands to the HAL client, based on
    * interaction with Audio framework.
    */
-  return ::android::hardware::bluetooth::a2dp::V1_0::Status::FAILURE;
+  auto requested = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(mLock);
+  if (mPlatformConfigured && sameCodecConfig(mCodecConfig, codecConfig)) {
+    mFastResumes++;
+  } else {
+    if (mPlatformConfigured) {
+      releasePlatform();
+      mPlatformConfigured = false;
+    }
+    Status status = configurePlatform(codecConfig);
+    if (status != Status::SUCCESS) {
+      return status;
+    }
+    mReconfigurations++;
+    mPlatformConfigured = true;
+    mCodecConfig = codecConfig;
+  }
+  mHostIf = hostIf;
+  mStartPending = true;
+  mSessionStartPending = true;
+  mStartRequested = requested;
+  return Status::SUCCESS;
 }
 
 Return<void> BluetoothAudioOffload::streamStarted(
-    ::android::hardware::bluetooth::a2dp::V1_0::Status status __unused) {
+    ::android::hardware::bluetooth::a2dp::V1_0::Status status) {
   /**
    * Streaming on control path has started,
    * HAL server should start the streaming on data path.
    */
+  std::lock_guard<std::mutex> lock(mLock);
+  if (!mStartPending || status == Status::PENDING) {
+    return Void();
+  }
+  StartStats& stats = mSessionStartPending ? mSessionStarts : mStreamStarts;
+  if (status == Status::SUCCESS) {
+    stats.add(std::chrono::steady_clock::now() - mStartRequested);
+  } else {
+    stats.failures++;
+  }
+  mStartPending = false;
   return Void();
 }
 
@@ -68,9 +152,74 @@ Return<void> BluetoothAudioOffload::endSession() {
    * Cleanup the audio platform as remote A2DP Sink device is no
    * longer active
    */
+  std::lock_guard<std::mutex> lock(mLock);
+  mHostIf = nullptr;
+  mStartPending = false;
   return Void();
 }
 
+Return<void> BluetoothAudioOffload::debug(
+    const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+  if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+    return Void();
+  }
+  int out = fd->data[0];
+  std::lock_guard<std::mutex> lock(mLock);
+  dprintf(out, "session %s, platform %s\n",
+          mHostIf != nullptr ? "active" : "inactive",
+          mPlatformConfigured ? "configured" : "not configured");
+  if (mPlatformConfigured) {
+    dprintf(out,
+            "codec 0x%x rate 0x%x bits 0x%x channels 0x%x bitrate %u mtu %u\n",
+            static_cast<uint32_t>(mCodecConfig.codecType),
+            static_cast<uint32_t>(mCodecConfig.sampleRate),
+            static_cast<uint32_t>(mCodecConfig.bitsPerSample),
+            static_cast<uint32_t>(mCodecConfig.channelMode),
+            mCodecConfig.encodedAudioBitrate, mCodecConfig.peerMtu);
+  }
+  dprintf(out, "%" PRIu64 " reconfigurations, %" PRIu64 " fast resumes\n",
+          mReconfigurations, mFastResumes);
+  const std::pair<const char*, const StartStats*> starts[] = {
+      {"session start", &mSessionStarts}, {"stream start", &mStreamStarts}};
+  for (const auto& start : starts) {
+    const StartStats& stats = *start.second;
+    dprintf(out, "%s: %" PRIu64 " started, %" PRIu64 " failed", start.first,
+            stats.count, stats.failures);
+    if (stats.count > 0) {
+      dprintf(out, ", latency mean %" PRId64 "us max %" PRId64 "us",
+              toMicroseconds(stats.total) / static_cast<int64_t>(stats.count),
+              toMicroseconds(stats.max));
+    }
+    dprintf(out, "\n");
+  }
+  return Void();
+}
+
+void BluetoothAudioOffload::requestStreamStart() {
+  sp<IBluetoothAudioHost> hostIf;
+  {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mHostIf == nullptr) {
+      ALOGW("stream start requested without a session");
+      return;
+    }
+    hostIf = mHostIf;
+    mStartPending = true;
+    mSessionStartPending = false;
+    mStartRequested = std::chrono::steady_clock::now();
+  }
+  hostIf->startStream();
+}
+
+::android::hardware::bluetooth::a2dp::V1_0::Status
+BluetoothAudioOffload::configurePlatform(
+    const ::android::hardware::bluetooth::a2dp::V1_0::CodecConfiguration&
+        codecConfig __unused) {
+  return ::android::hardware::bluetooth::a2dp::V1_0::Status::FAILURE;
+}
+
+void BluetoothAudioOffload::releasePlatform() {}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace a2dp
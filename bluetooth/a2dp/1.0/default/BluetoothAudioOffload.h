@@ -21,6 +21,9 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include <chrono>
+#include <mutex>
+
 namespace android {
 namespace hardware {
 namespace bluetooth {
@@ -50,6 +53,49 @@ struct BluetoothAudioOffload : public IBluetoothAudioOffload {
   Return<void> streamSuspended(
       ::android::hardware::bluetooth::a2dp::V1_0::Status status) override;
   Return<void> endSession() override;
+
+  // Methods from ::android::hidl::base::V1_0::IBase follow.
+  Return<void> debug(const hidl_handle& fd,
+                     const hidl_vec<hidl_string>& options) override;
+
+  // Asks the HAL client to start streaming on behalf of the audio platform.
+  // The start latency is measured from here to the streamStarted(SUCCESS)
+  // that answers it.
+  void requestStreamStart();
+
+ private:
+  // Latency from a start request to streamStarted(SUCCESS).
+  struct StartStats {
+    uint64_t count = 0;
+    uint64_t failures = 0;
+    std::chrono::nanoseconds total{0};
+    std::chrono::nanoseconds max{0};
+
+    void add(std::chrono::nanoseconds latency);
+  };
+
+  // Vendor path: sets up and tears down the audio platform for a codec
+  // configuration.
+  ::android::hardware::bluetooth::a2dp::V1_0::Status configurePlatform(
+      const ::android::hardware::bluetooth::a2dp::V1_0::CodecConfiguration&
+          codecConfig);
+  void releasePlatform();
+
+  std::mutex mLock;
+  sp<::android::hardware::bluetooth::a2dp::V1_0::IBluetoothAudioHost> mHostIf;
+  // The platform stays configured with the last accepted codec configuration
+  // across endSession, so that a session resuming with the same parameters
+  // skips the reconfiguration.
+  bool mPlatformConfigured = false;
+  ::android::hardware::bluetooth::a2dp::V1_0::CodecConfiguration mCodecConfig;
+  bool mStartPending = false;
+  // Whether the pending start is a session start or a stream start.
+  bool mSessionStartPending = false;
+  std::chrono::steady_clock::time_point mStartRequested;
+  uint64_t mReconfigurations = 0;
+  uint64_t mFastResumes = 0;
+  StartStats mSessionStarts;
+  StartStats mStreamStarts;
 };
 
 extern "C" IBluetoothAudioOffload* HIDL_FETCH_IBluetoothAudioOffload(
@@ -71,7 +71,7 @@ Return<void> BluetoothAudioProvidersFactory::getProviderCapabilities(
   hidl_vec<AudioCapabilities> audio_capabilities =
       hidl_vec<AudioCapabilities>(0);
   if (sessionType == SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
-    std::vector<CodecCapabilities> db_codec_capabilities =
+    const std::vector<CodecCapabilities>& db_codec_capabilities =
         android::bluetooth::audio::GetOffloadCodecCapabilities(sessionType);
     if (db_codec_capabilities.size()) {
       audio_capabilities.resize(db_codec_capabilities.size());
@@ -80,7 +80,7 @@ Return<void> BluetoothAudioProvidersFactory::getProviderCapabilities(
       }
     }
   } else if (sessionType != SessionType::UNKNOWN) {
-    std::vector<PcmParameters> db_pcm_capabilities =
+    const std::vector<PcmParameters>& db_pcm_capabilities =
         android::bluetooth::audio::GetSoftwarePcmCapabilities();
     if (db_pcm_capabilities.size() == 1) {
       audio_capabilities.resize(1);
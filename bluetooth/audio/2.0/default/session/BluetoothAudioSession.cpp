@@ -18,9 +18,14 @@
 
 #include "BluetoothAudioSession.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
+#include "BluetoothAudioSupportedCodecsDB.h"
+
 namespace android {
 namespace bluetooth {
 namespace audio {
@@ -44,6 +49,9 @@ AudioConfiguration BluetoothAudioSession::invalidOffloadAudioConfiguration = {};
 
 static constexpr int kFmqSendTimeoutMs = 1000;  // 1000 ms timeout for sending
 static constexpr int kWritePollMs = 1;          // polled non-blocking interval
+// the bits MessageQueue::readBlocking() and writeBlocking() use by default
+static constexpr uint32_t kFmqNotEmpty = 1 << 0;
+static constexpr uint32_t kFmqNotFull = 1 << 1;
 
 static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
   return {.tv_sec = static_cast<long>(TS.tvSec),
@@ -51,7 +59,12 @@ static inline timespec timespec_convert_from_hal(const TimeSpec& TS) {
 }
 
 BluetoothAudioSession::BluetoothAudioSession(const SessionType& session_type)
-    : session_type_(session_type), stack_iface_(nullptr), mDataMQ(nullptr) {
+    : session_type_(session_type),
+      stack_iface_(nullptr),
+      mDataMQ(nullptr),
+      low_latency_period_us_(0),
+      period_bytes_(0),
+      total_bytes_written_(0) {
   invalidSoftwareAudioConfiguration.pcmConfig(kInvalidPcmParameters);
   invalidOffloadAudioConfiguration.codecConfig(kInvalidCodecConfiguration);
 }
@@ -79,6 +92,7 @@ void BluetoothAudioSession::OnSessionStarted(
              : kInvalidSoftwareAudioConfiguration);
   } else {
     stack_iface_ = stack_iface;
+    UpdatePeriodBytes();
     LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
               << ", AudioConfiguration=" << toString(audio_config);
     ReportSessionStatus();
@@ -98,6 +112,7 @@ void BluetoothAudioSession::OnSessionEnded() {
                        : kInvalidSoftwareAudioConfiguration);
   stack_iface_ = nullptr;
   UpdateDataPath(nullptr);
+  period_bytes_ = 0;
 }
 
 // invoking the registered session_changed_cb_
@@ -152,17 +167,26 @@ bool BluetoothAudioSession::IsSessionReady() {
 }
 
 bool BluetoothAudioSession::UpdateDataPath(const DataMQ::Descriptor* dataMQ) {
+  mDataMQEventFlag = nullptr;
+  total_bytes_written_ = 0;
   if (dataMQ == nullptr) {
     // usecase of reset by nullptr
     mDataMQ = nullptr;
     return true;
   }
-  std::unique_ptr<DataMQ> tempDataMQ;
-  tempDataMQ.reset(new DataMQ(*dataMQ));
-  if (!tempDataMQ || !tempDataMQ->isValid()) {
+  std::shared_ptr<DataMQ> tempDataMQ = std::make_shared<DataMQ>(*dataMQ);
+  if (!tempDataMQ->isValid()) {
     mDataMQ = nullptr;
     return false;
   }
+  EventFlag* eventFlag = nullptr;
+  if (tempDataMQ->getEventFlagWord() != nullptr &&
+      EventFlag::createEventFlag(tempDataMQ->getEventFlagWord(), &eventFlag) ==
+          ::android::OK) {
+    mDataMQEventFlag.reset(eventFlag, [](EventFlag* flag) {
+      EventFlag::deleteEventFlag(&flag);
+    });
+  }
   mDataMQ = std::move(tempDataMQ);
   return true;
 }
@@ -190,6 +214,29 @@ bool BluetoothAudioSession::UpdateAudioConfig(
   return true;
 }
 
+void BluetoothAudioSession::UpdatePeriodBytes() {
+  // This is locked already by the callers
+  period_bytes_ = 0;
+  if (low_latency_period_us_ == 0 || mDataMQ == nullptr ||
+      audio_config_.getDiscriminator() !=
+          AudioConfiguration::hidl_discriminator::pcmConfig) {
+    return;
+  }
+  size_t period_bytes = GetSoftwarePcmPeriodBytes(audio_config_.pcmConfig(),
+                                                  low_latency_period_us_);
+  if (period_bytes == 0 ||
+      period_bytes * kLowLatencyPeriodCount > mDataMQ->getQuantumCount()) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << ", " << low_latency_period_us_
+                 << " us periods don't fit in the FMQ of "
+                 << mDataMQ->getQuantumCount() << " byte(s)";
+    return;
+  }
+  period_bytes_ = period_bytes;
+  LOG(INFO) << __func__ << " - SessionType=" << toString(session_type_)
+            << ", low-latency period=" << period_bytes_ << " byte(s)";
+}
+
 // The control function helps the bluetooth_audio module to register
 // PortStatusCallbacks
 // @return: cookie - the assigned number to this bluetooth_audio output
@@ -298,6 +345,15 @@ bool BluetoothAudioSession::GetPresentationPosition(
                << " has NO session";
     return false;
   }
+  // In the low-latency mode the position is what the stack has consumed from
+  // the FMQ, counted in whole periods.
+  uint64_t consumed_bytes = 0;
+  timespec consumed_timestamp = {};
+  if (period_bytes_ > 0) {
+    consumed_bytes = total_bytes_written_ - mDataMQ->availableToRead();
+    consumed_bytes -= consumed_bytes % period_bytes_;
+    clock_gettime(CLOCK_MONOTONIC, &consumed_timestamp);
+  }
   bool retval = false;
   auto hal_retval = stack_iface_->getPresentationPosition(
       [&retval, &remote_delay_report_ns, &total_bytes_readed, &data_position](
@@ -320,6 +376,10 @@ bool BluetoothAudioSession::GetPresentationPosition(
                  << toString(session_type_) << " failed";
     return false;
   }
+  if (retval && period_bytes_ > 0) {
+    if (total_bytes_readed) *total_bytes_readed = consumed_bytes;
+    if (data_position) *data_position = consumed_timestamp;
+  }
   return retval;
 }
 
@@ -370,36 +430,106 @@ void BluetoothAudioSession::UpdateTracksMetadata(
 size_t BluetoothAudioSession::OutWritePcmData(const void* buffer,
                                               size_t bytes) {
   if (buffer == nullptr || !bytes) return 0;
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = start + std::chrono::milliseconds(kFmqSendTimeoutMs);
   size_t totalWritten = 0;
-  int ms_timeout = kFmqSendTimeoutMs;
   do {
-    std::unique_lock<std::recursive_mutex> lock(mutex_);
-    if (!IsSessionReady()) break;
-    size_t availableToWrite = mDataMQ->availableToWrite();
+    std::shared_ptr<DataMQ> dataMQ;
+    std::shared_ptr<EventFlag> eventFlag;
+    size_t period_bytes;
+    {
+      // the lock is only needed to pick up the current data path
+      std::lock_guard<std::recursive_mutex> guard(mutex_);
+      if (!IsSessionReady()) break;
+      dataMQ = mDataMQ;
+      eventFlag = mDataMQEventFlag;
+      period_bytes = period_bytes_;
+    }
+    size_t availableToWrite = dataMQ->availableToWrite();
+    const size_t remaining = bytes - totalWritten;
+    if (period_bytes > 0) {
+      // keep no more than kLowLatencyPeriodCount periods queued, and only
+      // write whole periods except for a trailing partial one
+      size_t queued = dataMQ->availableToRead();
+      size_t limit = period_bytes * kLowLatencyPeriodCount;
+      availableToWrite =
+          std::min(availableToWrite, queued < limit ? limit - queued : 0);
+      if (remaining >= period_bytes) {
+        availableToWrite = std::min(availableToWrite, remaining);
+        availableToWrite -= availableToWrite % period_bytes;
+      } else if (availableToWrite < remaining) {
+        availableToWrite = 0;
+      }
+    }
     if (availableToWrite) {
-      if (availableToWrite > (bytes - totalWritten)) {
-        availableToWrite = bytes - totalWritten;
+      if (availableToWrite > remaining) {
+        availableToWrite = remaining;
       }
 
-      if (!mDataMQ->write(static_cast<const uint8_t*>(buffer) + totalWritten,
-                          availableToWrite)) {
+      DataMQ::MemTransaction tx;
+      if (!dataMQ->beginWrite(availableToWrite, &tx) ||
+          !tx.copyTo(static_cast<const uint8_t*>(buffer) + totalWritten, 0,
+                     availableToWrite)) {
         ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
         return totalWritten;
       }
+      {
+        // commit and count together, so that GetPresentationPosition never
+        // sees bytes in the FMQ that are not in total_bytes_written_ yet. A
+        // data path replaced meanwhile has a new count the write is not part of
+        std::lock_guard<std::recursive_mutex> guard(mutex_);
+        if (dataMQ != mDataMQ) break;
+        if (!dataMQ->commitWrite(availableToWrite)) {
+          ALOGE("FMQ datapath writting %zu/%zu failed", totalWritten, bytes);
+          return totalWritten;
+        }
+        total_bytes_written_ += availableToWrite;
+      }
       totalWritten += availableToWrite;
-    } else if (ms_timeout >= kWritePollMs) {
-      lock.unlock();
-      usleep(kWritePollMs * 1000);
-      ms_timeout -= kWritePollMs;
-    } else {
-      ALOGD("data %zu/%zu overflow %d ms", totalWritten, bytes,
-            (kFmqSendTimeoutMs - ms_timeout));
+      if (eventFlag) eventFlag->wake(kFmqNotEmpty);
+      continue;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      ALOGD("data %zu/%zu overflow %lld ms", totalWritten, bytes,
+            static_cast<long long>(
+                std::chrono::duration_cast<std::chrono::milliseconds>(now - start)
+                    .count()));
       return totalWritten;
     }
+    // A reader that signals the event flag when it frees space wakes this up
+    // right away, one that doesn't is still noticed within the poll interval.
+    const auto wait = std::min<std::chrono::nanoseconds>(
+        std::chrono::milliseconds(kWritePollMs), deadline - now);
+    if (eventFlag) {
+      uint32_t efState = 0;
+      eventFlag->wait(kFmqNotFull, &efState, wait.count());
+    } else {
+      usleep(std::chrono::duration_cast<std::chrono::microseconds>(wait).count());
+    }
   } while (totalWritten < bytes);
   return totalWritten;
 }
 
+bool BluetoothAudioSession::SetLowLatencyMode(uint32_t period_us) {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  if (session_type_ != SessionType::A2DP_SOFTWARE_ENCODING_DATAPATH &&
+      session_type_ != SessionType::HEARING_AID_SOFTWARE_ENCODING_DATAPATH) {
+    LOG(WARNING) << __func__ << " - SessionType=" << toString(session_type_)
+                 << " has no software data path";
+    return false;
+  }
+  low_latency_period_us_ = period_us;
+  UpdatePeriodBytes();
+  return period_us == 0 || period_bytes_ > 0 || !IsSessionReady();
+}
+
+size_t BluetoothAudioSession::GetPeriodBytes() {
+  std::lock_guard<std::recursive_mutex> guard(mutex_);
+  return period_bytes_;
+}
+
 std::unique_ptr<BluetoothAudioSessionInstance>
     BluetoothAudioSessionInstance::instance_ptr =
         std::unique_ptr<BluetoothAudioSessionInstance>(
@@ -16,10 +16,12 @@
 
 #pragma once
 
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 
 #include <android/hardware/bluetooth/audio/2.0/IBluetoothAudioPort.h>
+#include <fmq/EventFlag.h>
 #include <fmq/MessageQueue.h>
 #include <hardware/audio.h>
 #include <hidl/MQDescriptor.h>
@@ -29,6 +31,7 @@ namespace bluetooth {
 namespace audio {
 
 using ::android::sp;
+using ::android::hardware::EventFlag;
 using ::android::hardware::kSynchronizedReadWrite;
 using ::android::hardware::MessageQueue;
 using ::android::hardware::bluetooth::audio::V2_0::AudioConfiguration;
@@ -86,10 +89,20 @@ class BluetoothAudioSession {
 
   // audio control path to use for both software and offloading
   sp<IBluetoothAudioPort> stack_iface_;
-  // audio data path (FMQ) for software encoding
-  std::unique_ptr<DataMQ> mDataMQ;
+  // audio data path (FMQ) for software encoding. Shared so that a writer can
+  // use it without holding mutex_ while the session restarts.
+  std::shared_ptr<DataMQ> mDataMQ;
+  // event flag of mDataMQ, nullptr if the queue has none
+  std::shared_ptr<EventFlag> mDataMQEventFlag;
   // audio data configuration for both software and offloading
   AudioConfiguration audio_config_;
+  // requested low-latency period, 0 when the low-latency mode is off
+  uint32_t low_latency_period_us_;
+  // fixed write quantum of the low-latency mode, 0 when it is not active
+  size_t period_bytes_;
+  // bytes committed to mDataMQ since the data path was set up, only changed
+  // under mutex_ together with the commit to mDataMQ
+  uint64_t total_bytes_written_;
 
   static AudioConfiguration invalidSoftwareAudioConfiguration;
   static AudioConfiguration invalidOffloadAudioConfiguration;
@@ -100,6 +113,8 @@ class BluetoothAudioSession {
 
   bool UpdateDataPath(const DataMQ::Descriptor* dataMQ);
   bool UpdateAudioConfig(const AudioConfiguration& audio_config);
+  // recomputes period_bytes_ from low_latency_period_us_ and audio_config_
+  void UpdatePeriodBytes();
   // invoking the registered session_changed_cb_
   void ReportSessionStatus();
 
@@ -154,6 +169,18 @@ class BluetoothAudioSession {
   // The control function writes stream to FMQ
   size_t OutWritePcmData(const void* buffer, size_t bytes);
 
+  // The control function switches this software session into the low-latency
+  // mode, where at most kLowLatencyPeriodCount periods of period_us are queued
+  // in the FMQ, data is written in whole periods, and the presentation
+  // position counts the periods consumed by the Bluetooth stack. The period is
+  // kept across session restarts; period_us = 0 turns the mode off.
+  // @return: false if this session can't use the low-latency mode
+  bool SetLowLatencyMode(uint32_t period_us);
+  // @return: the bytes of one low-latency period, or 0 if the mode is off
+  size_t GetPeriodBytes();
+
+  static constexpr size_t kLowLatencyPeriodCount = 2;
+
   static constexpr PcmParameters kInvalidPcmParameters = {
       .sampleRate = SampleRate::RATE_UNKNOWN,
       .bitsPerSample = BitsPerSample::BITS_UNKNOWN,
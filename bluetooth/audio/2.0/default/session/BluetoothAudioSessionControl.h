@@ -136,6 +136,27 @@ class BluetoothAudioSessionControl {
     }
     return 0;
   }
+
+  // The control APIs for the bluetooth_audio module to use a small fixed period
+  // on a software session, and to size its writes to that period
+  static bool SetLowLatencyMode(const SessionType& session_type,
+                                uint32_t period_us) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->SetLowLatencyMode(period_us);
+    }
+    return false;
+  }
+
+  static size_t GetPeriodBytes(const SessionType& session_type) {
+    std::shared_ptr<BluetoothAudioSession> session_ptr =
+        BluetoothAudioSessionInstance::GetSessionInstance(session_type);
+    if (session_ptr != nullptr) {
+      return session_ptr->GetPeriodBytes();
+    }
+    return 0;
+  }
 };
 
 }  // namespace audio
@@ -18,6 +18,8 @@
 
 #include "BluetoothAudioSupportedCodecsDB.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 namespace android {
@@ -112,18 +114,9 @@ const std::vector<CodecCapabilities> kDefaultOffloadA2dpCodecCapabilities = {
     {.codecType = CodecType::APTX, .capabilities = {}},
     {.codecType = CodecType::APTX_HD, .capabilities = {}}};
 
+// true if exactly one of the bits in bitfield is set in bitmasks
 static bool IsSingleBit(uint32_t bitmasks, uint32_t bitfield) {
-  bool single = false;
-  uint32_t test_bit = 0x00000001;
-  while (test_bit <= bitmasks && test_bit <= bitfield) {
-    if (bitfield & test_bit && bitmasks & test_bit) {
-      if (single) return false;
-      single = true;
-    }
-    if (test_bit == 0x80000000) break;
-    test_bit <<= 1;
-  }
-  return single;
+  return __builtin_popcount(bitmasks & bitfield) == 1;
 }
 
 static bool IsOffloadSbcConfigurationValid(
@@ -294,15 +287,9 @@ static bool IsOffloadAptxHdConfigurationValid(
   return false;
 }
 
-std::vector<PcmParameters> GetSoftwarePcmCapabilities() {
-  return std::vector<PcmParameters>(1, kDefaultSoftwarePcmCapabilities);
-}
-
-std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
-    const SessionType& session_type) {
-  if (session_type != SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
-    return std::vector<CodecCapabilities>(0);
-  }
+// The capability lists only depend on the constants above, so they are built
+// once and then shared read-only by every session and provider.
+static std::vector<CodecCapabilities> BuildOffloadA2dpCodecCapabilities() {
   std::vector<CodecCapabilities> offload_a2dp_codec_capabilities =
       kDefaultOffloadA2dpCodecCapabilities;
   for (auto& codec_capability : offload_a2dp_codec_capabilities) {
@@ -335,6 +322,23 @@ std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
   return offload_a2dp_codec_capabilities;
 }
 
+const std::vector<PcmParameters>& GetSoftwarePcmCapabilities() {
+  static const std::vector<PcmParameters> software_pcm_capabilities(
+      1, kDefaultSoftwarePcmCapabilities);
+  return software_pcm_capabilities;
+}
+
+const std::vector<CodecCapabilities>& GetOffloadCodecCapabilities(
+    const SessionType& session_type) {
+  static const std::vector<CodecCapabilities> kNoCodecCapabilities;
+  static const std::vector<CodecCapabilities> offload_a2dp_codec_capabilities =
+      BuildOffloadA2dpCodecCapabilities();
+  if (session_type != SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
+    return kNoCodecCapabilities;
+  }
+  return offload_a2dp_codec_capabilities;
+}
+
 bool IsSoftwarePcmConfigurationValid(const PcmParameters& pcm_config) {
   if ((pcm_config.sampleRate != SampleRate::RATE_44100 &&
        pcm_config.sampleRate != SampleRate::RATE_48000 &&
@@ -363,6 +367,52 @@ bool IsSoftwarePcmConfigurationValid(const PcmParameters& pcm_config) {
   return false;
 }
 
+size_t GetSoftwarePcmPeriodBytes(const PcmParameters& pcm_config,
+                                 uint32_t period_us) {
+  if (!IsSoftwarePcmConfigurationValid(pcm_config)) return 0;
+  uint32_t sample_rate = 0;
+  switch (pcm_config.sampleRate) {
+    case SampleRate::RATE_16000:
+      sample_rate = 16000;
+      break;
+    case SampleRate::RATE_24000:
+      sample_rate = 24000;
+      break;
+    case SampleRate::RATE_44100:
+      sample_rate = 44100;
+      break;
+    case SampleRate::RATE_48000:
+      sample_rate = 48000;
+      break;
+    case SampleRate::RATE_88200:
+      sample_rate = 88200;
+      break;
+    case SampleRate::RATE_96000:
+      sample_rate = 96000;
+      break;
+    default:
+      return 0;
+  }
+  size_t bytes_per_sample = 0;
+  switch (pcm_config.bitsPerSample) {
+    case BitsPerSample::BITS_16:
+      bytes_per_sample = 2;
+      break;
+    case BitsPerSample::BITS_24:
+      bytes_per_sample = 3;
+      break;
+    case BitsPerSample::BITS_32:
+      bytes_per_sample = 4;
+      break;
+    default:
+      return 0;
+  }
+  size_t channel_count = (pcm_config.channelMode == ChannelMode::MONO ? 1 : 2);
+  size_t frame_count =
+      (static_cast<uint64_t>(sample_rate) * period_us + 999999) / 1000000;
+  return std::max<size_t>(frame_count, 1) * bytes_per_sample * channel_count;
+}
+
 bool IsOffloadCodecConfigurationValid(const SessionType& session_type,
                                       const CodecConfiguration& codec_config) {
   if (session_type != SessionType::A2DP_HARDWARE_OFFLOAD_DATAPATH) {
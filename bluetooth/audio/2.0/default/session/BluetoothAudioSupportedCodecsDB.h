@@ -27,11 +27,16 @@ using ::android::hardware::bluetooth::audio::V2_0::CodecConfiguration;
 using ::android::hardware::bluetooth::audio::V2_0::PcmParameters;
 using ::android::hardware::bluetooth::audio::V2_0::SessionType;
 
-std::vector<PcmParameters> GetSoftwarePcmCapabilities();
-std::vector<CodecCapabilities> GetOffloadCodecCapabilities(
+// The capabilities are built once and shared read-only
+const std::vector<PcmParameters>& GetSoftwarePcmCapabilities();
+const std::vector<CodecCapabilities>& GetOffloadCodecCapabilities(
     const SessionType& session_type);
 
 bool IsSoftwarePcmConfigurationValid(const PcmParameters& pcm_config);
+// The size of a whole number of PCM frames lasting about period_us, or 0 if
+// the software PCM capabilities don't support pcm_config
+size_t GetSoftwarePcmPeriodBytes(const PcmParameters& pcm_config,
+                                 uint32_t period_us);
 bool IsOffloadCodecConfigurationValid(const SessionType& session_type,
                                       const CodecConfiguration& codec_config);
 
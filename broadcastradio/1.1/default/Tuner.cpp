@@ -56,8 +56,13 @@ const struct {
     milliseconds scan = 200ms;
     milliseconds step = 100ms;
     milliseconds tune = 150ms;
+    milliseconds bandScanChunk = 100ms;
 } gDefaultDelay;
 
+// Programs found by each step of a band scan, and age after which the band map is rescanned.
+static constexpr size_t kBandScanChunkSize = 4;
+static constexpr auto kBandMapMaxAge = 30s;
+
 Tuner::Tuner(const sp<BroadcastRadio> module, V1_0::Class classId,
              const sp<V1_0::ITunerCallback>& callback)
     : mModule(module),
@@ -71,6 +76,7 @@ void Tuner::forceClose() {
     lock_guard<mutex> lk(mMut);
     mIsClosed = true;
     mThread.cancelAll();
+    mScanThread.cancelAll();
 }
 
 void Tuner::setConfigurationInternalLocked(const BandConfig& config) {
@@ -86,7 +92,76 @@ void Tuner::setConfigurationInternalLocked(const BandConfig& config) {
 
     mIsAmfmConfigSet = true;
     mCallback->configChange(Result::OK, mAmfmConfig);
+
+    // The map is of the previous band, so it's recreated from scratch.
+    mScanThread.cancelAll();
+    mIsBandScanning = false;
+    mIsBandScanned = false;
+    mBandMap.clear();
     if (mCallback1_1 != nullptr) mCallback1_1->programListChanged();
+    startBandScanLocked();
+}
+
+void Tuner::startBandScanLocked() {
+    if (mIsBandScanning) return;
+    mIsBandScanning = true;
+
+    auto list = mVirtualRadio.get().getProgramList();
+    sort(list.begin(), list.end());
+    ALOGV("Starting band scan of %zu programs", list.size());
+
+    // Programs are found in band order and streamed into the map as they are.
+    auto scanStart = std::chrono::steady_clock::now();
+    size_t chunks = (list.size() + kBandScanChunkSize - 1) / kBandScanChunkSize;
+    if (chunks == 0) chunks = 1;  // an empty band still completes
+    for (size_t i = 0; i < chunks; i++) {
+        auto first = std::min(list.size(), i * kBandScanChunkSize);
+        auto last = std::min(list.size(), first + kBandScanChunkSize);
+        vector<VirtualProgram> chunk(list.begin() + first, list.begin() + last);
+        bool isLast = i + 1 == chunks;
+        auto task = [this, chunk, scanStart, isLast]() {
+            lock_guard<mutex> lk(mMut);
+            bandScanChunkLocked(chunk, scanStart, isLast);
+        };
+        mScanThread.schedule(task, gDefaultDelay.bandScanChunk * (i + 1));
+    }
+}
+
+void Tuner::bandScanChunkLocked(const vector<VirtualProgram>& chunk,
+                                std::chrono::steady_clock::time_point scanStart, bool isLast) {
+    auto now = std::chrono::steady_clock::now();
+    for (auto&& program : chunk) {
+        // Programs are keyed by their primary identifier only, so the entry is replaced whole.
+        mBandMap.erase(program);
+        mBandMap.emplace(program, now);
+    }
+
+    if (isLast) {
+        // Whatever this scan didn't find anymore has gone off the air.
+        for (auto it = mBandMap.begin(); it != mBandMap.end();) {
+            if (it->second < scanStart) {
+                it = mBandMap.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        mIsBandScanning = false;
+        mIsBandScanned = true;
+        ALOGV("Band scan complete, %zu programs", mBandMap.size());
+    }
+
+    if (mCallback1_1 != nullptr) {
+        if (!chunk.empty() || isLast) mCallback1_1->programListChanged();
+        if (isLast) mCallback1_1->backgroundScanComplete(ProgramListResult::OK);
+    }
+}
+
+bool Tuner::isBandMapStaleLocked() const {
+    auto now = std::chrono::steady_clock::now();
+    for (auto&& entry : mBandMap) {
+        if (now - entry.second > kBandMapMaxAge) return true;
+    }
+    return false;
 }
 
 bool Tuner::autoConfigureLocked(uint64_t frequency) {
@@ -178,7 +253,19 @@ Return<Result> Tuner::scan(Direction direction, bool skipSubChannel __unused) {
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::NOT_INITIALIZED;
 
-    auto list = mVirtualRadio.get().getProgramList();
+    // Until the first band scan found anything, the air is looked at directly.
+    vector<VirtualProgram> list;
+    if (mBandMap.empty()) {
+        list = mVirtualRadio.get().getProgramList();
+        // Not optimal (O(sort) instead of O(n)), but not a big deal here;
+        // also, it's likely that list is already sorted (so O(n) anyway).
+        sort(list.begin(), list.end());
+    } else {
+        // Already in band order.
+        list.reserve(mBandMap.size());
+        for (auto&& entry : mBandMap) list.push_back(entry.first);
+    }
+    if (mBandMap.empty() || isBandMapStaleLocked()) startBandScanLocked();
 
     if (list.empty()) {
         mIsTuneCompleted = false;
@@ -196,9 +283,6 @@ Return<Result> Tuner::scan(Direction direction, bool skipSubChannel __unused) {
         return Result::OK;
     }
 
-    // Not optimal (O(sort) instead of O(n)), but not a big deal here;
-    // also, it's likely that list is already sorted (so O(n) anyway).
-    sort(list.begin(), list.end());
     auto current = mCurrentProgram;
     auto found = lower_bound(list.begin(), list.end(), VirtualProgram({current}));
     if (direction == Direction::UP) {
@@ -358,9 +442,8 @@ Return<ProgramListResult> Tuner::startBackgroundScan() {
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return ProgramListResult::NOT_INITIALIZED;
 
-    if (mCallback1_1 != nullptr) {
-        mCallback1_1->backgroundScanComplete(ProgramListResult::OK);
-    }
+    // Completion is reported by the last step of the band scan, or of the one already running.
+    startBandScanLocked();
 
     return ProgramListResult::OK;
 }
@@ -374,7 +457,18 @@ Return<void> Tuner::getProgramList(const hidl_vec<VendorKeyValue>& vendorFilter,
         return {};
     }
 
-    auto list = mVirtualRadio.get().getProgramList();
+    if (mBandMap.empty() && !mIsBandScanned) {
+        auto result =
+            mIsBandScanning ? ProgramListResult::NOT_READY : ProgramListResult::NOT_STARTED;
+        ALOGD("program list is not available yet: %s", toString(result).c_str());
+        _hidl_cb(result, {});
+        return {};
+    }
+
+    // Partial while a band scan is running, as it streams programs into the map.
+    vector<VirtualProgram> list;
+    list.reserve(mBandMap.size());
+    for (auto&& entry : mBandMap) list.push_back(entry.first);
     ALOGD("returning a list of %zu programs", list.size());
     _hidl_cb(ProgramListResult::OK, getProgramInfoVector(list, getHalRev()));
     return {};
@@ -22,6 +22,9 @@
 #include <android/hardware/broadcastradio/1.1/ITunerCallback.h>
 #include <broadcastradio-utils/WorkerThread.h>
 
+#include <chrono>
+#include <map>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
@@ -54,8 +57,12 @@ struct Tuner : public ITuner {
     virtual Return<void> isAnalogForced(isAnalogForced_cb _hidl_cb) override;
 
    private:
+    using BandMap = std::map<VirtualProgram, std::chrono::steady_clock::time_point>;
+
     std::mutex mMut;
     WorkerThread mThread;
+    // Runs band scans, so that cancel() and tuning, which cancel mThread, leave them running
+    WorkerThread mScanThread;
     bool mIsClosed = false;
 
     const sp<BroadcastRadio> mModule;
@@ -71,10 +78,23 @@ struct Tuner : public ITuner {
     V1_1::ProgramInfo mCurrentProgramInfo = {};
     std::atomic<bool> mIsAnalogForced;
 
+    /**
+     * Programs found on the current band, with the time they were last seen. Kept across scans,
+     * so that scan() is answered from it right away, while band scans refresh it in the
+     * background.
+     */
+    BandMap mBandMap;
+    bool mIsBandScanning = false;
+    bool mIsBandScanned = false;
+
     utils::HalRevision getHalRev() const;
     void setConfigurationInternalLocked(const V1_0::BandConfig& config);
     void tuneInternalLocked(const V1_1::ProgramSelector& sel);
     bool autoConfigureLocked(uint64_t frequency);
+    void startBandScanLocked();
+    void bandScanChunkLocked(const std::vector<VirtualProgram>& chunk,
+                             std::chrono::steady_clock::time_point scanStart, bool isLast);
+    bool isBandMapStaleLocked() const;
 };
 
 }  // namespace implementation
@@ -234,30 +234,57 @@ Return<Result> TunerSession::startProgramListUpdates(const ProgramFilter& filter
     lock_guard<mutex> lk(mMut);
     if (mIsClosed) return Result::INVALID_STATE;
 
-    auto list = virtualRadio().getProgramList();
-    vector<VirtualProgram> filteredList;
-    auto filterCb = [&filter](const VirtualProgram& program) {
-        return utils::satisfies(filter, program.selector);
-    };
-    std::copy_if(list.begin(), list.end(), std::back_inserter(filteredList), filterCb);
+    auto list = virtualRadio().getProgramList(filter);
 
     auto task = [this, list]() {
         lock_guard<mutex> lk(mMut);
-
-        ProgramListChunk chunk = {};
-        chunk.purge = true;
-        chunk.complete = true;
-        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
-
-        mCallback->onProgramListUpdated(chunk);
+        sendProgramListLocked(list);
     };
     mThread.schedule(task, delay::list);
 
     return Result::OK;
 }
 
+void TunerSession::sendProgramListLocked(const vector<VirtualProgram>& list) {
+    std::set<std::pair<uint32_t, uint64_t>> programs;
+    for (auto&& program : list) {
+        auto& id = program.selector.primaryId;
+        programs.emplace(id.type, id.value);
+    }
+
+    ProgramListChunk chunk = {};
+    chunk.complete = true;
+    if (!mSentPrograms) {
+        chunk.purge = true;
+        chunk.modified = hidl_vec<ProgramInfo>(list.begin(), list.end());
+    } else {
+        // Virtual programs never change, so the delta is made of added and removed ones only.
+        vector<ProgramInfo> added;
+        for (auto&& program : list) {
+            auto& id = program.selector.primaryId;
+            if (mSentPrograms->count({id.type, id.value}) == 0) added.push_back(program);
+        }
+        vector<ProgramIdentifier> removed;
+        for (auto&& id : *mSentPrograms) {
+            if (programs.count(id) == 0) removed.push_back({id.first, id.second});
+        }
+        if (added.empty() && removed.empty()) {
+            LOG(VERBOSE) << "program list unchanged by the new filter";
+            return;
+        }
+        chunk.modified = added;
+        chunk.removed = removed;
+    }
+    mSentPrograms = move(programs);
+
+    mCallback->onProgramListUpdated(chunk);
+}
+
 Return<void> TunerSession::stopProgramListUpdates() {
     LOG(DEBUG) << "requested program list updates to stop";
+    lock_guard<mutex> lk(mMut);
+    // The next start sends the whole list again, as the client may have dropped its copy.
+    mSentPrograms.reset();
     return {};
 }
 
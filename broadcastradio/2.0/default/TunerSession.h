@@ -23,6 +23,8 @@
 #include <broadcastradio-utils/WorkerThread.h>
 
 #include <optional>
+#include <set>
+#include <utility>
 
 namespace android {
 namespace hardware {
@@ -63,7 +65,14 @@ struct TunerSession : public ITunerSession {
     bool mIsTuneCompleted = false;
     ProgramSelector mCurrentProgram = {};
 
+    /**
+     * Primary identifiers of the programs the client holds, as of the last chunk sent. Set while
+     * program list updates are started, so that a new filter is sent as a delta against it.
+     */
+    std::optional<std::set<std::pair<uint32_t, uint64_t>>> mSentPrograms;
+
     void cancelLocked();
+    void sendProgramListLocked(const std::vector<VirtualProgram>& list);
     void tuneInternalLocked(const ProgramSelector& sel);
     const VirtualRadio& virtualRadio() const;
     const BroadcastRadio& module() const;
@@ -17,6 +17,8 @@
 
 #include <broadcastradio-utils-2x/Utils.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
@@ -53,7 +55,18 @@ VirtualRadio gDabRadio(
 // clang-format on
 
 VirtualRadio::VirtualRadio(const std::string& name, const vector<VirtualProgram>& initialList)
-    : mName(name), mPrograms(initialList) {}
+    : mName(name), mPrograms(initialList) {
+    mSelectorIndexes.reserve(mPrograms.size());
+    for (size_t i = 0; i < mPrograms.size(); i++) {
+        mSelectorIndexes.emplace_back(mPrograms[i].selector);
+        for (auto&& id : mPrograms[i].selector) {
+            auto& byId = mIdentifierIndex[{id.type, id.value}];
+            if (byId.empty() || byId.back() != i) byId.push_back(i);
+            auto& byType = mTypeIndex[id.type];
+            if (byType.empty() || byType.back() != i) byType.push_back(i);
+        }
+    }
+}
 
 std::string VirtualRadio::getName() const {
     return mName;
@@ -64,11 +77,46 @@ vector<VirtualProgram> VirtualRadio::getProgramList() const {
     return mPrograms;
 }
 
+vector<VirtualProgram> VirtualRadio::getProgramList(const ProgramFilter& filter) const {
+    lock_guard<mutex> lk(mMut);
+
+    vector<size_t> candidates;
+    auto addCandidates = [&candidates](const vector<size_t>* indexes) {
+        if (indexes != nullptr) {
+            candidates.insert(candidates.end(), indexes->begin(), indexes->end());
+        }
+    };
+    // A program must carry one of the identifiers, so they're the narrowest starting point.
+    if (filter.identifiers.size() > 0) {
+        for (auto&& id : filter.identifiers) {
+            auto it = mIdentifierIndex.find({id.type, id.value});
+            addCandidates(it != mIdentifierIndex.end() ? &it->second : nullptr);
+        }
+    } else if (filter.identifierTypes.size() > 0) {
+        for (auto&& type : filter.identifierTypes) {
+            auto it = mTypeIndex.find(type);
+            addCandidates(it != mTypeIndex.end() ? &it->second : nullptr);
+        }
+    } else {
+        candidates.resize(mPrograms.size());
+        for (size_t i = 0; i < candidates.size(); i++) candidates[i] = i;
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    vector<VirtualProgram> list;
+    for (auto i : candidates) {
+        if (utils::satisfies(filter, mSelectorIndexes[i])) list.push_back(mPrograms[i]);
+    }
+    return list;
+}
+
 bool VirtualRadio::getProgram(const ProgramSelector& selector, VirtualProgram& programOut) const {
     lock_guard<mutex> lk(mMut);
-    for (auto&& program : mPrograms) {
-        if (utils::tunesTo(selector, program.selector)) {
-            programOut = program;
+    utils::SelectorIndex query(selector);
+    for (size_t i = 0; i < mPrograms.size(); i++) {
+        if (utils::tunesTo(query, mSelectorIndexes[i])) {
+            programOut = mPrograms[i];
             return true;
         }
     }
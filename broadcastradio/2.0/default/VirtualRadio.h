@@ -18,7 +18,11 @@
 
 #include "VirtualProgram.h"
 
+#include <broadcastradio-utils-2x/Utils.h>
+
+#include <map>
 #include <mutex>
+#include <utility>
 #include <vector>
 
 namespace android {
@@ -41,12 +45,27 @@ class VirtualRadio {
 
     std::string getName() const;
     std::vector<VirtualProgram> getProgramList() const;
+    /**
+     * Programs satisfying the filter, in list order.
+     *
+     * Filters on identifiers or identifier types are answered through an index, so only the
+     * programs carrying one of them are checked against the filter.
+     */
+    std::vector<VirtualProgram> getProgramList(const ProgramFilter& filter) const;
     bool getProgram(const ProgramSelector& selector, VirtualProgram& program) const;
 
    private:
+    using IdentifierKey = std::pair<uint32_t, uint64_t>;
+
     mutable std::mutex mMut;
     std::string mName;
     std::vector<VirtualProgram> mPrograms;
+    // Identifier lookup tables of the selectors of mPrograms, in the same order
+    std::vector<utils::SelectorIndex> mSelectorIndexes;
+
+    // Indexes of mPrograms, by each identifier of their selectors and by its type
+    std::map<IdentifierKey, std::vector<size_t>> mIdentifierIndex;
+    std::map<uint32_t, std::vector<size_t>> mTypeIndex;
 };
 
 /** AM/FM virtual radio space. */
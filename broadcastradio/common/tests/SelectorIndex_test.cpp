@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <broadcastradio-utils-2x/Utils.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::broadcastradio::V2_0::IdentifierType;
+using android::hardware::broadcastradio::V2_0::ProgramFilter;
+using android::hardware::broadcastradio::V2_0::ProgramSelector;
+
+ProgramSelector makeHdSelector(uint32_t frequency, uint64_t stationId, uint64_t subchannel) {
+    auto sel = utils::make_selector_amfm(frequency);
+    sel.secondaryIds = {
+        utils::make_identifier(IdentifierType::HD_STATION_ID_EXT,
+                               (uint64_t(frequency) << 36) | (subchannel << 32) | stationId),
+        utils::make_identifier(IdentifierType::RDS_PI, 0x1234),
+        utils::make_identifier(IdentifierType::AMFM_FREQUENCY, frequency + 200),
+    };
+    return sel;
+}
+
+TEST(SelectorIndexTest, lookups) {
+    auto sel = makeHdSelector(97300, 0xABCD, 0);
+    utils::SelectorIndex index(sel);
+
+    EXPECT_EQ(IdentifierType::AMFM_FREQUENCY, index.getPrimaryType());
+    EXPECT_TRUE(index.hasId(IdentifierType::RDS_PI));
+    EXPECT_FALSE(index.hasId(IdentifierType::DAB_SID_EXT));
+    EXPECT_EQ(0x1234u, index.getId(IdentifierType::RDS_PI, 0));
+    EXPECT_EQ(42u, index.getId(IdentifierType::DAB_SID_EXT, 42));
+
+    // The primary identifier comes first among the identifiers of its type.
+    auto freqs = index.getAllIds(IdentifierType::AMFM_FREQUENCY);
+    ASSERT_EQ(2u, freqs.size());
+    EXPECT_EQ(97300u, freqs.begin()->value);
+    EXPECT_EQ(97500u, (freqs.begin() + 1)->value);
+    EXPECT_EQ(utils::getAllIds(sel, IdentifierType::AMFM_FREQUENCY).size(), freqs.size());
+}
+
+TEST(SelectorIndexTest, matchesSelectorVariants) {
+    std::vector<ProgramSelector> selectors = {
+        utils::make_selector_amfm(94900),
+        utils::make_selector_amfm(97300),
+        makeHdSelector(97300, 0xABCD, 0),
+        makeHdSelector(97300, 0xABCD, 1),
+        utils::make_selector_dab(0xA12345, 225648),
+        utils::make_selector_dab(0xA12345, 222064),
+    };
+
+    ProgramFilter byType = {};
+    byType.identifierTypes = {static_cast<uint32_t>(IdentifierType::DAB_ENSEMBLE)};
+    ProgramFilter byId = {};
+    byId.identifiers = {utils::make_identifier(IdentifierType::AMFM_FREQUENCY, 97300)};
+    ProgramFilter noCategories = {};
+    noCategories.includeCategories = false;
+
+    for (auto&& a : selectors) {
+        utils::SelectorIndex aIndex(a);
+        for (auto&& b : selectors) {
+            utils::SelectorIndex bIndex(b);
+            EXPECT_EQ(utils::tunesTo(a, b), utils::tunesTo(aIndex, bIndex))
+                << toString(a) << " -> " << toString(b);
+        }
+        for (auto&& filter : {byType, byId, noCategories}) {
+            EXPECT_EQ(utils::satisfies(filter, a), utils::satisfies(filter, aIndex))
+                << toString(filter) << " " << toString(a);
+        }
+    }
+}
+
+}  // anonymous namespace
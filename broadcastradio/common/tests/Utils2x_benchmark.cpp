@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Compares identifier matching over plain program selectors with the same matching over
+// SelectorIndex, on a program list the size of a crowded band map.
+
+#include <benchmark/benchmark.h>
+
+#include <broadcastradio-utils-2x/Utils.h>
+
+namespace {
+
+namespace utils = android::hardware::broadcastradio::utils;
+
+using android::hardware::broadcastradio::V2_0::IdentifierType;
+using android::hardware::broadcastradio::V2_0::ProgramFilter;
+using android::hardware::broadcastradio::V2_0::ProgramSelector;
+
+constexpr size_t kProgramCount = 5000;
+
+std::vector<ProgramSelector> makePrograms() {
+    std::vector<ProgramSelector> programs;
+    programs.reserve(kProgramCount);
+    for (uint32_t i = 0; i < kProgramCount; i++) {
+        if (i % 3 == 2) {
+            programs.push_back(utils::make_selector_dab(0xA10000 + i, 0x1000 + i % 64));
+            continue;
+        }
+        uint32_t frequency = 87500 + (i % 205) * 100;
+        auto sel = utils::make_selector_amfm(frequency);
+        sel.secondaryIds = {
+            utils::make_identifier(IdentifierType::RDS_PI, 0x1000 + i),
+            utils::make_identifier(IdentifierType::HD_STATION_ID_EXT,
+                                   (uint64_t(frequency) << 36) | (uint64_t(i % 8) << 32) | i),
+        };
+        programs.push_back(sel);
+    }
+    return programs;
+}
+
+std::vector<utils::SelectorIndex> makeIndexes(const std::vector<ProgramSelector>& programs) {
+    std::vector<utils::SelectorIndex> indexes;
+    indexes.reserve(programs.size());
+    for (auto&& program : programs) indexes.emplace_back(program);
+    return indexes;
+}
+
+ProgramFilter makeFilter() {
+    ProgramFilter filter = {};
+    filter.identifierTypes = {static_cast<uint32_t>(IdentifierType::DAB_ENSEMBLE)};
+    filter.identifiers = {utils::make_identifier(IdentifierType::RDS_PI, 0x1000 + 42)};
+    filter.includeCategories = false;
+    return filter;
+}
+
+void BM_TunesToSelectors(benchmark::State& state) {
+    auto programs = makePrograms();
+    auto query = programs[kProgramCount / 2];
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (auto&& program : programs) matches += utils::tunesTo(query, program);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kProgramCount);
+}
+BENCHMARK(BM_TunesToSelectors);
+
+void BM_TunesToIndexes(benchmark::State& state) {
+    auto indexes = makeIndexes(makePrograms());
+    auto& query = indexes[kProgramCount / 2];
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (auto&& index : indexes) matches += utils::tunesTo(query, index);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kProgramCount);
+}
+BENCHMARK(BM_TunesToIndexes);
+
+void BM_SatisfiesSelectors(benchmark::State& state) {
+    auto programs = makePrograms();
+    auto filter = makeFilter();
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (auto&& program : programs) matches += utils::satisfies(filter, program);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kProgramCount);
+}
+BENCHMARK(BM_SatisfiesSelectors);
+
+void BM_SatisfiesIndexes(benchmark::State& state) {
+    auto indexes = makeIndexes(makePrograms());
+    auto filter = makeFilter();
+    for (auto _ : state) {
+        size_t matches = 0;
+        for (auto&& index : indexes) matches += utils::satisfies(filter, index);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.SetItemsProcessed(state.iterations() * kProgramCount);
+}
+BENCHMARK(BM_SatisfiesIndexes);
+
+void BM_BuildIndexes(benchmark::State& state) {
+    auto programs = makePrograms();
+    for (auto _ : state) {
+        auto indexes = makeIndexes(programs);
+        benchmark::DoNotOptimize(indexes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * kProgramCount);
+}
+BENCHMARK(BM_BuildIndexes);
+
+}  // anonymous namespace
+
+BENCHMARK_MAIN();
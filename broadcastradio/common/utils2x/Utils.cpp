@@ -19,6 +19,8 @@
 
 #include <android-base/logging.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace broadcastradio {
@@ -91,28 +93,65 @@ FrequencyBand getBand(uint64_t freq) {
     return FrequencyBand::UNKNOWN;
 }
 
-static bool bothHaveId(const ProgramSelector& a, const ProgramSelector& b,
-                       const IdentifierType type) {
-    return hasId(a, type) && hasId(b, type);
+static bool maybeGetId(const ProgramSelector& sel, const IdentifierType type, uint64_t* val) {
+    auto itype = static_cast<uint32_t>(type);
+
+    if (sel.primaryId.type == itype) {
+        if (val) *val = sel.primaryId.value;
+        return true;
+    }
+
+    // TODO(twasilczyk): use IdentifierIterator
+    // not optimal, but we don't care in default impl
+    for (auto&& id : sel.secondaryIds) {
+        if (id.type == itype) {
+            if (val) *val = id.value;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool maybeGetId(const SelectorIndex& sel, const IdentifierType type, uint64_t* val) {
+    auto ids = sel.getAllIds(type);
+    if (ids.empty()) return false;
+    if (val) *val = ids.begin()->value;
+    return true;
+}
+
+static IdentifierType getPrimaryType(const ProgramSelector& sel) {
+    return getType(sel.primaryId);
 }
 
-static bool haveEqualIds(const ProgramSelector& a, const ProgramSelector& b,
-                         const IdentifierType type) {
-    if (!bothHaveId(a, b, type)) return false;
+static IdentifierType getPrimaryType(const SelectorIndex& sel) {
+    return sel.getPrimaryType();
+}
+
+/* The helpers below work on both ProgramSelector and SelectorIndex, looking each identifier up
+ * once per selector.
+ */
+template <typename Selector>
+static bool haveEqualIds(const Selector& a, const Selector& b, const IdentifierType type) {
     /* We should check all Ids of a given type (ie. other AF),
      * but it doesn't matter for default implementation.
      */
-    return getId(a, type) == getId(b, type);
+    uint64_t aValue, bValue;
+    if (!maybeGetId(a, type, &aValue) || !maybeGetId(b, type, &bValue)) return false;
+    return aValue == bValue;
 }
 
-static int getHdSubchannel(const ProgramSelector& sel) {
-    auto hdsidext = getId(sel, IdentifierType::HD_STATION_ID_EXT, 0);
+template <typename Selector>
+static int getHdSubchannel(const Selector& sel) {
+    uint64_t hdsidext = 0;
+    maybeGetId(sel, IdentifierType::HD_STATION_ID_EXT, &hdsidext);
     hdsidext >>= 32;        // Station ID number
     return hdsidext & 0xF;  // HD Radio subchannel
 }
 
-bool tunesTo(const ProgramSelector& a, const ProgramSelector& b) {
-    auto type = getType(b.primaryId);
+template <typename Selector>
+static bool tunesToImpl(const Selector& a, const Selector& b) {
+    auto type = getPrimaryType(b);
 
     switch (type) {
         case IdentifierType::HD_STATION_ID_EXT:
@@ -133,24 +172,12 @@ bool tunesTo(const ProgramSelector& a, const ProgramSelector& b) {
     }
 }
 
-static bool maybeGetId(const ProgramSelector& sel, const IdentifierType type, uint64_t* val) {
-    auto itype = static_cast<uint32_t>(type);
-
-    if (sel.primaryId.type == itype) {
-        if (val) *val = sel.primaryId.value;
-        return true;
-    }
-
-    // TODO(twasilczyk): use IdentifierIterator
-    // not optimal, but we don't care in default impl
-    for (auto&& id : sel.secondaryIds) {
-        if (id.type == itype) {
-            if (val) *val = id.value;
-            return true;
-        }
-    }
+bool tunesTo(const ProgramSelector& a, const ProgramSelector& b) {
+    return tunesToImpl(a, b);
+}
 
-    return false;
+bool tunesTo(const SelectorIndex& a, const SelectorIndex& b) {
+    return tunesToImpl(a, b);
 }
 
 bool hasId(const ProgramSelector& sel, const IdentifierType type) {
@@ -350,6 +377,61 @@ bool satisfies(const ProgramFilter& filter, const ProgramSelector& sel) {
     return true;
 }
 
+bool satisfies(const ProgramFilter& filter, const SelectorIndex& sel) {
+    if (filter.identifierTypes.size() > 0) {
+        auto hasType = [&sel](uint32_t type) { return sel.hasId(getType(type)); };
+        if (std::none_of(filter.identifierTypes.begin(), filter.identifierTypes.end(), hasType)) {
+            return false;
+        }
+    }
+
+    if (filter.identifiers.size() > 0) {
+        auto hasIdentifier = [&sel](const ProgramIdentifier& id) {
+            auto ids = sel.getAllIds(getType(id));
+            return std::find(ids.begin(), ids.end(), id) != ids.end();
+        };
+        if (std::none_of(filter.identifiers.begin(), filter.identifiers.end(), hasIdentifier)) {
+            return false;
+        }
+    }
+
+    if (!filter.includeCategories) {
+        if (sel.getPrimaryType() == IdentifierType::DAB_ENSEMBLE) return false;
+    }
+
+    return true;
+}
+
+SelectorIndex::SelectorIndex(const ProgramSelector& sel) : mPrimaryType(getType(sel.primaryId)) {
+    mIds.reserve(1 + sel.secondaryIds.size());
+    mIds.push_back(sel.primaryId);
+    mIds.insert(mIds.end(), sel.secondaryIds.begin(), sel.secondaryIds.end());
+
+    // Stable, so that the primary identifier stays the first of its type.
+    auto byType = [](const ProgramIdentifier& a, const ProgramIdentifier& b) {
+        return a.type < b.type;
+    };
+    std::stable_sort(mIds.begin(), mIds.end(), byType);
+}
+
+SelectorIndex::IdSpan SelectorIndex::getAllIds(IdentifierType type) const {
+    auto itype = static_cast<uint32_t>(type);
+    auto byType = [](const ProgramIdentifier& a, const ProgramIdentifier& b) {
+        return a.type < b.type;
+    };
+    auto range = std::equal_range(mIds.begin(), mIds.end(), ProgramIdentifier{itype, 0}, byType);
+    return IdSpan(mIds.data() + (range.first - mIds.begin()), range.second - range.first);
+}
+
+bool SelectorIndex::hasId(IdentifierType type) const {
+    return !getAllIds(type).empty();
+}
+
+uint64_t SelectorIndex::getId(IdentifierType type, uint64_t defval) const {
+    auto ids = getAllIds(type);
+    return ids.empty() ? defval : ids.begin()->value;
+}
+
 size_t ProgramInfoHasher::operator()(const ProgramInfo& info) const {
     auto& id = info.selector.primaryId;
 
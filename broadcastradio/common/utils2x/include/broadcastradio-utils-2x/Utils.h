@@ -22,6 +22,7 @@
 #include <queue>
 #include <thread>
 #include <unordered_set>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -132,6 +133,47 @@ V2_0::Metadata make_metadata(V2_0::MetadataKey key, std::string value);
 
 bool satisfies(const V2_0::ProgramFilter& filter, const V2_0::ProgramSelector& sel);
 
+/**
+ * Identifiers of a selector, grouped by type.
+ *
+ * For selectors that are queried many times, like the entries of a program list: it's built once,
+ * then each lookup is a binary search over the types, and getAllIds() returns a view instead of
+ * a new vector. It holds its own copy of the identifiers.
+ */
+class SelectorIndex {
+   public:
+    class IdSpan {
+       public:
+        IdSpan(const V2_0::ProgramIdentifier* first, size_t size) : mFirst(first), mSize(size) {}
+
+        const V2_0::ProgramIdentifier* begin() const { return mFirst; }
+        const V2_0::ProgramIdentifier* end() const { return mFirst + mSize; }
+        size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+
+       private:
+        const V2_0::ProgramIdentifier* mFirst;
+        size_t mSize;
+    };
+
+    explicit SelectorIndex(const V2_0::ProgramSelector& sel);
+
+    V2_0::IdentifierType getPrimaryType() const { return mPrimaryType; }
+    bool hasId(V2_0::IdentifierType type) const;
+    /** Returns the first ID of a given type, the primary one if it's of that type. */
+    uint64_t getId(V2_0::IdentifierType type, uint64_t defval) const;
+    /** Returns all IDs of a given type, valid as long as the index. */
+    IdSpan getAllIds(V2_0::IdentifierType type) const;
+
+   private:
+    V2_0::IdentifierType mPrimaryType;
+    std::vector<V2_0::ProgramIdentifier> mIds;  // sorted by type
+};
+
+/** Same as the ProgramSelector variants, for indexed selectors. */
+bool tunesTo(const SelectorIndex& pointer, const SelectorIndex& channel);
+bool satisfies(const V2_0::ProgramFilter& filter, const SelectorIndex& sel);
+
 struct ProgramInfoHasher {
     size_t operator()(const V2_0::ProgramInfo& info) const;
 };
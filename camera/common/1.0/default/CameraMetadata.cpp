@@ -20,6 +20,10 @@
 #include <log/log.h>
 #include <utils/Errors.h>
 
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
 #include "CameraMetadata.h"
 #include "VendorTagDescriptor.h"
 
@@ -153,6 +157,195 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     return append_camera_metadata(mBuffer, other);
 }
 
+namespace {
+
+// Entries of a metadata buffer as (tag, index) pairs, sorted by tag, so that two buffers can be
+// walked side by side whether or not they are sorted themselves.
+std::vector<std::pair<uint32_t, size_t>> sortedEntries(const camera_metadata_t* buffer) {
+    std::vector<std::pair<uint32_t, size_t>> entries;
+    size_t count = (buffer == NULL) ? 0 : get_camera_metadata_entry_count(buffer);
+    entries.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        camera_metadata_ro_entry_t entry;
+        if (get_camera_metadata_ro_entry(buffer, i, &entry) == OK) {
+            entries.emplace_back(entry.tag, i);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+camera_metadata_ro_entry_t getEntry(const camera_metadata_t* buffer, size_t index) {
+    camera_metadata_ro_entry_t entry;
+    get_camera_metadata_ro_entry(buffer, index, &entry);
+    return entry;
+}
+
+bool entryEquals(const camera_metadata_ro_entry_t& a, const camera_metadata_ro_entry_t& b) {
+    return a.type == b.type && a.count == b.count &&
+            (a.count == 0 ||
+             memcmp(a.data.u8, b.data.u8, camera_metadata_type_size[a.type] * a.count) == 0);
+}
+
+size_t entryDataSize(const camera_metadata_ro_entry_t& entry) {
+    return calculate_camera_metadata_entry_data_size(entry.type, entry.count);
+}
+
+// Walks the sorted entries of two buffers side by side, calling visit(a, b) on each tag with
+// the index of its entry in either buffer, or -1 when the buffer does not have it. Stops when
+// visit returns false.
+template <typename Visit>
+void walkEntries(const std::vector<std::pair<uint32_t, size_t>>& a,
+        const std::vector<std::pair<uint32_t, size_t>>& b, Visit visit) {
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        bool fromA = j == b.size() || (i < a.size() && a[i].first <= b[j].first);
+        bool fromB = i == a.size() || (j < b.size() && b[j].first <= a[i].first);
+        ssize_t indexA = fromA ? static_cast<ssize_t>(a[i++].second) : -1;
+        ssize_t indexB = fromB ? static_cast<ssize_t>(b[j++].second) : -1;
+        if (!visit(indexA, indexB)) {
+            return;
+        }
+    }
+}
+
+}  // anonymous namespace
+
+status_t CameraMetadata::merge(const camera_metadata_t* changed,
+        const Vector<uint32_t>& removed) {
+    if (mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    std::vector<std::pair<uint32_t, size_t>> current = sortedEntries(mBuffer);
+    std::vector<std::pair<uint32_t, size_t>> changes = sortedEntries(changed);
+    std::vector<uint32_t> removedTags(removed.begin(), removed.end());
+    std::sort(removedTags.begin(), removedTags.end());
+    auto isRemoved = [&removedTags](uint32_t tag) {
+        return std::binary_search(removedTags.begin(), removedTags.end(), tag);
+    };
+
+    // Size the result exactly, so that it is allocated once.
+    std::vector<size_t> kept;
+    size_t entryCount = changes.size();
+    size_t dataCount = 0;
+    walkEntries(current, changes, [&](ssize_t indexCurrent, ssize_t indexChange) {
+        if (indexChange >= 0) {
+            dataCount += entryDataSize(getEntry(changed, indexChange));
+        } else {
+            camera_metadata_ro_entry_t entry = getEntry(mBuffer, indexCurrent);
+            if (!isRemoved(entry.tag)) {
+                kept.push_back(indexCurrent);
+                dataCount += entryDataSize(entry);
+            }
+        }
+        return true;
+    });
+    entryCount += kept.size();
+    // The kept entries stay in their original order.
+    std::sort(kept.begin(), kept.end());
+
+    camera_metadata_t* merged = allocate_camera_metadata(entryCount, dataCount);
+    if (merged == NULL) {
+        ALOGE("%s: Can't allocate merged metadata buffer", __FUNCTION__);
+        return NO_MEMORY;
+    }
+    if (mBuffer != NULL) {
+        set_camera_metadata_vendor_id(merged, get_camera_metadata_vendor_id(mBuffer));
+    } else if (changed != NULL) {
+        set_camera_metadata_vendor_id(merged, get_camera_metadata_vendor_id(changed));
+    }
+
+    status_t res = OK;
+    for (size_t index : kept) {
+        camera_metadata_ro_entry_t entry = getEntry(mBuffer, index);
+        res = add_camera_metadata_entry(merged, entry.tag, entry.data.u8, entry.count);
+        if (res != OK) {
+            break;
+        }
+    }
+    for (size_t i = 0; res == OK && i < changes.size(); i++) {
+        camera_metadata_ro_entry_t entry = getEntry(changed, changes[i].second);
+        res = add_camera_metadata_entry(merged, entry.tag, entry.data.u8, entry.count);
+    }
+    if (res != OK) {
+        ALOGE("%s: Unable to merge metadata: %s (%d)", __FUNCTION__, strerror(-res), res);
+        free_camera_metadata(merged);
+        return res;
+    }
+
+    clear();
+    mBuffer = merged;
+    return OK;
+}
+
+status_t CameraMetadata::diff(const camera_metadata_t* from, const camera_metadata_t* to,
+        CameraMetadata* changed, Vector<uint32_t>* removed) {
+    if (changed == NULL || removed == NULL) {
+        return BAD_VALUE;
+    }
+    if (changed->mLocked) {
+        ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
+        return INVALID_OPERATION;
+    }
+    std::vector<std::pair<uint32_t, size_t>> fromEntries = sortedEntries(from);
+    std::vector<std::pair<uint32_t, size_t>> toEntries = sortedEntries(to);
+
+    removed->clear();
+    std::vector<size_t> changedIndices;
+    size_t dataCount = 0;
+    walkEntries(fromEntries, toEntries, [&](ssize_t indexFrom, ssize_t indexTo) {
+        if (indexTo < 0) {
+            removed->push_back(getEntry(from, indexFrom).tag);
+            return true;
+        }
+        camera_metadata_ro_entry_t entryTo = getEntry(to, indexTo);
+        if (indexFrom < 0 || !entryEquals(getEntry(from, indexFrom), entryTo)) {
+            changedIndices.push_back(indexTo);
+            dataCount += entryDataSize(entryTo);
+        }
+        return true;
+    });
+
+    changed->clear();
+    if (changedIndices.empty()) {
+        return OK;
+    }
+    changed->mBuffer = allocate_camera_metadata(changedIndices.size(), dataCount);
+    if (changed->mBuffer == NULL) {
+        ALOGE("%s: Can't allocate metadata delta buffer", __FUNCTION__);
+        return NO_MEMORY;
+    }
+    set_camera_metadata_vendor_id(changed->mBuffer, get_camera_metadata_vendor_id(to));
+    for (size_t index : changedIndices) {
+        camera_metadata_ro_entry_t entry = getEntry(to, index);
+        status_t res = add_camera_metadata_entry(changed->mBuffer, entry.tag, entry.data.u8,
+                entry.count);
+        if (res != OK) {
+            ALOGE("%s: Unable to add entry %x to delta: %s (%d)", __FUNCTION__, entry.tag,
+                    strerror(-res), res);
+            changed->clear();
+            return res;
+        }
+    }
+    return OK;
+}
+
+bool CameraMetadata::equals(const camera_metadata_t* a, const camera_metadata_t* b) {
+    size_t countA = (a == NULL) ? 0 : get_camera_metadata_entry_count(a);
+    size_t countB = (b == NULL) ? 0 : get_camera_metadata_entry_count(b);
+    if (countA != countB) {
+        return false;
+    }
+    bool equal = true;
+    walkEntries(sortedEntries(a), sortedEntries(b), [&](ssize_t indexA, ssize_t indexB) {
+        equal = indexA >= 0 && indexB >= 0 &&
+                entryEquals(getEntry(a, indexA), getEntry(b, indexB));
+        return equal;
+    });
+    return equal;
+}
+
 size_t CameraMetadata::entryCount() const {
     return (mBuffer == NULL) ? 0 :
             get_camera_metadata_entry_count(mBuffer);
@@ -318,7 +318,7 @@ int CameraModule::getCameraInfo(int cameraId, struct camera_info *info) {
         m.append(rawInfo.static_camera_characteristics);
         deriveCameraCharacteristicsKeys(rawInfo.device_version, m);
         cameraInfo = rawInfo;
-        cameraInfo.static_camera_characteristics = m.release();
+        cameraInfo.static_camera_characteristics = releaseCompacted(m);
         index = mCameraInfoMap.add(cameraId, cameraInfo);
     }
 
@@ -328,6 +328,23 @@ int CameraModule::getCameraInfo(int cameraId, struct camera_info *info) {
     return OK;
 }
 
+camera_metadata_t* CameraModule::releaseCompacted(CameraMetadata& m) {
+    if (m.sort() != OK) {
+        ALOGW("%s: sorting camera metadata failed", __FUNCTION__);
+    }
+    camera_metadata_t* raw = m.release();
+    if (raw == nullptr) {
+        return nullptr;
+    }
+    // appending and deriving keys grows the buffer geometrically
+    camera_metadata_t* compacted = clone_camera_metadata(raw);
+    if (compacted == nullptr) {
+        return raw;
+    }
+    free_camera_metadata(raw);
+    return compacted;
+}
+
 int CameraModule::getPhysicalCameraInfo(int physicalCameraId, camera_metadata_t **physicalInfo) {
     ATRACE_CALL();
     Mutex::Autolock lock(mCameraInfoLock);
@@ -360,12 +377,10 @@ int CameraModule::getPhysicalCameraInfo(int physicalCameraId, camera_metadata_t
         }
 
         // The camera_metadata_t returned by get_physical_camera_info could be using
-        // more memory than necessary due to unused reserved space. Reduce the
-        // size by appending it to a new CameraMetadata object, which internally
-        // calls resizeIfNeeded.
+        // more memory than necessary due to unused reserved space.
         CameraMetadata m;
         m.append(info);
-        camera_metadata_t* derivedMetadata = m.release();
+        camera_metadata_t* derivedMetadata = releaseCompacted(m);
         index = mPhysicalCameraInfoMap.add(physicalCameraId, derivedMetadata);
     }
 
@@ -209,11 +209,75 @@ String8 CameraParameters::flatten() const
     return flattened;
 }
 
+// Find the bounds of the "key=value" item starting at str, the same way unflatten() does.
+// Returns false if there's no more item.
+static bool next_item(const char *str, const char **keyEnd, const char **valueEnd)
+{
+    *keyEnd = strchr(str, '=');
+    if (*keyEnd == 0)
+        return false;
+    *valueEnd = strchr(*keyEnd + 1, ';');
+    if (*valueEnd == 0)
+        *valueEnd = *keyEnd + 1 + strlen(*keyEnd + 1);
+    return true;
+}
+
+bool CameraParameters::unflattenChangedValues(const String8 &params)
+{
+    // Apps setting parameters for every frame usually only change a value or two (zoom,
+    // focus areas...), so compare item by item against the last string instead of
+    // rebuilding all keys and values.
+    const char *a = params.string();
+    const char *o = mLastUnflattened.string();
+    const char *aKeyEnd, *aValueEnd, *oKeyEnd, *oValueEnd;
+    Vector<const char *> changed; // start of changed items in params
+    size_t count = 0;
+
+    for (;;) {
+        bool aMore = next_item(a, &aKeyEnd, &aValueEnd);
+        bool oMore = next_item(o, &oKeyEnd, &oValueEnd);
+        if (aMore != oMore)
+            return false;
+        if (!aMore)
+            break;
+        if (aKeyEnd - a != oKeyEnd - o || strncmp(a, o, aKeyEnd - a) != 0)
+            return false;
+        if (aValueEnd - aKeyEnd != oValueEnd - oKeyEnd ||
+                strncmp(aKeyEnd, oKeyEnd, aValueEnd - aKeyEnd) != 0)
+            changed.push(a);
+        count++;
+        if (*aValueEnd == '\0' || *oValueEnd == '\0') {
+            if (*aValueEnd != *oValueEnd)
+                return false;
+            break;
+        }
+        a = aValueEnd + 1;
+        o = oValueEnd + 1;
+    }
+
+    // Duplicated keys make the item order matter; leave those to the full parse.
+    if (count != mMap.size())
+        return false;
+
+    for (size_t i = 0; i < changed.size(); i++) {
+        next_item(changed[i], &aKeyEnd, &aValueEnd);
+        mMap.replaceValueFor(String8(changed[i], (size_t)(aKeyEnd - changed[i])),
+                String8(aKeyEnd + 1, (size_t)(aValueEnd - aKeyEnd - 1)));
+    }
+    return true;
+}
+
 void CameraParameters::unflatten(const String8 &params)
 {
     const char *a = params.string();
     const char *b;
 
+    if (mLastUnflattened.length() > 0 && unflattenChangedValues(params)) {
+        mLastUnflattened = params;
+        return;
+    }
+    mLastUnflattened = params;
+
     mMap.clear();
 
     for (;;) {
@@ -256,6 +320,7 @@ void CameraParameters::set(const char *key, const char *value)
     }
 
     mMap.replaceValueFor(String8(key), String8(value));
+    mLastUnflattened.clear();
 }
 
 void CameraParameters::set(const char *key, int value)
@@ -298,6 +363,7 @@ float CameraParameters::getFloat(const char *key) const
 void CameraParameters::remove(const char *key)
 {
     mMap.removeItem(String8(key));
+    mLastUnflattened.clear();
 }
 
 // Parse string like "640x480" or "10000,20000"
@@ -23,7 +23,9 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "Exif.h"
@@ -60,6 +62,8 @@ class ExifUtilsImpl : public ExifUtils {
     // cleared.
     virtual bool initialize();
 
+    virtual void setTemplateEnabled(bool enabled);
+
     // set all known fields from a metadata structure
     virtual bool setFromMetadata(const CameraMetadata& metadata,
                                  const size_t imageWidth,
@@ -306,6 +310,13 @@ class ExifUtilsImpl : public ExifUtils {
     // Destroys the buffer of APP1 segment if exists.
     virtual void destroyApp1();
 
+    // Records where the value of each entry of |exif_data_| is in |app1_buffer_|.
+    virtual void buildApp1Template(bool has_thumbnail);
+
+    // Writes the entry values of |exif_data_| and the thumbnail into |template_buffer_|.
+    // Returns false if the entries don't match the template layout.
+    virtual bool patchApp1Template(const void* thumbnail_buffer, uint32_t size);
+
     // The Exif data (APP1). Owned by this class.
     ExifData* exif_data_;
     // The raw data of APP1 segment. It's allocated by ExifMem in |exif_data_| but
@@ -314,6 +325,25 @@ class ExifUtilsImpl : public ExifUtils {
     // The length of |app1_buffer_|.
     unsigned int app1_length_;
 
+    struct TemplateEntry {
+        int ifd;
+        ExifTag tag;
+        ExifFormat format;
+        unsigned long components;
+        unsigned int size;
+        size_t offset; // offset of the value in |template_buffer_|
+    };
+    bool template_enabled_;
+    // |template_buffer_| holds a valid APP1 segment laid out as |template_entries_|
+    bool template_valid_;
+    // The APP1 segment returned by getApp1Buffer() is in |template_buffer_|
+    bool use_template_buffer_;
+    std::vector<uint8_t> template_buffer_;
+    std::vector<TemplateEntry> template_entries_;
+    // Length of the APP1 segment before the thumbnail
+    size_t template_header_length_;
+    // Offset of the JPEGInterchangeFormatLength value, 0 if there is no thumbnail
+    size_t template_thumb_length_offset_;
 };
 
 #define SET_SHORT(ifd, tag, value)                      \
@@ -370,7 +400,9 @@ ExifUtils::~ExifUtils() {
 }
 
 ExifUtilsImpl::ExifUtilsImpl()
-        : exif_data_(nullptr), app1_buffer_(nullptr), app1_length_(0) {}
+        : exif_data_(nullptr), app1_buffer_(nullptr), app1_length_(0),
+          template_enabled_(false), template_valid_(false), use_template_buffer_(false),
+          template_header_length_(0), template_thumb_length_offset_(0) {}
 
 ExifUtilsImpl::~ExifUtilsImpl() {
     reset();
@@ -397,6 +429,15 @@ bool ExifUtilsImpl::initialize() {
     return true;
 }
 
+void ExifUtilsImpl::setTemplateEnabled(bool enabled) {
+    template_enabled_ = enabled;
+    if (!enabled) {
+        template_valid_ = false;
+        template_entries_.clear();
+        std::vector<uint8_t>().swap(template_buffer_);
+    }
+}
+
 bool ExifUtilsImpl::setAperture(uint32_t numerator, uint32_t denominator) {
     SET_RATIONAL(EXIF_IFD_EXIF, EXIF_TAG_APERTURE_VALUE, numerator, denominator);
     return true;
@@ -757,6 +798,9 @@ bool ExifUtilsImpl::setYResolution(uint32_t numerator, uint32_t denominator) {
 
 bool ExifUtilsImpl::generateApp1(const void* thumbnail_buffer, uint32_t size) {
     destroyApp1();
+    if (template_enabled_ && patchApp1Template(thumbnail_buffer, size)) {
+        return true;
+    }
     exif_data_->data = const_cast<uint8_t*>(static_cast<const uint8_t*>(thumbnail_buffer));
     exif_data_->size = size;
     // Save the result into |app1_buffer_|.
@@ -774,15 +818,173 @@ bool ExifUtilsImpl::generateApp1(const void* thumbnail_buffer, uint32_t size) {
         ALOGE("%s: The size of APP1 segment is too large", __FUNCTION__);
         return false;
     }
+    if (template_enabled_) {
+        buildApp1Template(thumbnail_buffer != nullptr && size > 0);
+    }
     return true;
 }
 
 const uint8_t* ExifUtilsImpl::getApp1Buffer() {
-    return app1_buffer_;
+    return use_template_buffer_ ? template_buffer_.data() : app1_buffer_;
 }
 
 unsigned int ExifUtilsImpl::getApp1Length() {
-    return app1_length_;
+    return use_template_buffer_ ? template_buffer_.size() : app1_length_;
+}
+
+namespace {
+
+const size_t kExifHeaderLength = 6; // "Exif\0\0" before the TIFF header
+const ExifTag kIfdPointerTags[] = {
+    EXIF_TAG_EXIF_IFD_POINTER, EXIF_TAG_GPS_INFO_IFD_POINTER, EXIF_TAG_INTEROPERABILITY_IFD_POINTER};
+const ExifIfd kIfdPointerIfds[] = {
+    EXIF_IFD_EXIF, EXIF_IFD_GPS, EXIF_IFD_INTEROPERABILITY};
+
+typedef std::map<std::pair<int, uint16_t>, size_t> EntryOffsetMap;
+
+// Walks the IFD at |ifd_offset| of the |tiff_length| bytes long TIFF structure, and the
+// IFDs it points to, adding the offset of each entry value relative to |tiff| to |offsets|.
+bool parseIfd(const uint8_t* tiff, size_t tiff_length, uint32_t ifd_offset, int ifd,
+              int depth, EntryOffsetMap* offsets) {
+    if (depth > EXIF_IFD_COUNT || ifd_offset + 2 > tiff_length) {
+        return false;
+    }
+    uint16_t count = exif_get_short(tiff + ifd_offset, EXIF_BYTE_ORDER_INTEL);
+    size_t entries_end = ifd_offset + 2 + 12 * count;
+    if (entries_end + 4 > tiff_length) {
+        return false;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        const uint8_t* e = tiff + ifd_offset + 2 + 12 * i;
+        uint16_t tag = exif_get_short(e, EXIF_BYTE_ORDER_INTEL);
+        ExifFormat format =
+                static_cast<ExifFormat>(exif_get_short(e + 2, EXIF_BYTE_ORDER_INTEL));
+        uint32_t components = exif_get_long(e + 4, EXIF_BYTE_ORDER_INTEL);
+        size_t size = static_cast<size_t>(exif_format_get_size(format)) * components;
+        size_t value_offset = (size <= 4) ?
+                (e + 8 - tiff) : exif_get_long(e + 8, EXIF_BYTE_ORDER_INTEL);
+        if (value_offset + size > tiff_length) {
+            return false;
+        }
+        (*offsets)[std::make_pair(ifd, tag)] = value_offset;
+
+        for (size_t p = 0; p < sizeof(kIfdPointerTags) / sizeof(kIfdPointerTags[0]); p++) {
+            if (tag == kIfdPointerTags[p] &&
+                    !parseIfd(tiff, tiff_length, exif_get_long(e + 8, EXIF_BYTE_ORDER_INTEL),
+                              kIfdPointerIfds[p], depth + 1, offsets)) {
+                return false;
+            }
+        }
+    }
+    uint32_t next_ifd = exif_get_long(tiff + entries_end, EXIF_BYTE_ORDER_INTEL);
+    if (ifd == EXIF_IFD_0 && next_ifd != 0) {
+        return parseIfd(tiff, tiff_length, next_ifd, EXIF_IFD_1, depth + 1, offsets);
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+void ExifUtilsImpl::buildApp1Template(bool has_thumbnail) {
+    template_valid_ = false;
+    template_entries_.clear();
+    if (app1_length_ < kExifHeaderLength + 8) {
+        return;
+    }
+
+    const uint8_t* tiff = app1_buffer_ + kExifHeaderLength;
+    size_t tiff_length = app1_length_ - kExifHeaderLength;
+    EntryOffsetMap offsets;
+    if (!parseIfd(tiff, tiff_length, exif_get_long(tiff + 4, EXIF_BYTE_ORDER_INTEL),
+                  EXIF_IFD_0, 0, &offsets)) {
+        ALOGW("%s: cannot parse generated APP1 segment", __FUNCTION__);
+        return;
+    }
+
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        for (unsigned int i = 0; i < content->count; i++) {
+            ExifEntry* entry = content->entries[i];
+            auto it = offsets.find(std::make_pair(ifd, static_cast<uint16_t>(entry->tag)));
+            if (it == offsets.end()) {
+                ALOGV("%s: tag 0x%x not found in APP1 segment", __FUNCTION__, entry->tag);
+                template_entries_.clear();
+                return;
+            }
+            template_entries_.push_back({ifd, entry->tag, entry->format, entry->components,
+                    entry->size, kExifHeaderLength + it->second});
+        }
+    }
+
+    template_header_length_ = app1_length_;
+    template_thumb_length_offset_ = 0;
+    if (has_thumbnail) {
+        auto thumb = offsets.find(std::make_pair(
+                static_cast<int>(EXIF_IFD_1), static_cast<uint16_t>(EXIF_TAG_JPEG_INTERCHANGE_FORMAT)));
+        auto thumb_length = offsets.find(std::make_pair(
+                static_cast<int>(EXIF_IFD_1),
+                static_cast<uint16_t>(EXIF_TAG_JPEG_INTERCHANGE_FORMAT_LENGTH)));
+        if (thumb == offsets.end() || thumb_length == offsets.end()) {
+            template_entries_.clear();
+            return;
+        }
+        size_t thumb_offset = kExifHeaderLength +
+                exif_get_long(tiff + thumb->second, EXIF_BYTE_ORDER_INTEL);
+        size_t thumb_size = exif_get_long(tiff + thumb_length->second, EXIF_BYTE_ORDER_INTEL);
+        // Only a thumbnail at the end of the segment can change size in place
+        if (thumb_offset + thumb_size != app1_length_) {
+            ALOGV("%s: thumbnail is not at the end of APP1 segment", __FUNCTION__);
+            template_entries_.clear();
+            return;
+        }
+        template_header_length_ = thumb_offset;
+        template_thumb_length_offset_ = kExifHeaderLength + thumb_length->second;
+    }
+
+    template_buffer_.assign(app1_buffer_, app1_buffer_ + app1_length_);
+    template_valid_ = true;
+}
+
+bool ExifUtilsImpl::patchApp1Template(const void* thumbnail_buffer, uint32_t size) {
+    bool has_thumbnail = thumbnail_buffer != nullptr && size > 0;
+    if (!template_valid_ || has_thumbnail != (template_thumb_length_offset_ != 0) ||
+            template_header_length_ + size > 65533) {
+        return false;
+    }
+
+    // A failed match leaves |template_buffer_| partially patched, which is fine since the
+    // caller then regenerates the segment and the template.
+    size_t idx = 0;
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        for (unsigned int i = 0; i < content->count; i++, idx++) {
+            ExifEntry* entry = content->entries[i];
+            if (idx >= template_entries_.size()) {
+                template_valid_ = false;
+                return false;
+            }
+            const TemplateEntry& t = template_entries_[idx];
+            if (t.ifd != ifd || t.tag != entry->tag || t.format != entry->format ||
+                    t.components != entry->components || t.size != entry->size) {
+                template_valid_ = false;
+                return false;
+            }
+            memcpy(&template_buffer_[t.offset], entry->data, entry->size);
+        }
+    }
+    if (idx != template_entries_.size()) {
+        template_valid_ = false;
+        return false;
+    }
+
+    template_buffer_.resize(template_header_length_ + size);
+    if (has_thumbnail) {
+        exif_set_long(&template_buffer_[template_thumb_length_offset_],
+                      EXIF_BYTE_ORDER_INTEL, size);
+        memcpy(&template_buffer_[template_header_length_], thumbnail_buffer, size);
+    }
+    use_template_buffer_ = true;
+    return true;
 }
 
 bool ExifUtilsImpl::setExifVersion(const std::string& exif_version) {
@@ -957,6 +1159,7 @@ void ExifUtilsImpl::destroyApp1() {
     free(app1_buffer_);
     app1_buffer_ = nullptr;
     app1_length_ = 0;
+    use_template_buffer_ = false;
 }
 
 bool ExifUtilsImpl::setFromMetadata(const CameraMetadata& metadata,
@@ -31,6 +31,17 @@ using IMapperV3 = android::hardware::graphics::mapper::V3_0::IMapper;
 
 HandleImporter::HandleImporter() : mInitialized(false) {}
 
+HandleImporter::~HandleImporter() {
+    {
+        std::lock_guard<std::mutex> lk(mReaperLock);
+        mReaperExit = true;
+    }
+    mReaperCond.notify_one();
+    if (mReaper.joinable()) {
+        mReaper.join();
+    }
+}
+
 void HandleImporter::initializeLocked() {
     if (mInitialized) {
         return;
@@ -146,11 +157,39 @@ bool HandleImporter::importBuffer(buffer_handle_t& handle) {
         return true;
     }
 
+    Mutex::Autolock lock(mLock);
+    if (!mInitialized) {
+        initializeLocked();
+    }
+    return importBufferLocked(handle);
+}
+
+bool HandleImporter::importBuffers(std::vector<buffer_handle_t>& handles) {
+    // The mapper HALs have no batch import, so this saves the per handle locking and
+    // initialization check
     Mutex::Autolock lock(mLock);
     if (!mInitialized) {
         initializeLocked();
     }
 
+    std::vector<buffer_handle_t> imported = handles;
+    for (size_t i = 0; i < imported.size(); i++) {
+        if (!imported[i]->numFds && !imported[i]->numInts) {
+            imported[i] = nullptr;
+            continue;
+        }
+        if (!importBufferLocked(imported[i])) {
+            for (size_t j = 0; j < i; j++) {
+                freeBufferLocked(imported[j]);
+            }
+            return false;
+        }
+    }
+    handles = std::move(imported);
+    return true;
+}
+
+bool HandleImporter::importBufferLocked(buffer_handle_t& handle) {
     if (mMapperV3 != nullptr) {
         return importBufferInternal<IMapperV3, MapperErrorV3>(mMapperV3, handle);
     }
@@ -169,6 +208,15 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
     }
 
     Mutex::Autolock lock(mLock);
+    freeBufferLocked(handle);
+}
+
+void HandleImporter::freeBufferLocked(buffer_handle_t handle) {
+    if (!handle) {
+        return;
+    }
+
+    dropMappingLocked(handle);
     if (mMapperV3 == nullptr && mMapperV2 == nullptr) {
         ALOGE("%s: mMapperV3 and mMapperV2 are both null!", __FUNCTION__);
         return;
@@ -189,6 +237,49 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
     }
 }
 
+void HandleImporter::freeBufferDeferred(buffer_handle_t handle) {
+    if (!handle) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lk(mReaperLock);
+    if (mReaperExit) {
+        lk.unlock();
+        freeBuffer(handle);
+        return;
+    }
+    if (!mReaper.joinable()) {
+        mReaper = std::thread(&HandleImporter::reaperLoop, this);
+    }
+    mPendingFrees.push_back(handle);
+    lk.unlock();
+    mReaperCond.notify_one();
+}
+
+void HandleImporter::reaperLoop() {
+    std::vector<buffer_handle_t> handles;
+    std::unique_lock<std::mutex> lk(mReaperLock);
+    while (true) {
+        mReaperCond.wait(lk, [this] { return mReaperExit || !mPendingFrees.empty(); });
+        handles.swap(mPendingFrees);
+        bool exit = mReaperExit;
+        lk.unlock();
+
+        if (!handles.empty()) {
+            Mutex::Autolock lock(mLock);
+            for (buffer_handle_t handle : handles) {
+                freeBufferLocked(handle);
+            }
+            handles.clear();
+        }
+
+        lk.lock();
+        if (exit && mPendingFrees.empty()) {
+            return;
+        }
+    }
+}
+
 bool HandleImporter::importFence(const native_handle_t* handle, int& fd) const {
     if (handle == nullptr || handle->numFds == 0) {
         fd = -1;
@@ -227,6 +318,17 @@ void* HandleImporter::lock(
         return ret;
     }
 
+    if (mMappingCacheEnabled) {
+        auto it = mCachedMappings.find(buf);
+        if (it != mCachedMappings.end()) {
+            const CachedMapping& mapping = it->second;
+            if (!mapping.isYCbCr && mapping.usage == cpuUsage && mapping.size >= size) {
+                return mapping.ptr;
+            }
+            dropMappingLocked(buf);
+        }
+    }
+
     hidl_handle acquireFenceHandle;
     auto buffer = const_cast<native_handle_t*>(buf);
     if (mMapperV3 != nullptr) {
@@ -257,6 +359,9 @@ void* HandleImporter::lock(
     }
 
     ALOGV("%s: ptr %p size: %zu", __FUNCTION__, ret, size);
+    if (mMappingCacheEnabled && ret != nullptr) {
+        mCachedMappings[buf] = {cpuUsage, /*isYCbCr*/false, {}, ret, size};
+    }
     return ret;
 }
 
@@ -269,21 +374,48 @@ YCbCrLayout HandleImporter::lockYCbCr(
         initializeLocked();
     }
 
-    if (mMapperV3 != nullptr) {
-        return lockYCbCrInternal<IMapperV3, MapperErrorV3>(
-                mMapperV3, buf, cpuUsage, accessRegion);
+    if (mMappingCacheEnabled) {
+        auto it = mCachedMappings.find(buf);
+        if (it != mCachedMappings.end()) {
+            if (it->second.isYCbCr && it->second.usage == cpuUsage) {
+                return it->second.layout;
+            }
+            dropMappingLocked(buf);
+        }
     }
 
-    if (mMapperV2 != nullptr) {
-        return lockYCbCrInternal<IMapper, MapperErrorV2>(
+    YCbCrLayout layout = {};
+    if (mMapperV3 != nullptr) {
+        layout = lockYCbCrInternal<IMapperV3, MapperErrorV3>(
+                mMapperV3, buf, cpuUsage, accessRegion);
+    } else if (mMapperV2 != nullptr) {
+        layout = lockYCbCrInternal<IMapper, MapperErrorV2>(
                 mMapperV2, buf, cpuUsage, accessRegion);
+    } else {
+        ALOGE("%s: mMapperV3 and mMapperV2 are both null!", __FUNCTION__);
+        return {};
     }
 
-    ALOGE("%s: mMapperV3 and mMapperV2 are both null!", __FUNCTION__);
-    return {};
+    if (mMappingCacheEnabled && layout.y != nullptr) {
+        // The cached layout covers the whole buffer only if the lock did
+        if (accessRegion.left == 0 && accessRegion.top == 0) {
+            mCachedMappings[buf] = {cpuUsage, /*isYCbCr*/true, layout, nullptr, 0};
+        }
+    }
+    return layout;
 }
 
 int HandleImporter::unlock(buffer_handle_t& buf) {
+    Mutex::Autolock lock(mLock);
+    if (mMappingCacheEnabled && mCachedMappings.count(buf) != 0) {
+        // Stays locked until freeBuffer or the cache is disabled. CPU writes are done by now
+        // so there's no release fence to wait on.
+        return -1;
+    }
+    return unlockLocked(buf);
+}
+
+int HandleImporter::unlockLocked(buffer_handle_t& buf) {
     if (mMapperV3 != nullptr) {
         return unlockInternal<IMapperV3, MapperErrorV3>(mMapperV3, buf);
     }
@@ -295,6 +427,28 @@ int HandleImporter::unlock(buffer_handle_t& buf) {
     return -1;
 }
 
+void HandleImporter::dropMappingLocked(buffer_handle_t buf) {
+    auto it = mCachedMappings.find(buf);
+    if (it == mCachedMappings.end()) {
+        return;
+    }
+    mCachedMappings.erase(it);
+    int releaseFence = unlockLocked(buf);
+    if (releaseFence >= 0) {
+        close(releaseFence);
+    }
+}
+
+void HandleImporter::setMappingCacheEnabled(bool enabled) {
+    Mutex::Autolock lock(mLock);
+    if (!enabled) {
+        while (!mCachedMappings.empty()) {
+            dropMappingLocked(mCachedMappings.begin()->first);
+        }
+    }
+    mMappingCacheEnabled = enabled;
+}
+
 } // namespace helper
 } // namespace V1_0
 } // namespace common
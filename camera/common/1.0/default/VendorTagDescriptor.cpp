@@ -29,6 +29,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+#include <map>
+
 namespace android {
 namespace hardware {
 namespace camera2 {
@@ -78,6 +81,59 @@ void VendorTagDescriptor::copyFrom(const VendorTagDescriptor& src) {
     mSections = src.mSections;
     mTagCount = src.mTagCount;
     mVendorOps = src.mVendorOps;
+    // The table points into the maps, so it is rebuilt rather than copied.
+    buildTagTable();
+}
+
+void VendorTagDescriptor::buildTagTable() {
+    mTagTable.clear();
+    mTagTableFirstSection = 0;
+    mTagArray.clear();
+
+    size_t size = mTagToNameMap.size();
+    mTagArray.reserve(size);
+    std::map<uint32_t, uint32_t> sectionSizes;
+    for (size_t i = 0; i < size; ++i) {
+        uint32_t tag = mTagToNameMap.keyAt(i);
+        mTagArray.push_back(tag);
+        uint32_t& sectionSize = sectionSizes[tag >> 16];
+        sectionSize = std::max(sectionSize, (tag & 0xFFFF) + 1);
+    }
+    if (sectionSizes.empty()) {
+        return;
+    }
+
+    // Vendor tags are normally numbered from the start of their section, so the table is
+    // dense. Leave it empty if the tags are too scattered for that.
+    uint32_t firstSection = sectionSizes.begin()->first;
+    uint32_t lastSection = sectionSizes.rbegin()->first;
+    size_t tableSize = lastSection - firstSection + 1;
+    for (const auto& sectionSize : sectionSizes) {
+        tableSize += sectionSize.second;
+    }
+    if (tableSize > 4 * size + 256) {
+        ALOGW("%s: %zu vendor tags too sparse for a lookup table", __FUNCTION__, size);
+        return;
+    }
+
+    mTagTableFirstSection = firstSection;
+    mTagTable.resize(lastSection - firstSection + 1);
+    for (const auto& sectionSize : sectionSizes) {
+        mTagTable[sectionSize.first - firstSection].entries.resize(sectionSize.second);
+    }
+    for (size_t i = 0; i < size; ++i) {
+        uint32_t tag = mTagToNameMap.keyAt(i);
+        ssize_t sectionIndex = mTagToSectionMap.indexOfKey(tag);
+        auto type = mTagToTypeMap.find(tag);
+        if (sectionIndex < 0 || type == mTagToTypeMap.end()) {
+            continue;
+        }
+        TagEntry& entry = mTagTable[(tag >> 16) - firstSection].entries[tag & 0xFFFF];
+        entry.name = mTagToNameMap.valueAt(i).string();
+        entry.sectionIndex = mTagToSectionMap.valueAt(sectionIndex);
+        entry.sectionName = mSections[entry.sectionIndex].string();
+        entry.type = type->second;
+    }
 }
 
 int VendorTagDescriptor::getTagCount() const {
@@ -90,12 +146,20 @@ int VendorTagDescriptor::getTagCount() const {
 
 void VendorTagDescriptor::getTagArray(uint32_t* tagArray) const {
     size_t size = mTagToNameMap.size();
+    if (mTagArray.size() == size) {
+        std::copy(mTagArray.begin(), mTagArray.end(), tagArray);
+        return;
+    }
     for (size_t i = 0; i < size; ++i) {
         tagArray[i] = mTagToNameMap.keyAt(i);
     }
 }
 
 const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
+    const TagEntry* entry = findTagEntry(tag);
+    if (entry != nullptr) {
+        return entry->sectionName;
+    }
     ssize_t index = mTagToSectionMap.indexOfKey(tag);
     if (index < 0) {
         return VENDOR_SECTION_NAME_ERR;
@@ -104,10 +168,18 @@ const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
 }
 
 ssize_t VendorTagDescriptor::getSectionIndex(uint32_t tag) const {
+    const TagEntry* entry = findTagEntry(tag);
+    if (entry != nullptr) {
+        return entry->sectionIndex;
+    }
     return mTagToSectionMap.valueFor(tag);
 }
 
 const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
+    const TagEntry* entry = findTagEntry(tag);
+    if (entry != nullptr) {
+        return entry->name;
+    }
     ssize_t index = mTagToNameMap.indexOfKey(tag);
     if (index < 0) {
         return VENDOR_TAG_NAME_ERR;
@@ -116,6 +188,10 @@ const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
 }
 
 int VendorTagDescriptor::getTagType(uint32_t tag) const {
+    const TagEntry* entry = findTagEntry(tag);
+    if (entry != nullptr) {
+        return entry->type;
+    }
     auto iter = mTagToTypeMap.find(tag);
     if (iter == mTagToTypeMap.end()) {
         return VENDOR_TAG_TYPE_ERR;
@@ -368,6 +444,7 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
         desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
     }
 
+    desc->buildTagTable();
     descriptor = desc;
     return OK;
 }
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the vendor tag lookups of a VendorTagDescriptor, and the dump of a CameraMetadata
+// holding 500 vendor tags, which looks up the name, section and type of each of them.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "CameraMetadata.h"
+#include "VendorTagDescriptor.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace V1_0 {
+namespace helper {
+
+namespace {
+
+constexpr uint32_t kSectionCount = 5;
+constexpr uint32_t kTagsPerSection = 100;
+
+struct VendorTags {
+    std::vector<uint32_t> tags;
+    std::vector<std::string> sectionNames;
+    std::vector<std::string> tagNames;
+};
+
+const VendorTags& vendorTags() {
+    static VendorTags* vendorTags = [] {
+        auto* v = new VendorTags();
+        for (uint32_t s = 0; s < kSectionCount; ++s) {
+            v->sectionNames.push_back("com.vendor.section" + std::to_string(s));
+            for (uint32_t t = 0; t < kTagsPerSection; ++t) {
+                v->tags.push_back(((VENDOR_SECTION + s) << 16) | t);
+                v->tagNames.push_back("tag" + std::to_string(t));
+            }
+        }
+        return v;
+    }();
+    return *vendorTags;
+}
+
+size_t tagIndex(uint32_t tag) {
+    return ((tag >> 16) - VENDOR_SECTION) * kTagsPerSection + (tag & 0xFFFF);
+}
+
+int getTagCount(const vendor_tag_ops_t*) {
+    return vendorTags().tags.size();
+}
+
+void getAllTags(const vendor_tag_ops_t*, uint32_t* tagArray) {
+    std::copy(vendorTags().tags.begin(), vendorTags().tags.end(), tagArray);
+}
+
+const char* getSectionName(const vendor_tag_ops_t*, uint32_t tag) {
+    return vendorTags().sectionNames[(tag >> 16) - VENDOR_SECTION].c_str();
+}
+
+const char* getTagName(const vendor_tag_ops_t*, uint32_t tag) {
+    return vendorTags().tagNames[tagIndex(tag)].c_str();
+}
+
+int getTagType(const vendor_tag_ops_t*, uint32_t) {
+    return TYPE_INT32;
+}
+
+sp<VendorTagDescriptor> createDescriptor() {
+    vendor_tag_ops_t ops = {};
+    ops.get_tag_count = getTagCount;
+    ops.get_all_tags = getAllTags;
+    ops.get_section_name = getSectionName;
+    ops.get_tag_name = getTagName;
+    ops.get_tag_type = getTagType;
+    sp<VendorTagDescriptor> desc;
+    VendorTagDescriptor::createDescriptorFromOps(&ops, desc);
+    return desc;
+}
+
+void BM_VendorTagLookup(benchmark::State& state) {
+    sp<VendorTagDescriptor> desc = createDescriptor();
+    const std::vector<uint32_t>& tags = vendorTags().tags;
+    for (auto _ : state) {
+        for (uint32_t tag : tags) {
+            benchmark::DoNotOptimize(desc->getSectionName(tag));
+            benchmark::DoNotOptimize(desc->getTagName(tag));
+            benchmark::DoNotOptimize(desc->getTagType(tag));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * tags.size());
+}
+BENCHMARK(BM_VendorTagLookup);
+
+void BM_VendorTagArray(benchmark::State& state) {
+    sp<VendorTagDescriptor> desc = createDescriptor();
+    std::vector<uint32_t> tagArray(desc->getTagCount());
+    for (auto _ : state) {
+        desc->getTagArray(tagArray.data());
+        benchmark::DoNotOptimize(tagArray.data());
+    }
+}
+BENCHMARK(BM_VendorTagArray);
+
+void BM_CameraMetadataDump(benchmark::State& state) {
+    sp<VendorTagDescriptor> desc = createDescriptor();
+    VendorTagDescriptor::setAsGlobalVendorTagDescriptor(desc);
+    CameraMetadata metadata;
+    int32_t value = 0;
+    for (uint32_t tag : vendorTags().tags) {
+        metadata.update(tag, &value, 1);
+        value++;
+    }
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    for (auto _ : state) {
+        metadata.dump(fd, 1);
+    }
+    close(fd);
+    VendorTagDescriptor::clearGlobalVendorTagDescriptor();
+}
+BENCHMARK(BM_CameraMetadataDump);
+
+}  // namespace
+
+}  // namespace helper
+}  // namespace V1_0
+}  // namespace common
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -110,6 +110,28 @@ class CameraMetadata {
      */
     status_t append(const camera_metadata* other);
 
+    /**
+     * Apply a delta, as computed by diff(): update or add every entry of changed, and erase
+     * every tag of removed. Unlike repeated update() and erase() calls, this takes one pass
+     * and at most one reallocation. changed may be NULL.
+     */
+    status_t merge(const camera_metadata_t* changed, const Vector<uint32_t>& removed);
+
+    /**
+     * Compute the delta from one metadata buffer to another: the entries of to that are
+     * missing from from or that differ from it go into changed, and the tags of from missing
+     * from to go into removed. Merging the delta into a copy of from gives the entries of to.
+     * Either buffer may be NULL.
+     */
+    static status_t diff(const camera_metadata_t* from, const camera_metadata_t* to,
+            CameraMetadata* changed /*out*/, Vector<uint32_t>* removed /*out*/);
+
+    /**
+     * Whether two metadata buffers hold the same entries, in any order. Cheaper than diff(),
+     * since nothing is copied.
+     */
+    static bool equals(const camera_metadata_t* a, const camera_metadata_t* b);
+
     /**
      * Number of metadata entries.
      */
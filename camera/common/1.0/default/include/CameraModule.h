@@ -82,6 +82,10 @@ private:
     // Helper function to append available[request|result|chars]Keys
     static void appendAvailableKeys(CameraMetadata &chars,
             int32_t keyTag, const Vector<int32_t>& appendKeys);
+    // Release the metadata of m sorted and without unused capacity, for caching. Cached
+    // metadata is handed out as is (convertToHidl doesn't copy), so its size is what every
+    // getCameraCharacteristics call transfers and sorting lets find() binary search.
+    static camera_metadata_t* releaseCompacted(CameraMetadata& m);
     status_t filterOpenErrorCode(status_t err);
     camera_module_t *mModule;
     int mNumberOfCameras;
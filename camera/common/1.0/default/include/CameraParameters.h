@@ -696,7 +696,13 @@ public:
     static int previewFormatToEnum(const char* format);
 
 private:
+    // Update only the changed values when params has the same keys, in the same order,
+    // as mLastUnflattened. Returns false if the map needs to be rebuilt.
+    bool unflattenChangedValues(const String8 &params);
+
     DefaultKeyedVector<String8,String8>    mMap;
+    // Last string passed to unflatten(). Cleared once mMap is modified any other way.
+    String8                                mLastUnflattened;
 };
 
 };
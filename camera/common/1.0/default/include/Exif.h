@@ -54,6 +54,12 @@ class ExifUtils {
     // cleared.
     virtual bool initialize() = 0;
 
+    // In template mode the APP1 segment of the last generateApp1() call is kept. When the
+    // next image sets the same tags, with the same sizes, generateApp1() only patches the
+    // tag values and the thumbnail into that segment instead of serializing all IFDs again.
+    // Useful when the same ExifUtils is reused for a burst of captures.
+    virtual void setTemplateEnabled(bool enabled) = 0;
+
     // Set all known fields from a metadata structure
     virtual bool setFromMetadata(const CameraMetadata& metadata,
                                  const size_t imageWidth,
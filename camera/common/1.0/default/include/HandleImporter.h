@@ -17,6 +17,11 @@
 #ifndef CAMERA_COMMON_1_0_HANDLEIMPORTED_H
 #define CAMERA_COMMON_1_0_HANDLEIMPORTED_H
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <utils/Mutex.h>
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
 #include <android/hardware/graphics/mapper/3.0/IMapper.h>
@@ -36,12 +41,19 @@ namespace helper {
 class HandleImporter {
 public:
     HandleImporter();
+    ~HandleImporter();
 
     // In IComposer, any buffer_handle_t is owned by the caller and we need to
     // make a clone for hwcomposer2.  We also need to translate empty handle
     // to nullptr.  This function does that, in-place.
     bool importBuffer(buffer_handle_t& handle);
+    // Same as importBuffer for every handle, holding the mapper lock once. On failure all
+    // handles are left as they were and none stays imported.
+    bool importBuffers(std::vector<buffer_handle_t>& handles);
     void freeBuffer(buffer_handle_t handle);
+    // Queue handle to be freed on a background thread, for callers that must not wait on
+    // the mapper. The handle must not be used afterwards.
+    void freeBufferDeferred(buffer_handle_t handle);
     bool importFence(const native_handle_t* handle, int& fd) const;
     void closeFence(int fd) const;
 
@@ -54,6 +66,13 @@ public:
 
     int unlock(buffer_handle_t& buf); // returns release fence
 
+    // When enabled, unlock() keeps the CPU mapping of a buffer and the next lock or
+    // lockYCbCr of it with the same usage returns that mapping without a mapper call.
+    // Mappings are dropped by freeBuffer or when the cache is disabled.
+    // Mapper 2.0/3.0 only do CPU cache maintenance in unlock, so this must only be enabled
+    // when CPU mapped gralloc buffers are coherent with their consumers.
+    void setMappingCacheEnabled(bool enabled);
+
 private:
     void initializeLocked();
     void cleanup();
@@ -66,10 +85,33 @@ private:
     template<class M, class E>
     int unlockInternal(const sp<M> mapper, buffer_handle_t& buf);
 
+    bool importBufferLocked(buffer_handle_t& handle);
+    void freeBufferLocked(buffer_handle_t handle);
+    int unlockLocked(buffer_handle_t& buf);
+    // Unlock and forget the cached mapping of buf, if there's one
+    void dropMappingLocked(buffer_handle_t buf);
+    void reaperLoop();
+
     Mutex mLock;
     bool mInitialized;
     sp<IMapper> mMapperV2;
     sp<graphics::mapper::V3_0::IMapper> mMapperV3;
+
+    struct CachedMapping {
+        uint64_t usage;
+        bool isYCbCr;
+        YCbCrLayout layout; // if isYCbCr
+        void* ptr;          // otherwise
+        size_t size;        // bytes mapped at ptr
+    };
+    bool mMappingCacheEnabled = false;
+    std::unordered_map<buffer_handle_t, CachedMapping> mCachedMappings; // protected by mLock
+
+    std::mutex mReaperLock; // protecting members below
+    std::condition_variable mReaperCond;
+    std::vector<buffer_handle_t> mPendingFrees;
+    bool mReaperExit = false;
+    std::thread mReaper; // started by the first freeBufferDeferred call
 };
 
 } // namespace helper
@@ -25,6 +25,7 @@
 
 #include <stdint.h>
 #include <unordered_map>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -92,6 +93,36 @@ class VendorTagDescriptor {
         void dump(int fd, int verbosity, int indentation) const;
 
     protected:
+        // Rebuilds mTagTable from the maps below.
+        void buildTagTable();
+
+        // Entry of a tag in mTagTable. The strings point into mTagToNameMap and mSections.
+        struct TagEntry {
+            const char* name = nullptr;
+            const char* sectionName = nullptr;
+            uint32_t sectionIndex = 0;
+            int32_t type = -1;
+        };
+        // Entries of the tags of the vendor section (tag >> 16), indexed by tag & 0xFFFF.
+        struct TagSection {
+            std::vector<TagEntry> entries;
+        };
+
+        // Returns the entry of a tag, or nullptr if the tag is not in mTagTable.
+        const TagEntry* findTagEntry(uint32_t tag) const {
+            uint32_t section = tag >> 16;
+            if (section < mTagTableFirstSection ||
+                section - mTagTableFirstSection >= mTagTable.size()) {
+                return nullptr;
+            }
+            const TagSection& tagSection = mTagTable[section - mTagTableFirstSection];
+            uint32_t offset = tag & 0xFFFF;
+            if (offset >= tagSection.entries.size() || tagSection.entries[offset].name == nullptr) {
+                return nullptr;
+            }
+            return &tagSection.entries[offset];
+        }
+
         KeyedVector<String8, KeyedVector<String8, uint32_t>*> mReverseMapping;
         KeyedVector<uint32_t, String8> mTagToNameMap;
         KeyedVector<uint32_t, uint32_t> mTagToSectionMap; // Value is offset in mSections
@@ -101,6 +132,13 @@ class VendorTagDescriptor {
         // must be int32_t to be compatible with Parcel::writeInt32
         int32_t mTagCount;
 
+        // Flat lookup table of the tags, indexed by (tag >> 16) - mTagTableFirstSection. Tags
+        // that would make it too sparse are left out and found through the maps above.
+        std::vector<TagSection> mTagTable;
+        uint32_t mTagTableFirstSection = 0;
+        // Tags of mTagToNameMap, in the same order, for getTagArray.
+        std::vector<uint32_t> mTagArray;
+
         vendor_tag_ops mVendorOps;
 };
 } /* namespace params */
@@ -368,8 +368,21 @@ camera_memory_t* CameraDevice::sGetMemory(int fd, size_t buf_size, uint_t num_bu
     }
 
     CameraHeapMemory* mem;
+    if (fd < 0) {
+        Mutex::Autolock _l(object->mMemoryMapLock);
+        for (auto it = object->mCachedHeaps.begin(); it != object->mCachedHeaps.end(); it++) {
+            mem = *it;
+            if (mem->mBufSize == buf_size && mem->mNumBufs == num_bufs) {
+                object->mCachedHeaps.erase(it);
+                object->mMemoryMap[mem->handle.mId] = mem;
+                return &mem->handle;
+            }
+        }
+    }
+
     if (fd < 0) {
         mem = new CameraHeapMemory(object->mAshmemAllocator, buf_size, num_bufs);
+        mem->mFromAllocator = true;
     } else {
         mem = new CameraHeapMemory(fd, buf_size, num_bufs);
     }
@@ -401,6 +414,23 @@ void CameraDevice::sPutMemory(camera_memory_t *data) {
     if (device->mDeviceCallback == nullptr) {
         ALOGE("%s: camera HAL return memory while camera is not opened!", __FUNCTION__);
     }
+    if (mem->mFromAllocator && mem->mHidlHeapMemory != nullptr) {
+        CameraHeapMemory* evicted = nullptr;
+        {
+            Mutex::Autolock _l(device->mMemoryMapLock);
+            device->mMemoryMap.erase(mem->handle.mId);
+            device->mCachedHeaps.push_back(mem);
+            if (device->mCachedHeaps.size() > kMaxCachedHeaps) {
+                evicted = device->mCachedHeaps.front();
+                device->mCachedHeaps.erase(device->mCachedHeaps.begin());
+            }
+        }
+        if (evicted != nullptr) {
+            device->mDeviceCallback->unregisterMemory(evicted->handle.mId);
+            evicted->decStrong(evicted);
+        }
+        return;
+    }
     device->mDeviceCallback->unregisterMemory(mem->handle.mId);
     {
         Mutex::Autolock _l(device->mMemoryMapLock);
@@ -409,6 +439,20 @@ void CameraDevice::sPutMemory(camera_memory_t *data) {
     mem->decStrong(mem);
 }
 
+void CameraDevice::releaseCachedHeaps() {
+    std::vector<CameraHeapMemory*> heaps;
+    {
+        Mutex::Autolock _l(mMemoryMapLock);
+        heaps.swap(mCachedHeaps);
+    }
+    for (auto mem : heaps) {
+        if (mDeviceCallback != nullptr) {
+            mDeviceCallback->unregisterMemory(mem->handle.mId);
+        }
+        mem->decStrong(mem);
+    }
+}
+
 // Callback forwarding methods
 void CameraDevice::sNotifyCb(int32_t msg_type, int32_t ext1, int32_t ext2, void *user) {
     ALOGV("%s", __FUNCTION__);
@@ -1011,6 +1055,8 @@ void CameraDevice::closeLocked() {
             ALOGE("Could not close camera %s: %d", mCameraId.c_str(), rc);
         }
         mDevice = nullptr;
+        // HAL has returned all its memory by now
+        releaseCachedHeaps();
     }
 }
 
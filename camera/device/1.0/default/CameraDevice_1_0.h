@@ -18,6 +18,7 @@
 #define ANDROID_HARDWARE_CAMERA_DEVICE_V1_0_CAMERADEVICE_H
 
 #include <unordered_map>
+#include <vector>
 #include "utils/Mutex.h"
 #include "utils/SortedVector.h"
 #include "CameraModule.h"
@@ -130,6 +131,7 @@ private:
         sp<IMemory>      mHidlHeapMemory; // munmap happens in ~IMemory()
 
         CameraMemory handle;
+        bool mFromAllocator = false; // allocated by sGetMemory rather than wrapping a HAL fd
     };
     sp<IAllocator> mAshmemAllocator;
 
@@ -168,6 +170,13 @@ private:
     mutable Mutex mMemoryMapLock; // gating access to mMemoryMap
                                   // must not hold mLock after this lock is acquired
     std::unordered_map<MemoryId, CameraHeapMemory*> mMemoryMap;
+    // Heaps allocated by sGetMemory and returned by HAL, oldest first. They stay registered to
+    // the client so HALs requesting a new heap for every preview callback reuse one of the
+    // same size instead of allocating, mapping and registering it again.
+    // Also gated by mMemoryMapLock.
+    static const size_t kMaxCachedHeaps = 4;
+    std::vector<CameraHeapMemory*> mCachedHeaps;
+    void releaseCachedHeaps();
 
     bool mMetadataMode = false;
 
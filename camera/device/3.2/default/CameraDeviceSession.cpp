@@ -43,6 +43,18 @@ static constexpr int32_t CAMERA_RESULT_METADATA_QUEUE_SIZE  = 1 << 20 /* 1MB */;
 static constexpr int METADATA_SHRINK_ABS_THRESHOLD = 4096;
 static constexpr int METADATA_SHRINK_REL_THRESHOLD = 2;
 
+// Whether the settings fire an AE precapture or AF trigger.
+static bool hasActiveTrigger(const camera_metadata_t* settings) {
+    camera_metadata_ro_entry_t entry;
+    if (find_camera_metadata_ro_entry(settings, ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER, &entry) ==
+                OK && entry.count > 0 &&
+            entry.data.u8[0] != ANDROID_CONTROL_AE_PRECAPTURE_TRIGGER_IDLE) {
+        return true;
+    }
+    return find_camera_metadata_ro_entry(settings, ANDROID_CONTROL_AF_TRIGGER, &entry) == OK &&
+            entry.count > 0 && entry.data.u8[0] != ANDROID_CONTROL_AF_TRIGGER_IDLE;
+}
+
 HandleImporter CameraDeviceSession::sHandleImporter;
 buffer_handle_t CameraDeviceSession::sEmptyBuffer = nullptr;
 
@@ -282,8 +294,14 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
         }
     }
 
-    Mutex::Autolock _l(mInflightLock);
-    CirculatingBuffers& cbs = mCirculatingBuffers[streamId];
+    RWLock::AutoRLock _rl(mBufferCacheLock);
+    auto shardIt = mCirculatingBuffers.find(streamId);
+    if (shardIt == mCirculatingBuffers.end()) {
+        ALOGE("%s: stream %d is not configured!", __FUNCTION__, streamId);
+        return Status::ILLEGAL_ARGUMENT;
+    }
+    Mutex::Autolock _l(shardIt->second.mLock);
+    CirculatingBuffers& cbs = shardIt->second.mBuffers;
     if (cbs.count(bufId) == 0) {
         // Register a newly seen buffer
         buffer_handle_t importedBuf = buf;
@@ -299,6 +317,68 @@ Status CameraDeviceSession::importBuffer(int32_t streamId,
     return Status::OK;
 }
 
+Status CameraDeviceSession::importBuffers(const std::vector<int32_t>& streamIds,
+        const hidl_vec<uint64_t>& bufIds, const hidl_vec<buffer_handle_t>& bufs,
+        const std::vector<bool>& allowEmptyBufs,
+        /*out*/hidl_vec<buffer_handle_t*>& outBufPtrs) {
+    RWLock::AutoRLock _rl(mBufferCacheLock);
+
+    // Find the buffers that are not cached yet
+    std::vector<size_t> newBufIdxs;
+    std::vector<buffer_handle_t> newBufs;
+    for (size_t i = 0; i < bufs.size(); i++) {
+        if (bufs[i] == nullptr && bufIds[i] == BUFFER_ID_NO_BUFFER) {
+            if (allowEmptyBufs[i]) {
+                outBufPtrs[i] = &sEmptyBuffer;
+                continue;
+            }
+            ALOGE("%s: bufferId %" PRIu64 " has null buffer handle!", __FUNCTION__, bufIds[i]);
+            return Status::ILLEGAL_ARGUMENT;
+        }
+
+        auto shardIt = mCirculatingBuffers.find(streamIds[i]);
+        if (shardIt == mCirculatingBuffers.end()) {
+            ALOGE("%s: stream %d is not configured!", __FUNCTION__, streamIds[i]);
+            return Status::ILLEGAL_ARGUMENT;
+        }
+        Mutex::Autolock _l(shardIt->second.mLock);
+        CirculatingBuffers& cbs = shardIt->second.mBuffers;
+        auto it = cbs.find(bufIds[i]);
+        if (it != cbs.end()) {
+            outBufPtrs[i] = &it->second;
+        } else {
+            newBufIdxs.push_back(i);
+            newBufs.push_back(bufs[i]);
+        }
+    }
+    if (newBufs.empty()) {
+        return Status::OK;
+    }
+
+    if (!sHandleImporter.importBuffers(newBufs)) {
+        ALOGE("%s: importing %zu new buffers failed!", __FUNCTION__, newBufs.size());
+        return Status::INTERNAL_ERROR;
+    }
+    Status status = Status::OK;
+    for (size_t n = 0; n < newBufIdxs.size(); n++) {
+        size_t i = newBufIdxs[n];
+        if (newBufs[n] == nullptr) {
+            ALOGE("%s: output buffer for stream %d is invalid!", __FUNCTION__, streamIds[i]);
+            status = Status::INTERNAL_ERROR;
+            continue;
+        }
+        auto& shard = mCirculatingBuffers.at(streamIds[i]);
+        Mutex::Autolock _l(shard.mLock);
+        auto inserted = shard.mBuffers.emplace(bufIds[i], newBufs[n]);
+        if (!inserted.second) {
+            // Cached by another thread (or earlier in this request) in the meantime
+            sHandleImporter.freeBufferDeferred(newBufs[n]);
+        }
+        outBufPtrs[i] = &inserted.first->second;
+    }
+    return status;
+}
+
 Status CameraDeviceSession::importRequest(
         const CaptureRequest& request,
         hidl_vec<buffer_handle_t*>& allBufPtrs,
@@ -337,16 +417,15 @@ Status CameraDeviceSession::importRequestImpl(
         streamIds[numOutputBufs] = request.inputBuffer.streamId;
     }
 
-    for (size_t i = 0; i < numBufs; i++) {
-        Status st = importBuffer(
-                streamIds[i], allBufIds[i], allBufs[i], &allBufPtrs[i],
-                // Disallow empty buf for input stream, otherwise follow
-                // the allowEmptyBuf argument.
-                (hasInputBuf && i == numOutputBufs) ? false : allowEmptyBuf);
-        if (st != Status::OK) {
-            // Detailed error logs printed in importBuffer
-            return st;
-        }
+    // Disallow empty buf for input stream, otherwise follow the allowEmptyBuf argument.
+    std::vector<bool> allowEmptyBufs(numBufs, allowEmptyBuf);
+    if (hasInputBuf) {
+        allowEmptyBufs[numOutputBufs] = false;
+    }
+    Status st = importBuffers(streamIds, allBufIds, allBufs, allowEmptyBufs, allBufPtrs);
+    if (st != Status::OK) {
+        // Detailed error logs printed in importBuffers
+        return st;
     }
 
     // All buffers are imported. Now validate output buffer acquire fences
@@ -617,6 +696,7 @@ void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
 
     std::vector<CaptureResult> results;
     std::vector<uint32_t> toBeRemovedIdxes;
+    results.reserve(batch->mBatchSize * lastPartialResultIdx);
     for (auto& pair : batch->mResultMds) {
         uint32_t partialIdx = pair.first;
         if (partialIdx > lastPartialResultIdx) {
@@ -624,7 +704,8 @@ void CameraDeviceSession::ResultBatcher::sendBatchMetadataLocked(
         }
         toBeRemovedIdxes.push_back(partialIdx);
         InflightBatch::MetadataBatch& mb = pair.second;
-        for (const auto& p : mb.mMds) {
+        // Not const so the queued metadata is moved into the result instead of copied
+        for (auto& p : mb.mMds) {
             CaptureResult result;
             result.frameNumber = p.first;
             result.result = std::move(p.second);
@@ -923,7 +1004,7 @@ bool CameraDeviceSession::preProcessConfigurationLocked(
             mStreamMap[id] = stream;
             mStreamMap[id].data_space = mapToLegacyDataspace(
                     mStreamMap[id].data_space);
-            mCirculatingBuffers.emplace(stream.mId, CirculatingBuffers{});
+            addStreamBuffersLocked(stream.mId);
         } else {
             // width/height/format must not change, but usage/rotation might need to change
             if (mStreamMap[id].stream_type !=
@@ -1018,7 +1099,7 @@ void CameraDeviceSession::postProcessConfigurationFailureLocked(
                 }
             }
             if (!found) {
-                mCirculatingBuffers.emplace(id, CirculatingBuffers{});
+                addStreamBuffersLocked(id);
             }
         }
     }
@@ -1033,6 +1114,7 @@ Return<void> CameraDeviceSession::configureStreams(
     // hold the inflight lock for entire configureStreams scope since there must not be any
     // inflight request/results during stream configuration.
     Mutex::Autolock _l(mInflightLock);
+    RWLock::AutoWLock _bl(mBufferCacheLock);
     if (!mInflightBuffers.empty()) {
         ALOGE("%s: trying to configureStreams while there are still %zu inflight buffers!",
                 __FUNCTION__, mInflightBuffers.size());
@@ -1093,27 +1175,36 @@ Return<void> CameraDeviceSession::configureStreams(
     return Void();
 }
 
-// Needs to get called after acquiring 'mInflightLock'
+// Needs to get called after acquiring 'mInflightLock' and 'mBufferCacheLock' for writing
 void CameraDeviceSession::cleanupBuffersLocked(int id) {
-    for (auto& pair : mCirculatingBuffers.at(id)) {
-        sHandleImporter.freeBuffer(pair.second);
+    for (auto& pair : mCirculatingBuffers.at(id).mBuffers) {
+        sHandleImporter.freeBufferDeferred(pair.second);
     }
-    mCirculatingBuffers[id].clear();
     mCirculatingBuffers.erase(id);
 }
 
+void CameraDeviceSession::addStreamBuffersLocked(int id) {
+    // Default constructs the shard in place if the stream has none yet
+    mCirculatingBuffers[id];
+}
+
 void CameraDeviceSession::updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove) {
-    Mutex::Autolock _l(mInflightLock);
+    if (cachesToRemove.size() == 0) {
+        return;
+    }
+    RWLock::AutoRLock _rl(mBufferCacheLock);
     for (auto& cache : cachesToRemove) {
         auto cbsIt = mCirculatingBuffers.find(cache.streamId);
         if (cbsIt == mCirculatingBuffers.end()) {
             // The stream could have been removed
             continue;
         }
-        CirculatingBuffers& cbs = cbsIt->second;
+        Mutex::Autolock _l(cbsIt->second.mLock);
+        CirculatingBuffers& cbs = cbsIt->second.mBuffers;
         auto it = cbs.find(cache.bufferId);
         if (it != cbs.end()) {
-            sHandleImporter.freeBuffer(it->second);
+            // Freed in the background so processCaptureRequest doesn't wait on the mapper
+            sHandleImporter.freeBufferDeferred(it->second);
             cbs.erase(it);
         } else {
             ALOGE("%s: stream %d buffer %" PRIu64 " is not cached",
@@ -1195,6 +1286,18 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         return Status::ILLEGAL_ARGUMENT;
     }
 
+    // NULL settings tell the HAL to reuse the ones it has, which saves it from parsing the
+    // same settings again. Triggers must still reach it, since they act once per request.
+    if (!mFirstRequest && halRequest.settings != nullptr &&
+            !hasActiveTrigger(halRequest.settings)) {
+        const camera_metadata_t* lastSettings = mLastHalSettings.getAndLock();
+        if (::android::hardware::camera::common::V1_0::helper::CameraMetadata::equals(
+                lastSettings, halRequest.settings)) {
+            halRequest.settings = nullptr;
+        }
+        mLastHalSettings.unlock(lastSettings);
+    }
+
     hidl_vec<buffer_handle_t*> allBufPtrs;
     hidl_vec<int> allFences;
     bool hasInputBuf = (request.inputBuffer.streamId != -1 &&
@@ -1279,6 +1382,9 @@ Status CameraDeviceSession::processOneCaptureRequest(const CaptureRequest& reque
         return Status::INTERNAL_ERROR;
     }
 
+    if (halRequest.settings != nullptr) {
+        mLastHalSettings = halRequest.settings;
+    }
     mFirstRequest = false;
     return Status::OK;
 }
@@ -1323,8 +1429,9 @@ Return<void> CameraDeviceSession::close()  {
 
         // free all imported buffers
         Mutex::Autolock _l(mInflightLock);
+        RWLock::AutoWLock _bl(mBufferCacheLock);
         for(auto& pair : mCirculatingBuffers) {
-            CirculatingBuffers& buffers = pair.second;
+            CirculatingBuffers& buffers = pair.second.mBuffers;
             for (auto& p2 : buffers) {
                 sHandleImporter.freeBuffer(p2.second);
             }
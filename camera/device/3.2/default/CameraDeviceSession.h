@@ -31,6 +31,7 @@
 #include "hardware/camera3.h"
 #include "hardware/camera_common.h"
 #include "utils/Mutex.h"
+#include "utils/RWLock.h"
 
 namespace android {
 namespace hardware {
@@ -151,7 +152,7 @@ protected:
     // Stream ID -> Camera3Stream cache
     std::map<int, Camera3Stream> mStreamMap;
 
-    mutable Mutex mInflightLock; // protecting mInflightBuffers and mCirculatingBuffers
+    mutable Mutex mInflightLock; // protecting mInflightBuffers and the inflight overrides
     // (streamID, frameNumber) -> inflight buffer cache
     std::map<std::pair<int, uint32_t>, camera3_stream_buffer_t>  mInflightBuffers;
 
@@ -168,14 +169,25 @@ protected:
     // Buffer will be imported during process_capture_request and will be freed
     // when the its stream is deleted or camera device session is closed
     typedef std::unordered_map<uint64_t, buffer_handle_t> CirculatingBuffers;
+    // Circulating buffers of one stream. Streams are locked separately so importing buffers
+    // of one stream doesn't serialize with other streams or with the result path.
+    struct CirculatingBufferShard {
+        Mutex mLock; // protecting mBuffers
+        CirculatingBuffers mBuffers;
+    };
+    // Held for reading to access a shard, and for writing to add or remove streams.
+    // Acquired after mInflightLock when both are needed.
+    mutable RWLock mBufferCacheLock;
     // Stream ID -> circulating buffers map
-    std::map<int, CirculatingBuffers> mCirculatingBuffers;
+    std::map<int, CirculatingBufferShard> mCirculatingBuffers;
 
     static HandleImporter sHandleImporter;
     static buffer_handle_t sEmptyBuffer;
 
     bool mInitFail;
     bool mFirstRequest = false;
+    // The last non-NULL settings passed to the HAL, to pass NULL instead of the same again.
+    common::V1_0::helper::CameraMetadata mLastHalSettings;
 
     common::V1_0::helper::CameraMetadata mDeviceInfo;
 
@@ -320,10 +332,19 @@ protected:
             /*out*/buffer_handle_t** outBufPtr,
             bool allowEmptyBuf);
 
+    // importBuffer for all buffers of a request; buffers not cached yet are imported with a
+    // single HandleImporter call. allowEmptyBufs[i] applies to bufs[i].
+    Status importBuffers(const std::vector<int32_t>& streamIds,
+            const hidl_vec<uint64_t>& bufIds, const hidl_vec<buffer_handle_t>& bufs,
+            const std::vector<bool>& allowEmptyBufs,
+            /*out*/hidl_vec<buffer_handle_t*>& outBufPtrs);
+
     static void cleanupInflightFences(
             hidl_vec<int>& allFences, size_t numFences);
 
+    // Both need mBufferCacheLock held for writing
     void cleanupBuffersLocked(int id);
+    void addStreamBuffersLocked(int id);
 
     void updateBufferCaches(const hidl_vec<BufferCache>& cachesToRemove);
 
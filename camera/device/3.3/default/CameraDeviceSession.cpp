@@ -49,6 +49,7 @@ Return<void> CameraDeviceSession::configureStreams_3_3(
     // hold the inflight lock for entire configureStreams scope since there must not be any
     // inflight request/results during stream configuration.
     Mutex::Autolock _l(mInflightLock);
+    RWLock::AutoWLock _bl(mBufferCacheLock);
     if (!mInflightBuffers.empty()) {
         ALOGE("%s: trying to configureStreams while there are still %zu inflight buffers!",
                 __FUNCTION__, mInflightBuffers.size());
@@ -94,6 +94,7 @@ void CameraDeviceSession::configureStreams_3_4_Impl(
     // hold the inflight lock for entire configureStreams scope since there must not be any
     // inflight request/results during stream configuration.
     Mutex::Autolock _l(mInflightLock);
+    RWLock::AutoWLock _bl(mBufferCacheLock);
     if (!mInflightBuffers.empty()) {
         ALOGE("%s: trying to configureStreams while there are still %zu inflight buffers!",
                 __FUNCTION__, mInflightBuffers.size());
@@ -188,7 +189,7 @@ bool CameraDeviceSession::preProcessConfigurationLocked_3_4(
             mPhysicalCameraIdMap[id] = requestedConfiguration.streams[i].physicalCameraId;
             mStreamMap[id].data_space = mapToLegacyDataspace(
                     mStreamMap[id].data_space);
-            mCirculatingBuffers.emplace(stream.mId, CirculatingBuffers{});
+            addStreamBuffersLocked(stream.mId);
         } else {
             // width/height/format must not change, but usage/rotation might need to change.
             // format and data_space may change.
@@ -299,7 +300,7 @@ void CameraDeviceSession::postProcessConfigurationFailureLocked_3_4(
                 }
             }
             if (!found) {
-                mCirculatingBuffers.emplace(id, CirculatingBuffers{});
+                addStreamBuffersLocked(id);
             }
         }
     }
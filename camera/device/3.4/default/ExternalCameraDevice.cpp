@@ -20,6 +20,9 @@
 
 #include <algorithm>
 #include <array>
+#include <ctype.h>
+#include <mutex>
+#include <unordered_map>
 #include <linux/videodev2.h>
 #include "android-base/macros.h"
 #include "CameraMetadata.h"
@@ -34,12 +37,106 @@ namespace V3_4 {
 namespace implementation {
 
 namespace {
-// Only support MJPEG for now as it seems to be the one supports higher fps
+// MJPEG seems to be the one supports higher fps. YUYV and NV12 are supported too, as they
+// can be written to YUV outputs of the native size without an intermediate frame.
 // Other formats to consider in the future:
 // * V4L2_PIX_FMT_YVU420 (== YV12)
 // * V4L2_PIX_FMT_YVYU (YVYU: can be converted to YV12 or other YUV420_888 formats)
-const std::array<uint32_t, /*size*/ 2> kSupportedFourCCs{
-    {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_Z16}};  // double braces required in C++11
+const std::array<uint32_t, /*size*/ 4> kSupportedFourCCs{
+    {V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_Z16,
+     V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12}};  // double braces required in C++11
+
+bool isColorFourcc(uint32_t fourcc) {
+    return fourcc == V4L2_PIX_FMT_MJPEG || fourcc == V4L2_PIX_FMT_YUYV ||
+            fourcc == V4L2_PIX_FMT_NV12;
+}
+
+double getMaxFps(const SupportedV4L2Format& format) {
+    double maxFps = 0.0;
+    for (const auto& fr : format.frameRates) {
+        maxFps = std::max(maxFps, fr.getDouble());
+    }
+    return maxFps;
+}
+
+// Supported formats of already probed devices, see getProbeCacheKey
+struct ProbeResult {
+    std::vector<SupportedV4L2Format> formats;
+    CroppingType croppingType;
+};
+std::mutex gProbeCacheLock;
+std::unordered_map<std::string, ProbeResult> gProbeCache;
+
+bool readSysfsAttr(const std::string& path, std::string* out) {
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp == nullptr) {
+        return false;
+    }
+    char buf[64];
+    bool ok = fgets(buf, sizeof(buf), fp) != nullptr;
+    fclose(fp);
+    if (ok) {
+        *out = buf;
+        while (!out->empty() && isspace(out->back())) {
+            out->pop_back();
+        }
+    }
+    return ok && !out->empty();
+}
+
+// Identify a V4L2 node by USB VID/PID, firmware revision (bcdDevice), interface and node
+// index so a re-plugged camera maps to the same key regardless of its /dev/video number.
+// Returns an empty string for non-USB devices, which are then always probed.
+std::string getProbeCacheKey(const std::string& devPath) {
+    size_t pos = devPath.rfind('/');
+    std::string node = (pos == std::string::npos) ? devPath : devPath.substr(pos + 1);
+    std::string sysPath = "/sys/class/video4linux/" + node;
+    std::string vid, pid, rev, intf, index;
+    if (!readSysfsAttr(sysPath + "/device/../idVendor", &vid) ||
+            !readSysfsAttr(sysPath + "/device/../idProduct", &pid) ||
+            !readSysfsAttr(sysPath + "/device/../bcdDevice", &rev) ||
+            !readSysfsAttr(sysPath + "/device/bInterfaceNumber", &intf) ||
+            !readSysfsAttr(sysPath + "/index", &index)) {
+        return std::string();
+    }
+    return vid + ":" + pid + ":" + rev + ":" + intf + ":" + index;
+}
+
+// A size offered in several color formats only needs one of them. Prefer raw YUV over MJPEG
+// unless MJPEG is faster, since raw frames need no decode.
+void pruneDuplicateColorFormats(/*inout*/std::vector<SupportedV4L2Format>* pFmts) {
+    std::vector<SupportedV4L2Format>& fmts = *pFmts;
+    std::vector<bool> removed(fmts.size(), false);
+    for (size_t i = 0; i < fmts.size(); i++) {
+        if (removed[i] || !isColorFourcc(fmts[i].fourcc)) {
+            continue;
+        }
+        for (size_t j = i + 1; j < fmts.size(); j++) {
+            if (removed[j] || !isColorFourcc(fmts[j].fourcc) ||
+                    fmts[i].width != fmts[j].width || fmts[i].height != fmts[j].height) {
+                continue;
+            }
+            bool iIsMjpeg = fmts[i].fourcc == V4L2_PIX_FMT_MJPEG;
+            bool jIsMjpeg = fmts[j].fourcc == V4L2_PIX_FMT_MJPEG;
+            double iFps = getMaxFps(fmts[i]);
+            double jFps = getMaxFps(fmts[j]);
+            bool keepI = (iFps != jFps) ? (iFps > jFps) : (!iIsMjpeg || jIsMjpeg);
+            if (keepI) {
+                removed[j] = true;
+            } else {
+                removed[i] = true;
+                break;
+            }
+        }
+    }
+    std::vector<SupportedV4L2Format> out;
+    for (size_t i = 0; i < fmts.size(); i++) {
+        if (!removed[i]) {
+            out.push_back(fmts[i]);
+        }
+    }
+    fmts = out;
+}
 
 constexpr int MAX_RETRY = 5; // Allow retry v4l2 open failures a few times.
 constexpr int OPEN_RETRY_SLEEP_US = 100000; // 100ms * MAX_RETRY = 0.5 seconds
@@ -263,7 +360,9 @@ status_t ExternalCameraDevice::initAvailableCapabilities(
     for (const auto& fmt : mSupportedFormats) {
         switch (fmt.fourcc) {
             case V4L2_PIX_FMT_Z16: hasDepth = true; break;
-            case V4L2_PIX_FMT_MJPEG: hasColor = true; break;
+            case V4L2_PIX_FMT_MJPEG:
+            case V4L2_PIX_FMT_YUYV:
+            case V4L2_PIX_FMT_NV12: hasColor = true; break;
             default: ALOGW("%s: Unsupported format found", __FUNCTION__);
         }
     }
@@ -591,7 +690,8 @@ status_t ExternalCameraDevice::initOutputCharskeysByFormat(
     std::vector<int64_t> stallDurations;
 
     for (const auto& supportedFormat : mSupportedFormats) {
-        if (supportedFormat.fourcc != fourcc) {
+        if (supportedFormat.fourcc != fourcc &&
+                !(isColorFourcc(fourcc) && isColorFourcc(supportedFormat.fourcc))) {
             // Skip 4CCs not meant for the halFormats
             continue;
         }
@@ -689,7 +789,7 @@ status_t ExternalCameraDevice::initOutputCharsKeys(
 
     // For V4L2_PIX_FMT_Z16
     std::array<int, /*size*/ 1> halDepthFormats{{HAL_PIXEL_FORMAT_Y16}};
-    // For V4L2_PIX_FMT_MJPEG
+    // For V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_YUYV and V4L2_PIX_FMT_NV12
     std::array<int, /*size*/ 3> halFormats{{HAL_PIXEL_FORMAT_BLOB, HAL_PIXEL_FORMAT_YCbCr_420_888,
                                             HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED}};
 
@@ -699,6 +799,8 @@ status_t ExternalCameraDevice::initOutputCharsKeys(
                 hasDepth = true;
                 break;
             case V4L2_PIX_FMT_MJPEG:
+            case V4L2_PIX_FMT_YUYV:
+            case V4L2_PIX_FMT_NV12:
                 hasColor = true;
                 break;
             default:
@@ -908,6 +1010,7 @@ std::vector<SupportedV4L2Format> ExternalCameraDevice::getCandidateSupportedForm
         }
         fmtdesc.index++;
     }
+    pruneDuplicateColorFormats(&outFmts);
     trimSupportedFormats(cropType, &outFmts);
     return outFmts;
 }
@@ -941,6 +1044,27 @@ void ExternalCameraDevice::updateFpsBounds(
 }
 
 void ExternalCameraDevice::initSupportedFormatsLocked(int fd) {
+    std::string probeKey = getProbeCacheKey(mCameraId);
+    if (!probeKey.empty()) {
+        std::lock_guard<std::mutex> lk(gProbeCacheLock);
+        auto it = gProbeCache.find(probeKey);
+        if (it != gProbeCache.end()) {
+            ALOGV("%s: %s (%s) already probed", __FUNCTION__, mCameraId.c_str(), probeKey.c_str());
+            mSupportedFormats = it->second.formats;
+            mCroppingType = it->second.croppingType;
+            return;
+        }
+    }
+
+    probeSupportedFormatsLocked(fd);
+
+    if (!probeKey.empty() && !mSupportedFormats.empty()) {
+        std::lock_guard<std::mutex> lk(gProbeCacheLock);
+        gProbeCache[probeKey] = {mSupportedFormats, mCroppingType};
+    }
+}
+
+void ExternalCameraDevice::probeSupportedFormatsLocked(int fd) {
     std::vector<SupportedV4L2Format> horizontalFmts = getCandidateSupportedFormatsLocked(
         fd, HORIZONTAL, mCfg.fpsLimits, mCfg.depthFpsLimits, mCfg.minStreamSize, mCfg.depthEnabled);
     std::vector<SupportedV4L2Format> verticalFmts = getCandidateSupportedFormatsLocked(
@@ -19,6 +19,7 @@
 #include <log/log.h>
 
 #include <inttypes.h>
+#include <algorithm>
 #include "ExternalCameraDeviceSession.h"
 
 #include "android-base/macros.h"
@@ -148,6 +149,13 @@ bool ExternalCameraDeviceSession::initialize() {
         return true;
     }
     mOutputThread->setExifMakeModel(make, model);
+    mOutputThread->setPipelineDepth(mCfg.outputPipelineDepth);
+    mOutputThread->setMjpegDecoder(MjpegDecoder::create(mCfg));
+    mOutputThread->setFramePoolSize(mCfg.framePoolMaxIdleBytes);
+    mOutputThread->setScaleFilter(mCfg.scaleFilter);
+    mOutputThread->setJpegEncodeThreads(mCfg.jpegEncodeThreads);
+    mOutputThread->setOutputThreads(mCfg.outputThreads);
+    sHandleImporter.setMappingCacheEnabled(mCfg.cacheBufferMappings);
 
     status_t status = initDefaultRequests();
     if (status != OK) {
@@ -280,12 +288,22 @@ void ExternalCameraDeviceSession::dumpState(const native_handle_t* handle) {
                 mV4l2StreamingFps);
 
         size_t numDequeuedV4l2Buffers = 0;
+        uint64_t numStalls = 0;
+        nsecs_t stallNs = 0;
+        nsecs_t avgHoldNs = 0;
         {
             std::lock_guard<std::mutex> lk(mV4l2BufferLock);
             numDequeuedV4l2Buffers = mNumDequeuedV4l2Buffers;
+            numStalls = mNumV4l2BufferStalls;
+            stallNs = mV4l2BufferStallNs;
+            avgHoldNs = mAvgV4l2BufferHoldNs;
         }
-        dprintf(fd, "V4L2 buffer queue size %zu, dequeued %zu\n",
-                v4L2BufferCount, numDequeuedV4l2Buffers);
+        dprintf(fd, "V4L2 buffer queue size %zu%s, dequeued %zu\n",
+                v4L2BufferCount, mCfg.adaptiveV4l2Buffers ? " (adaptive)" : "",
+                numDequeuedV4l2Buffers);
+        dprintf(fd, "V4L2 buffer stalls %" PRIu64 ", total stall %" PRId64 "ms,"
+                " avg buffer hold %" PRId64 "us\n",
+                numStalls, stallNs / 1000000, avgHoldNs / 1000);
     }
 
     dprintf(fd, "In-flight frames (not sorted):");
@@ -736,7 +754,9 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
     }
 
     nsecs_t shutterTs = 0;
+    nsecs_t dequeueStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
     sp<V4L2Frame> frameIn = dequeueV4l2FrameLocked(&shutterTs);
+    mOutputThread->recordLatency(OutputThread::LATENCY_V4L2_DEQUEUE, dequeueStartTs);
     if ( frameIn == nullptr) {
         ALOGE("%s: V4L2 deque frame failed!", __FUNCTION__);
         return Status::INTERNAL_ERROR;
@@ -744,7 +764,7 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
 
     std::shared_ptr<HalRequest> halReq = std::make_shared<HalRequest>();
     halReq->frameNumber = request.frameNumber;
-    halReq->setting = mLatestReqSetting;
+    initCaptureResultLocked(&halReq->setting);
     halReq->frameIn = frameIn;
     halReq->shutterTs = shutterTs;
     halReq->buffers.resize(numOutputBufs);
@@ -766,27 +786,46 @@ Status ExternalCameraDeviceSession::processOneCaptureRequest(const CaptureReques
         mInflightFrames.insert(halReq->frameNumber);
     }
     // Send request to OutputThread for the rest of processing
-    mOutputThread->submitRequest(halReq);
+    if (mOutputThread->submitRequest(halReq) != Status::OK) {
+        // Nothing was sent to the client for this request yet, so fail the call instead of
+        // returning the error results from this binder thread
+        {
+            std::lock_guard<std::mutex> lk(mInflightFramesLock);
+            mInflightFrames.erase(halReq->frameNumber);
+        }
+        cleanupInflightFences(allFences, numOutputBufs);
+        enqueueV4l2Frame(frameIn);
+        return Status::INTERNAL_ERROR;
+    }
     mFirstRequest = false;
     return Status::OK;
 }
 
-void ExternalCameraDeviceSession::notifyShutter(uint32_t frameNumber, nsecs_t shutterTs) {
+NotifyMsg ExternalCameraDeviceSession::makeShutterMsg(uint32_t frameNumber, nsecs_t shutterTs) {
     NotifyMsg msg;
     msg.type = MsgType::SHUTTER;
     msg.msg.shutter.frameNumber = frameNumber;
     msg.msg.shutter.timestamp = shutterTs;
-    mCallback->notify({msg});
+    return msg;
 }
 
-void ExternalCameraDeviceSession::notifyError(
+NotifyMsg ExternalCameraDeviceSession::makeErrorMsg(
         uint32_t frameNumber, int32_t streamId, ErrorCode ec) {
     NotifyMsg msg;
     msg.type = MsgType::ERROR;
     msg.msg.error.frameNumber = frameNumber;
     msg.msg.error.errorStreamId = streamId;
     msg.msg.error.errorCode = ec;
-    mCallback->notify({msg});
+    return msg;
+}
+
+void ExternalCameraDeviceSession::notifyShutter(uint32_t frameNumber, nsecs_t shutterTs) {
+    mCallback->notify({makeShutterMsg(frameNumber, shutterTs)});
+}
+
+void ExternalCameraDeviceSession::notifyError(
+        uint32_t frameNumber, int32_t streamId, ErrorCode ec) {
+    mCallback->notify({makeErrorMsg(frameNumber, streamId, ec)});
 }
 
 //TODO: refactor with processCaptureResult
@@ -796,6 +835,12 @@ Status ExternalCameraDeviceSession::processCaptureRequestError(
     // Return V4L2 buffer to V4L2 buffer queue
     enqueueV4l2Frame(req->frameIn);
 
+    // Results must be sent in order
+    if (mCfg.resultBatchSize > 1) {
+        std::lock_guard<std::mutex> lk(mResultBatchLock);
+        sendResultBatchLocked();
+    }
+
     // NotifyShutter
     notifyShutter(req->frameNumber, req->shutterTs);
 
@@ -837,8 +882,9 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     // Return V4L2 buffer to V4L2 buffer queue
     enqueueV4l2Frame(req->frameIn);
 
-    // NotifyShutter
-    notifyShutter(req->frameNumber, req->shutterTs);
+    // NotifyShutter, and ERROR_BUFFER for the buffers that timed out
+    std::vector<NotifyMsg> msgs;
+    msgs.push_back(makeShutterMsg(req->frameNumber, req->shutterTs));
 
     // Fill output buffers
     hidl_vec<CaptureResult> results;
@@ -858,7 +904,8 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
                 handle->data[0] = req->buffers[i].acquireFence;
                 result.outputBuffers[i].releaseFence.setTo(handle, /*shouldOwn*/false);
             }
-            notifyError(req->frameNumber, req->buffers[i].streamId, ErrorCode::ERROR_BUFFER);
+            msgs.push_back(makeErrorMsg(
+                    req->frameNumber, req->buffers[i].streamId, ErrorCode::ERROR_BUFFER));
         } else {
             result.outputBuffers[i].status = BufferStatus::OK;
             // TODO: refactor
@@ -873,21 +920,59 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     // Fill capture result metadata
     fillCaptureResult(req->setting, req->shutterTs);
     const camera_metadata_t *rawResult = req->setting.getAndLock();
+    if (rawResult != nullptr) {
+        mResultEntryCount.store(get_camera_metadata_entry_count(rawResult),
+                std::memory_order_relaxed);
+        mResultDataCount.store(get_camera_metadata_data_count(rawResult),
+                std::memory_order_relaxed);
+    }
     V3_2::implementation::convertToHidl(rawResult, &result.result);
     req->setting.unlock(rawResult);
 
     // update inflight records
+    bool inflightEmpty;
     {
         std::lock_guard<std::mutex> lk(mInflightFramesLock);
         mInflightFrames.erase(req->frameNumber);
+        inflightEmpty = mInflightFrames.empty();
+    }
+
+    if (mCfg.resultBatchSize > 1) {
+        std::lock_guard<std::mutex> lk(mResultBatchLock);
+        mBatchedNotifies.insert(mBatchedNotifies.end(), msgs.begin(), msgs.end());
+        mBatchedResults.push_back(std::move(result));
+        if (mBatchedResults.size() >= mCfg.resultBatchSize || inflightEmpty) {
+            sendResultBatchLocked();
+        }
+        return Status::OK;
     }
 
     // Callback into framework
+    mCallback->notify(msgs);
     invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
     freeReleaseFences(results);
     return Status::OK;
 }
 
+void ExternalCameraDeviceSession::sendResultBatchLocked() {
+    if (mBatchedResults.empty()) {
+        return;
+    }
+    ATRACE_INT("ExtCamResultBatch", static_cast<int32_t>(mBatchedResults.size()));
+    mCallback->notify(mBatchedNotifies);
+    mBatchedNotifies.clear();
+
+    hidl_vec<CaptureResult> results;
+    results.resize(mBatchedResults.size());
+    for (size_t i = 0; i < mBatchedResults.size(); i++) {
+        results[i] = std::move(mBatchedResults[i]);
+    }
+    mBatchedResults.clear();
+
+    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */true);
+    freeReleaseFences(results);
+}
+
 void ExternalCameraDeviceSession::invokeProcessCaptureResultCallback(
         hidl_vec<CaptureResult> &results, bool tryWriteFmq) {
     if (mProcessCaptureResultLock.tryLock() != OK) {
@@ -945,9 +1030,23 @@ void ExternalCameraDeviceSession::freeReleaseFences(hidl_vec<CaptureResult>& res
 
 ExternalCameraDeviceSession::OutputThread::OutputThread(
         wp<ExternalCameraDeviceSession> parent,
-        CroppingType ct) : mParent(parent), mCroppingType(ct) {}
+        CroppingType ct) : mParent(parent), mCroppingType(ct) {
+    static const char* kStageNames[NUM_LATENCY_STAGES] = {
+        "v4l2_dequeue", "decode", "crop_and_scale", "format_convert", "create_jpeg",
+        "capture_result"};
+    for (int i = 0; i < NUM_LATENCY_STAGES; i++) {
+        mLatencyHistograms[i] = mMetrics.histogram(kStageNames[i]);
+    }
+}
 
-ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
+ExternalCameraDeviceSession::OutputThread::~OutputThread() {
+    for (auto& stage : mPipelineStages) {
+        if (stage != nullptr) {
+            stage->requestExitAndWait();
+            stage.clear();
+        }
+    }
+}
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
         const std::string& make, const std::string& model) {
@@ -955,6 +1054,54 @@ void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(
     mExifModel = model;
 }
 
+void ExternalCameraDeviceSession::OutputThread::setPipelineDepth(uint32_t depth) {
+    mPipelineDepth = depth;
+    if (mPipelineDepth == 0) {
+        return;
+    }
+
+    const char* names[NUM_PIPELINE_STAGES] = {"ExtCamYuvOut", "ExtCamJpegOut"};
+    for (int i = 0; i < NUM_PIPELINE_STAGES; i++) {
+        mPipelineStages[i] = new PipelineStage(
+                this, static_cast<PipelineStageId>(i), mPipelineDepth);
+        mPipelineStages[i]->run(names[i], PRIORITY_DISPLAY);
+    }
+}
+
+void ExternalCameraDeviceSession::OutputThread::setMjpegDecoder(
+        std::unique_ptr<MjpegDecoder> decoder) {
+    mMjpegDecoder = std::move(decoder);
+}
+
+void ExternalCameraDeviceSession::OutputThread::setFramePoolSize(size_t maxIdleBytes) {
+    mFramePool = std::make_unique<AllocatedFramePool>(maxIdleBytes);
+}
+
+void ExternalCameraDeviceSession::OutputThread::setScaleFilter(
+        ExternalCameraConfig::ScaleFilter filter) {
+    mScaleFilter = filter;
+}
+
+nsecs_t ExternalCameraDeviceSession::OutputThread::recordLatency(
+        LatencyStage stage, nsecs_t startTs) {
+    static const char* kCounterNames[NUM_LATENCY_STAGES] = {
+        "ExtCamDequeueUs", "ExtCamDecodeUs", "ExtCamCropScaleUs",
+        "ExtCamFormatConvertUs", "ExtCamCreateJpegUs", "ExtCamCaptureResultUs"};
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mLatencyHistograms[stage]->record(std::chrono::nanoseconds(now - startTs));
+    ATRACE_INT(kCounterNames[stage], static_cast<int32_t>((now - startTs) / 1000));
+    return now;
+}
+
+void ExternalCameraDeviceSession::OutputThread::requestExit() {
+    Thread::requestExit();
+    for (auto& stage : mPipelineStages) {
+        if (stage != nullptr) {
+            stage->requestExit();
+        }
+    }
+}
+
 uint32_t ExternalCameraDeviceSession::OutputThread::getFourCcFromLayout(
         const YCbCrLayout& layout) {
     intptr_t cb = reinterpret_cast<intptr_t>(layout.cb);
@@ -1039,6 +1186,13 @@ int ExternalCameraDeviceSession::OutputThread::getCropRect(
 
 int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         sp<AllocatedFrame>& in, const Size& outSz, YCbCrLayout* out) {
+    return cropAndScaleLocked(in, outSz, mIntermediateBuffers, mScaledYu12Frames, out);
+}
+
+int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
+        sp<AllocatedFrame>& in, const Size& outSz,
+        AllocatedFrameMap& intermediateBuffers, AllocatedFrameMap& scaledFrames,
+        YCbCrLayout* out) {
     Size inSz = {in->mWidth, in->mHeight};
 
     int ret;
@@ -1075,13 +1229,13 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return 0;
     }
 
-    auto it = mScaledYu12Frames.find(outSz);
+    auto it = scaledFrames.find(outSz);
     sp<AllocatedFrame> scaledYu12Buf;
-    if (it != mScaledYu12Frames.end()) {
+    if (it != scaledFrames.end()) {
         scaledYu12Buf = it->second;
     } else {
-        it = mIntermediateBuffers.find(outSz);
-        if (it == mIntermediateBuffers.end()) {
+        it = intermediateBuffers.find(outSz);
+        if (it == intermediateBuffers.end()) {
             ALOGE("%s: failed to find intermediate buffer size %dx%d",
                     __FUNCTION__, outSz.width, outSz.height);
             return -1;
@@ -1096,25 +1250,9 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return ret;
     }
 
-    ret = libyuv::I420Scale(
-            static_cast<uint8_t*>(croppedLayout.y),
-            croppedLayout.yStride,
-            static_cast<uint8_t*>(croppedLayout.cb),
-            croppedLayout.cStride,
-            static_cast<uint8_t*>(croppedLayout.cr),
-            croppedLayout.cStride,
-            inputCrop.width,
-            inputCrop.height,
-            static_cast<uint8_t*>(outLayout.y),
-            outLayout.yStride,
-            static_cast<uint8_t*>(outLayout.cb),
-            outLayout.cStride,
-            static_cast<uint8_t*>(outLayout.cr),
-            outLayout.cStride,
-            outSz.width,
-            outSz.height,
-            // TODO: b/72261744 see if we can use better filter without losing too much perf
-            libyuv::FilterMode::kFilterNone);
+    ret = scaleYu12(croppedLayout,
+            Size {static_cast<uint32_t>(inputCrop.width), static_cast<uint32_t>(inputCrop.height)},
+            outLayout, outSz);
 
     if (ret != 0) {
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d",
@@ -1124,7 +1262,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
     }
 
     *out = outLayout;
-    mScaledYu12Frames.insert({outSz, scaledYu12Buf});
+    scaledFrames.insert({outSz, scaledYu12Buf});
     return 0;
 }
 
@@ -1244,24 +1382,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
     }
 
 
-    ret = libyuv::I420Scale(
-            static_cast<uint8_t*>(inputLayout.y),
-            inputLayout.yStride,
-            static_cast<uint8_t*>(inputLayout.cb),
-            inputLayout.cStride,
-            static_cast<uint8_t*>(inputLayout.cr),
-            inputLayout.cStride,
-            inputCrop.width,
-            inputCrop.height,
-            static_cast<uint8_t*>(outFullLayout.y),
-            outFullLayout.yStride,
-            static_cast<uint8_t*>(outFullLayout.cb),
-            outFullLayout.cStride,
-            static_cast<uint8_t*>(outFullLayout.cr),
-            outFullLayout.cStride,
-            outSz.width,
-            outSz.height,
-            libyuv::FilterMode::kFilterNone);
+    ret = scaleYu12(inputLayout, cropSz, outFullLayout, outSz);
 
     if (ret != 0) {
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d",
@@ -1274,6 +1395,25 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
     return 0;
 }
 
+int ExternalCameraDeviceSession::OutputThread::scaleYu12(
+        const YCbCrLayout& in, const Size& inSz, const YCbCrLayout& out, const Size& outSz) {
+    // in is already offset to the crop rect, so only the cropped region is read.
+    // libyuv picks NEON/SSE row kernels for the running CPU.
+    static_assert(ExternalCameraConfig::SCALE_FILTER_BOX ==
+            static_cast<int>(libyuv::FilterMode::kFilterBox), "Scale filter mismatch");
+    ATRACE_NAME("scaleYu12");
+    return libyuv::I420Scale(
+            static_cast<uint8_t*>(in.y), in.yStride,
+            static_cast<uint8_t*>(in.cb), in.cStride,
+            static_cast<uint8_t*>(in.cr), in.cStride,
+            inSz.width, inSz.height,
+            static_cast<uint8_t*>(out.y), out.yStride,
+            static_cast<uint8_t*>(out.cb), out.cStride,
+            static_cast<uint8_t*>(out.cr), out.cStride,
+            outSz.width, outSz.height,
+            static_cast<libyuv::FilterMode>(mScaleFilter));
+}
+
 int ExternalCameraDeviceSession::OutputThread::formatConvertLocked(
         const YCbCrLayout& in, const YCbCrLayout& out, Size sz, uint32_t format) {
     int ret = 0;
@@ -1356,10 +1496,110 @@ int ExternalCameraDeviceSession::OutputThread::formatConvertLocked(
     return 0;
 }
 
+bool ExternalCameraDeviceSession::OutputThread::isRawYuvFourcc(uint32_t fourcc) {
+    return fourcc == V4L2_PIX_FMT_YUYV || fourcc == V4L2_PIX_FMT_NV12;
+}
+
+int ExternalCameraDeviceSession::OutputThread::convertRawYuv(
+        uint32_t inFourcc, const uint8_t* inData, size_t inDataSize,
+        const YCbCrLayout& out, Size sz, uint32_t outFourcc) {
+    // UVC devices deliver tightly packed lines
+    const size_t expectedSize = (inFourcc == V4L2_PIX_FMT_YUYV) ?
+            sz.width * sz.height * 2 : sz.width * sz.height * 3 / 2;
+    if (inDataSize < expectedSize) {
+        ALOGE("%s: V4L2 frame size %zu is smaller than expected %zu for %dx%d",
+                __FUNCTION__, inDataSize, expectedSize, sz.width, sz.height);
+        return -1;
+    }
+
+    uint8_t* outY = static_cast<uint8_t*>(out.y);
+    uint8_t* outCb = static_cast<uint8_t*>(out.cb);
+    uint8_t* outCr = static_cast<uint8_t*>(out.cr);
+    if (inFourcc == V4L2_PIX_FMT_YUYV) {
+        switch (outFourcc) {
+            case V4L2_PIX_FMT_YVU420: // YV12
+            case V4L2_PIX_FMT_YUV420: // YU12
+                return libyuv::YUY2ToI420(inData, sz.width * 2,
+                        outY, out.yStride, outCb, out.cStride, outCr, out.cStride,
+                        sz.width, sz.height);
+            case V4L2_PIX_FMT_NV12:
+                return libyuv::YUY2ToNV12(inData, sz.width * 2,
+                        outY, out.yStride, outCb, out.cStride,
+                        sz.width, sz.height);
+            default:
+                return -EINVAL;
+        }
+    }
+
+    const uint8_t* inUv = inData + sz.width * sz.height;
+    switch (outFourcc) {
+        case V4L2_PIX_FMT_YVU420: // YV12
+        case V4L2_PIX_FMT_YUV420: // YU12
+            return libyuv::NV12ToI420(inData, sz.width, inUv, sz.width,
+                    outY, out.yStride, outCb, out.cStride, outCr, out.cStride,
+                    sz.width, sz.height);
+        case V4L2_PIX_FMT_NV12:
+            // Same layout as the V4L2 frame: plain copy, no intermediate
+            libyuv::CopyPlane(inData, sz.width, outY, out.yStride, sz.width, sz.height);
+            libyuv::CopyPlane(inUv, sz.width, outCb, out.cStride, sz.width, sz.height / 2);
+            return 0;
+        default:
+            return -EINVAL;
+    }
+}
+
+bool ExternalCameraDeviceSession::OutputThread::needsYu12Frame(
+        const std::shared_ptr<HalRequest>& req) {
+    if (!isRawYuvFourcc(req->frameIn->mFourcc)) {
+        return true;
+    }
+    for (const auto& halBuf : req->buffers) {
+        switch (halBuf.format) {
+            case PixelFormat::YCBCR_420_888:
+            case PixelFormat::YV12:
+                if (halBuf.width != req->frameIn->mWidth ||
+                        halBuf.height != req->frameIn->mHeight) {
+                    return true;
+                }
+                break;
+            case PixelFormat::Y16:
+                break;
+            default: // BLOB
+                return true;
+        }
+    }
+    return false;
+}
+
+int ExternalCameraDeviceSession::OutputThread::fillYu12FrameLocked(
+        const std::shared_ptr<HalRequest>& req) {
+    if (req->yu12FrameFilled) {
+        return 0;
+    }
+    uint8_t* inData;
+    size_t inDataSize;
+    if (req->frameIn->map(&inData, &inDataSize) != 0) {
+        ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+        return -1;
+    }
+    YCbCrLayout yu12Layout;
+    req->yu12Frame->getLayout(&yu12Layout);
+    ATRACE_BEGIN("RawYuvToI420");
+    int ret = convertRawYuv(req->frameIn->mFourcc, inData, inDataSize, yu12Layout,
+            Size {req->yu12Frame->mWidth, req->yu12Frame->mHeight}, V4L2_PIX_FMT_YUV420);
+    ATRACE_END();
+    if (ret != 0) {
+        ALOGE("%s: convert V4L2 frame to YU12 failed! ret %d", __FUNCTION__, ret);
+        return ret;
+    }
+    req->yu12FrameFilled = true;
+    return 0;
+}
+
 int ExternalCameraDeviceSession::OutputThread::encodeJpegYU12(
         const Size & inSz, const YCbCrLayout& inLayout,
         int jpegQuality, const void *app1Buffer, size_t app1Size,
-        void *out, const size_t maxOutSize, size_t &actualCodeSize)
+        void *out, const size_t maxOutSize, size_t &actualCodeSize, bool restartPerMcuRow)
 {
     /* libjpeg is a C library so we use C-style "inheritance" by
      * putting libjpeg's jpeg_destination_mgr first in our custom
@@ -1444,6 +1684,9 @@ int ExternalCameraDeviceSession::OutputThread::encodeJpegYU12(
     jpeg_set_colorspace(&cinfo, JCS_YCbCr);
     cinfo.raw_data_in = 1;
     cinfo.dct_method = JDCT_IFAST;
+    if (restartPerMcuRow) {
+        cinfo.restart_in_rows = 1;
+    }
 
     /* Configure sampling factors. The sampling factor is JPEG subsampling 420
      * because the source format is YUV420. Note that libjpeg sampling factors
@@ -1614,6 +1857,132 @@ ssize_t ExternalCameraDeviceSession::getJpegBufferSize(
     return jpegBufferSize;
 }
 
+int ExternalCameraDeviceSession::OutputThread::encodeJpegYU12Parallel(
+        const Size & inSz, const YCbCrLayout& inLayout,
+        int jpegQuality, const void *app1Buffer, size_t app1Size,
+        void *out, const size_t maxOutSize, size_t &actualCodeSize, uint32_t numThreads)
+{
+    // YUV420 MCUs are 16x16
+    const uint32_t kMcuSize = 2 * DCTSIZE;
+    const uint32_t mcuRows = (inSz.height + kMcuSize - 1) / kMcuSize;
+    const uint32_t numStrips = std::min(numThreads, mcuRows);
+    if (numStrips < 2) {
+        return encodeJpegYU12(inSz, inLayout, jpegQuality, app1Buffer, app1Size,
+                out, maxOutSize, actualCodeSize);
+    }
+
+    // Every strip is a standalone JPEG with the same tables and restart interval. Only the
+    // first one carries APP1.
+    struct Strip {
+        uint32_t firstMcuRow;
+        std::vector<uint8_t> code;
+        size_t codeSize = 0;
+        int ret = -1;
+    };
+    std::vector<Strip> strips(numStrips);
+    auto encodeStrip = [&](uint32_t k) {
+        ATRACE_NAME("encodeJpegStrip");
+        Strip& strip = strips[k];
+        strip.firstMcuRow = k * mcuRows / numStrips;
+        uint32_t rowStart = strip.firstMcuRow * kMcuSize;
+        uint32_t rowEnd = std::min((k + 1) * mcuRows / numStrips * kMcuSize, inSz.height);
+        Size stripSz {inSz.width, rowEnd - rowStart};
+
+        YCbCrLayout stripLayout = inLayout;
+        stripLayout.y = static_cast<uint8_t*>(inLayout.y) + rowStart * inLayout.yStride;
+        stripLayout.cb = static_cast<uint8_t*>(inLayout.cb) + rowStart / 2 * inLayout.cStride;
+        stripLayout.cr = static_cast<uint8_t*>(inLayout.cr) + rowStart / 2 * inLayout.cStride;
+
+        const void* app1 = (k == 0) ? app1Buffer : nullptr;
+        size_t stripApp1Size = (k == 0) ? app1Size : 0;
+        // Raw size covers even a poorly compressed strip; add room for headers
+        strip.code.resize(stripSz.width * stripSz.height * 2 + stripApp1Size + 4096);
+        strip.ret = encodeJpegYU12(stripSz, stripLayout, jpegQuality, app1, stripApp1Size,
+                strip.code.data(), strip.code.size(), strip.codeSize,
+                /*restartPerMcuRow*/true);
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t k = 1; k < numStrips; k++) {
+        workers.emplace_back(encodeStrip, k);
+    }
+    encodeStrip(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Stitch: strip 0 headers with the full image height, then the entropy coded data of
+    // all strips with restart markers renumbered in image order.
+    ATRACE_BEGIN("stitchJpegStrips");
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    size_t dstSize = 0;
+    uint32_t rstIdx = 0;
+    auto append = [&](const uint8_t* src, size_t size) {
+        if (dstSize + size > maxOutSize) {
+            return false;
+        }
+        memcpy(dst + dstSize, src, size);
+        dstSize += size;
+        return true;
+    };
+    auto appendRst = [&]() {
+        uint8_t marker[2] = {0xFF, static_cast<uint8_t>(0xD0 + (rstIdx++ & 0x7))};
+        return append(marker, sizeof(marker));
+    };
+
+    bool ok = true;
+    for (uint32_t k = 0; k < numStrips && ok; k++) {
+        const Strip& strip = strips[k];
+        ParallelMjpegDecoder::ScanInfo scan;
+        if (strip.ret != 0 ||
+                !ParallelMjpegDecoder::parseScan(strip.code.data(), strip.codeSize, &scan)) {
+            ALOGE("%s: encoding strip %u failed (ret %d)", __FUNCTION__, k, strip.ret);
+            ok = false;
+            break;
+        }
+        const uint8_t* code = strip.code.data();
+        if (k == 0) {
+            ok = append(code, scan.sosEnd);
+            if (ok) {
+                // SOF height field
+                dst[scan.sofOffset + 5] = (inSz.height >> 8) & 0xFF;
+                dst[scan.sofOffset + 6] = inSz.height & 0xFF;
+            }
+        } else {
+            ok = appendRst();
+        }
+        size_t start = scan.sosEnd;
+        for (size_t rst : scan.rstOffsets) {
+            ok = ok && append(code + start, rst - start) && appendRst();
+            start = rst + 2;
+        }
+        ok = ok && append(code + start, scan.eoiOffset - start);
+    }
+    const uint8_t eoi[2] = {0xFF, 0xD9};
+    ok = ok && append(eoi, sizeof(eoi));
+    ATRACE_END();
+
+    if (!ok) {
+        ALOGW("%s: stitching %u strips failed, encoding on one thread", __FUNCTION__, numStrips);
+        return encodeJpegYU12(inSz, inLayout, jpegQuality, app1Buffer, app1Size,
+                out, maxOutSize, actualCodeSize);
+    }
+    actualCodeSize = dstSize;
+    return 0;
+}
+
+void ExternalCameraDeviceSession::OutputThread::setJpegEncodeThreads(uint32_t numThreads) {
+    mJpegEncodeThreads = std::max(numThreads, 1u);
+}
+
+void ExternalCameraDeviceSession::OutputThread::setOutputThreads(uint32_t numThreads) {
+    if (numThreads > 1) {
+        mOutputFanOut = std::make_unique<TaskFanOut>(numThreads);
+    } else {
+        mOutputFanOut.reset();
+    }
+}
+
 int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         HalStreamBuffer &halBuf,
         const std::shared_ptr<HalRequest>& req)
@@ -1639,7 +2008,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
           halBuf.bufPtr);
     ALOGV("%s: YV12 buffer %d x %d",
           __FUNCTION__,
-          mYu12Frame->mWidth, mYu12Frame->mHeight);
+          req->yu12Frame->mWidth, req->yu12Frame->mHeight);
 
     int jpegQuality, thumbQuality;
     Size thumbSize;
@@ -1704,7 +2073,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
 
     YCbCrLayout yu12Thumb;
     if (outputThumbnail) {
-        ret = cropAndScaleThumbLocked(mYu12Frame, thumbSize, &yu12Thumb);
+        ret = cropAndScaleThumbLocked(req->yu12Frame, thumbSize, &yu12Thumb);
 
         if (ret != 0) {
             return lfail(
@@ -1713,7 +2082,12 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Scale and crop main jpeg */
-    ret = cropAndScaleLocked(mYu12Frame, jpegSize, &yu12Main);
+    if (mPipelineDepth > 0) {
+        ret = cropAndScaleLocked(req->yu12Frame, jpegSize,
+                mJpegIntermediateBuffers, mJpegScaledYu12Frames, &yu12Main);
+    } else {
+        ret = cropAndScaleLocked(req->yu12Frame, jpegSize, &yu12Main);
+    }
 
     if (ret != 0) {
         return lfail("%s: crop and scale main failed!", __FUNCTION__);
@@ -1736,7 +2110,11 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     meta.append(req->setting);
 
     /* Generate EXIF object */
-    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    if (mExifUtils == nullptr) {
+        mExifUtils.reset(ExifUtils::create());
+        mExifUtils->setTemplateEnabled(true);
+    }
+    ExifUtils* utils = mExifUtils.get();
     /* Make sure it's initialized */
     utils->initialize();
 
@@ -1763,9 +2141,16 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     }
 
     /* Encode the main jpeg image */
-    ret = encodeJpegYU12(jpegSize, yu12Main,
-            jpegQuality, exifData, exifDataSize,
-            bufPtr, maxJpegCodeSize, jpegCodeSize);
+    if (mJpegEncodeThreads > 1 &&
+            jpegSize.width * jpegSize.height >= kParallelJpegMinPixels) {
+        ret = encodeJpegYU12Parallel(jpegSize, yu12Main,
+                jpegQuality, exifData, exifDataSize,
+                bufPtr, maxJpegCodeSize, jpegCodeSize, mJpegEncodeThreads);
+    } else {
+        ret = encodeJpegYU12(jpegSize, yu12Main,
+                jpegQuality, exifData, exifDataSize,
+                bufPtr, maxJpegCodeSize, jpegCodeSize);
+    }
 
     /* TODO: Not sure this belongs here, maybe better to pass jpegCodeSize out
      * and do this when returning buffer to parent */
@@ -1794,6 +2179,218 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     return 0;
 }
 
+bool ExternalCameraDeviceSession::OutputThread::waitForBufferReady(HalStreamBuffer& halBuf) {
+    const int kSyncWaitTimeoutMs = 500;
+    if (*(halBuf.bufPtr) == nullptr) {
+        ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
+        halBuf.fenceTimeout = true;
+    } else if (halBuf.acquireFence >= 0) {
+        int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
+        if (ret) {
+            halBuf.fenceTimeout = true;
+        } else {
+            ::close(halBuf.acquireFence);
+            halBuf.acquireFence = -1;
+        }
+    }
+    return !halBuf.fenceTimeout;
+}
+
+int ExternalCameraDeviceSession::OutputThread::processYuvOutputsLocked(
+        const std::shared_ptr<HalRequest>& req) {
+    // Group the writable outputs by size. Outputs of one size share a scaled intermediate
+    // frame and are filled in order by one task; groups of different sizes only share
+    // req->yu12Frame, read-only, and are filled in parallel.
+    std::vector<std::vector<HalStreamBuffer*>> groups;
+    for (auto& halBuf : req->buffers) {
+        if (halBuf.format == PixelFormat::BLOB) {
+            continue;
+        }
+
+        if (!waitForBufferReady(halBuf)) {
+            continue;
+        }
+
+        auto it = std::find_if(groups.begin(), groups.end(),
+                [&halBuf](const std::vector<HalStreamBuffer*>& group) {
+                    return group[0]->width == halBuf.width && group[0]->height == halBuf.height;
+                });
+        if (it == groups.end()) {
+            groups.push_back({&halBuf});
+        } else {
+            it->push_back(&halBuf);
+        }
+    }
+
+    std::mutex fillLock;
+    std::vector<AllocatedFrameMap> scaledFrames(groups.size());
+    std::vector<int> results(groups.size(), 0);
+    auto fillGroup = [&](size_t i) {
+        for (HalStreamBuffer* halBuf : groups[i]) {
+            results[i] = processYuvOutputLocked(req, *halBuf, scaledFrames[i], fillLock);
+            if (results[i] != 0) {
+                return;
+            }
+        }
+    };
+    if (mOutputFanOut != nullptr && groups.size() > 1) {
+        ATRACE_NAME("fanOutYuvOutputs");
+        mOutputFanOut->run(groups.size(), fillGroup);
+    } else {
+        for (size_t i = 0; i < groups.size(); i++) {
+            fillGroup(i);
+            if (results[i] != 0) {
+                break;
+            }
+        }
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (ret == 0) {
+            ret = results[i];
+        }
+        // JPEG outputs of the same size reuse the scaled frames
+        mScaledYu12Frames.insert(scaledFrames[i].begin(), scaledFrames[i].end());
+    }
+    return ret;
+}
+
+int ExternalCameraDeviceSession::OutputThread::processYuvOutputLocked(
+        const std::shared_ptr<HalRequest>& req, HalStreamBuffer& halBuf,
+        AllocatedFrameMap& scaledFrames, std::mutex& fillLock) {
+    // Gralloc lockYCbCr the buffer
+    switch (halBuf.format) {
+        case PixelFormat::Y16: {
+            uint8_t* inData;
+            size_t inDataSize;
+            if (req->frameIn->map(&inData, &inDataSize) != 0) {
+                ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+                return -1;
+            }
+
+            void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr), halBuf.usage, inDataSize);
+
+            std::memcpy(outLayout, inData, inDataSize);
+
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        case PixelFormat::YCBCR_420_888:
+        case PixelFormat::YV12: {
+            IMapper::Rect outRect {0, 0,
+                    static_cast<int32_t>(halBuf.width),
+                    static_cast<int32_t>(halBuf.height)};
+            YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
+                    *(halBuf.bufPtr), halBuf.usage, outRect);
+            ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
+                    __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
+                    outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
+
+            // Convert to output buffer size/format
+            uint32_t outputFourcc = getFourCcFromLayout(outLayout);
+            ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
+                    outputFourcc & 0xFF,
+                    (outputFourcc >> 8) & 0xFF,
+                    (outputFourcc >> 16) & 0xFF,
+                    (outputFourcc >> 24) & 0xFF);
+
+            Size sz {halBuf.width, halBuf.height};
+            if (isRawYuvFourcc(req->frameIn->mFourcc) &&
+                    sz.width == req->frameIn->mWidth && sz.height == req->frameIn->mHeight) {
+                // Straight from the V4L2 buffer into the output, skipping yu12Frame
+                uint8_t* inData;
+                size_t inDataSize;
+                if (req->frameIn->map(&inData, &inDataSize) != 0) {
+                    ALOGE("%s: V4L2 buffer map failed", __FUNCTION__);
+                    return -1;
+                }
+                nsecs_t convertStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+                ATRACE_BEGIN("convertRawYuv");
+                int ret = convertRawYuv(req->frameIn->mFourcc, inData, inDataSize,
+                        outLayout, sz, outputFourcc);
+                ATRACE_END();
+                if (ret == 0) {
+                    recordLatency(LATENCY_FORMAT_CONVERT, convertStartTs);
+                    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                    if (relFence >= 0) {
+                        halBuf.acquireFence = relFence;
+                    }
+                    break;
+                } else if (ret != -EINVAL) {
+                    ALOGE("%s: raw YUV conversion failed!", __FUNCTION__);
+                    return ret;
+                }
+                // No single pass conversion to outputFourcc, go through yu12Frame
+            }
+            int ret;
+            {
+                std::lock_guard<std::mutex> lk(fillLock);
+                ret = fillYu12FrameLocked(req);
+            }
+            if (ret != 0) {
+                return ret;
+            }
+
+            YCbCrLayout cropAndScaled;
+            nsecs_t stageStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+            ATRACE_BEGIN("cropAndScaleLocked");
+            ret = cropAndScaleLocked(
+                    req->yu12Frame,
+                    Size { halBuf.width, halBuf.height },
+                    mIntermediateBuffers, scaledFrames,
+                    &cropAndScaled);
+            ATRACE_END();
+            if (ret != 0) {
+                ALOGE("%s: crop and scale failed!", __FUNCTION__);
+                return ret;
+            }
+            stageStartTs = recordLatency(LATENCY_CROP_AND_SCALE, stageStartTs);
+
+            ATRACE_BEGIN("formatConvertLocked");
+            ret = formatConvertLocked(cropAndScaled, outLayout, sz, outputFourcc);
+            ATRACE_END();
+            if (ret != 0) {
+                ALOGE("%s: format coversion failed!", __FUNCTION__);
+                return ret;
+            }
+            recordLatency(LATENCY_FORMAT_CONVERT, stageStartTs);
+            int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+            if (relFence >= 0) {
+                halBuf.acquireFence = relFence;
+            }
+        } break;
+        default:
+            ALOGE("%s: unknown output format %x", __FUNCTION__, halBuf.format);
+            return -1;
+    }
+    return 0;
+}
+
+int ExternalCameraDeviceSession::OutputThread::processJpegOutputsLocked(
+        const std::shared_ptr<HalRequest>& req) {
+    for (auto& halBuf : req->buffers) {
+        if (halBuf.format != PixelFormat::BLOB) {
+            continue;
+        }
+
+        if (!waitForBufferReady(halBuf)) {
+            continue;
+        }
+
+        nsecs_t jpegStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+        int ret = createJpegLocked(halBuf, req);
+        if (ret != 0) {
+            ALOGE("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
+            return ret;
+        }
+        recordLatency(LATENCY_CREATE_JPEG, jpegStartTs);
+    }
+    return 0;
+}
+
 bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     std::shared_ptr<HalRequest> req;
     auto parent = mParent.promote();
@@ -1805,21 +2402,34 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     // TODO: maybe we need to setup a sensor thread to dq/enq v4l frames
     //       regularly to prevent v4l buffer queue filled with stale buffers
     //       when app doesn't program a preveiw request
-    waitForNextRequest(&req);
+    bool flushed = false;
+    waitForNextRequest(&req, &flushed);
     if (req == nullptr) {
         // No new request, wait again
         return true;
     }
 
+    if (flushed) {
+        // Results of requests still in the pipeline must be sent first
+        waitForPipelineIdle();
+        parent->processCaptureRequestError(req);
+        signalRequestDone();
+        return true;
+    }
+
     auto onDeviceError = [&](auto... args) {
         ALOGE(args...);
         parent->notifyError(
                 req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+        if (mPipelineDepth > 0) {
+            releasePipelineFrame(req);
+        }
         signalRequestDone();
         return false;
     };
 
-    if (req->frameIn->mFourcc != V4L2_PIX_FMT_MJPEG && req->frameIn->mFourcc != V4L2_PIX_FMT_Z16) {
+    if (req->frameIn->mFourcc != V4L2_PIX_FMT_MJPEG && req->frameIn->mFourcc != V4L2_PIX_FMT_Z16 &&
+            !isRawYuvFourcc(req->frameIn->mFourcc)) {
         return onDeviceError("%s: do not support V4L2 format %c%c%c%c", __FUNCTION__,
                 req->frameIn->mFourcc & 0xFF,
                 (req->frameIn->mFourcc >> 8) & 0xFF,
@@ -1833,30 +2443,67 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         return onDeviceError("%s: failed to send buffer request!", __FUNCTION__);
     }
 
-    std::unique_lock<std::mutex> lk(mBufferLock);
+    // In serial mode the whole request is processed with mBufferLock held. In pipelined
+    // mode the decode target is a pool frame owned by this request until it's finished.
+    const bool pipelined = mPipelineDepth > 0;
+    std::unique_lock<std::mutex> lk(mBufferLock, std::defer_lock);
+    if (pipelined) {
+        req->yu12Frame = acquirePipelineFrame();
+        if (req->yu12Frame == nullptr) {
+            return onDeviceError("%s: no free pipeline frame!", __FUNCTION__);
+        }
+    } else {
+        lk.lock();
+        req->yu12Frame = mYu12Frame;
+    }
+
     // Convert input V4L2 frame to YU12 of the same size
     // TODO: see if we can save some computation by converting to YV12 here
     uint8_t* inData;
     size_t inDataSize;
     if (req->frameIn->map(&inData, &inDataSize) != 0) {
-        lk.unlock();
+        if (lk.owns_lock()) {
+            lk.unlock();
+        }
         return onDeviceError("%s: V4L2 buffer map failed", __FUNCTION__);
     }
 
     // TODO: in some special case maybe we can decode jpg directly to gralloc output?
-    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
-        ATRACE_BEGIN("MJPGtoI420");
-        int res = libyuv::MJPGToI420(
-            inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y), mYu12FrameLayout.yStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cb), mYu12FrameLayout.cStride,
-            static_cast<uint8_t*>(mYu12FrameLayout.cr), mYu12FrameLayout.cStride,
-            mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth, mYu12Frame->mHeight);
-        ATRACE_END();
+    // Raw YUV frames are converted now only if some output can't be written from the V4L2
+    // buffer directly.
+    if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG ||
+            (isRawYuvFourcc(req->frameIn->mFourcc) && needsYu12Frame(req))) {
+        int res;
+        nsecs_t decodeStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (req->frameIn->mFourcc == V4L2_PIX_FMT_MJPEG) {
+            YCbCrLayout yu12Layout;
+            req->yu12Frame->getLayout(&yu12Layout);
+            ATRACE_BEGIN("MJPGtoI420");
+            res = mMjpegDecoder->decode(inData, inDataSize,
+                    req->yu12Frame->mWidth, req->yu12Frame->mHeight, yu12Layout);
+            ATRACE_END();
+            req->yu12FrameFilled = (res == 0);
+        } else {
+            res = fillYu12FrameLocked(req);
+        }
+        recordLatency(LATENCY_DECODE, decodeStartTs);
 
         if (res != 0) {
             // For some webcam, the first few V4L2 frames might be malformed...
             ALOGE("%s: Convert V4L2 frame to YU12 failed! res %d", __FUNCTION__, res);
-            lk.unlock();
+            if (lk.owns_lock()) {
+                lk.unlock();
+            }
+            // Collect the buffers requested for this frame, they are returned with the error
+            if (waitForBufferRequestDone(&req->buffers) != 0) {
+                return onDeviceError("%s: failed to process buffer request error!",
+                        __FUNCTION__);
+            }
+            if (pipelined) {
+                // Errors for this request must not overtake results of earlier ones
+                waitForPipelineIdle();
+                releasePipelineFrame(req);
+            }
             Status st = parent->processCaptureRequestError(req);
             if (st != Status::OK) {
                 return onDeviceError("%s: failed to process capture request error!", __FUNCTION__);
@@ -1872,105 +2519,45 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
 
     if (res != 0) {
         ALOGE("%s: wait for BufferRequest done failed! res %d", __FUNCTION__, res);
-        lk.unlock();
+        if (lk.owns_lock()) {
+            lk.unlock();
+        }
         return onDeviceError("%s: failed to process buffer request error!", __FUNCTION__);
     }
 
-    ALOGV("%s processing new request", __FUNCTION__);
-    const int kSyncWaitTimeoutMs = 500;
-    for (auto& halBuf : req->buffers) {
-        if (*(halBuf.bufPtr) == nullptr) {
-            ALOGW("%s: buffer for stream %d missing", __FUNCTION__, halBuf.streamId);
-            halBuf.fenceTimeout = true;
-        } else if (halBuf.acquireFence >= 0) {
-            int ret = sync_wait(halBuf.acquireFence, kSyncWaitTimeoutMs);
-            if (ret) {
-                halBuf.fenceTimeout = true;
-            } else {
-                ::close(halBuf.acquireFence);
-                halBuf.acquireFence = -1;
-            }
+    if (pipelined) {
+        {
+            std::lock_guard<std::mutex> plk(mPipelineLock);
+            mPipelineInflight++;
         }
-
-        if (halBuf.fenceTimeout) {
-            continue;
+        if (mPipelineStages[STAGE_YUV_OUTPUT]->enqueue(req) != 0) {
+            finishPipelineRequest(req);
+            return onDeviceError("%s: output pipeline is exiting!", __FUNCTION__);
         }
+        signalRequestDone();
+        return true;
+    }
 
-        // Gralloc lockYCbCr the buffer
-        switch (halBuf.format) {
-            case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req);
-
-                if(ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: createJpegLocked failed with %d",
-                          __FUNCTION__, ret);
-                }
-            } break;
-            case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(*(halBuf.bufPtr), halBuf.usage, inDataSize);
-
-                std::memcpy(outLayout, inData, inDataSize);
-
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            case PixelFormat::YCBCR_420_888:
-            case PixelFormat::YV12: {
-                IMapper::Rect outRect {0, 0,
-                        static_cast<int32_t>(halBuf.width),
-                        static_cast<int32_t>(halBuf.height)};
-                YCbCrLayout outLayout = sHandleImporter.lockYCbCr(
-                        *(halBuf.bufPtr), halBuf.usage, outRect);
-                ALOGV("%s: outLayout y %p cb %p cr %p y_str %d c_str %d c_step %d",
-                        __FUNCTION__, outLayout.y, outLayout.cb, outLayout.cr,
-                        outLayout.yStride, outLayout.cStride, outLayout.chromaStep);
-
-                // Convert to output buffer size/format
-                uint32_t outputFourcc = getFourCcFromLayout(outLayout);
-                ALOGV("%s: converting to format %c%c%c%c", __FUNCTION__,
-                        outputFourcc & 0xFF,
-                        (outputFourcc >> 8) & 0xFF,
-                        (outputFourcc >> 16) & 0xFF,
-                        (outputFourcc >> 24) & 0xFF);
-
-                YCbCrLayout cropAndScaled;
-                ATRACE_BEGIN("cropAndScaleLocked");
-                int ret = cropAndScaleLocked(
-                        mYu12Frame,
-                        Size { halBuf.width, halBuf.height },
-                        &cropAndScaled);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: crop and scale failed!", __FUNCTION__);
-                }
+    ALOGV("%s processing new request", __FUNCTION__);
+    int ret = processYuvOutputsLocked(req);
+    if (ret != 0) {
+        lk.unlock();
+        return onDeviceError("%s: processing YUV outputs failed with %d", __FUNCTION__, ret);
+    }
 
-                Size sz {halBuf.width, halBuf.height};
-                ATRACE_BEGIN("formatConvertLocked");
-                ret = formatConvertLocked(cropAndScaled, outLayout, sz, outputFourcc);
-                ATRACE_END();
-                if (ret != 0) {
-                    lk.unlock();
-                    return onDeviceError("%s: format coversion failed!", __FUNCTION__);
-                }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
-                if (relFence >= 0) {
-                    halBuf.acquireFence = relFence;
-                }
-            } break;
-            default:
-                lk.unlock();
-                return onDeviceError("%s: unknown output format %x", __FUNCTION__, halBuf.format);
-        }
-    } // for each buffer
+    ret = processJpegOutputsLocked(req);
+    if (ret != 0) {
+        lk.unlock();
+        return onDeviceError("%s: processing JPEG outputs failed with %d", __FUNCTION__, ret);
+    }
     mScaledYu12Frames.clear();
 
     // Don't hold the lock while calling back to parent
     lk.unlock();
+    req->yu12Frame.clear();
+    nsecs_t resultStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
     Status st = parent->processCaptureResult(req);
+    recordLatency(LATENCY_CAPTURE_RESULT, resultStartTs);
     if (st != Status::OK) {
         return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
     }
@@ -1978,77 +2565,297 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
     return true;
 }
 
+bool ExternalCameraDeviceSession::OutputThread::processPipelineStage(
+        PipelineStageId id, std::shared_ptr<HalRequest>& req) {
+    auto parent = mParent.promote();
+    if (parent == nullptr) {
+       ALOGE("%s: session has been disconnected!", __FUNCTION__);
+       finishPipelineRequest(req);
+       return false;
+    }
+
+    auto onDeviceError = [&](auto... args) {
+        ALOGE(args...);
+        parent->notifyError(
+                req->frameNumber, /*stream*/-1, ErrorCode::ERROR_DEVICE);
+        finishPipelineRequest(req);
+        return false;
+    };
+
+    switch (id) {
+        case STAGE_YUV_OUTPUT: {
+            int ret;
+            {
+                std::lock_guard<std::mutex> lk(mBufferLock);
+                ret = processYuvOutputsLocked(req);
+                mScaledYu12Frames.clear();
+            }
+            if (ret != 0) {
+                return onDeviceError("%s: processing YUV outputs failed with %d",
+                        __FUNCTION__, ret);
+            }
+            if (mPipelineStages[STAGE_JPEG_OUTPUT]->enqueue(req) != 0) {
+                return onDeviceError("%s: output pipeline is exiting!", __FUNCTION__);
+            }
+        } break;
+        case STAGE_JPEG_OUTPUT: {
+            int ret;
+            {
+                std::lock_guard<std::mutex> lk(mJpegBufferLock);
+                ret = processJpegOutputsLocked(req);
+                mJpegScaledYu12Frames.clear();
+            }
+            if (ret != 0) {
+                return onDeviceError("%s: processing JPEG outputs failed with %d",
+                        __FUNCTION__, ret);
+            }
+
+            // Give the frame back to the decoder before calling back to framework
+            releasePipelineFrame(req);
+            nsecs_t resultStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
+            Status st = parent->processCaptureResult(req);
+            recordLatency(LATENCY_CAPTURE_RESULT, resultStartTs);
+            if (st != Status::OK) {
+                return onDeviceError("%s: failed to process capture result!", __FUNCTION__);
+            }
+            finishPipelineRequest(req);
+        } break;
+        default:
+            ALOGE("%s: unknown pipeline stage %d", __FUNCTION__, id);
+            return false;
+    }
+    return true;
+}
+
+sp<AllocatedFrame> ExternalCameraDeviceSession::OutputThread::acquirePipelineFrame() {
+    std::unique_lock<std::mutex> lk(mPipelineLock);
+    if (mFreePipelineFrames.empty()) {
+        ATRACE_NAME("Wait for pipeline frame");
+        std::chrono::seconds timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+        bool available = mPipelineCond.wait_for(lk, timeout,
+                [this] { return !mFreePipelineFrames.empty(); });
+        if (!available) {
+            ALOGE("%s: wait for free pipeline frame timeout!", __FUNCTION__);
+            return nullptr;
+        }
+    }
+    sp<AllocatedFrame> frame = mFreePipelineFrames.back();
+    mFreePipelineFrames.pop_back();
+    return frame;
+}
+
+void ExternalCameraDeviceSession::OutputThread::releasePipelineFrame(
+        const std::shared_ptr<HalRequest>& req) {
+    if (req->yu12Frame == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(mPipelineLock);
+        mFreePipelineFrames.push_back(req->yu12Frame);
+    }
+    req->yu12Frame.clear();
+    mPipelineCond.notify_all();
+}
+
+void ExternalCameraDeviceSession::OutputThread::finishPipelineRequest(
+        const std::shared_ptr<HalRequest>& req) {
+    releasePipelineFrame(req);
+    {
+        std::lock_guard<std::mutex> lk(mPipelineLock);
+        if (mPipelineInflight > 0) {
+            mPipelineInflight--;
+        }
+    }
+    mPipelineCond.notify_all();
+}
+
+void ExternalCameraDeviceSession::OutputThread::waitForPipelineIdle() {
+    std::unique_lock<std::mutex> lk(mPipelineLock);
+    if (mPipelineInflight == 0) {
+        return;
+    }
+    ATRACE_NAME("Wait for pipeline idle");
+    std::chrono::seconds timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
+    bool idle = mPipelineCond.wait_for(lk, timeout, [this] { return mPipelineInflight == 0; });
+    if (!idle) {
+        ALOGE("%s: wait for %zu pipelined requests to finish timeout!",
+                __FUNCTION__, mPipelineInflight);
+    }
+}
+
+ExternalCameraDeviceSession::OutputThread::PipelineStage::PipelineStage(
+        OutputThread* owner, PipelineStageId id, size_t capacity) :
+        mOwner(owner), mId(id), mCapacity(capacity) {}
+
+ExternalCameraDeviceSession::OutputThread::PipelineStage::~PipelineStage() {}
+
+int ExternalCameraDeviceSession::OutputThread::PipelineStage::enqueue(
+        const std::shared_ptr<HalRequest>& req) {
+    std::unique_lock<std::mutex> lk(mQueueLock);
+    while (mQueue.size() >= mCapacity) {
+        if (exitPending()) {
+            return -1;
+        }
+        mQueueCond.wait_for(lk, std::chrono::milliseconds(kReqWaitTimeoutMs));
+    }
+    mQueue.push_back(req);
+    lk.unlock();
+    mQueueCond.notify_all();
+    return 0;
+}
+
+void ExternalCameraDeviceSession::OutputThread::PipelineStage::requestExit() {
+    Thread::requestExit();
+    mQueueCond.notify_all();
+}
+
+bool ExternalCameraDeviceSession::OutputThread::PipelineStage::threadLoop() {
+    std::shared_ptr<HalRequest> req;
+    {
+        std::unique_lock<std::mutex> lk(mQueueLock);
+        while (mQueue.empty()) {
+            if (exitPending()) {
+                return false;
+            }
+            mQueueCond.wait_for(lk, std::chrono::milliseconds(kReqWaitTimeoutMs));
+        }
+        req = mQueue.front();
+        mQueue.pop_front();
+    }
+    mQueueCond.notify_all();
+    return mOwner->processPipelineStage(mId, req);
+}
+
+void ExternalCameraDeviceSession::OutputThread::PipelineStage::dump(int fd) {
+    std::lock_guard<std::mutex> lk(mQueueLock);
+    dprintf(fd, "OutputThread %s stage queue contains frame: ",
+            (mId == STAGE_YUV_OUTPUT) ? "YUV" : "JPEG");
+    for (const auto& req : mQueue) {
+        dprintf(fd, "%d, ", req->frameNumber);
+    }
+    dprintf(fd, "\n");
+}
+
 Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
         const Size& v4lSize, const Size& thumbSize,
         const hidl_vec<Stream>& streams,
         uint32_t blobBufferSize) {
     std::lock_guard<std::mutex> lk(mBufferLock);
-    if (mScaledYu12Frames.size() != 0) {
+    std::lock_guard<std::mutex> jpegLk(mJpegBufferLock);
+    if (mScaledYu12Frames.size() != 0 || mJpegScaledYu12Frames.size() != 0) {
         ALOGE("%s: intermediate buffer pool has %zu inflight buffers! (expect 0)",
-                __FUNCTION__, mScaledYu12Frames.size());
+                __FUNCTION__, mScaledYu12Frames.size() + mJpegScaledYu12Frames.size());
         return Status::INTERNAL_ERROR;
     }
 
-    // Allocating intermediate YU12 frame
-    if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
+    const bool pipelined = mPipelineDepth > 0;
+    if (pipelined) {
+        // Allocating decoded YU12 frames circulating in the output pipeline
+        std::lock_guard<std::mutex> plk(mPipelineLock);
+        if (mPipelineInflight != 0) {
+            ALOGE("%s: output pipeline has %zu inflight requests! (expect 0)",
+                    __FUNCTION__, mPipelineInflight);
+            return Status::INTERNAL_ERROR;
+        }
+        if (mPipelineFrames.size() != mPipelineDepth || mPipelineFrames[0]->mWidth !=
+                v4lSize.width || mPipelineFrames[0]->mHeight != v4lSize.height) {
+            mFreePipelineFrames.clear();
+            for (auto& frame : mPipelineFrames) {
+                mFramePool->release(frame);
+            }
+            mPipelineFrames.clear();
+            for (uint32_t i = 0; i < mPipelineDepth; i++) {
+                sp<AllocatedFrame> frame = mFramePool->acquire(v4lSize.width, v4lSize.height);
+                if (frame == nullptr) {
+                    ALOGE("%s: allocating pipeline YU12 frame failed!", __FUNCTION__);
+                    for (auto& f : mPipelineFrames) {
+                        mFramePool->release(f);
+                    }
+                    mPipelineFrames.clear();
+                    return Status::INTERNAL_ERROR;
+                }
+                mPipelineFrames.push_back(frame);
+            }
+            mFreePipelineFrames = mPipelineFrames;
+        }
+    } else if (mYu12Frame == nullptr || mYu12Frame->mWidth != v4lSize.width ||
             mYu12Frame->mHeight != v4lSize.height) {
-        mYu12Frame.clear();
-        mYu12Frame = new AllocatedFrame(v4lSize.width, v4lSize.height);
-        int ret = mYu12Frame->allocate(&mYu12FrameLayout);
-        if (ret != 0) {
+        // Allocating intermediate YU12 frame
+        mFramePool->release(mYu12Frame);
+        mYu12Frame = mFramePool->acquire(v4lSize.width, v4lSize.height);
+        if (mYu12Frame == nullptr) {
             ALOGE("%s: allocating YU12 frame failed!", __FUNCTION__);
             return Status::INTERNAL_ERROR;
         }
+        mYu12Frame->getLayout(&mYu12FrameLayout);
     }
 
     // Allocating intermediate YU12 thumbnail frame
     if (mYu12ThumbFrame == nullptr ||
         mYu12ThumbFrame->mWidth != thumbSize.width ||
         mYu12ThumbFrame->mHeight != thumbSize.height) {
-        mYu12ThumbFrame.clear();
-        mYu12ThumbFrame = new AllocatedFrame(thumbSize.width, thumbSize.height);
-        int ret = mYu12ThumbFrame->allocate(&mYu12ThumbFrameLayout);
-        if (ret != 0) {
+        mFramePool->release(mYu12ThumbFrame);
+        mYu12ThumbFrame = mFramePool->acquire(thumbSize.width, thumbSize.height);
+        if (mYu12ThumbFrame == nullptr) {
             ALOGE("%s: allocating YU12 thumb frame failed!", __FUNCTION__);
             return Status::INTERNAL_ERROR;
         }
+        mYu12ThumbFrame->getLayout(&mYu12ThumbFrameLayout);
     }
 
-    // Allocating scaled buffers
-    for (const auto& stream : streams) {
-        Size sz = {stream.width, stream.height};
-        if (sz == v4lSize) {
-            continue; // Don't need an intermediate buffer same size as v4lBuffer
-        }
-        if (mIntermediateBuffers.count(sz) == 0) {
-            // Create new intermediate buffer
-            sp<AllocatedFrame> buf = new AllocatedFrame(stream.width, stream.height);
-            int ret = buf->allocate();
-            if (ret != 0) {
-                ALOGE("%s: allocating intermediate YU12 frame %dx%d failed!",
-                            __FUNCTION__, stream.width, stream.height);
-                return Status::INTERNAL_ERROR;
+    // When pipelined, BLOB streams are scaled by the JPEG stage into its own buffers
+    auto isJpegStageStream = [pipelined](const Stream& stream) {
+        return pipelined && stream.format == PixelFormat::BLOB;
+    };
+
+    auto updateBuffers = [&](AllocatedFrameMap& buffers, bool jpegStage) {
+        // Return unconfigured buffers to the pool first so new sizes can reuse them
+        auto it = buffers.begin();
+        while (it != buffers.end()) {
+            bool configured = false;
+            auto sz = it->first;
+            for (const auto& stream : streams) {
+                if (stream.width == sz.width && stream.height == sz.height &&
+                        isJpegStageStream(stream) == jpegStage) {
+                    configured = true;
+                    break;
+                }
+            }
+            if (configured) {
+                it++;
+            } else {
+                mFramePool->release(it->second);
+                it = buffers.erase(it);
             }
-            mIntermediateBuffers[sz] = buf;
         }
-    }
 
-    // Remove unconfigured buffers
-    auto it = mIntermediateBuffers.begin();
-    while (it != mIntermediateBuffers.end()) {
-        bool configured = false;
-        auto sz = it->first;
+        // Allocating scaled buffers
         for (const auto& stream : streams) {
-            if (stream.width == sz.width && stream.height == sz.height) {
-                configured = true;
-                break;
+            Size sz = {stream.width, stream.height};
+            if (sz == v4lSize || isJpegStageStream(stream) != jpegStage) {
+                continue; // Don't need an intermediate buffer same size as v4lBuffer
+            }
+            if (buffers.count(sz) == 0) {
+                // Create new intermediate buffer
+                sp<AllocatedFrame> buf = mFramePool->acquire(stream.width, stream.height);
+                if (buf == nullptr) {
+                    ALOGE("%s: allocating intermediate YU12 frame %dx%d failed!",
+                                __FUNCTION__, stream.width, stream.height);
+                    return Status::INTERNAL_ERROR;
+                }
+                buffers[sz] = buf;
             }
         }
-        if (configured) {
-            it++;
-        } else {
-            it = mIntermediateBuffers.erase(it);
-        }
+        return Status::OK;
+    };
+
+    Status status = updateBuffers(mIntermediateBuffers, /*jpegStage*/false);
+    if (status != Status::OK) {
+        return status;
+    }
+    status = updateBuffers(mJpegIntermediateBuffers, /*jpegStage*/true);
+    if (status != Status::OK) {
+        return status;
     }
 
     mBlobBufferSize = blobBufferSize;
@@ -2057,10 +2864,23 @@ Status ExternalCameraDeviceSession::OutputThread::allocateIntermediateBuffers(
 
 Status ExternalCameraDeviceSession::OutputThread::submitRequest(
         const std::shared_ptr<HalRequest>& req) {
-    std::unique_lock<std::mutex> lk(mRequestListLock);
-    mRequestList.push_back(req);
-    lk.unlock();
-    mRequestCond.notify_one();
+    // Only called by processCaptureRequest with the session lock held, so this is the
+    // single producer of mRequestQueue.
+    uint64_t idx = mRequestQueue.pushCount();
+    mQueuedFrameNumbers[idx % kRequestQueueSize].store(req->frameNumber,
+            std::memory_order_relaxed);
+    std::shared_ptr<HalRequest> queued = req;
+    if (!mRequestQueue.push(std::move(queued))) {
+        ALOGE("%s: request queue full, cannot queue frame %d", __FUNCTION__, req->frameNumber);
+        return Status::INTERNAL_ERROR;
+    }
+    // Lock only if the output thread might be about to sleep. Paired with the fence in
+    // waitForNextRequest so either this sees the flag or the output thread sees the request.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaitingForRequest.load()) {
+        std::lock_guard<std::mutex> lk(mRequestWaitLock);
+        mRequestCond.notify_one();
+    }
     return Status::OK;
 }
 
@@ -2072,74 +2892,132 @@ void ExternalCameraDeviceSession::OutputThread::flush() {
        return;
     }
 
-    std::unique_lock<std::mutex> lk(mRequestListLock);
-    std::list<std::shared_ptr<HalRequest>> reqs = std::move(mRequestList);
-    mRequestList.clear();
-    if (mProcessingRequest) {
+    // Every request queued so far is returned with an error by threadLoop, in order and
+    // after the requests already being processed.
+    uint64_t flushEnd = mRequestQueue.pushCount();
+    uint64_t prevEnd = mFlushEnd.load();
+    while (prevEnd < flushEnd && !mFlushEnd.compare_exchange_weak(prevEnd, flushEnd)) {}
+    {
+        std::lock_guard<std::mutex> lk(mRequestWaitLock);
+        mRequestCond.notify_one();
+    }
+
+    std::unique_lock<std::mutex> lk(mRequestDoneLock);
+    if (isRunning()) {
         std::chrono::seconds timeout = std::chrono::seconds(kFlushWaitTimeoutSec);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
+        bool done = mRequestDoneCond.wait_for(lk, timeout, [&] {
+            return !mProcessingRequest && mRequestsDone >= flushEnd;
+        });
+        if (!done) {
             ALOGE("%s: wait for inflight request finish timeout!", __FUNCTION__);
         }
     }
-
-    ALOGV("%s: flusing inflight requests", __FUNCTION__);
     lk.unlock();
-    for (const auto& req : reqs) {
-        parent->processCaptureRequestError(req);
+
+    if (!isRunning()) {
+        // threadLoop has exited (or never ran) so nothing else consumes the queue
+        ALOGV("%s: flusing inflight requests", __FUNCTION__);
+        waitForPipelineIdle();
+        std::shared_ptr<HalRequest> req;
+        while (mRequestQueue.pop(&req)) {
+            parent->processCaptureRequestError(req);
+        }
+        lk.lock();
+        mRequestsDone = mRequestQueue.popCount();
+        return;
     }
+    // Requests already in the pipeline are older than the flushed ones
+    waitForPipelineIdle();
 }
 
 void ExternalCameraDeviceSession::OutputThread::waitForNextRequest(
-        std::shared_ptr<HalRequest>* out) {
+        std::shared_ptr<HalRequest>* out, bool* flushed) {
     ATRACE_CALL();
-    if (out == nullptr) {
+    if (out == nullptr || flushed == nullptr) {
         ALOGE("%s: out is null", __FUNCTION__);
         return;
     }
 
-    std::unique_lock<std::mutex> lk(mRequestListLock);
-    int waitTimes = 0;
-    while (mRequestList.empty()) {
-        if (exitPending()) {
-            return;
-        }
-        std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
-        auto st = mRequestCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
-            waitTimes++;
-            if (waitTimes == kReqWaitTimesMax) {
-                // no new request, return
+    uint64_t seq = 0;
+    if (!mRequestQueue.pop(out, &seq)) {
+        std::unique_lock<std::mutex> lk(mRequestWaitLock);
+        mWaitingForRequest.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int waitTimes = 0;
+        while (!mRequestQueue.pop(out, &seq)) {
+            if (exitPending()) {
+                mWaitingForRequest.store(false);
                 return;
             }
+            std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
+            auto st = mRequestCond.wait_for(lk, timeout);
+            if (st == std::cv_status::timeout) {
+                waitTimes++;
+                if (waitTimes == kReqWaitTimesMax) {
+                    // no new request, return
+                    mWaitingForRequest.store(false);
+                    return;
+                }
+            }
         }
+        mWaitingForRequest.store(false);
     }
-    *out = mRequestList.front();
-    mRequestList.pop_front();
+    *flushed = seq < mFlushEnd.load();
+
+    std::lock_guard<std::mutex> lk(mRequestDoneLock);
     mProcessingRequest = true;
     mProcessingFrameNumer = (*out)->frameNumber;
 }
 
 void ExternalCameraDeviceSession::OutputThread::signalRequestDone() {
-    std::unique_lock<std::mutex> lk(mRequestListLock);
+    std::unique_lock<std::mutex> lk(mRequestDoneLock);
     mProcessingRequest = false;
     mProcessingFrameNumer = 0;
+    mRequestsDone = mRequestQueue.popCount();
     lk.unlock();
-    mRequestDoneCond.notify_one();
+    mRequestDoneCond.notify_all();
 }
 
 void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
-    std::lock_guard<std::mutex> lk(mRequestListLock);
-    if (mProcessingRequest) {
-        dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumer);
-    } else {
-        dprintf(fd, "OutputThread not processing any frames\n");
+    {
+        std::lock_guard<std::mutex> lk(mRequestDoneLock);
+        if (mProcessingRequest) {
+            dprintf(fd, "OutputThread processing frame %d\n", mProcessingFrameNumer);
+        } else {
+            dprintf(fd, "OutputThread not processing any frames\n");
+        }
     }
-    dprintf(fd, "OutputThread request list contains frame: ");
-    for (const auto& req : mRequestList) {
-        dprintf(fd, "%d, ", req->frameNumber);
+    // Racy snapshot of the queue, good enough for a dump
+    uint64_t head = mRequestQueue.popCount();
+    uint64_t tail = mRequestQueue.pushCount();
+    dprintf(fd, "OutputThread request queue (%" PRIu64 "/%zu) contains frame: ",
+            tail - head, kRequestQueueSize);
+    for (uint64_t i = head; i < tail; i++) {
+        dprintf(fd, "%d, ",
+                mQueuedFrameNumbers[i % kRequestQueueSize].load(std::memory_order_relaxed));
     }
     dprintf(fd, "\n");
+    dprintf(fd, "OutputThread MJPEG decoder: %s\n",
+            mMjpegDecoder ? mMjpegDecoder->getName() : "none");
+    if (mFramePool != nullptr) {
+        mFramePool->dump(fd);
+    }
+    dprintf(fd, "OutputThread stage latencies:\n");
+    mMetrics.dump(fd);
+
+    if (mPipelineDepth > 0) {
+        size_t inflight, freeFrames;
+        {
+            std::lock_guard<std::mutex> plk(mPipelineLock);
+            inflight = mPipelineInflight;
+            freeFrames = mFreePipelineFrames.size();
+        }
+        dprintf(fd, "OutputThread pipeline depth %u, %zu requests in pipeline, %zu free frames\n",
+                mPipelineDepth, inflight, freeFrames);
+        for (const auto& stage : mPipelineStages) {
+            stage->dump(fd);
+        }
+    }
 }
 
 void ExternalCameraDeviceSession::cleanupBuffersLocked(int id) {
@@ -2388,8 +3266,7 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
         return fpsRet;
     }
 
-    uint32_t v4lBufferCount = (fps >= kDefaultFps) ?
-            mCfg.numVideoBuffers : mCfg.numStillBuffers;
+    uint32_t v4lBufferCount = getV4l2BufferCountLocked(fps);
     // VIDIOC_REQBUFS: create buffers
     v4l2_requestbuffers req_buffers{};
     req_buffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -2410,6 +3287,10 @@ int ExternalCameraDeviceSession::configureV4l2StreamLocked(
     // VIDIOC_QUERYBUF:  get buffer offset in the V4L2 fd
     // VIDIOC_QBUF: send buffer to driver
     mV4L2BufferCount = req_buffers.count;
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        mV4l2BufferDequeueTs.assign(mV4L2BufferCount, 0);
+    }
     for (uint32_t i = 0; i < req_buffers.count; i++) {
         v4l2_buffer buffer = {
             .type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
@@ -2481,8 +3362,12 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
 
     {
         std::unique_lock<std::mutex> lk(mV4l2BufferLock);
-        if (mNumDequeuedV4l2Buffers == mV4L2BufferCount) {
+        if (mNumDequeuedV4l2Buffers >= getMaxDequeuedV4l2BuffersLocked()) {
+            ATRACE_NAME("V4L2 buffer stall");
+            nsecs_t stallStartTs = systemTime(SYSTEM_TIME_MONOTONIC);
             int waitRet = waitForV4L2BufferReturnLocked(lk);
+            mNumV4l2BufferStalls++;
+            mV4l2BufferStallNs += systemTime(SYSTEM_TIME_MONOTONIC) - stallStartTs;
             if (waitRet != 0) {
                 return ret;
             }
@@ -2527,6 +3412,9 @@ sp<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(/*out*/nsecs_t
     {
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         mNumDequeuedV4l2Buffers++;
+        if (buffer.index < mV4l2BufferDequeueTs.size()) {
+            mV4l2BufferDequeueTs[buffer.index] = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
     }
     return new V4L2Frame(
             mV4l2StreamingFmt.width, mV4l2StreamingFmt.height, mV4l2StreamingFmt.fourcc,
@@ -2551,10 +3439,56 @@ void ExternalCameraDeviceSession::enqueueV4l2Frame(const sp<V4L2Frame>& frame) {
     {
         std::lock_guard<std::mutex> lk(mV4l2BufferLock);
         mNumDequeuedV4l2Buffers--;
+        size_t idx = static_cast<size_t>(frame->mBufferIndex);
+        if (idx < mV4l2BufferDequeueTs.size() && mV4l2BufferDequeueTs[idx] != 0) {
+            nsecs_t holdNs = systemTime(SYSTEM_TIME_MONOTONIC) - mV4l2BufferDequeueTs[idx];
+            mV4l2BufferDequeueTs[idx] = 0;
+            mAvgV4l2BufferHoldNs = (mAvgV4l2BufferHoldNs == 0) ? holdNs :
+                    (mAvgV4l2BufferHoldNs * 7 + holdNs) / 8;
+        }
     }
     mV4L2BufferReturned.notify_one();
 }
 
+uint32_t ExternalCameraDeviceSession::getV4l2BufferCountLocked(double fps) {
+    const double kDefaultFps = 30.0;
+    uint32_t count = (fps >= kDefaultFps) ? mCfg.numVideoBuffers : mCfg.numStillBuffers;
+    if (!mCfg.adaptiveV4l2Buffers || fps <= 0.0) {
+        return count;
+    }
+
+    nsecs_t avgHoldNs;
+    {
+        std::lock_guard<std::mutex> lk(mV4l2BufferLock);
+        avgHoldNs = mAvgV4l2BufferHoldNs;
+    }
+    // Frames arriving while a request holds its buffer each need a buffer of their own
+    nsecs_t frameDurationNs = static_cast<nsecs_t>(1e9 / fps);
+    uint32_t held = 1;
+    if (avgHoldNs > frameDurationNs) {
+        held = static_cast<uint32_t>((avgHoldNs + frameDurationNs - 1) / frameDurationNs);
+    }
+    // A JPEG capture keeps its buffer through the encode while preview continues
+    if (mHasBlobStream) {
+        held++;
+    }
+    // Plus one being filled by the driver and one always left queued
+    uint32_t adaptive = held + 2;
+    uint32_t maxCount = std::max(mCfg.maxV4l2Buffers, count);
+    count = std::min(std::max(adaptive, count), maxCount);
+    ALOGV("%s: %u buffers (avg hold %" PRId64 "us at %f fps)", __FUNCTION__, count,
+            avgHoldNs / 1000, fps);
+    return count;
+}
+
+size_t ExternalCameraDeviceSession::getMaxDequeuedV4l2BuffersLocked() const {
+    if (mCfg.adaptiveV4l2Buffers && mV4L2BufferCount > 1) {
+        // Keep one buffer queued so the driver never has to drop a frame
+        return mV4L2BufferCount - 1;
+    }
+    return mV4L2BufferCount;
+}
+
 Status ExternalCameraDeviceSession::isStreamCombinationSupported(
         const V3_2::StreamConfiguration& config,
         const std::vector<SupportedV4L2Format>& supportedFormats,
@@ -2708,6 +3642,13 @@ Status ExternalCameraDeviceSession::configureStreams(
         return Status::ILLEGAL_ARGUMENT;
     }
 
+    mHasBlobStream = false;
+    for (const auto& stream : config.streams) {
+        if (stream.format == PixelFormat::BLOB) {
+            mHasBlobStream = true;
+        }
+    }
+
     if (configureV4l2StreamLocked(v4l2Fmt) != 0) {
         ALOGE("V4L configuration failed!, format:%c%c%c%c, w %d, h %d",
             v4l2Fmt.fourcc & 0xFF,
@@ -2995,6 +3936,32 @@ status_t ExternalCameraDeviceSession::fillCaptureResult(
     return OK;
 }
 
+void ExternalCameraDeviceSession::initCaptureResultLocked(
+        common::V1_0::helper::CameraMetadata* out) {
+    const camera_metadata_t* settings = mLatestReqSetting.getAndLock();
+    size_t entryCount = 0;
+    size_t dataCount = 0;
+    if (settings != nullptr) {
+        entryCount = get_camera_metadata_entry_count(settings);
+        dataCount = get_camera_metadata_data_count(settings);
+    }
+    mLatestReqSetting.unlock(settings);
+
+    // update() on a buffer that's full reallocates and copies it, typically a few times per
+    // result. Allocate once with the size the previous result ended up at instead.
+    size_t entryCapacity = std::max(mResultEntryCount.load(std::memory_order_relaxed),
+            entryCount + kResultExtraEntries);
+    size_t dataCapacity = std::max(mResultDataCount.load(std::memory_order_relaxed),
+            dataCount + kResultExtraData);
+    common::V1_0::helper::CameraMetadata md(entryCapacity, dataCapacity);
+    if (settings != nullptr && md.append(mLatestReqSetting) != OK) {
+        ALOGW("%s: append settings failed, copying instead", __FUNCTION__);
+        *out = mLatestReqSetting;
+        return;
+    }
+    out->acquire(md);
+}
+
 #undef ARRAY_SIZE
 #undef UPDATE
 
@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "ExtCamMjpegDec@3.4"
+//#define LOG_NDEBUG 0
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#include <log/log.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include <utils/Trace.h>
+#include "ExternalCameraMjpegDecoder.h"
+
+#define HAVE_JPEG // required for libyuv.h to export MJPEG decode APIs
+#include <libyuv.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+namespace {
+// JPEG markers
+constexpr uint8_t kMarkerPrefix = 0xFF;
+constexpr uint8_t kSOI = 0xD8;
+constexpr uint8_t kEOI = 0xD9;
+constexpr uint8_t kSOS = 0xDA;
+constexpr uint8_t kDRI = 0xDD;
+constexpr uint8_t kRST0 = 0xD0;
+constexpr uint8_t kRST7 = 0xD7;
+constexpr uint8_t kSOF0 = 0xC0; // baseline
+constexpr uint8_t kSOF1 = 0xC1; // extended sequential, huffman
+constexpr uint8_t kDHT = 0xC4;
+constexpr uint8_t kDAC = 0xCC;
+
+bool isUnsupportedSof(uint8_t marker) {
+    // SOF2..SOF15, excluding DHT/DAC which share the range
+    return marker >= 0xC2 && marker <= 0xCF && marker != kDHT && marker != kDAC;
+}
+} // anonymous namespace
+
+std::unique_ptr<MjpegDecoder> MjpegDecoder::create(const ExternalCameraConfig& cfg) {
+    const auto& decCfg = cfg.mjpegDecoder;
+    auto createSoftware = [&decCfg]() -> std::unique_ptr<MjpegDecoder> {
+        if (decCfg.numThreads > 1) {
+            return std::make_unique<ParallelMjpegDecoder>(decCfg.numThreads);
+        }
+        return std::make_unique<LibyuvMjpegDecoder>();
+    };
+
+    std::unique_ptr<MjpegDecoder> decoder;
+    if (decCfg.type == "v4l2m2m") {
+        if (decCfg.devicePath.empty()) {
+            ALOGW("%s: no device specified for V4L2 M2M MJPEG decoder", __FUNCTION__);
+        } else {
+            auto hwDecoder = std::make_unique<V4l2M2mMjpegDecoder>(
+                    decCfg.devicePath, createSoftware());
+            if (hwDecoder->initialize() == 0) {
+                decoder = std::move(hwDecoder);
+            } else {
+                ALOGW("%s: V4L2 M2M MJPEG decoder %s unavailable, using software decode",
+                        __FUNCTION__, decCfg.devicePath.c_str());
+            }
+        }
+        if (decoder == nullptr) {
+            decoder = createSoftware();
+        }
+    } else if (decCfg.type == "parallel") {
+        decoder = createSoftware();
+    } else {
+        if (decCfg.type != "libyuv") {
+            ALOGW("%s: unknown MJPEG decoder type '%s'", __FUNCTION__, decCfg.type.c_str());
+        }
+        decoder = std::make_unique<LibyuvMjpegDecoder>();
+    }
+    ALOGI("%s: using %s MJPEG decoder", __FUNCTION__, decoder->getName());
+    return decoder;
+}
+
+int LibyuvMjpegDecoder::decode(const uint8_t* inData, size_t inDataSize,
+        uint32_t width, uint32_t height, const YCbCrLayout& out) {
+    return libyuv::MJPGToI420(
+            inData, inDataSize,
+            static_cast<uint8_t*>(out.y), out.yStride,
+            static_cast<uint8_t*>(out.cb), out.cStride,
+            static_cast<uint8_t*>(out.cr), out.cStride,
+            width, height, width, height);
+}
+
+ParallelMjpegDecoder::ParallelMjpegDecoder(uint32_t numThreads) {
+    // The decode() caller works on strips too, so only spawn numThreads - 1 workers
+    mStripBuffers.resize(std::max(numThreads, 1u));
+    for (size_t i = 0; i + 1 < mStripBuffers.size(); i++) {
+        mWorkers.emplace_back(&ParallelMjpegDecoder::workerLoop, this, i);
+    }
+}
+
+ParallelMjpegDecoder::~ParallelMjpegDecoder() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExit = true;
+    }
+    mWorkCond.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+bool ParallelMjpegDecoder::parseScan(const uint8_t* data, size_t size, ScanInfo* info) {
+    // info is reused from frame to frame: start from a clean one, keeping only the capacity
+    // of rstOffsets
+    std::vector<size_t> rstOffsets = std::move(info->rstOffsets);
+    rstOffsets.clear();
+    *info = ScanInfo();
+    info->rstOffsets = std::move(rstOffsets);
+
+    if (size < 4 || data[0] != kMarkerPrefix || data[1] != kSOI) {
+        return false;
+    }
+
+    bool haveSof = false;
+    uint32_t numComponents = 0;
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != kMarkerPrefix) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == kMarkerPrefix) {
+            pos++; // fill byte
+            continue;
+        }
+        size_t len = (data[pos + 2] << 8) | data[pos + 3];
+        if (len < 2 || pos + 2 + len > size) {
+            return false;
+        }
+        const uint8_t* seg = data + pos + 4;
+
+        if (marker == kSOF0 || marker == kSOF1) {
+            if (len < 8) {
+                return false;
+            }
+            info->height = (seg[1] << 8) | seg[2];
+            info->width = (seg[3] << 8) | seg[4];
+            numComponents = seg[5];
+            if (numComponents == 0 || len < 8 + 3 * numComponents) {
+                return false;
+            }
+            uint32_t maxH = 1, maxV = 1;
+            for (uint32_t i = 0; i < numComponents; i++) {
+                uint8_t sampling = seg[6 + 3 * i + 1];
+                maxH = std::max<uint32_t>(maxH, sampling >> 4);
+                maxV = std::max<uint32_t>(maxV, sampling & 0xF);
+            }
+            info->mcuWidth = 8 * maxH;
+            info->mcuHeight = 8 * maxV;
+            info->sofOffset = pos;
+            haveSof = true;
+        } else if (isUnsupportedSof(marker)) {
+            // progressive, lossless or arithmetic coded
+            return false;
+        } else if (marker == kDRI) {
+            if (len < 4) {
+                return false;
+            }
+            info->restartInterval = (seg[0] << 8) | seg[1];
+        } else if (marker == kSOS) {
+            // Only a single scan with all components interleaved can be split
+            if (!haveSof || seg[0] != numComponents) {
+                return false;
+            }
+            info->sosEnd = pos + 2 + len;
+            break;
+        }
+        pos += 2 + len;
+    }
+    if (info->sosEnd == 0 || info->sosEnd <= info->sofOffset) {
+        return false;
+    }
+
+    // Walk the entropy coded data for restart markers
+    info->eoiOffset = size;
+    const uint8_t* cur = data + info->sosEnd;
+    const uint8_t* end = data + size;
+    while (cur + 1 < end) {
+        cur = static_cast<const uint8_t*>(memchr(cur, kMarkerPrefix, end - cur - 1));
+        if (cur == nullptr) {
+            break;
+        }
+        uint8_t marker = cur[1];
+        if (marker == 0x00) {
+            cur += 2; // stuffed 0xFF data byte
+        } else if (marker == kMarkerPrefix) {
+            cur += 1; // fill byte
+        } else if (marker >= kRST0 && marker <= kRST7) {
+            info->rstOffsets.push_back(cur - data);
+            cur += 2;
+        } else if (marker == kEOI) {
+            info->eoiOffset = cur - data;
+            break;
+        } else {
+            // DNL or a second scan, neither of which we can split
+            return false;
+        }
+    }
+    return true;
+}
+
+int ParallelMjpegDecoder::decode(const uint8_t* inData, size_t inDataSize,
+        uint32_t width, uint32_t height, const YCbCrLayout& out) {
+    // No strip is pending here, so workers don't touch mScan
+    if (mWorkers.empty() || !parseScan(inData, inDataSize, &mScan) ||
+            mScan.width != width || mScan.height != height) {
+        return mFallback.decode(inData, inDataSize, width, height, out);
+    }
+
+    // Strips must start at a restart marker and cover whole MCU rows
+    uint32_t mcusPerRow = (width + mScan.mcuWidth - 1) / mScan.mcuWidth;
+    uint32_t mcuRows = (height + mScan.mcuHeight - 1) / mScan.mcuHeight;
+    if (mScan.restartInterval == 0 || (mScan.restartInterval % mcusPerRow) != 0) {
+        ALOGV("%s: restart interval %u is not a multiple of MCU row (%u MCUs)",
+                __FUNCTION__, mScan.restartInterval, mcusPerRow);
+        return mFallback.decode(inData, inDataSize, width, height, out);
+    }
+    uint32_t rowsPerInterval = mScan.restartInterval / mcusPerRow;
+    size_t numIntervals = mScan.rstOffsets.size() + 1;
+    if (numIntervals != (mcuRows + rowsPerInterval - 1) / rowsPerInterval) {
+        // Truncated or corrupt frame; let libyuv deal with it
+        return mFallback.decode(inData, inDataSize, width, height, out);
+    }
+    size_t numStrips = std::min(mStripBuffers.size(), numIntervals);
+    if (numStrips < 2) {
+        return mFallback.decode(inData, inDataSize, width, height, out);
+    }
+
+    ATRACE_CALL();
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mData = inData;
+        mOut = out;
+        mWidth = width;
+        mStrips.resize(numStrips);
+        for (size_t i = 0; i < numStrips; i++) {
+            Strip& strip = mStrips[i];
+            strip.firstInterval = i * numIntervals / numStrips;
+            strip.endInterval = (i + 1) * numIntervals / numStrips;
+            strip.rowStart = strip.firstInterval * rowsPerInterval * mScan.mcuHeight;
+            uint32_t rowEnd = std::min<uint32_t>(
+                    strip.endInterval * rowsPerInterval * mScan.mcuHeight, height);
+            strip.rows = rowEnd - strip.rowStart;
+            strip.result = -1;
+        }
+        mNextStrip = 0;
+        mPendingStrips = numStrips;
+    }
+    mWorkCond.notify_all();
+
+    while (decodeNextStrip(/*workerIdx*/0)) {}
+
+    std::unique_lock<std::mutex> lk(mLock);
+    mDoneCond.wait(lk, [this] { return mPendingStrips == 0; });
+    for (const auto& strip : mStrips) {
+        if (strip.result != 0) {
+            ALOGE("%s: decode strip at row %u failed: %d",
+                    __FUNCTION__, strip.rowStart, strip.result);
+            return strip.result;
+        }
+    }
+    return 0;
+}
+
+void ParallelMjpegDecoder::workerLoop(size_t workerIdx) {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (true) {
+        mWorkCond.wait(lk, [this] { return mExit || mNextStrip < mStrips.size(); });
+        if (mExit) {
+            return;
+        }
+        lk.unlock();
+        decodeNextStrip(workerIdx + 1);
+        lk.lock();
+    }
+}
+
+bool ParallelMjpegDecoder::decodeNextStrip(size_t workerIdx) {
+    std::unique_lock<std::mutex> lk(mLock);
+    if (mNextStrip >= mStrips.size()) {
+        return false;
+    }
+    size_t idx = mNextStrip++;
+    Strip strip = mStrips[idx];
+    lk.unlock();
+
+    int res = decodeStrip(strip, &mStripBuffers[workerIdx]);
+
+    lk.lock();
+    mStrips[idx].result = res;
+    mPendingStrips--;
+    if (mPendingStrips == 0) {
+        lk.unlock();
+        mDoneCond.notify_all();
+    }
+    return true;
+}
+
+int ParallelMjpegDecoder::decodeStrip(const Strip& strip, std::vector<uint8_t>* buf) {
+    ATRACE_CALL();
+    // Rebuild the strip as a standalone JPEG: the original headers with the strip height
+    // in SOF, then the strip's restart intervals with RSTn renumbered from RST0.
+    buf->assign(mData, mData + mScan.sosEnd);
+    (*buf)[mScan.sofOffset + 5] = (strip.rows >> 8) & 0xFF;
+    (*buf)[mScan.sofOffset + 6] = strip.rows & 0xFF;
+
+    size_t start = (strip.firstInterval == 0) ?
+            mScan.sosEnd : mScan.rstOffsets[strip.firstInterval - 1] + 2;
+    uint8_t rst = 0;
+    for (size_t i = strip.firstInterval; i < strip.endInterval; i++) {
+        size_t end = (i < mScan.rstOffsets.size()) ? mScan.rstOffsets[i] : mScan.eoiOffset;
+        buf->insert(buf->end(), mData + start, mData + end);
+        if (i + 1 < strip.endInterval) {
+            buf->push_back(kMarkerPrefix);
+            buf->push_back(kRST0 + (rst & 0x7));
+            rst++;
+        }
+        start = end + 2;
+    }
+    buf->push_back(kMarkerPrefix);
+    buf->push_back(kEOI);
+
+    return libyuv::MJPGToI420(
+            buf->data(), buf->size(),
+            static_cast<uint8_t*>(mOut.y) + strip.rowStart * mOut.yStride, mOut.yStride,
+            static_cast<uint8_t*>(mOut.cb) + strip.rowStart / 2 * mOut.cStride, mOut.cStride,
+            static_cast<uint8_t*>(mOut.cr) + strip.rowStart / 2 * mOut.cStride, mOut.cStride,
+            mWidth, strip.rows, mWidth, strip.rows);
+}
+
+V4l2M2mMjpegDecoder::V4l2M2mMjpegDecoder(
+        const std::string& devicePath, std::unique_ptr<MjpegDecoder> fallback) :
+        mDevicePath(devicePath), mFallback(std::move(fallback)) {}
+
+V4l2M2mMjpegDecoder::~V4l2M2mMjpegDecoder() {
+    teardown();
+}
+
+int V4l2M2mMjpegDecoder::initialize() {
+    mFd.reset(TEMP_FAILURE_RETRY(open(mDevicePath.c_str(), O_RDWR | O_NONBLOCK)));
+    if (mFd.get() < 0) {
+        ALOGE("%s: open %s failed: %s", __FUNCTION__, mDevicePath.c_str(), strerror(errno));
+        return -errno;
+    }
+
+    struct v4l2_capability capability {};
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QUERYCAP, &capability)) < 0) {
+        ALOGE("%s: QUERYCAP on %s failed: %s", __FUNCTION__, mDevicePath.c_str(),
+                strerror(errno));
+        mFd.reset();
+        return -EINVAL;
+    }
+    uint32_t caps = (capability.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+            capability.device_caps : capability.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_M2M_MPLANE) || !(caps & V4L2_CAP_STREAMING)) {
+        ALOGE("%s: %s is not a multi-planar M2M device (caps 0x%x)", __FUNCTION__,
+                mDevicePath.c_str(), caps);
+        mFd.reset();
+        return -EINVAL;
+    }
+
+    struct v4l2_fmtdesc fmtdesc {};
+    fmtdesc.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    while (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_ENUM_FMT, &fmtdesc)) == 0) {
+        if (fmtdesc.pixelformat == V4L2_PIX_FMT_MJPEG ||
+                fmtdesc.pixelformat == V4L2_PIX_FMT_JPEG) {
+            return 0;
+        }
+        fmtdesc.index++;
+    }
+    ALOGE("%s: %s does not decode JPEG", __FUNCTION__, mDevicePath.c_str());
+    mFd.reset();
+    return -EINVAL;
+}
+
+int V4l2M2mMjpegDecoder::decode(const uint8_t* inData, size_t inDataSize,
+        uint32_t width, uint32_t height, const YCbCrLayout& out) {
+    if (mFd.get() >= 0 && configure(width, height, inDataSize) == 0) {
+        ATRACE_NAME("V4L2 M2M decode");
+        int ret = decodeFrame(inData, inDataSize, out);
+        if (ret == 0) {
+            return 0;
+        }
+        if (ret != -ENOSPC) {
+            // Buffers may be stuck in the driver; start over on next frame
+            teardown();
+        }
+    }
+    return mFallback->decode(inData, inDataSize, width, height, out);
+}
+
+int V4l2M2mMjpegDecoder::configure(uint32_t width, uint32_t height, size_t inDataSize) {
+    if (mConfigured && mWidth == width && mHeight == height && inDataSize <= mOutputBuf.length) {
+        return 0;
+    }
+    teardown();
+
+    struct v4l2_format fmt {};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.width = width;
+    fmt.fmt.pix_mp.height = height;
+    fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_MJPEG;
+    fmt.fmt.pix_mp.num_planes = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage =
+            std::max<size_t>(inDataSize, /*2 bytes per pixel*/ width * height * 2);
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_S_FMT, &fmt)) < 0) {
+        fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_JPEG;
+        if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_S_FMT, &fmt)) < 0) {
+            ALOGE("%s: S_FMT on output queue failed: %s", __FUNCTION__, strerror(errno));
+            return -errno;
+        }
+    }
+
+    fmt = {};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    fmt.fmt.pix_mp.width = width;
+    fmt.fmt.pix_mp.height = height;
+    fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_YUV420;
+    fmt.fmt.pix_mp.num_planes = 1;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_S_FMT, &fmt)) < 0) {
+        ALOGE("%s: S_FMT on capture queue failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+    if ((fmt.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_YUV420 &&
+            fmt.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_NV12) ||
+            fmt.fmt.pix_mp.num_planes != 1 ||
+            fmt.fmt.pix_mp.width < width || fmt.fmt.pix_mp.height < height) {
+        ALOGE("%s: unsupported capture format 0x%x %dx%d (%d planes)", __FUNCTION__,
+                fmt.fmt.pix_mp.pixelformat, fmt.fmt.pix_mp.width, fmt.fmt.pix_mp.height,
+                fmt.fmt.pix_mp.num_planes);
+        return -EINVAL;
+    }
+    mCaptureFourcc = fmt.fmt.pix_mp.pixelformat;
+    mCaptureStride = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    mCaptureHeight = fmt.fmt.pix_mp.height;
+
+    struct QueueSetup {
+        v4l2_buf_type type;
+        MappedBuffer* buf;
+    } queues[] = {
+        {V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, &mOutputBuf},
+        {V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, &mCaptureBuf},
+    };
+    for (auto& q : queues) {
+        v4l2_requestbuffers reqBuffers {};
+        reqBuffers.type = q.type;
+        reqBuffers.memory = V4L2_MEMORY_MMAP;
+        reqBuffers.count = 1;
+        if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_REQBUFS, &reqBuffers)) < 0 ||
+                reqBuffers.count < 1) {
+            ALOGE("%s: REQBUFS type %d failed: %s", __FUNCTION__, q.type, strerror(errno));
+            teardown();
+            return -EINVAL;
+        }
+
+        v4l2_plane plane {};
+        v4l2_buffer buffer {};
+        buffer.type = q.type;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = 0;
+        buffer.m.planes = &plane;
+        buffer.length = 1;
+        if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QUERYBUF, &buffer)) < 0) {
+            ALOGE("%s: QUERYBUF type %d failed: %s", __FUNCTION__, q.type, strerror(errno));
+            teardown();
+            return -EINVAL;
+        }
+        void* addr = mmap(nullptr, plane.length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                mFd.get(), plane.m.mem_offset);
+        if (addr == MAP_FAILED) {
+            ALOGE("%s: mmap type %d failed: %s", __FUNCTION__, q.type, strerror(errno));
+            teardown();
+            return -EINVAL;
+        }
+        q.buf->addr = addr;
+        q.buf->length = plane.length;
+    }
+
+    if (mCaptureBuf.length < static_cast<size_t>(mCaptureStride) * mCaptureHeight * 3 / 2) {
+        ALOGE("%s: capture buffer too small: %zu", __FUNCTION__, mCaptureBuf.length);
+        teardown();
+        return -EINVAL;
+    }
+
+    for (auto& q : queues) {
+        int type = q.type;
+        if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_STREAMON, &type)) < 0) {
+            ALOGE("%s: STREAMON type %d failed: %s", __FUNCTION__, type, strerror(errno));
+            teardown();
+            return -EINVAL;
+        }
+    }
+
+    mWidth = width;
+    mHeight = height;
+    mConfigured = true;
+    ALOGI("%s: V4L2 M2M decoder configured %dx%d, capture fourcc 0x%x stride %d",
+            __FUNCTION__, width, height, mCaptureFourcc, mCaptureStride);
+    return 0;
+}
+
+void V4l2M2mMjpegDecoder::teardown() {
+    if (mFd.get() < 0) {
+        return;
+    }
+    const v4l2_buf_type types[] = {
+            V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE};
+    MappedBuffer* bufs[] = {&mOutputBuf, &mCaptureBuf};
+    for (size_t i = 0; i < 2; i++) {
+        int type = types[i];
+        TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_STREAMOFF, &type));
+        if (bufs[i]->addr != nullptr) {
+            munmap(bufs[i]->addr, bufs[i]->length);
+            *bufs[i] = MappedBuffer{};
+        }
+        v4l2_requestbuffers reqBuffers {};
+        reqBuffers.type = types[i];
+        reqBuffers.memory = V4L2_MEMORY_MMAP;
+        reqBuffers.count = 0;
+        TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_REQBUFS, &reqBuffers));
+    }
+    mConfigured = false;
+}
+
+int V4l2M2mMjpegDecoder::decodeFrame(
+        const uint8_t* inData, size_t inDataSize, const YCbCrLayout& out) {
+    // The driver may allocate less than the sizeimage asked for in configure()
+    if (inDataSize > mOutputBuf.length) {
+        ALOGW("%s: frame of %zu bytes does not fit the %zu bytes output buffer", __FUNCTION__,
+                inDataSize, mOutputBuf.length);
+        return -ENOSPC;
+    }
+    memcpy(mOutputBuf.addr, inData, inDataSize);
+
+    v4l2_plane plane {};
+    v4l2_buffer buffer {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = 0;
+    buffer.m.planes = &plane;
+    buffer.length = 1;
+    plane.bytesused = inDataSize;
+    plane.length = mOutputBuf.length;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+        ALOGE("%s: QBUF output failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+
+    plane = {};
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    plane.length = mCaptureBuf.length;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_QBUF, &buffer)) < 0) {
+        ALOGE("%s: QBUF capture failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+
+    struct pollfd pfd = {mFd.get(), POLLIN, 0};
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, kDecodeTimeoutMs));
+    if (ret <= 0) {
+        ALOGE("%s: wait for decoded frame %s", __FUNCTION__,
+                (ret == 0) ? "timeout" : strerror(errno));
+        return -ETIMEDOUT;
+    }
+
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
+        ALOGE("%s: DQBUF capture failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+    bool decodeError = (buffer.flags & V4L2_BUF_FLAG_ERROR) != 0;
+
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    if (TEMP_FAILURE_RETRY(ioctl(mFd.get(), VIDIOC_DQBUF, &buffer)) < 0) {
+        ALOGE("%s: DQBUF output failed: %s", __FUNCTION__, strerror(errno));
+        return -errno;
+    }
+    if (decodeError) {
+        ALOGE("%s: decoder reported a corrupt frame", __FUNCTION__);
+        return -EIO;
+    }
+
+    const uint8_t* y = static_cast<uint8_t*>(mCaptureBuf.addr);
+    const uint8_t* chroma = y + mCaptureStride * mCaptureHeight;
+    if (mCaptureFourcc == V4L2_PIX_FMT_NV12) {
+        return libyuv::NV12ToI420(
+                y, mCaptureStride, chroma, mCaptureStride,
+                static_cast<uint8_t*>(out.y), out.yStride,
+                static_cast<uint8_t*>(out.cb), out.cStride,
+                static_cast<uint8_t*>(out.cr), out.cStride,
+                mWidth, mHeight);
+    }
+    const uint32_t cStride = mCaptureStride / 2;
+    return libyuv::I420Copy(
+            y, mCaptureStride,
+            chroma, cStride,
+            chroma + cStride * (mCaptureHeight / 2), cStride,
+            static_cast<uint8_t*>(out.y), out.yStride,
+            static_cast<uint8_t*>(out.cb), out.cStride,
+            static_cast<uint8_t*>(out.cr), out.cStride,
+            mWidth, mHeight);
+}
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -18,6 +18,7 @@
 #include <log/log.h>
 
 #include <cmath>
+#include <stdio.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
 #include "ExternalCameraUtils.h"
@@ -139,6 +140,116 @@ int AllocatedFrame::getCroppedLayout(const IMapper::Rect& rect, YCbCrLayout* out
     return 0;
 }
 
+AllocatedFramePool::AllocatedFramePool(size_t maxIdleBytes) : mMaxIdleBytes(maxIdleBytes) {}
+
+sp<AllocatedFrame> AllocatedFramePool::acquire(uint32_t w, uint32_t h) {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (auto it = mIdleFrames.begin(); it != mIdleFrames.end(); it++) {
+            if ((*it)->mWidth == w && (*it)->mHeight == h) {
+                sp<AllocatedFrame> frame = *it;
+                mIdleFrames.erase(it);
+                mIdleBytes -= getFrameBytes(w, h);
+                mHits++;
+                return frame;
+            }
+        }
+        mMisses++;
+    }
+
+    sp<AllocatedFrame> frame = new AllocatedFrame(w, h);
+    if (frame->allocate() != 0) {
+        ALOGE("%s: allocating %dx%d frame failed!", __FUNCTION__, w, h);
+        return nullptr;
+    }
+    return frame;
+}
+
+void AllocatedFramePool::release(const sp<AllocatedFrame>& frame) {
+    if (frame == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lk(mLock);
+    size_t frameBytes = getFrameBytes(frame->mWidth, frame->mHeight);
+    if (frameBytes > mMaxIdleBytes) {
+        mEvictions++;
+        return;
+    }
+    mIdleFrames.push_front(frame);
+    mIdleBytes += frameBytes;
+    while (mIdleBytes > mMaxIdleBytes) {
+        const sp<AllocatedFrame>& oldest = mIdleFrames.back();
+        mIdleBytes -= getFrameBytes(oldest->mWidth, oldest->mHeight);
+        mIdleFrames.pop_back();
+        mEvictions++;
+    }
+}
+
+void AllocatedFramePool::dump(int fd) {
+    std::lock_guard<std::mutex> lk(mLock);
+    uint64_t requests = mHits + mMisses;
+    dprintf(fd, "Intermediate frame pool: %zu idle frames (%zu/%zu bytes), "
+            "hits %" PRIu64 ", misses %" PRIu64 ", hit rate %.1f%%, evictions %" PRIu64 "\n",
+            mIdleFrames.size(), mIdleBytes, mMaxIdleBytes, mHits, mMisses,
+            requests == 0 ? 0.0 : 100.0 * mHits / requests, mEvictions);
+    for (const auto& frame : mIdleFrames) {
+        dprintf(fd, "  idle %dx%d\n", frame->mWidth, frame->mHeight);
+    }
+}
+
+TaskFanOut::TaskFanOut(uint32_t numThreads) {
+    for (uint32_t i = 1; i < numThreads; i++) {
+        mWorkers.emplace_back(&TaskFanOut::workerLoop, this);
+    }
+}
+
+TaskFanOut::~TaskFanOut() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExit = true;
+    }
+    mWorkCond.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void TaskFanOut::run(size_t numTasks, const std::function<void(size_t)>& task) {
+    std::unique_lock<std::mutex> lk(mLock);
+    mTask = &task;
+    mNumTasks = numTasks;
+    mNextTask = 0;
+    mPendingTasks = numTasks;
+    mWorkCond.notify_all();
+    while (runNextTask(lk)) {}
+    mDoneCond.wait(lk, [this] { return mPendingTasks == 0; });
+    mTask = nullptr;
+}
+
+bool TaskFanOut::runNextTask(std::unique_lock<std::mutex>& lk) {
+    if (mTask == nullptr || mNextTask >= mNumTasks) {
+        return false;
+    }
+    size_t idx = mNextTask++;
+    const std::function<void(size_t)>& task = *mTask;
+    lk.unlock();
+    task(idx);
+    lk.lock();
+    if (--mPendingTasks == 0) {
+        mDoneCond.notify_all();
+    }
+    return true;
+}
+
+void TaskFanOut::workerLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (!mExit) {
+        if (!runNextTask(lk)) {
+            mWorkCond.wait(lk);
+        }
+    }
+}
+
 bool isAspectRatioClose(float ar1, float ar2) {
     const float kAspectRatioMatchThres = 0.025f; // This threshold is good enough to distinguish
                                                 // 4:3/16:9/20:9
@@ -162,8 +273,16 @@ namespace {
     const int kDefaultJpegBufSize = 5 << 20; // 5MB
     const int kDefaultNumVideoBuffer = 4;
     const int kDefaultNumStillBuffer = 2;
+    const int kDefaultMaxV4l2Buffers = 8;
     const int kDefaultOrientation = 0; // suitable for natural landscape displays like tablet/TV
                                        // For phone devices 270 is better
+    const int kDefaultOutputPipelineDepth = 0; // serial output processing
+    const char* kDefaultMjpegDecoder = "libyuv";
+    const int kDefaultMjpegDecodeThreads = 4;
+    const int kDefaultJpegEncodeThreads = 1; // single threaded encode
+    const uint32_t kDefaultFramePoolMaxIdleBytes = 32 << 20; // 32MB
+    const uint32_t kDefaultResultBatchSize = 1; // no batching
+    const uint32_t kDefaultOutputThreads = 1; // YUV outputs filled one after another
 } // anonymous namespace
 
 const char* ExternalCameraConfig::kDefaultCfgPath = "/vendor/etc/external_camera_config.xml";
@@ -240,6 +359,15 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
                 numStillBuf->UnsignedAttribute("count", /*Default*/kDefaultNumStillBuffer);
     }
 
+    XMLElement *adaptiveBuf = deviceCfg->FirstChildElement("AdaptiveV4l2Buffers");
+    if (adaptiveBuf == nullptr) {
+        ALOGI("%s: no adaptive v4l2 buffers specified", __FUNCTION__);
+    } else {
+        ret.adaptiveV4l2Buffers = adaptiveBuf->BoolAttribute("enabled", /*Default*/false);
+        ret.maxV4l2Buffers =
+                adaptiveBuf->UnsignedAttribute("max", /*Default*/kDefaultMaxV4l2Buffers);
+    }
+
     XMLElement *fpsList = deviceCfg->FirstChildElement("FpsList");
     if (fpsList == nullptr) {
         ALOGI("%s: no fps list specified", __FUNCTION__);
@@ -284,10 +412,103 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         ret.orientation = orientation->IntAttribute("degree", /*Default*/kDefaultOrientation);
     }
 
+    XMLElement *outputPipeline = deviceCfg->FirstChildElement("OutputPipeline");
+    if (outputPipeline == nullptr) {
+        ALOGI("%s: no output pipeline depth specified", __FUNCTION__);
+    } else {
+        ret.outputPipelineDepth = outputPipeline->UnsignedAttribute(
+                "depth", /*Default*/kDefaultOutputPipelineDepth);
+    }
+
+    XMLElement *mjpegDecoder = deviceCfg->FirstChildElement("MjpegDecoder");
+    if (mjpegDecoder == nullptr) {
+        ALOGI("%s: no MJPEG decoder specified", __FUNCTION__);
+    } else {
+        const char* type = mjpegDecoder->Attribute("type");
+        if (type != nullptr) {
+            ret.mjpegDecoder.type = type;
+        }
+        ret.mjpegDecoder.numThreads = mjpegDecoder->UnsignedAttribute(
+                "threads", /*Default*/kDefaultMjpegDecodeThreads);
+        const char* device = mjpegDecoder->Attribute("device");
+        if (device != nullptr) {
+            ret.mjpegDecoder.devicePath = device;
+        }
+    }
+
+    XMLElement *scaleFilter = deviceCfg->FirstChildElement("ScaleFilter");
+    if (scaleFilter == nullptr) {
+        ALOGI("%s: no scale filter specified", __FUNCTION__);
+    } else {
+        if (scaleFilter->Attribute("mode", "linear")) {
+            ret.scaleFilter = SCALE_FILTER_LINEAR;
+        } else if (scaleFilter->Attribute("mode", "bilinear")) {
+            ret.scaleFilter = SCALE_FILTER_BILINEAR;
+        } else if (scaleFilter->Attribute("mode", "box")) {
+            ret.scaleFilter = SCALE_FILTER_BOX;
+        } else if (!scaleFilter->Attribute("mode", "none")) {
+            ALOGW("%s: unknown scale filter, using none", __FUNCTION__);
+        }
+    }
+
+    XMLElement *jpegEncoder = deviceCfg->FirstChildElement("JpegEncoder");
+    if (jpegEncoder == nullptr) {
+        ALOGI("%s: no JPEG encoder threads specified", __FUNCTION__);
+    } else {
+        ret.jpegEncodeThreads = jpegEncoder->UnsignedAttribute(
+                "threads", /*Default*/kDefaultJpegEncodeThreads);
+    }
+
+    XMLElement *framePool = deviceCfg->FirstChildElement("FramePool");
+    if (framePool == nullptr) {
+        ALOGI("%s: no frame pool size specified", __FUNCTION__);
+    } else {
+        ret.framePoolMaxIdleBytes = framePool->UnsignedAttribute(
+                "maxIdleBytes", /*Default*/kDefaultFramePoolMaxIdleBytes);
+    }
+
+    XMLElement *mappingCache = deviceCfg->FirstChildElement("BufferMappingCache");
+    if (mappingCache == nullptr) {
+        ALOGI("%s: no buffer mapping cache specified", __FUNCTION__);
+    } else {
+        ret.cacheBufferMappings = mappingCache->BoolAttribute("enabled", /*Default*/false);
+    }
+
+    XMLElement *resultBatching = deviceCfg->FirstChildElement("ResultBatching");
+    if (resultBatching == nullptr) {
+        ALOGI("%s: no result batch size specified", __FUNCTION__);
+    } else {
+        ret.resultBatchSize = resultBatching->UnsignedAttribute(
+                "size", /*Default*/kDefaultResultBatchSize);
+        if (ret.resultBatchSize == 0) {
+            ALOGW("%s: invalid result batch size 0, disabling batching", __FUNCTION__);
+            ret.resultBatchSize = 1;
+        }
+    }
+
+    XMLElement *outputFanOut = deviceCfg->FirstChildElement("OutputFanOut");
+    if (outputFanOut == nullptr) {
+        ALOGI("%s: no output fan-out threads specified", __FUNCTION__);
+    } else {
+        ret.outputThreads = outputFanOut->UnsignedAttribute(
+                "threads", /*Default*/kDefaultOutputThreads);
+        if (ret.outputThreads == 0) {
+            ALOGW("%s: invalid output fan-out threads 0, using 1", __FUNCTION__);
+            ret.outputThreads = 1;
+        }
+    }
+
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
-            " num video buffers %d, num still buffers %d, orientation %d",
+            " num video buffers %d, num still buffers %d, adaptive v4l2 buffers %d (max %u),"
+            " orientation %d,"
+            " output pipeline depth %d, scale filter %d, jpeg encode threads %d,"
+            " frame pool max idle bytes %u, buffer mapping cache %d, result batch size %u,"
+            " output threads %u",
             __FUNCTION__, ret.maxJpegBufSize,
-            ret.numVideoBuffers, ret.numStillBuffers, ret.orientation);
+            ret.numVideoBuffers, ret.numStillBuffers, ret.adaptiveV4l2Buffers,
+            ret.maxV4l2Buffers, ret.orientation, ret.outputPipelineDepth, ret.scaleFilter, ret.jpegEncodeThreads,
+            ret.framePoolMaxIdleBytes, ret.cacheBufferMappings, ret.resultBatchSize,
+            ret.outputThreads);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__,
                 limit.size.width, limit.size.height, limit.fpsUpperBound);
@@ -298,6 +519,9 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
     }
     ALOGI("%s: minStreamSize: %dx%d" , __FUNCTION__,
          ret.minStreamSize.width, ret.minStreamSize.height);
+    ALOGI("%s: MJPEG decoder %s, threads %d, device '%s'", __FUNCTION__,
+            ret.mjpegDecoder.type.c_str(), ret.mjpegDecoder.numThreads,
+            ret.mjpegDecoder.devicePath.c_str());
     return ret;
 }
 
@@ -333,12 +557,23 @@ ExternalCameraConfig::ExternalCameraConfig() :
         maxJpegBufSize(kDefaultJpegBufSize),
         numVideoBuffers(kDefaultNumVideoBuffer),
         numStillBuffers(kDefaultNumStillBuffer),
+        adaptiveV4l2Buffers(false),
+        maxV4l2Buffers(kDefaultMaxV4l2Buffers),
         depthEnabled(false),
-        orientation(kDefaultOrientation) {
+        orientation(kDefaultOrientation),
+        outputPipelineDepth(kDefaultOutputPipelineDepth),
+        scaleFilter(SCALE_FILTER_NONE),
+        jpegEncodeThreads(kDefaultJpegEncodeThreads),
+        cacheBufferMappings(false),
+        framePoolMaxIdleBytes(kDefaultFramePoolMaxIdleBytes),
+        resultBatchSize(kDefaultResultBatchSize),
+        outputThreads(kDefaultOutputThreads) {
     fpsLimits.push_back({/*Size*/{ 640,  480}, /*FPS upper bound*/30.0});
     fpsLimits.push_back({/*Size*/{1280,  720}, /*FPS upper bound*/7.5});
     fpsLimits.push_back({/*Size*/{1920, 1080}, /*FPS upper bound*/5.0});
     minStreamSize = {0, 0};
+    mjpegDecoder.type = kDefaultMjpegDecoder;
+    mjpegDecoder.numThreads = kDefaultMjpegDecodeThreads;
 }
 
 
@@ -20,6 +20,7 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android/hardware/camera/device/3.4/ICameraDeviceSession.h>
 #include <fmq/MessageQueue.h>
+#include <hal-metrics/Metrics.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <include/convert.h>
@@ -35,6 +36,7 @@
 #include "utils/Mutex.h"
 #include "utils/Thread.h"
 #include "android-base/unique_fd.h"
+#include "ExternalCameraMjpegDecoder.h"
 #include "ExternalCameraUtils.h"
 
 namespace android {
@@ -166,6 +168,8 @@ protected:
         uint32_t frameNumber;
         common::V1_0::helper::CameraMetadata setting;
         sp<V4L2Frame> frameIn;
+        sp<AllocatedFrame> yu12Frame; // frameIn decoded to YU12, set by OutputThread
+        bool yu12FrameFilled = false; // raw YUV frameIn are only converted to yu12Frame on demand
         nsecs_t shutterTs;
         std::vector<HalStreamBuffer> buffers;
     };
@@ -184,6 +188,9 @@ protected:
     Status initStatus() const;
     status_t initDefaultRequests();
     status_t fillCaptureResult(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp);
+    // Copy mLatestReqSetting into out with enough capacity left for fillCaptureResult to
+    // update the result tags in place, sized from the previous capture result.
+    void initCaptureResultLocked(common::V1_0::helper::CameraMetadata* out);
     Status configureStreams(const V3_2::StreamConfiguration&,
             V3_3::HalStreamConfiguration* out,
             // Only filled by configureStreams_3_4, and only one blob stream supported
@@ -238,10 +245,14 @@ protected:
 
     Status processCaptureResult(std::shared_ptr<HalRequest>&);
     Status processCaptureRequestError(const std::shared_ptr<HalRequest>&);
+    static NotifyMsg makeShutterMsg(uint32_t frameNumber, nsecs_t shutterTs);
+    static NotifyMsg makeErrorMsg(uint32_t frameNumber, int32_t streamId, ErrorCode ec);
     void notifyShutter(uint32_t frameNumber, nsecs_t shutterTs);
     void notifyError(uint32_t frameNumber, int32_t streamId, ErrorCode ec);
     void invokeProcessCaptureResultCallback(
             hidl_vec<CaptureResult> &results, bool tryWriteFmq);
+    // Send the batched notifications and results. Caller must hold mResultBatchLock
+    void sendResultBatchLocked();
     static void freeReleaseFences(hidl_vec<CaptureResult>&);
 
     Size getMaxJpegResolution() const;
@@ -251,6 +262,11 @@ protected:
 
     int waitForV4L2BufferReturnLocked(std::unique_lock<std::mutex>& lk);
 
+    // Number of V4L2 buffers to request when streaming at fps
+    uint32_t getV4l2BufferCountLocked(double fps);
+    // Maximal number of V4L2 buffers requests may hold at once
+    size_t getMaxDequeuedV4l2BuffersLocked() const;
+
     class OutputThread : public android::Thread {
     public:
         OutputThread(wp<ExternalCameraDeviceSession> parent, CroppingType);
@@ -267,7 +283,72 @@ protected:
 
         void setExifMakeModel(const std::string& make, const std::string& model);
 
+        // Must be called before the thread starts running. A depth of 0 keeps all output
+        // processing on this thread; otherwise this thread only decodes V4L2 frames and
+        // hands them to the downstream YUV output and JPEG/result stages.
+        void setPipelineDepth(uint32_t depth);
+
+        // Must be called before the thread starts running.
+        void setMjpegDecoder(std::unique_ptr<MjpegDecoder> decoder);
+
+        // Must be called before allocateIntermediateBuffers.
+        void setFramePoolSize(size_t maxIdleBytes);
+
+        void setScaleFilter(ExternalCameraConfig::ScaleFilter filter);
+
+        void setJpegEncodeThreads(uint32_t numThreads);
+
+        // Must be called before the thread starts running.
+        void setOutputThreads(uint32_t numThreads);
+
+        enum LatencyStage {
+            LATENCY_V4L2_DEQUEUE,   // waiting for and dequeuing a V4L2 buffer
+            LATENCY_DECODE,         // V4L2 frame to YU12
+            LATENCY_CROP_AND_SCALE,
+            LATENCY_FORMAT_CONVERT,
+            LATENCY_CREATE_JPEG,
+            LATENCY_CAPTURE_RESULT, // processCaptureResult callback
+            NUM_LATENCY_STAGES
+        };
+        // Record the time since startTs for stage and return the current time. Can be called
+        // from any thread.
+        nsecs_t recordLatency(LatencyStage stage, nsecs_t startTs);
+
+        virtual void requestExit() override;
+
     protected:
+        typedef std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> AllocatedFrameMap;
+
+        enum PipelineStageId {
+            STAGE_YUV_OUTPUT = 0, // crop/scale/format convert to YUV and Y16 outputs
+            STAGE_JPEG_OUTPUT,    // BLOB outputs and processCaptureResult
+            NUM_PIPELINE_STAGES
+        };
+
+        // A stage of the output pipeline downstream of the decode done in threadLoop.
+        // Requests are handled one at a time in submission order, so result and
+        // shutter ordering is the same as in the serial path.
+        class PipelineStage : public android::Thread {
+        public:
+            PipelineStage(OutputThread* owner, PipelineStageId id, size_t capacity);
+            virtual ~PipelineStage();
+
+            // Blocks while the stage queue is full. Returns non-zero if the stage is exiting.
+            int enqueue(const std::shared_ptr<HalRequest>&);
+            void dump(int fd);
+            virtual void requestExit() override;
+            virtual bool threadLoop() override;
+
+        private:
+            OutputThread* const mOwner; // owner joins this thread before being destroyed
+            const PipelineStageId mId;
+            const size_t mCapacity;
+
+            std::mutex mQueueLock;
+            std::condition_variable mQueueCond; // signaled when mQueue is pushed or popped
+            std::list<std::shared_ptr<HalRequest>> mQueue;
+        };
+
         // Methods to request output buffer in parallel
         // No-op for device@3.4. Implemented in device@3.5
         virtual int requestBufferStart(const std::vector<HalStreamBuffer>&) { return 0; }
@@ -286,13 +367,41 @@ protected:
         static const int kReqWaitTimeoutMs = 33;   // 33ms
         static const int kReqWaitTimesMax = 90;    // 33ms * 90 ~= 3 sec
 
-        void waitForNextRequest(std::shared_ptr<HalRequest>* out);
+        // Sets *flushed if the request was submitted before a pending flush() and must be
+        // returned with an error instead of being processed.
+        void waitForNextRequest(std::shared_ptr<HalRequest>* out, bool* flushed);
         void signalRequestDone();
 
+        // Fill all non-BLOB output buffers of req from req->yu12Frame
+        int processYuvOutputsLocked(const std::shared_ptr<HalRequest>& req);
+        // Fill one non-BLOB output buffer. Can run concurrently for outputs of different
+        // sizes: scaled frames are looked up and kept in scaledFrames, and req->yu12Frame is
+        // only filled with fillLock held.
+        int processYuvOutputLocked(const std::shared_ptr<HalRequest>& req,
+                HalStreamBuffer& halBuf, AllocatedFrameMap& scaledFrames, std::mutex& fillLock);
+        // Fill all BLOB output buffers of req from req->yu12Frame
+        int processJpegOutputsLocked(const std::shared_ptr<HalRequest>& req);
+        // Returns false if the buffer cannot be written (missing buffer or fence timeout)
+        static bool waitForBufferReady(HalStreamBuffer& halBuf);
+
+        // Called by PipelineStage threads. Returns false if the stage should stop.
+        bool processPipelineStage(PipelineStageId id, std::shared_ptr<HalRequest>& req);
+        sp<AllocatedFrame> acquirePipelineFrame();
+        // Return req->yu12Frame to the decoded frame pool
+        void releasePipelineFrame(const std::shared_ptr<HalRequest>& req);
+        // Called once a request handed to the pipeline stages is done (or failed)
+        void finishPipelineRequest(const std::shared_ptr<HalRequest>& req);
+        void waitForPipelineIdle();
+
         int cropAndScaleLocked(
                 sp<AllocatedFrame>& in, const Size& outSize,
                 YCbCrLayout* out);
 
+        int cropAndScaleLocked(
+                sp<AllocatedFrame>& in, const Size& outSize,
+                AllocatedFrameMap& intermediateBuffers, AllocatedFrameMap& scaledFrames,
+                YCbCrLayout* out);
+
         int cropAndScaleThumbLocked(
                 sp<AllocatedFrame>& in, const Size& outSize,
                 YCbCrLayout* out);
@@ -300,24 +409,63 @@ protected:
         int formatConvertLocked(const YCbCrLayout& in, const YCbCrLayout& out,
                 Size sz, uint32_t format);
 
+        // Scale the inSz image at in to outSz at out with mScaleFilter
+        int scaleYu12(const YCbCrLayout& in, const Size& inSz,
+                const YCbCrLayout& out, const Size& outSz);
+
+        static bool isRawYuvFourcc(uint32_t fourcc);
+        // Convert a YUYV or NV12 V4L2 frame of size sz in one pass into an output of the same
+        // size. Returns -EINVAL if there is no direct conversion to outFourcc.
+        static int convertRawYuv(uint32_t inFourcc, const uint8_t* inData, size_t inDataSize,
+                const YCbCrLayout& out, Size sz, uint32_t outFourcc);
+        // true if some output of req must be produced from req->yu12Frame
+        static bool needsYu12Frame(const std::shared_ptr<HalRequest>& req);
+        // Convert raw YUV req->frameIn into req->yu12Frame if not done yet
+        int fillYu12FrameLocked(const std::shared_ptr<HalRequest>& req);
+
+        // restartPerMcuRow inserts a restart marker after every MCU row
         static int encodeJpegYU12(const Size &inSz,
                 const YCbCrLayout& inLayout, int jpegQuality,
                 const void *app1Buffer, size_t app1Size,
                 void *out, size_t maxOutSize,
-                size_t &actualCodeSize);
+                size_t &actualCodeSize, bool restartPerMcuRow = false);
+
+        // Encode horizontal strips of MCU rows on numThreads threads and stitch them into one
+        // JPEG, using a restart marker per MCU row. Falls back to encodeJpegYU12 for images
+        // too small to split.
+        static int encodeJpegYU12Parallel(const Size &inSz,
+                const YCbCrLayout& inLayout, int jpegQuality,
+                const void *app1Buffer, size_t app1Size,
+                void *out, size_t maxOutSize,
+                size_t &actualCodeSize, uint32_t numThreads);
+        // Captures smaller than this are not worth splitting
+        static const uint32_t kParallelJpegMinPixels = 5 * 1000 * 1000;
 
         int createJpegLocked(HalStreamBuffer &halBuf, const std::shared_ptr<HalRequest>& req);
 
         const wp<ExternalCameraDeviceSession> mParent;
         const CroppingType mCroppingType;
 
-        mutable std::mutex mRequestListLock;      // Protect acccess to mRequestList,
-                                                  // mProcessingRequest and mProcessingFrameNumer
+        // Requests queued by processCaptureRequest. Every queued request holds a dequeued V4L2
+        // buffer, so the queue only fills up with more V4L2 buffers than its size; requests
+        // that don't fit then fail in processCaptureRequest.
+        static const size_t kRequestQueueSize = 32;
+        SpscQueue<std::shared_ptr<HalRequest>, kRequestQueueSize> mRequestQueue;
+        // Frame numbers of the queued requests, indexed like mRequestQueue slots; for dump only
+        std::atomic<uint32_t> mQueuedFrameNumbers[kRequestQueueSize] {};
+        // Requests pushed before this index are returned with an error by threadLoop
+        std::atomic<uint64_t> mFlushEnd {0};
+
+        std::mutex mRequestWaitLock;              // only used to sleep on mRequestCond
         std::condition_variable mRequestCond;     // signaled when a new request is submitted
+        std::atomic<bool> mWaitingForRequest {false};
+
+        mutable std::mutex mRequestDoneLock;      // Protect mProcessingRequest,
+                                                  // mProcessingFrameNumer and mRequestsDone
         std::condition_variable mRequestDoneCond; // signaled when a request is done processing
-        std::list<std::shared_ptr<HalRequest>> mRequestList;
         bool mProcessingRequest = false;
         uint32_t mProcessingFrameNumer = 0;
+        uint64_t mRequestsDone = 0;               // number of popped requests that are done
 
         // V4L2 frameIn
         // (MJPG decode)-> mYu12Frame
@@ -326,11 +474,40 @@ protected:
         mutable std::mutex mBufferLock; // Protect access to intermediate buffers
         sp<AllocatedFrame> mYu12Frame;
         sp<AllocatedFrame> mYu12ThumbFrame;
-        std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mIntermediateBuffers;
-        std::unordered_map<Size, sp<AllocatedFrame>, SizeHasher> mScaledYu12Frames;
+        AllocatedFrameMap mIntermediateBuffers;
+        AllocatedFrameMap mScaledYu12Frames;
         YCbCrLayout mYu12FrameLayout;
         YCbCrLayout mYu12ThumbFrameLayout;
         uint32_t mBlobBufferSize = 0; // 0 -> HAL derive buffer size, else: use given size
+        // Source of all intermediate frames, kept across stream configurations
+        std::unique_ptr<AllocatedFramePool> mFramePool;
+        ExternalCameraConfig::ScaleFilter mScaleFilter = ExternalCameraConfig::SCALE_FILTER_NONE;
+        uint32_t mJpegEncodeThreads = 1;
+        // Fills the YUV outputs of different sizes in parallel, null if single threaded
+        std::unique_ptr<TaskFanOut> mOutputFanOut;
+        // Reused by every JPEG capture so bursts only patch the previous APP1 segment. Only
+        // used by the thread producing JPEG outputs.
+        std::unique_ptr<ExifUtils> mExifUtils;
+
+        // Stage latencies, dumped by dump()
+        ::android::hardware::metrics::Registry mMetrics{"camera.external"};
+        ::android::hardware::metrics::Histogram* mLatencyHistograms[NUM_LATENCY_STAGES];
+
+        std::unique_ptr<MjpegDecoder> mMjpegDecoder;
+
+        // Pipelined output only. The YUV output stage uses the intermediate buffers above
+        // under mBufferLock; the JPEG stage uses its own set under mJpegBufferLock.
+        uint32_t mPipelineDepth = 0;
+        sp<PipelineStage> mPipelineStages[NUM_PIPELINE_STAGES];
+        mutable std::mutex mJpegBufferLock; // Protect mYu12ThumbFrame and JPEG stage buffers
+        AllocatedFrameMap mJpegIntermediateBuffers;
+        AllocatedFrameMap mJpegScaledYu12Frames;
+
+        mutable std::mutex mPipelineLock; // Protect decoded frame pool and inflight count
+        std::condition_variable mPipelineCond; // signaled when a pipeline request finishes
+        std::vector<sp<AllocatedFrame>> mPipelineFrames;
+        std::vector<sp<AllocatedFrame>> mFreePipelineFrames;
+        size_t mPipelineInflight = 0;
 
         std::string mExifMake;
         std::string mExifModel;
@@ -360,6 +537,12 @@ protected:
     bool mInitFail = false;
     bool mFirstRequest = false;
     common::V1_0::helper::CameraMetadata mLatestReqSetting;
+    // Entry and data count of the last capture result. Written by the output thread.
+    std::atomic<size_t> mResultEntryCount {0};
+    std::atomic<size_t> mResultDataCount {0};
+    // Room left for the tags fillCaptureResult adds before the first result is known
+    static const size_t kResultExtraEntries = 16;
+    static const size_t kResultExtraData = 64; // bytes
 
     bool mV4l2Streaming = false;
     SupportedV4L2Format mV4l2StreamingFmt;
@@ -370,6 +553,11 @@ protected:
     std::mutex mV4l2BufferLock; // protect the buffer count and condition below
     std::condition_variable mV4L2BufferReturned;
     size_t mNumDequeuedV4l2Buffers = 0;
+    // Dequeue time of each V4L2 buffer, used to measure how long requests hold buffers
+    std::vector<nsecs_t> mV4l2BufferDequeueTs;
+    nsecs_t mAvgV4l2BufferHoldNs = 0;   // moving average over returned buffers
+    uint64_t mNumV4l2BufferStalls = 0;  // dequeues that had to wait for a buffer return
+    nsecs_t mV4l2BufferStallNs = 0;     // total time spent in those waits
     uint32_t mMaxV4L2BufferSize = 0;
 
     // Not protected by mLock (but might be used when mLock is locked)
@@ -377,10 +565,18 @@ protected:
 
     // Stream ID -> Camera3Stream cache
     std::unordered_map<int, Stream> mStreamMap;
+    bool mHasBlobStream = false;
 
     std::mutex mInflightFramesLock; // protect mInflightFrames
     std::unordered_set<uint32_t>  mInflightFrames;
 
+    // Results waiting to be sent in one callback when mCfg.resultBatchSize > 1. A batch is
+    // sent once it is full or no request is left in flight.
+    std::mutex mResultBatchLock; // protect members below, must not lock mInflightFramesLock
+                                 // after acquiring this lock
+    std::vector<NotifyMsg> mBatchedNotifies;
+    std::vector<CaptureResult> mBatchedResults;
+
     // buffers currently circulating between HAL and camera service
     // key: bufferId sent via HIDL interface
     // value: imported buffer_handle_t
@@ -99,8 +99,12 @@ protected:
             const std::string& cameraId,
             unique_fd v4l2Fd);
 
-    // Init supported w/h/format/fps in mSupportedFormats. Caller still owns fd
+    // Init supported w/h/format/fps in mSupportedFormats. Caller still owns fd.
+    // Results of USB cameras are cached across devices, keyed by VID/PID and firmware
+    // revision, so the V4L2 format walk below is only done once per camera model.
     void initSupportedFormatsLocked(int fd);
+    // Enumerate formats, sizes and frame intervals through V4L2. Caller still owns fd
+    void probeSupportedFormatsLocked(int fd);
 
     // Calls into virtual member function. Do not use it in constructor
     status_t initCameraCharacteristics();
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMMJPEGDECODER_H
+#define ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMMJPEGDECODER_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "android-base/unique_fd.h"
+#include "ExternalCameraUtils.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace V3_4 {
+namespace implementation {
+
+using ::android::hardware::camera::external::common::ExternalCameraConfig;
+
+// Decodes V4L2 MJPEG frames into the YU12 intermediate frame of the output thread.
+// A decoder instance is only used by one thread at a time.
+class MjpegDecoder {
+public:
+    virtual ~MjpegDecoder() {}
+
+    // Decode inData into the width x height YU12 image described by out.
+    // Returns 0 on success.
+    virtual int decode(const uint8_t* inData, size_t inDataSize,
+            uint32_t width, uint32_t height, const YCbCrLayout& out) = 0;
+
+    virtual const char* getName() const = 0;
+
+    // Create the decoder declared by cfg. Falls back to the libyuv software decoder when
+    // the declared backend is not available.
+    static std::unique_ptr<MjpegDecoder> create(const ExternalCameraConfig& cfg);
+};
+
+// Single threaded libyuv MJPGToI420 decode
+class LibyuvMjpegDecoder : public MjpegDecoder {
+public:
+    virtual int decode(const uint8_t* inData, size_t inDataSize,
+            uint32_t width, uint32_t height, const YCbCrLayout& out) override;
+    virtual const char* getName() const override { return "libyuv"; }
+};
+
+// Splits a frame at its restart (RSTn) markers into horizontal strips that are decoded
+// as standalone JPEGs on a pool of worker threads. Frames without a usable restart
+// interval (no DRI, or an interval that doesn't cover whole MCU rows) are decoded with
+// libyuv on the calling thread.
+class ParallelMjpegDecoder : public MjpegDecoder {
+public:
+    explicit ParallelMjpegDecoder(uint32_t numThreads);
+    virtual ~ParallelMjpegDecoder();
+
+    virtual int decode(const uint8_t* inData, size_t inDataSize,
+            uint32_t width, uint32_t height, const YCbCrLayout& out) override;
+    virtual const char* getName() const override { return "parallel"; }
+
+    // Location of the headers and restart markers of a baseline JPEG
+    struct ScanInfo {
+        size_t sofOffset = 0;  // offset of the SOF marker
+        size_t sosEnd = 0;     // offset of the first byte of entropy coded data
+        size_t eoiOffset = 0;  // offset of the EOI marker (or end of data)
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mcuWidth = 0;
+        uint32_t mcuHeight = 0;
+        uint32_t restartInterval = 0; // in MCUs, 0 if there's no DRI marker
+        std::vector<size_t> rstOffsets; // offsets of the RSTn markers in scan order
+    };
+    // Returns false if data isn't a single scan, huffman coded sequential JPEG
+    static bool parseScan(const uint8_t* data, size_t size, ScanInfo* info);
+
+private:
+    struct Strip {
+        size_t firstInterval;  // first restart interval in this strip
+        size_t endInterval;    // one past the last restart interval in this strip
+        uint32_t rowStart;     // first output row
+        uint32_t rows;
+        int result;
+    };
+
+    void workerLoop(size_t workerIdx);
+    // Take the next undecoded strip and decode it. Returns false if there's none left.
+    bool decodeNextStrip(size_t workerIdx);
+    int decodeStrip(const Strip& strip, std::vector<uint8_t>* buf);
+
+    LibyuvMjpegDecoder mFallback;
+    std::vector<std::thread> mWorkers;
+    // Per-thread scratch buffer holding a strip rebuilt as a standalone JPEG.
+    // Index 0 is used by the decode() caller, i + 1 by mWorkers[i].
+    std::vector<std::vector<uint8_t>> mStripBuffers;
+
+    std::mutex mLock;                   // protect all members below
+    std::condition_variable mWorkCond;  // signaled when new strips are ready or on exit
+    std::condition_variable mDoneCond;  // signaled when the last strip of a frame is done
+    bool mExit = false;
+    std::vector<Strip> mStrips;
+    size_t mNextStrip = 0;
+    size_t mPendingStrips = 0;
+
+    // Frame being decoded. Only written by decode() while no strip is pending.
+    const uint8_t* mData = nullptr;
+    ScanInfo mScan;
+    YCbCrLayout mOut;
+    uint32_t mWidth = 0;
+};
+
+// Decodes through a V4L2 memory-to-memory JPEG decoder node (V4L2_CAP_VIDEO_M2M_MPLANE).
+// Failing frames are handed to the fallback software decoder.
+class V4l2M2mMjpegDecoder : public MjpegDecoder {
+public:
+    V4l2M2mMjpegDecoder(const std::string& devicePath, std::unique_ptr<MjpegDecoder> fallback);
+    virtual ~V4l2M2mMjpegDecoder();
+
+    // Open and probe the device. Returns 0 if it can be used.
+    int initialize();
+
+    virtual int decode(const uint8_t* inData, size_t inDataSize,
+            uint32_t width, uint32_t height, const YCbCrLayout& out) override;
+    virtual const char* getName() const override { return "v4l2m2m"; }
+
+private:
+    struct MappedBuffer {
+        void* addr = nullptr;
+        size_t length = 0;
+    };
+
+    int configure(uint32_t width, uint32_t height, size_t inDataSize);
+    void teardown();
+    int decodeFrame(const uint8_t* inData, size_t inDataSize, const YCbCrLayout& out);
+
+    static const int kDecodeTimeoutMs = 100;
+
+    const std::string mDevicePath;
+    const std::unique_ptr<MjpegDecoder> mFallback;
+    android::base::unique_fd mFd;
+
+    bool mConfigured = false;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mCaptureFourcc = 0;
+    uint32_t mCaptureStride = 0;
+    uint32_t mCaptureHeight = 0; // may be aligned up from mHeight by the driver
+    MappedBuffer mOutputBuf;  // compressed input
+    MappedBuffer mCaptureBuf; // decoded output
+};
+
+}  // namespace implementation
+}  // namespace V3_4
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMMJPEGDECODER_H
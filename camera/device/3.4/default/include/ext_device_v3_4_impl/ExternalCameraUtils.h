@@ -18,12 +18,19 @@
 #define ANDROID_HARDWARE_CAMERA_DEVICE_V3_4_EXTCAMUTIL_H
 
 #include <android/hardware/graphics/mapper/2.0/IMapper.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <inttypes.h>
+#include <list>
 #include <mutex>
+#include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 #include "tinyxml2.h"  // XML parsing
 #include "utils/LightRefBase.h"
+#include "utils/Timers.h"
 
 using android::hardware::graphics::mapper::V2_0::IMapper;
 using android::hardware::graphics::mapper::V2_0::YCbCrLayout;
@@ -72,6 +79,14 @@ struct ExternalCameraConfig {
     // Size of v4l2 buffer queue when streaming > kMaxVideoSize
     uint32_t numStillBuffers;
 
+    // Size the v4l2 buffer queue from the configured streams and the measured time requests
+    // hold a buffer, instead of numVideoBuffers/numStillBuffers alone. One buffer is then
+    // always left queued to the driver.
+    bool adaptiveV4l2Buffers;
+
+    // Upper bound of the adaptive v4l2 buffer queue size
+    uint32_t maxV4l2Buffers;
+
     // Indication that the device connected supports depth output
     bool depthEnabled;
 
@@ -88,6 +103,49 @@ struct ExternalCameraConfig {
     // The value of android.sensor.orientation
     int32_t orientation;
 
+    // Number of requests that can be in flight between the decode, YUV output and JPEG
+    // stages of the output pipeline. 0 means all processing is done serially on one thread.
+    uint32_t outputPipelineDepth;
+
+    // MJPEG decode backend used by the output thread
+    struct MjpegDecoderConfig {
+        std::string type;       // "libyuv", "parallel" or "v4l2m2m"
+        uint32_t numThreads;    // number of decode threads of the parallel decoder
+        std::string devicePath; // V4L2 memory-to-memory decoder node for "v4l2m2m"
+    };
+    MjpegDecoderConfig mjpegDecoder;
+
+    // Filter used when scaling the V4L2 frame to output and thumbnail sizes. Values match
+    // libyuv::FilterMode.
+    enum ScaleFilter {
+        SCALE_FILTER_NONE = 0,     // point sampling, fastest
+        SCALE_FILTER_LINEAR = 1,   // horizontal only
+        SCALE_FILTER_BILINEAR = 2,
+        SCALE_FILTER_BOX = 3,      // best quality for large downscales
+    };
+    ScaleFilter scaleFilter;
+
+    // Number of threads used to encode large JPEG captures. 1 disables strip encoding.
+    uint32_t jpegEncodeThreads;
+
+    // Keep output buffers CPU mapped between frames instead of locking and unlocking them
+    // for every request. Only safe when CPU mappings of gralloc buffers are coherent, see
+    // HandleImporter::setMappingCacheEnabled.
+    bool cacheBufferMappings;
+
+    // Maximum total size of idle intermediate frames kept for reuse across stream
+    // configurations, in bytes
+    uint32_t framePoolMaxIdleBytes;
+
+    // Number of capture results (and their shutter notifications) sent to the framework in
+    // one callback. Saves binder calls for high frame rate streams at the cost of up to
+    // resultBatchSize - 1 frames of result latency. 1 disables batching.
+    uint32_t resultBatchSize;
+
+    // Number of threads filling the YUV outputs of a frame. Outputs of different sizes are
+    // scaled and converted in parallel. 1 fills them one after another.
+    uint32_t outputThreads;
+
 private:
     ExternalCameraConfig();
     static bool updateFpsList(tinyxml2::XMLElement* fpsList, std::vector<FpsLimitation>& fpsLimits);
@@ -152,6 +210,102 @@ private:
     std::vector<uint8_t> mData;
 };
 
+// Keeps AllocatedFrames that are no longer configured so later stream configurations can
+// reuse them instead of allocating again. Idle frames are matched by size and the least
+// recently released ones are freed once their total size exceeds maxIdleBytes.
+class AllocatedFramePool {
+public:
+    explicit AllocatedFramePool(size_t maxIdleBytes);
+    // Returns an allocated w x h frame, or nullptr if allocation fails
+    sp<AllocatedFrame> acquire(uint32_t w, uint32_t h);
+    // frame must not be used by the caller afterwards
+    void release(const sp<AllocatedFrame>& frame);
+    void dump(int fd);
+private:
+    static size_t getFrameBytes(uint32_t w, uint32_t h) { return w * h * 3 / 2; } // YUV420
+
+    std::mutex mLock;
+    const size_t mMaxIdleBytes;
+    size_t mIdleBytes = 0;
+    std::list<sp<AllocatedFrame>> mIdleFrames; // most recently released first
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+    uint64_t mEvictions = 0;
+};
+
+// Bounded single producer, single consumer FIFO. push() and pop() never block or allocate;
+// push() must only be called from one producer thread and pop() from one consumer thread.
+template <typename T, size_t kCapacity>
+class SpscQueue {
+public:
+    static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+            "SpscQueue capacity must be a power of two");
+
+    // Returns false if the queue is full
+    bool push(T&& item) {
+        uint64_t tail = mPushCount.load(std::memory_order_relaxed);
+        if (tail - mPopCount.load(std::memory_order_acquire) == kCapacity) {
+            return false;
+        }
+        mSlots[tail & (kCapacity - 1)] = std::move(item);
+        mPushCount.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty. seq, if not null, is set to the number of items
+    // popped before this one.
+    bool pop(T* out, uint64_t* seq = nullptr) {
+        uint64_t head = mPopCount.load(std::memory_order_relaxed);
+        if (head == mPushCount.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *out = std::move(mSlots[head & (kCapacity - 1)]);
+        mPopCount.store(head + 1, std::memory_order_release);
+        if (seq != nullptr) {
+            *seq = head;
+        }
+        return true;
+    }
+
+    // Number of items pushed/popped so far. Can be read from any thread.
+    uint64_t pushCount() const { return mPushCount.load(std::memory_order_acquire); }
+    uint64_t popCount() const { return mPopCount.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return kCapacity; }
+
+private:
+    T mSlots[kCapacity];
+    // On separate cache lines so the producer and consumer don't contend
+    alignas(64) std::atomic<uint64_t> mPushCount {0};
+    alignas(64) std::atomic<uint64_t> mPopCount {0};
+};
+
+// Runs batches of independent tasks on numThreads - 1 worker threads plus the calling thread.
+// run() returns once every task of the batch is done. Only one run() at a time.
+class TaskFanOut {
+public:
+    explicit TaskFanOut(uint32_t numThreads);
+    ~TaskFanOut();
+
+    // Run task(0) .. task(numTasks - 1)
+    void run(size_t numTasks, const std::function<void(size_t)>& task);
+
+private:
+    void workerLoop();
+    // Run the next task of the batch with lk released. Returns false if none is left.
+    bool runNextTask(std::unique_lock<std::mutex>& lk);
+
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mLock;                   // protect all members below
+    std::condition_variable mWorkCond;  // signaled when a batch is started or on exit
+    std::condition_variable mDoneCond;  // signaled when the last task of a batch is done
+    bool mExit = false;
+    const std::function<void(size_t)>* mTask = nullptr;
+    size_t mNumTasks = 0;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+};
+
 enum CroppingType {
     HORIZONTAL = 0,
     VERTICAL = 1
@@ -17,6 +17,7 @@
 #define LOG_TAG "ExtCamDevSsn@3.5"
 #include <android/log.h>
 
+#include <algorithm>
 #include <utils/Trace.h>
 #include "ExternalCameraDeviceSession.h"
 
@@ -60,11 +61,32 @@ ExternalCameraDeviceSession::~ExternalCameraDeviceSession() {
 Return<void> ExternalCameraDeviceSession::configureStreams_3_5(
         const StreamConfiguration& requestedConfiguration,
         ICameraDeviceSession::configureStreams_3_5_cb _hidl_cb)  {
-    return configureStreams_3_4(requestedConfiguration.v3_4, _hidl_cb);
+    mStreamConfigCounter = requestedConfiguration.streamConfigCounter;
+    if (mBufferRequestThread != nullptr) {
+        mBufferRequestThread->returnPrefetchedBuffers({});
+    }
+    Return<void> ret = configureStreams_3_4(requestedConfiguration.v3_4, _hidl_cb);
+    if (mBufferRequestThread != nullptr) {
+        // JPEG captures are sporadic, don't hold BLOB buffers ahead of them
+        for (const auto& stream : requestedConfiguration.v3_4.streams) {
+            if (stream.v3_2.format == PixelFormat::BLOB) {
+                mBufferRequestThread->setPrefetchDepth(stream.v3_2.id, 0);
+            }
+        }
+    }
+    return ret;
 }
 
 Return<void> ExternalCameraDeviceSession::signalStreamFlush(
-        const hidl_vec<int32_t>& /*streamIds*/, uint32_t /*streamConfigCounter*/) {
+        const hidl_vec<int32_t>& streamIds, uint32_t streamConfigCounter) {
+    if (streamConfigCounter < mStreamConfigCounter) {
+        // Stale call, the streams have been reconfigured since
+        return Void();
+    }
+    if (mBufferRequestThread != nullptr) {
+        mBufferRequestThread->returnPrefetchedBuffers(
+                std::vector<int32_t>(streamIds.begin(), streamIds.end()));
+    }
     return Void();
 }
 
@@ -94,14 +116,17 @@ int ExternalCameraDeviceSession::BufferRequestThread::requestBufferStart(
 
     {
         std::lock_guard<std::mutex> lk(mLock);
-        if (mRequestingBuffer) {
-            ALOGE("%s: BufferRequestThread does not support more than one concurrent request!",
-                    __FUNCTION__);
+        if (mBufferReqs.size() + mPendingReturnBufferReqs.size() >= kMaxQueuedRequests) {
+            ALOGE("%s: more than %zu buffer requests queued!", __FUNCTION__, kMaxQueuedRequests);
             return -1;
         }
 
-        mBufferReqs = bufReqs;
-        mRequestingBuffer = true;
+        for (const auto& buf : bufReqs) {
+            mPrefetchDepth.emplace(buf.streamId, kDefaultPrefetchDepth);
+        }
+        mBufferReqs.push_back(bufReqs);
+        // Complete the request right away if enough buffers are prefetched
+        completeRequestsLocked({});
     }
     mRequestCond.notify_one();
     return 0;
@@ -110,33 +135,188 @@ int ExternalCameraDeviceSession::BufferRequestThread::requestBufferStart(
 int ExternalCameraDeviceSession::BufferRequestThread::waitForBufferRequestDone(
         std::vector<HalStreamBuffer>* outBufReq) {
     std::unique_lock<std::mutex> lk(mLock);
-    if (!mRequestingBuffer) {
+    if (mBufferReqs.size() + mPendingReturnBufferReqs.size() <= mAbandonedReqs) {
         ALOGE("%s: no pending buffer request!", __FUNCTION__);
         return -1;
     }
 
     if (mPendingReturnBufferReqs.empty()) {
         std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqProcTimeoutMs);
-        auto st = mRequestDoneCond.wait_for(lk, timeout);
-        if (st == std::cv_status::timeout) {
+        bool done = mRequestDoneCond.wait_for(lk, timeout,
+                [this] { return !mPendingReturnBufferReqs.empty(); });
+        if (!done) {
             ALOGE("%s: wait for buffer request finish timeout!", __FUNCTION__);
+            mAbandonedReqs++;
             return -1;
         }
     }
-    mRequestingBuffer = false;
-    *outBufReq = std::move(mPendingReturnBufferReqs);
-    mPendingReturnBufferReqs.clear();
+    *outBufReq = std::move(mPendingReturnBufferReqs.front());
+    mPendingReturnBufferReqs.pop_front();
     return 0;
 }
 
+void ExternalCameraDeviceSession::BufferRequestThread::setPrefetchDepth(
+        int32_t streamId, uint32_t depth) {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mPrefetchDepth[streamId] = depth;
+    }
+    mRequestCond.notify_one();
+}
+
+void ExternalCameraDeviceSession::BufferRequestThread::returnPrefetchedBuffers(
+        const std::vector<int32_t>& streamIds) {
+    ATRACE_CALL();
+    std::vector<HalStreamBuffer> bufs;
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (auto it = mPrefetchedBufs.begin(); it != mPrefetchedBufs.end();) {
+            if (!streamIds.empty() &&
+                    std::find(streamIds.begin(), streamIds.end(), it->first) == streamIds.end()) {
+                ++it;
+                continue;
+            }
+            bufs.insert(bufs.end(), it->second.begin(), it->second.end());
+            mPrefetchDepth.erase(it->first);
+            it = mPrefetchedBufs.erase(it);
+        }
+        if (streamIds.empty()) {
+            mPrefetchDepth.clear();
+        } else {
+            for (int32_t streamId : streamIds) {
+                mPrefetchDepth.erase(streamId);
+            }
+        }
+    }
+    if (bufs.empty()) {
+        return;
+    }
+
+    hidl_vec<V3_2::StreamBuffer> hBufs;
+    hBufs.resize(bufs.size());
+    for (size_t i = 0; i < bufs.size(); i++) {
+        hBufs[i].streamId = bufs[i].streamId;
+        hBufs[i].bufferId = bufs[i].bufferId;
+        hBufs[i].status = BufferStatus::ERROR;
+        if (bufs[i].acquireFence >= 0) {
+            native_handle_t* handle = native_handle_create(/*numFds*/1, /*numInts*/0);
+            handle->data[0] = bufs[i].acquireFence;
+            hBufs[i].releaseFence.setTo(handle, /*shouldOwn*/false);
+        }
+    }
+    auto err = mCallbacks->returnStreamBuffers(hBufs);
+    if (!err.isOk()) {
+        ALOGE("%s: Transaction error: %s", __FUNCTION__, err.description().c_str());
+    }
+    for (auto& hBuf : hBufs) {
+        if (hBuf.releaseFence.getNativeHandle() != nullptr) {
+            native_handle_t* handle = const_cast<native_handle_t*>(
+                    hBuf.releaseFence.getNativeHandle());
+            native_handle_close(handle);
+            native_handle_delete(handle);
+        }
+    }
+}
+
+size_t ExternalCameraDeviceSession::BufferRequestThread::prefetchedCountLocked(
+        int32_t streamId) {
+    auto it = mPrefetchedBufs.find(streamId);
+    return it == mPrefetchedBufs.end() ? 0 : it->second.size();
+}
+
+void ExternalCameraDeviceSession::BufferRequestThread::completeRequestsLocked(
+        const std::vector<int32_t>& failedStreams) {
+    bool completed = false;
+    while (!mBufferReqs.empty()) {
+        std::vector<HalStreamBuffer>& bufReqs = mBufferReqs.front();
+        std::map<int32_t, size_t> needed;
+        for (const auto& buf : bufReqs) {
+            needed[buf.streamId]++;
+        }
+        bool ready = true;
+        for (const auto& n : needed) {
+            if (prefetchedCountLocked(n.first) < n.second &&
+                    std::find(failedStreams.begin(), failedStreams.end(), n.first) ==
+                    failedStreams.end()) {
+                ready = false;
+                break;
+            }
+        }
+        if (!ready) {
+            break;
+        }
+
+        // Buffers of failed streams are left empty, as when requestStreamBuffers fails
+        for (auto& buf : bufReqs) {
+            auto it = mPrefetchedBufs.find(buf.streamId);
+            if (it == mPrefetchedBufs.end() || it->second.empty()) {
+                continue;
+            }
+            const HalStreamBuffer& prefetched = it->second.front();
+            buf.bufferId = prefetched.bufferId;
+            buf.bufPtr = prefetched.bufPtr;
+            buf.acquireFence = prefetched.acquireFence;
+            it->second.pop_front();
+        }
+
+        if (mAbandonedReqs > 0) {
+            // Nobody waits for this request anymore, keep its buffers for the next ones
+            mAbandonedReqs--;
+            for (auto& buf : bufReqs) {
+                if (buf.bufferId != BUFFER_ID_NO_BUFFER) {
+                    mPrefetchedBufs[buf.streamId].push_back(buf);
+                }
+            }
+        } else {
+            mPendingReturnBufferReqs.push_back(std::move(bufReqs));
+            completed = true;
+        }
+        mBufferReqs.pop_front();
+    }
+    if (completed) {
+        mRequestDoneCond.notify_all();
+    }
+}
+
 void ExternalCameraDeviceSession::BufferRequestThread::waitForNextRequest() {
     ATRACE_CALL();
     std::unique_lock<std::mutex> lk(mLock);
     int waitTimes = 0;
-    while (mBufferReqs.empty()) {
+    std::vector<BufferRequest> halBufferReqs;
+    mHalPrefetchCounts.clear();
+    while (true) {
         if (exitPending()) {
             return;
         }
+
+        // Buffers the queued requests need, plus the prefetch depth of each stream
+        std::map<int32_t, size_t> needed;
+        for (const auto& bufReqs : mBufferReqs) {
+            for (const auto& buf : bufReqs) {
+                needed[buf.streamId]++;
+            }
+        }
+        for (const auto& depth : mPrefetchDepth) {
+            needed.emplace(depth.first, 0);
+        }
+        for (const auto& n : needed) {
+            auto depthIt = mPrefetchDepth.find(n.first);
+            size_t depth = depthIt == mPrefetchDepth.end() ? 0 : depthIt->second;
+            size_t have = prefetchedCountLocked(n.first);
+            if (n.second + depth <= have) {
+                continue;
+            }
+            BufferRequest halBufferReq;
+            halBufferReq.streamId = n.first;
+            halBufferReq.numBuffersRequested = n.second + depth - have;
+            halBufferReqs.push_back(halBufferReq);
+            mHalPrefetchCounts.push_back(
+                    static_cast<uint32_t>(std::min(depth, n.second + depth - have)));
+        }
+        if (!halBufferReqs.empty()) {
+            break;
+        }
+
         std::chrono::milliseconds timeout = std::chrono::milliseconds(kReqWaitTimeoutMs);
         auto st = mRequestCond.wait_for(lk, timeout);
         if (st == std::cv_status::timeout) {
@@ -151,11 +331,7 @@ void ExternalCameraDeviceSession::BufferRequestThread::waitForNextRequest() {
     }
 
     // Fill in hidl BufferRequest
-    mHalBufferReqs.resize(mBufferReqs.size());
-    for (size_t i = 0; i < mHalBufferReqs.size(); i++) {
-        mHalBufferReqs[i].streamId = mBufferReqs[i].streamId;
-        mHalBufferReqs[i].numBuffersRequested = 1;
-    }
+    mHalBufferReqs = std::move(halBufferReqs);
 }
 
 bool ExternalCameraDeviceSession::BufferRequestThread::threadLoop() {
@@ -179,7 +355,15 @@ bool ExternalCameraDeviceSession::BufferRequestThread::threadLoop() {
         return false;
     }
 
-    std::unique_lock<std::mutex> lk(mLock);
+    // Import the returned buffers outside of mLock, importBuffer takes mCbsLock
+    std::vector<HalStreamBuffer> importedBufs;
+    auto cleanupImportedFences = [&importedBufs]() {
+        for (auto& buf : importedBufs) {
+            sHandleImporter.closeFence(buf.acquireFence);
+        }
+    };
+    // Indices into mHalBufferReqs of the streams that got no buffers
+    std::vector<size_t> failedReqs;
     if (status == BufferRequestStatus::OK || status == BufferRequestStatus::FAILED_PARTIAL) {
         if (bufRets.size() != mHalBufferReqs.size()) {
             ALOGE("%s: expect %zu buffer requests returned, only got %zu",
@@ -193,59 +377,79 @@ bool ExternalCameraDeviceSession::BufferRequestThread::threadLoop() {
             return false;
         }
 
-        hidl_vec<int> importedFences;
-        importedFences.resize(bufRets.size());
         for (size_t i = 0; i < bufRets.size(); i++) {
             int streamId = bufRets[i].streamId;
             switch (bufRets[i].val.getDiscriminator()) {
                 case StreamBuffersVal::hidl_discriminator::error:
+                    failedReqs.push_back(i);
                     continue;
                 case StreamBuffersVal::hidl_discriminator::buffers: {
                     const hidl_vec<V3_2::StreamBuffer>& hBufs = bufRets[i].val.buffers();
-                    if (hBufs.size() != 1) {
-                        ALOGE("%s: expect 1 buffer returned, got %zu!", __FUNCTION__, hBufs.size());
+                    if (hBufs.size() != mHalBufferReqs[i].numBuffersRequested) {
+                        ALOGE("%s: expect %u buffers returned, got %zu!", __FUNCTION__,
+                                mHalBufferReqs[i].numBuffersRequested, hBufs.size());
+                        cleanupImportedFences();
                         return false;
                     }
-                    const V3_2::StreamBuffer& hBuf = hBufs[0];
-
-                    mBufferReqs[i].bufferId = hBuf.bufferId;
-                    // TODO: create a batch import API so we don't need to lock/unlock mCbsLock
-                    // repeatedly?
-                    lk.unlock();
-                    Status s = parent->importBuffer(streamId,
-                            hBuf.bufferId, hBuf.buffer.getNativeHandle(),
-                            /*out*/&mBufferReqs[i].bufPtr,
-                            /*allowEmptyBuf*/false);
-                    lk.lock();
-
-                    if (s != Status::OK) {
-                        ALOGE("%s: stream %d import buffer failed!", __FUNCTION__, streamId);
-                        cleanupInflightFences(importedFences, i - 1);
-                        return false;
-                    }
-                    if (!sHandleImporter.importFence(hBuf.acquireFence,
-                            mBufferReqs[i].acquireFence)) {
-                        ALOGE("%s: stream %d import fence failed!", __FUNCTION__, streamId);
-                        cleanupInflightFences(importedFences, i - 1);
-                        return false;
+                    for (const V3_2::StreamBuffer& hBuf : hBufs) {
+                        HalStreamBuffer buf = {};
+                        buf.streamId = streamId;
+                        buf.bufferId = hBuf.bufferId;
+                        buf.acquireFence = -1;
+                        Status s = parent->importBuffer(streamId,
+                                hBuf.bufferId, hBuf.buffer.getNativeHandle(),
+                                /*out*/&buf.bufPtr,
+                                /*allowEmptyBuf*/false);
+                        if (s != Status::OK) {
+                            ALOGE("%s: stream %d import buffer failed!", __FUNCTION__, streamId);
+                            cleanupImportedFences();
+                            return false;
+                        }
+                        if (!sHandleImporter.importFence(hBuf.acquireFence, buf.acquireFence)) {
+                            ALOGE("%s: stream %d import fence failed!", __FUNCTION__, streamId);
+                            cleanupImportedFences();
+                            return false;
+                        }
+                        importedBufs.push_back(buf);
                     }
-                    importedFences[i] = mBufferReqs[i].acquireFence;
                 }
                 break;
                 default:
                     ALOGE("%s: unkown StreamBuffersVal discrimator!", __FUNCTION__);
+                    cleanupImportedFences();
                     return false;
             }
         }
     } else {
         ALOGE("%s: requestStreamBuffers call failed!", __FUNCTION__);
+        for (size_t i = 0; i < mHalBufferReqs.size(); i++) {
+            failedReqs.push_back(i);
+        }
     }
 
-    mPendingReturnBufferReqs = std::move(mBufferReqs);
-    mBufferReqs.clear();
+    std::unique_lock<std::mutex> lk(mLock);
+    for (auto& buf : importedBufs) {
+        mPrefetchedBufs[buf.streamId].push_back(buf);
+    }
 
-    lk.unlock();
-    mRequestDoneCond.notify_one();
+    std::vector<int32_t> failedStreams;
+    for (size_t i : failedReqs) {
+        int32_t streamId = mHalBufferReqs[i].streamId;
+        uint32_t prefetchCount = mHalPrefetchCounts[i];
+        if (prefetchCount > 0) {
+            // e.g. the stream has no more buffers to spare; only fetch what requests need
+            ALOGW("%s: stop prefetching buffers of stream %d", __FUNCTION__, streamId);
+            mPrefetchDepth[streamId] = 0;
+            // A stream error may be due to the prefetched buffers only, retry without them
+            bool retry = status == BufferRequestStatus::FAILED_PARTIAL ||
+                    status == BufferRequestStatus::OK;
+            if (retry || mHalBufferReqs[i].numBuffersRequested == prefetchCount) {
+                continue;
+            }
+        }
+        failedStreams.push_back(streamId);
+    }
+    completeRequestsLocked(failedStreams);
     return true;
 }
 
@@ -261,6 +465,7 @@ void ExternalCameraDeviceSession::closeOutputThreadImpl() {
     if (mBufferRequestThread) {
         mBufferRequestThread->requestExit();
         mBufferRequestThread->join();
+        mBufferRequestThread->returnPrefetchedBuffers({});
         mBufferRequestThread.clear();
     }
 }
@@ -19,6 +19,8 @@
 
 #include <android/hardware/camera/device/3.5/ICameraDeviceCallback.h>
 #include <android/hardware/camera/device/3.5/ICameraDeviceSession.h>
+#include <deque>
+#include <map>
 #include <../../3.4/default/include/ext_device_v3_4_impl/ExternalCameraDeviceSession.h>
 
 namespace android {
@@ -120,6 +122,14 @@ protected:
             hidl_vec<buffer_handle_t*>& allBufPtrs,
             hidl_vec<int>& allFences) override;
 
+    // Fetches output buffers from camera service for the output thread.
+    //
+    // Buffer requests are queued and completed in order, so the output thread can ask for the
+    // buffers of frame N+1 while frame N is still being waited for. On top of the buffers
+    // queued requests need, the thread keeps up to a per stream prefetch depth of buffers
+    // ahead, so that a request can usually be completed from the prefetched buffers without a
+    // binder round trip. The buffers of all streams are fetched by one requestStreamBuffers
+    // call. Prefetched buffers are returned by returnPrefetchedBuffers().
     class BufferRequestThread : public android::Thread {
     public:
         BufferRequestThread(
@@ -130,21 +140,41 @@ protected:
         int waitForBufferRequestDone(
                 /*out*/std::vector<HalStreamBuffer>*);
 
+        // Sets how many buffers of a stream are fetched ahead of the requests. Streams not
+        // set get kDefaultPrefetchDepth when first requested.
+        void setPrefetchDepth(int32_t streamId, uint32_t depth);
+        // Returns the prefetched buffers of the given streams, or of all streams if empty, to
+        // camera service. The streams are not prefetched again until next requested.
+        void returnPrefetchedBuffers(const std::vector<int32_t>& streamIds);
+
         virtual bool threadLoop() override;
 
     private:
         void waitForNextRequest();
+        // Completes, in order, the queued requests whose buffers are all prefetched or whose
+        // missing buffers belong to a stream in failedStreams.
+        void completeRequestsLocked(const std::vector<int32_t>& failedStreams);
+        size_t prefetchedCountLocked(int32_t streamId);
 
         const wp<ExternalCameraDeviceSession> mParent;
         const sp<V3_5::ICameraDeviceCallback> mCallbacks;
 
         std::mutex mLock;
-        bool mRequestingBuffer = false;
 
-        std::vector<HalStreamBuffer> mBufferReqs;
-        std::vector<HalStreamBuffer> mPendingReturnBufferReqs;
-        // mHalBufferReqs is not under mLock protection during the HIDL transaction
+        std::deque<std::vector<HalStreamBuffer>> mBufferReqs;
+        std::deque<std::vector<HalStreamBuffer>> mPendingReturnBufferReqs;
+        // Completed requests whose waiter timed out; their buffers go back to the prefetch pool
+        size_t mAbandonedReqs = 0;
+        std::map<int32_t, std::deque<HalStreamBuffer>> mPrefetchedBufs;
+        std::map<int32_t, uint32_t> mPrefetchDepth;
+        // mHalBufferReqs and mHalPrefetchCounts are not under mLock protection during the
+        // HIDL transaction
         hidl_vec<BufferRequest>      mHalBufferReqs;
+        // Number of buffers of each entry of mHalBufferReqs no queued request needs yet
+        std::vector<uint32_t>        mHalPrefetchCounts;
+
+        static const uint32_t kDefaultPrefetchDepth = 1;
+        static const size_t kMaxQueuedRequests = 4;
 
         // request buffers takes much less time in steady state, but can take much longer
         // when requesting 1st buffer from a stream.
@@ -179,6 +209,8 @@ protected:
 
     sp<V3_5::ICameraDeviceCallback> mCallback_3_5;
     bool mSupportBufMgr;
+    // streamConfigCounter of the last configureStreams_3_5 call
+    std::atomic<uint32_t> mStreamConfigCounter{0};
 
 private:
 
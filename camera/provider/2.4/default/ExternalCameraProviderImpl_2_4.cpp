@@ -18,7 +18,9 @@
 //#define LOG_NDEBUG 0
 #include <log/log.h>
 
+#include <atomic>
 #include <regex>
+#include <thread>
 #include <sys/inotify.h>
 #include <errno.h>
 #include <linux/videodev2.h>
@@ -272,6 +274,35 @@ ExternalCameraProviderImpl_2_4::HotplugThread::HotplugThread(
 
 ExternalCameraProviderImpl_2_4::HotplugThread::~HotplugThread() {}
 
+void ExternalCameraProviderImpl_2_4::HotplugThread::addDevices(
+        const std::vector<std::string>& devices) {
+    // Probing a device takes a while (mostly V4L2 format/frame interval enumeration) and
+    // devices don't depend on each other, so probe them concurrently.
+    size_t numThreads = (devices.size() < kMaxProbeThreads) ? devices.size() : kMaxProbeThreads;
+    if (numThreads <= 1) {
+        for (const auto& dev : devices) {
+            mParent->deviceAdded(dev.c_str());
+        }
+        return;
+    }
+
+    std::atomic<size_t> next {0};
+    auto probeLoop = [&]() {
+        size_t i;
+        while ((i = next.fetch_add(1)) < devices.size()) {
+            mParent->deviceAdded(devices[i].c_str());
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < numThreads; i++) {
+        workers.emplace_back(probeLoop);
+    }
+    probeLoop();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
 bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
     // Find existing /dev/video* devices
     DIR* devdir = opendir(kDevicePath);
@@ -280,6 +311,7 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
         return false;
     }
 
+    std::vector<std::string> devices;
     struct dirent* de;
     while ((de = readdir(devdir)) != 0) {
         // Find external v4l devices that's existing before we start watching and add them
@@ -292,11 +324,12 @@ bool ExternalCameraProviderImpl_2_4::HotplugThread::threadLoop() {
                 char v4l2DevicePath[kMaxDevicePathLen];
                 snprintf(v4l2DevicePath, kMaxDevicePathLen,
                         "%s%s", kDevicePath, de->d_name);
-                mParent->deviceAdded(v4l2DevicePath);
+                devices.push_back(v4l2DevicePath);
             }
         }
     }
     closedir(devdir);
+    addDevices(devices);
 
     // Watch new video devices
     mINotifyFD = inotify_init();
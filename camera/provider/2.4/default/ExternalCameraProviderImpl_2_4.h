@@ -20,6 +20,7 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include <utils/Mutex.h>
 #include <utils/Thread.h>
 #include <hidl/Status.h>
@@ -91,6 +92,11 @@ private:
         virtual bool threadLoop() override;
 
     private:
+        // Probe devices and add the usable ones, using up to kMaxProbeThreads threads
+        void addDevices(const std::vector<std::string>& devices);
+
+        static const size_t kMaxProbeThreads = 4;
+
         ExternalCameraProviderImpl_2_4* mParent = nullptr;
         const std::unordered_set<std::string> mInternalDevices;
 
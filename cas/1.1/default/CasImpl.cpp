@@ -18,10 +18,14 @@
 #define LOG_TAG "android.hardware.cas@1.1-CasImpl"
 
 #include <android/hardware/cas/1.1/ICasListener.h>
+#include <stdio.h>
 #include <media/cas/CasAPI.h>
 #include <utils/Log.h>
 
+#include <vector>
+
 #include "CasImpl.h"
+#include "SessionExecutor.h"
 #include "SharedLibrary.h"
 #include "TypeConvert.h"
 
@@ -92,7 +96,18 @@ void CasImpl::onEvent(const CasSessionId* sessionId, int32_t event, int32_t arg,
     }
 
     if (sessionId != NULL) {
-        mListener->onSessionEvent(*sessionId, event, arg, eventData);
+        std::shared_ptr<SessionExecutor> executor = getSessionExecutor(*sessionId);
+        if (executor == nullptr) {
+            mListener->onSessionEvent(*sessionId, event, arg, eventData);
+            return;
+        }
+        // The data belongs to the plugin, which can free it as soon as this returns
+        sp<ICasListener> listener = mListener;
+        HidlCasSessionId id = *sessionId;
+        std::vector<uint8_t> dataCopy(eventData.begin(), eventData.end());
+        executor->post([listener, id, event, arg, dataCopy] {
+            listener->onSessionEvent(id, event, arg, dataCopy);
+        });
     } else {
         mListener->onEvent(event, arg, eventData);
     }
@@ -117,6 +132,10 @@ Return<void> CasImpl::openSession(openSession_cb _hidl_cb) {
         err = holder->openSession(&sessionId);
         holder.reset();
     }
+    if (err == OK) {
+        std::lock_guard<std::mutex> lock(mSessionLock);
+        mSessionExecutors[sessionId] = std::make_shared<SessionExecutor>();
+    }
 
     _hidl_cb(toStatus(err), sessionId);
 
@@ -130,7 +149,12 @@ Return<Status> CasImpl::setSessionPrivateData(const HidlCasSessionId& sessionId,
     if (holder.get() == nullptr) {
         return toStatus(INVALID_OPERATION);
     }
-    return toStatus(holder->setSessionPrivateData(sessionId, pvtData));
+    std::shared_ptr<SessionExecutor> executor = getSessionExecutor(sessionId);
+    if (executor == nullptr) {
+        return toStatus(holder->setSessionPrivateData(sessionId, pvtData));
+    }
+    return toStatus(
+            executor->run([&] { return holder->setSessionPrivateData(sessionId, pvtData); }));
 }
 
 Return<Status> CasImpl::closeSession(const HidlCasSessionId& sessionId) {
@@ -139,7 +163,20 @@ Return<Status> CasImpl::closeSession(const HidlCasSessionId& sessionId) {
     if (holder.get() == nullptr) {
         return toStatus(INVALID_OPERATION);
     }
-    return toStatus(holder->closeSession(sessionId));
+    std::shared_ptr<SessionExecutor> executor;
+    {
+        std::lock_guard<std::mutex> lock(mSessionLock);
+        auto it = mSessionExecutors.find(sessionId);
+        if (it != mSessionExecutors.end()) {
+            executor = it->second;
+            mSessionExecutors.erase(it);
+        }
+    }
+    if (executor == nullptr) {
+        return toStatus(holder->closeSession(sessionId));
+    }
+    // Closed after the work already queued for the session
+    return toStatus(executor->run([&] { return holder->closeSession(sessionId); }));
 }
 
 Return<Status> CasImpl::processEcm(const HidlCasSessionId& sessionId, const HidlCasData& ecm) {
@@ -149,7 +186,11 @@ Return<Status> CasImpl::processEcm(const HidlCasSessionId& sessionId, const Hidl
         return toStatus(INVALID_OPERATION);
     }
 
-    return toStatus(holder->processEcm(sessionId, ecm));
+    std::shared_ptr<SessionExecutor> executor = getSessionExecutor(sessionId);
+    if (executor == nullptr) {
+        return toStatus(holder->processEcm(sessionId, ecm));
+    }
+    return toStatus(executor->run([&] { return holder->processEcm(sessionId, ecm); }));
 }
 
 Return<Status> CasImpl::processEmm(const HidlCasData& emm) {
@@ -181,7 +222,12 @@ Return<Status> CasImpl::sendSessionEvent(const HidlCasSessionId& sessionId, int3
         return toStatus(INVALID_OPERATION);
     }
 
-    status_t err = holder->sendSessionEvent(sessionId, event, arg, eventData);
+    std::shared_ptr<SessionExecutor> executor = getSessionExecutor(sessionId);
+    if (executor == nullptr) {
+        return toStatus(holder->sendSessionEvent(sessionId, event, arg, eventData));
+    }
+    status_t err = executor->run(
+            [&] { return holder->sendSessionEvent(sessionId, event, arg, eventData); });
     return toStatus(err);
 }
 
@@ -212,9 +258,39 @@ Return<Status> CasImpl::release() {
     std::shared_ptr<CasPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    std::map<CasSessionId, std::shared_ptr<SessionExecutor>> executors;
+    {
+        std::lock_guard<std::mutex> lock(mSessionLock);
+        executors.swap(mSessionExecutors);
+    }
+    // Joined without the lock, as their pending listener callbacks can call back into this object
+    executors.clear();
+
     return Status::OK;
 }
 
+Return<void> CasImpl::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("%s: missing fd", __FUNCTION__);
+        return Void();
+    }
+    int out = fd->data[0];
+
+    std::lock_guard<std::mutex> lock(mSessionLock);
+    dprintf(out, "%zu sessions\n", mSessionExecutors.size());
+    for (const auto& entry : mSessionExecutors) {
+        dprintf(out, "session %s:\n", sessionIdToString(entry.first).string());
+        entry.second->dump(out);
+    }
+    return Void();
+}
+
+std::shared_ptr<SessionExecutor> CasImpl::getSessionExecutor(const CasSessionId& sessionId) {
+    std::lock_guard<std::mutex> lock(mSessionLock);
+    auto it = mSessionExecutors.find(sessionId);
+    return it != mSessionExecutors.end() ? it->second : nullptr;
+}
+
 }  // namespace implementation
 }  // namespace V1_1
 }  // namespace cas
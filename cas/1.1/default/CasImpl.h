@@ -18,8 +18,13 @@
 #define ANDROID_HARDWARE_CAS_V1_1_CAS_IMPL_H_
 
 #include <android/hardware/cas/1.1/ICas.h>
+#include <media/cas/CasAPI.h>
 #include <media/stagefright/foundation/ABase.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace android {
 struct CasPlugin;
 
@@ -33,6 +38,7 @@ using ::android::hardware::cas::V1_0::HidlCasData;
 using ::android::hardware::cas::V1_0::HidlCasSessionId;
 using ::android::hardware::cas::V1_0::Status;
 
+class SessionExecutor;
 class SharedLibrary;
 
 class CasImpl : public ICas {
@@ -80,12 +86,25 @@ class CasImpl : public ICas {
 
     virtual Return<Status> release() override;
 
+    // Dumps the number of sessions, and the queue depth and job latency of each executor.
+    virtual Return<void> debug(const hidl_handle& fd,
+                               const hidl_vec<hidl_string>& options) override;
+
    private:
     struct PluginHolder;
+
+    // Returns the executor of the session, or nullptr if it is not open.
+    std::shared_ptr<SessionExecutor> getSessionExecutor(const CasSessionId& sessionId);
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<CasPlugin> mPluginHolder;
     sp<ICasListener> mListener;
 
+    // The ECMs, private data and events of each session are handled in order on its executor,
+    // and concurrently with the other sessions.
+    std::mutex mSessionLock;
+    std::map<CasSessionId, std::shared_ptr<SessionExecutor>> mSessionExecutors;
+
     DISALLOW_EVIL_CONSTRUCTORS(CasImpl);
 };
 
@@ -17,10 +17,15 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "android.hardware.cas@1.1-DescramblerImpl"
 
+#include <fcntl.h>
 #include <hidlmemory/mapping.h>
+#include <linux/kcmp.h>
 #include <media/cas/DescramblerAPI.h>
 #include <media/hardware/CryptoAPI.h>
 #include <media/stagefright/foundation/AUtils.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include <utils/Log.h>
 
 #include "DescramblerImpl.h"
@@ -77,6 +82,64 @@ Return<bool> DescramblerImpl::requiresSecureDecoderComponent(const hidl_string&
     return holder->requiresSecureDecoderComponent(String8(mime.c_str()));
 }
 
+// Returns whether both fds refer to the same open file. That is how a heap shows up in two binder
+// transactions: the fds differ, but they are installed from the same file. Clears *supported if
+// the kernel cannot tell.
+static bool isSameFile(int fd1, int fd2, bool* supported) {
+    pid_t pid = getpid();
+    int result = syscall(SYS_kcmp, pid, pid, KCMP_FILE, fd1, fd2);
+    if (result < 0) {
+        ALOGW("kcmp failed (%s), not caching heap mappings", strerror(errno));
+        *supported = false;
+        return false;
+    }
+    return result == 0;
+}
+
+sp<IMemory> DescramblerImpl::mapHeap(const hidl_memory& heapBase) {
+    const native_handle_t* handle = heapBase.handle();
+    if (handle == nullptr || handle->numFds < 1) {
+        return mapMemory(heapBase);
+    }
+    int fd = handle->data[0];
+
+    std::lock_guard<std::mutex> lock(mHeapCacheLock);
+    if (!mHeapCacheSupported) {
+        return mapMemory(heapBase);
+    }
+    for (auto it = mMappedHeaps.begin(); it != mMappedHeaps.end(); ++it) {
+        if (it->size == heapBase.size() && isSameFile(it->fd.get(), fd, &mHeapCacheSupported)) {
+            mMappedHeaps.splice(mMappedHeaps.begin(), mMappedHeaps, it);
+            return it->memory;
+        }
+        if (!mHeapCacheSupported) {
+            mMappedHeaps.clear();
+            return mapMemory(heapBase);
+        }
+    }
+
+    sp<IMemory> memory = mapMemory(heapBase);
+    if (memory == NULL) {
+        return NULL;
+    }
+    base::unique_fd dupFd(fcntl(fd, F_DUPFD_CLOEXEC, 0));
+    if (dupFd.get() < 0) {
+        ALOGW("Failed to dup heap fd: %s", strerror(errno));
+        return memory;
+    }
+    mMappedHeaps.push_front({std::move(dupFd), heapBase.size(), memory});
+    // The client usually cycles through a few heaps. An evicted one is simply mapped again.
+    if (mMappedHeaps.size() > kMaxMappedHeaps) {
+        mMappedHeaps.pop_back();
+    }
+    return memory;
+}
+
+void DescramblerImpl::clearHeapCache() {
+    std::lock_guard<std::mutex> lock(mHeapCacheLock);
+    mMappedHeaps.clear();
+}
+
 static inline bool validateRangeForSize(uint64_t offset, uint64_t length, uint64_t size) {
     return isInRange<uint64_t, uint64_t>(0, size, offset, length);
 }
@@ -98,7 +161,7 @@ Return<void> DescramblerImpl::descramble(ScramblingControl scramblingControl,
         return Void();
     }
 
-    sp<IMemory> srcMem = mapMemory(srcBuffer.heapBase);
+    sp<IMemory> srcMem = mapHeap(srcBuffer.heapBase);
 
     // Validate if the offset and size in the SharedBuffer is consistent with the
     // mapped ashmem, since the offset and size is controlled by client.
@@ -185,6 +248,9 @@ Return<Status> DescramblerImpl::release() {
     std::shared_ptr<DescramblerPlugin> holder(nullptr);
     std::atomic_store(&mPluginHolder, holder);
 
+    // The cached mappings keep the client's heaps alive, drop them with the session.
+    clearHeapCache();
+
     return Status::OK;
 }
 
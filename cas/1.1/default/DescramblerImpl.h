@@ -17,9 +17,14 @@
 #ifndef ANDROID_HARDWARE_CAS_V1_1_DESCRAMBLER_IMPL_H_
 #define ANDROID_HARDWARE_CAS_V1_1_DESCRAMBLER_IMPL_H_
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/cas/native/1.0/IDescrambler.h>
+#include <android/hidl/memory/1.0/IMemory.h>
 #include <media/stagefright/foundation/ABase.h>
 
+#include <list>
+#include <mutex>
+
 namespace android {
 struct DescramblerPlugin;
 using namespace hardware::cas::native::V1_0;
@@ -52,9 +57,29 @@ class DescramblerImpl : public IDescrambler {
     virtual Return<Status> release() override;
 
    private:
+    // A heap mapped by an earlier descramble call. The fd is a dup of the one the heap came with,
+    // kept to recognize the heap in the later calls, which each receive it under a new fd.
+    struct MappedHeap {
+        base::unique_fd fd;
+        uint64_t size;
+        sp<hidl::memory::V1_0::IMemory> memory;
+    };
+
+    // Returns the mapping of the heap, from the cache if it was already mapped.
+    sp<hidl::memory::V1_0::IMemory> mapHeap(const hidl_memory& heapBase);
+    void clearHeapCache();
+
+    static constexpr size_t kMaxMappedHeaps = 8;
+
     sp<SharedLibrary> mLibrary;
     std::shared_ptr<DescramblerPlugin> mPluginHolder;
 
+    std::mutex mHeapCacheLock;
+    // Most recently used first
+    std::list<MappedHeap> mMappedHeaps;
+    // Cleared if the kernel cannot compare fds, in which case heaps are mapped on every call
+    bool mHeapCacheSupported = true;
+
     DISALLOW_EVIL_CONSTRUCTORS(DescramblerImpl);
 };
 
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.cas@1.1-SessionExecutor"
+
+#include <utils/Log.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "SessionExecutor.h"
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_1 {
+namespace implementation {
+
+struct SessionExecutor::State {
+    State()
+        : metrics("cas.session"),
+          queuedJobs(metrics.counter("queued_jobs")),
+          latency(metrics.histogram("job_latency")) {}
+
+    struct Job {
+        std::function<void()> function;
+        nsecs_t postTimeNs;
+    };
+
+    std::mutex lock;
+    std::condition_variable condition;
+    std::deque<Job> jobs;
+    bool exiting = false;
+
+    metrics::Registry metrics;
+    metrics::Counter* const queuedJobs;
+    metrics::Histogram* const latency;
+};
+
+SessionExecutor::SessionExecutor()
+    : mState(std::make_shared<State>()), mThread(threadLoop, mState) {}
+
+SessionExecutor::~SessionExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mState->lock);
+        mState->exiting = true;
+        mState->condition.notify_one();
+    }
+    if (std::this_thread::get_id() == mThread.get_id()) {
+        // A session can be closed from a listener callback made on its own thread, which cannot
+        // join itself.
+        mThread.detach();
+    } else {
+        mThread.join();
+    }
+}
+
+// static
+void SessionExecutor::threadLoop(std::shared_ptr<State> state) {
+    std::unique_lock<std::mutex> lock(state->lock);
+    while (true) {
+        state->condition.wait(lock, [&] { return state->exiting || !state->jobs.empty(); });
+        if (state->jobs.empty()) {
+            break;
+        }
+        State::Job job = std::move(state->jobs.front());
+        state->jobs.pop_front();
+
+        lock.unlock();
+        job.function();
+        state->queuedJobs->increment(-1);
+        state->latency->record(
+                std::chrono::nanoseconds(systemTime(SYSTEM_TIME_MONOTONIC) - job.postTimeNs));
+        state->metrics.maybeTraceHistograms();
+        lock.lock();
+    }
+    ALOGV("session thread exiting");
+}
+
+status_t SessionExecutor::run(const std::function<status_t()>& job) {
+    if (std::this_thread::get_id() == mThread.get_id()) {
+        // Waiting for the job would deadlock, it cannot run after the one making this call.
+        return job();
+    }
+
+    std::promise<status_t> result;
+    std::future<status_t> future = result.get_future();
+    post([&] { result.set_value(job()); });
+    return future.get();
+}
+
+void SessionExecutor::post(std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mState->lock);
+    mState->jobs.push_back({std::move(job), systemTime(SYSTEM_TIME_MONOTONIC)});
+    mState->queuedJobs->increment();
+    mState->condition.notify_one();
+}
+
+void SessionExecutor::dump(int fd) const {
+    mState->metrics.dump(fd);
+}
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
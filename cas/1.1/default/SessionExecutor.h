@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CAS_V1_1_SESSION_EXECUTOR_H_
+#define ANDROID_HARDWARE_CAS_V1_1_SESSION_EXECUTOR_H_
+
+#include <hal-metrics/Metrics.h>
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace cas {
+namespace V1_1 {
+namespace implementation {
+
+// Runs the work of one session on its own thread, in the order it is posted, so that sessions
+// do not wait for each other.
+//
+// Each executor has its own registry: the "queued_jobs" counter holds the jobs queued on it, and
+// the "job_latency" histogram the time from posting each job to its completion.
+class SessionExecutor {
+   public:
+    SessionExecutor();
+    // Completes the jobs already posted and joins the thread. When the last reference is dropped
+    // by a job of the session itself, the thread is detached instead, and exits once that job
+    // returns.
+    ~SessionExecutor();
+
+    // Runs the job after the ones posted before it, and returns its result.
+    status_t run(const std::function<status_t()>& job);
+
+    // Queues the job after the ones posted before it, without waiting for it.
+    void post(std::function<void()> job);
+
+    // Writes the metrics of the session to fd.
+    void dump(int fd) const;
+
+   private:
+    struct State;
+    static void threadLoop(std::shared_ptr<State> state);
+
+    // Shared with the thread, which outlives the executor when it is detached
+    std::shared_ptr<State> mState;
+    std::thread mThread;
+
+    DISALLOW_EVIL_CONSTRUCTORS(SessionExecutor);
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace cas
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CAS_V1_1_SESSION_EXECUTOR_H_
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define ATRACE_TAG ATRACE_TAG_HAL
+
+#include <hal-metrics/Metrics.h>
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <cutils/trace.h>
+
+using android::base::StringAppendF;
+
+namespace android {
+namespace hardware {
+namespace metrics {
+
+namespace {
+
+constexpr std::chrono::nanoseconds kTracePeriod = std::chrono::seconds(1);
+
+int64_t toMicroseconds(std::chrono::nanoseconds value) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+}
+
+}  // namespace
+
+void Counter::trace(int64_t value) const {
+    if (ATRACE_ENABLED()) {
+        ATRACE_INT64(mTraceName.c_str(), value);
+    }
+}
+
+void Histogram::record(std::chrono::nanoseconds value) {
+    uint64_t us = value.count() > 0 ? toMicroseconds(value) : 0;
+    size_t bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    mBuckets[std::min(bucket, kBucketCount - 1)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mTotalNs.fetch_add(value.count(), std::memory_order_relaxed);
+    int64_t max = mMaxNs.load(std::memory_order_relaxed);
+    while (value.count() > max &&
+           !mMaxNs.compare_exchange_weak(max, value.count(), std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        snapshot.buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.total = std::chrono::nanoseconds(mTotalNs.load(std::memory_order_relaxed));
+    snapshot.max = std::chrono::nanoseconds(mMaxNs.load(std::memory_order_relaxed));
+    return snapshot;
+}
+
+std::chrono::microseconds Histogram::Snapshot::percentile(double percent) const {
+    uint64_t rank = static_cast<uint64_t>(count * percent / 100);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount - 1; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return std::chrono::microseconds(1ll << i);
+        }
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(max);
+}
+
+Counter* Registry::counter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto& counter = mCounters[name];
+    if (counter == nullptr) {
+        counter = std::make_unique<Counter>(mPrefix + "." + name);
+    }
+    return counter.get();
+}
+
+Histogram* Registry::histogram(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto& histogram = mHistograms[name];
+    if (histogram == nullptr) {
+        histogram = std::make_unique<Histogram>();
+    }
+    return histogram.get();
+}
+
+std::string Registry::toString() const {
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (const auto& counter : mCounters) {
+            StringAppendF(&out, "%s: %" PRId64 "\n", counter.first.c_str(),
+                          counter.second->value());
+        }
+        for (const auto& histogram : mHistograms) {
+            Histogram::Snapshot snapshot = histogram.second->snapshot();
+            StringAppendF(&out, "%s: %" PRIu64 " samples", histogram.first.c_str(),
+                          snapshot.count);
+            if (snapshot.count > 0) {
+                StringAppendF(&out,
+                              ", mean %" PRId64 "us, p50 %" PRId64 "us, p99 %" PRId64
+                              "us, max %" PRId64 "us",
+                              toMicroseconds(snapshot.total) / static_cast<int64_t>(snapshot.count),
+                              static_cast<int64_t>(snapshot.percentile(50).count()),
+                              static_cast<int64_t>(snapshot.percentile(99).count()),
+                              toMicroseconds(snapshot.max));
+            }
+            out += "\n";
+        }
+    }
+    return out;
+}
+
+void Registry::dump(int fd) const {
+    android::base::WriteStringToFd(toString(), fd);
+}
+
+void Registry::traceHistograms() const {
+    if (!ATRACE_ENABLED()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    for (const auto& histogram : mHistograms) {
+        Histogram::Snapshot snapshot = histogram.second->snapshot();
+        std::string name = mPrefix + "." + histogram.first;
+        ATRACE_INT64((name + ".count").c_str(), snapshot.count);
+        ATRACE_INT64((name + ".p99_us").c_str(), snapshot.percentile(99).count());
+    }
+}
+
+void Registry::maybeTraceHistograms() {
+    if (!ATRACE_ENABLED()) {
+        return;
+    }
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now().time_since_epoch())
+                          .count();
+    int64_t next = mNextTraceNs.load(std::memory_order_relaxed);
+    if (now < next || !mNextTraceNs.compare_exchange_strong(next, now + kTracePeriod.count(),
+                                                            std::memory_order_relaxed)) {
+        return;
+    }
+    traceHistograms();
+}
+
+}  // namespace metrics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_COMMON_METRICS_H
+#define ANDROID_HARDWARE_COMMON_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace metrics {
+
+// A value that only its owner updates, such as an event count or a queue depth. Updates are
+// relaxed atomics, safe from any thread. A counter set while the HAL trace tag is enabled is
+// also traced as a systrace counter.
+class Counter {
+   public:
+    explicit Counter(std::string traceName) : mTraceName(std::move(traceName)) {}
+
+    void increment(int64_t delta = 1) {
+        trace(mValue.fetch_add(delta, std::memory_order_relaxed) + delta);
+    }
+    void set(int64_t value) {
+        mValue.store(value, std::memory_order_relaxed);
+        trace(value);
+    }
+    int64_t value() const { return mValue.load(std::memory_order_relaxed); }
+
+   private:
+    void trace(int64_t value) const;
+
+    const std::string mTraceName;
+    std::atomic<int64_t> mValue{0};
+};
+
+// Latency histogram with fixed power of two buckets: bucket 0 counts the values under 1us,
+// bucket i the ones in [2^(i-1), 2^i) us, and the last bucket everything longer. record() takes a
+// few relaxed atomic adds and never blocks, so it fits real-time threads.
+class Histogram {
+   public:
+    static constexpr size_t kBucketCount = 24;
+
+    struct Snapshot {
+        std::array<uint64_t, kBucketCount> buckets{};
+        uint64_t count = 0;
+        std::chrono::nanoseconds total{0};
+        std::chrono::nanoseconds max{0};
+
+        // Upper bound of the bucket holding the given percentile, or max for the last bucket.
+        std::chrono::microseconds percentile(double percent) const;
+    };
+
+    void record(std::chrono::nanoseconds value);
+    // Not atomic as a whole: a snapshot taken during record() may be one sample off.
+    Snapshot snapshot() const;
+
+   private:
+    std::array<std::atomic<uint64_t>, kBucketCount> mBuckets{};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<int64_t> mTotalNs{0};
+    std::atomic<int64_t> mMaxNs{0};
+};
+
+// Records the time from its construction to its destruction into a histogram.
+class ScopedTimer {
+   public:
+    explicit ScopedTimer(Histogram* histogram)
+        : mHistogram(histogram), mStart(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() { mHistogram->record(std::chrono::steady_clock::now() - mStart); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+   private:
+    Histogram* const mHistogram;
+    const std::chrono::steady_clock::time_point mStart;
+};
+
+// The named counters and histograms of a HAL instance. Metrics are created on first lookup,
+// which takes a lock, so hot paths look them up once and keep the pointer; it stays valid for
+// the life of the registry.
+class Registry {
+   public:
+    // The prefix names the HAL in the trace counters, e.g. "audio.out".
+    explicit Registry(std::string prefix) : mPrefix(std::move(prefix)) {}
+
+    Counter* counter(const std::string& name);
+    Histogram* histogram(const std::string& name);
+
+    // One line per metric, sorted by name:
+    //   <name>: <value>
+    //   <name>: <count> samples, mean <us>us, p50 <us>us, p99 <us>us, max <us>us
+    std::string toString() const;
+    // Writes toString() to fd.
+    void dump(int fd) const;
+    // Traces the sample count and p99 of each histogram as systrace counters.
+    void traceHistograms() const;
+    // Calls traceHistograms() if the HAL trace tag is enabled and it was not called in the last
+    // second. It may take the registry lock, so call it after recording a sample on threads
+    // that can afford it, not on real-time threads.
+    void maybeTraceHistograms();
+
+   private:
+    const std::string mPrefix;
+    std::atomic<int64_t> mNextTraceNs{0};
+    mutable std::mutex mLock;
+    std::map<std::string, std::unique_ptr<Counter>> mCounters;
+    std::map<std::string, std::unique_ptr<Histogram>> mHistograms;
+};
+
+// The sample at the given percentile of samples sorted in increasing order, which must not be
+// empty. Benchmarks keep every sample and use this; hot paths record into a Histogram instead.
+template <typename T>
+T percentile(const std::vector<T>& sorted, double percent) {
+    return sorted[static_cast<size_t>((sorted.size() - 1) * percent / 100)];
+}
+
+}  // namespace metrics
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_COMMON_METRICS_H
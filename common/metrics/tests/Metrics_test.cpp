@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <hal-metrics/Metrics.h>
+
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace android {
+namespace hardware {
+namespace metrics {
+namespace {
+
+TEST(HistogramTest, Buckets) {
+    Histogram histogram;
+    histogram.record(0ns);
+    histogram.record(999ns);  // Under 1us
+    histogram.record(1us);
+    histogram.record(1999ns);
+    histogram.record(2us);
+    histogram.record(3us);
+    histogram.record(4us);
+    histogram.record(1000us);
+    histogram.record(-1us);  // Counted as 0
+
+    Histogram::Snapshot snapshot = histogram.snapshot();
+    EXPECT_EQ(9u, snapshot.count);
+    EXPECT_EQ(3u, snapshot.buckets[0]);
+    EXPECT_EQ(2u, snapshot.buckets[1]);   // [1us, 2us)
+    EXPECT_EQ(2u, snapshot.buckets[2]);   // [2us, 4us)
+    EXPECT_EQ(1u, snapshot.buckets[3]);   // [4us, 8us)
+    EXPECT_EQ(1u, snapshot.buckets[10]);  // [512us, 1024us)
+    EXPECT_EQ(std::chrono::nanoseconds(1000us), snapshot.max);
+    EXPECT_EQ(std::chrono::nanoseconds(999 + 1000 + 1999 + 2000 + 3000 + 4000 + 1000000 - 1000),
+              snapshot.total);
+}
+
+TEST(HistogramTest, LastBucketTakesLongerValues) {
+    Histogram histogram;
+    histogram.record(std::chrono::hours(1));
+    histogram.record(std::chrono::microseconds(1ll << (Histogram::kBucketCount - 2)));
+
+    Histogram::Snapshot snapshot = histogram.snapshot();
+    EXPECT_EQ(2u, snapshot.buckets[Histogram::kBucketCount - 1]);
+    EXPECT_EQ(std::chrono::nanoseconds(std::chrono::hours(1)), snapshot.max);
+}
+
+TEST(HistogramTest, PercentileIsUpperBoundOfItsBucket) {
+    Histogram histogram;
+    for (int i = 0; i < 90; i++) {
+        histogram.record(1us);
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.record(100us);  // [64us, 128us)
+    }
+
+    Histogram::Snapshot snapshot = histogram.snapshot();
+    EXPECT_EQ(2us, snapshot.percentile(0));
+    EXPECT_EQ(2us, snapshot.percentile(50));
+    EXPECT_EQ(2us, snapshot.percentile(89.9));
+    EXPECT_EQ(128us, snapshot.percentile(90));
+    EXPECT_EQ(128us, snapshot.percentile(99));
+    // No sample ranks past the last one, which gives max
+    EXPECT_EQ(100us, snapshot.percentile(100));
+}
+
+TEST(HistogramTest, PercentileInLastBucketIsMax) {
+    Histogram histogram;
+    histogram.record(std::chrono::hours(1));
+
+    EXPECT_EQ(std::chrono::microseconds(std::chrono::hours(1)),
+              histogram.snapshot().percentile(50));
+}
+
+TEST(HistogramTest, PercentileOfEmptyHistogramIsZero) {
+    Histogram histogram;
+
+    EXPECT_EQ(0us, histogram.snapshot().percentile(50));
+}
+
+TEST(PercentileTest, PicksTheSampleAtTheRank) {
+    std::vector<int64_t> sorted;
+    for (int64_t i = 1; i <= 101; i++) {
+        sorted.push_back(i);
+    }
+
+    EXPECT_EQ(1, percentile(sorted, 0));
+    EXPECT_EQ(51, percentile(sorted, 50));
+    EXPECT_EQ(100, percentile(sorted, 99));
+    EXPECT_EQ(101, percentile(sorted, 100));
+    EXPECT_EQ(7, percentile(std::vector<int64_t>{7}, 99));
+}
+
+TEST(RegistryTest, ReturnsTheSameMetricForAName) {
+    Registry registry("test");
+
+    EXPECT_EQ(registry.counter("a"), registry.counter("a"));
+    EXPECT_NE(registry.counter("a"), registry.counter("b"));
+    EXPECT_EQ(registry.histogram("a"), registry.histogram("a"));
+}
+
+TEST(RegistryTest, ToString) {
+    Registry registry("test");
+    registry.counter("b")->increment(3);
+    registry.counter("a")->set(-1);
+    registry.histogram("empty");
+    Histogram* latency = registry.histogram("latency");
+    latency->record(10us);
+    latency->record(30us);
+
+    EXPECT_EQ(
+            "a: -1\n"
+            "b: 3\n"
+            "empty: 0 samples\n"
+            "latency: 2 samples, mean 20us, p50 32us, p99 32us, max 30us\n",
+            registry.toString());
+}
+
+}  // namespace
+}  // namespace metrics
+}  // namespace hardware
+}  // namespace android
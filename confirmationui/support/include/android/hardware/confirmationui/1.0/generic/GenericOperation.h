@@ -73,9 +73,21 @@ class Operation {
         // to read it from the shared buffer directly. Anyway we don't trust or interpret the
         // extra data in any way so all we do is take a snapshot and we don't care if it is
         // modified concurrently.
-        auto state = write(WriteState(formattedMessageBuffer_),
-                           map(pair(text("prompt"), text(promptStringBuffer_, promptText.size())),
-                               pair(text("extra"), bytes(extraData))));
+        // The message is sized first, so that an oversized one is rejected before anything is
+        // written, and then formatted exactly once. Both the result and the confirmation token
+        // are taken from formattedMessageBuffer_ as is.
+        auto promptKey = text("prompt");
+        auto prompt = text(promptStringBuffer_, promptText.size());
+        auto extraKey = text("extra");
+        auto extra = bytes(extraData);
+        auto promptPair = pair(promptKey, prompt);
+        auto extraPair = pair(extraKey, extra);
+        auto message = map(promptPair, extraPair);
+        size_t messageSize = serializedSize(message);
+        if (messageSize > sizeof(formattedMessageBuffer_)) {
+            return ResponseCode::UIErrorMessageTooLong;
+        }
+        auto state = write(WriteState(formattedMessageBuffer_, messageSize), message);
         switch (state.error_) {
             case Error::OK:
                 break;
@@ -57,7 +57,7 @@ template <typename Key, typename Value>
 struct MapElement {
     const Key& key_;
     const Value& value_;
-    MapElement(const Key& key, const Value& value) : key_(key), value_(value) {}
+    constexpr MapElement(const Key& key, const Value& value) : key_(key), value_(value) {}
 };
 
 template <typename... Elems>
@@ -67,7 +67,7 @@ template <typename Head, typename... Tail>
 struct Array<Head, Tail...> {
     const Head& head_;
     Array<Tail...> tail_;
-    Array(const Head& head, const Tail&... tail) : head_(head), tail_(tail...) {}
+    constexpr Array(const Head& head, const Tail&... tail) : head_(head), tail_(tail...) {}
     constexpr size_t size() const { return sizeof...(Tail) + 1; };
 };
 
@@ -81,11 +81,11 @@ template <typename T, typename Variant>
 struct StringBuffer {
     const T* data_;
     size_t size_;
-    StringBuffer(const T* data, size_t size) : data_(data), size_(size) {
+    constexpr StringBuffer(const T* data, size_t size) : data_(data), size_(size) {
         static_assert(sizeof(T) == 1, "elements too large");
     }
-    const T* data() const { return data_; }
-    size_t size() const { return size_; }
+    constexpr const T* data() const { return data_; }
+    constexpr size_t size() const { return size_; }
 };
 
 /**
@@ -94,7 +94,7 @@ struct StringBuffer {
  * If the terminating 0 shall not be stripped use text_keep_last.
  */
 template <size_t size>
-StringBuffer<char, TextStr> text(const char (&str)[size]) {
+constexpr StringBuffer<char, TextStr> text(const char (&str)[size]) {
     if (size > 0) return StringBuffer<char, TextStr>(str, size - 1);
     return StringBuffer<char, TextStr>(str, size);
 }
@@ -103,7 +103,7 @@ StringBuffer<char, TextStr> text(const char (&str)[size]) {
  * As opposed to text(const char (&str)[size] this function does not strips the last character.
  */
 template <size_t size>
-StringBuffer<char, TextStr> text_keep_last(const char (&str)[size]) {
+constexpr StringBuffer<char, TextStr> text_keep_last(const char (&str)[size]) {
     return StringBuffer<char, TextStr>(str, size);
 }
 
@@ -122,17 +122,17 @@ auto text(const T& str) -> StringBuffer<std::decay_t<decltype(*getData(str))>, T
     return StringBuffer<std::decay_t<decltype(*getData(str))>, TextStr>(getData(str), str.size());
 }
 
-inline StringBuffer<char, TextStr> text(const char* str, size_t size) {
+constexpr StringBuffer<char, TextStr> text(const char* str, size_t size) {
     return StringBuffer<char, TextStr>(str, size);
 }
 
 template <typename T, size_t size>
-StringBuffer<T, ByteStr> bytes(const T (&str)[size]) {
+constexpr StringBuffer<T, ByteStr> bytes(const T (&str)[size]) {
     return StringBuffer<T, ByteStr>(str, size);
 }
 
 template <typename T>
-StringBuffer<T, ByteStr> bytes(const T* str, size_t size) {
+constexpr StringBuffer<T, ByteStr> bytes(const T* str, size_t size) {
     return StringBuffer<T, ByteStr>(str, size);
 }
 
@@ -148,7 +148,7 @@ template <typename HeadKey, typename HeadValue, typename... Tail>
 struct Map<MapElement<HeadKey, HeadValue>, Tail...> {
     const MapElement<HeadKey, HeadValue>& head_;
     Map<Tail...> tail_;
-    Map(const MapElement<HeadKey, HeadValue>& head, const Tail&... tail)
+    constexpr Map(const MapElement<HeadKey, HeadValue>& head, const Tail&... tail)
         : head_(head), tail_(tail...) {}
     constexpr size_t size() const { return sizeof...(Tail) + 1; };
 };
@@ -157,17 +157,17 @@ template <>
 struct Map<> {};
 
 template <typename... Keys, typename... Values>
-Map<MapElement<Keys, Values>...> map(const MapElement<Keys, Values>&... elements) {
+constexpr Map<MapElement<Keys, Values>...> map(const MapElement<Keys, Values>&... elements) {
     return Map<MapElement<Keys, Values>...>(elements...);
 }
 
 template <typename... Elements>
-Array<Elements...> arr(const Elements&... elements) {
+constexpr Array<Elements...> arr(const Elements&... elements) {
     return Array<Elements...>(elements...);
 }
 
 template <typename Key, typename Value>
-MapElement<Key, Value> pair(const Key& k, const Value& v) {
+constexpr MapElement<Key, Value> pair(const Key& k, const Value& v) {
     return MapElement<Key, Value>(k, v);
 }
 
@@ -327,6 +327,83 @@ WriteState write(WriteState wState, const Head& head, const Tail&... tail) {
     return write(wState, tail...);
 }
 
+/**
+ * The serializedSize overloads mirror the write overloads above and return the exact number of
+ * bytes write will use for the same arguments, without writing anything. This allows sizing the
+ * buffer, or rejecting an oversized message, before any of it is formatted. They are constexpr so
+ * that messages made of literals are sized at compile time.
+ */
+constexpr size_t headerSize(const uint64_t value) {
+    return value < 24 ? 1
+                      : value < 0x100 ? 2
+                                      : value < 0x10000 ? 3 : value < 0x100000000 ? 5 : 9;
+}
+
+template <typename T>
+constexpr size_t numberSize(const T& v) {
+    return v >= 0 ? headerSize(v) : headerSize(UINT64_C(-1) - v);
+}
+
+constexpr size_t serializedSize(const uint8_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const int8_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const uint16_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const int16_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const uint32_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const int32_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const uint64_t& v) {
+    return numberSize(v);
+}
+constexpr size_t serializedSize(const int64_t& v) {
+    return numberSize(v);
+}
+
+template <typename T, typename Variant>
+constexpr size_t serializedSize(const StringBuffer<T, Variant>& v) {
+    return headerSize(v.size()) + v.size();
+}
+
+template <template <typename...> class Arr>
+constexpr size_t serializedSizeArrayHelper(const Arr<>&) {
+    return 0;
+}
+
+template <template <typename...> class Arr, typename Head, typename... Tail>
+constexpr size_t serializedSizeArrayHelper(const Arr<Head, Tail...>& arr) {
+    return serializedSize(arr.head_) + serializedSizeArrayHelper(arr.tail_);
+}
+
+template <typename... Elems>
+constexpr size_t serializedSize(const Map<Elems...>& map) {
+    return headerSize(map.size()) + serializedSizeArrayHelper(map);
+}
+
+template <typename... Elems>
+constexpr size_t serializedSize(const Array<Elems...>& arr) {
+    return headerSize(arr.size()) + serializedSizeArrayHelper(arr);
+}
+
+template <typename Key, typename Value>
+constexpr size_t serializedSize(const MapElement<Key, Value>& element) {
+    return serializedSize(element.key_) + serializedSize(element.value_);
+}
+
+template <typename Head, typename... Tail>
+constexpr size_t serializedSize(const Head& head, const Tail&... tail) {
+    return serializedSize(head) + serializedSize(tail...);
+}
+
 }  // namespace support
 }  // namespace confirmationui
 }  // namespace hardware
@@ -86,6 +86,42 @@ TEST(Cbor, FeatureTest) {
     ASSERT_EQ(0, memcmp(buffer, testVector, sizeof(testVector)));
 }
 
+size_t serializedSizeTest() {
+    return serializedSize(                                                  //
+        map(                                                                //
+            pair(text("key"), text("value")),                               //
+            pair(text("key"), bytes("100101010010")),                       //
+            pair(4, 7),                                                     //
+            pair((UINT64_C(1) << 62), INT64_C(-2000000000000000))           //
+            ),                                                              //
+        arr(text("♨⚖ⶖ"), bytes(fourHundredAs)));
+}
+
+TEST(Cbor, SerializedSizeTest) {
+    ASSERT_EQ(sizeof(testVector), serializedSizeTest());
+
+    uint8_t buffer[sizeof(testVector)];
+    WriteState state(buffer, serializedSizeTest());
+    state = writeTest(state);
+    ASSERT_EQ(Error::OK, state.error_);
+    ASSERT_EQ(sizeof(testVector), size_t(state.data_ - buffer));
+}
+
+TEST(Cbor, SerializedSizeIsConstexpr) {
+    // 1 map header, 1 + 6 "prompt", 1 + 5 "value"
+    static_assert(serializedSize(map(pair(text("prompt"), text("value")))) == 14,
+                  "message of literals sized at compile time");
+    static_assert(serializedSize(bytes(fourHundredAs)) == 3 + sizeof(fourHundredAs),
+                  "byte string sized at compile time");
+    ASSERT_EQ(size_t(1), serializedSize(23));
+    ASSERT_EQ(size_t(2), serializedSize(24));
+    ASSERT_EQ(size_t(3), serializedSize(uint16_t(0xffff)));
+    ASSERT_EQ(size_t(5), serializedSize(UINT64_C(0xffffffff)));
+    ASSERT_EQ(size_t(9), serializedSize(UINT64_C(0x100000000)));
+    ASSERT_EQ(size_t(1), serializedSize(-24));
+    ASSERT_EQ(size_t(2), serializedSize(-25));
+}
+
 // Test if in all write cases an out of data error is correctly propagated and we don't
 // write beyond  the end of the buffer.
 TEST(Cbor, BufferTooShort) {
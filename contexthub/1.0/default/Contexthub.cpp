@@ -35,11 +35,20 @@ namespace implementation {
 
 static constexpr uint64_t ALL_APPS = UINT64_C(0xFFFFFFFFFFFFFFFF);
 
+// Loading writes the nanoapp to the hub storage, which takes much longer than the other requests
+static constexpr std::chrono::milliseconds kLoadTimeout = std::chrono::seconds(30);
+static constexpr std::chrono::milliseconds kTransactionTimeout = std::chrono::seconds(5);
+
 Contexthub::Contexthub()
         : mInitCheck(NO_INIT),
           mContextHubModule(nullptr),
           mDeathRecipient(new DeathRecipient(this)),
-          mIsTransactionPending(false) {
+          mTransactions([this](uint32_t hubId, uint32_t transactionId, TransactionResult result) {
+              sp<IContexthubCallback> cb = getCallBackForHubId(hubId);
+              if (cb != nullptr) {
+                  cb->handleTxnResult(transactionId, result);
+              }
+          }) {
     const hw_module_t *module;
 
     mInitCheck = hw_get_module(CONTEXT_HUB_MODULE_ID, &module);
@@ -260,6 +269,7 @@ static bool isValidOsStatus(const uint8_t *msg,
 }
 
 int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
+                                uint32_t hubId,
                                 uint32_t msgType,
                                 const uint8_t *msg,
                                 int msgLen) {
@@ -281,9 +291,8 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
                 result = TransactionResult::FAILURE;
             }
 
-            mIsTransactionPending = false;
-            if (cb != nullptr) {
-                cb->handleTxnResult(mTransactionId, result);
+            if (!mTransactions.complete(hubId, msgType, result)) {
+                ALOGW("No pending transaction for response of type %" PRIu32, msgType);
             }
             retVal = 0;
             break;
@@ -294,6 +303,7 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
             std::vector<HubAppInfo> apps;
             int numApps = msgLen / sizeof(hub_app_info);
             const hub_app_info *unalignedInfoAddr = reinterpret_cast<const hub_app_info *>(msg);
+            apps.reserve(numApps);
 
             for (int i = 0; i < numApps; i++) {
                 hub_app_info query_info;
@@ -322,7 +332,7 @@ int Contexthub::handleOsMessage(sp<IContexthubCallback> cb,
 
         case CONTEXT_HUB_OS_REBOOT:
         {
-            mIsTransactionPending = false;
+            mTransactions.failAll(hubId);
             if (cb != nullptr) {
                 cb->handleHubEvent(AsyncEventType::RESTARTED);
             }
@@ -375,6 +385,7 @@ int Contexthub::contextHubCb(uint32_t hubId,
 
     if (rxMsg->message_type < CONTEXT_HUB_TYPE_PRIVATE_MSG_BASE) {
         obj->handleOsMessage(cb,
+                             hubId,
                              rxMsg->message_type,
                              static_cast<const uint8_t *>(rxMsg->message),
                              rxMsg->message_len);
@@ -384,9 +395,10 @@ int Contexthub::contextHubCb(uint32_t hubId,
         msg.appName = rxMsg->app_name.id;
         msg.msgType = rxMsg->message_type;
         msg.hostEndPoint = static_cast<uint16_t>(HostEndPoint::BROADCAST);
-        msg.msg = std::vector<uint8_t>(static_cast<const uint8_t *>(rxMsg->message),
-                                       static_cast<const uint8_t *>(rxMsg->message) +
-                                       rxMsg->message_len);
+        // rxMsg stays valid until handleClientMsg returns, so it is not copied beforehand
+        msg.msg.setToExternal(
+                const_cast<uint8_t *>(static_cast<const uint8_t *>(rxMsg->message)),
+                rxMsg->message_len);
 
         cb->handleClientMsg(msg);
     }
@@ -401,10 +413,6 @@ Return<Result> Contexthub::unloadNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -418,11 +426,14 @@ Return<Result> Contexthub::unloadNanoApp(uint32_t hubId,
     msg.message = &req;
     req.app_name.id = appId;
 
-    if(mContextHubModule->send_message(hubId, &msg) != 0) {
+    if (!mTransactions.add(hubId, CONTEXT_HUB_UNLOAD_APP, transactionId, kTransactionTimeout)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    if (mContextHubModule->send_message(hubId, &msg) != 0) {
+        mTransactions.cancel(hubId, transactionId);
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -434,10 +445,6 @@ Return<Result> Contexthub::loadNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t hubMsg;
 
     if (setOsAppAsDestination(&hubMsg, hubId) == false) {
@@ -468,11 +475,14 @@ Return<Result> Contexthub::loadNanoApp(uint32_t hubId,
     hubMsg.message_len = binaryWithHeader.size();
     hubMsg.message = binaryWithHeader.data();
 
+    if (!mTransactions.add(hubId, CONTEXT_HUB_LOAD_APP, transactionId, kLoadTimeout)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
     if (mContextHubModule->send_message(hubId, &hubMsg) != 0) {
+        mTransactions.cancel(hubId, transactionId);
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -484,10 +494,6 @@ Return<Result> Contexthub::enableNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -501,11 +507,14 @@ Return<Result> Contexthub::enableNanoApp(uint32_t hubId,
     req.app_name.id = appId;
     msg.message = &req;
 
-    if(mContextHubModule->send_message(hubId, &msg) != 0) {
+    if (!mTransactions.add(hubId, CONTEXT_HUB_APPS_ENABLE, transactionId, kTransactionTimeout)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    if (mContextHubModule->send_message(hubId, &msg) != 0) {
+        mTransactions.cancel(hubId, transactionId);
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -517,10 +526,6 @@ Return<Result> Contexthub::disableNanoApp(uint32_t hubId,
       return Result::NOT_INIT;
     }
 
-    if (mIsTransactionPending) {
-        return Result::TRANSACTION_PENDING;
-    }
-
     hub_message_t msg;
 
     if (setOsAppAsDestination(&msg, hubId) == false) {
@@ -534,11 +539,14 @@ Return<Result> Contexthub::disableNanoApp(uint32_t hubId,
     req.app_name.id = appId;
     msg.message = &req;
 
-    if(mContextHubModule->send_message(hubId, &msg) != 0) {
+    if (!mTransactions.add(hubId, CONTEXT_HUB_APPS_DISABLE, transactionId, kTransactionTimeout)) {
+        return Result::TRANSACTION_PENDING;
+    }
+
+    if (mContextHubModule->send_message(hubId, &msg) != 0) {
+        mTransactions.cancel(hubId, transactionId);
         return Result::TRANSACTION_FAILED;
     } else {
-        mTransactionId = transactionId;
-        mIsTransactionPending = true;
         return Result::OK;
     }
 }
@@ -569,6 +577,13 @@ Return<Result> Contexthub::queryApps(uint32_t hubId) {
     return Result::OK;
 }
 
+Return<void> Contexthub::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /*options*/) {
+    if (fd.getNativeHandle() != nullptr && fd->numFds > 0) {
+        mTransactions.dump(fd->data[0]);
+    }
+    return Void();
+}
+
 bool Contexthub::isInitialized() {
     return (mInitCheck == OK && mContextHubModule != nullptr);
 }
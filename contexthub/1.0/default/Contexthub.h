@@ -23,6 +23,8 @@
 #include <android/hardware/contexthub/1.0/IContexthub.h>
 #include <hardware/context_hub.h>
 
+#include "TransactionTable.h"
+
 namespace android {
 namespace hardware {
 namespace contexthub {
@@ -60,6 +62,9 @@ struct Contexthub : public ::android::hardware::contexthub::V1_0::IContexthub {
 
     Return<Result> reboot(uint32_t hubId);
 
+    // Prints the pending transactions and their latency
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     bool isInitialized();
 
 private:
@@ -86,14 +91,14 @@ private:
     std::unordered_map<uint32_t, CachedHubInformation> mCachedHubInfo;
 
     sp<DeathRecipient> mDeathRecipient;
-    bool mIsTransactionPending;
-    uint32_t mTransactionId;
+    TransactionTable mTransactions;
 
     bool isValidHubId(uint32_t hubId);
 
     sp<IContexthubCallback> getCallBackForHubId(uint32_t hubId);
 
     int handleOsMessage(sp<IContexthubCallback> cb,
+                        uint32_t hubId,
                         uint32_t msgType,
                         const uint8_t *msg,
                         int msgLen);
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TransactionTable.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace contexthub {
+namespace V1_0 {
+namespace implementation {
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+TransactionTable::TransactionTable(Completion completion)
+        : mCompletion(std::move(completion)) {
+    mThread = std::thread(&TransactionTable::timeoutLoop, this);
+}
+
+TransactionTable::~TransactionTable() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+size_t TransactionTable::pendingCountLocked(uint32_t hubId) const {
+    size_t count = 0;
+    for (auto it = mPending.lower_bound({hubId, 0});
+         it != mPending.end() && it->first.first == hubId; ++it) {
+        count += it->second.size();
+    }
+    return count;
+}
+
+bool TransactionTable::add(uint32_t hubId,
+                           uint32_t msgType,
+                           uint32_t transactionId,
+                           milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (pendingCountLocked(hubId) >= kMaxPending) {
+        return false;
+    }
+
+    auto now = Clock::now();
+    mPending[{hubId, msgType}].push_back({transactionId, now, now + timeout});
+
+    size_t depth = 0;
+    for (auto &&entry : mPending) {
+        depth += entry.second.size();
+    }
+    mMaxDepth = std::max(mMaxDepth, depth);
+
+    mCondition.notify_all();
+    return true;
+}
+
+void TransactionTable::cancel(uint32_t hubId, uint32_t transactionId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto it = mPending.lower_bound({hubId, 0});
+         it != mPending.end() && it->first.first == hubId; ++it) {
+        auto &queue = it->second;
+        auto txn = std::find_if(queue.begin(), queue.end(), [transactionId](auto &&t) {
+            return t.transactionId == transactionId;
+        });
+        if (txn != queue.end()) {
+            queue.erase(txn);
+            if (queue.empty()) {
+                mPending.erase(it);
+            }
+            return;
+        }
+    }
+}
+
+bool TransactionTable::complete(uint32_t hubId, uint32_t msgType, TransactionResult result) {
+    const Key key = {hubId, msgType};
+    uint32_t transactionId;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto late = mLateResponses.find(key);
+        if (late != mLateResponses.end()) {
+            if (--late->second == 0) {
+                mLateResponses.erase(late);
+            }
+            return true;
+        }
+
+        auto it = mPending.find(key);
+        if (it == mPending.end()) {
+            return false;
+        }
+        const Transaction &txn = it->second.front();
+        transactionId = txn.transactionId;
+
+        auto latency = Clock::now() - txn.sent;
+        Stats &stats = mStats[msgType];
+        stats.completed++;
+        stats.totalLatency += latency;
+        stats.maxLatency = std::max(stats.maxLatency, latency);
+
+        it->second.pop_front();
+        if (it->second.empty()) {
+            mPending.erase(it);
+        }
+    }
+
+    mCompletion(hubId, transactionId, result);
+    return true;
+}
+
+void TransactionTable::failAll(uint32_t hubId) {
+    std::vector<Transaction> failed;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mPending.lower_bound({hubId, 0});
+        while (it != mPending.end() && it->first.first == hubId) {
+            failed.insert(failed.end(), it->second.begin(), it->second.end());
+            it = mPending.erase(it);
+        }
+        auto late = mLateResponses.lower_bound({hubId, 0});
+        while (late != mLateResponses.end() && late->first.first == hubId) {
+            late = mLateResponses.erase(late);
+        }
+    }
+
+    std::stable_sort(failed.begin(), failed.end(), [](auto &&a, auto &&b) {
+        return a.sent < b.sent;
+    });
+    for (auto &&txn : failed) {
+        mCompletion(hubId, txn.transactionId, TransactionResult::FAILURE);
+    }
+}
+
+void TransactionTable::timeoutLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExit) {
+        auto now = Clock::now();
+        auto nextDeadline = Clock::time_point::max();
+        std::vector<std::pair<uint32_t, uint32_t>> expired;  // hubId, transactionId
+
+        for (auto it = mPending.begin(); it != mPending.end();) {
+            // All the transactions of a type share their timeout, so deadlines are in order
+            auto &queue = it->second;
+            while (!queue.empty() && queue.front().deadline <= now) {
+                expired.emplace_back(it->first.first, queue.front().transactionId);
+                mLateResponses[it->first]++;
+                mStats[it->first.second].timedOut++;
+                queue.pop_front();
+            }
+            if (queue.empty()) {
+                it = mPending.erase(it);
+            } else {
+                nextDeadline = std::min(nextDeadline, queue.front().deadline);
+                ++it;
+            }
+        }
+
+        if (!expired.empty()) {
+            lock.unlock();
+            for (auto &&txn : expired) {
+                mCompletion(txn.first, txn.second, TransactionResult::FAILURE);
+            }
+            lock.lock();
+        } else if (nextDeadline == Clock::time_point::max()) {
+            mCondition.wait(lock);
+        } else {
+            mCondition.wait_until(lock, nextDeadline);
+        }
+    }
+}
+
+void TransactionTable::dump(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto now = Clock::now();
+
+    size_t depth = 0;
+    for (auto &&entry : mPending) {
+        depth += entry.second.size();
+    }
+    dprintf(fd, "Pending transactions: %zu (max %zu)\n", depth, mMaxDepth);
+    for (auto &&entry : mPending) {
+        auto age = duration_cast<milliseconds>(now - entry.second.front().sent);
+        dprintf(fd, "  hub %" PRIu32 ", type %" PRIu32 ": %zu pending, oldest %" PRId64 " ms\n",
+                entry.first.first, entry.first.second, entry.second.size(),
+                static_cast<int64_t>(age.count()));
+    }
+
+    dprintf(fd, "Transaction latency:\n");
+    for (auto &&entry : mStats) {
+        const Stats &stats = entry.second;
+        Clock::duration average = Clock::duration::zero();
+        if (stats.completed > 0) {
+            average = stats.totalLatency / static_cast<int64_t>(stats.completed);
+        }
+        dprintf(fd,
+                "  type %" PRIu32 ": %" PRIu64 " completed, %" PRIu64 " timed out, average %" PRId64
+                " ms, max %" PRId64 " ms\n",
+                entry.first, stats.completed, stats.timedOut,
+                static_cast<int64_t>(duration_cast<milliseconds>(average).count()),
+                static_cast<int64_t>(duration_cast<milliseconds>(stats.maxLatency).count()));
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace contexthub
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_CONTEXTHUB_V1_0_TRANSACTIONTABLE_H_
+#define ANDROID_HARDWARE_CONTEXTHUB_V1_0_TRANSACTIONTABLE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <android-base/macros.h>
+#include <android/hardware/contexthub/1.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace contexthub {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * The nanoapp transactions sent to the hubs and not answered yet.
+ *
+ * Legacy responses only carry the message type of their request, so each response completes
+ * the oldest pending transaction of that type on its hub. A transaction that times out fails,
+ * and the next response of its type is then taken to be its late answer and dropped.
+ */
+class TransactionTable {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Completion = std::function<void(uint32_t hubId,
+                                          uint32_t transactionId,
+                                          TransactionResult result)>;
+
+    static constexpr size_t kMaxPending = 32;
+
+    // Called without any lock held, in completion order
+    explicit TransactionTable(Completion completion);
+    ~TransactionTable();
+
+    // Returns false if the hub already has kMaxPending transactions in flight.
+    bool add(uint32_t hubId,
+             uint32_t msgType,
+             uint32_t transactionId,
+             std::chrono::milliseconds timeout);
+
+    // Forgets a transaction whose request could not be sent, without completing it.
+    void cancel(uint32_t hubId, uint32_t transactionId);
+
+    // Completes the oldest transaction of msgType on the hub. Returns false if there was none.
+    bool complete(uint32_t hubId, uint32_t msgType, TransactionResult result);
+
+    // Fails all the transactions of the hub, which will not answer them anymore.
+    void failAll(uint32_t hubId);
+
+    void dump(int fd);
+
+private:
+    struct Transaction {
+        uint32_t transactionId;
+        Clock::time_point sent;
+        Clock::time_point deadline;
+    };
+
+    struct Stats {
+        uint64_t completed = 0;
+        uint64_t timedOut = 0;
+        Clock::duration totalLatency = Clock::duration::zero();
+        Clock::duration maxLatency = Clock::duration::zero();
+    };
+
+    using Key = std::pair<uint32_t, uint32_t>;  // hubId, msgType
+
+    size_t pendingCountLocked(uint32_t hubId) const;
+    void timeoutLoop();
+
+    Completion mCompletion;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::map<Key, std::deque<Transaction>> mPending;
+    // Responses still owed for timed out transactions, dropped when they arrive
+    std::map<Key, uint32_t> mLateResponses;
+    std::map<uint32_t, Stats> mStats;  // by msgType
+    size_t mMaxDepth = 0;
+    bool mExit = false;
+    std::thread mThread;
+
+    DISALLOW_COPY_AND_ASSIGN(TransactionTable);
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace contexthub
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_CONTEXTHUB_V1_0_TRANSACTIONTABLE_H_
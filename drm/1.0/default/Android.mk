@@ -50,6 +50,7 @@ LOCAL_SRC_FILES := \
     DrmPlugin.cpp \
     CryptoFactory.cpp \
     CryptoPlugin.cpp \
+    DecryptQueue.cpp \
     LegacyPluginPath.cpp \
     TypeConvert.cpp \
 
@@ -80,3 +81,40 @@ LOCAL_32_BIT_ONLY := true
 endif
 
 include $(BUILD_SHARED_LIBRARY)
+
+############# Build legacy drm impl unit tests ############
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.drm@1.0-impl_test
+LOCAL_SRC_FILES := \
+    CryptoPlugin.cpp \
+    DecryptQueue.cpp \
+    TypeConvert.cpp \
+    tests/CryptoPlugin_test.cpp \
+    tests/PluginIndex_test.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    android.hardware.drm@1.0 \
+    android.hidl.memory@1.0 \
+    libbase \
+    libcutils \
+    libhidlbase \
+    libhidlmemory \
+    libhidltransport \
+    liblog \
+    libstagefright_foundation \
+    libutils \
+
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.drm@1.0-helper \
+
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH) \
+    frameworks/native/include \
+    frameworks/av/include
+
+ifneq ($(TARGET_ENABLE_MEDIADRM_64), true)
+LOCAL_32_BIT_ONLY := true
+endif
+
+include $(BUILD_NATIVE_TEST)
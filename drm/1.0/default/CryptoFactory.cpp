@@ -28,41 +28,43 @@ namespace V1_0 {
 namespace implementation {
 
     CryptoFactory::CryptoFactory() :
-        loader(getDrmPluginPath(), "createCryptoFactory") {
+        loader(getDrmPluginPath(), "createCryptoFactory",
+               getDrmPluginIndexPath("createCryptoFactory").string()) {
     }
 
     // Methods from ::android::hardware::drm::V1_0::ICryptoFactory follow.
     Return<bool> CryptoFactory::isCryptoSchemeSupported(
             const hidl_array<uint8_t, 16>& uuid) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                return true;
-            }
-        }
-        return false;
+        return findFactoryForScheme(uuid) >= 0;
     }
 
     Return<void> CryptoFactory::createPlugin(const hidl_array<uint8_t, 16>& uuid,
             const hidl_vec<uint8_t>& initData, createPlugin_cb _hidl_cb) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                android::CryptoPlugin *legacyPlugin = NULL;
-                status_t status = loader.getFactory(i)->createPlugin(uuid.data(),
-                        initData.data(), initData.size(), &legacyPlugin);
-                CryptoPlugin *newPlugin = NULL;
-                if (legacyPlugin == NULL) {
-                    ALOGE("Crypto legacy HAL: failed to create crypto plugin");
-                } else {
-                    newPlugin = new CryptoPlugin(legacyPlugin);
-                }
-                _hidl_cb(toStatus(status), newPlugin);
-                return Void();
+        ssize_t i = findFactoryForScheme(uuid);
+        if (i >= 0 && loader.getFactory(i) != NULL) {
+            android::CryptoPlugin *legacyPlugin = NULL;
+            status_t status = loader.getFactory(i)->createPlugin(uuid.data(),
+                    initData.data(), initData.size(), &legacyPlugin);
+            CryptoPlugin *newPlugin = NULL;
+            if (legacyPlugin == NULL) {
+                ALOGE("Crypto legacy HAL: failed to create crypto plugin");
+            } else {
+                newPlugin = new CryptoPlugin(legacyPlugin);
             }
+            _hidl_cb(toStatus(status), newPlugin);
+            return Void();
         }
         _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, NULL);
         return Void();
     }
 
+    ssize_t CryptoFactory::findFactoryForScheme(const hidl_array<uint8_t, 16>& uuid) {
+        return loader.findFactory(getCryptoSchemeIndexKey(uuid.data()),
+                [&](android::CryptoFactory *factory) {
+                    return factory->isCryptoSchemeSupported(uuid.data());
+                });
+    }
+
     ICryptoFactory* HIDL_FETCH_ICryptoFactory(const char* /* name */) {
         return new CryptoFactory();
     }
@@ -51,6 +51,9 @@ struct CryptoFactory : public ICryptoFactory {
             override;
 
 private:
+    // Returns the plugin supporting the scheme, or -1
+    ssize_t findFactoryForScheme(const hidl_array<uint8_t, 16>& uuid);
+
     PluginLoader<android::CryptoFactory> loader;
 
     CryptoFactory(const CryptoFactory &) = delete;
@@ -23,6 +23,8 @@
 #include <log/log.h>
 #include <media/stagefright/foundation/AString.h>
 
+#include <string.h>
+
 using android::hardware::hidl_memory;
 using android::hidl::memory::V1_0::IMemory;
 
@@ -35,29 +37,57 @@ namespace implementation {
     // Methods from ::android::hardware::drm::V1_0::ICryptoPlugin follow
     Return<bool> CryptoPlugin::requiresSecureDecoderComponent(
             const hidl_string& mime) {
+        std::unique_lock<std::shared_mutex> lock(mLegacyLock);
         return mLegacyPlugin->requiresSecureDecoderComponent(mime.c_str());
     }
 
     Return<void> CryptoPlugin::notifyResolution(uint32_t width,
             uint32_t height) {
+        std::unique_lock<std::shared_mutex> lock(mLegacyLock);
         mLegacyPlugin->notifyResolution(width, height);
         return Void();
     }
 
     Return<Status> CryptoPlugin::setMediaDrmSession(
             const hidl_vec<uint8_t>& sessionId) {
+        std::unique_lock<std::shared_mutex> lock(mLegacyLock);
         return toStatus(mLegacyPlugin->setMediaDrmSession(toVector(sessionId)));
     }
 
     Return<void> CryptoPlugin::setSharedBufferBase(const hidl_memory& base,
             uint32_t bufferId) {
-        sp<IMemory> hidlMemory = mapMemory(base);
+        SharedBufferSlot slot;
+        slot.isSet = true;
+        slot.memory = mapMemory(base);
 
         // allow mapMemory to return nullptr
-        mSharedBufferMap[bufferId] = hidlMemory;
+        if (slot.memory != nullptr) {
+            slot.base = static_cast<uint8_t *>(
+                    static_cast<void *>(slot.memory->getPointer()));
+            slot.size = slot.memory->getSize();
+        }
+
+        if (bufferId < kMaxIndexedBufferId) {
+            if (bufferId >= mSharedBuffers.size()) {
+                mSharedBuffers.resize(bufferId + 1);
+            }
+            mSharedBuffers[bufferId] = slot;
+        } else {
+            mOverflowSharedBuffers[bufferId] = slot;
+        }
         return Void();
     }
 
+    const CryptoPlugin::SharedBufferSlot *CryptoPlugin::findSharedBuffer(
+            uint32_t bufferId) const {
+        if (bufferId < mSharedBuffers.size()) {
+            const SharedBufferSlot &slot = mSharedBuffers[bufferId];
+            return slot.isSet ? &slot : nullptr;
+        }
+        auto it = mOverflowSharedBuffers.find(bufferId);
+        return it != mOverflowSharedBuffers.end() ? &it->second : nullptr;
+    }
+
     Return<void> CryptoPlugin::decrypt(bool secure,
             const hidl_array<uint8_t, 16>& keyId,
             const hidl_array<uint8_t, 16>& iv, Mode mode,
@@ -65,41 +95,107 @@ namespace implementation {
             const SharedBuffer& source, uint64_t offset,
             const DestinationBuffer& destination,
             decrypt_cb _hidl_cb) {
+        // Local to the call, decrypt() may be called from several binder threads
+        DecryptRequest request;
+        DecryptResult result;
+        if (prepareDecrypt(secure, keyId, iv, mode, pattern, subSamples, source,
+                offset, destination, &request, &result)) {
+            runDecrypt(request, &result);
+        }
+        _hidl_cb(result.status, result.bytesWritten, result.detailedMessage);
+        return Void();
+    }
+
+    void CryptoPlugin::decryptAsync(bool secure,
+            const hidl_array<uint8_t, 16>& keyId,
+            const hidl_array<uint8_t, 16>& iv, Mode mode,
+            const Pattern& pattern, const hidl_vec<SubSample>& subSamples,
+            const SharedBuffer& source, uint64_t offset,
+            const DestinationBuffer& destination,
+            const DecryptCallback& callback) {
+        auto request = std::make_shared<DecryptRequest>();
+        auto result = std::make_shared<DecryptResult>();
+        bool prepared = prepareDecrypt(secure, keyId, iv, mode, pattern, subSamples,
+                source, offset, destination, request.get(), result.get());
+
+        // Even a request that failed to prepare goes through the queue, to
+        // keep its callback in order with the others.
+        getDecryptQueue()->submit(
+                [this, prepared, request, result] {
+                    if (prepared) {
+                        runDecrypt(*request, result.get());
+                    }
+                },
+                [callback, result] { callback(*result); });
+    }
 
-        if (mSharedBufferMap.find(source.bufferId) == mSharedBufferMap.end()) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source decrypt buffer base not set");
-            return Void();
+    void CryptoPlugin::flushDecrypts() {
+        DecryptQueue *queue;
+        {
+            std::lock_guard<std::mutex> lock(mDecryptQueueLock);
+            queue = mDecryptQueue.get();
+        }
+        if (queue != nullptr) {
+            queue->flush();
+        }
+    }
+
+    DecryptQueue *CryptoPlugin::getDecryptQueue() {
+        std::lock_guard<std::mutex> lock(mDecryptQueueLock);
+        if (mDecryptQueue == nullptr) {
+            mDecryptQueue.reset(new DecryptQueue(mMaxDecryptsInFlight));
+        }
+        return mDecryptQueue.get();
+    }
+
+    bool CryptoPlugin::prepareDecrypt(bool secure,
+            const hidl_array<uint8_t, 16>& keyId,
+            const hidl_array<uint8_t, 16>& iv, Mode mode,
+            const Pattern& pattern, const hidl_vec<SubSample>& subSamples,
+            const SharedBuffer& source, uint64_t offset,
+            const DestinationBuffer& destination,
+            DecryptRequest *request, DecryptResult *result) {
+        const SharedBufferSlot *sourceSlot = findSharedBuffer(source.bufferId);
+        if (sourceSlot == nullptr) {
+            *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0, "source decrypt buffer base not set"};
+            return false;
         }
 
+        const SharedBufferSlot *destSlot = nullptr;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& dest = destination.nonsecureMemory;
-            if (mSharedBufferMap.find(dest.bufferId) == mSharedBufferMap.end()) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination decrypt buffer base not set");
-                return Void();
+            destSlot = findSharedBuffer(dest.bufferId);
+            if (destSlot == nullptr) {
+                *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0,
+                        "destination decrypt buffer base not set"};
+                return false;
             }
         }
 
-        android::CryptoPlugin::Mode legacyMode;
+        request->secure = secure;
+        memcpy(request->keyId, keyId.data(), sizeof(request->keyId));
+        memcpy(request->iv, iv.data(), sizeof(request->iv));
+
         switch(mode) {
         case Mode::UNENCRYPTED:
-            legacyMode = android::CryptoPlugin::kMode_Unencrypted;
+            request->mode = android::CryptoPlugin::kMode_Unencrypted;
             break;
         case Mode::AES_CTR:
-            legacyMode = android::CryptoPlugin::kMode_AES_CTR;
+            request->mode = android::CryptoPlugin::kMode_AES_CTR;
             break;
         case Mode::AES_CBC_CTS:
-            legacyMode = android::CryptoPlugin::kMode_AES_WV;
+            request->mode = android::CryptoPlugin::kMode_AES_WV;
             break;
         case Mode::AES_CBC:
-            legacyMode = android::CryptoPlugin::kMode_AES_CBC;
+            request->mode = android::CryptoPlugin::kMode_AES_CBC;
             break;
         }
-        android::CryptoPlugin::Pattern legacyPattern;
-        legacyPattern.mEncryptBlocks = pattern.encryptBlocks;
-        legacyPattern.mSkipBlocks = pattern.skipBlocks;
+        request->pattern.mEncryptBlocks = pattern.encryptBlocks;
+        request->pattern.mSkipBlocks = pattern.skipBlocks;
 
-        std::unique_ptr<android::CryptoPlugin::SubSample[]> legacySubSamples =
-                std::make_unique<android::CryptoPlugin::SubSample[]>(subSamples.size());
+        // resize() only reallocates when a sample has more subsamples than any before it
+        request->subSamples.resize(subSamples.size());
+        android::CryptoPlugin::SubSample *legacySubSamples = request->subSamples.data();
 
         size_t destSize = 0;
         for (size_t i = 0; i < subSamples.size(); i++) {
@@ -108,80 +204,93 @@ namespace implementation {
             uint32_t numBytesOfEncryptedData = subSamples[i].numBytesOfEncryptedData;
             legacySubSamples[i].mNumBytesOfEncryptedData = numBytesOfEncryptedData;
             if (__builtin_add_overflow(destSize, numBytesOfClearData, &destSize)) {
-                _hidl_cb(Status::BAD_VALUE, 0, "subsample clear size overflow");
-                return Void();
+                *result = {Status::BAD_VALUE, 0, "subsample clear size overflow"};
+                return false;
             }
             if (__builtin_add_overflow(destSize, numBytesOfEncryptedData, &destSize)) {
-                _hidl_cb(Status::BAD_VALUE, 0, "subsample encrypted size overflow");
-                return Void();
+                *result = {Status::BAD_VALUE, 0, "subsample encrypted size overflow"};
+                return false;
             }
         }
 
-        AString detailMessage;
-        sp<IMemory> sourceBase = mSharedBufferMap[source.bufferId];
-        if (sourceBase == nullptr) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "source is a nullptr");
-            return Void();
+        if (sourceSlot->memory == nullptr) {
+            *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0, "source is a nullptr"};
+            return false;
         }
 
-        if (source.offset + offset + source.size > sourceBase->getSize()) {
-            _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size");
-            return Void();
+        if (source.offset + offset + source.size > sourceSlot->size) {
+            *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size"};
+            return false;
         }
 
-        uint8_t *base = static_cast<uint8_t *>
-                (static_cast<void *>(sourceBase->getPointer()));
-        void *srcPtr = static_cast<void *>(base + source.offset + offset);
+        uint8_t *base = sourceSlot->base;
+        request->sourceMemory = sourceSlot->memory;
+        request->srcPtr = static_cast<void *>(base + source.offset + offset);
 
-        void *destPtr = NULL;
+        request->destMemory = nullptr;
         if (destination.type == BufferType::SHARED_MEMORY) {
             const SharedBuffer& destBuffer = destination.nonsecureMemory;
-            sp<IMemory> destBase = mSharedBufferMap[destBuffer.bufferId];
-            if (destBase == nullptr) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination is a nullptr");
-                return Void();
+            if (destSlot->memory == nullptr) {
+                *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0, "destination is a nullptr"};
+                return false;
             }
 
-            if (destBuffer.offset + destBuffer.size > destBase->getSize()) {
-                _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size");
-                return Void();
+            if (destBuffer.offset + destBuffer.size > destSlot->size) {
+                *result = {Status::ERROR_DRM_CANNOT_HANDLE, 0, "invalid buffer size"};
+                return false;
             }
 
             if (destSize > destBuffer.size) {
-                _hidl_cb(Status::BAD_VALUE, 0, "subsample sum too large");
-                return Void();
+                *result = {Status::BAD_VALUE, 0, "subsample sum too large"};
+                return false;
             }
 
-            destPtr = static_cast<void *>(base + destination.nonsecureMemory.offset);
+            request->destMemory = destSlot->memory;
+            request->destPtr = static_cast<void *>(base + destination.nonsecureMemory.offset);
         } else if (destination.type == BufferType::NATIVE_HANDLE) {
             if (!secure) {
-                _hidl_cb(Status::BAD_VALUE, 0, "native handle destination must be secure");
-                return Void();
+                *result = {Status::BAD_VALUE, 0, "native handle destination must be secure"};
+                return false;
             }
             native_handle_t *handle = const_cast<native_handle_t *>(
                     destination.secureMemory.getNativeHandle());
-            destPtr = static_cast<void *>(handle);
+            request->destPtr = static_cast<void *>(handle);
+        } else {
+            *result = {Status::BAD_VALUE, 0, "invalid destination type"};
+            return false;
+        }
+        return true;
+    }
+
+    void CryptoPlugin::runDecrypt(const DecryptRequest &request, DecryptResult *result) {
+        AString detailMessage;
+        ssize_t decrypted;
+        if (mMaxDecryptsInFlight > 1) {
+            std::shared_lock<std::shared_mutex> lock(mLegacyLock);
+            decrypted = mLegacyPlugin->decrypt(request.secure, request.keyId,
+                    request.iv, request.mode, request.pattern, request.srcPtr,
+                    request.subSamples.data(), request.subSamples.size(),
+                    request.destPtr, &detailMessage);
         } else {
-            _hidl_cb(Status::BAD_VALUE, 0, "invalid destination type");
-            return Void();
+            std::unique_lock<std::shared_mutex> lock(mLegacyLock);
+            decrypted = mLegacyPlugin->decrypt(request.secure, request.keyId,
+                    request.iv, request.mode, request.pattern, request.srcPtr,
+                    request.subSamples.data(), request.subSamples.size(),
+                    request.destPtr, &detailMessage);
         }
-        ssize_t result = mLegacyPlugin->decrypt(secure, keyId.data(), iv.data(),
-                legacyMode, legacyPattern, srcPtr, legacySubSamples.get(),
-                subSamples.size(), destPtr, &detailMessage);
 
         uint32_t status;
         uint32_t bytesWritten;
 
-        if (result >= 0) {
+        if (decrypted >= 0) {
             status = android::OK;
-            bytesWritten = result;
+            bytesWritten = decrypted;
         } else {
-            status = result;
+            status = decrypted;
             bytesWritten = 0;
         }
 
-        _hidl_cb(toStatus(status), bytesWritten, detailMessage.c_str());
-        return Void();
+        *result = {toStatus(status), bytesWritten, detailMessage.c_str()};
     }
 
 } // namespace implementation
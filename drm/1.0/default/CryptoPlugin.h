@@ -22,6 +22,16 @@
 #include <hidl/Status.h>
 #include <media/hardware/CryptoAPI.h>
 
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "DecryptQueue.h"
+
 namespace android {
 namespace hardware {
 namespace drm {
@@ -42,9 +52,19 @@ using ::android::hidl::memory::V1_0::IMemory;
 using ::android::sp;
 
 struct CryptoPlugin : public ICryptoPlugin {
-    CryptoPlugin(android::CryptoPlugin *plugin) : mLegacyPlugin(plugin) {}
-
-    ~CryptoPlugin() {delete mLegacyPlugin;}
+    /**
+     * maxDecryptsInFlight bounds the decrypts decryptAsync() runs at once.
+     * Above 1, the legacy plugin must support concurrent decrypt calls;
+     * otherwise all the calls to the legacy plugin are serialized.
+     */
+    CryptoPlugin(android::CryptoPlugin *plugin, size_t maxDecryptsInFlight = 1)
+            : mLegacyPlugin(plugin), mMaxDecryptsInFlight(maxDecryptsInFlight) {}
+
+    ~CryptoPlugin() {
+        // The queued decrypts still use the legacy plugin
+        mDecryptQueue.reset();
+        delete mLegacyPlugin;
+    }
 
     // Methods from ::android::hardware::drm::V1_0::ICryptoPlugin
     // follow.
@@ -66,9 +86,82 @@ struct CryptoPlugin : public ICryptoPlugin {
             uint64_t offset, const DestinationBuffer& destination,
             decrypt_cb _hidl_cb) override;
 
+    struct DecryptResult {
+        Status status;
+        uint32_t bytesWritten;
+        std::string detailedMessage;
+    };
+
+    typedef std::function<void(const DecryptResult &)> DecryptCallback;
+
+    /**
+     * Queues a decrypt of the same arguments as decrypt(), and returns as
+     * soon as it is queued, blocking only while the maximum number of
+     * decrypts are in flight. The callbacks are called in submit order,
+     * on the threads of the queue, and must not queue or flush decrypts.
+     *
+     * A native handle destination must stay valid until the callback.
+     */
+    void decryptAsync(bool secure, const hidl_array<uint8_t, 16>& keyId,
+            const hidl_array<uint8_t, 16>& iv, Mode mode, const Pattern& pattern,
+            const hidl_vec<SubSample>& subSamples, const SharedBuffer& source,
+            uint64_t offset, const DestinationBuffer& destination,
+            const DecryptCallback& callback);
+
+    // Waits until the callbacks of all the queued decrypts have returned
+    void flushDecrypts();
+
 private:
+    // A decrypt with its arguments validated and converted for the legacy plugin
+    struct DecryptRequest {
+        bool secure;
+        uint8_t keyId[16];
+        uint8_t iv[16];
+        android::CryptoPlugin::Mode mode;
+        android::CryptoPlugin::Pattern pattern;
+        std::vector<android::CryptoPlugin::SubSample> subSamples;
+        void *srcPtr;
+        void *destPtr;
+        // Keep the buffers mapped while the decrypt is in flight
+        sp<IMemory> sourceMemory;
+        sp<IMemory> destMemory;
+    };
+
+    // Returns false, with the error in result, if the decrypt cannot be made
+    bool prepareDecrypt(bool secure, const hidl_array<uint8_t, 16>& keyId,
+            const hidl_array<uint8_t, 16>& iv, Mode mode, const Pattern& pattern,
+            const hidl_vec<SubSample>& subSamples, const SharedBuffer& source,
+            uint64_t offset, const DestinationBuffer& destination,
+            DecryptRequest *request, DecryptResult *result);
+
+    void runDecrypt(const DecryptRequest &request, DecryptResult *result);
+
+    DecryptQueue *getDecryptQueue();
+
+    // A shared buffer set by setSharedBufferBase, with its mapping resolved once
+    struct SharedBufferSlot {
+        bool isSet = false;
+        sp<IMemory> memory;
+        uint8_t *base = nullptr;
+        size_t size = 0;
+    };
+
+    // Buffer ids below this are looked up by index, the others in mOverflowSharedBuffers
+    static constexpr uint32_t kMaxIndexedBufferId = 256;
+
+    const SharedBufferSlot *findSharedBuffer(uint32_t bufferId) const;
+
     android::CryptoPlugin *mLegacyPlugin;
-    std::map<uint32_t, sp<IMemory> > mSharedBufferMap;
+    // Held around the calls to the legacy plugin: exclusively, except by the
+    // decrypts of a plugin supporting concurrent decrypts.
+    std::shared_mutex mLegacyLock;
+    std::vector<SharedBufferSlot> mSharedBuffers;
+    std::map<uint32_t, SharedBufferSlot> mOverflowSharedBuffers;
+
+    const size_t mMaxDecryptsInFlight;
+    std::mutex mDecryptQueueLock;
+    // Created by the first decryptAsync() call, guarded by mDecryptQueueLock
+    std::unique_ptr<DecryptQueue> mDecryptQueue;
 
     CryptoPlugin() = delete;
     CryptoPlugin(const CryptoPlugin &) = delete;
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "android.hardware.drm@1.0-impl"
+
+#include "DecryptQueue.h"
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace implementation {
+
+    DecryptQueue::DecryptQueue(size_t maxInFlight)
+            : mMaxInFlight(maxInFlight > 0 ? maxInFlight : 1) {
+        for (size_t i = 0; i < mMaxInFlight; i++) {
+            mThreads.emplace_back(&DecryptQueue::threadLoop, this);
+        }
+    }
+
+    DecryptQueue::~DecryptQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mExiting = true;
+        }
+        mWorkCondition.notify_all();
+        for (std::thread &thread : mThreads) {
+            thread.join();
+        }
+    }
+
+    void DecryptQueue::submit(std::function<void()> work,
+            std::function<void()> completion) {
+        auto job = std::make_shared<Job>();
+        job->work = std::move(work);
+        job->completion = std::move(completion);
+
+        std::unique_lock<std::mutex> lock(mLock);
+        mCompletedCondition.wait(lock, [this] { return mInFlight.size() < mMaxInFlight; });
+        mPending.push_back(job);
+        mInFlight.push_back(job);
+        mWorkCondition.notify_one();
+    }
+
+    void DecryptQueue::flush() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCompletedCondition.wait(lock, [this] { return mInFlight.empty(); });
+    }
+
+    void DecryptQueue::threadLoop() {
+        std::unique_lock<std::mutex> lock(mLock);
+        while (true) {
+            mWorkCondition.wait(lock, [this] { return mExiting || !mPending.empty(); });
+            if (mPending.empty()) {
+                return;
+            }
+            std::shared_ptr<Job> job = mPending.front();
+            mPending.pop_front();
+
+            lock.unlock();
+            job->work();
+            lock.lock();
+            job->done = true;
+
+            // A job done ahead of the ones submitted before it waits for them,
+            // its completion is then called by the thread calling theirs.
+            if (mCompleting) {
+                continue;
+            }
+            mCompleting = true;
+            while (!mInFlight.empty() && mInFlight.front()->done) {
+                std::shared_ptr<Job> completed = mInFlight.front();
+                lock.unlock();
+                completed->completion();
+                lock.lock();
+                mInFlight.pop_front();
+                mCompletedCondition.notify_all();
+            }
+            mCompleting = false;
+        }
+    }
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace drm
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_DRM_V1_0__DECRYPTQUEUE_H
+#define ANDROID_HARDWARE_DRM_V1_0__DECRYPTQUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace implementation {
+
+/**
+ * Runs up to maxInFlight jobs at once on its own threads, and calls their
+ * completions one at a time, in the order the jobs were submitted.
+ *
+ * A job stays in flight until its completion returns. Completions must not
+ * submit to or flush the queue.
+ */
+class DecryptQueue {
+public:
+    explicit DecryptQueue(size_t maxInFlight);
+
+    // Completes the jobs already submitted first
+    ~DecryptQueue();
+
+    // Blocks while maxInFlight jobs are in flight
+    void submit(std::function<void()> work, std::function<void()> completion);
+
+    // Waits until all the submitted jobs have completed
+    void flush();
+
+private:
+    struct Job {
+        std::function<void()> work;
+        std::function<void()> completion;
+        bool done = false;
+    };
+
+    void threadLoop();
+
+    const size_t mMaxInFlight;
+
+    std::mutex mLock;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mCompletedCondition;
+    // Submitted and not started yet
+    std::deque<std::shared_ptr<Job>> mPending;
+    // Submitted and not completed yet, in submit order
+    std::deque<std::shared_ptr<Job>> mInFlight;
+    bool mCompleting = false;
+    bool mExiting = false;
+    std::vector<std::thread> mThreads;
+
+    DecryptQueue(const DecryptQueue &) = delete;
+    void operator=(const DecryptQueue &) = delete;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace drm
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_DRM_V1_0__DECRYPTQUEUE_H
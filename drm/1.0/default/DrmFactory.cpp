@@ -28,52 +28,53 @@ namespace V1_0 {
 namespace implementation {
 
     DrmFactory::DrmFactory() :
-        loader(getDrmPluginPath(), "createDrmFactory") {
+        loader(getDrmPluginPath(), "createDrmFactory",
+               getDrmPluginIndexPath("createDrmFactory").string()) {
     }
 
     // Methods from ::android::hardware::drm::V1_0::IDrmFactory follow.
     Return<bool> DrmFactory::isCryptoSchemeSupported (
             const hidl_array<uint8_t, 16>& uuid) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                return true;
-            }
-        }
-        return false;
+        return findFactoryForScheme(uuid) >= 0;
     }
 
     Return<bool> DrmFactory::isContentTypeSupported (
             const hidl_string& mimeType) {
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isContentTypeSupported(String8(mimeType.c_str()))) {
-                return true;
-            }
-        }
-        return false;
+        String8 type(mimeType.c_str());
+        return loader.findFactory(getContentTypeIndexKey(type.string()),
+                [&](android::DrmFactory *factory) {
+                    return factory->isContentTypeSupported(type);
+                }) >= 0;
     }
 
     Return<void> DrmFactory::createPlugin(const hidl_array<uint8_t, 16>& uuid,
             const hidl_string& /* appPackageName */, createPlugin_cb _hidl_cb) {
 
-        for (size_t i = 0; i < loader.factoryCount(); i++) {
-            if (loader.getFactory(i)->isCryptoSchemeSupported(uuid.data())) {
-                android::DrmPlugin *legacyPlugin = NULL;
-                status_t status = loader.getFactory(i)->createDrmPlugin(
-                        uuid.data(), &legacyPlugin);
-                DrmPlugin *newPlugin = NULL;
-                if (legacyPlugin == NULL) {
-                    ALOGE("Drm legacy HAL: failed to create drm plugin");
-                } else {
-                    newPlugin = new DrmPlugin(legacyPlugin);
-                }
-                _hidl_cb(toStatus(status), newPlugin);
-                return Void();
+        ssize_t i = findFactoryForScheme(uuid);
+        if (i >= 0 && loader.getFactory(i) != NULL) {
+            android::DrmPlugin *legacyPlugin = NULL;
+            status_t status = loader.getFactory(i)->createDrmPlugin(
+                    uuid.data(), &legacyPlugin);
+            DrmPlugin *newPlugin = NULL;
+            if (legacyPlugin == NULL) {
+                ALOGE("Drm legacy HAL: failed to create drm plugin");
+            } else {
+                newPlugin = new DrmPlugin(legacyPlugin);
             }
+            _hidl_cb(toStatus(status), newPlugin);
+            return Void();
         }
         _hidl_cb(Status::ERROR_DRM_CANNOT_HANDLE, NULL);
         return Void();
     }
 
+    ssize_t DrmFactory::findFactoryForScheme(const hidl_array<uint8_t, 16>& uuid) {
+        return loader.findFactory(getCryptoSchemeIndexKey(uuid.data()),
+                [&](android::DrmFactory *factory) {
+                    return factory->isCryptoSchemeSupported(uuid.data());
+                });
+    }
+
     IDrmFactory* HIDL_FETCH_IDrmFactory(const char* /* name */) {
         return new DrmFactory();
     }
@@ -53,6 +53,9 @@ struct DrmFactory : public IDrmFactory {
             const hidl_string& appPackageName, createPlugin_cb _hidl_cb) override;
 
 private:
+    // Returns the plugin supporting the scheme, or -1
+    ssize_t findFactoryForScheme(const hidl_array<uint8_t, 16>& uuid);
+
     PluginLoader<android::DrmFactory> loader;
 
     DrmFactory(const DrmFactory &) = delete;
@@ -38,6 +38,26 @@ const char* getDrmPluginPath() {
 #endif
 }
 
+String8 getDrmPluginIndexPath(const char* entry) {
+#if defined(__LP64__)
+    return String8::format("/data/vendor/mediadrm/%s-64.index", entry);
+#else
+    return String8::format("/data/vendor/mediadrm/%s-32.index", entry);
+#endif
+}
+
+String8 getCryptoSchemeIndexKey(const uint8_t uuid[16]) {
+    String8 key("uuid:");
+    for (size_t i = 0; i < 16; i++) {
+        key.appendFormat("%02x", uuid[i]);
+    }
+    return key;
+}
+
+String8 getContentTypeIndexKey(const char* mimeType) {
+    return String8("mime:") + mimeType;
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace drm
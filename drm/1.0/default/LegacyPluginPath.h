@@ -18,6 +18,9 @@
 
 #define LEGACY_PLUGIN_PATH_H_
 
+#include <stdint.h>
+#include <utils/String8.h>
+
 namespace android {
 namespace hardware {
 namespace drm {
@@ -26,6 +29,13 @@ namespace implementation {
 
 const char* getDrmPluginPath();
 
+// Where the plugin answers of the factories created by entry are persisted
+String8 getDrmPluginIndexPath(const char* entry);
+
+// The keys of the support queries in the plugin index
+String8 getCryptoSchemeIndexKey(const uint8_t uuid[16]);
+String8 getContentTypeIndexKey(const char* mimeType);
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace drm
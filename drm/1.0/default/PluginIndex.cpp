@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PluginIndex"
+
+#include "PluginIndex.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace helper {
+
+// The file holds the signature of the libraries on its first line,
+// then one "<answer> <key>" line per query.
+PluginIndex::PluginIndex(const String8& indexPath,
+        const std::vector<String8>& libraryPaths)
+    : mIndexPath(indexPath), mLibraryCount(libraryPaths.size()) {
+    for (const String8& path : libraryPaths) {
+        struct stat st;
+        if (stat(path.string(), &st) != 0) {
+            st.st_size = -1;
+            st.st_mtime = 0;
+        }
+        mSignature.appendFormat("%s:%" PRId64 ":%" PRId64 ";", path.string(),
+                (int64_t)st.st_size, (int64_t)st.st_mtime);
+    }
+    load();
+}
+
+bool PluginIndex::lookup(const String8& key, ssize_t* library) {
+    Mutex::Autolock lock(mLock);
+    ssize_t index = mEntries.indexOfKey(key);
+    if (index < 0) {
+        return false;
+    }
+    *library = mEntries.valueAt(index);
+    return true;
+}
+
+void PluginIndex::add(const String8& key, ssize_t library) {
+    // Keys come from the clients, keep them from breaking or bloating the file
+    if (strchr(key.string(), '\n') != NULL) {
+        return;
+    }
+    Mutex::Autolock lock(mLock);
+    if (mEntries.size() >= kMaxEntries && mEntries.indexOfKey(key) < 0) {
+        return;
+    }
+    mEntries.replaceValueFor(key, library);
+    save();
+}
+
+void PluginIndex::load() {
+    FILE* file = fopen(mIndexPath.string(), "re");
+    if (file == NULL) {
+        ALOGV("No plugin index at %s", mIndexPath.string());
+        return;
+    }
+
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length = getline(&line, &capacity, file);
+    if (length <= 0 || line[length - 1] != '\n' ||
+            String8(line, length - 1) != mSignature) {
+        ALOGI("Plugins changed, dropping the index at %s", mIndexPath.string());
+    } else {
+        while (mEntries.size() < kMaxEntries &&
+                (length = getline(&line, &capacity, file)) > 0) {
+            long library;
+            int keyOffset;
+            // The key is everything after the single space, and an answer
+            // is -1 or the position of one of the libraries
+            if (line[length - 1] != '\n' ||
+                    sscanf(line, "%ld%n", &library, &keyOffset) != 1 ||
+                    line[keyOffset] != ' ' || library < -1 ||
+                    library >= (long)mLibraryCount) {
+                ALOGW("Ignoring malformed plugin index entry");
+                continue;
+            }
+            keyOffset++;
+            mEntries.add(String8(line + keyOffset, length - 1 - keyOffset), library);
+        }
+    }
+    free(line);
+    fclose(file);
+}
+
+void PluginIndex::save() {
+    // Written aside and renamed, so that a reader never sees it partially written
+    String8 tempPath = mIndexPath + ".tmp";
+    FILE* file = fopen(tempPath.string(), "we");
+    if (file == NULL) {
+        ALOGV("Cannot write the plugin index at %s", tempPath.string());
+        return;
+    }
+    bool ok = fprintf(file, "%s\n", mSignature.string()) >= 0;
+    for (size_t i = 0; ok && i < mEntries.size(); i++) {
+        ok = fprintf(file, "%zd %s\n", mEntries.valueAt(i), mEntries.keyAt(i).string()) >= 0;
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(tempPath.string(), mIndexPath.string()) != 0) {
+        ALOGW("Failed to write the plugin index at %s", mIndexPath.string());
+        unlink(tempPath.string());
+    }
+}
+
+}
+}
+}
+}
+} // namespace android
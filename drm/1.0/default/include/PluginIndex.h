@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLUGIN_INDEX_H_
+#define PLUGIN_INDEX_H_
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace helper {
+
+/**
+ * Persisted answers to the support queries made to a set of plugin
+ * libraries, so that a service can answer them again without loading
+ * the libraries.
+ *
+ * A query is identified by a key, and answered by the position of the
+ * first library that supports it, or -1 if none does. The stored
+ * answers are dropped as soon as a library is added, removed, or has
+ * its size or modification time changed.
+ */
+class PluginIndex {
+  public:
+    PluginIndex(const String8& indexPath, const std::vector<String8>& libraryPaths);
+
+    // Returns whether the query is known, and if so its answer
+    bool lookup(const String8& key, ssize_t* library);
+
+    // Records the answer to a query, and persists the index
+    void add(const String8& key, ssize_t library);
+
+  private:
+    static constexpr size_t kMaxEntries = 64;
+
+    void load();
+    void save();
+
+    const String8 mIndexPath;
+    const size_t mLibraryCount;
+    String8 mSignature;
+
+    Mutex mLock;
+    KeyedVector<String8, ssize_t> mEntries;
+
+    PluginIndex(const PluginIndex&) = delete;
+    void operator=(const PluginIndex&) = delete;
+};
+
+}
+}
+}
+}
+}
+
+#endif  // PLUGIN_INDEX_H_
@@ -17,27 +17,44 @@
 #ifndef PLUGIN_LOADER_H_
 #define PLUGIN_LOADER_H_
 
+#include "PluginIndex.h"
 #include "SharedLibrary.h"
+#include <dirent.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace drm {
 namespace V1_0 {
 namespace helper {
 
+/**
+ * Finds the plugins of a plugin directory, and loads each of them the
+ * first time it is needed rather than all of them up front.
+ *
+ * Given an index path, the answers of findFactory() are persisted there,
+ * so that later instances answer the same queries without loading any
+ * plugin.
+ */
 template <class T>
 class PluginLoader {
 
   public:
-    PluginLoader(const char *dir, const char *entry) {
+    PluginLoader(const char *dir, const char *entry, const char *indexPath = NULL)
+            : entry(entry) {
         /**
          * scan all plugins in the plugin directory and add them to the
-         * factories list.
+         * plugins list, sorted so that the index positions are stable.
          */
         String8 pluginDir(dir);
+        std::vector<String8> paths;
 
         DIR* pDir = opendir(pluginDir.string());
         if (pDir == NULL) {
@@ -47,33 +64,81 @@ class PluginLoader {
             while ((pEntry = readdir(pDir))) {
                 String8 file(pEntry->d_name);
                 if (file.getPathExtension() == ".so") {
-                    String8 path = pluginDir + "/" + pEntry->d_name;
-                    T *plugin = loadOne(path, entry);
-                    if (plugin) {
-                        factories.push(plugin);
-                    }
+                    paths.push_back(pluginDir + "/" + pEntry->d_name);
                 }
             }
             closedir(pDir);
         }
+        std::sort(paths.begin(), paths.end());
+
+        plugins.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            plugins[i].path = paths[i];
+        }
+        if (indexPath != NULL) {
+            index.reset(new PluginIndex(String8(indexPath), paths));
+        }
     }
 
     ~PluginLoader() {
-        for (size_t i = 0; i < factories.size(); i++) {
-            delete factories[i];
+        for (size_t i = 0; i < plugins.size(); i++) {
+            delete plugins[i].factory;
         }
     }
 
-    T *getFactory(size_t i) const {
-        return factories[i];
+    /**
+     * Returns the factory of plugin i, loading it if needed, or NULL if
+     * it cannot be loaded.
+     */
+    T *getFactory(size_t i) {
+        Mutex::Autolock autoLock(lock);
+        Plugin &plugin = plugins[i];
+        if (!plugin.loaded) {
+            plugin.loaded = true;
+            plugin.factory = loadOne(plugin.path.string(), entry);
+        }
+        return plugin.factory;
     }
 
-    size_t factoryCount() const {return factories.size();}
+    size_t factoryCount() const {return plugins.size();}
+
+    /**
+     * Returns the position of the first plugin whose factory supports()
+     * accepts, or -1 if there is none. key identifies the query in the
+     * index: a query already answered does not load any plugin.
+     */
+    template <class Predicate>
+    ssize_t findFactory(const String8 &key, Predicate supports) {
+        ssize_t found = -1;
+        if (index != nullptr && index->lookup(key, &found)) {
+            if (found < (ssize_t)plugins.size()) {
+                return found;
+            }
+            found = -1;
+        }
+        for (size_t i = 0; i < plugins.size(); i++) {
+            T *factory = getFactory(i);
+            if (factory != NULL && supports(factory)) {
+                found = i;
+                break;
+            }
+        }
+        if (index != nullptr) {
+            index->add(key, found);
+        }
+        return found;
+    }
 
   private:
+    struct Plugin {
+        String8 path;
+        bool loaded = false;
+        T *factory = NULL;
+    };
+
     T* loadOne(const char *path, const char *entry) {
         sp<SharedLibrary> library = new SharedLibrary(String8(path));
-        if (!library.get()) {
+        if (!*library) {
             ALOGE("Failed to open plugin library %s: %s", path,
                     library->lastError());
         } else {
@@ -93,8 +158,11 @@ class PluginLoader {
         return NULL;
     }
 
-    Vector<T *> factories;
+    const char *entry;
+    Mutex lock;
+    std::vector<Plugin> plugins;
     Vector<sp<SharedLibrary> > libraries;
+    std::unique_ptr<PluginIndex> index;
 
     PluginLoader(const PluginLoader &) = delete;
     void operator=(const PluginLoader &) = delete;
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CryptoPluginTest"
+
+#include <gtest/gtest.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/native_handle.h>
+#include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/foundation/AString.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CryptoPlugin.h"
+
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+constexpr uint32_t kSampleSize = 256;
+constexpr uint32_t kSampleCount = 8;
+// The destinations follow the sources in the shared buffer
+constexpr uint32_t kBufferSize = 2 * kSampleSize * kSampleCount;
+constexpr uint32_t kBufferId = 0;
+constexpr uint32_t kUnsetBufferId = 7;
+// A key starting with this byte has no license
+constexpr uint8_t kNoLicenseKey = 0xff;
+
+// Copies the sample, after sleeping for as many ms as its first byte, and
+// records how many decrypts ran at once.
+class FakeLegacyPlugin : public android::CryptoPlugin {
+  public:
+    explicit FakeLegacyPlugin(std::atomic<int> *maxConcurrent)
+        : mMaxConcurrent(maxConcurrent) {}
+
+    bool requiresSecureDecoderComponent(const char *) const override { return false; }
+
+    ssize_t decrypt(bool, const uint8_t key[16], const uint8_t[16], Mode, const Pattern &,
+            const void *srcPtr, const SubSample *subSamples, size_t numSubSamples,
+            void *dstPtr, AString *) override {
+        int concurrent = ++mConcurrent;
+        int max = mMaxConcurrent->load();
+        while (concurrent > max && !mMaxConcurrent->compare_exchange_weak(max, concurrent)) {
+        }
+
+        const uint8_t *src = static_cast<const uint8_t *>(srcPtr);
+        std::this_thread::sleep_for(std::chrono::milliseconds(src[0]));
+        size_t size = 0;
+        for (size_t i = 0; i < numSubSamples; i++) {
+            size += subSamples[i].mNumBytesOfClearData + subSamples[i].mNumBytesOfEncryptedData;
+        }
+        memcpy(dstPtr, src, size);
+
+        --mConcurrent;
+        return key[0] == kNoLicenseKey ? android::ERROR_DRM_NO_LICENSE : size;
+    }
+
+  private:
+    std::atomic<int> mConcurrent{0};
+    std::atomic<int> *mMaxConcurrent;
+};
+
+class CryptoPluginTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        int fd = ashmem_create_region("CryptoPluginTest", kBufferSize);
+        ASSERT_GE(fd, 0);
+        mHandle = native_handle_create(1 /* numFds */, 0 /* numInts */);
+        mHandle->data[0] = fd;
+        void *base = mmap(nullptr, kBufferSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ASSERT_NE(MAP_FAILED, base);
+        mBase = static_cast<uint8_t *>(base);
+    }
+
+    void TearDown() override {
+        if (mBase != nullptr) {
+            munmap(mBase, kBufferSize);
+        }
+        if (mHandle != nullptr) {
+            native_handle_close(mHandle);
+            native_handle_delete(mHandle);
+        }
+    }
+
+    std::unique_ptr<CryptoPlugin> createPlugin(size_t maxDecryptsInFlight) {
+        std::unique_ptr<CryptoPlugin> plugin(new CryptoPlugin(
+                new FakeLegacyPlugin(&mMaxConcurrent), maxDecryptsInFlight));
+        plugin->setSharedBufferBase(hidl_memory("ashmem", hidl_handle(mHandle), kBufferSize),
+                kBufferId);
+        return plugin;
+    }
+
+    // Decrypts sample i of the buffer, which takes delayMs, into destination i
+    void decryptAsync(CryptoPlugin *plugin, uint32_t i, uint8_t delayMs, uint8_t key0,
+            uint32_t bufferId, const CryptoPlugin::DecryptCallback &callback) {
+        // The delay of a sample is its first byte
+        mBase[i * kSampleSize] = delayMs;
+
+        hidl_array<uint8_t, 16> keyId;
+        memset(keyId.data(), 0, 16);
+        keyId[0] = key0;
+        hidl_array<uint8_t, 16> iv;
+        memset(iv.data(), 0, 16);
+        hidl_vec<SubSample> subSamples({{kSampleSize, 0}});
+        SharedBuffer source = {bufferId, i * kSampleSize, kSampleSize};
+        DestinationBuffer destination;
+        destination.type = BufferType::SHARED_MEMORY;
+        destination.nonsecureMemory = {bufferId, (kSampleCount + i) * kSampleSize,
+                kSampleSize};
+        plugin->decryptAsync(false, keyId, iv, Mode::UNENCRYPTED, {0, 0}, subSamples, source,
+                0, destination, callback);
+    }
+
+    native_handle_t *mHandle = nullptr;
+    uint8_t *mBase = nullptr;
+    std::atomic<int> mMaxConcurrent{0};
+};
+
+TEST_F(CryptoPluginTest, DecryptAsyncCompletesInOrder) {
+    auto plugin = createPlugin(4 /* maxDecryptsInFlight */);
+
+    std::mutex lock;
+    std::vector<uint32_t> completed;
+    for (uint32_t i = 0; i < kSampleCount; i++) {
+        // The later samples finish first
+        decryptAsync(plugin.get(), i, 2 * (kSampleCount - i), 0, kBufferId,
+                [&, i](const CryptoPlugin::DecryptResult &result) {
+                    EXPECT_EQ(Status::OK, result.status);
+                    EXPECT_EQ(kSampleSize, result.bytesWritten);
+                    std::lock_guard<std::mutex> guard(lock);
+                    completed.push_back(i);
+                });
+    }
+    plugin->flushDecrypts();
+
+    std::vector<uint32_t> expected(kSampleCount);
+    for (uint32_t i = 0; i < kSampleCount; i++) expected[i] = i;
+    EXPECT_EQ(expected, completed);
+    EXPECT_LE(mMaxConcurrent.load(), 4);
+}
+
+TEST_F(CryptoPluginTest, DecryptAsyncReportsErrorsInOrder) {
+    auto plugin = createPlugin(2 /* maxDecryptsInFlight */);
+
+    std::mutex lock;
+    std::vector<Status> statuses;
+    auto record = [&](const CryptoPlugin::DecryptResult &result) {
+        std::lock_guard<std::mutex> guard(lock);
+        statuses.push_back(result.status);
+    };
+    decryptAsync(plugin.get(), 0, 10, 0, kBufferId, record);
+    // Fails before reaching the legacy plugin
+    decryptAsync(plugin.get(), 1, 0, 0, kUnsetBufferId, record);
+    // Fails in the legacy plugin
+    decryptAsync(plugin.get(), 2, 0, kNoLicenseKey, kBufferId, record);
+    decryptAsync(plugin.get(), 3, 0, 0, kBufferId, record);
+    plugin->flushDecrypts();
+
+    std::vector<Status> expected = {Status::OK, Status::ERROR_DRM_CANNOT_HANDLE,
+            Status::ERROR_DRM_NO_LICENSE, Status::OK};
+    EXPECT_EQ(expected, statuses);
+}
+
+TEST_F(CryptoPluginTest, DecryptDoesNotOverlapQueuedDecrypts) {
+    auto plugin = createPlugin(1 /* maxDecryptsInFlight */);
+
+    std::thread syncDecrypts([&] {
+        hidl_array<uint8_t, 16> keyId;
+        memset(keyId.data(), 0, 16);
+        hidl_vec<SubSample> subSamples({{kSampleSize, 0}});
+        SharedBuffer source = {kBufferId, 0, kSampleSize};
+        DestinationBuffer destination;
+        destination.type = BufferType::SHARED_MEMORY;
+        destination.nonsecureMemory = {kBufferId, kSampleCount * kSampleSize, kSampleSize};
+        for (uint32_t i = 0; i < kSampleCount; i++) {
+            plugin->decrypt(false, keyId, keyId, Mode::UNENCRYPTED, {0, 0}, subSamples,
+                    source, 0, destination,
+                    [](Status status, uint32_t, const hidl_string &) {
+                        EXPECT_EQ(Status::OK, status);
+                    });
+        }
+    });
+    for (uint32_t i = 1; i < kSampleCount; i++) {
+        decryptAsync(plugin.get(), i, 2, 0, kBufferId,
+                [](const CryptoPlugin::DecryptResult &) {});
+    }
+    syncDecrypts.join();
+    plugin->flushDecrypts();
+
+    EXPECT_EQ(1, mMaxConcurrent.load());
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace drm
+}  // namespace hardware
+}  // namespace android
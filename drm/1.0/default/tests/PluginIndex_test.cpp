@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PluginIndexTest"
+
+#include <gtest/gtest.h>
+
+#include <android-base/file.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PluginIndex.h"
+
+using ::android::base::ReadFileToString;
+using ::android::base::WriteStringToFile;
+
+namespace android {
+namespace hardware {
+namespace drm {
+namespace V1_0 {
+namespace helper {
+namespace {
+
+class PluginIndexTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        mIndexPath = String8(mDir.path) + "/index";
+        for (const char* name : {"/a.so", "/b.so"}) {
+            String8 path = String8(mDir.path) + name;
+            ASSERT_TRUE(WriteStringToFile(name, path.string()));
+            mLibraryPaths.push_back(path);
+        }
+    }
+
+    std::unique_ptr<PluginIndex> open() {
+        return std::unique_ptr<PluginIndex>(new PluginIndex(mIndexPath, mLibraryPaths));
+    }
+
+    // The first line of the index written for the libraries
+    std::string signatureLine() {
+        open()->add(String8("seed"), 0);
+        std::string contents;
+        EXPECT_TRUE(ReadFileToString(mIndexPath.string(), &contents));
+        return contents.substr(0, contents.find('\n') + 1);
+    }
+
+    void writeIndex(const std::string& contents) {
+        ASSERT_TRUE(WriteStringToFile(contents, mIndexPath.string()));
+    }
+
+    // Returns the answer to key, or -2 if it is not known
+    ssize_t answer(PluginIndex* index, const char* key) {
+        ssize_t library = -2;
+        return index->lookup(String8(key), &library) ? library : -2;
+    }
+
+    TemporaryDir mDir;
+    String8 mIndexPath;
+    std::vector<String8> mLibraryPaths;
+};
+
+TEST_F(PluginIndexTest, RemembersTheAnswers) {
+    auto index = open();
+    EXPECT_EQ(-2, answer(index.get(), "video/mp4"));
+    index->add(String8("video/mp4"), 1);
+    index->add(String8("audio/mpeg"), -1);
+    index->add(String8("with spaces "), 0);
+    EXPECT_EQ(1, answer(index.get(), "video/mp4"));
+
+    // And across instances
+    index = open();
+    EXPECT_EQ(1, answer(index.get(), "video/mp4"));
+    EXPECT_EQ(-1, answer(index.get(), "audio/mpeg"));
+    EXPECT_EQ(0, answer(index.get(), "with spaces "));
+    EXPECT_EQ(-2, answer(index.get(), "video/webm"));
+}
+
+TEST_F(PluginIndexTest, IgnoresKeysThatWouldBreakTheFile) {
+    auto index = open();
+    index->add(String8("video/mp4\n1 audio/mpeg"), 1);
+    EXPECT_EQ(-2, answer(index.get(), "video/mp4\n1 audio/mpeg"));
+    EXPECT_EQ(-2, answer(open().get(), "audio/mpeg"));
+}
+
+TEST_F(PluginIndexTest, DropsTheAnswersWhenALibraryChanges) {
+    open()->add(String8("video/mp4"), 1);
+    ASSERT_TRUE(WriteStringToFile("a larger library", mLibraryPaths[0].string()));
+    EXPECT_EQ(-2, answer(open().get(), "video/mp4"));
+}
+
+TEST_F(PluginIndexTest, DropsTheAnswersWhenALibraryIsAdded) {
+    open()->add(String8("video/mp4"), 1);
+    mLibraryPaths.push_back(String8(mDir.path) + "/c.so");
+    EXPECT_EQ(-2, answer(open().get(), "video/mp4"));
+}
+
+TEST_F(PluginIndexTest, ReadsAWellFormedFile) {
+    writeIndex(signatureLine() + "1 video/mp4\n-1 audio/mpeg\n0 \n");
+    auto index = open();
+    EXPECT_EQ(1, answer(index.get(), "video/mp4"));
+    EXPECT_EQ(-1, answer(index.get(), "audio/mpeg"));
+    EXPECT_EQ(0, answer(index.get(), ""));
+}
+
+TEST_F(PluginIndexTest, IgnoresATruncatedEntry) {
+    writeIndex(signatureLine() + "1 video/mp4\n0 audio/mp");
+    auto index = open();
+    EXPECT_EQ(1, answer(index.get(), "video/mp4"));
+    EXPECT_EQ(-2, answer(index.get(), "audio/mp"));
+}
+
+TEST_F(PluginIndexTest, DropsATruncatedSignature) {
+    std::string signature = signatureLine();
+    writeIndex(signature.substr(0, signature.size() - 1));
+    EXPECT_EQ(-2, answer(open().get(), "seed"));
+    writeIndex("");
+    EXPECT_EQ(-2, answer(open().get(), "seed"));
+
+    // A longer first line does not match either
+    writeIndex(signature.substr(0, signature.size() - 1) + "x\n0 video/mp4\n");
+    EXPECT_EQ(-2, answer(open().get(), "video/mp4"));
+}
+
+TEST_F(PluginIndexTest, IgnoresCorruptEntries) {
+    writeIndex(signatureLine() +
+               "\n"
+               "1\n"
+               "x video/mp4\n"
+               "1video/webm\n"
+               "2 audio/mpeg\n"
+               "-2 audio/aac\n"
+               "99999999999999999999999 audio/flac\n"
+               "1 video/avc\n");
+    auto index = open();
+    EXPECT_EQ(-2, answer(index.get(), "video/mp4"));
+    EXPECT_EQ(-2, answer(index.get(), "video/webm"));
+    EXPECT_EQ(-2, answer(index.get(), "audio/mpeg"));
+    EXPECT_EQ(-2, answer(index.get(), "audio/aac"));
+    EXPECT_EQ(-2, answer(index.get(), "audio/flac"));
+    EXPECT_EQ(1, answer(index.get(), "video/avc"));
+}
+
+TEST_F(PluginIndexTest, WorksWithoutAWritableIndex) {
+    mIndexPath = String8(mDir.path) + "/missing/index";
+    auto index = open();
+    index->add(String8("video/mp4"), 1);
+    EXPECT_EQ(1, answer(index.get(), "video/mp4"));
+    EXPECT_EQ(-2, answer(open().get(), "video/mp4"));
+}
+
+}  // namespace
+}  // namespace helper
+}  // namespace V1_0
+}  // namespace drm
+}  // namespace hardware
+}  // namespace android
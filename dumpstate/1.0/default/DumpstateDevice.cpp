@@ -21,6 +21,7 @@
 #include <hidl/HidlBinderSupport.h>
 #include <log/log.h>
 
+#include "DumpstateSections.h"
 #include "DumpstateUtil.h"
 
 using android::os::dumpstate::DumpFileToFd;
@@ -56,9 +57,14 @@ Return<void> DumpstateDevice::dumpstateBoard(const hidl_handle& handle) {
     ALOGI("Dumpstate HIDL not provided by device\n");
     dprintf(fd, "Dumpstate HIDL not provided by device; providing bogus data.\n");
 
-    // Shows some examples on how to use the libdumpstateutil API.
-    RunCommandToFd(fd, "DATE", {"/vendor/bin/date"});
-    DumpFileToFd(fd, "HOSTS", "/system/etc/hosts");
+    // Shows some examples on how to use the libdumpstateutil API. Independent sections are
+    // collected concurrently, and still written in this order.
+    DumpstateSections sections;
+    sections.add("DATE", std::chrono::seconds(10),
+                 [](int sectionFd) { RunCommandToFd(sectionFd, "DATE", {"/vendor/bin/date"}); });
+    sections.add("HOSTS", std::chrono::seconds(10),
+                 [](int sectionFd) { DumpFileToFd(sectionFd, "HOSTS", "/system/etc/hosts"); });
+    sections.run(fd);
 
     return Void();
 }
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "dumpstate"
+
+#include "DumpstateSections.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
+#include <log/log.h>
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// Output of a running section. It is shared with the threads of the section, which may outlive
+// run() when the section times out.
+struct SectionOutput {
+    std::mutex lock;
+    std::condition_variable done;
+    std::string buffer;
+    bool finished = false;
+    std::chrono::steady_clock::duration duration{0};
+};
+
+void drain(unique_fd readFd, std::shared_ptr<SectionOutput> output,
+           std::chrono::steady_clock::time_point start) {
+    char buf[4096];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(readFd.get(), buf, sizeof(buf)))) > 0) {
+        std::lock_guard<std::mutex> lock(output->lock);
+        output->buffer.append(buf, n);
+    }
+    std::lock_guard<std::mutex> lock(output->lock);
+    output->finished = true;
+    output->duration = std::chrono::steady_clock::now() - start;
+    output->done.notify_all();
+}
+
+int64_t toMilliseconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+}
+
+}  // namespace
+
+void DumpstateSections::add(const std::string& name, std::chrono::milliseconds timeout,
+                            Collector collector) {
+    mSections.push_back({name, timeout, std::move(collector)});
+}
+
+void DumpstateSections::run(int fd) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<SectionOutput>> outputs;
+    for (auto& section : mSections) {
+        auto output = std::make_shared<SectionOutput>();
+        outputs.push_back(output);
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            ALOGE("failed to create pipe for section %s: %s", section.name.c_str(),
+                  strerror(errno));
+            output->buffer = "*** failed to collect section\n";
+            output->finished = true;
+            continue;
+        }
+        unique_fd readFd(fds[0]);
+        unique_fd writeFd(fds[1]);
+        // The collector closes its end when it returns, which ends the drain.
+        std::thread(drain, std::move(readFd), output, start).detach();
+        std::thread([collector = section.collector, writeFd = std::move(writeFd)]() {
+            collector(writeFd.get());
+        }).detach();
+    }
+
+    std::string summary = "------ BOARD SECTION DURATIONS ------\n";
+    for (size_t i = 0; i < mSections.size(); ++i) {
+        const Section& section = mSections[i];
+        SectionOutput& output = *outputs[i];
+        std::unique_lock<std::mutex> lock(output.lock);
+        bool finished = output.done.wait_until(lock, start + section.timeout,
+                                               [&output] { return output.finished; });
+        android::base::WriteStringToFd(output.buffer, fd);
+        if (finished) {
+            summary += StringPrintf("%s: %" PRId64 " ms\n", section.name.c_str(),
+                                    toMilliseconds(output.duration));
+        } else {
+            // Later output of the section is dropped.
+            output.buffer.clear();
+            dprintf(fd, "*** %s timed out after %" PRId64 " ms\n", section.name.c_str(),
+                    toMilliseconds(section.timeout));
+            summary += StringPrintf("%s: timed out after %" PRId64 " ms\n",
+                                    section.name.c_str(), toMilliseconds(section.timeout));
+        }
+    }
+    summary += StringPrintf("total: %" PRId64 " ms\n",
+                            toMilliseconds(std::chrono::steady_clock::now() - start));
+    android::base::WriteStringToFd(summary, fd);
+    ALOGI("%s", summary.c_str());
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
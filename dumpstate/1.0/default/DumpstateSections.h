@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+#define ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace dumpstate {
+namespace V1_0 {
+namespace implementation {
+
+// Board sections of a bugreport, collected concurrently.
+//
+// Each collector writes its section to the fd it is given, which is a pipe buffered into
+// memory, on its own thread. run() writes the sections to the dumpstate fd in the order they
+// were added, each as soon as it and the ones before it are done, then a summary of the time
+// each took. A section still running at its timeout, counted from the start of run(), is
+// written as far as it got; its collector cannot be interrupted and is left to finish alone.
+class DumpstateSections {
+  public:
+    using Collector = std::function<void(int fd)>;
+
+    void add(const std::string& name, std::chrono::milliseconds timeout, Collector collector);
+    void run(int fd);
+
+  private:
+    struct Section {
+        std::string name;
+        std::chrono::milliseconds timeout;
+        Collector collector;
+    };
+
+    std::vector<Section> mSections;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace dumpstate
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_DUMPSTATE_V1_0_DUMPSTATESECTIONS_H
@@ -16,6 +16,8 @@
 #define LOG_TAG "android.hardware.gatekeeper@1.0-service"
 
 #include <dlfcn.h>
+#include <inttypes.h>
+#include <stdio.h>
 
 #include <log/log.h>
 
@@ -58,15 +60,18 @@ Return<void> Gatekeeper::enroll(uint32_t uid,
         const hidl_vec<uint8_t>& desiredPassword,
         enroll_cb cb)
 {
+    auto start = std::chrono::steady_clock::now();
     GatekeeperResponse rsp;
     uint8_t *enrolled_password_handle = nullptr;
     uint32_t enrolled_password_handle_length = 0;
 
+    auto deviceStart = std::chrono::steady_clock::now();
     int ret = device->enroll(device, uid,
             currentPasswordHandle.data(), currentPasswordHandle.size(),
             currentPassword.data(), currentPassword.size(),
             desiredPassword.data(), desiredPassword.size(),
             &enrolled_password_handle, &enrolled_password_handle_length);
+    auto deviceTime = std::chrono::steady_clock::now() - deviceStart;
     if (!ret) {
         rsp.data.setToExternal(enrolled_password_handle,
                                enrolled_password_handle_length,
@@ -79,6 +84,7 @@ Return<void> Gatekeeper::enroll(uint32_t uid,
         rsp.code = GatekeeperStatusCode::ERROR_GENERAL_FAILURE;
     }
     cb(rsp);
+    recordTiming(&mEnrollTiming, start, deviceTime);
     return Void();
 }
 
@@ -88,16 +94,19 @@ Return<void> Gatekeeper::verify(uint32_t uid,
                                 const hidl_vec<uint8_t>& providedPassword,
                                 verify_cb cb)
 {
+    auto start = std::chrono::steady_clock::now();
     GatekeeperResponse rsp;
     uint8_t *auth_token = nullptr;
     uint32_t auth_token_length = 0;
     bool request_reenroll = false;
 
+    auto deviceStart = std::chrono::steady_clock::now();
     int ret = device->verify(device, uid, challenge,
             enrolledPasswordHandle.data(), enrolledPasswordHandle.size(),
             providedPassword.data(), providedPassword.size(),
             &auth_token, &auth_token_length,
             &request_reenroll);
+    auto deviceTime = std::chrono::steady_clock::now() - deviceStart;
     if (!ret) {
         rsp.data.setToExternal(auth_token, auth_token_length, true);
         if (request_reenroll) {
@@ -112,6 +121,7 @@ Return<void> Gatekeeper::verify(uint32_t uid,
         rsp.code = GatekeeperStatusCode::ERROR_GENERAL_FAILURE;
     }
     cb(rsp);
+    recordTiming(&mVerifyTiming, start, deviceTime);
     return Void();
 }
 
@@ -154,6 +164,51 @@ Return<void> Gatekeeper::deleteAllUsers(deleteAllUsers_cb cb)  {
     return Void();
 }
 
+void Gatekeeper::OperationTiming::add(std::chrono::nanoseconds device,
+                                      std::chrono::nanoseconds overhead) {
+    count++;
+    deviceTotal += device;
+    deviceMax = std::max(deviceMax, device);
+    overheadTotal += overhead;
+    overheadMax = std::max(overheadMax, overhead);
+}
+
+void Gatekeeper::recordTiming(OperationTiming* timing,
+                              std::chrono::steady_clock::time_point start,
+                              std::chrono::nanoseconds device) {
+    auto total = std::chrono::steady_clock::now() - start;
+    std::lock_guard<std::mutex> lock(mTimingLock);
+    timing->add(device, total - device);
+}
+
+static void dumpTiming(int fd, const char* name, uint64_t count, std::chrono::nanoseconds total,
+                       std::chrono::nanoseconds max) {
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+    dprintf(fd, "  %s: mean %" PRId64 " us, max %" PRId64 " us\n", name,
+            count ? static_cast<int64_t>(duration_cast<microseconds>(total).count() / count) : 0,
+            static_cast<int64_t>(duration_cast<microseconds>(max).count()));
+}
+
+Return<void> Gatekeeper::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
+    if (handle == nullptr || handle->numFds < 1 || handle->data[0] < 0) {
+        ALOGE("debug called with no handle");
+        return Void();
+    }
+    int fd = handle->data[0];
+
+    std::lock_guard<std::mutex> lock(mTimingLock);
+    const std::pair<const char*, const OperationTiming*> operations[] = {
+            {"enroll", &mEnrollTiming}, {"verify", &mVerifyTiming}};
+    for (auto& operation : operations) {
+        const OperationTiming& timing = *operation.second;
+        dprintf(fd, "%s: %" PRIu64 " calls\n", operation.first, timing.count);
+        dumpTiming(fd, "TEE", timing.count, timing.deviceTotal, timing.deviceMax);
+        dumpTiming(fd, "HAL overhead", timing.count, timing.overheadTotal, timing.overheadMax);
+    }
+    return Void();
+}
+
 IGatekeeper* HIDL_FETCH_IGatekeeper(const char* /* name */) {
     return new Gatekeeper();
 }
@@ -24,6 +24,10 @@
 #include <hardware/hardware.h>
 #include <hardware/gatekeeper.h>
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
 namespace android {
 namespace hardware {
 namespace gatekeeper {
@@ -34,6 +38,7 @@ using ::android::hardware::gatekeeper::V1_0::GatekeeperResponse;
 using ::android::hardware::gatekeeper::V1_0::IGatekeeper;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
 using ::android::sp;
@@ -56,9 +61,30 @@ public:
                         verify_cb _hidl_cb)  override;
     Return<void> deleteUser(uint32_t uid, deleteUser_cb _hidl_cb)  override;
     Return<void> deleteAllUsers(deleteAllUsers_cb _hidl_cb)  override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 private:
+    // Time spent by the calls of one operation, split between the legacy device, which is
+    // where the TEE round trip happens, and the rest of the HAL, up to the callback return.
+    struct OperationTiming {
+        uint64_t count = 0;
+        std::chrono::nanoseconds deviceTotal{0};
+        std::chrono::nanoseconds deviceMax{0};
+        std::chrono::nanoseconds overheadTotal{0};
+        std::chrono::nanoseconds overheadMax{0};
+
+        void add(std::chrono::nanoseconds device, std::chrono::nanoseconds overhead);
+    };
+
+    void recordTiming(OperationTiming* timing, std::chrono::steady_clock::time_point start,
+                      std::chrono::nanoseconds device);
+
     gatekeeper_device_t *device;
     const hw_module_t *module;
+    std::mutex mTimingLock;
+    OperationTiming mEnrollTiming;
+    OperationTiming mVerifyTiming;
 };
 
 extern "C" IGatekeeper* HIDL_FETCH_IGatekeeper(const char* name);
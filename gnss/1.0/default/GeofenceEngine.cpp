@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssHal_GeofenceEngine"
+
+#include "GeofenceEngine.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+constexpr double kEarthRadiusMeters = 6371008.8;
+constexpr double kMetersPerDegree = kEarthRadiusMeters * M_PI / 180.0;
+
+/*
+ * Grid cells are kCellDegrees on a side, about 1.1 km of latitude. A geofence, or the accuracy
+ * circle of a fix, covering more than kMaxIndexedCells cells is not looked up in the grid.
+ */
+constexpr double kCellDegrees = 0.01;
+constexpr int32_t kLatCells = static_cast<int32_t>(180.0 / kCellDegrees);
+constexpr int32_t kLonCells = static_cast<int32_t>(360.0 / kCellDegrees);
+constexpr int64_t kMaxIndexedCells = 256;
+
+/*
+ * horizontalAccuracyMeters is the radius of 68% confidence. IGnssGeofenceCallback recommends
+ * deciding the state with 95% confidence, which for a circular normal error is 1.62 times larger.
+ */
+constexpr double kConfidenceScale = 1.62;
+
+constexpr int32_t kAllTransitions =
+        static_cast<int32_t>(IGnssGeofenceCallback::GeofenceTransition::ENTERED) |
+        static_cast<int32_t>(IGnssGeofenceCallback::GeofenceTransition::EXITED) |
+        static_cast<int32_t>(IGnssGeofenceCallback::GeofenceTransition::UNCERTAIN);
+
+double toRadians(double degrees) {
+    return degrees * M_PI / 180.0;
+}
+
+double distanceMeters(double lat1, double lon1, double lat2, double lon2) {
+    double dLat = toRadians(lat2 - lat1);
+    double dLon = toRadians(lon2 - lon1);
+    double a = std::sin(dLat / 2) * std::sin(dLat / 2) +
+               std::cos(toRadians(lat1)) * std::cos(toRadians(lat2)) * std::sin(dLon / 2) *
+                       std::sin(dLon / 2);
+    return 2 * kEarthRadiusMeters * std::asin(std::sqrt(std::min(1.0, a)));
+}
+
+int32_t latCell(double latitudeDegrees) {
+    return std::min(kLatCells - 1,
+                    std::max(0, static_cast<int32_t>(
+                                        std::floor((latitudeDegrees + 90.0) / kCellDegrees))));
+}
+
+int32_t lonCell(double longitudeDegrees) {
+    return static_cast<int32_t>(std::floor((longitudeDegrees + 180.0) / kCellDegrees));
+}
+
+int64_t cellCount(int32_t minLat, int32_t maxLat, int32_t minLon, int32_t maxLon) {
+    return static_cast<int64_t>(maxLat - minLat + 1) * (maxLon - minLon + 1);
+}
+
+}  // namespace
+
+constexpr size_t GeofenceEngine::kMaxGeofences;
+
+GeofenceEngine::CellRange GeofenceEngine::cellsAround(double latitudeDegrees,
+                                                      double longitudeDegrees,
+                                                      double radiusMeters) {
+    double dLat = radiusMeters / kMetersPerDegree;
+    CellRange range = {.minLat = latCell(latitudeDegrees - dLat),
+                       .maxLat = latCell(latitudeDegrees + dLat),
+                       .minLon = 0,
+                       .maxLon = kLonCells - 1};
+
+    // The widest latitude of the circle is the one nearest to a pole
+    double widestLat = std::min(90.0, std::abs(latitudeDegrees) + dLat);
+    double cosLat = std::cos(toRadians(widestLat));
+    double dLon = cosLat > 0 ? radiusMeters / (kMetersPerDegree * cosLat) : 360.0;
+    if (dLon < 180.0) {
+        // May extend past the antimeridian, forEachCell() wraps the cells around
+        range.minLon = lonCell(longitudeDegrees - dLon);
+        range.maxLon = lonCell(longitudeDegrees + dLon);
+    }
+    return range;
+}
+
+int64_t GeofenceEngine::cellKey(int32_t latCell, int32_t lonCell) {
+    int32_t wrapped = ((lonCell % kLonCells) + kLonCells) % kLonCells;
+    return static_cast<int64_t>(latCell) * kLonCells + wrapped;
+}
+
+template <typename Visitor>
+void GeofenceEngine::forEachCell(const CellRange& range, Visitor visitor) {
+    for (int32_t lat = range.minLat; lat <= range.maxLat; lat++) {
+        for (int32_t lon = range.minLon; lon <= range.maxLon; lon++) {
+            visitor(cellKey(lat, lon));
+        }
+    }
+}
+
+void GeofenceEngine::indexGeofence(int32_t geofenceId, const Geofence& geofence) {
+    CellRange range =
+            cellsAround(geofence.latitudeDegrees, geofence.longitudeDegrees, geofence.radiusMeters);
+    if (cellCount(range.minLat, range.maxLat, range.minLon, range.maxLon) > kMaxIndexedCells) {
+        mLargeGeofences.insert(geofenceId);
+        return;
+    }
+    forEachCell(range, [&](int64_t key) { mCells[key].push_back(geofenceId); });
+}
+
+void GeofenceEngine::unindexGeofence(int32_t geofenceId, const Geofence& geofence) {
+    if (mLargeGeofences.erase(geofenceId) > 0) {
+        return;
+    }
+    CellRange range =
+            cellsAround(geofence.latitudeDegrees, geofence.longitudeDegrees, geofence.radiusMeters);
+    forEachCell(range, [&](int64_t key) {
+        auto cell = mCells.find(key);
+        if (cell == mCells.end()) {
+            return;
+        }
+        auto& ids = cell->second;
+        auto it = std::find(ids.begin(), ids.end(), geofenceId);
+        if (it != ids.end()) {
+            *it = ids.back();
+            ids.pop_back();
+        }
+        if (ids.empty()) {
+            mCells.erase(cell);
+        }
+    });
+}
+
+void GeofenceEngine::updateActive(int32_t geofenceId, const Geofence& geofence) {
+    if (geofence.state != State::OUTSIDE || geofence.ambiguousSinceMs >= 0) {
+        mActive.insert(geofenceId);
+    } else {
+        mActive.erase(geofenceId);
+    }
+}
+
+GeofenceEngine::GeofenceStatus GeofenceEngine::addGeofence(
+        int32_t geofenceId, double latitudeDegrees, double longitudeDegrees, double radiusMeters,
+        GeofenceTransition lastTransition, int32_t monitorTransitions, uint32_t unknownTimerMs) {
+    if ((monitorTransitions & ~kAllTransitions) != 0) {
+        return GeofenceStatus::ERROR_INVALID_TRANSITION;
+    }
+    State state;
+    switch (lastTransition) {
+        case GeofenceTransition::ENTERED:
+            state = State::INSIDE;
+            break;
+        case GeofenceTransition::EXITED:
+            state = State::OUTSIDE;
+            break;
+        case GeofenceTransition::UNCERTAIN:
+            state = State::UNKNOWN;
+            break;
+        default:
+            return GeofenceStatus::ERROR_INVALID_TRANSITION;
+    }
+    if (!(radiusMeters > 0) || !(std::abs(latitudeDegrees) <= 90.0) ||
+        !(std::abs(longitudeDegrees) <= 180.0)) {
+        ALOGE("%s: Invalid geofence %d", __func__, geofenceId);
+        return GeofenceStatus::ERROR_GENERIC;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mGeofences.count(geofenceId) > 0) {
+        return GeofenceStatus::ERROR_ID_EXISTS;
+    }
+    if (mGeofences.size() >= kMaxGeofences) {
+        return GeofenceStatus::ERROR_TOO_MANY_GEOFENCES;
+    }
+    Geofence& geofence = mGeofences[geofenceId];
+    geofence = {.latitudeDegrees = latitudeDegrees,
+                .longitudeDegrees = longitudeDegrees,
+                .radiusMeters = radiusMeters,
+                .monitorTransitions = monitorTransitions,
+                .unknownTimerMs = unknownTimerMs,
+                .state = state,
+                .paused = false,
+                .ambiguousSinceMs = -1};
+    indexGeofence(geofenceId, geofence);
+    updateActive(geofenceId, geofence);
+    return GeofenceStatus::OPERATION_SUCCESS;
+}
+
+GeofenceEngine::GeofenceStatus GeofenceEngine::pauseGeofence(int32_t geofenceId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mGeofences.find(geofenceId);
+    if (it == mGeofences.end()) {
+        return GeofenceStatus::ERROR_ID_UNKNOWN;
+    }
+    // The state is still tracked, so that resuming does not report stale transitions
+    it->second.paused = true;
+    return GeofenceStatus::OPERATION_SUCCESS;
+}
+
+GeofenceEngine::GeofenceStatus GeofenceEngine::resumeGeofence(int32_t geofenceId,
+                                                              int32_t monitorTransitions) {
+    if ((monitorTransitions & ~kAllTransitions) != 0) {
+        return GeofenceStatus::ERROR_INVALID_TRANSITION;
+    }
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mGeofences.find(geofenceId);
+    if (it == mGeofences.end()) {
+        return GeofenceStatus::ERROR_ID_UNKNOWN;
+    }
+    it->second.paused = false;
+    it->second.monitorTransitions = monitorTransitions;
+    return GeofenceStatus::OPERATION_SUCCESS;
+}
+
+GeofenceEngine::GeofenceStatus GeofenceEngine::removeGeofence(int32_t geofenceId) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mGeofences.find(geofenceId);
+    if (it == mGeofences.end()) {
+        return GeofenceStatus::ERROR_ID_UNKNOWN;
+    }
+    unindexGeofence(geofenceId, it->second);
+    mActive.erase(geofenceId);
+    mGeofences.erase(it);
+    return GeofenceStatus::OPERATION_SUCCESS;
+}
+
+void GeofenceEngine::evaluate(const GnssLocation& location, std::vector<Transition>* transitions) {
+    transitions->clear();
+    double accuracyMeters = 0;
+    if (location.gnssLocationFlags & GnssLocationFlags::HAS_HORIZONTAL_ACCURACY) {
+        accuracyMeters = location.horizontalAccuracyMeters * kConfidenceScale;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCandidates.clear();
+    CellRange range =
+            cellsAround(location.latitudeDegrees, location.longitudeDegrees, accuracyMeters);
+    if (cellCount(range.minLat, range.maxLat, range.minLon, range.maxLon) > kMaxIndexedCells) {
+        // Too inaccurate to narrow down the geofences
+        for (const auto& geofence : mGeofences) {
+            mCandidates.push_back(geofence.first);
+        }
+    } else {
+        /*
+         * A geofence in none of these cells is farther than the accuracy circle, so it is
+         * Outside. It only needs evaluating if it was not already Outside, which mActive holds.
+         */
+        forEachCell(range, [&](int64_t key) {
+            auto cell = mCells.find(key);
+            if (cell != mCells.end()) {
+                mCandidates.insert(mCandidates.end(), cell->second.begin(), cell->second.end());
+            }
+        });
+        mCandidates.insert(mCandidates.end(), mLargeGeofences.begin(), mLargeGeofences.end());
+        mCandidates.insert(mCandidates.end(), mActive.begin(), mActive.end());
+        std::sort(mCandidates.begin(), mCandidates.end());
+        mCandidates.erase(std::unique(mCandidates.begin(), mCandidates.end()),
+                          mCandidates.end());
+    }
+
+    for (int32_t geofenceId : mCandidates) {
+        auto it = mGeofences.find(geofenceId);
+        evaluateGeofence(geofenceId, &it->second, location, accuracyMeters, transitions);
+    }
+}
+
+void GeofenceEngine::evaluateGeofence(int32_t geofenceId, Geofence* geofence,
+                                      const GnssLocation& location, double accuracyMeters,
+                                      std::vector<Transition>* transitions) {
+    double distance = distanceMeters(geofence->latitudeDegrees, geofence->longitudeDegrees,
+                                     location.latitudeDegrees, location.longitudeDegrees);
+    bool inside = distance + accuracyMeters <= geofence->radiusMeters;
+    bool outside = distance - accuracyMeters >= geofence->radiusMeters;
+    GeofenceTransition transition;
+    if (inside || outside) {
+        State observed = inside ? State::INSIDE : State::OUTSIDE;
+        geofence->ambiguousSinceMs = -1;
+        if (geofence->state == observed) {
+            updateActive(geofenceId, *geofence);
+            return;
+        }
+        geofence->state = observed;
+        transition = observed == State::INSIDE ? GeofenceTransition::ENTERED
+                                               : GeofenceTransition::EXITED;
+    } else {
+        // The accuracy circle straddles the boundary
+        if (geofence->state == State::UNKNOWN) {
+            return;
+        }
+        if (geofence->ambiguousSinceMs < 0) {
+            geofence->ambiguousSinceMs = location.timestamp;
+            updateActive(geofenceId, *geofence);
+            return;
+        }
+        if (location.timestamp - geofence->ambiguousSinceMs < geofence->unknownTimerMs) {
+            return;
+        }
+        geofence->state = State::UNKNOWN;
+        geofence->ambiguousSinceMs = -1;
+        transition = GeofenceTransition::UNCERTAIN;
+    }
+    updateActive(geofenceId, *geofence);
+
+    if (!geofence->paused && (geofence->monitorTransitions & static_cast<int32_t>(transition))) {
+        transitions->push_back({.geofenceId = geofenceId, .transition = transition});
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef android_hardware_gnss_V1_0_GeofenceEngine_H_
+#define android_hardware_gnss_V1_0_GeofenceEngine_H_
+
+#include <android/hardware/gnss/1.0/IGnssGeofenceCallback.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V1_0 {
+namespace implementation {
+
+/*
+ * Evaluates geofences in software, for conventional GNSS HALs without a geofencing extension.
+ * The geofences are only evaluated against the fixes passed to evaluate(), it does not request
+ * any on its own.
+ *
+ * Each geofence is in the Inside, Outside or Unknown state described in IGnssGeofenceCallback.
+ * A fix only evaluates the geofences whose grid cells its accuracy circle touches, plus the
+ * ones that are not known to be Outside, so the cost of a fix does not grow with the number
+ * of distant geofences.
+ */
+class GeofenceEngine {
+  public:
+    using GeofenceTransition = IGnssGeofenceCallback::GeofenceTransition;
+    using GeofenceStatus = IGnssGeofenceCallback::GeofenceStatus;
+
+    struct Transition {
+        int32_t geofenceId;
+        GeofenceTransition transition;
+    };
+
+    static constexpr size_t kMaxGeofences = 10000;
+
+    GeofenceStatus addGeofence(int32_t geofenceId, double latitudeDegrees,
+                               double longitudeDegrees, double radiusMeters,
+                               GeofenceTransition lastTransition, int32_t monitorTransitions,
+                               uint32_t unknownTimerMs);
+    GeofenceStatus pauseGeofence(int32_t geofenceId);
+    GeofenceStatus resumeGeofence(int32_t geofenceId, int32_t monitorTransitions);
+    GeofenceStatus removeGeofence(int32_t geofenceId);
+
+    /*
+     * Evaluates the geofences against a fix, and replaces the content of transitions with the
+     * monitored transitions it caused.
+     */
+    void evaluate(const GnssLocation& location, std::vector<Transition>* transitions);
+
+  private:
+    enum class State { INSIDE, OUTSIDE, UNKNOWN };
+
+    struct Geofence {
+        double latitudeDegrees;
+        double longitudeDegrees;
+        double radiusMeters;
+        int32_t monitorTransitions;
+        uint32_t unknownTimerMs;
+        State state;
+        bool paused;
+        // Timestamp of the first fix of the current run of ambiguous fixes, or -1
+        int64_t ambiguousSinceMs;
+    };
+
+    struct CellRange {
+        int32_t minLat;
+        int32_t maxLat;
+        int32_t minLon;
+        int32_t maxLon;
+    };
+
+    static CellRange cellsAround(double latitudeDegrees, double longitudeDegrees,
+                                 double radiusMeters);
+    static int64_t cellKey(int32_t latCell, int32_t lonCell);
+    template <typename Visitor>
+    static void forEachCell(const CellRange& range, Visitor visitor);
+
+    void indexGeofence(int32_t geofenceId, const Geofence& geofence);
+    void unindexGeofence(int32_t geofenceId, const Geofence& geofence);
+    void updateActive(int32_t geofenceId, const Geofence& geofence);
+    void evaluateGeofence(int32_t geofenceId, Geofence* geofence, const GnssLocation& location,
+                          double accuracyMeters, std::vector<Transition>* transitions);
+
+    std::mutex mMutex;
+    std::unordered_map<int32_t, Geofence> mGeofences;
+    // Geofences by the grid cells their bounding box covers
+    std::unordered_map<int64_t, std::vector<int32_t>> mCells;
+    // Geofences covering too many cells to be indexed, evaluated on every fix
+    std::unordered_set<int32_t> mLargeGeofences;
+    // Geofences not known to be Outside, or timing an ambiguous run, evaluated on every fix
+    std::unordered_set<int32_t> mActive;
+    // Scratch space of evaluate(), kept to avoid allocating on every fix
+    std::vector<int32_t> mCandidates;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // android_hardware_gnss_V1_0_GeofenceEngine_H_
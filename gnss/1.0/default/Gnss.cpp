@@ -18,6 +18,7 @@
 
 #include "Gnss.h"
 #include <GnssUtils.h>
+#include <cutils/properties.h>
 
 namespace android {
 namespace hardware {
@@ -31,6 +32,13 @@ bool Gnss::sInterfaceExists = false;
 bool Gnss::sWakelockHeldGnss = false;
 bool Gnss::sWakelockHeldFused = false;
 
+/*
+ * Evaluates the geofences in software when the conventional GNSS HAL has no geofencing
+ * extension. Off by default: the software geofences are only evaluated on the fixes of a running
+ * navigation session, so they do not work like the ones of a HAL that tracks them on its own.
+ */
+constexpr char kSoftwareGeofencingProperty[] = "ro.vendor.gnss.software_geofencing";
+
 GpsCallbacks Gnss::sGnssCb = {
     .size = sizeof(GpsCallbacks),
     .location_cb = locationCb,
@@ -84,6 +92,8 @@ void Gnss::locationCb(GpsLocation* location) {
     if (!ret.isOk()) {
         ALOGE("%s: Unable to invoke callback", __func__);
     }
+
+    GnssGeofencing::softwareLocationCb(gnssLocation);
 }
 
 void Gnss::statusCb(GpsStatus* gnssStatus) {
@@ -548,10 +558,14 @@ Return<sp<IGnssGeofencing>> Gnss::getExtensionGnssGeofencing()  {
                         mGnssIface->get_extension(GPS_GEOFENCING_INTERFACE));
 
         if (gpsGeofencingIface == nullptr) {
-            ALOGE("%s: GnssGeofencing interface not implemented by HAL", __func__);
-        } else {
-            mGnssGeofencingIface = new GnssGeofencing(gpsGeofencingIface);
+            if (!property_get_bool(kSoftwareGeofencingProperty, false)) {
+                ALOGE("%s: GnssGeofencing interface not implemented by HAL", __func__);
+                return nullptr;
+            }
+            ALOGI("%s: GnssGeofencing interface not implemented by HAL, using software",
+                  __func__);
         }
+        mGnssGeofencingIface = new GnssGeofencing(gpsGeofencingIface);
     }
 
     return mGnssGeofencingIface;
@@ -28,6 +28,8 @@ namespace implementation {
 std::vector<std::unique_ptr<ThreadFuncArgs>> GnssGeofencing::sThreadFuncArgsList;
 sp<IGnssGeofenceCallback> GnssGeofencing::mGnssGeofencingCbIface = nullptr;
 bool GnssGeofencing::sInterfaceExists = false;
+std::mutex GnssGeofencing::sEngineMutex;
+std::shared_ptr<GeofenceEngine> GnssGeofencing::sEngine;
 
 GpsGeofenceCallbacks GnssGeofencing::sGnssGfCb = {
     .geofence_transition_callback = gnssGfTransitionCb,
@@ -44,11 +46,20 @@ GnssGeofencing::GnssGeofencing(const GpsGeofencingInterface* gpsGeofencingIface)
     /* Error out if an instance of the interface already exists. */
     LOG_ALWAYS_FATAL_IF(sInterfaceExists);
     sInterfaceExists = true;
+
+    if (mGnssGeofencingIface == nullptr) {
+        ALOGI("%s: Evaluating geofences in software", __func__);
+        std::lock_guard<std::mutex> lock(sEngineMutex);
+        sEngine = std::make_shared<GeofenceEngine>();
+    }
 }
 
 GnssGeofencing::~GnssGeofencing() {
     sThreadFuncArgsList.clear();
     sInterfaceExists = false;
+
+    std::lock_guard<std::mutex> lock(sEngineMutex);
+    sEngine = nullptr;
 }
 void GnssGeofencing::gnssGfTransitionCb(int32_t geofenceId,
                                         GpsLocation* location,
@@ -152,12 +163,44 @@ pthread_t GnssGeofencing::createThreadCb(const char* name, void (*start)(void*),
     return createPthread(name, start, arg, &sThreadFuncArgsList);
 }
 
+void GnssGeofencing::softwareLocationCb(const GnssLocation& location) {
+    std::shared_ptr<GeofenceEngine> engine;
+    {
+        std::lock_guard<std::mutex> lock(sEngineMutex);
+        engine = sEngine;
+    }
+    if (engine == nullptr) {
+        return;
+    }
+
+    // Only called from the thread of the location callback, so the vector can be kept
+    static std::vector<GeofenceEngine::Transition> transitions;
+    engine->evaluate(location, &transitions);
+    if (transitions.empty()) {
+        return;
+    }
+
+    if (mGnssGeofencingCbIface == nullptr) {
+        ALOGE("%s: GNSS Geofence Callback Interface configured incorrectly", __func__);
+        return;
+    }
+    for (const auto& transition : transitions) {
+        auto ret = mGnssGeofencingCbIface->gnssGeofenceTransitionCb(
+                transition.geofenceId, location, transition.transition, location.timestamp);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    }
+}
+
 // Methods from ::android::hardware::gnss::V1_0::IGnssGeofencing follow.
 Return<void> GnssGeofencing::setCallback(const sp<IGnssGeofenceCallback>& callback)  {
     mGnssGeofencingCbIface = callback;
 
     if (mGnssGeofencingIface == nullptr) {
-        ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        if (sEngine == nullptr) {
+            ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        }
     } else {
         mGnssGeofencingIface->init(&sGnssGfCb);
     }
@@ -175,7 +218,18 @@ Return<void> GnssGeofencing::addGeofence(
         uint32_t notificationResponsivenessMs,
         uint32_t unknownTimerMs)  {
     if (mGnssGeofencingIface == nullptr) {
-        ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        if (sEngine == nullptr) {
+            ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        } else {
+            /*
+             * notificationResponsivenessMs is met as long as fixes come at least that often,
+             * as each fix is evaluated as soon as it is reported.
+             */
+            gnssGfAddCb(geofenceId, static_cast<int32_t>(sEngine->addGeofence(
+                                            geofenceId, latitudeDegrees, longitudeDegrees,
+                                            radiusMeters, lastTransition, monitorTransitions,
+                                            unknownTimerMs)));
+        }
         return Void();
     } else {
         mGnssGeofencingIface->add_geofence_area(
@@ -193,7 +247,11 @@ Return<void> GnssGeofencing::addGeofence(
 
 Return<void> GnssGeofencing::pauseGeofence(int32_t geofenceId)  {
     if (mGnssGeofencingIface == nullptr) {
-        ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        if (sEngine == nullptr) {
+            ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        } else {
+            gnssGfPauseCb(geofenceId, static_cast<int32_t>(sEngine->pauseGeofence(geofenceId)));
+        }
     } else {
         mGnssGeofencingIface->pause_geofence(geofenceId);
     }
@@ -202,7 +260,12 @@ Return<void> GnssGeofencing::pauseGeofence(int32_t geofenceId)  {
 
 Return<void> GnssGeofencing::resumeGeofence(int32_t geofenceId, int32_t monitorTransitions)  {
     if (mGnssGeofencingIface == nullptr) {
-        ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        if (sEngine == nullptr) {
+            ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        } else {
+            gnssGfResumeCb(geofenceId, static_cast<int32_t>(sEngine->resumeGeofence(
+                                               geofenceId, monitorTransitions)));
+        }
     } else {
         mGnssGeofencingIface->resume_geofence(geofenceId, monitorTransitions);
     }
@@ -211,7 +274,12 @@ Return<void> GnssGeofencing::resumeGeofence(int32_t geofenceId, int32_t monitorT
 
 Return<void> GnssGeofencing::removeGeofence(int32_t geofenceId)  {
     if (mGnssGeofencingIface == nullptr) {
-        ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        if (sEngine == nullptr) {
+            ALOGE("%s: GnssGeofencing interface is not available", __func__);
+        } else {
+            gnssGfRemoveCb(geofenceId,
+                           static_cast<int32_t>(sEngine->removeGeofence(geofenceId)));
+        }
     } else {
         mGnssGeofencingIface->remove_geofence_area(geofenceId);
     }
@@ -17,11 +17,15 @@
 #ifndef android_hardware_gnss_V1_0_GnssGeofencing_H_
 #define android_hardware_gnss_V1_0_GnssGeofencing_H_
 
+#include <GeofenceEngine.h>
 #include <ThreadCreationWrapper.h>
 #include <android/hardware/gnss/1.0/IGnssGeofencing.h>
 #include <hidl/Status.h>
 #include <hardware/gps.h>
 
+#include <memory>
+#include <mutex>
+
 namespace android {
 namespace hardware {
 namespace gnss {
@@ -40,6 +44,12 @@ using ::android::sp;
  * Interface for GNSS Geofencing support. It also contains wrapper methods to allow
  * methods from IGnssGeofenceCallback interface to be passed into the
  * conventional implementation of the GNSS HAL.
+ *
+ * If the conventional GNSS HAL has no geofencing extension and ro.vendor.gnss.software_geofencing
+ * is set, gpsGeofencingIface is null and the geofences are evaluated in software by a
+ * GeofenceEngine, from the fixes passed to softwareLocationCb(). Those are the fixes of the
+ * navigation session started by IGnss::start(), so no transition is reported while navigation is
+ * stopped.
  */
 struct GnssGeofencing : public IGnssGeofencing {
     GnssGeofencing(const GpsGeofencingInterface* gpsGeofencingIface);
@@ -76,6 +86,12 @@ struct GnssGeofencing : public IGnssGeofencing {
     static void gnssGfResumeCb(int32_t geofence_id, int32_t status);
     static pthread_t createThreadCb(const char* name, void (*start)(void*), void* arg);
 
+    /*
+     * Evaluates the software geofences against a location fix of the GNSS HAL, if there are
+     * any. This method is not part of the IGnssGeofencing base class.
+     */
+    static void softwareLocationCb(const GnssLocation& location);
+
     /*
      * Holds function pointers to the callback methods.
      */
@@ -86,6 +102,8 @@ struct GnssGeofencing : public IGnssGeofencing {
     static sp<IGnssGeofenceCallback> mGnssGeofencingCbIface;
     const GpsGeofencingInterface* mGnssGeofencingIface = nullptr;
     static bool sInterfaceExists;
+    static std::mutex sEngineMutex;
+    static std::shared_ptr<GeofenceEngine> sEngine;
 };
 
 }  // namespace implementation
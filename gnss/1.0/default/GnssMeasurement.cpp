@@ -25,6 +25,7 @@ namespace V1_0 {
 namespace implementation {
 
 sp<IGnssMeasurementCallback> GnssMeasurement::sGnssMeasureCbIface = nullptr;
+IGnssMeasurementCallback::GnssData GnssMeasurement::sGnssData;
 GpsMeasurementCallbacks GnssMeasurement::sGnssMeasurementCbs = {
     .size = sizeof(GpsMeasurementCallbacks),
     .measurement_callback = gpsMeasurementCb,
@@ -45,12 +46,13 @@ void GnssMeasurement::gnssMeasurementCb(LegacyGnssData* legacyGnssData) {
         return;
     }
 
-    IGnssMeasurementCallback::GnssData gnssData;
+    // Only the first measurementCount entries are read, so only those are converted.
+    IGnssMeasurementCallback::GnssData& gnssData = sGnssData;
     gnssData.measurementCount = std::min(legacyGnssData->measurement_count,
                                          static_cast<size_t>(GnssMax::SVS_COUNT));
 
     for (size_t i = 0; i < gnssData.measurementCount; i++) {
-        auto entry = legacyGnssData->measurements[i];
+        const auto& entry = legacyGnssData->measurements[i];
         auto state = static_cast<GnssMeasurementState>(entry.state);
         if (state & IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_DECODED) {
           state |= IGnssMeasurementCallback::GnssMeasurementState::STATE_TOW_KNOWN;
@@ -82,7 +84,7 @@ void GnssMeasurement::gnssMeasurementCb(LegacyGnssData* legacyGnssData) {
         };
     }
 
-    auto clockVal = legacyGnssData->clock;
+    const auto& clockVal = legacyGnssData->clock;
     gnssData.clock = {
         .gnssClockFlags = clockVal.flags,
         .leapSecond = clockVal.leap_second,
@@ -119,13 +121,13 @@ void GnssMeasurement::gpsMeasurementCb(GpsData* gpsData) {
         return;
     }
 
-    IGnssMeasurementCallback::GnssData gnssData;
+    IGnssMeasurementCallback::GnssData& gnssData = sGnssData;
     gnssData.measurementCount = std::min(gpsData->measurement_count,
                                          static_cast<size_t>(GnssMax::SVS_COUNT));
 
 
     for (size_t i = 0; i < gnssData.measurementCount; i++) {
-        auto entry = gpsData->measurements[i];
+        const auto& entry = gpsData->measurements[i];
         gnssData.measurements[i].flags = entry.flags;
         gnssData.measurements[i].svid = static_cast<int32_t>(entry.prn);
         if (entry.prn >= 1 && entry.prn <= 32) {
@@ -150,6 +152,8 @@ void GnssMeasurement::gpsMeasurementCb(GpsData* gpsData) {
                 entry.accumulated_delta_range_m;
         gnssData.measurements[i].accumulatedDeltaRangeUncertaintyM =
                 entry.accumulated_delta_range_uncertainty_m;
+        // Not provided by GpsMeasurement, and sGnssData keeps the value of the previous epoch
+        gnssData.measurements[i].carrierCycles = 0;
 
         if (entry.flags & GNSS_MEASUREMENT_HAS_CARRIER_FREQUENCY) {
             gnssData.measurements[i].carrierFrequencyHz = entry.carrier_frequency_hz;
@@ -183,6 +187,7 @@ void GnssMeasurement::gpsMeasurementCb(GpsData* gpsData) {
     auto clockVal = gpsData->clock;
     static uint32_t discontinuity_count_to_handle_old_clock_type = 0;
 
+    gnssData.clock = {};
     gnssData.clock.leapSecond = clockVal.leap_second;
     /*
      * GnssClock only supports the more effective HW_CLOCK type, so type
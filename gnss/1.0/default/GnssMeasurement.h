@@ -73,6 +73,12 @@ struct GnssMeasurement : public IGnssMeasurement {
  private:
     const GpsMeasurementInterface* mGnssMeasureIface = nullptr;
     static sp<IGnssMeasurementCallback> sGnssMeasureCbIface;
+    /*
+     * The GnssData converted for each epoch. It holds GnssMax::SVS_COUNT measurements, so it is
+     * kept across epochs rather than built anew on the stack of every callback. Only used from the
+     * callback thread of the conventional GNSS HAL.
+     */
+    static IGnssMeasurementCallback::GnssData sGnssData;
 };
 
 }  // namespace implementation
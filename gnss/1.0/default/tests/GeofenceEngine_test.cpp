@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "GeofenceEngine.h"
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using GeofenceTransition = GeofenceEngine::GeofenceTransition;
+using GeofenceStatus = GeofenceEngine::GeofenceStatus;
+
+constexpr double kLatitude = 37.0;
+constexpr double kLongitude = -122.0;
+constexpr double kRadiusMeters = 100.0;
+// About 111 m of latitude
+constexpr double kMilliDegree = 0.001;
+constexpr uint32_t kUnknownTimerMs = 10000;
+
+constexpr int32_t kAllTransitions = static_cast<int32_t>(GeofenceTransition::ENTERED) |
+                                    static_cast<int32_t>(GeofenceTransition::EXITED) |
+                                    static_cast<int32_t>(GeofenceTransition::UNCERTAIN);
+
+GnssLocation makeFix(double latitudeDegrees, double longitudeDegrees, float accuracyMeters,
+                     int64_t timestampMs) {
+    GnssLocation location = {};
+    location.gnssLocationFlags =
+            static_cast<uint16_t>(GnssLocationFlags::HAS_LAT_LONG) |
+            static_cast<uint16_t>(GnssLocationFlags::HAS_HORIZONTAL_ACCURACY);
+    location.latitudeDegrees = latitudeDegrees;
+    location.longitudeDegrees = longitudeDegrees;
+    location.horizontalAccuracyMeters = accuracyMeters;
+    location.timestamp = timestampMs;
+    return location;
+}
+
+class GeofenceEngineTest : public ::testing::Test {
+  protected:
+    GeofenceStatus add(int32_t geofenceId, GeofenceTransition lastTransition,
+                       int32_t monitorTransitions = kAllTransitions) {
+        return mEngine.addGeofence(geofenceId, kLatitude, kLongitude, kRadiusMeters,
+                                   lastTransition, monitorTransitions, kUnknownTimerMs);
+    }
+
+    // Evaluates a fix, and returns the transitions it caused
+    std::vector<GeofenceEngine::Transition> evaluate(double latitudeDegrees,
+                                                     double longitudeDegrees,
+                                                     float accuracyMeters = 5,
+                                                     int64_t timestampMs = 0) {
+        std::vector<GeofenceEngine::Transition> transitions;
+        mEngine.evaluate(makeFix(latitudeDegrees, longitudeDegrees, accuracyMeters, timestampMs),
+                         &transitions);
+        return transitions;
+    }
+
+    void expectTransition(const std::vector<GeofenceEngine::Transition>& transitions,
+                          int32_t geofenceId, GeofenceTransition transition) {
+        ASSERT_EQ(1u, transitions.size());
+        EXPECT_EQ(geofenceId, transitions[0].geofenceId);
+        EXPECT_EQ(transition, transitions[0].transition);
+    }
+
+    GeofenceEngine mEngine;
+};
+
+TEST_F(GeofenceEngineTest, EntersAndExits) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::UNCERTAIN));
+
+    expectTransition(evaluate(kLatitude, kLongitude), 1, GeofenceTransition::ENTERED);
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude).empty());
+
+    expectTransition(evaluate(kLatitude + 10 * kMilliDegree, kLongitude), 1,
+                     GeofenceTransition::EXITED);
+    EXPECT_TRUE(evaluate(kLatitude + 10 * kMilliDegree, kLongitude).empty());
+}
+
+TEST_F(GeofenceEngineTest, FindsOutsideGeofencesThroughTheGrid) {
+    // Known to be Outside, so only found by the cells of the fix
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+    EXPECT_TRUE(evaluate(kLatitude + 100 * kMilliDegree, kLongitude).empty());
+
+    expectTransition(evaluate(kLatitude, kLongitude), 1, GeofenceTransition::ENTERED);
+}
+
+TEST_F(GeofenceEngineTest, WrapsAroundTheAntimeridian) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS,
+              mEngine.addGeofence(1, 0.0, 179.9999, kRadiusMeters, GeofenceTransition::EXITED,
+                                  kAllTransitions, kUnknownTimerMs));
+
+    expectTransition(evaluate(0.0, -179.9999), 1, GeofenceTransition::ENTERED);
+}
+
+TEST_F(GeofenceEngineTest, AccuracyCircleMustBeOnOneSide) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+
+    // The center is inside, but the accuracy circle reaches outside
+    EXPECT_TRUE(evaluate(kLatitude + 0.5 * kMilliDegree, kLongitude, 50).empty());
+
+    expectTransition(evaluate(kLatitude + 0.5 * kMilliDegree, kLongitude, 5), 1,
+                     GeofenceTransition::ENTERED);
+}
+
+TEST_F(GeofenceEngineTest, UncertainAfterTheUnknownTimer) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::ENTERED));
+    double boundary = kLatitude + 0.9 * kMilliDegree;
+
+    EXPECT_TRUE(evaluate(boundary, kLongitude, 50, 1000).empty());
+    EXPECT_TRUE(evaluate(boundary, kLongitude, 50, 1000 + kUnknownTimerMs - 1).empty());
+    expectTransition(evaluate(boundary, kLongitude, 50, 1000 + kUnknownTimerMs), 1,
+                     GeofenceTransition::UNCERTAIN);
+    EXPECT_TRUE(evaluate(boundary, kLongitude, 50, 1000 + 2 * kUnknownTimerMs).empty());
+
+    expectTransition(evaluate(kLatitude, kLongitude), 1, GeofenceTransition::ENTERED);
+}
+
+TEST_F(GeofenceEngineTest, ClearFixRestartsTheUnknownTimer) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::ENTERED));
+    double boundary = kLatitude + 0.9 * kMilliDegree;
+
+    EXPECT_TRUE(evaluate(boundary, kLongitude, 50, 0).empty());
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude, 5, kUnknownTimerMs / 2).empty());
+    EXPECT_TRUE(evaluate(boundary, kLongitude, 50, kUnknownTimerMs).empty());
+}
+
+TEST_F(GeofenceEngineTest, ReportsMonitoredTransitionsOnly) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS,
+              add(1, GeofenceTransition::EXITED, static_cast<int32_t>(GeofenceTransition::EXITED)));
+
+    // The state still changes
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude).empty());
+    expectTransition(evaluate(kLatitude + 10 * kMilliDegree, kLongitude), 1,
+                     GeofenceTransition::EXITED);
+}
+
+TEST_F(GeofenceEngineTest, PausedGeofenceTracksItsStateSilently) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, mEngine.pauseGeofence(1));
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude).empty());
+
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, mEngine.resumeGeofence(1, kAllTransitions));
+    // Already Inside, so nothing stale is reported on resume
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude).empty());
+    expectTransition(evaluate(kLatitude + 10 * kMilliDegree, kLongitude), 1,
+                     GeofenceTransition::EXITED);
+}
+
+TEST_F(GeofenceEngineTest, RemovedGeofenceIsNotEvaluated) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, mEngine.removeGeofence(1));
+    EXPECT_TRUE(evaluate(kLatitude, kLongitude).empty());
+
+    // The id can be reused
+    EXPECT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+}
+
+TEST_F(GeofenceEngineTest, RejectsInvalidRequests) {
+    ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS, add(1, GeofenceTransition::EXITED));
+    EXPECT_EQ(GeofenceStatus::ERROR_ID_EXISTS, add(1, GeofenceTransition::EXITED));
+    EXPECT_EQ(GeofenceStatus::ERROR_INVALID_TRANSITION,
+              add(2, GeofenceTransition::EXITED, kAllTransitions << 1));
+    EXPECT_EQ(GeofenceStatus::ERROR_INVALID_TRANSITION, add(2, GeofenceTransition(0)));
+    EXPECT_EQ(GeofenceStatus::ERROR_GENERIC,
+              mEngine.addGeofence(2, 91.0, kLongitude, kRadiusMeters,
+                                  GeofenceTransition::EXITED, kAllTransitions, kUnknownTimerMs));
+    EXPECT_EQ(GeofenceStatus::ERROR_GENERIC,
+              mEngine.addGeofence(2, kLatitude, kLongitude, 0, GeofenceTransition::EXITED,
+                                  kAllTransitions, kUnknownTimerMs));
+
+    EXPECT_EQ(GeofenceStatus::ERROR_ID_UNKNOWN, mEngine.pauseGeofence(2));
+    EXPECT_EQ(GeofenceStatus::ERROR_ID_UNKNOWN, mEngine.resumeGeofence(2, kAllTransitions));
+    EXPECT_EQ(GeofenceStatus::ERROR_ID_UNKNOWN, mEngine.removeGeofence(2));
+}
+
+TEST_F(GeofenceEngineTest, LimitsTheNumberOfGeofences) {
+    for (size_t i = 0; i < GeofenceEngine::kMaxGeofences; i++) {
+        ASSERT_EQ(GeofenceStatus::OPERATION_SUCCESS,
+                  add(static_cast<int32_t>(i), GeofenceTransition::EXITED));
+    }
+    EXPECT_EQ(GeofenceStatus::ERROR_TOO_MANY_GEOFENCES,
+              add(static_cast<int32_t>(GeofenceEngine::kMaxGeofences), GeofenceTransition::EXITED));
+
+    // All of them at the same place
+    EXPECT_EQ(GeofenceEngine::kMaxGeofences, evaluate(kLatitude, kLongitude).size());
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
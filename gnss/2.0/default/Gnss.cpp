@@ -19,7 +19,6 @@
 #include "Gnss.h"
 
 #include <log/log.h>
-#include <utils/SystemClock.h>
 
 #include "AGnss.h"
 #include "AGnssRil.h"
@@ -49,11 +48,48 @@ sp<V1_1::IGnssCallback> Gnss::sGnssCallback_1_1 = nullptr;
 
 namespace {
 
-V2_0::GnssLocation getMockLocationV2_0() {
+hidl_vec<V2_0::IGnssCallback::GnssSvInfo> getMockSvInfoListV2_0() {
+    struct {
+        int16_t svid;
+        V2_0::GnssConstellationType constellation;
+        float cN0DbHz;
+        float elevationDegrees;
+        float azimuthDegrees;
+    } const mockSvs[] = {
+            {3, V2_0::GnssConstellationType::GPS, 32.5, 59.1, 166.5},
+            {5, V2_0::GnssConstellationType::GPS, 27.0, 29.0, 56.5},
+            {17, V2_0::GnssConstellationType::GPS, 30.5, 71.0, 77.0},
+            {26, V2_0::GnssConstellationType::GPS, 24.1, 28.0, 253.0},
+            {5, V2_0::GnssConstellationType::GLONASS, 20.5, 11.5, 116.0},
+            {17, V2_0::GnssConstellationType::GLONASS, 21.5, 28.5, 186.0},
+            {18, V2_0::GnssConstellationType::GLONASS, 28.3, 38.8, 69.0},
+            {10, V2_0::GnssConstellationType::GLONASS, 25.0, 66.0, 247.0}};
+
+    hidl_vec<V2_0::IGnssCallback::GnssSvInfo> svInfoList(sizeof(mockSvs) / sizeof(mockSvs[0]));
+    for (size_t i = 0; i < svInfoList.size(); i++) {
+        // The 1.0 constellation is superseded by the 2.0 one
+        svInfoList[i].v1_0 =
+                Utils::getSvInfo(mockSvs[i].svid, V1_0::GnssConstellationType::UNKNOWN,
+                                 mockSvs[i].cN0DbHz, mockSvs[i].elevationDegrees,
+                                 mockSvs[i].azimuthDegrees);
+        svInfoList[i].constellation = mockSvs[i].constellation;
+    }
+    return svInfoList;
+}
+
+}  // namespace
+
+Gnss::Gnss() : mEpochScheduler(std::make_shared<GnssEpochScheduler>()) {}
+
+Gnss::~Gnss() {
+    stop();
+}
+
+V2_0::GnssLocation Gnss::getMockLocation(const GnssEpochScheduler::Epoch& epoch) {
     const ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
                      ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
+            .timestampNs = static_cast<uint64_t>(epoch.elapsedRealtimeNs),
             // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
             // In an actual implementation provide an estimate of the synchronization uncertainty
             // or don't set the field.
@@ -63,14 +99,6 @@ V2_0::GnssLocation getMockLocationV2_0() {
     return location;
 }
 
-}  // namespace
-
-Gnss::Gnss() : mMinIntervalMs(1000) {}
-
-Gnss::~Gnss() {
-    stop();
-}
-
 // Methods from V1_0::IGnss follow.
 Return<bool> Gnss::setCallback(const sp<V1_0::IGnssCallback>&) {
     // TODO(b/124012850): Implement function.
@@ -78,28 +106,21 @@ Return<bool> Gnss::setCallback(const sp<V1_0::IGnssCallback>&) {
 }
 
 Return<bool> Gnss::start() {
-    if (mIsActive) {
-        ALOGW("Gnss has started. Restarting...");
-        stop();
-    }
-
-    mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            const auto location = getMockLocationV2_0();
-            this->reportLocation(location);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMs));
-        }
-    });
+    // The SV status of an epoch is reported first, as the location is computed from it
+    mEpochScheduler->setListener(GnssEpochScheduler::Stream::SV_STATUS,
+                                 [this](const GnssEpochScheduler::Epoch&) {
+                                     this->reportSvStatus(getMockSvInfoListV2_0());
+                                 });
+    mEpochScheduler->setListener(GnssEpochScheduler::Stream::LOCATION,
+                                 [this](const GnssEpochScheduler::Epoch& epoch) {
+                                     this->reportLocation(getMockLocation(epoch));
+                                 });
     return true;
 }
 
 Return<bool> Gnss::stop() {
-    mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
-    }
+    mEpochScheduler->clearListener(GnssEpochScheduler::Stream::LOCATION);
+    mEpochScheduler->clearListener(GnssEpochScheduler::Stream::SV_STATUS);
     return true;
 }
 
@@ -124,8 +145,9 @@ Return<void> Gnss::deleteAidingData(V1_0::IGnss::GnssAidingData) {
 }
 
 Return<bool> Gnss::setPositionMode(V1_0::IGnss::GnssPositionMode,
-                                   V1_0::IGnss::GnssPositionRecurrence, uint32_t, uint32_t,
-                                   uint32_t) {
+                                   V1_0::IGnss::GnssPositionRecurrence, uint32_t minIntervalMs,
+                                   uint32_t, uint32_t) {
+    mEpochScheduler->setInterval(std::chrono::milliseconds(minIntervalMs));
     return true;
 }
 
@@ -175,8 +197,7 @@ Return<sp<V1_0::IGnssDebug>> Gnss::getExtensionGnssDebug() {
 }
 
 Return<sp<V1_0::IGnssBatching>> Gnss::getExtensionGnssBatching() {
-    // TODO(b/124012850): Implement function.
-    return sp<V1_0::IGnssBatching>{};
+    return new GnssBatching();
 }
 
 // Methods from V1_1::IGnss follow.
@@ -212,8 +233,9 @@ Return<bool> Gnss::setCallback_1_1(const sp<V1_1::IGnssCallback>& callback) {
 }
 
 Return<bool> Gnss::setPositionMode_1_1(V1_0::IGnss::GnssPositionMode,
-                                       V1_0::IGnss::GnssPositionRecurrence, uint32_t, uint32_t,
-                                       uint32_t, bool) {
+                                       V1_0::IGnss::GnssPositionRecurrence,
+                                       uint32_t minIntervalMs, uint32_t, uint32_t, bool) {
+    mEpochScheduler->setInterval(std::chrono::milliseconds(minIntervalMs));
     return true;
 }
 
@@ -224,7 +246,7 @@ Return<sp<V1_1::IGnssConfiguration>> Gnss::getExtensionGnssConfiguration_1_1() {
 
 Return<sp<V1_1::IGnssMeasurement>> Gnss::getExtensionGnssMeasurement_1_1() {
     ALOGD("Gnss::getExtensionGnssMeasurement_1_1");
-    return new GnssMeasurement();
+    return new GnssMeasurement(mEpochScheduler);
 }
 
 Return<bool> Gnss::injectBestLocation(const V1_0::GnssLocation&) {
@@ -252,7 +274,7 @@ Return<sp<V2_0::IAGnssRil>> Gnss::getExtensionAGnssRil_2_0() {
 
 Return<sp<V2_0::IGnssMeasurement>> Gnss::getExtensionGnssMeasurement_2_0() {
     ALOGD("Gnss::getExtensionGnssMeasurement_2_0");
-    return new GnssMeasurement();
+    return new GnssMeasurement(mEpochScheduler);
 }
 
 Return<sp<measurement_corrections::V1_0::IMeasurementCorrections>>
@@ -306,13 +328,24 @@ Return<bool> Gnss::setCallback_2_0(const sp<V2_0::IGnssCallback>& callback) {
 Return<void> Gnss::reportLocation(const V2_0::GnssLocation& location) const {
     std::unique_lock<std::mutex> lock(mMutex);
     if (sGnssCallback_2_0 == nullptr) {
-        ALOGE("%s: sGnssCallback 2.0 is null.", __func__);
+        ALOGV("%s: sGnssCallback 2.0 is null.", __func__);
         return Void();
     }
     sGnssCallback_2_0->gnssLocationCb_2_0(location);
     return Void();
 }
 
+Return<void> Gnss::reportSvStatus(
+        const hidl_vec<V2_0::IGnssCallback::GnssSvInfo>& svInfoList) const {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (sGnssCallback_2_0 == nullptr) {
+        ALOGV("%s: sGnssCallback 2.0 is null.", __func__);
+        return Void();
+    }
+    sGnssCallback_2_0->gnssSvStatusCb_2_0(svInfoList);
+    return Void();
+}
+
 Return<bool> Gnss::injectBestLocation_2_0(const V2_0::GnssLocation&) {
     // TODO(b/124012850): Implement function.
     return bool{};
@@ -20,9 +20,10 @@
 #include <android/hardware/gnss/2.0/IGnss.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
-#include <atomic>
+#include <memory>
 #include <mutex>
-#include <thread>
+
+#include "GnssEpochScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -95,13 +96,16 @@ struct Gnss : public IGnss {
     Return<sp<V2_0::IGnssBatching>> getExtensionGnssBatching_2_0() override;
     Return<bool> injectBestLocation_2_0(const V2_0::GnssLocation& location) override;
 
+    // The mock fix of an epoch, which batching records as well
+    static V2_0::GnssLocation getMockLocation(const GnssEpochScheduler::Epoch& epoch);
+
   private:
     Return<void> reportLocation(const V2_0::GnssLocation&) const;
+    Return<void> reportSvStatus(const hidl_vec<V2_0::IGnssCallback::GnssSvInfo>&) const;
     static sp<V2_0::IGnssCallback> sGnssCallback_2_0;
     static sp<V1_1::IGnssCallback> sGnssCallback_1_1;
-    std::atomic<long> mMinIntervalMs;
-    std::atomic<bool> mIsActive;
-    std::thread mThread;
+    // Shared with the GnssMeasurement extensions, whose measurements come with the locations
+    std::shared_ptr<GnssEpochScheduler> mEpochScheduler;
     mutable std::mutex mMutex;
 };
 
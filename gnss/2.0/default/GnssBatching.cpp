@@ -18,51 +18,142 @@
 
 #include "GnssBatching.h"
 
+#include <log/log.h>
+
+#include <inttypes.h>
+#include <chrono>
+#include <limits>
+
+#include "Gnss.h"
+
 namespace android {
 namespace hardware {
 namespace gnss {
 namespace V2_0 {
 namespace implementation {
 
+using Flag = V1_0::IGnssBatching::Flag;
+
+namespace {
+
+constexpr size_t kFifoCapacity = GnssBatching::kFifoMemoryBytes / sizeof(V2_0::GnssLocation);
+static_assert(kFifoCapacity > 0 && kFifoCapacity <= std::numeric_limits<uint16_t>::max(),
+              "The batch size must fit getBatchSize()");
+
+}  // namespace
+
+constexpr size_t GnssBatching::kFifoMemoryBytes;
+
+sp<V1_0::IGnssBatchingCallback> GnssBatching::sCallback_1_0 = nullptr;
 sp<V2_0::IGnssBatchingCallback> GnssBatching::sCallback = nullptr;
 
+GnssBatching::GnssBatching() : mFifo(kFifoCapacity) {}
+
+GnssBatching::~GnssBatching() {
+    stop();
+}
+
 // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
-Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>&) {
-    // TODO implement
-    return bool{};
+Return<bool> GnssBatching::init(const sp<V1_0::IGnssBatchingCallback>& callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    sCallback_1_0 = callback;
+    sCallback = nullptr;
+    return true;
 }
 
 Return<uint16_t> GnssBatching::getBatchSize() {
-    // TODO implement
-    return uint16_t{};
+    return kFifoCapacity;
 }
 
-Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options&) {
-    // TODO implement
-    return bool{};
+Return<bool> GnssBatching::start(const V1_0::IGnssBatching::Options& options) {
+    if (options.periodNanos <= 0) {
+        ALOGE("%s: Invalid period %" PRId64 " ns", __func__, options.periodNanos);
+        return false;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWakeupOnFifoFull = (options.flags & static_cast<uint8_t>(Flag::WAKEUP_ON_FIFO_FULL)) != 0;
+    }
+    mEpochScheduler.setInterval(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::nanoseconds(options.periodNanos)));
+    mEpochScheduler.setListener(GnssEpochScheduler::Stream::LOCATION,
+                                [this](const GnssEpochScheduler::Epoch& epoch) {
+                                    this->recordLocation(Gnss::getMockLocation(epoch));
+                                });
+    return true;
 }
 
 Return<void> GnssBatching::flush() {
-    // TODO implement
+    std::unique_lock<std::mutex> lock(mMutex);
+    deliverBatchLocked();
     return Void();
 }
 
 Return<bool> GnssBatching::stop() {
-    // TODO implement
-    return bool{};
+    // Not under mMutex, which a location being recorded may be waiting for
+    mEpochScheduler.clearListener(GnssEpochScheduler::Stream::LOCATION);
+    return true;
 }
 
 Return<void> GnssBatching::cleanup() {
-    // TODO implement
+    stop();
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFifoHead = 0;
+    mFifoCount = 0;
+    sCallback_1_0 = nullptr;
+    sCallback = nullptr;
     return Void();
 }
 
 // Methods from V2_0::IGnssBatching follow.
 Return<bool> GnssBatching::init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) {
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = callback;
+    sCallback_1_0 = nullptr;
     return true;
 }
 
+void GnssBatching::recordLocation(const V2_0::GnssLocation& location) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (mFifoCount == mFifo.size()) {
+        if (mWakeupOnFifoFull) {
+            deliverBatchLocked();
+        } else {
+            mFifoHead = (mFifoHead + 1) % mFifo.size();
+            mFifoCount--;
+        }
+    }
+    mFifo[(mFifoHead + mFifoCount) % mFifo.size()] = location;
+    mFifoCount++;
+}
+
+void GnssBatching::deliverBatchLocked() {
+    // The callback is made even for an empty batch, as flush() requires
+    if (sCallback != nullptr) {
+        hidl_vec<V2_0::GnssLocation> locations(mFifoCount);
+        for (size_t i = 0; i < mFifoCount; i++) {
+            locations[i] = mFifo[(mFifoHead + i) % mFifo.size()];
+        }
+        auto ret = sCallback->gnssLocationBatchCb(locations);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    } else if (sCallback_1_0 != nullptr) {
+        hidl_vec<V1_0::GnssLocation> locations(mFifoCount);
+        for (size_t i = 0; i < mFifoCount; i++) {
+            locations[i] = mFifo[(mFifoHead + i) % mFifo.size()].v1_0;
+        }
+        auto ret = sCallback_1_0->gnssLocationBatchCb(locations);
+        if (!ret.isOk()) {
+            ALOGE("%s: Unable to invoke callback", __func__);
+        }
+    } else {
+        ALOGE("%s: No callback, dropping %zu locations", __func__, mFifoCount);
+    }
+    mFifoHead = 0;
+    mFifoCount = 0;
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace gnss
@@ -19,6 +19,10 @@
 #include <android/hardware/gnss/2.0/IGnssBatching.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <mutex>
+#include <vector>
+
+#include "GnssEpochScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -34,7 +38,19 @@ using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
 
+/**
+ * Keeps the batched locations in a FIFO of fixed capacity, allocated once, as the memory of a
+ * receiver would be. The locations are recorded on their own epochs, at the batching period, so
+ * they do not disturb the interval of IGnss::start(). When the FIFO is full the oldest location is
+ * dropped, unless WAKEUP_ON_FIFO_FULL is set, in which case the whole batch is delivered first.
+ */
 struct GnssBatching : public IGnssBatching {
+    // Memory for the FIFO, from which getBatchSize() is derived
+    static constexpr size_t kFifoMemoryBytes = 64 * 1024;
+
+    GnssBatching();
+    ~GnssBatching();
+
     // Methods from ::android::hardware::gnss::V1_0::IGnssBatching follow.
     Return<bool> init(const sp<V1_0::IGnssBatchingCallback>& callback) override;
     Return<uint16_t> getBatchSize() override;
@@ -47,7 +63,22 @@ struct GnssBatching : public IGnssBatching {
     Return<bool> init_2_0(const sp<V2_0::IGnssBatchingCallback>& callback) override;
 
   private:
+    void recordLocation(const V2_0::GnssLocation& location);
+    // Empties the FIFO into a single callback. Called with mMutex held.
+    void deliverBatchLocked();
+
+    static sp<V1_0::IGnssBatchingCallback> sCallback_1_0;
     static sp<IGnssBatchingCallback> sCallback;
+
+    std::mutex mMutex;
+    std::vector<V2_0::GnssLocation> mFifo;
+    // Index of the oldest location, and number of locations, in mFifo
+    size_t mFifoHead = 0;
+    size_t mFifoCount = 0;
+    bool mWakeupOnFifoFull = false;
+
+    // Last, so that its thread is joined before the FIFO it records to is destroyed
+    GnssEpochScheduler mEpochScheduler;
 };
 
 }  // namespace implementation
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GnssEpochScheduler"
+
+#include "GnssEpochScheduler.h"
+
+#include <log/log.h>
+#include <utils/SystemClock.h>
+
+#include <inttypes.h>
+#include <algorithm>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+constexpr std::chrono::milliseconds GnssEpochScheduler::kMinInterval;
+
+GnssEpochScheduler::GnssEpochScheduler() : mInterval(std::chrono::seconds(1)) {}
+
+GnssEpochScheduler::~GnssEpochScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExit = true;
+    }
+    mCondition.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+void GnssEpochScheduler::setInterval(std::chrono::milliseconds interval) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mInterval = std::max(interval, kMinInterval);
+    // Do not wait out the rest of a longer interval
+    mNextEpoch = std::min(mNextEpoch, std::chrono::steady_clock::now() + mInterval);
+    mCondition.notify_one();
+}
+
+void GnssEpochScheduler::setListener(Stream stream, Listener listener) {
+    std::lock_guard<std::mutex> reportLock(mReportLock);
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mListeners.empty()) {
+        mNextEpoch = std::chrono::steady_clock::now();
+    }
+    mListeners[stream] = std::move(listener);
+    if (!mThread.joinable()) {
+        mThread = std::thread(&GnssEpochScheduler::threadLoop, this);
+    }
+    mCondition.notify_one();
+}
+
+void GnssEpochScheduler::clearListener(Stream stream) {
+    std::lock_guard<std::mutex> reportLock(mReportLock);
+    std::lock_guard<std::mutex> lock(mLock);
+    mListeners.erase(stream);
+}
+
+void GnssEpochScheduler::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExit) {
+        if (mListeners.empty()) {
+            mCondition.wait(lock);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now < mNextEpoch) {
+            mCondition.wait_until(lock, mNextEpoch);
+            continue;
+        }
+
+        // Each deadline follows from the previous one, not from the time the epoch is reported.
+        // If reporting fell a whole interval behind, the missed epochs are dropped rather than
+        // reported in a burst.
+        mNextEpoch += mInterval;
+        if (mNextEpoch <= now) {
+            ALOGW("Epoch %" PRIu64 " late, skipping to the next one", mEpochNumber);
+            mNextEpoch = now + mInterval;
+        }
+        const Epoch epoch = {.number = mEpochNumber++,
+                             .elapsedRealtimeNs = ::android::elapsedRealtimeNano()};
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> reportLock(mReportLock);
+            for (const auto& listener : mListeners) {
+                listener.second(epoch);
+            }
+        }
+        lock.lock();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
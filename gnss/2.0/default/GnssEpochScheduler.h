@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
+#define ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace gnss {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * Drives the reports of the receiver, one epoch at a time. For each epoch, all the streams that
+ * are enabled are reported together, in the order of Stream, and with the time of the epoch.
+ * Epochs follow each other at a fixed interval from absolute deadlines, so the time taken to
+ * report an epoch does not delay the next one, which keeps fast modes at their rate.
+ */
+class GnssEpochScheduler {
+  public:
+    enum class Stream { SV_STATUS, LOCATION, MEASUREMENTS };
+
+    struct Epoch {
+        uint64_t number;
+        // elapsedRealtimeNano() at the start of the epoch
+        int64_t elapsedRealtimeNs;
+    };
+
+    using Listener = std::function<void(const Epoch&)>;
+
+    static constexpr std::chrono::milliseconds kMinInterval{10};
+
+    GnssEpochScheduler();
+    ~GnssEpochScheduler();
+
+    // Clamped to kMinInterval. Takes effect from the next epoch.
+    void setInterval(std::chrono::milliseconds interval);
+
+    // Epochs run while at least one stream has a listener. If none had, the first epoch starts
+    // right away, otherwise the stream joins the next one. Must not be called from a listener.
+    void setListener(Stream stream, Listener listener);
+
+    // Once this returns the listener of the stream is no longer running nor called. Must not be
+    // called from a listener.
+    void clearListener(Stream stream);
+
+  private:
+    void threadLoop();
+
+    // Taken before mLock when both are needed. Held while the listeners are called, and to
+    // change them.
+    std::mutex mReportLock;
+    std::map<Stream, Listener> mListeners;
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::chrono::steady_clock::duration mInterval;
+    std::chrono::steady_clock::time_point mNextEpoch;
+    uint64_t mEpochNumber = 0;
+    bool mExit = false;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace gnss
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_GNSS_V2_0_GNSSEPOCHSCHEDULER_H
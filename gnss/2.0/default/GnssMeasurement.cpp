@@ -18,7 +18,6 @@
 #include "GnssMeasurement.h"
 
 #include <log/log.h>
-#include <utils/SystemClock.h>
 
 namespace android {
 namespace hardware {
@@ -32,7 +31,8 @@ using GnssMeasurementState = V2_0::IGnssMeasurementCallback::GnssMeasurementStat
 
 sp<V2_0::IGnssMeasurementCallback> GnssMeasurement::sCallback = nullptr;
 
-GnssMeasurement::GnssMeasurement() : mMinIntervalMillis(1000) {}
+GnssMeasurement::GnssMeasurement(const std::shared_ptr<GnssEpochScheduler>& epochScheduler)
+    : mEpochScheduler(epochScheduler) {}
 
 GnssMeasurement::~GnssMeasurement() {
     stop();
@@ -47,8 +47,9 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 
 Return<void> GnssMeasurement::close() {
     ALOGD("close");
-    std::unique_lock<std::mutex> lock(mMutex);
+    // Not under mMutex, which a measurement being reported may be waiting for
     stop();
+    std::unique_lock<std::mutex> lock(mMutex);
     sCallback = nullptr;
     return Void();
 }
@@ -64,13 +65,14 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallback_2_0(
     const sp<V2_0::IGnssMeasurementCallback>& callback, bool) {
     ALOGD("setCallback_2_0");
-    std::unique_lock<std::mutex> lock(mMutex);
-    sCallback = callback;
-
-    if (mIsActive) {
-        ALOGW("GnssMeasurement callback already set. Resetting the callback...");
-        stop();
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (sCallback != nullptr) {
+            ALOGW("GnssMeasurement callback already set. Resetting the callback...");
+        }
+        sCallback = callback;
     }
+    // Replaces the listener of a previous callback, if any
     start();
 
     return V1_0::IGnssMeasurement::GnssMeasurementStatus::SUCCESS;
@@ -78,26 +80,18 @@ Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> GnssMeasurement::setCallba
 
 void GnssMeasurement::start() {
     ALOGD("start");
-    mIsActive = true;
-    mThread = std::thread([this]() {
-        while (mIsActive == true) {
-            auto measurement = this->getMockMeasurement();
-            this->reportMeasurement(measurement);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(mMinIntervalMillis));
-        }
-    });
+    mEpochScheduler->setListener(GnssEpochScheduler::Stream::MEASUREMENTS,
+                                 [this](const GnssEpochScheduler::Epoch& epoch) {
+                                     this->reportMeasurement(this->getMockMeasurement(epoch));
+                                 });
 }
 
 void GnssMeasurement::stop() {
     ALOGD("stop");
-    mIsActive = false;
-    if (mThread.joinable()) {
-        mThread.join();
-    }
+    mEpochScheduler->clearListener(GnssEpochScheduler::Stream::MEASUREMENTS);
 }
 
-GnssData GnssMeasurement::getMockMeasurement() {
+GnssData GnssMeasurement::getMockMeasurement(const GnssEpochScheduler::Epoch& epoch) {
     V1_0::IGnssMeasurementCallback::GnssMeasurement measurement_1_0 = {
             .flags = (uint32_t)GnssMeasurementFlags::HAS_CARRIER_FREQUENCY,
             .svid = (int16_t)6,
@@ -139,7 +133,7 @@ GnssData GnssMeasurement::getMockMeasurement() {
     ElapsedRealtime timestamp = {
             .flags = ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
                      ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-            .timestampNs = static_cast<uint64_t>(::android::elapsedRealtimeNano()),
+            .timestampNs = static_cast<uint64_t>(epoch.elapsedRealtimeNs),
             // This is an hardcoded value indicating a 1ms of uncertainty between the two clocks.
             // In an actual implementation provide an estimate of the synchronization uncertainty
             // or don't set the field.
@@ -154,7 +148,7 @@ void GnssMeasurement::reportMeasurement(const GnssData& data) {
     ALOGD("reportMeasurement()");
     std::unique_lock<std::mutex> lock(mMutex);
     if (sCallback == nullptr) {
-        ALOGE("%s: GnssMeasurement::sCallback is null.", __func__);
+        ALOGV("%s: GnssMeasurement::sCallback is null.", __func__);
         return;
     }
     sCallback->gnssMeasurementCb_2_0(data);
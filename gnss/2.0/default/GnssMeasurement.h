@@ -20,9 +20,10 @@
 #include <android/hardware/gnss/2.0/IGnssMeasurement.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
-#include <atomic>
+#include <memory>
 #include <mutex>
-#include <thread>
+
+#include "GnssEpochScheduler.h"
 
 namespace android {
 namespace hardware {
@@ -41,7 +42,7 @@ using ::android::hardware::Void;
 using GnssData = V2_0::IGnssMeasurementCallback::GnssData;
 
 struct GnssMeasurement : public IGnssMeasurement {
-    GnssMeasurement();
+    GnssMeasurement(const std::shared_ptr<GnssEpochScheduler>& epochScheduler);
     ~GnssMeasurement();
     // Methods from V1_0::IGnssMeasurement follow.
     Return<V1_0::IGnssMeasurement::GnssMeasurementStatus> setCallback(
@@ -59,13 +60,11 @@ struct GnssMeasurement : public IGnssMeasurement {
    private:
     void start();
     void stop();
-    GnssData getMockMeasurement();
+    GnssData getMockMeasurement(const GnssEpochScheduler::Epoch& epoch);
     void reportMeasurement(const GnssData&);
 
     static sp<IGnssMeasurementCallback> sCallback;
-    std::atomic<long> mMinIntervalMillis;
-    std::atomic<bool> mIsActive;
-    std::thread mThread;
+    const std::shared_ptr<GnssEpochScheduler> mEpochScheduler;
     mutable std::mutex mMutex;
 };
 
@@ -279,8 +279,9 @@ gralloc1_error_t Gralloc1On0Adapter::allocate(
     auto buffer = std::make_shared<Buffer>(handle, backingStore,
             *descriptor, stride, numFlexPlanes, true);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    mBuffers.emplace(handle, std::move(buffer));
+    auto& shard = getBufferShard(handle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.buffers.emplace(handle, std::move(buffer));
 
     return GRALLOC1_ERROR_NONE;
 }
@@ -331,7 +332,7 @@ int32_t Gralloc1On0Adapter::allocateHook(gralloc1_device* device,
 gralloc1_error_t Gralloc1On0Adapter::retain(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    std::lock_guard<std::mutex> lock(getBufferShard(buffer->getHandle()).mutex);
     buffer->retain();
     return GRALLOC1_ERROR_NONE;
 }
@@ -339,12 +340,13 @@ gralloc1_error_t Gralloc1On0Adapter::retain(
 gralloc1_error_t Gralloc1On0Adapter::release(
         const std::shared_ptr<Buffer>& buffer)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    buffer_handle_t handle = buffer->getHandle();
+    auto& shard = getBufferShard(handle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
     if (!buffer->release()) {
         return GRALLOC1_ERROR_NONE;
     }
 
-    buffer_handle_t handle = buffer->getHandle();
     if (buffer->wasAllocated()) {
         ALOGV("Calling free(%p)", handle);
         int result = mDevice->free(mDevice, handle);
@@ -359,7 +361,7 @@ gralloc1_error_t Gralloc1On0Adapter::release(
         }
     }
 
-    mBuffers.erase(handle);
+    shard.buffers.erase(handle);
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -367,10 +369,12 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 {
     ALOGV("retain(%p)", bufferHandle);
 
-    std::lock_guard<std::mutex> lock(mBufferMutex);
+    auto& shard = getBufferShard(bufferHandle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
-    if (mBuffers.count(bufferHandle) != 0) {
-        mBuffers[bufferHandle]->retain();
+    auto existing = shard.buffers.find(bufferHandle);
+    if (existing != shard.buffers.end()) {
+        existing->second->retain();
         return GRALLOC1_ERROR_NONE;
     }
 
@@ -417,7 +421,7 @@ gralloc1_error_t Gralloc1On0Adapter::retain(buffer_handle_t bufferHandle)
 
     auto buffer = std::make_shared<Buffer>(bufferHandle, backingStore,
             descriptor, stride, numFlexPlanes, false);
-    mBuffers.emplace(bufferHandle, std::move(buffer));
+    shard.buffers.emplace(bufferHandle, std::move(buffer));
     return GRALLOC1_ERROR_NONE;
 }
 
@@ -552,12 +556,22 @@ Gralloc1On0Adapter::getDescriptor(gralloc1_buffer_descriptor_t descriptorId)
 std::shared_ptr<Gralloc1On0Adapter::Buffer> Gralloc1On0Adapter::getBuffer(
         buffer_handle_t bufferHandle)
 {
-    std::lock_guard<std::mutex> lock(mBufferMutex);
-    if (mBuffers.count(bufferHandle) == 0) {
+    auto& shard = getBufferShard(bufferHandle);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto buffer = shard.buffers.find(bufferHandle);
+    if (buffer == shard.buffers.end()) {
         return nullptr;
     }
 
-    return mBuffers[bufferHandle];
+    return buffer->second;
+}
+
+Gralloc1On0Adapter::BufferShard& Gralloc1On0Adapter::getBufferShard(
+        buffer_handle_t bufferHandle)
+{
+    // handles are heap allocated, skip the bits that are always aligned
+    auto key = reinterpret_cast<uintptr_t>(bufferHandle) >> 4;
+    return mBufferShards[key % kNumBufferShards];
 }
 
 std::atomic<gralloc1_buffer_descriptor_t>
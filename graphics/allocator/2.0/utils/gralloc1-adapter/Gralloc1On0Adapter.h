@@ -20,6 +20,7 @@
 #include <hardware/gralloc1.h>
 #include <log/log.h>
 
+#include <array>
 #include <atomic>
 #include <memory>
 #include <mutex>
@@ -448,8 +449,16 @@ private:
     std::mutex mDescriptorMutex;
     std::unordered_map<gralloc1_buffer_descriptor_t,
             std::shared_ptr<Descriptor>> mDescriptors;
-    std::mutex mBufferMutex;
-    std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> mBuffers;
+
+    // Buffers are spread over lock-striped shards so that threads working on
+    // different buffers do not contend on a single mutex
+    struct BufferShard {
+        std::mutex mutex;
+        std::unordered_map<buffer_handle_t, std::shared_ptr<Buffer>> buffers;
+    };
+    static constexpr size_t kNumBufferShards = 16;
+    BufferShard& getBufferShard(buffer_handle_t bufferHandle);
+    std::array<BufferShard, kNumBufferShards> mBufferShards;
 };
 
 } // namespace hardware
@@ -96,25 +96,35 @@ class Gralloc1HalImpl : public Hal {
 
         uint32_t stride = 0;
         std::vector<const native_handle_t*> buffers;
-        buffers.reserve(count);
 
-        // allocate the buffers
-        for (uint32_t i = 0; i < count; i++) {
-            const native_handle_t* tmpBuffer;
-            uint32_t tmpStride;
-            error = allocateOneBuffer(desc, &tmpBuffer, &tmpStride);
-            if (error != Error::NONE) {
-                break;
-            }
-
-            buffers.push_back(tmpBuffer);
-
-            if (stride == 0) {
-                stride = tmpStride;
-            } else if (stride != tmpStride) {
-                // non-uniform strides
-                error = Error::UNSUPPORTED;
-                break;
+        // gralloc1 allocates an array of descriptors in one call; fall back to
+        // one call per buffer for devices that cannot
+        error = (count > 1) ? allocateBufferArray(desc, count, &stride, &buffers)
+                            : Error::UNSUPPORTED;
+        if (error == Error::UNSUPPORTED) {
+            error = Error::NONE;
+            stride = 0;
+            buffers.clear();
+            buffers.reserve(count);
+
+            // allocate the buffers
+            for (uint32_t i = 0; i < count; i++) {
+                const native_handle_t* tmpBuffer;
+                uint32_t tmpStride;
+                error = allocateOneBuffer(desc, &tmpBuffer, &tmpStride);
+                if (error != Error::NONE) {
+                    break;
+                }
+
+                buffers.push_back(tmpBuffer);
+
+                if (stride == 0) {
+                    stride = tmpStride;
+                } else if (stride != tmpStride) {
+                    // non-uniform strides
+                    error = Error::UNSUPPORTED;
+                    break;
+                }
             }
         }
 
@@ -310,6 +320,40 @@ class Gralloc1HalImpl : public Hal {
         return toError(error);
     }
 
+    // On failure, no buffer is left allocated.
+    Error allocateBufferArray(gralloc1_buffer_descriptor_t descriptor, uint32_t count,
+                              uint32_t* outStride, std::vector<const native_handle_t*>* outBuffers) {
+        std::vector<gralloc1_buffer_descriptor_t> descriptors(count, descriptor);
+        std::vector<const native_handle_t*> buffers(count, nullptr);
+        int32_t error = mDispatch.allocate(mDevice, count, descriptors.data(), buffers.data());
+        if (error != GRALLOC1_ERROR_NONE && error != GRALLOC1_ERROR_NOT_SHARED) {
+            return toError(error);
+        }
+
+        uint32_t stride = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t tmpStride = 0;
+            error = mDispatch.getStride(mDevice, buffers[i], &tmpStride);
+            if (error != GRALLOC1_ERROR_NONE && error != GRALLOC1_ERROR_UNDEFINED) {
+                freeBuffers(buffers);
+                return toError(error);
+            }
+
+            if (i == 0) {
+                stride = tmpStride;
+            } else if (stride != tmpStride) {
+                // non-uniform strides
+                freeBuffers(buffers);
+                return Error::UNSUPPORTED;
+            }
+        }
+
+        *outStride = stride;
+        *outBuffers = std::move(buffers);
+
+        return Error::NONE;
+    }
+
     Error allocateOneBuffer(gralloc1_buffer_descriptor_t descriptor,
                             const native_handle_t** outBuffer, uint32_t* outStride) {
         const native_handle_t* buffer = nullptr;
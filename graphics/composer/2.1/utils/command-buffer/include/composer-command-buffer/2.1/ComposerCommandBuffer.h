@@ -54,7 +54,8 @@ using CommandQueueType = MessageQueue<uint32_t, kSynchronizedReadWrite>;
 // units of uint32_t's.
 class CommandWriterBase {
    public:
-    CommandWriterBase(uint32_t initialMaxSize) : mDataMaxSize(initialMaxSize) {
+    CommandWriterBase(uint32_t initialMaxSize)
+        : mDataMaxSize(initialMaxSize), mQueueChanged(false) {
         mData = std::make_unique<uint32_t[]>(mDataMaxSize);
         reset();
     }
@@ -76,6 +77,57 @@ class CommandWriterBase {
         mTemporaryHandles.clear();
     }
 
+    // Estimates the size of a frame updating every layer of the given
+    // displays, rectangle lists excluded.  Meant to be passed to reserve.
+    static uint32_t estimateCapacity(uint32_t displayCount, uint32_t layerCount) {
+        constexpr uint32_t kDisplayFrameLength = (1 + 2) +      // selectDisplay
+                                                 (1 + 4) +      // setClientTarget
+                                                 (1 + 3) +      // setOutputBuffer
+                                                 1 + 1 + 1;     // validate, accept, present
+        constexpr uint32_t kLayerFrameLength = (1 + 2) +        // selectLayer
+                                               (1 + 3) +        // setLayerBuffer
+                                               (1 + 4) +        // setLayerSurfaceDamage
+                                               (1 + 1) * 5 +    // blend, color, composition,
+                                                                // dataspace, plane alpha
+                                               (1 + 4) * 2 +    // display frame, source crop
+                                               (1 + 4) +        // setLayerVisibleRegion
+                                               (1 + 1) * 2;     // transform, z-order
+
+        uint64_t capacity = static_cast<uint64_t>(displayCount) * kDisplayFrameLength +
+                            static_cast<uint64_t>(layerCount) * kLayerFrameLength;
+        return static_cast<uint32_t>(
+            std::min<uint64_t>(capacity, std::numeric_limits<uint32_t>::max()));
+    }
+
+    // Makes sure that at least capacity entries can be written without the
+    // buffer or the queue growing.  This is meant to be called between frames,
+    // e.g. when displays or layers are added: the new queue, if any, is
+    // reported through outQueueChanged by the next writeQueue, rather than
+    // being allocated there in the middle of a frame.
+    bool reserve(uint32_t capacity) {
+        if (capacity > mDataMaxSize) {
+            uint32_t newMaxSize = mDataMaxSize << 1;
+            if (newMaxSize < capacity || newMaxSize < mDataMaxSize) {
+                newMaxSize = capacity;
+            }
+            resizeData(newMaxSize);
+        }
+
+        if (mQueue && mDataMaxSize <= mQueue->getQuantumCount()) {
+            return true;
+        }
+
+        auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
+        if (!newQueue->isValid()) {
+            ALOGE("failed to reserve a message queue of %" PRIu32 " entries", mDataMaxSize);
+            return false;
+        }
+
+        mQueue = std::move(newQueue);
+        mQueueChanged = true;
+        return true;
+    }
+
     IComposerClient::Command getCommand(uint32_t offset) {
         uint32_t val = (offset < mDataWritten) ? mData[offset] : 0;
         return static_cast<IComposerClient::Command>(
@@ -115,7 +167,7 @@ class CommandWriterBase {
                 return false;
             }
 
-            *outQueueChanged = false;
+            *outQueueChanged = mQueueChanged;
         } else {
             auto newQueue = std::make_unique<CommandQueueType>(mDataMaxSize);
             if (!newQueue->isValid() || !newQueue->write(mData.get(), mDataWritten)) {
@@ -126,6 +178,7 @@ class CommandWriterBase {
             mQueue = std::move(newQueue);
             *outQueueChanged = true;
         }
+        mQueueChanged = false;
 
         *outCommandLength = mDataWritten;
         outCommandHandles->setToExternal(const_cast<hidl_handle*>(mDataHandles.data()),
@@ -554,6 +607,10 @@ class CommandWriterBase {
             newMaxSize = newWritten;
         }
 
+        resizeData(newMaxSize);
+    }
+
+    void resizeData(uint32_t newMaxSize) {
         auto newData = std::make_unique<uint32_t[]>(newMaxSize);
         std::copy_n(mData.get(), mDataWritten, newData.get());
         mDataMaxSize = newMaxSize;
@@ -568,6 +625,8 @@ class CommandWriterBase {
     std::vector<native_handle_t*> mTemporaryHandles;
 
     std::unique_ptr<CommandQueueType> mQueue;
+    // set when reserve replaced mQueue and the reader has not been told yet
+    bool mQueueChanged;
 };
 
 // This class helps parse a command queue.  Note that all sizes/lengths are in
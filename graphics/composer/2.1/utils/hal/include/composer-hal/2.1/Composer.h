@@ -25,6 +25,7 @@
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <android/hardware/graphics/composer/2.1/IComposer.h>
@@ -74,7 +75,14 @@ class ComposerImpl : public Interface {
     }
 
     Return<void> dumpDebugInfo(IComposer::dumpDebugInfo_cb hidl_cb) override {
-        hidl_cb(mHal->dumpDebugInfo());
+        std::string info = mHal->dumpDebugInfo();
+
+        const auto& importStats = ComposerHandleImporter::getImportStats();
+        info += "Buffer imports: " + std::to_string(importStats.bufferImports.load()) +
+                " imported, " + std::to_string(importStats.bufferFrees.load()) + " freed, " +
+                std::to_string(importStats.lastFrameBufferImports.load()) + " in last frame\n";
+
+        hidl_cb(info);
         return Void();
     }
 
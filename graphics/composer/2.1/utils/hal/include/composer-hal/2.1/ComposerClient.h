@@ -28,6 +28,7 @@
 #include <composer-hal/2.1/ComposerCommandEngine.h>
 #include <composer-hal/2.1/ComposerHal.h>
 #include <composer-hal/2.1/ComposerResources.h>
+#include <composer-hal/2.1/VsyncDispatcher.h>
 #include <log/log.h>
 
 namespace android {
@@ -83,18 +84,39 @@ class ComposerClientImpl : public Interface {
         mOnClientDestroyed = onClientDestroyed;
     }
 
+    // Opts in to dropping the layer setters that would not change the state
+    // last applied to the layer.  Off by default.
+    void setLayerStateCacheEnabled(bool enabled) {
+        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+        mCommandEngine->setLayerStateCacheEnabled(enabled);
+    }
+
+    // number of layer setters dropped by the last executeCommands
+    uint32_t getSuppressedCommandCount() {
+        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+        return mCommandEngine->getSuppressedCommandCount();
+    }
+
     // IComposerClient 2.1 interface
 
     class HalEventCallback : public Hal::EventCallback {
        public:
         HalEventCallback(const sp<IComposerCallback> callback, ComposerResources* resources)
-            : mCallback(callback), mResources(resources) {}
+            : mCallback(callback),
+              mResources(resources),
+              mVsyncDispatcher([this](Display display, int64_t timestamp) {
+                  auto ret = mCallback->onVsync(display, timestamp);
+                  ALOGE_IF(!ret.isOk(), "failed to send onVsync: %s",
+                           ret.description().c_str());
+              }) {}
 
         void onHotplug(Display display, IComposerCallback::Connection connected) {
             if (connected == IComposerCallback::Connection::CONNECTED) {
                 mResources->addPhysicalDisplay(display);
+                mVsyncDispatcher.addDisplay(display);
             } else if (connected == IComposerCallback::Connection::DISCONNECTED) {
                 mResources->removeDisplay(display);
+                mVsyncDispatcher.removeDisplay(display);
             }
 
             auto ret = mCallback->onHotplug(display, connected);
@@ -108,13 +130,14 @@ class ComposerClientImpl : public Interface {
         }
 
         void onVsync(Display display, int64_t timestamp) {
-            auto ret = mCallback->onVsync(display, timestamp);
-            ALOGE_IF(!ret.isOk(), "failed to send onVsync: %s", ret.description().c_str());
+            mVsyncDispatcher.onVsync(display, timestamp);
         }
 
        protected:
         const sp<IComposerCallback> mCallback;
         ComposerResources* const mResources;
+        // Last, so that its threads stop before the rest goes away.
+        VsyncDispatcher mVsyncDispatcher;
     };
 
     Return<void> registerCallback(const sp<IComposerCallback>& callback) override {
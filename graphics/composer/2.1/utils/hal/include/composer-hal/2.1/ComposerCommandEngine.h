@@ -54,6 +54,10 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return Error::BAD_PARAMETER;
         }
 
+        mSuppressedCommandCount = 0;
+        auto& importStats = ComposerHandleImporter::getImportStats();
+        const uint64_t importsBefore = importStats.bufferImports.load(std::memory_order_relaxed);
+
         IComposerClient::Command command;
         uint16_t length = 0;
         while (!isEmpty()) {
@@ -70,6 +74,10 @@ class ComposerCommandEngine : protected CommandReaderBase {
             }
         }
 
+        importStats.lastFrameBufferImports.store(
+            importStats.bufferImports.load(std::memory_order_relaxed) - importsBefore,
+            std::memory_order_relaxed);
+
         if (!isEmpty()) {
             return Error::BAD_PARAMETER;
         }
@@ -81,6 +89,14 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
     const MQDescriptorSync<uint32_t>* getOutputMQDescriptor() { return mWriter.getMQDescriptor(); }
 
+    // When enabled, layer setters that would not change the layer state are
+    // dropped instead of being passed to the HAL.  Only fixed-size states are
+    // cached; buffers, regions and sideband streams are always passed.
+    void setLayerStateCacheEnabled(bool enabled) { mLayerStateCacheEnabled = enabled; }
+
+    // number of layer setters dropped by the last execute
+    uint32_t getSuppressedCommandCount() const { return mSuppressedCommandCount; }
+
     void reset() {
         CommandReaderBase::reset();
         mWriter.reset();
@@ -250,16 +266,18 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
-        std::vector<Layer> changedLayers;
-        std::vector<IComposerClient::Composition> compositionTypes;
+        auto& changedLayers = mScratch.changedLayers;
+        auto& compositionTypes = mScratch.compositionTypes;
         uint32_t displayRequestMask = 0x0;
-        std::vector<Layer> requestedLayers;
-        std::vector<uint32_t> requestMasks;
+        auto& requestedLayers = mScratch.requestedLayers;
+        auto& requestMasks = mScratch.requestMasks;
+        mScratch.clear();
 
         auto err = mHal->validateDisplay(mCurrentDisplay, &changedLayers, &compositionTypes,
                                          &displayRequestMask, &requestedLayers, &requestMasks);
         mResources->setDisplayMustValidateState(mCurrentDisplay, false);
         if (err == Error::NONE) {
+            invalidateCompositionTypes(changedLayers);
             mWriter.setChangedCompositionTypes(changedLayers, compositionTypes);
             mWriter.setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
         } else {
@@ -277,8 +295,9 @@ class ComposerCommandEngine : protected CommandReaderBase {
         // First try to Present as is.
         if (mHal->hasCapability(HWC2_CAPABILITY_SKIP_VALIDATE)) {
             int presentFence = -1;
-            std::vector<Layer> layers;
-            std::vector<int> fences;
+            auto& layers = mScratch.releasedLayers;
+            auto& fences = mScratch.releaseFences;
+            mScratch.clear();
             auto err = mResources->mustValidateDisplay(mCurrentDisplay)
                            ? Error::NOT_VALIDATED
                            : mHal->presentDisplay(mCurrentDisplay, &presentFence, &layers, &fences);
@@ -291,16 +310,18 @@ class ComposerCommandEngine : protected CommandReaderBase {
         }
 
         // Present has failed. We need to fallback to validate
-        std::vector<Layer> changedLayers;
-        std::vector<IComposerClient::Composition> compositionTypes;
+        auto& changedLayers = mScratch.changedLayers;
+        auto& compositionTypes = mScratch.compositionTypes;
         uint32_t displayRequestMask = 0x0;
-        std::vector<Layer> requestedLayers;
-        std::vector<uint32_t> requestMasks;
+        auto& requestedLayers = mScratch.requestedLayers;
+        auto& requestMasks = mScratch.requestMasks;
+        mScratch.clear();
 
         auto err = mHal->validateDisplay(mCurrentDisplay, &changedLayers, &compositionTypes,
                                          &displayRequestMask, &requestedLayers, &requestMasks);
         mResources->setDisplayMustValidateState(mCurrentDisplay, false);
         if (err == Error::NONE) {
+            invalidateCompositionTypes(changedLayers);
             mWriter.setPresentOrValidateResult(0);
             mWriter.setChangedCompositionTypes(changedLayers, compositionTypes);
             mWriter.setDisplayRequests(displayRequestMask, requestedLayers, requestMasks);
@@ -330,8 +351,9 @@ class ComposerCommandEngine : protected CommandReaderBase {
         }
 
         int presentFence = -1;
-        std::vector<Layer> layers;
-        std::vector<int> fences;
+        auto& layers = mScratch.releasedLayers;
+        auto& fences = mScratch.releaseFences;
+        mScratch.clear();
         auto err = mHal->presentDisplay(mCurrentDisplay, &presentFence, &layers, &fences);
         if (err == Error::NONE) {
             mWriter.setPresentFence(presentFence);
@@ -408,8 +430,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::BLEND_MODE, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerBlendMode(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::BLEND_MODE);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -421,8 +448,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::COLOR, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerColor(mCurrentDisplay, mCurrentLayer, readColor());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::COLOR);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -434,8 +466,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::COMPOSITION_TYPE, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerCompositionType(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::COMPOSITION_TYPE);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -447,8 +484,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::DATASPACE, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerDataspace(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::DATASPACE);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -460,8 +502,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::DISPLAY_FRAME, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerDisplayFrame(mCurrentDisplay, mCurrentLayer, readRect());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::DISPLAY_FRAME);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -473,8 +520,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::PLANE_ALPHA, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerPlaneAlpha(mCurrentDisplay, mCurrentLayer, readFloat());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::PLANE_ALPHA);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -507,8 +559,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::SOURCE_CROP, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerSourceCrop(mCurrentDisplay, mCurrentLayer, readFRect());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::SOURCE_CROP);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -520,8 +577,13 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::TRANSFORM, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerTransform(mCurrentDisplay, mCurrentLayer, readSigned());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::TRANSFORM);
             mWriter.setError(getCommandLoc(), err);
         }
 
@@ -548,14 +610,56 @@ class ComposerCommandEngine : protected CommandReaderBase {
             return false;
         }
 
+        if (skipUnchangedLayerState(LayerState::Z_ORDER, length)) {
+            return true;
+        }
+
         auto err = mHal->setLayerZOrder(mCurrentDisplay, mCurrentLayer, read());
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::Z_ORDER);
             mWriter.setError(getCommandLoc(), err);
         }
 
         return true;
     }
 
+    using LayerState = ComposerLayerResource::LayerState;
+
+    // Consumes the current command and returns true when the layer state
+    // cache shows that it would set the state to the value it already has
+    bool skipUnchangedLayerState(LayerState state, uint16_t length) {
+        if (!mLayerStateCacheEnabled) {
+            return false;
+        }
+
+        ComposerLayerResource::LayerStateValue value = {};
+        std::copy_n(&mData[mDataRead], length, value.begin());
+        if (mResources->updateLayerState(mCurrentDisplay, mCurrentLayer, state, value)) {
+            return false;
+        }
+
+        mDataRead += length;
+        mSuppressedCommandCount++;
+        return true;
+    }
+
+    // the value recorded for a failed setter must not suppress its retry
+    void invalidateLayerState(LayerState state) { invalidateLayerState(mCurrentLayer, state); }
+
+    void invalidateLayerState(Layer layer, LayerState state) {
+        if (mLayerStateCacheEnabled) {
+            mResources->invalidateLayerState(mCurrentDisplay, layer, state);
+        }
+    }
+
+    // The HAL changes the composition types it could not handle, so the
+    // value the client sent last is no longer the applied one
+    void invalidateCompositionTypes(const std::vector<Layer>& changedLayers) {
+        for (auto layer : changedLayers) {
+            invalidateLayerState(layer, LayerState::COMPOSITION_TYPE);
+        }
+    }
+
     hwc_rect_t readRect() {
         return hwc_rect_t{
             readSigned(), readSigned(), readSigned(), readSigned(),
@@ -588,6 +692,31 @@ class ComposerCommandEngine : protected CommandReaderBase {
 
     Display mCurrentDisplay = 0;
     Layer mCurrentLayer = 0;
+
+    // Output vectors of validate and present.  Displays are executed one at a
+    // time, so they can all share the same vectors and keep their capacity
+    // from one command to the next.
+    struct PresentationScratch {
+        std::vector<Layer> changedLayers;
+        std::vector<IComposerClient::Composition> compositionTypes;
+        std::vector<Layer> requestedLayers;
+        std::vector<uint32_t> requestMasks;
+        std::vector<Layer> releasedLayers;
+        std::vector<int> releaseFences;
+
+        void clear() {
+            changedLayers.clear();
+            compositionTypes.clear();
+            requestedLayers.clear();
+            requestMasks.clear();
+            releasedLayers.clear();
+            releaseFences.clear();
+        }
+    };
+    PresentationScratch mScratch;
+
+    bool mLayerStateCacheEnabled = false;
+    uint32_t mSuppressedCommandCount = 0;
 };
 
 }  // namespace hal
@@ -20,6 +20,9 @@
 #warning "ComposerResources.h included without LOG_TAG"
 #endif
 
+#include <array>
+#include <atomic>
+#include <bitset>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
@@ -39,6 +42,19 @@ namespace hal {
 // wrapper for IMapper to import buffers and sideband streams
 class ComposerHandleImporter {
    public:
+    // process-wide buffer import counters, reported by dumpDebugInfo
+    struct ImportStats {
+        std::atomic<uint64_t> bufferImports{0};
+        std::atomic<uint64_t> bufferFrees{0};
+        // imports done by the last executeCommands
+        std::atomic<uint32_t> lastFrameBufferImports{0};
+    };
+
+    static ImportStats& getImportStats() {
+        static ImportStats stats;
+        return stats;
+    }
+
     bool init() {
         mMapper3 = mapper::V3_0::IMapper::getService();
         if (mMapper3) {
@@ -82,12 +98,14 @@ class ComposerHandleImporter {
             }
         }
 
+        getImportStats().bufferImports.fetch_add(1, std::memory_order_relaxed);
         *outBufferHandle = bufferHandle;
         return Error::NONE;
     }
 
     void freeBuffer(const native_handle_t* bufferHandle) {
         if (bufferHandle) {
+            getImportStats().bufferFrees.fetch_add(1, std::memory_order_relaxed);
             if (mMapper2) {
                 mMapper2->freeBuffer(
                     static_cast<void*>(const_cast<native_handle_t*>(bufferHandle)));
@@ -229,9 +247,46 @@ class ComposerLayerResource {
                                               outReplacedHandle);
     }
 
+    // layer states whose last applied value can be cached
+    enum class LayerState : uint32_t {
+        BLEND_MODE,
+        COLOR,
+        COMPOSITION_TYPE,
+        DATASPACE,
+        DISPLAY_FRAME,
+        PLANE_ALPHA,
+        SOURCE_CROP,
+        TRANSFORM,
+        Z_ORDER,
+        // composer 2.3; the value is a hash of the command parameters
+        PER_FRAME_METADATA_BLOBS,
+        COUNT,
+    };
+
+    // the command parameters of a layer state, as written to the command queue
+    using LayerStateValue = std::array<uint32_t, 4>;
+
+    // Records value as the last one applied to a layer state.  Returns false
+    // when it is already the recorded value.
+    bool updateState(LayerState state, const LayerStateValue& value) {
+        auto index = static_cast<size_t>(state);
+        if (mStateValid[index] && mStateValues[index] == value) {
+            return false;
+        }
+
+        mStateValues[index] = value;
+        mStateValid[index] = true;
+        return true;
+    }
+
+    void invalidateState(LayerState state) { mStateValid[static_cast<size_t>(state)] = false; }
+
    protected:
     ComposerHandleCache mBufferCache;
     ComposerHandleCache mSidebandStreamCache;
+
+    std::array<LayerStateValue, static_cast<size_t>(LayerState::COUNT)> mStateValues;
+    std::bitset<static_cast<size_t>(LayerState::COUNT)> mStateValid;
 };
 
 // display resource
@@ -277,15 +332,27 @@ class ComposerDisplayResource {
         return result.second;
     }
 
-    bool removeLayer(Layer layer) { return mLayerResources.erase(layer) > 0; }
+    bool removeLayer(Layer layer) {
+        if (mLastLayerResource && mLastLayer == layer) {
+            mLastLayerResource = nullptr;
+        }
+        return mLayerResources.erase(layer) > 0;
+    }
 
     ComposerLayerResource* findLayerResource(Layer layer) {
+        // layer commands come grouped by layer
+        if (mLastLayerResource && mLastLayer == layer) {
+            return mLastLayerResource;
+        }
+
         auto layerIter = mLayerResources.find(layer);
         if (layerIter == mLayerResources.end()) {
             return nullptr;
         }
 
-        return layerIter->second.get();
+        mLastLayer = layer;
+        mLastLayerResource = layerIter->second.get();
+        return mLastLayerResource;
     }
 
     std::vector<Layer> getLayers() const {
@@ -308,6 +375,10 @@ class ComposerDisplayResource {
     bool mMustValidate;
 
     std::unordered_map<Layer, std::unique_ptr<ComposerLayerResource>> mLayerResources;
+
+    // the layer resource found last, to skip the map lookup
+    Layer mLastLayer = 0;
+    ComposerLayerResource* mLastLayerResource = nullptr;
 };
 
 class ComposerResources {
@@ -336,6 +407,7 @@ class ComposerResources {
             removeDisplay(display, displayResource.isVirtual(), displayResource.getLayers());
         }
         mDisplayResources.clear();
+        mLastDisplayResource = nullptr;
     }
 
     Error addPhysicalDisplay(Display display) {
@@ -358,6 +430,9 @@ class ComposerResources {
 
     Error removeDisplay(Display display) {
         std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        if (mLastDisplayResource && mLastDisplay == display) {
+            mLastDisplayResource = nullptr;
+        }
         return mDisplayResources.erase(display) > 0 ? Error::NONE : Error::BAD_DISPLAY;
     }
 
@@ -395,6 +470,25 @@ class ComposerResources {
         return displayResource->removeLayer(layer) ? Error::NONE : Error::BAD_LAYER;
     }
 
+    // Returns false when value is the one last applied to the layer state, in
+    // which case setting it again can be skipped.  Unknown layers always
+    // report a change so that the HAL gets to reject them.
+    bool updateLayerState(Display display, Layer layer, ComposerLayerResource::LayerState state,
+                          const ComposerLayerResource::LayerStateValue& value) {
+        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        ComposerLayerResource* layerResource = findLayerResourceLocked(display, layer);
+        return layerResource ? layerResource->updateState(state, value) : true;
+    }
+
+    void invalidateLayerState(Display display, Layer layer,
+                              ComposerLayerResource::LayerState state) {
+        std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
+        ComposerLayerResource* layerResource = findLayerResourceLocked(display, layer);
+        if (layerResource) {
+            layerResource->invalidateState(state);
+        }
+    }
+
     using ReplacedBufferHandle = ReplacedHandle<true>;
     using ReplacedStreamHandle = ReplacedHandle<false>;
 
@@ -456,11 +550,24 @@ class ComposerResources {
     }
 
     ComposerDisplayResource* findDisplayResourceLocked(Display display) {
+        // commands come grouped by display
+        if (mLastDisplayResource && mLastDisplay == display) {
+            return mLastDisplayResource;
+        }
+
         auto iter = mDisplayResources.find(display);
         if (iter == mDisplayResources.end()) {
             return nullptr;
         }
-        return iter->second.get();
+
+        mLastDisplay = display;
+        mLastDisplayResource = iter->second.get();
+        return mLastDisplayResource;
+    }
+
+    ComposerLayerResource* findLayerResourceLocked(Display display, Layer layer) {
+        ComposerDisplayResource* displayResource = findDisplayResourceLocked(display);
+        return displayResource ? displayResource->findLayerResource(layer) : nullptr;
     }
 
     ComposerHandleImporter mImporter;
@@ -468,6 +575,11 @@ class ComposerResources {
     std::mutex mDisplayResourcesMutex;
     std::unordered_map<Display, std::unique_ptr<ComposerDisplayResource>> mDisplayResources;
 
+    // the display resource found last, to skip the map lookup; guarded by
+    // mDisplayResourcesMutex
+    Display mLastDisplay = 0;
+    ComposerDisplayResource* mLastDisplayResource = nullptr;
+
    private:
     enum class Cache {
         CLIENT_TARGET,
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifndef LOG_TAG
+#warning "VsyncDispatcher.h included without LOG_TAG"
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cinttypes>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <composer-hal/2.1/ComposerHal.h>
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_1 {
+namespace hal {
+
+// VsyncDispatcher takes the vsyncs off the HAL vsync thread. Each vsync is handed to a dispatch
+// thread of its display, at SCHED_FIFO, which delivers it to the client. A slow delivery on one
+// display thus does not delay the others. A vsync arriving while the previous one of its display
+// is still being delivered replaces any vsync waiting behind it.
+//
+// A display has a dispatch thread from its connection to its disconnection, as reported by
+// addDisplay() and removeDisplay(). Vsyncs of other displays are dropped.
+class VsyncDispatcher {
+   public:
+    using Deliver = std::function<void(Display display, int64_t timestamp)>;
+
+    // Same as the SurfaceFlinger main thread.
+    static constexpr int kDispatchPriority = 2;
+
+    explicit VsyncDispatcher(Deliver deliver) : mDeliver(std::move(deliver)) {}
+
+    ~VsyncDispatcher() {
+        std::unordered_map<Display, std::unique_ptr<DisplayState>> displays;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            displays.swap(mDisplays);
+        }
+        for (auto& display : displays) {
+            display.second->stop();
+        }
+    }
+
+    // Starts the dispatch thread of a connected display. Does nothing if the display is already
+    // connected.
+    void addDisplay(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mDisplays.count(display) != 0) {
+            return;
+        }
+
+        auto state = std::make_unique<DisplayState>();
+        state->thread = std::thread(&VsyncDispatcher::threadLoop, this, display, state.get());
+        mDisplays.emplace(display, std::move(state));
+    }
+
+    void onVsync(Display display, int64_t timestamp) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        DisplayState* state = findLocked(display);
+        if (state == nullptr) {
+            ALOGV("vsync of unknown display %" PRIu64, display);
+            return;
+        }
+
+        std::lock_guard<std::mutex> stateLock(state->mutex);
+        if (state->hasPending) {
+            state->replacedCount++;
+        }
+        state->pendingTimestamp = timestamp;
+        state->hasPending = true;
+        state->cond.notify_one();
+    }
+
+    // Stops the dispatch thread of a disconnected display. A vsync being delivered is waited
+    // for.
+    void removeDisplay(Display display) {
+        std::unique_ptr<DisplayState> state;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = mDisplays.find(display);
+            if (it == mDisplays.end()) {
+                return;
+            }
+            state = std::move(it->second);
+            mDisplays.erase(it);
+        }
+        state->stop();
+        ALOGD_IF(state->replacedCount > 0, "display %" PRIu64 ": %" PRIu64 " vsyncs replaced",
+                 display, state->replacedCount);
+    }
+
+   private:
+    struct DisplayState {
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                exit = true;
+            }
+            cond.notify_one();
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        int64_t pendingTimestamp = 0;
+        bool hasPending = false;
+        bool exit = false;
+        uint64_t replacedCount = 0;
+        std::thread thread;
+    };
+
+    DisplayState* findLocked(Display display) {
+        auto it = mDisplays.find(display);
+        return it != mDisplays.end() ? it->second.get() : nullptr;
+    }
+
+    void threadLoop(Display display, DisplayState* state) {
+        struct sched_param param = {0};
+        param.sched_priority = kDispatchPriority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+            ALOGW("failed to set SCHED_FIFO for vsync dispatch of display %" PRIu64, display);
+        }
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        while (!state->exit) {
+            if (!state->hasPending) {
+                state->cond.wait(lock);
+                continue;
+            }
+            int64_t timestamp = state->pendingTimestamp;
+            state->hasPending = false;
+            lock.unlock();
+            mDeliver(display, timestamp);
+            lock.lock();
+        }
+    }
+
+    const Deliver mDeliver;
+    std::mutex mMutex;
+    std::unordered_map<Display, std::unique_ptr<DisplayState>> mDisplays;
+};
+
+}  // namespace hal
+}  // namespace V2_1
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
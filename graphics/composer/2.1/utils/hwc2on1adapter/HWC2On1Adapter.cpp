@@ -25,8 +25,10 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <sstream>
 
 #include <hardware/hwcomposer.h>
@@ -525,7 +527,9 @@ HWC2On1Adapter::Display::Display(HWC2On1Adapter& device, HWC2::DisplayType type)
     mOutputBuffer(),
     mHasColorTransform(false),
     mLayers(),
+    mLayersChanged(true),
     mHwc1LayerMap(),
+    mHwc1RequestedContentsSize(0),
     mNumAvailableRects(0),
     mNextAvailableRect(nullptr),
     mGeometryChanged(false)
@@ -562,7 +566,8 @@ Error HWC2On1Adapter::Display::acceptChanges() {
 Error HWC2On1Adapter::Display::createLayer(hwc2_layer_t* outLayerId) {
     std::unique_lock<std::recursive_mutex> lock(mStateMutex);
 
-    auto layer = *mLayers.emplace(std::make_shared<Layer>(*this));
+    auto layer = std::make_shared<Layer>(*this);
+    insertLayer(layer);
     mDevice.mLayers.emplace(std::make_pair(layer->getId(), layer));
     *outLayerId = layer->getId();
     ALOGV("[%" PRIu64 "] created layer %" PRIu64, mId, *outLayerId);
@@ -581,13 +586,7 @@ Error HWC2On1Adapter::Display::destroyLayer(hwc2_layer_t layerId) {
     }
     const auto layer = mapLayer->second;
     mDevice.mLayers.erase(mapLayer);
-    const auto zRange = mLayers.equal_range(layer);
-    for (auto current = zRange.first; current != zRange.second; ++current) {
-        if (**current == *layer) {
-            current = mLayers.erase(current);
-            break;
-        }
-    }
+    eraseLayer(layer);
     ALOGV("[%" PRIu64 "] destroyed layer %" PRIu64, mId, layerId);
     markGeometryChanged();
     return Error::None;
@@ -1001,28 +1000,19 @@ Error HWC2On1Adapter::Display::updateLayerZ(hwc2_layer_t layerId, uint32_t z) {
     }
 
     const auto layer = mapLayer->second;
-    const auto zRange = mLayers.equal_range(layer);
-    bool layerOnDisplay = false;
-    for (auto current = zRange.first; current != zRange.second; ++current) {
-        if (**current == *layer) {
-            if ((*current)->getZ() == z) {
-                // Don't change anything if the Z hasn't changed
-                return Error::None;
-            }
-            current = mLayers.erase(current);
-            layerOnDisplay = true;
-            break;
-        }
+    if (layer->getZ() == z && findLayer(layer) != mLayers.end()) {
+        // Don't change anything if the Z hasn't changed
+        return Error::None;
     }
 
-    if (!layerOnDisplay) {
+    if (!eraseLayer(layer)) {
         ALOGE("[%" PRIu64 "] updateLayerZ failed to find layer on display",
                 mId);
         return Error::BadLayer;
     }
 
     layer->setZ(z);
-    mLayers.emplace(std::move(layer));
+    insertLayer(layer);
     markGeometryChanged();
 
     return Error::None;
@@ -1214,8 +1204,15 @@ bool HWC2On1Adapter::Display::prepare() {
         return false;
     }
 
-    allocateRequestedContents();
-    assignHwc1LayerIds();
+    // Unless layers were added, removed or reordered, or a layer's visible
+    // region changed size, last frame's contents have the right layout and
+    // only the layers whose state changed need to be translated again.
+    const bool updateOnly = canUpdateRequestedContents();
+    if (!updateOnly) {
+        allocateRequestedContents();
+        assignHwc1LayerIds();
+    }
+    mLayersChanged = false;
 
     mHwc1RequestedContents->retireFenceFd = -1;
     mHwc1RequestedContents->flags = 0;
@@ -1231,6 +1228,10 @@ bool HWC2On1Adapter::Display::prepare() {
         auto& hwc1Layer = mHwc1RequestedContents->hwLayers[layer->getHwc1Id()];
         hwc1Layer.releaseFenceFd = -1;
         hwc1Layer.acquireFenceFd = -1;
+        if (updateOnly && !layer->isDirty()) {
+            layer->applyFrameState(hwc1Layer);
+            continue;
+        }
         ALOGV("Applying states for layer %" PRIu64 " ", layer->getId());
         layer->applyState(hwc1Layer);
     }
@@ -1576,6 +1577,16 @@ hwc_rect_t* HWC2On1Adapter::Display::GetRects(size_t numRects) {
     return rects;
 }
 
+hwc_rect_t* HWC2On1Adapter::Display::getRegionRects(hwc_region_t& region,
+        size_t numRects) {
+    // Rects already allocated to the region are reused in place
+    if (region.rects == nullptr || region.numRects != numRects) {
+        region.rects = GetRects(numRects);
+        region.numRects = region.rects ? numRects : 0;
+    }
+    return const_cast<hwc_rect_t*>(region.rects);
+}
+
 hwc_display_contents_1* HWC2On1Adapter::Display::getDisplayContents() {
     return mHwc1RequestedContents.get();
 }
@@ -1807,12 +1818,60 @@ void HWC2On1Adapter::Display::allocateRequestedContents() {
     size_t size = sizeof(hwc_display_contents_1_t) +
             sizeof(hwc_layer_1_t) * numLayers +
             sizeof(hwc_rect_t) * numRects;
-    auto contents = static_cast<hwc_display_contents_1_t*>(std::calloc(size, 1));
-    mHwc1RequestedContents.reset(contents);
+    // Keep the previous allocation when it is large enough
+    if (!mHwc1RequestedContents || size > mHwc1RequestedContentsSize) {
+        mHwc1RequestedContents.reset(
+                static_cast<hwc_display_contents_1_t*>(std::calloc(size, 1)));
+        mHwc1RequestedContentsSize = size;
+    } else {
+        std::memset(mHwc1RequestedContents.get(), 0, size);
+    }
+    auto contents = mHwc1RequestedContents.get();
     mNextAvailableRect = reinterpret_cast<hwc_rect_t*>(&contents->hwLayers[numLayers]);
     mNumAvailableRects = numRects;
 }
 
+bool HWC2On1Adapter::Display::canUpdateRequestedContents() const {
+    if (!mHwc1RequestedContents || mLayersChanged ||
+            mHwc1RequestedContents->numHwLayers != mLayers.size() + 1) {
+        return false;
+    }
+
+    for (const auto& layer : mLayers) {
+        const auto& hwc1Layer = mHwc1RequestedContents->hwLayers[layer->getHwc1Id()];
+        if (layer->isDirty() &&
+                layer->getNumVisibleRegions() != hwc1Layer.visibleRegionScreen.numRects) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::shared_ptr<HWC2On1Adapter::Layer>>::iterator
+        HWC2On1Adapter::Display::findLayer(const std::shared_ptr<Layer>& layer) {
+    auto zRange = std::equal_range(mLayers.begin(), mLayers.end(), layer,
+            SortLayersByZ());
+    auto current = std::find(zRange.first, zRange.second, layer);
+    return current != zRange.second ? current : mLayers.end();
+}
+
+void HWC2On1Adapter::Display::insertLayer(const std::shared_ptr<Layer>& layer) {
+    // After the layers with the same Z, as std::multiset used to
+    mLayers.insert(std::upper_bound(mLayers.begin(), mLayers.end(), layer,
+            SortLayersByZ()), layer);
+    mLayersChanged = true;
+}
+
+bool HWC2On1Adapter::Display::eraseLayer(const std::shared_ptr<Layer>& layer) {
+    auto current = findLayer(layer);
+    if (current == mLayers.end()) {
+        return false;
+    }
+    mLayers.erase(current);
+    mLayersChanged = true;
+    return true;
+}
+
 void HWC2On1Adapter::Display::assignHwc1LayerIds() {
     mHwc1LayerMap.clear();
     size_t nextHwc1Id = 0;
@@ -1886,8 +1945,7 @@ void HWC2On1Adapter::Display::prepareFramebufferTarget() {
     hwc1Target.displayFrame = {0, 0, width, height};
     hwc1Target.planeAlpha = 255;
 
-    hwc1Target.visibleRegionScreen.numRects = 1;
-    hwc_rect_t* rects = GetRects(1);
+    hwc_rect_t* rects = getRegionRects(hwc1Target.visibleRegionScreen, 1);
     rects[0].left = 0;
     rects[0].top = 0;
     rects[0].right = width;
@@ -1919,7 +1977,8 @@ HWC2On1Adapter::Layer::Layer(Display& display)
     mZ(0),
     mReleaseFence(),
     mHwc1Id(0),
-    mHasUnsupportedPlaneAlpha(false) {}
+    mHasUnsupportedPlaneAlpha(false),
+    mDirty(true) {}
 
 bool HWC2On1Adapter::SortLayersByZ::operator()(const std::shared_ptr<Layer>& lhs,
                                                const std::shared_ptr<Layer>& rhs) const {
@@ -1963,18 +2022,21 @@ Error HWC2On1Adapter::Layer::setSurfaceDamage(hwc_region_t damage) {
 
 Error HWC2On1Adapter::Layer::setBlendMode(BlendMode mode) {
     mBlendMode = mode;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setColor(hwc_color_t color) {
     mColor = color;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setCompositionType(Composition type) {
     mCompositionType = type;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -1985,30 +2047,35 @@ Error HWC2On1Adapter::Layer::setDataspace(android_dataspace_t) {
 
 Error HWC2On1Adapter::Layer::setDisplayFrame(hwc_rect_t frame) {
     mDisplayFrame = frame;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setPlaneAlpha(float alpha) {
     mPlaneAlpha = alpha;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSidebandStream(const native_handle_t* stream) {
     mSidebandStream = stream;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setSourceCrop(hwc_frect_t crop) {
     mSourceCrop = crop;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
 
 Error HWC2On1Adapter::Layer::setTransform(Transform transform) {
     mTransform = transform;
+    mDirty = true;
     mDisplay.markGeometryChanged();
     return Error::None;
 }
@@ -2026,6 +2093,7 @@ Error HWC2On1Adapter::Layer::setVisibleRegion(hwc_region_t visible) {
                     compareRects)) {
         mVisibleRegion.resize(visible.numRects);
         std::copy_n(visible.rects, visible.numRects, mVisibleRegion.begin());
+        mDirty = true;
         mDisplay.markGeometryChanged();
     }
     return Error::None;
@@ -2047,6 +2115,13 @@ const sp<MiniFence>& HWC2On1Adapter::Layer::getReleaseFence() const {
 
 void HWC2On1Adapter::Layer::applyState(hwc_layer_1_t& hwc1Layer) {
     applyCommonState(hwc1Layer);
+    applyFrameState(hwc1Layer);
+    mDirty = false;
+}
+
+void HWC2On1Adapter::Layer::applyFrameState(hwc_layer_1_t& hwc1Layer) {
+    // HWC1 rewrites the hints during prepare
+    hwc1Layer.hints = 0;
     applyCompositionType(hwc1Layer);
     switch (mCompositionType) {
         case Composition::SolidColor : applySolidColorState(hwc1Layer); break;
@@ -2151,10 +2226,8 @@ void HWC2On1Adapter::Layer::applyCommonState(hwc_layer_1_t& hwc1Layer) {
 
     hwc1Layer.transform = static_cast<uint32_t>(mTransform);
 
-    auto& hwc1VisibleRegion = hwc1Layer.visibleRegionScreen;
-    hwc1VisibleRegion.numRects = mVisibleRegion.size();
-    hwc_rect_t* rects = mDisplay.GetRects(hwc1VisibleRegion.numRects);
-    hwc1VisibleRegion.rects = rects;
+    hwc_rect_t* rects = mDisplay.getRegionRects(hwc1Layer.visibleRegionScreen,
+            mVisibleRegion.size());
     for (size_t i = 0; i < mVisibleRegion.size(); i++) {
         rects[i] = mVisibleRegion[i];
     }
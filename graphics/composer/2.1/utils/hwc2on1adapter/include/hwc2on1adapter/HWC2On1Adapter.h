@@ -274,6 +274,10 @@ private:
             // Return a rect from the pool allocated during validate()
             hwc_rect_t* GetRects(size_t numRects);
 
+            // Return numRects rects for region, reusing its current ones
+            // when it already has that many
+            hwc_rect_t* getRegionRects(hwc_region_t& region, size_t numRects);
+
             hwc_display_contents_1* getDisplayContents();
 
             void markGeometryChanged() { mGeometryChanged = true; }
@@ -413,6 +417,16 @@ private:
             // mHwc1RequestedContents.
             void allocateRequestedContents();
 
+            // True if mHwc1RequestedContents can be updated in place, i.e. the
+            // layer list and the rect layout are the same as last frame.
+            bool canUpdateRequestedContents() const;
+
+            // Lookup and sorted insertion/removal in mLayers
+            std::vector<std::shared_ptr<Layer>>::iterator findLayer(
+                    const std::shared_ptr<Layer>& layer);
+            void insertLayer(const std::shared_ptr<Layer>& layer);
+            bool eraseLayer(const std::shared_ptr<Layer>& layer);
+
             // Array of structs exchanged between client and hwc1 device.
             // Sent to device upon calling prepare().
             std::unique_ptr<hwc_display_contents_1> mHwc1RequestedContents;
@@ -442,15 +456,20 @@ private:
 
             bool mHasColorTransform;
 
-            // All layers this Display is aware of.
-            std::multiset<std::shared_ptr<Layer>, SortLayersByZ> mLayers;
+            // All layers this Display is aware of, sorted by Z.
+            std::vector<std::shared_ptr<Layer>> mLayers;
+
+            // True if mLayers changed since the last prepare()
+            bool mLayersChanged;
 
             // Mapping between layer index in array of hwc_display_contents_1*
             // passed to HWC1 during validate/set and Layer object.
             std::unordered_map<size_t, std::shared_ptr<Layer>> mHwc1LayerMap;
 
             // All communication with HWC1 via prepare/set is done with one
-            // alloc. This pointer is pointing to a pool of hwc_rect_t.
+            // alloc, reused while it is large enough. This pointer is pointing
+            // to a pool of hwc_rect_t.
+            size_t mHwc1RequestedContentsSize;
             size_t mNumAvailableRects;
             hwc_rect_t* mNextAvailableRect;
 
@@ -563,6 +582,14 @@ private:
             // Write state to HWC1 communication struct.
             void applyState(struct hwc_layer_1& hwc1Layer);
 
+            // Write only the state that must be sent every frame (buffer,
+            // fences and composition type), for layers that are not dirty.
+            void applyFrameState(struct hwc_layer_1& hwc1Layer);
+
+            // True if the state written by applyState() changed since it was
+            // last applied
+            bool isDirty() const { return mDirty; }
+
             std::string dump() const;
 
             std::size_t getNumVisibleRegions() { return mVisibleRegion.size(); }
@@ -605,6 +632,7 @@ private:
 
             size_t mHwc1Id;
             bool mHasUnsupportedPlaneAlpha;
+            bool mDirty;
     };
 
     // Utility tempate calling a Layer object method based on ID parameters:
@@ -24,6 +24,7 @@
 #include <type_traits>
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <time.h>
 #include <sys/prctl.h>
 #include <unistd.h> // for close
@@ -658,6 +659,7 @@ HWC2OnFbAdapter::HWC2OnFbAdapter(framebuffer_device_t* fbDevice)
     mFbInfo.vsync_period_ns = int(1e9 / mFbDevice->fps);
     mFbInfo.xdpi_scaled = int(mFbDevice->xdpi * 1000.0f);
     mFbInfo.ydpi_scaled = int(mFbDevice->ydpi * 1000.0f);
+    mFbInfo.num_framebuffers = mFbDevice->numFramebuffers;
 
     // Present fences aren't supported, always indicate PresentFenceIsNotReliable
     // for FB devices
@@ -692,6 +694,7 @@ const HWC2OnFbAdapter::Info& HWC2OnFbAdapter::getInfo() const {
 }
 
 void HWC2OnFbAdapter::updateDebugString() {
+    mDebugString.clear();
     if (mFbDevice->common.version >= 1 && mFbDevice->dump) {
         char buffer[4096];
         mFbDevice->dump(mFbDevice, buffer, sizeof(buffer));
@@ -699,6 +702,12 @@ void HWC2OnFbAdapter::updateDebugString() {
 
         mDebugString = buffer;
     }
+
+    char stats[128];
+    snprintf(stats, sizeof(stats),
+             "framebuffers %d, posts %" PRIu64 ", missed vsyncs %" PRIu64 "\n",
+             mFbInfo.num_framebuffers, mPostCount, mMissedVsyncCount);
+    mDebugString += stats;
 }
 
 const std::string& HWC2OnFbAdapter::getDebugString() const {
@@ -781,10 +790,32 @@ void HWC2OnFbAdapter::setBuffer(buffer_handle_t buffer) {
     mBuffer = buffer;
 }
 
+/*
+ * post usually blocks until the vsync that flips the buffer.  We use that to
+ *
+ *  - align VsyncThread to the real vsync, so that SurfaceFlinger wakes up in
+ *    phase with the panel rather than with an arbitrary software clock
+ *  - count the posts that waited for more than one vsync, which means that
+ *    the frame missed its deadline
+ *
+ * Devices whose post returns right away give us no phase information and are
+ * left alone.
+ */
 bool HWC2OnFbAdapter::postBuffer() {
     int error = 0;
     if (mBuffer) {
+        const int64_t period = mFbInfo.vsync_period_ns;
+        const int64_t start = VsyncThread::now();
         error = mFbDevice->post(mFbDevice, mBuffer);
+        const int64_t end = VsyncThread::now();
+
+        mPostCount++;
+        if (error == 0 && end - start > period / 8) {
+            mVsyncThread.updatePhase(end);
+            if (end - start > period + period / 8) {
+                mMissedVsyncCount++;
+            }
+        }
     }
 
     return error == 0;
@@ -870,6 +901,11 @@ void HWC2OnFbAdapter::VsyncThread::enableCallback(bool enable) {
     mCondition.notify_all();
 }
 
+void HWC2OnFbAdapter::VsyncThread::updatePhase(int64_t vsync) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mVsyncHint = vsync;
+}
+
 void HWC2OnFbAdapter::VsyncThread::vsyncLoop() {
     prctl(PR_SET_NAME, "VsyncThread", 0, 0, 0);
 
@@ -905,6 +941,19 @@ void HWC2OnFbAdapter::VsyncThread::vsyncLoop() {
             }
             mNextVsync += mPeriod;
         }
+
+        // move a quarter of the way towards the observed phase so that a
+        // single late post does not make the vsync callbacks jump
+        if (mVsyncHint) {
+            int64_t offset = (mVsyncHint - mNextVsync) % mPeriod;
+            if (offset > mPeriod / 2) {
+                offset -= mPeriod;
+            } else if (offset < -mPeriod / 2) {
+                offset += mPeriod;
+            }
+            mNextVsync += offset / 4;
+            mVsyncHint = 0;
+        }
     }
 }
 
@@ -53,6 +53,7 @@ public:
         int vsync_period_ns;
         int xdpi_scaled;
         int ydpi_scaled;
+        int num_framebuffers;
     };
     const Info& getInfo() const;
 
@@ -95,6 +96,10 @@ private:
 
     buffer_handle_t mBuffer{nullptr};
 
+    // post statistics, see postBuffer
+    uint64_t mPostCount{0};
+    uint64_t mMissedVsyncCount{0};
+
     std::unordered_set<HWC2::Capability> mCapabilities;
 
     class VsyncThread {
@@ -106,6 +111,7 @@ private:
         void stop();
         void setCallback(HWC2_PFN_VSYNC callback, hwc2_callback_data_t data);
         void enableCallback(bool enable);
+        void updatePhase(int64_t vsync);
 
     private:
         void vsyncLoop();
@@ -121,6 +127,8 @@ private:
         HWC2_PFN_VSYNC mCallback{nullptr};
         hwc2_callback_data_t mCallbackData{nullptr};
         bool mCallbackEnabled{false};
+        // a timestamp known to be on a real vsync, 0 when there is none
+        int64_t mVsyncHint{0};
     };
     VsyncThread mVsyncThread;
 };
@@ -76,6 +76,9 @@ class ComposerCommandEngine : public V2_1::hal::ComposerCommandEngine {
             return false;
         }
 
+        // the float color replaces the one recorded by the layer state cache
+        invalidateLayerState(LayerState::COLOR);
+
         auto err = mHal->setLayerFloatColor(mCurrentDisplay, mCurrentLayer, readFloatColor());
         if (err != Error::NONE) {
             mWriter.setError(getCommandLoc(), err);
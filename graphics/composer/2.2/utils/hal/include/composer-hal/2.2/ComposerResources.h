@@ -70,13 +70,13 @@ class ComposerResources : public V2_1::hal::ComposerResources {
 
         std::lock_guard<std::mutex> lock(mDisplayResourcesMutex);
 
-        auto iter = mDisplayResources.find(display);
-        if (iter == mDisplayResources.end()) {
+        auto* baseDisplayResource = findDisplayResourceLocked(display);
+        if (!baseDisplayResource) {
             mImporter.freeBuffer(importedHandle);
             return Error::BAD_DISPLAY;
         }
         ComposerDisplayResource& displayResource =
-            *static_cast<ComposerDisplayResource*>(iter->second.get());
+            *static_cast<ComposerDisplayResource*>(baseDisplayResource);
 
         // update cache
         const native_handle_t* replacedHandle;
@@ -24,6 +24,7 @@
 #include <composer-hal/2.2/ComposerResources.h>
 #include <composer-hal/2.3/ComposerCommandEngine.h>
 #include <composer-hal/2.3/ComposerHal.h>
+#include <composer-hal/2.3/DisplayedContentSampleCache.h>
 
 namespace android {
 namespace hardware {
@@ -38,6 +39,13 @@ namespace detail {
 template <typename Interface, typename Hal>
 class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interface, Hal> {
    public:
+    static std::unique_ptr<ComposerClientImpl> create(Hal* hal) {
+        auto client = std::make_unique<ComposerClientImpl>(hal);
+        return client->init() ? std::move(client) : nullptr;
+    }
+
+    ComposerClientImpl(Hal* hal) : BaseType2_2(hal), mContentSampleCache(hal) {}
+
     Return<void> getPerFrameMetadataKeys_2_3(
         Display display, IComposerClient::getPerFrameMetadataKeys_2_3_cb hidl_cb) override {
         std::vector<IComposerClient::PerFrameMetadataKey> keys;
@@ -135,7 +143,22 @@ class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interfac
         uint64_t display, IComposerClient::DisplayedContentSampling enable,
         hidl_bitfield<IComposerClient::FormatColorComponent> componentMask,
         uint64_t maxFrames) override {
-        return mHal->setDisplayedContentSamplingEnabled(display, enable, componentMask, maxFrames);
+        Error error =
+            mHal->setDisplayedContentSamplingEnabled(display, enable, componentMask, maxFrames);
+        if (error == Error::NONE) {
+            mContentSampleCache.onSamplingEnabled(
+                display, enable == IComposerClient::DisplayedContentSampling::ENABLE, maxFrames);
+        }
+        return error;
+    }
+
+    // Returns in *outFd the shared memory region accumulating the displayed content samples
+    // of a display, laid out as a DisplayedContentSampleRegion. The caller owns the fd. The
+    // region is refreshed by the thread of the cache while sampling is enabled, so that clients
+    // may read it at any rate without calling getDisplayedContentSample.
+    Error getDisplayedContentSampleRegion(Display display, int* outFd) {
+        *outFd = mContentSampleCache.dupRegionFd(display);
+        return *outFd >= 0 ? Error::NONE : Error::NOT_SUPPORTED;
     }
 
     Return<void> getDisplayedContentSample(
@@ -196,6 +219,8 @@ class ComposerClientImpl : public V2_2::hal::detail::ComposerClientImpl<Interfac
     using BaseType2_1::mCommandEngineMutex;
     using BaseType2_1::mHal;
     using BaseType2_1::mResources;
+
+    DisplayedContentSampleCache mContentSampleCache;
 };
 
 }  // namespace detail
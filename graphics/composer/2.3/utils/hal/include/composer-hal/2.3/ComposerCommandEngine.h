@@ -74,10 +74,16 @@ class ComposerCommandEngine : public V2_2::hal::ComposerCommandEngine {
             return false;
         }
 
+        // HDR10+ dynamic metadata is often the same for a whole scene
+        if (skipUnchangedMetadataBlobs(length)) {
+            return true;
+        }
+
         uint32_t numBlobs = read();
         length--;
 
-        std::vector<IComposerClient::PerFrameMetadataBlob> metadata;
+        // blob vectors keep their capacity across frames
+        mMetadataBlobs.resize(numBlobs);
 
         for (size_t i = 0; i < numBlobs; i++) {
             IComposerClient::PerFrameMetadataKey key =
@@ -87,34 +93,71 @@ class ComposerCommandEngine : public V2_2::hal::ComposerCommandEngine {
             length -= 2;
 
             if (length * sizeof(uint32_t) < blobSize) {
+                invalidateLayerState(LayerState::PER_FRAME_METADATA_BLOBS);
                 return false;
             }
 
-            metadata.push_back({key, std::vector<uint8_t>()});
-            IComposerClient::PerFrameMetadataBlob& metadataBlob = metadata.back();
-            metadataBlob.blob.resize(blobSize);
-            readBlob(blobSize, metadataBlob.blob.data());
+            IComposerClient::PerFrameMetadataBlob& metadataBlob = mMetadataBlobs[i];
+            metadataBlob.key = key;
+            const uint8_t* blob = reinterpret_cast<const uint8_t*>(&mData[mDataRead]);
+            metadataBlob.blob.assign(blob, blob + blobSize);
+            skipBlob(blobSize);
+            length -= (blobSize + sizeof(uint32_t) - 1) / sizeof(uint32_t);
         }
-        auto err = mHal->setLayerPerFrameMetadataBlobs(mCurrentDisplay, mCurrentLayer, metadata);
+        auto err =
+            mHal->setLayerPerFrameMetadataBlobs(mCurrentDisplay, mCurrentLayer, mMetadataBlobs);
         if (err != Error::NONE) {
+            invalidateLayerState(LayerState::PER_FRAME_METADATA_BLOBS);
             mWriter.setError(getCommandLoc(), err);
         }
         return true;
     }
 
-    void readBlob(uint32_t size, void* blob) {
-        memcpy(blob, &mData[mDataRead], size);
+    // Like skipUnchangedLayerState, but the blobs are too large to be recorded: their 64-bit
+    // FNV-1a hash, computed in place in the command queue, is recorded instead
+    bool skipUnchangedMetadataBlobs(uint16_t length) {
+        if (!mLayerStateCacheEnabled) {
+            return false;
+        }
+
+        uint64_t hash = 14695981039346656037ull;
+        for (uint16_t i = 0; i < length; i++) {
+            hash = (hash ^ mData[mDataRead + i]) * 1099511628211ull;
+        }
+        V2_1::hal::ComposerLayerResource::LayerStateValue value = {
+            static_cast<uint32_t>(hash), static_cast<uint32_t>(hash >> 32), length, 0};
+        if (mResources->updateLayerState(mCurrentDisplay, mCurrentLayer,
+                                         LayerState::PER_FRAME_METADATA_BLOBS, value)) {
+            return false;
+        }
+
+        mDataRead += length;
+        mSuppressedCommandCount++;
+        return true;
+    }
+
+    void skipBlob(uint32_t size) {
         uint32_t numElements = size / sizeof(uint32_t);
         mDataRead += numElements;
         mDataRead += (size - numElements * sizeof(uint32_t) != 0) ? 1 : 0;
     }
 
+    void readBlob(uint32_t size, void* blob) {
+        memcpy(blob, &mData[mDataRead], size);
+        skipBlob(size);
+    }
+
    private:
     using BaseType2_1 = V2_1::hal::ComposerCommandEngine;
+    using BaseType2_1::mLayerStateCacheEnabled;
+    using BaseType2_1::mResources;
+    using BaseType2_1::mSuppressedCommandCount;
     using BaseType2_1::mWriter;
     using BaseType2_2 = V2_2::hal::ComposerCommandEngine;
 
     ComposerHal* mHal;
+    // reused by every SET_LAYER_PER_FRAME_METADATA_BLOBS command
+    std::vector<IComposerClient::PerFrameMetadataBlob> mMetadataBlobs;
 };
 
 }  // namespace hal
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#ifndef LOG_TAG
+#warning "DisplayedContentSampleCache.h included without LOG_TAG"
+#endif
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <composer-hal/2.3/ComposerHal.h>
+#include <cutils/ashmem.h>
+#include <log/log.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace composer {
+namespace V2_3 {
+namespace hal {
+
+// Layout of the shared memory region of a display with displayed content sampling enabled.
+//
+// The region is published as a seqlock: sequence is odd while the cache writes the region. A
+// reader copies what it needs between two acquire loads of sequence, and retries when they
+// differ or are odd. It never blocks the cache, nor queries the HAL.
+struct DisplayedContentSampleRegion {
+    static constexpr uint32_t kComponentCount = 4;
+    static constexpr uint32_t kMaxBuckets = 256;
+
+    std::atomic<uint32_t> sequence;
+    // Number of valid buckets of each histogram, at most kMaxBuckets.
+    uint32_t bucketCount;
+    // CLOCK_MONOTONIC time of the last refresh, in nanoseconds.
+    uint64_t timestamp;
+    // Number of frames in the window and since sampling was enabled.
+    uint64_t windowFrameCount;
+    uint64_t totalFrameCount;
+    // Histograms over the last maxFrames frames, as passed to
+    // setDisplayedContentSamplingEnabled, or over all frames when maxFrames is 0. The window
+    // slides by whole refreshes, so it may hold a few frames more than maxFrames.
+    uint64_t windowSamples[kComponentCount][kMaxBuckets];
+    // Histograms since sampling was enabled. They only grow, so a client needing deltas
+    // subtracts two snapshots.
+    uint64_t totalSamples[kComponentCount][kMaxBuckets];
+};
+
+// DisplayedContentSampleCache keeps the displayed content histograms of the displays with
+// sampling enabled in a DisplayedContentSampleRegion each. Its own thread, started when sampling
+// is first enabled, queries the HAL every kRefreshInterval for the frames posted since the
+// previous refresh, and accumulates them into the window and total histograms. The refreshes
+// are thus off the frame path, and do not hold the command engine lock.
+class DisplayedContentSampleCache {
+   public:
+    static constexpr std::chrono::milliseconds kRefreshInterval{100};
+
+    DisplayedContentSampleCache(ComposerHal* hal) : mHal(hal) {}
+
+    ~DisplayedContentSampleCache() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mCondition.notify_all();
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    // Sets up or drops the region of a display after the HAL accepted
+    // setDisplayedContentSamplingEnabled. A display re-enabled keeps its region, with the
+    // histograms cleared, so that the clients mapping it carry on.
+    void onSamplingEnabled(Display display, bool enabled, uint64_t maxFrames) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!enabled) {
+            mDisplays.erase(display);
+            return;
+        }
+
+        auto it = mDisplays.find(display);
+        if (it == mDisplays.end()) {
+            auto state = std::make_unique<DisplayState>();
+            if (!state->map()) {
+                return;
+            }
+            it = mDisplays.emplace(display, std::move(state)).first;
+            if (!mThread.joinable()) {
+                mThread = std::thread([this] { refreshLoop(); });
+            }
+            mCondition.notify_all();
+        }
+
+        DisplayState& state = *it->second;
+        state.maxFrames = maxFrames;
+        state.windowFrameCount = 0;
+        state.window.clear();
+        state.lastRefresh = now();
+        beginWrite(state.region);
+        state.region->bucketCount = 0;
+        state.region->timestamp = state.lastRefresh;
+        state.region->windowFrameCount = 0;
+        state.region->totalFrameCount = 0;
+        std::memset(state.region->windowSamples, 0, sizeof(state.region->windowSamples));
+        std::memset(state.region->totalSamples, 0, sizeof(state.region->totalSamples));
+        endWrite(state.region);
+    }
+
+    // Returns a duplicate of the region fd of a display, owned by the caller, or -1 when
+    // sampling is not enabled on the display.
+    int dupRegionFd(Display display) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mDisplays.find(display);
+        if (it == mDisplays.end()) {
+            return -1;
+        }
+        return dup(it->second->fd);
+    }
+
+   protected:
+    // Refreshes the displays due every kRefreshInterval, and sleeps while no display has
+    // sampling enabled.
+    void refreshLoop() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping) {
+            if (mDisplays.empty()) {
+                mCondition.wait(lock);
+                continue;
+            }
+            mCondition.wait_for(lock, kRefreshInterval);
+            if (!mStopping) {
+                refreshDueLocked();
+            }
+        }
+    }
+
+    void refreshDueLocked() {
+        uint64_t timestamp = now();
+        for (auto it = mDisplays.begin(); it != mDisplays.end();) {
+            DisplayState& state = *it->second;
+            if (timestamp - state.lastRefresh >= kRefreshIntervalNs &&
+                refreshLocked(it->first, &state, timestamp) == Error::BAD_DISPLAY) {
+                // The display is gone; its clients see the last refresh.
+                it = mDisplays.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static constexpr uint64_t kRefreshIntervalNs =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(kRefreshInterval).count();
+    static constexpr size_t kMaxWindowDeltas = 64;
+
+    // Histograms of the frames posted between two refreshes.
+    struct Delta {
+        uint64_t frameCount;
+        std::vector<uint64_t> samples[DisplayedContentSampleRegion::kComponentCount];
+    };
+
+    struct DisplayState {
+        ~DisplayState() {
+            if (region != nullptr) {
+                munmap(region, sizeof(DisplayedContentSampleRegion));
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        bool map() {
+            fd = ashmem_create_region("composer-content-sample",
+                                      sizeof(DisplayedContentSampleRegion));
+            if (fd < 0) {
+                ALOGE("failed to create displayed content sample region");
+                return false;
+            }
+            void* addr = mmap(nullptr, sizeof(DisplayedContentSampleRegion),
+                              PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                ALOGE("failed to map displayed content sample region");
+                return false;
+            }
+            // ashmem regions are zero-filled, which is a valid empty region.
+            region = static_cast<DisplayedContentSampleRegion*>(addr);
+            return true;
+        }
+
+        int fd = -1;
+        DisplayedContentSampleRegion* region = nullptr;
+        uint64_t maxFrames = 0;
+        uint64_t lastRefresh = 0;
+        uint64_t windowFrameCount = 0;
+        std::deque<Delta> window;
+    };
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    static void beginWrite(DisplayedContentSampleRegion* region) {
+        region->sequence.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void endWrite(DisplayedContentSampleRegion* region) {
+        region->sequence.fetch_add(1, std::memory_order_release);
+    }
+
+    Error refreshLocked(Display display, DisplayState* state, uint64_t timestamp) {
+        Delta delta;
+        hidl_vec<uint64_t> samples[DisplayedContentSampleRegion::kComponentCount];
+        Error error = mHal->getDisplayedContentSample(display, 0, state->lastRefresh,
+                                                      delta.frameCount, samples[0], samples[1],
+                                                      samples[2], samples[3]);
+        if (error != Error::NONE) {
+            ALOGW("failed to sample displayed content of display %" PRIu64 ": %d", display,
+                  static_cast<int32_t>(error));
+            return error;
+        }
+        state->lastRefresh = timestamp;
+
+        DisplayedContentSampleRegion* region = state->region;
+        uint32_t bucketCount = 0;
+        for (uint32_t c = 0; c < DisplayedContentSampleRegion::kComponentCount; c++) {
+            size_t count =
+                std::min<size_t>(samples[c].size(), DisplayedContentSampleRegion::kMaxBuckets);
+            delta.samples[c].assign(samples[c].data(), samples[c].data() + count);
+            bucketCount = std::max(bucketCount, static_cast<uint32_t>(count));
+        }
+
+        beginWrite(region);
+        region->timestamp = timestamp;
+        region->bucketCount = std::max(region->bucketCount, bucketCount);
+        region->totalFrameCount += delta.frameCount;
+        addSamples(region->totalSamples, delta, 1);
+        addSamples(region->windowSamples, delta, 1);
+        state->windowFrameCount += delta.frameCount;
+        // Drop the oldest refreshes as long as the rest still cover the window.
+        if (state->maxFrames != 0) {
+            while (!state->window.empty() &&
+                   state->windowFrameCount - state->window.front().frameCount >=
+                       state->maxFrames) {
+                addSamples(region->windowSamples, state->window.front(), -1);
+                state->windowFrameCount -= state->window.front().frameCount;
+                state->window.pop_front();
+            }
+        }
+        region->windowFrameCount = state->windowFrameCount;
+        endWrite(region);
+
+        // With no window limit, the window is the total; there is nothing to slide.
+        if (state->maxFrames != 0 && delta.frameCount != 0) {
+            state->window.push_back(std::move(delta));
+            // Bound the memory of long windows by merging the two oldest refreshes, which
+            // only makes the window slide by larger steps.
+            if (state->window.size() > kMaxWindowDeltas) {
+                Delta& oldest = state->window[0];
+                Delta& next = state->window[1];
+                next.frameCount += oldest.frameCount;
+                for (uint32_t c = 0; c < DisplayedContentSampleRegion::kComponentCount; c++) {
+                    if (next.samples[c].size() < oldest.samples[c].size()) {
+                        next.samples[c].resize(oldest.samples[c].size(), 0);
+                    }
+                    for (size_t i = 0; i < oldest.samples[c].size(); i++) {
+                        next.samples[c][i] += oldest.samples[c][i];
+                    }
+                }
+                state->window.pop_front();
+            }
+        }
+        return Error::NONE;
+    }
+
+    static void addSamples(uint64_t (*histograms)[DisplayedContentSampleRegion::kMaxBuckets],
+                           const Delta& delta, int sign) {
+        for (uint32_t c = 0; c < DisplayedContentSampleRegion::kComponentCount; c++) {
+            for (size_t i = 0; i < delta.samples[c].size(); i++) {
+                if (sign > 0) {
+                    histograms[c][i] += delta.samples[c][i];
+                } else {
+                    histograms[c][i] -= delta.samples[c][i];
+                }
+            }
+        }
+    }
+
+    ComposerHal* const mHal;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mStopping = false;
+    std::unordered_map<Display, std::unique_ptr<DisplayState>> mDisplays;
+    // Started by the first display with sampling enabled, and joined on destruction
+    std::thread mThread;
+};
+
+}  // namespace hal
+}  // namespace V2_3
+}  // namespace composer
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GraphicsBufferHalBenchmark"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <android/hardware/graphics/allocator/2.0/IAllocator.h>
+#include <android/hardware/graphics/mapper/2.0/IMapper.h>
+#include <android/hardware/graphics/mapper/2.1/IMapper.h>
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+#include <hal-metrics/Metrics.h>
+
+namespace android {
+namespace hardware {
+namespace graphics {
+namespace mapper {
+namespace V2_0 {
+
+namespace {
+
+using android::hardware::graphics::allocator::V2_0::IAllocator;
+using android::hardware::graphics::common::V1_0::BufferUsage;
+using android::hardware::graphics::common::V1_0::PixelFormat;
+
+constexpr uint64_t kCpuUsage =
+        static_cast<uint64_t>(BufferUsage::CPU_READ_OFTEN | BufferUsage::CPU_WRITE_OFTEN);
+
+// Buffer sizes to allocate, from a cursor to a 4K frame
+constexpr int kSizes[][2] = {{64, 64}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+constexpr PixelFormat kFormats[] = {PixelFormat::RGBA_8888, PixelFormat::YCBCR_420_888};
+
+constexpr int kMaxThreads = 8;
+
+// Keeps the latency of every timed operation to report percentiles, which the
+// mean reported by the benchmark library hides
+class LatencyRecorder {
+   public:
+    template <typename Op>
+    void time(benchmark::State& state, Op op) {
+        auto start = std::chrono::steady_clock::now();
+        op();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        state.SetIterationTime(std::chrono::duration<double>(elapsed).count());
+        mLatencies.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    // Percentiles are computed per thread and averaged over the threads
+    void report(benchmark::State& state) {
+        if (mLatencies.empty()) {
+            return;
+        }
+
+        std::sort(mLatencies.begin(), mLatencies.end());
+        state.counters["p50_ns"] = benchmark::Counter(metrics::percentile(mLatencies, 50),
+                                                      benchmark::Counter::kAvgThreads);
+        state.counters["p99_ns"] = benchmark::Counter(metrics::percentile(mLatencies, 99),
+                                                      benchmark::Counter::kAvgThreads);
+    }
+
+   private:
+    std::vector<int64_t> mLatencies;
+};
+
+// Thin wrapper over the default IAllocator and IMapper services.  Unlike the
+// VTS one, it does not assert, so that failures can be reported as benchmark
+// errors.
+class Gralloc {
+   public:
+    static Gralloc& get() {
+        static Gralloc gralloc;
+        return gralloc;
+    }
+
+    bool isValid() const { return mAllocator != nullptr && mMapper != nullptr; }
+
+    const char* getMapperVersion() const { return mMapper2_1 ? "mapper 2.1" : "mapper 2.0"; }
+
+    bool createDescriptor(const IMapper::BufferDescriptorInfo& info,
+                          BufferDescriptor* outDescriptor) {
+        Error error = Error::NO_RESOURCES;
+        mMapper->createDescriptor(info, [&](const auto& tmpError, const auto& tmpDescriptor) {
+            error = tmpError;
+            *outDescriptor = tmpDescriptor;
+        });
+        return error == Error::NONE;
+    }
+
+    // Returns a raw handle owned by the caller, see freeRawBuffer
+    native_handle_t* allocate(const BufferDescriptor& descriptor) {
+        native_handle_t* rawHandle = nullptr;
+        mAllocator->allocate(descriptor, 1,
+                             [&](const auto& error, const auto& /* stride */, const auto& buffers) {
+                                 if (error == Error::NONE && buffers.size() == 1) {
+                                     rawHandle = native_handle_clone(buffers[0].getNativeHandle());
+                                 }
+                             });
+        return rawHandle;
+    }
+
+    void freeRawBuffer(native_handle_t* rawHandle) {
+        native_handle_close(rawHandle);
+        native_handle_delete(rawHandle);
+    }
+
+    void* importBuffer(const native_handle_t* rawHandle) {
+        void* buffer = nullptr;
+        mMapper->importBuffer(rawHandle, [&](const auto& error, const auto& tmpBuffer) {
+            if (error == Error::NONE) {
+                buffer = tmpBuffer;
+            }
+        });
+        return buffer;
+    }
+
+    void freeBuffer(void* buffer) { mMapper->freeBuffer(buffer); }
+
+    bool lock(void* buffer, const IMapper::Rect& region) {
+        Error error = Error::NO_RESOURCES;
+        mMapper->lock(buffer, kCpuUsage, region, hidl_handle(),
+                      [&](const auto& tmpError, const auto& /* data */) { error = tmpError; });
+        return error == Error::NONE;
+    }
+
+    bool lockYCbCr(void* buffer, const IMapper::Rect& region) {
+        Error error = Error::NO_RESOURCES;
+        mMapper->lockYCbCr(buffer, kCpuUsage, region, hidl_handle(),
+                           [&](const auto& tmpError, const auto& /* layout */) { error = tmpError; });
+        return error == Error::NONE;
+    }
+
+    bool unlock(void* buffer) {
+        Error error = Error::NO_RESOURCES;
+        mMapper->unlock(buffer, [&](const auto& tmpError, const auto& /* releaseFence */) {
+            error = tmpError;
+        });
+        return error == Error::NONE;
+    }
+
+   private:
+    Gralloc() : mAllocator(IAllocator::getService()), mMapper(IMapper::getService()) {
+        if (mMapper != nullptr) {
+            mMapper2_1 = V2_1::IMapper::castFrom(mMapper);
+        }
+    }
+
+    sp<IAllocator> mAllocator;
+    sp<IMapper> mMapper;
+    sp<V2_1::IMapper> mMapper2_1;
+};
+
+IMapper::BufferDescriptorInfo makeInfo(int width, int height, PixelFormat format) {
+    IMapper::BufferDescriptorInfo info;
+    info.width = width;
+    info.height = height;
+    info.layerCount = 1;
+    info.format = format;
+    info.usage = kCpuUsage;
+    return info;
+}
+
+// A buffer allocated and imported for the whole run of a benchmark thread
+class ImportedBuffer {
+   public:
+    ImportedBuffer(Gralloc& gralloc, const IMapper::BufferDescriptorInfo& info)
+        : mGralloc(gralloc) {
+        BufferDescriptor descriptor;
+        if (gralloc.createDescriptor(info, &descriptor)) {
+            mRawHandle = gralloc.allocate(descriptor);
+        }
+        if (mRawHandle) {
+            mBuffer = gralloc.importBuffer(mRawHandle);
+        }
+    }
+
+    ~ImportedBuffer() {
+        if (mBuffer) {
+            mGralloc.freeBuffer(mBuffer);
+        }
+        if (mRawHandle) {
+            mGralloc.freeRawBuffer(mRawHandle);
+        }
+    }
+
+    const native_handle_t* getRawHandle() const { return mRawHandle; }
+    void* getBuffer() const { return mBuffer; }
+
+   private:
+    Gralloc& mGralloc;
+    native_handle_t* mRawHandle = nullptr;
+    void* mBuffer = nullptr;
+};
+
+Gralloc* getGralloc(benchmark::State& state) {
+    auto& gralloc = Gralloc::get();
+    if (!gralloc.isValid()) {
+        state.SkipWithError("allocator or mapper service unavailable");
+        return nullptr;
+    }
+    state.SetLabel(gralloc.getMapperVersion());
+    return &gralloc;
+}
+
+void SizesAndFormats(benchmark::internal::Benchmark* b) {
+    for (auto format : kFormats) {
+        for (const auto& size : kSizes) {
+            b->Args({size[0], size[1], static_cast<int>(format)});
+        }
+    }
+}
+
+// Args: width, height, format
+void BM_IAllocator_allocate(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    BufferDescriptor descriptor;
+    auto info = makeInfo(state.range(0), state.range(1), static_cast<PixelFormat>(state.range(2)));
+    if (!gralloc->createDescriptor(info, &descriptor)) {
+        state.SkipWithError("createDescriptor failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        native_handle_t* rawHandle = nullptr;
+        recorder.time(state, [&] { rawHandle = gralloc->allocate(descriptor); });
+        if (!rawHandle) {
+            state.SkipWithError("allocate failed");
+            break;
+        }
+        gralloc->freeRawBuffer(rawHandle);
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IAllocator_allocate)
+        ->Apply(SizesAndFormats)
+        ->ThreadRange(1, kMaxThreads)
+        ->UseManualTime();
+
+void BM_IMapper_importBuffer(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    ImportedBuffer source(*gralloc, makeInfo(1920, 1080, PixelFormat::RGBA_8888));
+    if (!source.getRawHandle()) {
+        state.SkipWithError("allocate failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        void* buffer = nullptr;
+        recorder.time(state, [&] { buffer = gralloc->importBuffer(source.getRawHandle()); });
+        if (!buffer) {
+            state.SkipWithError("importBuffer failed");
+            break;
+        }
+        gralloc->freeBuffer(buffer);
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IMapper_importBuffer)->ThreadRange(1, kMaxThreads)->UseManualTime();
+
+void BM_IMapper_freeBuffer(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    ImportedBuffer source(*gralloc, makeInfo(1920, 1080, PixelFormat::RGBA_8888));
+    if (!source.getRawHandle()) {
+        state.SkipWithError("allocate failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        void* buffer = gralloc->importBuffer(source.getRawHandle());
+        if (!buffer) {
+            state.SkipWithError("importBuffer failed");
+            break;
+        }
+        recorder.time(state, [&] { gralloc->freeBuffer(buffer); });
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IMapper_freeBuffer)->ThreadRange(1, kMaxThreads)->UseManualTime();
+
+// Args: width, height, format
+void BM_IMapper_lock(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    const IMapper::Rect region = {0, 0, static_cast<int32_t>(state.range(0)),
+                                  static_cast<int32_t>(state.range(1))};
+    ImportedBuffer buffer(*gralloc, makeInfo(state.range(0), state.range(1), PixelFormat::RGBA_8888));
+    if (!buffer.getBuffer()) {
+        state.SkipWithError("allocate or importBuffer failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        bool locked = false;
+        recorder.time(state, [&] { locked = gralloc->lock(buffer.getBuffer(), region); });
+        if (!locked) {
+            state.SkipWithError("lock failed");
+            break;
+        }
+        gralloc->unlock(buffer.getBuffer());
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IMapper_lock)
+        ->Args({1920, 1080})
+        ->Args({3840, 2160})
+        ->ThreadRange(1, kMaxThreads)
+        ->UseManualTime();
+
+// Args: width, height
+void BM_IMapper_lockYCbCr(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    const IMapper::Rect region = {0, 0, static_cast<int32_t>(state.range(0)),
+                                  static_cast<int32_t>(state.range(1))};
+    ImportedBuffer buffer(*gralloc,
+                          makeInfo(state.range(0), state.range(1), PixelFormat::YCBCR_420_888));
+    if (!buffer.getBuffer()) {
+        state.SkipWithError("allocate or importBuffer failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        bool locked = false;
+        recorder.time(state, [&] { locked = gralloc->lockYCbCr(buffer.getBuffer(), region); });
+        if (!locked) {
+            state.SkipWithError("lockYCbCr failed");
+            break;
+        }
+        gralloc->unlock(buffer.getBuffer());
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IMapper_lockYCbCr)
+        ->Args({1920, 1080})
+        ->Args({3840, 2160})
+        ->ThreadRange(1, kMaxThreads)
+        ->UseManualTime();
+
+// Args: width, height
+void BM_IMapper_unlock(benchmark::State& state) {
+    auto gralloc = getGralloc(state);
+    if (!gralloc) {
+        return;
+    }
+
+    const IMapper::Rect region = {0, 0, static_cast<int32_t>(state.range(0)),
+                                  static_cast<int32_t>(state.range(1))};
+    ImportedBuffer buffer(*gralloc, makeInfo(state.range(0), state.range(1), PixelFormat::RGBA_8888));
+    if (!buffer.getBuffer()) {
+        state.SkipWithError("allocate or importBuffer failed");
+        return;
+    }
+
+    LatencyRecorder recorder;
+    for (auto _ : state) {
+        if (!gralloc->lock(buffer.getBuffer(), region)) {
+            state.SkipWithError("lock failed");
+            break;
+        }
+        recorder.time(state, [&] { gralloc->unlock(buffer.getBuffer()); });
+    }
+    recorder.report(state);
+}
+BENCHMARK(BM_IMapper_unlock)
+        ->Args({1920, 1080})
+        ->Args({3840, 2160})
+        ->ThreadRange(1, kMaxThreads)
+        ->UseManualTime();
+
+}  // namespace
+
+}  // namespace V2_0
+}  // namespace mapper
+}  // namespace graphics
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
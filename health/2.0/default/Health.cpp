@@ -22,7 +22,8 @@
 #include <hal_conversion.h>
 #include <hidl/HidlTransportSupport.h>
 
-extern void healthd_battery_update_internal(bool);
+extern void healthd_battery_update_internal(bool, const struct android::BatteryProperties&);
+extern void healthd_dump_wake_stats(int fd);
 
 namespace android {
 namespace hardware {
@@ -151,24 +152,22 @@ Return<Result> Health::update() {
     bool chargerOnline = battery_monitor_->update();
 
     // adjust uevent / wakealarm periods
-    healthd_battery_update_internal(chargerOnline);
+    healthd_battery_update_internal(chargerOnline, getBatteryProperties(battery_monitor_.get()));
 
     return Result::SUCCESS;
 }
 
 Return<Result> Health::updateAndNotify(const sp<IHealthInfoCallback>& callback) {
     std::lock_guard<decltype(callbacks_lock_)> lock(callbacks_lock_);
-    std::vector<sp<IHealthInfoCallback>> storedCallbacks{std::move(callbacks_)};
-    callbacks_.clear();
-    if (callback != nullptr) {
-        callbacks_.push_back(callback);
-    }
+    notify_only_target_ = true;
+    notify_target_ = callback;
     Return<Result> result = update();
-    callbacks_ = std::move(storedCallbacks);
+    notify_only_target_ = false;
+    notify_target_ = nullptr;
     return result;
 }
 
-void Health::notifyListeners(HealthInfo* healthInfo) {
+void Health::fillExtendedInfo(HealthInfo* healthInfo) {
     std::vector<StorageInfo> info;
     get_storage_info(info);
 
@@ -186,8 +185,33 @@ void Health::notifyListeners(HealthInfo* healthInfo) {
     healthInfo->batteryCurrentAverage = currentAvg;
     healthInfo->diskStats = stats;
     healthInfo->storageInfos = info;
+}
+
+void Health::getFreshSnapshot(HealthInfo* info) {
+    using android::hardware::health::V1_0::hal_conversion::convertToHealthInfo;
+
+    // update() normally stores the snapshot through notifyListeners(). The battery is only read
+    // here when it did not, e.g. when healthd_mode_ops are not set up.
+    snapshot_.getFresh(
+            info, [this] { updateAndNotify(nullptr); },
+            [this](HealthInfo* healthInfo) {
+                struct android::BatteryProperties p = getBatteryProperties(battery_monitor_.get());
+                convertToHealthInfo(&p, healthInfo->legacy);
+                fillExtendedInfo(healthInfo);
+            });
+}
+
+void Health::notifyListeners(HealthInfo* healthInfo) {
+    fillExtendedInfo(healthInfo);
+    snapshot_.store(*healthInfo);
 
     std::lock_guard<decltype(callbacks_lock_)> lock(callbacks_lock_);
+    if (notify_only_target_) {
+        if (notify_target_ != nullptr) {
+            (void)notify_target_->healthInfoChanged(*healthInfo).isOk();  // ignore errors
+        }
+        return;
+    }
     for (auto it = callbacks_.begin(); it != callbacks_.end();) {
         auto ret = (*it)->healthInfoChanged(*healthInfo);
         if (!ret.isOk() && ret.isDeadObject()) {
@@ -202,6 +226,7 @@ Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
         battery_monitor_->dumpState(fd);
+        healthd_dump_wake_stats(fd);
 
         getHealthInfo([fd](auto res, const auto& info) {
             android::base::WriteStringToFd("\ngetHealthInfo -> ", fd);
@@ -219,10 +244,10 @@ Return<void> Health::debug(const hidl_handle& handle, const hidl_vec<hidl_string
 }
 
 Return<void> Health::getStorageInfo(getStorageInfo_cb _hidl_cb) {
-    std::vector<struct StorageInfo> info;
-    get_storage_info(info);
-    hidl_vec<struct StorageInfo> info_vec(info);
-    if (!info.size()) {
+    HealthInfo healthInfo;
+    getFreshSnapshot(&healthInfo);
+    const hidl_vec<struct StorageInfo>& info_vec = healthInfo.storageInfos;
+    if (!info_vec.size()) {
         _hidl_cb(Result::NOT_SUPPORTED, info_vec);
     } else {
         _hidl_cb(Result::SUCCESS, info_vec);
@@ -231,10 +256,10 @@ Return<void> Health::getStorageInfo(getStorageInfo_cb _hidl_cb) {
 }
 
 Return<void> Health::getDiskStats(getDiskStats_cb _hidl_cb) {
-    std::vector<struct DiskStats> stats;
-    get_disk_stats(stats);
-    hidl_vec<struct DiskStats> stats_vec(stats);
-    if (!stats.size()) {
+    HealthInfo healthInfo;
+    getFreshSnapshot(&healthInfo);
+    const hidl_vec<struct DiskStats>& stats_vec = healthInfo.diskStats;
+    if (!stats_vec.size()) {
         _hidl_cb(Result::NOT_SUPPORTED, stats_vec);
     } else {
         _hidl_cb(Result::SUCCESS, stats_vec);
@@ -243,34 +268,8 @@ Return<void> Health::getDiskStats(getDiskStats_cb _hidl_cb) {
 }
 
 Return<void> Health::getHealthInfo(getHealthInfo_cb _hidl_cb) {
-    using android::hardware::health::V1_0::hal_conversion::convertToHealthInfo;
-
-    updateAndNotify(nullptr);
-    struct android::BatteryProperties p = getBatteryProperties(battery_monitor_.get());
-
-    V1_0::HealthInfo batteryInfo;
-    convertToHealthInfo(&p, batteryInfo);
-
-    std::vector<StorageInfo> info;
-    get_storage_info(info);
-
-    std::vector<DiskStats> stats;
-    get_disk_stats(stats);
-
-    int32_t currentAvg = 0;
-
-    struct BatteryProperty prop;
-    status_t ret = battery_monitor_->getProperty(BATTERY_PROP_CURRENT_AVG, &prop);
-    if (ret == OK) {
-        currentAvg = static_cast<int32_t>(prop.valueInt64);
-    }
-
-    V2_0::HealthInfo healthInfo = {};
-    healthInfo.legacy = std::move(batteryInfo);
-    healthInfo.batteryCurrentAverage = currentAvg;
-    healthInfo.diskStats = stats;
-    healthInfo.storageInfos = info;
-
+    HealthInfo healthInfo;
+    getFreshSnapshot(&healthInfo);
     _hidl_cb(Result::SUCCESS, healthInfo);
     return Void();
 }
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <health2/HealthInfoCache.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace implementation {
+
+void HealthInfoCache::store(const HealthInfo& info) {
+    std::lock_guard<decltype(lock_)> lock(lock_);
+    info_ = info;
+    time_ = std::chrono::steady_clock::now();
+    valid_ = true;
+}
+
+bool HealthInfoCache::get(HealthInfo* info) {
+    std::lock_guard<decltype(lock_)> lock(lock_);
+    if (!valid_ || std::chrono::steady_clock::now() - time_ >= ttl_) {
+        return false;
+    }
+    *info = info_;
+    return true;
+}
+
+void HealthInfoCache::getFresh(HealthInfo* info, const std::function<void()>& update,
+                               const std::function<void(HealthInfo*)>& read) {
+    if (get(info)) return;
+
+    std::lock_guard<decltype(refresh_lock_)> lock(refresh_lock_);
+    // Another caller may have refreshed the snapshot while we were waiting.
+    if (get(info)) return;
+
+    update();
+    if (get(info)) return;
+
+    HealthInfo healthInfo = {};
+    read(&healthInfo);
+    store(healthInfo);
+    *info = std::move(healthInfo);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -24,15 +24,19 @@
 #include <cutils/klog.h>
 #include <cutils/uevent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 #include <utils/Errors.h>
 
+#include <mutex>
+
 #include <health2/Health.h>
 
 using namespace android;
@@ -42,6 +46,16 @@ using namespace android;
 // Periodic chores fast interval in seconds
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_SLOW (60 * 10)
 
+// Each periodic chore whose readings are stable doubles the wake interval, up to this many times.
+#define ADAPTIVE_MAX_BACKOFF_SHIFT 2
+// Readings count as changing once the battery temperature moves by at least this many tenths of
+// a degree Celsius per minute, or the battery current by at least this many percent.
+#define ADAPTIVE_TEMPERATURE_RATE_THRESHOLD 10
+#define ADAPTIVE_CURRENT_CHANGE_PERCENT 20
+// Near these thresholds the fast interval is always used (tenths of a degree Celsius, percent).
+#define ADAPTIVE_HOT_TEMPERATURE 450
+#define ADAPTIVE_LOW_CAPACITY 15
+
 static struct healthd_config healthd_config = {
     .periodic_chores_interval_fast = DEFAULT_PERIODIC_CHORES_INTERVAL_FAST,
     .periodic_chores_interval_slow = DEFAULT_PERIODIC_CHORES_INTERVAL_SLOW,
@@ -70,11 +84,32 @@ static int epollfd;
 static int uevent_fd;
 static int wakealarm_fd;
 
+// Guards the wake intervals, the adaptive scheduler state and the wake statistics below, which
+// Health::update() also reaches from binder threads.
+static std::mutex wake_interval_lock;
+
 // -1 for no epoll timeout
 static int awake_poll_interval = -1;
 
 static int wakealarm_wake_interval = DEFAULT_PERIODIC_CHORES_INTERVAL_FAST;
 
+// Set while the main loop runs its periodic chores, which are the only updates sampled by the
+// adaptive scheduler. Updates requested over binder or by uevents come at arbitrary times, so
+// they would make the readings look stable or changing regardless of the battery.
+static thread_local bool in_periodic_chores = false;
+
+// Last readings used by the adaptive scheduler, and the number of consecutive stable updates.
+static bool adaptive_have_sample = false;
+static int64_t adaptive_sample_time_ms;
+static int adaptive_sample_temperature;
+static int adaptive_sample_current;
+static int adaptive_stable_count = 0;
+
+// Wake statistics reported by healthd_dump_wake_stats().
+static uint64_t wakealarm_wakeups = 0;
+static uint64_t awake_poll_wakeups = 0;
+static uint64_t uevent_updates = 0;
+
 using ::android::hardware::health::V2_0::implementation::Health;
 
 struct healthd_mode_ops* healthd_mode_ops = nullptr;
@@ -114,13 +149,70 @@ static void wakealarm_set_interval(int interval) {
         KLOG_ERROR(LOG_TAG, "wakealarm_set_interval: timerfd_settime failed\n");
 }
 
-void healthd_battery_update_internal(bool charger_online) {
+static int64_t boottime_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Returns true if the readings in props moved noticeably since the previous sample.
+// Called with wake_interval_lock held.
+static bool adaptive_readings_changed(const struct android::BatteryProperties& props) {
+    int64_t now = boottime_ms();
+    bool changed = true;
+
+    if (adaptive_have_sample) {
+        int64_t elapsed_ms = now - adaptive_sample_time_ms;
+        int64_t temperature_delta = abs(props.batteryTemperature - adaptive_sample_temperature);
+        int64_t current_delta = abs(props.batteryCurrent - adaptive_sample_current);
+        int64_t current_base = abs(adaptive_sample_current);
+
+        bool temperature_changed =
+            elapsed_ms <= 0 ||
+            temperature_delta * 60 * 1000 >= ADAPTIVE_TEMPERATURE_RATE_THRESHOLD * elapsed_ms;
+        bool current_changed =
+            current_delta * 100 > current_base * ADAPTIVE_CURRENT_CHANGE_PERCENT;
+        changed = temperature_changed || current_changed;
+    }
+
+    adaptive_have_sample = true;
+    adaptive_sample_time_ms = now;
+    adaptive_sample_temperature = props.batteryTemperature;
+    adaptive_sample_current = props.batteryCurrent;
+    return changed;
+}
+
+void healthd_battery_update_internal(bool charger_online,
+                                     const struct android::BatteryProperties& props) {
     // Fast wake interval when on charger (watch for overheat);
     // slow wake interval when on battery (watch for drained battery).
 
     int new_wake_interval = charger_online ? healthd_config.periodic_chores_interval_fast
                                            : healthd_config.periodic_chores_interval_slow;
 
+    std::lock_guard<std::mutex> lock(wake_interval_lock);
+
+    // Back off while the battery current and temperature are stable, and return to the base
+    // interval as soon as they change. Near the hot and low battery thresholds, use the fast
+    // interval regardless of the charger state.
+    bool near_threshold = props.batteryTemperature >= ADAPTIVE_HOT_TEMPERATURE ||
+                          props.batteryLevel <= ADAPTIVE_LOW_CAPACITY;
+    if (near_threshold) {
+        adaptive_stable_count = 0;
+    } else if (in_periodic_chores) {
+        if (adaptive_readings_changed(props)) {
+            adaptive_stable_count = 0;
+        } else if (adaptive_stable_count < ADAPTIVE_MAX_BACKOFF_SHIFT) {
+            adaptive_stable_count++;
+        }
+    }
+
+    if (near_threshold && healthd_config.periodic_chores_interval_fast != -1) {
+        new_wake_interval = healthd_config.periodic_chores_interval_fast;
+    } else if (new_wake_interval != -1) {
+        new_wake_interval <<= adaptive_stable_count;
+    }
+
     if (new_wake_interval != wakealarm_wake_interval) wakealarm_set_interval(new_wake_interval);
 
     // During awake periods poll at fast rate.  If wake alarm is set at fast
@@ -136,39 +228,64 @@ void healthd_battery_update_internal(bool charger_online) {
                                   : healthd_config.periodic_chores_interval_fast * 1000;
 }
 
+void healthd_dump_wake_stats(int fd) {
+    std::lock_guard<std::mutex> lock(wake_interval_lock);
+    dprintf(fd,
+            "wake alarm: interval %ds, %" PRIu64 " wakeups; awake polls: %" PRIu64
+            "; power_supply uevent updates: %" PRIu64 "; stable updates: %d\n",
+            wakealarm_wake_interval, wakealarm_wakeups, awake_poll_wakeups, uevent_updates,
+            adaptive_stable_count);
+}
+
 static void healthd_battery_update(void) {
     Health::getImplementation()->update();
 }
 
 static void periodic_chores() {
+    in_periodic_chores = true;
     healthd_battery_update();
+    in_periodic_chores = false;
 }
 
 #define UEVENT_MSG_LEN 2048
-static void uevent_event(uint32_t /*epevents*/) {
-    char msg[UEVENT_MSG_LEN + 2];
+static bool uevent_is_power_supply(char* msg, int n) {
     char* cp;
-    int n;
 
-    n = uevent_kernel_multicast_recv(uevent_fd, msg, UEVENT_MSG_LEN);
-    if (n <= 0) return;
     if (n >= UEVENT_MSG_LEN) /* overflow -- discard */
-        return;
+        return false;
 
     msg[n] = '\0';
     msg[n + 1] = '\0';
     cp = msg;
 
     while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) {
-            healthd_battery_update();
-            break;
-        }
+        if (!strcmp(cp, "SUBSYSTEM=" POWER_SUPPLY_SUBSYSTEM)) return true;
 
         /* advance to after the next \0 */
         while (*cp++)
             ;
     }
+    return false;
+}
+
+static void uevent_event(uint32_t /*epevents*/) {
+    char msg[UEVENT_MSG_LEN + 2];
+    bool power_supply_changed = false;
+    int n;
+
+    // Drain every uevent queued on the (non-blocking) socket so that a burst of power_supply
+    // uevents results in a single update and a single round of callbacks.
+    while ((n = uevent_kernel_multicast_recv(uevent_fd, msg, UEVENT_MSG_LEN)) > 0) {
+        if (uevent_is_power_supply(msg, n)) power_supply_changed = true;
+    }
+
+    if (power_supply_changed) {
+        {
+            std::lock_guard<std::mutex> lock(wake_interval_lock);
+            uevent_updates++;
+        }
+        healthd_battery_update();
+    }
 }
 
 static void uevent_init(void) {
@@ -192,6 +309,10 @@ static void wakealarm_event(uint32_t /*epevents*/) {
         return;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(wake_interval_lock);
+        wakealarm_wakeups += wakeups;
+    }
     periodic_chores();
 }
 
@@ -212,9 +333,14 @@ static void healthd_mainloop(void) {
     int nevents = 0;
     while (1) {
         struct epoll_event events[eventct];
-        int timeout = awake_poll_interval;
+        int timeout;
         int mode_timeout;
 
+        {
+            std::lock_guard<std::mutex> lock(wake_interval_lock);
+            timeout = awake_poll_interval;
+        }
+
         /* Don't wait for first timer timeout to run periodic chores */
         if (!nevents) periodic_chores();
 
@@ -228,6 +354,10 @@ static void healthd_mainloop(void) {
             KLOG_ERROR(LOG_TAG, "healthd_mainloop: epoll_wait failed\n");
             break;
         }
+        if (nevents == 0) {
+            std::lock_guard<std::mutex> lock(wake_interval_lock);
+            awake_poll_wakeups++;
+        }
 
         for (int n = 0; n < nevents; ++n) {
             if (events[n].data.ptr) (*(void (*)(int))events[n].data.ptr)(events[n].events);
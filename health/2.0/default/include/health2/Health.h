@@ -1,11 +1,14 @@
 #ifndef ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 #define ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_H
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include <android/hardware/health/1.0/types.h>
 #include <android/hardware/health/2.0/IHealth.h>
+#include <health2/HealthInfoCache.h>
 #include <healthd/BatteryMonitor.h>
 #include <hidl/Status.h>
 
@@ -57,14 +60,28 @@ struct Health : public IHealth, hidl_death_recipient {
     void serviceDied(uint64_t cookie, const wp<IBase>& /* who */) override;
 
    private:
+    // How long a snapshot serves the get* calls before the next one reads sysfs again.
+    static constexpr std::chrono::milliseconds kSnapshotTtl{500};
+
     static sp<Health> instance_;
 
     std::recursive_mutex callbacks_lock_;
     std::vector<sp<IHealthInfoCallback>> callbacks_;
+    // While notify_only_target_ is set, notifyListeners() only notifies notify_target_.
+    // Guarded by callbacks_lock_.
+    bool notify_only_target_ = false;
+    sp<IHealthInfoCallback> notify_target_;
     std::unique_ptr<BatteryMonitor> battery_monitor_;
 
+    HealthInfoCache snapshot_{kSnapshotTtl};
+
     bool unregisterCallbackInternal(const sp<IBase>& cb);
 
+    // Reads the fields of HealthInfo that BatteryMonitor does not report.
+    void fillExtendedInfo(HealthInfo* info);
+    // Returns the last snapshot, refreshing it first if it is stale.
+    void getFreshSnapshot(HealthInfo* info);
+
     // update() and only notify the given callback, but none of the other callbacks.
     // If cb is null, do not notify any callback at all.
     Return<Result> updateAndNotify(const sp<IHealthInfoCallback>& cb);
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_INFO_CACHE_H
+#define ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_INFO_CACHE_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include <android/hardware/health/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace implementation {
+
+// The last HealthInfo read, which serves the get* calls for ttl before sysfs is read again.
+class HealthInfoCache {
+   public:
+    explicit HealthInfoCache(std::chrono::milliseconds ttl) : ttl_(ttl) {}
+
+    void store(const HealthInfo& info);
+    // Returns false if there is no snapshot younger than ttl.
+    bool get(HealthInfo* info);
+    // Returns the last snapshot, refreshing it first if it is stale. The refresh calls update,
+    // which is expected to store() what it reads, and only calls read if update did not.
+    // Concurrent callers wait for a single refresh.
+    void getFresh(HealthInfo* info, const std::function<void()>& update,
+                  const std::function<void(HealthInfo*)>& read);
+
+   private:
+    const std::chrono::milliseconds ttl_;
+
+    // Held by the caller that refreshes a stale snapshot, so that concurrent callers wait for
+    // its read rather than reading too. Taken before lock_.
+    std::mutex refresh_lock_;
+    std::mutex lock_;
+    bool valid_ = false;
+    std::chrono::steady_clock::time_point time_;
+    HealthInfo info_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_HEALTH_V2_0_HEALTH_INFO_CACHE_H
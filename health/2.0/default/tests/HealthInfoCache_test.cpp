@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <health2/HealthInfoCache.h>
+
+namespace android {
+namespace hardware {
+namespace health {
+namespace V2_0 {
+namespace implementation {
+namespace {
+
+constexpr std::chrono::milliseconds kLongTtl(60000);
+
+HealthInfo makeInfo(int32_t capacity) {
+    HealthInfo info = {};
+    info.legacy.batteryLevel = capacity;
+    return info;
+}
+
+// Counts the refreshes, which read the given capacity. The update either stores it in the
+// cache itself, as Health::update() does through notifyListeners(), or leaves it to the read.
+class Refresher {
+   public:
+    Refresher(HealthInfoCache* cache, bool updateStores)
+        : cache_(cache), updateStores_(updateStores) {}
+
+    int32_t getFresh(int32_t capacity) {
+        HealthInfo info;
+        cache_->getFresh(
+                &info,
+                [&] {
+                    updates++;
+                    if (updateStores_) cache_->store(makeInfo(capacity));
+                },
+                [&](HealthInfo* readInfo) {
+                    reads++;
+                    *readInfo = makeInfo(capacity);
+                });
+        return info.legacy.batteryLevel;
+    }
+
+    std::atomic<int> updates{0};
+    std::atomic<int> reads{0};
+
+   private:
+    HealthInfoCache* cache_;
+    bool updateStores_;
+};
+
+TEST(HealthInfoCacheTest, ReusesWhatTheUpdateStored) {
+    HealthInfoCache cache(kLongTtl);
+    Refresher refresher(&cache, true /* updateStores */);
+
+    EXPECT_EQ(50, refresher.getFresh(50));
+    EXPECT_EQ(1, refresher.updates);
+    EXPECT_EQ(0, refresher.reads);
+}
+
+TEST(HealthInfoCacheTest, ReadsWhenTheUpdateStoredNothing) {
+    HealthInfoCache cache(kLongTtl);
+    Refresher refresher(&cache, false /* updateStores */);
+
+    EXPECT_EQ(50, refresher.getFresh(50));
+    EXPECT_EQ(1, refresher.updates);
+    EXPECT_EQ(1, refresher.reads);
+
+    // What was read is cached too
+    HealthInfo info;
+    ASSERT_TRUE(cache.get(&info));
+    EXPECT_EQ(50, info.legacy.batteryLevel);
+}
+
+TEST(HealthInfoCacheTest, ServesTheSnapshotUntilItIsStale) {
+    const std::chrono::milliseconds ttl(100);
+    HealthInfoCache cache(ttl);
+    Refresher refresher(&cache, true /* updateStores */);
+
+    EXPECT_EQ(50, refresher.getFresh(50));
+    EXPECT_EQ(50, refresher.getFresh(49));
+    EXPECT_EQ(1, refresher.updates);
+
+    std::this_thread::sleep_for(ttl);
+    EXPECT_EQ(48, refresher.getFresh(48));
+    EXPECT_EQ(2, refresher.updates);
+}
+
+TEST(HealthInfoCacheTest, StoredInfoIsServedWithoutARefresh) {
+    HealthInfoCache cache(kLongTtl);
+    HealthInfo info;
+    EXPECT_FALSE(cache.get(&info));
+
+    // As notifyListeners() does on a uevent
+    cache.store(makeInfo(70));
+    Refresher refresher(&cache, true /* updateStores */);
+    EXPECT_EQ(70, refresher.getFresh(10));
+    EXPECT_EQ(0, refresher.updates);
+}
+
+TEST(HealthInfoCacheTest, ConcurrentCallersShareARefresh) {
+    HealthInfoCache cache(kLongTtl);
+    std::atomic<int> updates{0};
+    std::vector<std::thread> threads;
+    std::vector<int32_t> capacities(8);
+    for (size_t i = 0; i < capacities.size(); i++) {
+        threads.emplace_back([&, i] {
+            HealthInfo info;
+            cache.getFresh(
+                    &info,
+                    [&] {
+                        updates++;
+                        // Slow enough for the other callers to queue up
+                        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                        cache.store(makeInfo(42));
+                    },
+                    [](HealthInfo*) { FAIL() << "the update stores the info"; });
+            capacities[i] = info.legacy.batteryLevel;
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    EXPECT_EQ(1, updates);
+    EXPECT_EQ(std::vector<int32_t>(capacities.size(), 42), capacities);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace health
+}  // namespace hardware
+}  // namespace android
@@ -16,9 +16,14 @@
 
 #include "Storage.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <sstream>
 
-#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -32,8 +37,8 @@ namespace V1_0 {
 namespace implementation {
 
 using base::ReadFileToString;
-using base::Timer;
 using base::Trim;
+using base::unique_fd;
 using base::WriteStringToFd;
 using base::WriteStringToFile;
 using fs_mgr::Fstab;
@@ -52,56 +57,169 @@ std::string getGarbageCollectPath() {
     return "";
 }
 
+// Bounds of the exponential backoff between manual_gc polls when the device does not signal
+// the attribute.
+constexpr std::chrono::milliseconds kMinGcPollInterval{250};
+constexpr std::chrono::milliseconds kMaxGcPollInterval{8000};
+
+Storage::Storage() : cancel_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (cancel_fd_ < 0) {
+        PLOG(WARNING) << "Cannot create Dev GC cancel eventfd";
+    }
+    gc_thread_ = std::thread(&Storage::gcThreadLoop, this);
+}
+
+Storage::~Storage() {
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        exiting_ = true;
+        if (cancel_fd_ >= 0) eventfd_write(cancel_fd_, 1);
+    }
+    cv_.notify_one();
+    gc_thread_.join();
+}
+
 Return<void> Storage::garbageCollect(uint64_t timeoutSeconds,
                                      const sp<IGarbageCollectCallback>& cb) {
-    Result result = Result::SUCCESS;
-    std::string path = getGarbageCollectPath();
+    auto request = std::make_unique<GcRequest>();
+    request->deadline = std::chrono::steady_clock::now() +
+                        std::chrono::seconds(std::min<uint64_t>(timeoutSeconds, INT32_MAX));
+    request->cb = cb;
 
-    if (path.empty()) {
-        LOG(WARNING) << "Cannot find Dev GC path";
-        result = Result::UNKNOWN_ERROR;
-    } else {
-        Timer timer;
-        LOG(INFO) << "Start Dev GC on " << path;
-        while (1) {
-            std::string require;
-            if (!ReadFileToString(path, &require)) {
-                PLOG(WARNING) << "Reading manual_gc failed in " << path;
-                result = Result::IO_ERROR;
-                break;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (pending_ != nullptr && pending_->cb != nullptr) {
+            // Superseded before it started; report it like a timeout.
+            auto ret = pending_->cb->onFinish(Result::SUCCESS);
+            if (!ret.isOk()) {
+                LOG(WARNING) << "Cannot return result to callback: " << ret.description();
             }
-            require = Trim(require);
-            if (require == "" || require == "off" || require == "disabled") {
-                LOG(DEBUG) << "No more to do Dev GC";
-                break;
-            }
-            LOG(DEBUG) << "Trigger Dev GC on " << path;
-            if (!WriteStringToFile("1", path)) {
-                PLOG(WARNING) << "Start Dev GC failed on " << path;
-                result = Result::IO_ERROR;
-                break;
+        }
+        pending_ = std::move(request);
+        if (gc_running_ && cancel_fd_ >= 0) {
+            LOG(INFO) << "Cancel running Dev GC";
+            eventfd_write(cancel_fd_, 1);
+        }
+    }
+    cv_.notify_one();
+    return Void();
+}
+
+void Storage::gcThreadLoop() {
+    while (true) {
+        std::unique_ptr<GcRequest> request;
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            cv_.wait(lock, [this] { return exiting_ || pending_ != nullptr; });
+            if (exiting_) return;
+            request = std::move(pending_);
+            if (cancel_fd_ >= 0) {
+                eventfd_t ignored;
+                (void)eventfd_read(cancel_fd_, &ignored);  // drop stale cancellations
             }
-            if (timer.duration() >= std::chrono::seconds(timeoutSeconds)) {
-                LOG(WARNING) << "Dev GC timeout";
-                // Timeout is not treated as an error. Try next time.
-                break;
+            gc_running_ = true;
+            gc_rounds_ = 0;
+            gc_start_ = gc_last_progress_ = std::chrono::steady_clock::now();
+        }
+
+        Result result = Result::SUCCESS;
+        std::string path = getGarbageCollectPath();
+        if (path.empty()) {
+            LOG(WARNING) << "Cannot find Dev GC path";
+            result = Result::UNKNOWN_ERROR;
+        } else {
+            result = runGarbageCollect(path, request->deadline);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            gc_running_ = false;
+        }
+
+        if (request->cb != nullptr) {
+            auto ret = request->cb->onFinish(result);
+            if (!ret.isOk()) {
+                LOG(WARNING) << "Cannot return result to callback: " << ret.description();
             }
-            sleep(2);
         }
-        LOG(INFO) << "Stop Dev GC on " << path;
-        if (!WriteStringToFile("0", path)) {
-            PLOG(WARNING) << "Stop Dev GC failed on " << path;
+    }
+}
+
+bool Storage::waitForGc(int gc_fd, std::chrono::milliseconds delay, bool* signalled) {
+    struct pollfd fds[2] = {
+            {gc_fd, POLLPRI | POLLERR, 0},
+            {cancel_fd_.get(), POLLIN, 0},
+    };
+    int ret = TEMP_FAILURE_RETRY(
+            poll(fds, cancel_fd_ >= 0 ? 2 : 1, static_cast<int>(delay.count())));
+    if (ret < 0) {
+        PLOG(WARNING) << "poll on manual_gc failed";
+        // Fall back to the plain backoff.
+        std::this_thread::sleep_for(delay);
+        ret = 0;
+    }
+    *signalled = ret > 0 && (fds[0].revents & (POLLPRI | POLLERR));
+    return !(ret > 0 && (fds[1].revents & POLLIN));
+}
+
+Result Storage::runGarbageCollect(const std::string& path,
+                                  std::chrono::steady_clock::time_point deadline) {
+    Result result = Result::SUCCESS;
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDWR | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(WARNING) << "Opening manual_gc failed in " << path;
+        return Result::IO_ERROR;
+    }
+
+    LOG(INFO) << "Start Dev GC on " << path;
+    std::chrono::milliseconds interval = kMinGcPollInterval;
+    while (1) {
+        // Reading the attribute also re-arms sysfs notification for the next poll.
+        char buf[64];
+        ssize_t n = TEMP_FAILURE_RETRY(pread(fd, buf, sizeof(buf) - 1, 0));
+        if (n < 0) {
+            PLOG(WARNING) << "Reading manual_gc failed in " << path;
+            result = Result::IO_ERROR;
+            break;
+        }
+        std::string require = Trim(std::string(buf, n));
+        if (require == "" || require == "off" || require == "disabled") {
+            LOG(DEBUG) << "No more to do Dev GC";
+            break;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            LOG(WARNING) << "Dev GC timeout";
+            // Timeout is not treated as an error. Try next time.
+            break;
+        }
+        LOG(DEBUG) << "Trigger Dev GC on " << path << ", state: " << require;
+        if (TEMP_FAILURE_RETRY(pwrite(fd, "1", 1, 0)) != 1) {
+            PLOG(WARNING) << "Start Dev GC failed on " << path;
             result = Result::IO_ERROR;
+            break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            gc_rounds_++;
+            gc_last_progress_ = now;
         }
-    }
 
-    if (cb != nullptr) {
-        auto ret = cb->onFinish(result);
-        if (!ret.isOk()) {
-            LOG(WARNING) << "Cannot return result to callback: " << ret.description();
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+        bool signalled = false;
+        if (!waitForGc(fd, std::min(interval, remaining), &signalled)) {
+            LOG(INFO) << "Dev GC cancelled";
+            break;
         }
+        // Poll promptly again when the device signals; otherwise back off.
+        interval = signalled ? kMinGcPollInterval : std::min(interval * 2, kMaxGcPollInterval);
     }
-    return Void();
+    LOG(INFO) << "Stop Dev GC on " << path;
+    if (TEMP_FAILURE_RETRY(pwrite(fd, "0", 1, 0)) != 1) {
+        PLOG(WARNING) << "Stop Dev GC failed on " << path;
+        result = Result::IO_ERROR;
+    }
+    return result;
 }
 
 Return<void> Storage::debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) {
@@ -112,6 +230,22 @@ Return<void> Storage::debug(const hidl_handle& handle, const hidl_vec<hidl_strin
     int fd = handle->data[0];
     std::stringstream output;
 
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto since = [](auto time) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - time)
+                    .count();
+        };
+        output << "Dev GC: " << (gc_running_ ? "running" : "idle") << ", " << gc_rounds_
+               << " rounds";
+        if (gc_rounds_ > 0) {
+            output << ", started " << since(gc_start_) << "ms ago, last triggered "
+                   << since(gc_last_progress_) << "ms ago";
+        }
+        output << std::endl;
+    }
+
     std::string path = getGarbageCollectPath();
     if (path.empty()) {
         output << "Cannot find Dev GC path";
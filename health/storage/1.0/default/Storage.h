@@ -17,6 +17,14 @@
 #ifndef ANDROID_HARDWARE_HEALTH_FILESYSTEM_V1_0_FILESYSTEM_H
 #define ANDROID_HARDWARE_HEALTH_FILESYSTEM_V1_0_FILESYSTEM_H
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <android-base/unique_fd.h>
 #include <android/hardware/health/storage/1.0/IStorage.h>
 #include <hidl/Status.h>
 
@@ -34,9 +42,41 @@ using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 
 struct Storage : public IStorage {
+    Storage();
+    ~Storage();
+
+    // Hands the request to the GC worker and returns immediately. A request arriving while
+    // garbage collection is running cancels the running one; a timeout of 0 only cancels.
     Return<void> garbageCollect(uint64_t timeoutSeconds,
                                 const sp<IGarbageCollectCallback>& cb) override;
     Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>&) override;
+
+   private:
+    struct GcRequest {
+        std::chrono::steady_clock::time_point deadline;
+        sp<IGarbageCollectCallback> cb;
+    };
+
+    void gcThreadLoop();
+    Result runGarbageCollect(const std::string& path,
+                             std::chrono::steady_clock::time_point deadline);
+    // Waits for the device to signal manual_gc, for delay to pass, or for a cancellation.
+    // Returns false if cancelled; otherwise sets *signalled if the device signalled.
+    bool waitForGc(int gc_fd, std::chrono::milliseconds delay, bool* signalled);
+
+    std::mutex lock_;
+    std::condition_variable cv_;
+    std::unique_ptr<GcRequest> pending_;
+    bool exiting_ = false;
+    // Signalled whenever the running garbage collection must stop.
+    base::unique_fd cancel_fd_;
+    std::thread gc_thread_;
+
+    // Progress of the current or last garbage collection, for debug(). Guarded by lock_.
+    bool gc_running_ = false;
+    uint32_t gc_rounds_ = 0;
+    std::chrono::steady_clock::time_point gc_start_;
+    std::chrono::steady_clock::time_point gc_last_progress_;
 };
 
 }  // namespace implementation
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ClassificationEngine.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+using namespace android::hardware::input::common::V1_0;
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+/**
+ * PointerCoords::bits has the layout of the framework's BitSet64, where axis N is bit 63 - N,
+ * and the values are packed in the order of the axes.
+ */
+float getAxisValue(const PointerCoords& coords, Axis axis) {
+    const uint64_t bit = 0x8000000000000000ULL >> static_cast<uint64_t>(axis);
+    const uint64_t bits = coords.bits;
+    if (!(bits & bit)) {
+        return 0;
+    }
+    const size_t index = __builtin_popcountll(bits & ~(bit | (bit - 1)));
+    return index < coords.values.size() ? coords.values[index] : 0;
+}
+
+bool endsGesture(Action action) {
+    return action == Action::UP || action == Action::CANCEL;
+}
+
+}  // namespace
+
+void FeatureExtractor::reset() {
+    mWindow.clear();
+    mWindowPressureSum = 0;
+    mFeatures = {};
+}
+
+const Features& FeatureExtractor::update(const PointerSample& sample, size_t pointerCount) {
+    if (mFeatures.sampleCount == 0) {
+        mFirstSample = sample;
+        mFeatures.peakPressure = sample.pressure;
+    }
+
+    PointerSample evicted;
+    if (mWindow.push(sample, &evicted)) {
+        mWindowPressureSum -= evicted.pressure;
+    }
+    mWindowPressureSum += sample.pressure;
+
+    const PointerSample& oldest = mWindow.front();
+    const int64_t windowNs = sample.eventTime - oldest.eventTime;
+
+    mFeatures.sampleCount++;
+    mFeatures.pointerCount = pointerCount;
+    mFeatures.durationNs = sample.eventTime - mFirstSample.eventTime;
+    mFeatures.pressure = sample.pressure;
+    mFeatures.peakPressure = fmaxf(mFeatures.peakPressure, sample.pressure);
+    mFeatures.meanPressure = mWindowPressureSum / mWindow.size();
+    mFeatures.pressureSlope =
+            windowNs > 0 ? (sample.pressure - oldest.pressure) * 1e9f / windowNs : 0;
+    mFeatures.touchMajor = sample.touchMajor;
+    mFeatures.touchMajorGrowth = sample.touchMajor - mFirstSample.touchMajor;
+    mFeatures.displacement = hypotf(sample.x - mFirstSample.x, sample.y - mFirstSample.y);
+    return mFeatures;
+}
+
+void ClassificationEngine::DeviceState::resetGesture() {
+    pointerId = -1;
+    classification = Classification::NONE;
+    extractor.reset();
+}
+
+ClassificationEngine::ClassificationEngine(std::unique_ptr<ClassificationModel> model)
+    : mModel(std::move(model)) {}
+
+Classification ClassificationEngine::classify(const MotionEvent& event) {
+    std::lock_guard<std::mutex> lock(mLock);
+    DeviceState& device = getDeviceState(event.deviceId);
+
+    if (event.action == Action::DOWN) {
+        device.resetGesture();
+        if (!event.pointerProperties.size()) {
+            return Classification::NONE;
+        }
+        device.pointerId = event.pointerProperties[0].id;
+    }
+
+    if (device.pointerId >= 0) {
+        const size_t pointerCount =
+                std::min(event.pointerProperties.size(), event.pointerCoords.size());
+        for (size_t i = 0; i < pointerCount; i++) {
+            if (event.pointerProperties[i].id != device.pointerId) {
+                continue;
+            }
+            const PointerCoords& coords = event.pointerCoords[i];
+            const PointerSample sample = {
+                    .eventTime = event.eventTime,
+                    .x = getAxisValue(coords, Axis::X),
+                    .y = getAxisValue(coords, Axis::Y),
+                    .pressure = getAxisValue(coords, Axis::PRESSURE),
+                    .touchMajor = getAxisValue(coords, Axis::TOUCH_MAJOR),
+            };
+            device.classification = mModel->classify(device.extractor.update(sample, pointerCount));
+            break;
+        }
+    }
+
+    // Events of a gesture that did not start with a down, or whose pointer is gone, keep the
+    // last classification
+    const Classification classification = device.classification;
+    if (endsGesture(event.action)) {
+        device.resetGesture();
+    }
+    return classification;
+}
+
+void ClassificationEngine::reset() {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (DeviceState& device : mDevices) {
+        device.inUse = false;
+        device.resetGesture();
+    }
+}
+
+void ClassificationEngine::resetDevice(int32_t deviceId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (DeviceState& device : mDevices) {
+        if (device.inUse && device.deviceId == deviceId) {
+            device.inUse = false;
+            device.resetGesture();
+            return;
+        }
+    }
+}
+
+ClassificationEngine::DeviceState& ClassificationEngine::getDeviceState(int32_t deviceId) {
+    DeviceState* state = nullptr;
+    for (DeviceState& device : mDevices) {
+        if (device.inUse && device.deviceId == deviceId) {
+            state = &device;
+            break;
+        }
+        if (state == nullptr || !device.inUse ||
+            (state->inUse && device.lastUse < state->lastUse)) {
+            state = &device;
+        }
+    }
+    if (!state->inUse || state->deviceId != deviceId) {
+        state->inUse = true;
+        state->deviceId = deviceId;
+        state->resetGesture();
+    }
+    state->lastUse = ++mUseCount;
+    return *state;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_CLASSIFICATIONENGINE_H
+#define ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_CLASSIFICATIONENGINE_H
+
+#include <android/hardware/input/common/1.0/types.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+
+using ::android::hardware::input::common::V1_0::Classification;
+using ::android::hardware::input::common::V1_0::MotionEvent;
+
+/**
+ * One sample of the pointer a gesture is classified on.
+ */
+struct PointerSample {
+    // In nanoseconds
+    int64_t eventTime;
+    float x;
+    float y;
+    float pressure;
+    float touchMajor;
+};
+
+/**
+ * Ring buffer of the last N values pushed, indexed from the oldest one.
+ */
+template <typename T, size_t N>
+class RingBuffer {
+  public:
+    /**
+     * Adds a value, and returns true with the oldest value in evicted if the buffer was full.
+     */
+    bool push(const T& value, T* evicted) {
+        if (mSize < N) {
+            mItems[(mStart + mSize++) % N] = value;
+            return false;
+        }
+        *evicted = mItems[mStart];
+        mItems[mStart] = value;
+        mStart = (mStart + 1) % N;
+        return true;
+    }
+
+    const T& operator[](size_t index) const { return mItems[(mStart + index) % N]; }
+    const T& front() const { return (*this)[0]; }
+    const T& back() const { return (*this)[mSize - 1]; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    void clear() {
+        mStart = 0;
+        mSize = 0;
+    }
+
+  private:
+    std::array<T, N> mItems;
+    size_t mStart = 0;
+    size_t mSize = 0;
+};
+
+/**
+ * Features of the current gesture of a device, as given to the ClassificationModel.
+ */
+struct Features {
+    // Number of samples since the start of the gesture
+    size_t sampleCount;
+    // Number of pointers down in the last event
+    size_t pointerCount;
+    // Time since the start of the gesture, in nanoseconds
+    int64_t durationNs;
+    float pressure;
+    float peakPressure;
+    // Over the samples of the window
+    float meanPressure;
+    // Change of pressure per second over the samples of the window
+    float pressureSlope;
+    float touchMajor;
+    // Change of touch major since the start of the gesture
+    float touchMajorGrowth;
+    // Distance from the start of the gesture, in the units of the X and Y axes
+    float displacement;
+};
+
+/**
+ * Keeps the features of a gesture up to date, at a constant cost per sample.
+ */
+class FeatureExtractor {
+  public:
+    static constexpr size_t kWindowSize = 16;
+
+    void reset();
+    const Features& update(const PointerSample& sample, size_t pointerCount);
+    const Features& features() const { return mFeatures; }
+
+  private:
+    RingBuffer<PointerSample, kWindowSize> mWindow;
+    float mWindowPressureSum = 0;
+    PointerSample mFirstSample = {};
+    Features mFeatures = {};
+};
+
+/**
+ * The model that turns the features of a gesture into a classification. It is called on every
+ * event of a gesture, so it runs in a bounded time and must neither allocate nor block.
+ */
+class ClassificationModel {
+  public:
+    virtual ~ClassificationModel() = default;
+    virtual Classification classify(const Features& features) = 0;
+};
+
+/**
+ * Reports every gesture as not having any classification, which is equivalent to not having the
+ * InputClassifier HAL at all. To be replaced by a model tuned for the touchscreen of the device.
+ */
+class NoClassificationModel : public ClassificationModel {
+  public:
+    Classification classify(const Features&) override { return Classification::NONE; }
+};
+
+/**
+ * Classifies the gestures of each device incrementally, one MotionEvent at a time.
+ *
+ * The state of up to kMaxDevices devices is kept in place, the least recently used one being
+ * recycled for a new device, so that classify() never allocates.
+ */
+class ClassificationEngine {
+  public:
+    static constexpr size_t kMaxDevices = 8;
+
+    explicit ClassificationEngine(std::unique_ptr<ClassificationModel> model);
+
+    Classification classify(const MotionEvent& event);
+    void reset();
+    void resetDevice(int32_t deviceId);
+
+  private:
+    struct DeviceState {
+        bool inUse = false;
+        int32_t deviceId = 0;
+        uint64_t lastUse = 0;
+        // Id of the pointer the gesture is classified on, or -1 outside of a gesture
+        int32_t pointerId = -1;
+        Classification classification = Classification::NONE;
+        FeatureExtractor extractor;
+
+        void resetGesture();
+    };
+
+    DeviceState& getDeviceState(int32_t deviceId);
+
+    std::mutex mLock;
+    std::unique_ptr<ClassificationModel> mModel;
+    std::array<DeviceState, kMaxDevices> mDevices;
+    uint64_t mUseCount = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_INPUT_CLASSIFIER_V1_0_CLASSIFICATIONENGINE_H
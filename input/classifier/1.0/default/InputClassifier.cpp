@@ -30,25 +30,30 @@ namespace classifier {
 namespace V1_0 {
 namespace implementation {
 
+InputClassifier::InputClassifier() : InputClassifier(std::make_unique<NoClassificationModel>()) {}
+
+InputClassifier::InputClassifier(std::unique_ptr<ClassificationModel> model)
+    : mEngine(std::move(model)) {}
+
 // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
-Return<Classification> InputClassifier::classify(const MotionEvent& /*event*/) {
+Return<Classification> InputClassifier::classify(const MotionEvent& event) {
     /**
      * The touchscreen data is highly device-dependent.
-     * As a result, the implementation of this method will likely be hardware-specific.
-     * Here we just report gesture as not having any classification, which means that the
+     * As a result, the model behind the engine will likely be hardware-specific.
+     * The default model reports gesture as not having any classification, which means that the
      * default action will be taken in the framework.
      * This is equivalent to not having the InputClassifier HAL at all.
      */
-    return Classification::NONE;
+    return mEngine.classify(event);
 }
 
 Return<void> InputClassifier::reset() {
-    // We don't have any internal state, so no work needed here.
+    mEngine.reset();
     return Void();
 }
 
-Return<void> InputClassifier::resetDevice(int32_t /*deviceId*/) {
-    // We don't have any internal per-device state, so no work needed here.
+Return<void> InputClassifier::resetDevice(int32_t deviceId) {
+    mEngine.resetDevice(deviceId);
     return Void();
 }
 
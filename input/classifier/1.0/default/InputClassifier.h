@@ -20,6 +20,8 @@
 #include <android/hardware/input/classifier/1.0/IInputClassifier.h>
 #include <hidl/Status.h>
 
+#include "ClassificationEngine.h"
+
 namespace android {
 namespace hardware {
 namespace input {
@@ -30,6 +32,9 @@ namespace implementation {
 using ::android::hardware::Return;
 
 struct InputClassifier : public IInputClassifier {
+    InputClassifier();
+    explicit InputClassifier(std::unique_ptr<ClassificationModel> model);
+
     // Methods from ::android::hardware::input::classifier::V1_0::IInputClassifier follow.
 
     Return<android::hardware::input::common::V1_0::Classification> classify(
@@ -37,6 +42,9 @@ struct InputClassifier : public IInputClassifier {
 
     Return<void> reset() override;
     Return<void> resetDevice(int32_t deviceId) override;
+
+  private:
+    ClassificationEngine mEngine;
 };
 
 }  // namespace implementation
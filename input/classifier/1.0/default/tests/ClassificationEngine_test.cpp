@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "ClassificationEngine.h"
+
+using namespace android::hardware::input::common::V1_0;
+
+namespace android {
+namespace hardware {
+namespace input {
+namespace classifier {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+constexpr int64_t kMillisecond = 1000000;
+
+// PointerCoords::bits has axis N at bit 63 - N
+constexpr uint64_t axisBit(Axis axis) {
+    return 0x8000000000000000ULL >> static_cast<uint64_t>(axis);
+}
+
+struct Pointer {
+    int32_t id;
+    float x;
+    float y;
+    float pressure;
+    float touchMajor;
+};
+
+MotionEvent makeEvent(int32_t deviceId, Action action, int64_t eventTime,
+                      const std::vector<Pointer>& pointers) {
+    std::vector<PointerProperties> properties;
+    std::vector<PointerCoords> coords;
+    for (const Pointer& pointer : pointers) {
+        PointerProperties property = {};
+        property.id = pointer.id;
+        properties.push_back(property);
+
+        PointerCoords coord = {};
+        coord.bits = axisBit(Axis::X) | axisBit(Axis::Y) | axisBit(Axis::PRESSURE) |
+                     axisBit(Axis::TOUCH_MAJOR);
+        coord.values = std::vector<float>(
+                {pointer.x, pointer.y, pointer.pressure, pointer.touchMajor});
+        coords.push_back(coord);
+    }
+
+    MotionEvent event = {};
+    event.deviceId = deviceId;
+    event.action = action;
+    event.eventTime = eventTime;
+    event.pointerProperties = properties;
+    event.pointerCoords = coords;
+    return event;
+}
+
+PointerSample makeSample(int64_t eventTime, float x, float y, float pressure, float touchMajor) {
+    return {.eventTime = eventTime, .x = x, .y = y, .pressure = pressure, .touchMajor = touchMajor};
+}
+
+// Reports DEEP_PRESS for every classified sample, and records the features it was given.
+class RecordingModel : public ClassificationModel {
+  public:
+    Classification classify(const Features& features) override {
+        calls++;
+        lastFeatures = features;
+        return Classification::DEEP_PRESS;
+    }
+
+    size_t calls = 0;
+    Features lastFeatures = {};
+};
+
+TEST(RingBufferTest, FillsUpToItsCapacity) {
+    RingBuffer<int, 3> buffer;
+    int evicted = -1;
+    EXPECT_TRUE(buffer.empty());
+
+    EXPECT_FALSE(buffer.push(1, &evicted));
+    EXPECT_FALSE(buffer.push(2, &evicted));
+    EXPECT_EQ(-1, evicted);
+    EXPECT_EQ(2u, buffer.size());
+    EXPECT_EQ(1, buffer.front());
+    EXPECT_EQ(2, buffer.back());
+}
+
+TEST(RingBufferTest, WrapsAroundEvictingTheOldest) {
+    RingBuffer<int, 3> buffer;
+    int evicted = -1;
+    for (int i = 1; i <= 3; i++) {
+        EXPECT_FALSE(buffer.push(i, &evicted));
+    }
+
+    for (int i = 4; i <= 8; i++) {
+        EXPECT_TRUE(buffer.push(i, &evicted));
+        EXPECT_EQ(i - 3, evicted);
+        ASSERT_EQ(3u, buffer.size());
+        EXPECT_EQ(i - 2, buffer[0]);
+        EXPECT_EQ(i - 1, buffer[1]);
+        EXPECT_EQ(i, buffer[2]);
+        EXPECT_EQ(i, buffer.back());
+    }
+
+    buffer.clear();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_FALSE(buffer.push(9, &evicted));
+    EXPECT_EQ(9, buffer.front());
+    EXPECT_EQ(9, buffer.back());
+}
+
+TEST(FeatureExtractorTest, FirstSample) {
+    FeatureExtractor extractor;
+    const Features& features = extractor.update(makeSample(1000, 10, 20, 0.5, 4), 1);
+
+    EXPECT_EQ(1u, features.sampleCount);
+    EXPECT_EQ(1u, features.pointerCount);
+    EXPECT_EQ(0, features.durationNs);
+    EXPECT_FLOAT_EQ(0.5, features.pressure);
+    EXPECT_FLOAT_EQ(0.5, features.peakPressure);
+    EXPECT_FLOAT_EQ(0.5, features.meanPressure);
+    EXPECT_FLOAT_EQ(0, features.pressureSlope);
+    EXPECT_FLOAT_EQ(4, features.touchMajor);
+    EXPECT_FLOAT_EQ(0, features.touchMajorGrowth);
+    EXPECT_FLOAT_EQ(0, features.displacement);
+}
+
+TEST(FeatureExtractorTest, FollowsTheGesture) {
+    FeatureExtractor extractor;
+    extractor.update(makeSample(1000, 10, 20, 0.5, 4), 1);
+    const Features& features =
+            extractor.update(makeSample(1000 + 10 * kMillisecond, 13, 24, 0.7, 6), 2);
+
+    EXPECT_EQ(2u, features.sampleCount);
+    EXPECT_EQ(2u, features.pointerCount);
+    EXPECT_EQ(10 * kMillisecond, features.durationNs);
+    EXPECT_FLOAT_EQ(0.7, features.peakPressure);
+    EXPECT_FLOAT_EQ(0.6, features.meanPressure);
+    // 0.2 in 10 ms
+    EXPECT_FLOAT_EQ(20, features.pressureSlope);
+    EXPECT_FLOAT_EQ(2, features.touchMajorGrowth);
+    EXPECT_FLOAT_EQ(5, features.displacement);
+
+    // The peak is kept as the pressure goes down
+    extractor.update(makeSample(1000 + 20 * kMillisecond, 13, 24, 0.3, 6), 1);
+    EXPECT_FLOAT_EQ(0.3, extractor.features().pressure);
+    EXPECT_FLOAT_EQ(0.7, extractor.features().peakPressure);
+}
+
+TEST(FeatureExtractorTest, WindowedFeaturesSlide) {
+    FeatureExtractor extractor;
+    const size_t count = FeatureExtractor::kWindowSize + 4;
+    for (size_t i = 0; i < count; i++) {
+        extractor.update(makeSample(i * kMillisecond, 0, 0, i, 1), 1);
+    }
+    const Features& features = extractor.features();
+
+    EXPECT_EQ(count, features.sampleCount);
+    EXPECT_EQ(static_cast<int64_t>(count - 1) * kMillisecond, features.durationNs);
+    EXPECT_FLOAT_EQ(count - 1, features.peakPressure);
+    // The window holds the pressures 4 to 19, which grow by 1 per millisecond
+    EXPECT_FLOAT_EQ(11.5, features.meanPressure);
+    EXPECT_FLOAT_EQ(1000, features.pressureSlope);
+}
+
+TEST(FeatureExtractorTest, ResetStartsANewGesture) {
+    FeatureExtractor extractor;
+    extractor.update(makeSample(0, 0, 0, 0.9, 1), 1);
+    extractor.update(makeSample(kMillisecond, 30, 40, 0.8, 3), 1);
+
+    extractor.reset();
+    const Features& features = extractor.update(makeSample(5 * kMillisecond, 30, 40, 0.2, 3), 1);
+    EXPECT_EQ(1u, features.sampleCount);
+    EXPECT_EQ(0, features.durationNs);
+    EXPECT_FLOAT_EQ(0.2, features.peakPressure);
+    EXPECT_FLOAT_EQ(0.2, features.meanPressure);
+    EXPECT_FLOAT_EQ(0, features.displacement);
+}
+
+class ClassificationEngineTest : public ::testing::Test {
+  protected:
+    ClassificationEngineTest() {
+        auto model = std::make_unique<RecordingModel>();
+        mModel = model.get();
+        mEngine = std::make_unique<ClassificationEngine>(std::move(model));
+    }
+
+    Classification send(int32_t deviceId, Action action,
+                        const std::vector<Pointer>& pointers = {{0, 0, 0, 1, 1}}) {
+        return mEngine->classify(makeEvent(deviceId, action, mTime++ * kMillisecond, pointers));
+    }
+
+    RecordingModel* mModel;
+    std::unique_ptr<ClassificationEngine> mEngine;
+    int64_t mTime = 0;
+};
+
+TEST_F(ClassificationEngineTest, ClassifiesThePointerThatWentDown) {
+    EXPECT_EQ(Classification::DEEP_PRESS, send(1, Action::DOWN, {{3, 10, 20, 0.5, 4}}));
+    EXPECT_EQ(1u, mModel->calls);
+
+    EXPECT_EQ(Classification::DEEP_PRESS,
+              send(1, Action::MOVE, {{5, 100, 100, 1, 9}, {3, 13, 24, 0.7, 6}}));
+    EXPECT_EQ(2u, mModel->lastFeatures.sampleCount);
+    EXPECT_EQ(2u, mModel->lastFeatures.pointerCount);
+    EXPECT_FLOAT_EQ(0.7, mModel->lastFeatures.pressure);
+    EXPECT_FLOAT_EQ(5, mModel->lastFeatures.displacement);
+}
+
+TEST_F(ClassificationEngineTest, KeepsTheClassificationWhenThePointerIsGone) {
+    send(1, Action::DOWN, {{3, 0, 0, 1, 1}});
+    EXPECT_EQ(Classification::DEEP_PRESS, send(1, Action::MOVE, {{5, 0, 0, 1, 1}}));
+    EXPECT_EQ(1u, mModel->calls);
+}
+
+TEST_F(ClassificationEngineTest, EventsOutsideOfAGestureAreNotClassified) {
+    EXPECT_EQ(Classification::NONE, send(1, Action::MOVE));
+
+    send(1, Action::DOWN);
+    EXPECT_EQ(Classification::DEEP_PRESS, send(1, Action::UP));
+    EXPECT_EQ(Classification::NONE, send(1, Action::MOVE));
+    EXPECT_EQ(2u, mModel->calls);
+
+    // A down without pointers
+    EXPECT_EQ(Classification::NONE, send(1, Action::DOWN, {}));
+    EXPECT_EQ(2u, mModel->calls);
+}
+
+TEST_F(ClassificationEngineTest, ReusesTheLeastRecentlyUsedDevice) {
+    for (size_t i = 0; i < ClassificationEngine::kMaxDevices; i++) {
+        send(i, Action::DOWN);
+    }
+    // Device 1 is now the least recently used one
+    send(0, Action::MOVE);
+
+    send(ClassificationEngine::kMaxDevices, Action::DOWN);
+
+    // The others kept their gesture
+    EXPECT_EQ(Classification::DEEP_PRESS, send(0, Action::MOVE));
+    EXPECT_EQ(3u, mModel->lastFeatures.sampleCount);
+    EXPECT_EQ(Classification::DEEP_PRESS, send(2, Action::MOVE));
+    EXPECT_EQ(2u, mModel->lastFeatures.sampleCount);
+    EXPECT_EQ(Classification::DEEP_PRESS, send(ClassificationEngine::kMaxDevices, Action::MOVE));
+    EXPECT_EQ(2u, mModel->lastFeatures.sampleCount);
+
+    // Device 1 lost its gesture, and now takes the place of device 3
+    size_t calls = mModel->calls;
+    EXPECT_EQ(Classification::NONE, send(1, Action::MOVE));
+    EXPECT_EQ(calls, mModel->calls);
+    EXPECT_EQ(Classification::NONE, send(3, Action::MOVE));
+    EXPECT_EQ(calls, mModel->calls);
+}
+
+TEST_F(ClassificationEngineTest, ResetDropsTheGestures) {
+    send(1, Action::DOWN);
+    send(2, Action::DOWN);
+
+    mEngine->resetDevice(1);
+    EXPECT_EQ(Classification::NONE, send(1, Action::MOVE));
+    EXPECT_EQ(Classification::DEEP_PRESS, send(2, Action::MOVE));
+
+    mEngine->reset();
+    EXPECT_EQ(Classification::NONE, send(2, Action::MOVE));
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace classifier
+}  // namespace input
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <keymasterV4_0/BufferedOperation.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+BufferedOperation::BufferedOperation(const sp<IKeymasterDevice>& device, uint64_t operationHandle,
+                                     const HardwareAuthToken& authToken,
+                                     const VerificationToken& verificationToken, size_t chunkSize)
+    : device_(device),
+      operationHandle_(operationHandle),
+      authToken_(authToken),
+      verificationToken_(verificationToken),
+      chunkSize_(std::max<size_t>(1, std::min(chunkSize, kMaxChunkSize))) {}
+
+void BufferedOperation::append(const uint8_t* input, size_t size) {
+    buffer_.erase(buffer_.begin(), buffer_.begin() + bufferStart_);
+    bufferStart_ = 0;
+    buffer_.insert(buffer_.end(), input, input + size);
+}
+
+ErrorCode BufferedOperation::update(const uint8_t* input, size_t size,
+                                    std::vector<uint8_t>* output) {
+    append(input, size);
+    return flush(chunkSize_, output);
+}
+
+ErrorCode BufferedOperation::flush(size_t minSize, std::vector<uint8_t>* output) {
+    while (buffered() >= minSize && buffered() > 0) {
+        hidl_vec<uint8_t> chunk;
+        chunk.setToExternal(buffer_.data() + bufferStart_, std::min(buffered(), chunkSize_));
+
+        ErrorCode error = ErrorCode::UNKNOWN_ERROR;
+        uint32_t consumed = 0;
+        auto rc = device_->update(
+            operationHandle_, {}, chunk, authToken_, verificationToken_,
+            [&](ErrorCode updateError, uint32_t inputConsumed, const hidl_vec<KeyParameter>&,
+                const hidl_vec<uint8_t>& updateOutput) {
+                error = updateError;
+                consumed = std::min<size_t>(inputConsumed, chunk.size());
+                output->insert(output->end(), updateOutput.begin(), updateOutput.end());
+            });
+        ++transactionCount_;
+        if (!rc.isOk()) {
+            LOG(ERROR) << "update failed: " << rc.description();
+            return ErrorCode::UNKNOWN_ERROR;
+        }
+        if (error != ErrorCode::OK) return error;
+
+        bufferStart_ += consumed;
+        inputConsumed_ += consumed;
+        // The HAL wants more input before it consumes any, as block ciphers can.
+        if (consumed == 0) break;
+    }
+    return ErrorCode::OK;
+}
+
+ErrorCode BufferedOperation::finish(const uint8_t* input, size_t size,
+                                    const hidl_vec<uint8_t>& signature,
+                                    std::vector<uint8_t>* output,
+                                    hidl_vec<KeyParameter>* outParams) {
+    append(input, size);
+    // Keep the last message within the chunk size too
+    ErrorCode error = flush(chunkSize_ + 1, output);
+    if (error != ErrorCode::OK) return error;
+
+    hidl_vec<uint8_t> remaining;
+    remaining.setToExternal(buffer_.data() + bufferStart_, buffered());
+    auto rc = device_->finish(operationHandle_, {}, remaining, signature, authToken_,
+                              verificationToken_,
+                              [&](ErrorCode finishError, const hidl_vec<KeyParameter>& params,
+                                  const hidl_vec<uint8_t>& finishOutput) {
+                                  error = finishError;
+                                  if (outParams) *outParams = params;
+                                  output->insert(output->end(), finishOutput.begin(),
+                                                 finishOutput.end());
+                              });
+    ++transactionCount_;
+    if (!rc.isOk()) {
+        LOG(ERROR) << "finish failed: " << rc.description();
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    if (error == ErrorCode::OK) {
+        inputConsumed_ += buffered();
+        buffer_.clear();
+        bufferStart_ = 0;
+    }
+    return error;
+}
+
+ErrorCode BufferedOperation::abort() {
+    buffer_.clear();
+    bufferStart_ = 0;
+    auto rc = device_->abort(operationHandle_);
+    if (!rc.isOk()) {
+        LOG(ERROR) << "abort failed: " << rc.description();
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    return rc;
+}
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -16,6 +16,8 @@
 
 #include <keymasterV4_0/Keymaster.h>
 
+#include <chrono>
+#include <future>
 #include <iomanip>
 
 #include <android-base/logging.h>
@@ -79,6 +81,46 @@ std::ostream& operator<<(std::ostream& os, const Keymaster& keymaster) {
     return os;
 }
 
+// A device that takes longer than this to answer is reported, and waited for again.
+static constexpr auto kDeviceCallTimeout = std::chrono::seconds(2);
+
+static int64_t millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                 start)
+        .count();
+}
+
+/**
+ * Runs call(i) for each i < count, each on its own thread, and returns once all of them have
+ * returned. "what" names the call, and name(i) the device it is made on, in the logs of the time
+ * each call takes. HIDL calls cannot be cancelled, so a device slower than kDeviceCallTimeout is
+ * logged and waited for again, rather than dropped.
+ */
+template <typename Call, typename Name>
+static void callConcurrently(size_t count, const char* what, Call call, Name name) {
+    std::vector<std::future<void>> calls;
+    calls.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        calls.push_back(std::async(std::launch::async, [&, i] {
+            auto start = std::chrono::steady_clock::now();
+            call(i);
+            LOG(INFO) << what << " on " << name(i) << " took " << millisecondsSince(start)
+                      << " ms";
+        }));
+    }
+    for (size_t i = 0; i < count; ++i) {
+        while (calls[i].wait_for(kDeviceCallTimeout) == std::future_status::timeout) {
+            LOG(WARNING) << "Still waiting for " << what << " on " << name(i);
+        }
+        calls[i].get();
+    }
+}
+
+static std::string deviceName(const Keymaster& keymaster) {
+    // Not operator<<, which gets the hardware info of the device
+    return std::string(keymaster.descriptor()) + "/" + std::string(keymaster.instanceName());
+}
+
 template <typename Wrapper>
 std::vector<std::unique_ptr<Keymaster>> enumerateDevices(
     const sp<IServiceManager>& serviceManager) {
@@ -86,16 +128,23 @@ std::vector<std::unique_ptr<Keymaster>> enumerateDevices(
 
     bool foundDefault = false;
     auto& descriptor = Wrapper::WrappedIKeymasterDevice::descriptor;
-    serviceManager->listByInterface(descriptor, [&](const hidl_vec<hidl_string>& names) {
-        for (auto& name : names) {
-            if (name == "default") foundDefault = true;
-            auto device = Wrapper::WrappedIKeymasterDevice::getService(name);
-            CHECK(device) << "Failed to get service for " << descriptor << " with interface name "
-                          << name;
-            result.push_back(std::unique_ptr<Keymaster>(new Wrapper(device, name)));
-        }
+    std::vector<hidl_string> names;
+    serviceManager->listByInterface(descriptor, [&](const hidl_vec<hidl_string>& instances) {
+        names.assign(instances.begin(), instances.end());
     });
 
+    std::vector<sp<typename Wrapper::WrappedIKeymasterDevice>> devices(names.size());
+    callConcurrently(
+        names.size(), "getService",
+        [&](size_t i) { devices[i] = Wrapper::WrappedIKeymasterDevice::getService(names[i]); },
+        [&](size_t i) { return std::string(descriptor) + "/" + std::string(names[i]); });
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == "default") foundDefault = true;
+        CHECK(devices[i]) << "Failed to get service for " << descriptor
+                          << " with interface name " << names[i];
+        result.push_back(std::unique_ptr<Keymaster>(new Wrapper(devices[i], names[i])));
+    }
+
     if (!foundDefault) {
         // "default" wasn't provided by listByInterface.  Maybe there's a passthrough
         // implementation.
@@ -123,12 +172,20 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     auto serviceManager = IServiceManager::getService();
     CHECK(serviceManager) << "Could not retrieve ServiceManager";
 
+    auto start = std::chrono::steady_clock::now();
+    auto km3s = std::async(std::launch::async,
+                           [&] { return enumerateDevices<Keymaster3>(serviceManager); });
     auto km4s = enumerateDevices<Keymaster4>(serviceManager);
-    auto km3s = enumerateDevices<Keymaster3>(serviceManager);
 
     auto result = std::move(km4s);
-    result.insert(result.end(), std::make_move_iterator(km3s.begin()),
-                  std::make_move_iterator(km3s.end()));
+    auto km3Result = km3s.get();
+    result.insert(result.end(), std::make_move_iterator(km3Result.begin()),
+                  std::make_move_iterator(km3Result.end()));
+
+    // The devices get their hardware info once, on their first halVersion() call
+    callConcurrently(
+        result.size(), "getHardwareInfo", [&](size_t i) { result[i]->halVersion(); },
+        [&](size_t i) { return deviceName(*result[i]); });
 
     std::sort(result.begin(), result.end(),
               [](auto& a, auto& b) { return a->halVersion() > b->halVersion(); });
@@ -136,59 +193,77 @@ Keymaster::KeymasterSet Keymaster::enumerateAvailableDevices() {
     size_t i = 1;
     LOG(INFO) << "List of Keymaster HALs found:";
     for (auto& hal : result) LOG(INFO) << "Keymaster HAL #" << i++ << ": " << *hal;
+    LOG(INFO) << "Found " << result.size() << " Keymaster HALs in " << millisecondsSince(start)
+              << " ms";
 
     return result;
 }
 
-static hidl_vec<HmacSharingParameters> getHmacParameters(
-    const Keymaster::KeymasterSet& keymasters) {
-    std::vector<HmacSharingParameters> params_vec;
-    params_vec.reserve(keymasters.size());
+// The devices that take part in the HMAC key agreement
+static std::vector<Keymaster*> hmacDevices(const Keymaster::KeymasterSet& keymasters) {
+    std::vector<Keymaster*> devices;
     for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
-        auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
-            CHECK(error == ErrorCode::OK)
-                << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-            params_vec.push_back(params);
-        });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
-                         << " error: " << rc.description();
+        if (keymaster->halVersion().majorVersion >= 4) devices.push_back(keymaster.get());
     }
+    return devices;
+}
+
+static hidl_vec<HmacSharingParameters> getHmacParameters(const std::vector<Keymaster*>& devices) {
+    std::vector<HmacSharingParameters> params_vec(devices.size());
+    callConcurrently(
+        devices.size(), "getHmacSharingParameters",
+        [&](size_t i) {
+            Keymaster* keymaster = devices[i];
+            auto rc = keymaster->getHmacSharingParameters([&](auto error, auto& params) {
+                CHECK(error == ErrorCode::OK)
+                    << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
+                params_vec[i] = params;
+            });
+            CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+                             << " error: " << rc.description();
+        },
+        [&](size_t i) { return deviceName(*devices[i]); });
     std::sort(params_vec.begin(), params_vec.end());
 
     return params_vec;
 }
 
-static void computeHmac(const Keymaster::KeymasterSet& keymasters,
+static void computeHmac(const std::vector<Keymaster*>& devices,
                         const hidl_vec<HmacSharingParameters>& params) {
     if (!params.size()) return;
 
-    hidl_vec<uint8_t> sharingCheck;
-    bool firstKeymaster = true;
     LOG(DEBUG) << "Computing HMAC with params " << params;
-    for (auto& keymaster : keymasters) {
-        if (keymaster->halVersion().majorVersion < 4) continue;
-        LOG(DEBUG) << "Computing HMAC for " << *keymaster;
-        auto rc = keymaster->computeSharedHmac(
-            params, [&](ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
-                CHECK(error == ErrorCode::OK)
-                    << "Failed to get HMAC parameters from " << *keymaster << " error " << error;
-                if (firstKeymaster) {
-                    sharingCheck = curSharingCheck;
-                    firstKeymaster = false;
-                }
-                if (curSharingCheck != sharingCheck)
-                    LOG(WARNING) << "HMAC computation failed for " << *keymaster  //
-                                 << " Expected: " << sharingCheck                 //
-                                 << " got: " << curSharingCheck;
-            });
-        CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
-                         << " error: " << rc.description();
+    std::vector<hidl_vec<uint8_t>> sharingChecks(devices.size());
+    callConcurrently(
+        devices.size(), "computeSharedHmac",
+        [&](size_t i) {
+            Keymaster* keymaster = devices[i];
+            auto rc = keymaster->computeSharedHmac(
+                params, [&](ErrorCode error, const hidl_vec<uint8_t>& curSharingCheck) {
+                    CHECK(error == ErrorCode::OK) << "Failed to get HMAC parameters from "
+                                                  << *keymaster << " error " << error;
+                    sharingChecks[i] = curSharingCheck;
+                });
+            CHECK(rc.isOk()) << "Failed to communicate with " << *keymaster
+                             << " error: " << rc.description();
+        },
+        [&](size_t i) { return deviceName(*devices[i]); });
+
+    // All the devices must agree with the first one
+    for (size_t i = 1; i < devices.size(); ++i) {
+        if (sharingChecks[i] != sharingChecks[0])
+            LOG(WARNING) << "HMAC computation failed for " << *devices[i]  //
+                         << " Expected: " << sharingChecks[0]              //
+                         << " got: " << sharingChecks[i];
     }
 }
 
 void Keymaster::performHmacKeyAgreement(const KeymasterSet& keymasters) {
-    computeHmac(keymasters, getHmacParameters(keymasters));
+    auto start = std::chrono::steady_clock::now();
+    auto devices = hmacDevices(keymasters);
+    computeHmac(devices, getHmacParameters(devices));
+    LOG(INFO) << "HMAC key agreement with " << devices.size() << " devices took "
+              << millisecondsSince(start) << " ms";
 }
 
 }  // namespace support
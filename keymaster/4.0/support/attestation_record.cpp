@@ -19,6 +19,10 @@
 #include <android-base/logging.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <atomic>
+#include <future>
+
 #include <openssl/asn1t.h>
 #include <openssl/bn.h>
 #include <openssl/evp.h>
@@ -362,6 +366,232 @@ ErrorCode parse_root_of_trust(const uint8_t* asn1_key_desc, size_t asn1_key_desc
     return ErrorCode::OK;  // KM_ERROR_OK;
 }
 
+// Decodes a non-negative DER INTEGER or ENUMERATED that fits in 64 bits.
+static bool get_asn1_uint64(CBS* cbs, unsigned asn1_tag, uint64_t* value) {
+    CBS contents;
+    if (!CBS_get_asn1(cbs, &contents, asn1_tag) || CBS_len(&contents) == 0) return false;
+    const uint8_t* data = CBS_data(&contents);
+    size_t len = CBS_len(&contents);
+    if (data[0] & 0x80) return false;
+    if (data[0] == 0 && len > 1) {
+        // DER: the leading zero is only there to clear the sign bit.
+        if (!(data[1] & 0x80)) return false;
+        data++;
+        len--;
+    }
+    if (len > sizeof(uint64_t)) return false;
+    *value = 0;
+    for (size_t i = 0; i < len; ++i) {
+        *value = *value << 8 | data[i];
+    }
+    return true;
+}
+
+static hidl_vec<uint8_t> external_vec(const CBS& cbs) {
+    hidl_vec<uint8_t> vec;
+    vec.setToExternal(const_cast<uint8_t*>(CBS_data(&cbs)), CBS_len(&cbs));
+    return vec;
+}
+
+ErrorCode AttestationRecordView::parse(const uint8_t* asn1_key_desc, size_t asn1_key_desc_len) {
+    mParsed = false;
+    CBS record, key_desc;
+    CBS_init(&record, asn1_key_desc, asn1_key_desc_len);
+    if (!CBS_get_asn1(&record, &key_desc, CBS_ASN1_SEQUENCE) ||
+        !CBS_get_asn1_element(&key_desc, &mAttestationVersion, CBS_ASN1_INTEGER) ||
+        !CBS_get_asn1_element(&key_desc, &mAttestationSecurityLevel, CBS_ASN1_ENUMERATED) ||
+        !CBS_get_asn1_element(&key_desc, &mKeymasterVersion, CBS_ASN1_INTEGER) ||
+        !CBS_get_asn1_element(&key_desc, &mKeymasterSecurityLevel, CBS_ASN1_ENUMERATED) ||
+        !CBS_get_asn1(&key_desc, &mAttestationChallenge, CBS_ASN1_OCTETSTRING) ||
+        !CBS_get_asn1(&key_desc, &mUniqueId, CBS_ASN1_OCTETSTRING) ||
+        !CBS_get_asn1(&key_desc, &mSoftwareEnforced, CBS_ASN1_SEQUENCE) ||
+        !CBS_get_asn1(&key_desc, &mTeeEnforced, CBS_ASN1_SEQUENCE)) {
+        LOG(ERROR) << AT << "Failed record parsing";
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    mParsed = true;
+    return ErrorCode::OK;
+}
+
+static ErrorCode get_version(const CBS& field, unsigned asn1_tag, bool parsed, uint32_t* version) {
+    if (!parsed) return ErrorCode::UNKNOWN_ERROR;
+    CBS cbs = field;
+    uint64_t value;
+    if (!get_asn1_uint64(&cbs, asn1_tag, &value) || value > UINT32_MAX) {
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    *version = static_cast<uint32_t>(value);
+    return ErrorCode::OK;
+}
+
+ErrorCode AttestationRecordView::attestationVersion(uint32_t* version) const {
+    return get_version(mAttestationVersion, CBS_ASN1_INTEGER, mParsed, version);
+}
+
+ErrorCode AttestationRecordView::attestationSecurityLevel(SecurityLevel* securityLevel) const {
+    uint32_t value;
+    ErrorCode error = get_version(mAttestationSecurityLevel, CBS_ASN1_ENUMERATED, mParsed, &value);
+    if (error == ErrorCode::OK) *securityLevel = static_cast<SecurityLevel>(value);
+    return error;
+}
+
+ErrorCode AttestationRecordView::keymasterVersion(uint32_t* version) const {
+    return get_version(mKeymasterVersion, CBS_ASN1_INTEGER, mParsed, version);
+}
+
+ErrorCode AttestationRecordView::keymasterSecurityLevel(SecurityLevel* securityLevel) const {
+    uint32_t value;
+    ErrorCode error = get_version(mKeymasterSecurityLevel, CBS_ASN1_ENUMERATED, mParsed, &value);
+    if (error == ErrorCode::OK) *securityLevel = static_cast<SecurityLevel>(value);
+    return error;
+}
+
+ErrorCode AttestationRecordView::attestationChallenge(hidl_vec<uint8_t>* challenge) const {
+    if (!mParsed) return ErrorCode::UNKNOWN_ERROR;
+    *challenge = external_vec(mAttestationChallenge);
+    return ErrorCode::OK;
+}
+
+ErrorCode AttestationRecordView::uniqueId(hidl_vec<uint8_t>* uniqueId) const {
+    if (!mParsed) return ErrorCode::UNKNOWN_ERROR;
+    *uniqueId = external_vec(mUniqueId);
+    return ErrorCode::OK;
+}
+
+// Authorization list entries are EXPLICIT context-specific tags, numbered by the masked tag, so
+// *value is left on the element inside the tag.
+bool AttestationRecordView::findTag(AuthList list, Tag tag, CBS* value) const {
+    if (!mParsed) return false;
+    CBS entries = list == AuthList::TEE_ENFORCED ? mTeeEnforced : mSoftwareEnforced;
+    const unsigned wanted = CBS_ASN1_CONTEXT_SPECIFIC | CBS_ASN1_CONSTRUCTED |
+                            (static_cast<uint32_t>(tag) & 0x0FFFFFFF);
+    while (CBS_len(&entries) > 0) {
+        CBS entry;
+        unsigned entry_tag;
+        size_t header_len;
+        if (!CBS_get_any_asn1_element(&entries, &entry, &entry_tag, &header_len) ||
+            !CBS_skip(&entry, header_len)) {
+            return false;
+        }
+        if (entry_tag == wanted) {
+            *value = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool AttestationRecordView::hasTag(AuthList list, Tag tag) const {
+    CBS value;
+    return findTag(list, tag, &value);
+}
+
+ErrorCode AttestationRecordView::getInteger(AuthList list, Tag tag, uint64_t* value) const {
+    CBS entry;
+    if (!findTag(list, tag, &entry)) return ErrorCode::INVALID_TAG;
+    if (!get_asn1_uint64(&entry, CBS_ASN1_INTEGER, value)) return ErrorCode::UNKNOWN_ERROR;
+    return ErrorCode::OK;
+}
+
+ErrorCode AttestationRecordView::getIntegers(AuthList list, Tag tag,
+                                             std::vector<uint64_t>* values) const {
+    CBS entry, set;
+    if (!findTag(list, tag, &entry)) return ErrorCode::INVALID_TAG;
+    if (!CBS_get_asn1(&entry, &set, CBS_ASN1_SET)) return ErrorCode::UNKNOWN_ERROR;
+    values->clear();
+    while (CBS_len(&set) > 0) {
+        uint64_t value;
+        if (!get_asn1_uint64(&set, CBS_ASN1_INTEGER, &value)) return ErrorCode::UNKNOWN_ERROR;
+        values->push_back(value);
+    }
+    return ErrorCode::OK;
+}
+
+ErrorCode AttestationRecordView::getBytes(AuthList list, Tag tag, hidl_vec<uint8_t>* value) const {
+    CBS entry, bytes;
+    if (!findTag(list, tag, &entry)) return ErrorCode::INVALID_TAG;
+    if (!CBS_get_asn1(&entry, &bytes, CBS_ASN1_OCTETSTRING)) return ErrorCode::UNKNOWN_ERROR;
+    *value = external_vec(bytes);
+    return ErrorCode::OK;
+}
+
+ErrorCode AttestationRecordView::rootOfTrust(hidl_vec<uint8_t>* verified_boot_key,
+                                             keymaster_verified_boot_t* verified_boot_state,
+                                             bool* device_locked,
+                                             hidl_vec<uint8_t>* verified_boot_hash) const {
+    CBS entry, root_of_trust, key, locked, hash;
+    uint64_t state;
+    if (!findTag(AuthList::TEE_ENFORCED, TAG_ROOT_OF_TRUST, &entry)) {
+        LOG(ERROR) << AT << "Failed root of trust parsing";
+        return ErrorCode::INVALID_ARGUMENT;
+    }
+    if (!CBS_get_asn1(&entry, &root_of_trust, CBS_ASN1_SEQUENCE) ||
+        !CBS_get_asn1(&root_of_trust, &key, CBS_ASN1_OCTETSTRING) ||
+        !CBS_get_asn1(&root_of_trust, &locked, CBS_ASN1_BOOLEAN) || CBS_len(&locked) != 1 ||
+        !get_asn1_uint64(&root_of_trust, CBS_ASN1_ENUMERATED, &state) ||
+        !CBS_get_asn1(&root_of_trust, &hash, CBS_ASN1_OCTETSTRING)) {
+        LOG(ERROR) << AT << "Failed root of trust parsing";
+        return ErrorCode::INVALID_ARGUMENT;
+    }
+    *verified_boot_key = external_vec(key);
+    *device_locked = CBS_data(&locked)[0] != 0;
+    *verified_boot_state = static_cast<keymaster_verified_boot_t>(state);
+    *verified_boot_hash = external_vec(hash);
+    return ErrorCode::OK;
+}
+
+// Copies the attestation record of a DER-encoded certificate into *record.
+static ErrorCode extract_attestation_record(const hidl_vec<uint8_t>& certificate,
+                                            const ASN1_OBJECT* oid, std::vector<uint8_t>* record) {
+    const uint8_t* p = certificate.data();
+    X509_Ptr x509(d2i_X509(nullptr, &p, certificate.size()));
+    if (!x509.get()) {
+        LOG(ERROR) << AT << "Failed certificate parsing";
+        return ErrorCode::UNKNOWN_ERROR;
+    }
+    int location = X509_get_ext_by_OBJ(x509.get(), oid, -1 /* search from beginning */);
+    if (location == -1) return ErrorCode::INVALID_ARGUMENT;
+    ASN1_OCTET_STRING* data = X509_EXTENSION_get_data(X509_get_ext(x509.get(), location));
+    if (!data) return ErrorCode::INVALID_ARGUMENT;
+
+    record->assign(data->data, data->data + data->length);
+    return ErrorCode::OK;
+}
+
+std::vector<ErrorCode> parse_attestation_certificates(
+    const std::vector<hidl_vec<uint8_t>>& certificates, size_t threads,
+    std::vector<AttestationRecordView>* views) {
+    std::vector<ErrorCode> errors(certificates.size(), ErrorCode::UNKNOWN_ERROR);
+    views->clear();
+    views->resize(certificates.size());
+
+    ASN1_OBJECT_Ptr oid(OBJ_txt2obj(kAttestionRecordOid, 1 /* dotted string format */));
+    if (!oid.get()) return errors;
+
+    // Workers take the next certificate until there are none left, so that a few large ones do
+    // not hold back the rest.
+    std::atomic<size_t> next(0);
+    auto work = [&] {
+        for (size_t i = next++; i < certificates.size(); i = next++) {
+            AttestationRecordView& view = (*views)[i];
+            errors[i] = extract_attestation_record(certificates[i], oid.get(), &view.mOwnedRecord);
+            if (errors[i] == ErrorCode::OK) {
+                errors[i] = view.parse(view.mOwnedRecord.data(), view.mOwnedRecord.size());
+            }
+        }
+    };
+    threads = std::max<size_t>(1, std::min(threads, certificates.size()));
+    std::vector<std::future<void>> workers;
+    for (size_t i = 1; i < threads; ++i) {
+        workers.push_back(std::async(std::launch::async, work));
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.get();
+    }
+    return errors;
+}
+
 }  // namespace V4_0
 }  // namespace keymaster
 }  // namespace hardware
@@ -17,6 +17,7 @@
 #include <keymasterV4_0/authorization_set.h>
 
 #include <assert.h>
+#include <string.h>
 
 #include <android-base/logging.h>
 
@@ -83,14 +84,29 @@ inline bool keyParamEqual(const KeyParameter& a, const KeyParameter& b) {
     return false;
 }
 
+inline bool keyParamTagLess(const KeyParameter& a, Tag b) {
+    return a.tag < b;
+}
+
 void AuthorizationSet::Sort() {
     std::sort(data_.begin(), data_.end(), keyParamLess);
 }
 
+void AuthorizationSet::KeepSorted() {
+    if (!keep_sorted_) Sort();
+    keep_sorted_ = true;
+}
+
+std::vector<KeyParameter>::iterator AuthorizationSet::insertPosition(const KeyParameter& param) {
+    if (!keep_sorted_) return data_.end();
+    // After the equal entries, so that they keep their insertion order.
+    return std::upper_bound(data_.begin(), data_.end(), param, keyParamLess);
+}
+
 void AuthorizationSet::Deduplicate() {
     if (data_.empty()) return;
 
-    Sort();
+    if (!keep_sorted_) Sort();
     std::vector<KeyParameter> result;
 
     auto curr = data_.begin();
@@ -108,7 +124,13 @@ void AuthorizationSet::Deduplicate() {
 }
 
 void AuthorizationSet::Union(const AuthorizationSet& other) {
+    size_t size = data_.size();
     data_.insert(data_.end(), other.data_.begin(), other.data_.end());
+    if (keep_sorted_) {
+        auto middle = data_.begin() + size;
+        if (!other.keep_sorted_) std::sort(middle, data_.end(), keyParamLess);
+        std::inplace_merge(data_.begin(), middle, data_.end(), keyParamLess);
+    }
     Deduplicate();
 }
 
@@ -139,10 +161,6 @@ void AuthorizationSet::Filter(std::function<bool(const KeyParameter&)> doKeep) {
     std::swap(data_, result);
 }
 
-KeyParameter& AuthorizationSet::operator[](int at) {
-    return data_[at];
-}
-
 const KeyParameter& AuthorizationSet::operator[](int at) const {
     return data_[at];
 }
@@ -152,6 +170,12 @@ void AuthorizationSet::Clear() {
 }
 
 size_t AuthorizationSet::GetTagCount(Tag tag) const {
+    if (keep_sorted_) {
+        auto first = std::lower_bound(data_.begin(), data_.end(), tag, keyParamTagLess);
+        auto last = first;
+        while (last != data_.end() && last->tag == tag) ++last;
+        return last - first;
+    }
     size_t count = 0;
     for (int pos = -1; (pos = find(tag, pos)) != -1;) ++count;
     return count;
@@ -160,6 +184,12 @@ size_t AuthorizationSet::GetTagCount(Tag tag) const {
 int AuthorizationSet::find(Tag tag, int begin) const {
     auto iter = data_.begin() + (1 + begin);
 
+    if (keep_sorted_) {
+        iter = std::lower_bound(iter, data_.end(), tag, keyParamTagLess);
+        if (iter != data_.end() && iter->tag == tag) return iter - data_.begin();
+        return -1;
+    }
+
     while (iter != data_.end() && iter->tag != tag) ++iter;
 
     if (iter != data_.end()) return iter - data_.begin();
@@ -200,54 +230,67 @@ NullOr<const KeyParameter&> AuthorizationSet::GetEntry(Tag tag) const {
  * | 32 bit indirect_offset |
  */
 
-struct OutStreams {
-    std::ostream& indirect;
-    std::ostream& elements;
+/**
+ * Serialization measures the set in a first pass, with null buffers, then writes it in a second
+ * pass into a single buffer of the measured size.
+ */
+struct OutBuffers {
+    uint8_t* indirect;
+    uint8_t* elements;
+    size_t indirect_size;
+    size_t elements_size;
     size_t skipped;
+    bool bad;
 };
 
-OutStreams& serializeParamValue(OutStreams& out, const hidl_vec<uint8_t>& blob) {
+void appendElements(OutBuffers& out, const void* data, size_t size) {
+    if (out.elements) memcpy(out.elements + out.elements_size, data, size);
+    out.elements_size += size;
+}
+
+OutBuffers& serializeParamValue(OutBuffers& out, const hidl_vec<uint8_t>& blob) {
     uint32_t buffer;
 
     // write blob_length
     auto blob_length = blob.size();
     if (blob_length > std::numeric_limits<uint32_t>::max()) {
-        out.elements.setstate(std::ios_base::badbit);
+        out.bad = true;
         return out;
     }
     buffer = blob_length;
-    out.elements.write(reinterpret_cast<const char*>(&buffer), sizeof(uint32_t));
+    appendElements(out, &buffer, sizeof(uint32_t));
 
     // write indirect_offset
-    auto offset = out.indirect.tellp();
-    if (offset < 0 || offset > std::numeric_limits<uint32_t>::max() ||
+    auto offset = out.indirect_size;
+    if (offset > std::numeric_limits<uint32_t>::max() ||
         uint32_t(offset) + uint32_t(blob_length) < uint32_t(offset)) {  // overflow check
-        out.elements.setstate(std::ios_base::badbit);
+        out.bad = true;
         return out;
     }
     buffer = offset;
-    out.elements.write(reinterpret_cast<const char*>(&buffer), sizeof(uint32_t));
+    appendElements(out, &buffer, sizeof(uint32_t));
 
-    // write blob to indirect stream
-    if (blob_length) out.indirect.write(reinterpret_cast<const char*>(&blob[0]), blob_length);
+    // write blob to indirect buffer
+    if (blob_length && out.indirect) memcpy(out.indirect + offset, &blob[0], blob_length);
+    out.indirect_size += blob_length;
 
     return out;
 }
 
 template <typename T>
-OutStreams& serializeParamValue(OutStreams& out, const T& value) {
-    out.elements.write(reinterpret_cast<const char*>(&value), sizeof(T));
+OutBuffers& serializeParamValue(OutBuffers& out, const T& value) {
+    appendElements(out, &value, sizeof(T));
     return out;
 }
 
-OutStreams& serialize(TAG_INVALID_t&&, OutStreams& out, const KeyParameter&) {
+OutBuffers& serialize(TAG_INVALID_t&&, OutBuffers& out, const KeyParameter&) {
     // skip invalid entries.
     ++out.skipped;
     return out;
 }
 template <typename T>
-OutStreams& serialize(T ttag, OutStreams& out, const KeyParameter& param) {
-    out.elements.write(reinterpret_cast<const char*>(&param.tag), sizeof(int32_t));
+OutBuffers& serialize(T ttag, OutBuffers& out, const KeyParameter& param) {
+    appendElements(out, &param.tag, sizeof(int32_t));
     return serializeParamValue(out, accessTagValue(ttag, param));
 }
 
@@ -255,16 +298,19 @@ template <typename... T>
 struct choose_serializer;
 template <typename... Tags>
 struct choose_serializer<MetaList<Tags...>> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+    static OutBuffers& serialize(OutBuffers& out, const KeyParameter& param) {
         return choose_serializer<Tags...>::serialize(out, param);
     }
 };
 
 template <>
 struct choose_serializer<> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
-        LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag)
-                     << ". Did you forget to add it to all_tags_t?";
+    static OutBuffers& serialize(OutBuffers& out, const KeyParameter& param) {
+        // Only warn once, while measuring
+        if (!out.elements) {
+            LOG(WARNING) << "Trying to serialize unknown tag " << unsigned(param.tag)
+                         << ". Did you forget to add it to all_tags_t?";
+        }
         ++out.skipped;
         return out;
     }
@@ -272,7 +318,7 @@ struct choose_serializer<> {
 
 template <TagType tag_type, Tag tag, typename... Tail>
 struct choose_serializer<TypedTag<tag_type, tag>, Tail...> {
-    static OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+    static OutBuffers& serialize(OutBuffers& out, const KeyParameter& param) {
         if (param.tag == tag) {
             return V4_0::serialize(TypedTag<tag_type, tag>(), out, param);
         } else {
@@ -281,82 +327,123 @@ struct choose_serializer<TypedTag<tag_type, tag>, Tail...> {
     }
 };
 
-OutStreams& serialize(OutStreams& out, const KeyParameter& param) {
+OutBuffers& serialize(OutBuffers& out, const KeyParameter& param) {
     return choose_serializer<all_tags_t>::serialize(out, param);
 }
 
-std::ostream& serialize(std::ostream& out, const std::vector<KeyParameter>& params) {
-    std::stringstream indirect;
-    std::stringstream elements;
-    OutStreams streams = {indirect, elements, 0};
+// Returns the measure of params, with bad set if they cannot be serialized.
+OutBuffers measure(const std::vector<KeyParameter>& params) {
+    OutBuffers layout = {nullptr, nullptr, 0, 0, 0, false};
     for (const auto& param : params) {
-        serialize(streams, param);
+        serialize(layout, param);
     }
-    if (indirect.bad() || elements.bad()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
-    }
-    auto pos = indirect.tellp();
-    if (pos < 0 || pos > std::numeric_limits<uint32_t>::max()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
+    if (layout.indirect_size > std::numeric_limits<uint32_t>::max() ||
+        layout.elements_size > std::numeric_limits<uint32_t>::max()) {
+        layout.bad = true;
     }
-    uint32_t indirect_size = pos;
-    pos = elements.tellp();
-    if (pos < 0 || pos > std::numeric_limits<uint32_t>::max()) {
-        out.setstate(std::ios_base::badbit);
-        return out;
-    }
-    uint32_t elements_size = pos;
-    uint32_t element_count = params.size() - streams.skipped;
+    return layout;
+}
 
-    out.write(reinterpret_cast<const char*>(&indirect_size), sizeof(uint32_t));
+size_t serializedSize(const OutBuffers& layout) {
+    return 3 * sizeof(uint32_t) + layout.indirect_size + layout.elements_size;
+}
 
-    pos = out.tellp();
-    if (indirect_size) out << indirect.rdbuf();
-    assert(out.tellp() - pos == indirect_size);
+// Writes params, of the given measure, to buf, which holds serializedSize(layout) bytes.
+uint8_t* serialize(const std::vector<KeyParameter>& params, const OutBuffers& layout,
+                   uint8_t* buf) {
+    uint32_t indirect_size = layout.indirect_size;
+    uint32_t element_count = params.size() - layout.skipped;
+    uint32_t elements_size = layout.elements_size;
 
-    out.write(reinterpret_cast<const char*>(&element_count), sizeof(uint32_t));
-    out.write(reinterpret_cast<const char*>(&elements_size), sizeof(uint32_t));
+    memcpy(buf, &indirect_size, sizeof(uint32_t));
+    buf += sizeof(uint32_t);
+    uint8_t* indirect = buf;
+    buf += indirect_size;
+    memcpy(buf, &element_count, sizeof(uint32_t));
+    buf += sizeof(uint32_t);
+    memcpy(buf, &elements_size, sizeof(uint32_t));
+    buf += sizeof(uint32_t);
 
-    pos = out.tellp();
-    if (elements_size) out << elements.rdbuf();
-    assert(out.tellp() - pos == elements_size);
+    OutBuffers out = {indirect, buf, 0, 0, 0, false};
+    for (const auto& param : params) {
+        serialize(out, param);
+    }
+    assert(out.indirect_size == layout.indirect_size);
+    assert(out.elements_size == layout.elements_size);
+    return buf + elements_size;
+}
 
+std::ostream& serialize(std::ostream& out, const std::vector<KeyParameter>& params) {
+    OutBuffers layout = measure(params);
+    if (layout.bad) {
+        out.setstate(std::ios_base::badbit);
+        return out;
+    }
+    std::vector<uint8_t> buffer(serializedSize(layout));
+    serialize(params, layout, buffer.data());
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
     return out;
 }
 
-struct InStreams {
-    std::istream& indirect;
-    std::istream& elements;
+/**
+ * Deserialization reads from the serialized buffer in place. Blobs and bignums are either copied
+ * or, when borrowing, refer to the buffer.
+ */
+struct InBuffers {
+    const uint8_t* indirect;
+    size_t indirect_size;
+    const uint8_t* elements;
+    size_t elements_size;
+    size_t elements_pos;
+    bool borrow;
     size_t invalids;
+    bool bad;
 };
 
-InStreams& deserializeParamValue(InStreams& in, hidl_vec<uint8_t>* blob) {
+void readElements(InBuffers& in, void* data, size_t size) {
+    if (in.bad || size > in.elements_size - in.elements_pos) {
+        in.bad = true;
+        memset(data, 0, size);
+        return;
+    }
+    memcpy(data, in.elements + in.elements_pos, size);
+    in.elements_pos += size;
+}
+
+InBuffers& deserializeParamValue(InBuffers& in, hidl_vec<uint8_t>* blob) {
     uint32_t blob_length = 0;
     uint32_t offset = 0;
-    in.elements.read(reinterpret_cast<char*>(&blob_length), sizeof(uint32_t));
-    blob->resize(blob_length);
-    in.elements.read(reinterpret_cast<char*>(&offset), sizeof(uint32_t));
-    in.indirect.seekg(offset);
-    in.indirect.read(reinterpret_cast<char*>(&(*blob)[0]), blob->size());
+    readElements(in, &blob_length, sizeof(uint32_t));
+    readElements(in, &offset, sizeof(uint32_t));
+    if (in.bad || offset > in.indirect_size || blob_length > in.indirect_size - offset) {
+        in.bad = true;
+        blob->resize(0);
+        return in;
+    }
+    if (in.borrow) {
+        blob->setToExternal(const_cast<uint8_t*>(in.indirect + offset), blob_length,
+                            false /* shouldOwn */);
+    } else {
+        blob->resize(blob_length);
+        if (blob_length) memcpy(&(*blob)[0], in.indirect + offset, blob_length);
+    }
     return in;
 }
 
 template <typename T>
-InStreams& deserializeParamValue(InStreams& in, T* value) {
-    in.elements.read(reinterpret_cast<char*>(value), sizeof(T));
+InBuffers& deserializeParamValue(InBuffers& in, T* value) {
+    readElements(in, value, sizeof(T));
     return in;
 }
 
-InStreams& deserialize(TAG_INVALID_t&&, InStreams& in, KeyParameter*) {
+InBuffers& deserialize(TAG_INVALID_t&&, InBuffers& in, KeyParameter*) {
     // there should be no invalid KeyParamaters but if handle them as zero sized.
     ++in.invalids;
     return in;
 }
 
 template <typename T>
-InStreams& deserialize(T&& ttag, InStreams& in, KeyParameter* param) {
+InBuffers& deserialize(T&& ttag, InBuffers& in, KeyParameter* param) {
     return deserializeParamValue(in, &accessTagValue(ttag, *param));
 }
 
@@ -364,21 +451,21 @@ template <typename... T>
 struct choose_deserializer;
 template <typename... Tags>
 struct choose_deserializer<MetaList<Tags...>> {
-    static InStreams& deserialize(InStreams& in, KeyParameter* param) {
+    static InBuffers& deserialize(InBuffers& in, KeyParameter* param) {
         return choose_deserializer<Tags...>::deserialize(in, param);
     }
 };
 template <>
 struct choose_deserializer<> {
-    static InStreams& deserialize(InStreams& in, KeyParameter*) {
+    static InBuffers& deserialize(InBuffers& in, KeyParameter*) {
         // encountered an unknown tag -> fail parsing
-        in.elements.setstate(std::ios_base::badbit);
+        in.bad = true;
         return in;
     }
 };
 template <TagType tag_type, Tag tag, typename... Tail>
 struct choose_deserializer<TypedTag<tag_type, tag>, Tail...> {
-    static InStreams& deserialize(InStreams& in, KeyParameter* param) {
+    static InBuffers& deserialize(InBuffers& in, KeyParameter* param) {
         if (param->tag == tag) {
             return V4_0::deserialize(TypedTag<tag_type, tag>(), in, param);
         } else {
@@ -387,52 +474,53 @@ struct choose_deserializer<TypedTag<tag_type, tag>, Tail...> {
     }
 };
 
-InStreams& deserialize(InStreams& in, KeyParameter* param) {
-    in.elements.read(reinterpret_cast<char*>(&param->tag), sizeof(Tag));
+InBuffers& deserialize(InBuffers& in, KeyParameter* param) {
+    readElements(in, &param->tag, sizeof(Tag));
+    if (in.bad) return in;
     return choose_deserializer<all_tags_t>::deserialize(in, param);
 }
 
-std::istream& deserialize(std::istream& in, std::vector<KeyParameter>* params) {
+// Returns the end of the serialized set at data, or nullptr if it is malformed.
+const uint8_t* deserialize(const uint8_t* data, const uint8_t* end, bool borrow,
+                           std::vector<KeyParameter>* params) {
+    auto read32 = [&](uint32_t* value) {
+        if (end - data < ptrdiff_t(sizeof(uint32_t))) return false;
+        memcpy(value, data, sizeof(uint32_t));
+        data += sizeof(uint32_t);
+        return true;
+    };
+
+    params->clear();
     uint32_t indirect_size = 0;
-    in.read(reinterpret_cast<char*>(&indirect_size), sizeof(uint32_t));
-    std::string indirect_buffer(indirect_size, '\0');
-    if (indirect_buffer.size() != indirect_size) {
-        in.setstate(std::ios_base::badbit);
-        return in;
-    }
-    in.read(&indirect_buffer[0], indirect_buffer.size());
+    if (!read32(&indirect_size) || uint64_t(end - data) < indirect_size) return nullptr;
+    const uint8_t* indirect = data;
+    data += indirect_size;
 
     uint32_t element_count = 0;
-    in.read(reinterpret_cast<char*>(&element_count), sizeof(uint32_t));
     uint32_t elements_size = 0;
-    in.read(reinterpret_cast<char*>(&elements_size), sizeof(uint32_t));
+    if (!read32(&element_count) || !read32(&elements_size)) return nullptr;
+    if (uint64_t(end - data) < elements_size) return nullptr;
+    // Every element holds at least its tag, this bounds the allocation below.
+    if (element_count > elements_size / sizeof(uint32_t)) return nullptr;
 
-    std::string elements_buffer(elements_size, '\0');
-    if (elements_buffer.size() != elements_size) {
-        in.setstate(std::ios_base::badbit);
-        return in;
-    }
-    in.read(&elements_buffer[0], elements_buffer.size());
-
-    if (in.bad()) return in;
-
-    // TODO write one-shot stream buffer to avoid copying here
-    std::stringstream indirect(indirect_buffer);
-    std::stringstream elements(elements_buffer);
-    InStreams streams = {indirect, elements, 0};
+    InBuffers in = {indirect, indirect_size, data, elements_size, 0, borrow, 0, false};
 
     params->resize(element_count);
 
-    for (uint32_t i = 0; i < element_count; ++i) {
-        deserialize(streams, &(*params)[i]);
+    for (uint32_t i = 0; i < element_count && !in.bad; ++i) {
+        deserialize(in, &(*params)[i]);
+    }
+    if (in.bad) {
+        params->clear();
+        return nullptr;
     }
 
     /*
      * There are legacy blobs which have invalid tags in them due to a bug during serialization.
      * This makes sure that invalid tags are filtered from the result before it is returned.
      */
-    if (streams.invalids > 0) {
-        std::vector<KeyParameter> filtered(element_count - streams.invalids);
+    if (in.invalids > 0) {
+        std::vector<KeyParameter> filtered(element_count - in.invalids);
         auto ifiltered = filtered.begin();
         for (auto& p : *params) {
             if (p.tag != Tag::INVALID) {
@@ -441,6 +529,33 @@ std::istream& deserialize(std::istream& in, std::vector<KeyParameter>* params) {
         }
         *params = std::move(filtered);
     }
+    return data + elements_size;
+}
+
+std::istream& deserialize(std::istream& in, std::vector<KeyParameter>* params) {
+    // Reads the serialized set into one buffer, to deserialize it from there.
+    std::vector<uint8_t> buffer(sizeof(uint32_t));
+    uint32_t indirect_size = 0;
+    in.read(reinterpret_cast<char*>(&indirect_size), sizeof(uint32_t));
+    if (!in) return in;
+    memcpy(buffer.data(), &indirect_size, sizeof(uint32_t));
+
+    size_t pos = buffer.size();
+    buffer.resize(pos + indirect_size + 2 * sizeof(uint32_t));
+    in.read(reinterpret_cast<char*>(&buffer[pos]), indirect_size + 2 * sizeof(uint32_t));
+    if (!in) return in;
+
+    uint32_t elements_size = 0;
+    memcpy(&elements_size, &buffer[buffer.size() - sizeof(uint32_t)], sizeof(uint32_t));
+    pos = buffer.size();
+    buffer.resize(pos + elements_size);
+    if (elements_size) in.read(reinterpret_cast<char*>(&buffer[pos]), elements_size);
+    if (!in) return in;
+
+    if (deserialize(buffer.data(), buffer.data() + buffer.size(), false /* borrow */, params) ==
+        nullptr) {
+        in.setstate(std::ios_base::badbit);
+    }
     return in;
 }
 
@@ -450,6 +565,30 @@ void AuthorizationSet::Serialize(std::ostream* out) const {
 
 void AuthorizationSet::Deserialize(std::istream* in) {
     deserialize(*in, &data_);
+    if (keep_sorted_) Sort();
+}
+
+size_t AuthorizationSet::SerializedSize() const {
+    OutBuffers layout = measure(data_);
+    return layout.bad ? 0 : serializedSize(layout);
+}
+
+uint8_t* AuthorizationSet::Serialize(uint8_t* buf, const uint8_t* end) const {
+    OutBuffers layout = measure(data_);
+    if (layout.bad || size_t(end - buf) < serializedSize(layout)) return nullptr;
+    return serialize(data_, layout, buf);
+}
+
+const uint8_t* AuthorizationSet::Deserialize(const uint8_t* data, const uint8_t* end) {
+    const uint8_t* result = deserialize(data, end, false /* borrow */, &data_);
+    if (keep_sorted_) Sort();
+    return result;
+}
+
+const uint8_t* AuthorizationSet::DeserializeBorrowed(const uint8_t* data, const uint8_t* end) {
+    const uint8_t* result = deserialize(data, end, true /* borrow */, &data_);
+    if (keep_sorted_) Sort();
+    return result;
 }
 
 AuthorizationSetBuilder& AuthorizationSetBuilder::RsaKey(uint32_t key_size,
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the tag lookups of an AuthorizationSet in its default, linear, mode to its sorted mode
+// (AuthorizationSet::KeepSorted()), on the characteristics of typical keys. The lookups are the
+// ones keystore makes to check the parameters of an operation. Also compares the stream and
+// buffer serialization of the same sets.
+
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
+#include <keymasterV4_0/authorization_set.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+
+namespace {
+
+enum KeyKind { RSA_SIGNING, AES_ENCRYPTION, EC_ATTESTED };
+
+// The hardware and software enforced characteristics of a generated key, in a single set
+AuthorizationSet MakeKeyCharacteristics(KeyKind kind) {
+    AuthorizationSetBuilder builder;
+    switch (kind) {
+        case RSA_SIGNING:
+            builder.RsaSigningKey(2048, 65537)
+                    .Digest(Digest::NONE, Digest::SHA_2_256, Digest::SHA_2_384, Digest::SHA_2_512)
+                    .Padding(PaddingMode::NONE, PaddingMode::RSA_PKCS1_1_5_SIGN,
+                             PaddingMode::RSA_PSS);
+            break;
+        case AES_ENCRYPTION:
+            builder.AesEncryptionKey(256)
+                    .BlockMode(BlockMode::ECB, BlockMode::CBC, BlockMode::GCM)
+                    .Padding(PaddingMode::NONE, PaddingMode::PKCS7)
+                    .Authorization(TAG_MIN_MAC_LENGTH, 128);
+            break;
+        case EC_ATTESTED: {
+            // Large attestation ids make up most of the size of these sets
+            std::vector<uint8_t> applicationId(1024, 0xa5);
+            builder.EcdsaSigningKey(EcCurve::P_256)
+                    .Digest(Digest::NONE, Digest::SHA_2_256)
+                    .Authorization(TAG_ATTESTATION_APPLICATION_ID, applicationId.data(),
+                                   applicationId.size())
+                    .Authorization(TAG_USER_SECURE_ID, 0x1234567890abcdefULL)
+                    .Authorization(TAG_USER_AUTH_TYPE, HardwareAuthenticatorType::FINGERPRINT)
+                    .Authorization(TAG_AUTH_TIMEOUT, 300);
+            break;
+        }
+    }
+    builder.Authorization(TAG_ORIGIN, KeyOrigin::GENERATED)
+            .Authorization(TAG_OS_VERSION, 100000)
+            .Authorization(TAG_OS_PATCHLEVEL, 201909)
+            .Authorization(TAG_VENDOR_PATCHLEVEL, 20190905)
+            .Authorization(TAG_BOOT_PATCHLEVEL, 20190905)
+            .Authorization(TAG_CREATION_DATETIME, 1567700000000ULL);
+    if (kind != EC_ATTESTED) builder.Authorization(TAG_NO_AUTH_REQUIRED);
+    return std::move(builder);
+}
+
+// The checks of a begin() call on the key
+bool CheckBeginParameters(const AuthorizationSet& characteristics) {
+    bool ok = characteristics.GetTagValue(TAG_ALGORITHM).isOk();
+    ok &= characteristics.Contains(TAG_PURPOSE, KeyPurpose::SIGN) ||
+          characteristics.Contains(TAG_PURPOSE, KeyPurpose::ENCRYPT);
+    ok &= characteristics.Contains(TAG_DIGEST, Digest::SHA_2_256) ||
+          characteristics.Contains(TAG_BLOCK_MODE, BlockMode::GCM);
+    ok &= characteristics.GetTagCount(TAG_PADDING) > 0;
+    ok &= characteristics.Contains(TAG_NO_AUTH_REQUIRED) ||
+          characteristics.GetTagValue(TAG_USER_SECURE_ID).isOk();
+    ok &= !characteristics.GetTagValue(TAG_ACTIVE_DATETIME).isOk();
+    ok &= !characteristics.GetTagValue(TAG_USAGE_EXPIRE_DATETIME).isOk();
+    ok &= !characteristics.Contains(TAG_CALLER_NONCE);
+    ok &= !characteristics.GetTagValue(TAG_MAX_USES_PER_BOOT).isOk();
+    ok &= characteristics.GetTagValue(TAG_OS_PATCHLEVEL).isOk();
+    return ok;
+}
+
+void BM_Lookup(benchmark::State& state) {
+    AuthorizationSet characteristics = MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0)));
+    if (state.range(1)) characteristics.KeepSorted();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(CheckBeginParameters(characteristics));
+    }
+    state.counters["entries"] = characteristics.size();
+}
+
+// The sets keystore builds from the parameters of each operation
+void BM_BuildAndDeduplicate(benchmark::State& state) {
+    AuthorizationSet characteristics = MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0)));
+    for (auto _ : state) {
+        AuthorizationSet set;
+        if (state.range(1)) set.KeepSorted();
+        set.push_back(characteristics);
+        set.push_back(characteristics);
+        set.Deduplicate();
+        benchmark::DoNotOptimize(set.size());
+    }
+}
+
+void KeyKindsAndModes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"key", "sorted"});
+    for (int kind : {RSA_SIGNING, AES_ENCRYPTION, EC_ATTESTED}) {
+        b->Args({kind, 0});
+        b->Args({kind, 1});
+    }
+}
+
+void BM_SerializeStream(benchmark::State& state) {
+    AuthorizationSet characteristics = MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0)));
+    for (auto _ : state) {
+        std::stringstream stream;
+        characteristics.Serialize(&stream);
+        benchmark::DoNotOptimize(stream.tellp());
+    }
+}
+
+void BM_SerializeBuffer(benchmark::State& state) {
+    AuthorizationSet characteristics = MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0)));
+    for (auto _ : state) {
+        std::vector<uint8_t> buffer(characteristics.SerializedSize());
+        benchmark::DoNotOptimize(
+                characteristics.Serialize(buffer.data(), buffer.data() + buffer.size()));
+    }
+}
+
+void BM_DeserializeStream(benchmark::State& state) {
+    std::stringstream serialized;
+    MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0))).Serialize(&serialized);
+    std::string data = serialized.str();
+    for (auto _ : state) {
+        std::stringstream stream(data);
+        AuthorizationSet set;
+        set.Deserialize(&stream);
+        benchmark::DoNotOptimize(set.size());
+    }
+}
+
+void BM_DeserializeBuffer(benchmark::State& state) {
+    AuthorizationSet characteristics = MakeKeyCharacteristics(static_cast<KeyKind>(state.range(0)));
+    std::vector<uint8_t> data(characteristics.SerializedSize());
+    characteristics.Serialize(data.data(), data.data() + data.size());
+    for (auto _ : state) {
+        AuthorizationSet set;
+        if (state.range(1)) {
+            set.DeserializeBorrowed(data.data(), data.data() + data.size());
+        } else {
+            set.Deserialize(data.data(), data.data() + data.size());
+        }
+        benchmark::DoNotOptimize(set.size());
+    }
+}
+
+void KeyKinds(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"key"});
+    for (int kind : {RSA_SIGNING, AES_ENCRYPTION, EC_ATTESTED}) {
+        b->Args({kind});
+    }
+}
+
+void KeyKindsAndBorrowing(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"key", "borrowed"});
+    for (int kind : {RSA_SIGNING, AES_ENCRYPTION, EC_ATTESTED}) {
+        b->Args({kind, 0});
+        b->Args({kind, 1});
+    }
+}
+
+BENCHMARK(BM_Lookup)->Apply(KeyKindsAndModes);
+BENCHMARK(BM_BuildAndDeduplicate)->Apply(KeyKindsAndModes);
+BENCHMARK(BM_SerializeStream)->Apply(KeyKinds);
+BENCHMARK(BM_SerializeBuffer)->Apply(KeyKinds);
+BENCHMARK(BM_DeserializeStream)->Apply(KeyKinds);
+BENCHMARK(BM_DeserializeBuffer)->Apply(KeyKindsAndBorrowing);
+
+}  // namespace
+
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_BUFFERED_OPERATION_H_
+#define HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_BUFFERED_OPERATION_H_
+
+#include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+
+/**
+ * BufferedOperation coalesces the input of many small update() calls on an operation into fewer,
+ * larger ones, each of chunkSize bytes, to save binder transactions on the bulk operations that do
+ * not need per-update parameters (AES, HMAC, signing).
+ *
+ * The input the HAL does not consume stays buffered and is sent again, ahead of new input. The
+ * remaining input goes with finish().
+ */
+class BufferedOperation {
+   public:
+    static constexpr size_t kDefaultChunkSize = 32 * 1024;
+    // Chunk sizes are clamped to this, the chunk size keystore uses, which all HALs accept.
+    static constexpr size_t kMaxChunkSize = 64 * 1024;
+
+    BufferedOperation(const sp<IKeymasterDevice>& device, uint64_t operationHandle,
+                      const HardwareAuthToken& authToken = {},
+                      const VerificationToken& verificationToken = {},
+                      size_t chunkSize = kDefaultChunkSize);
+
+    /**
+     * Buffers the input, sending the full chunks to the HAL. The output the HAL returns is appended
+     * to output.
+     */
+    ErrorCode update(const uint8_t* input, size_t size, std::vector<uint8_t>* output);
+
+    /**
+     * Sends the buffered and given input, and finishes the operation.
+     */
+    ErrorCode finish(const uint8_t* input, size_t size, const hidl_vec<uint8_t>& signature,
+                     std::vector<uint8_t>* output, hidl_vec<KeyParameter>* outParams = nullptr);
+
+    ErrorCode abort();
+
+    // Total input the HAL has consumed so far
+    uint64_t inputConsumed() const { return inputConsumed_; }
+    // Input given to update() that the HAL has not consumed yet
+    size_t buffered() const { return buffer_.size() - bufferStart_; }
+    // update() and finish() calls made on the HAL
+    size_t transactionCount() const { return transactionCount_; }
+
+   private:
+    void append(const uint8_t* input, size_t size);
+    // Sends the buffered input, as long as there is at least minSize of it and the HAL consumes
+    // some of it.
+    ErrorCode flush(size_t minSize, std::vector<uint8_t>* output);
+
+    const sp<IKeymasterDevice> device_;
+    const uint64_t operationHandle_;
+    const HardwareAuthToken authToken_;
+    const VerificationToken verificationToken_;
+    const size_t chunkSize_;
+
+    // The buffered input is buffer_[bufferStart_, end). The consumed input before it is only
+    // erased when new input is appended, once per call rather than once per chunk.
+    std::vector<uint8_t> buffer_;
+    size_t bufferStart_ = 0;
+    uint64_t inputConsumed_ = 0;
+    size_t transactionCount_ = 0;
+};
+
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_KEYMASTER_40_SUPPORT_BUFFERED_OPERATION_H_
@@ -17,7 +17,10 @@
 #ifndef HARDWARE_INTERFACES_KEYMASTER_40_VTS_FUNCTIONAL_ATTESTATION_RECORD_H_
 #define HARDWARE_INTERFACES_KEYMASTER_40_VTS_FUNCTIONAL_ATTESTATION_RECORD_H_
 
+#include <vector>
+
 #include <android/hardware/keymaster/4.0/IKeymasterDevice.h>
+#include <openssl/bytestring.h>
 
 namespace android {
 namespace hardware {
@@ -64,6 +67,79 @@ ErrorCode parse_root_of_trust(const uint8_t* asn1_key_desc, size_t asn1_key_desc
                               keymaster_verified_boot_t* verified_boot_state, bool* device_locked,
                               hidl_vec<uint8_t>* verified_boot_hash);
 
+/**
+ * A view of a DER-encoded attestation record that decodes its fields on demand, for callers that
+ * only need a few of them. parse() only locates the fields of the KeyDescription sequence; each
+ * getter then decodes its field, or walks an authorization list to find a tag.
+ *
+ * The view points into the record it was parsed from, which must outlive it, unless the view was
+ * filled by parse_attestation_certificates. Byte fields are returned without a copy, as external
+ * hidl_vecs.
+ *
+ * The version and security level getters return ErrorCode::UNKNOWN_ERROR for a value that does
+ * not fit in 32 bits. Getters of authorization list tags return ErrorCode::INVALID_TAG if the tag
+ * is absent, and ErrorCode::UNKNOWN_ERROR if its value is malformed.
+ */
+class AttestationRecordView {
+  public:
+    enum class AuthList { SOFTWARE_ENFORCED, TEE_ENFORCED };
+
+    AttestationRecordView() = default;
+    AttestationRecordView(AttestationRecordView&&) = default;
+    AttestationRecordView& operator=(AttestationRecordView&&) = default;
+    // The fields point into mOwnedRecord, so copies would dangle.
+    AttestationRecordView(const AttestationRecordView&) = delete;
+    AttestationRecordView& operator=(const AttestationRecordView&) = delete;
+
+    ErrorCode parse(const uint8_t* asn1_key_desc, size_t asn1_key_desc_len);
+
+    ErrorCode attestationVersion(uint32_t* version) const;
+    ErrorCode attestationSecurityLevel(SecurityLevel* securityLevel) const;
+    ErrorCode keymasterVersion(uint32_t* version) const;
+    ErrorCode keymasterSecurityLevel(SecurityLevel* securityLevel) const;
+    ErrorCode attestationChallenge(hidl_vec<uint8_t>* challenge) const;
+    ErrorCode uniqueId(hidl_vec<uint8_t>* uniqueId) const;
+
+    bool hasTag(AuthList list, Tag tag) const;
+    // For the INTEGER tags: ENUM, UINT, ULONG and DATE ones.
+    ErrorCode getInteger(AuthList list, Tag tag, uint64_t* value) const;
+    // For the repeatable INTEGER tags, such as TAG_PURPOSE or TAG_DIGEST.
+    ErrorCode getIntegers(AuthList list, Tag tag, std::vector<uint64_t>* values) const;
+    ErrorCode getBytes(AuthList list, Tag tag, hidl_vec<uint8_t>* value) const;
+    // The root of trust is only in the TEE enforced list.
+    ErrorCode rootOfTrust(hidl_vec<uint8_t>* verified_boot_key,
+                          keymaster_verified_boot_t* verified_boot_state, bool* device_locked,
+                          hidl_vec<uint8_t>* verified_boot_hash) const;
+
+  private:
+    friend std::vector<ErrorCode> parse_attestation_certificates(
+        const std::vector<hidl_vec<uint8_t>>& certificates, size_t threads,
+        std::vector<AttestationRecordView>* views);
+
+    bool findTag(AuthList list, Tag tag, CBS* value) const;
+
+    std::vector<uint8_t> mOwnedRecord;
+    bool mParsed = false;
+    CBS mAttestationVersion;
+    CBS mAttestationSecurityLevel;
+    CBS mKeymasterVersion;
+    CBS mKeymasterSecurityLevel;
+    CBS mAttestationChallenge;
+    CBS mUniqueId;
+    CBS mSoftwareEnforced;
+    CBS mTeeEnforced;
+};
+
+/**
+ * Finds the attestation extension of each DER-encoded certificate, typically the leaves of the
+ * chains to check, and parses it into (*views)[i], using up to threads threads. The views own a
+ * copy of their record. Returns the error of each certificate, ErrorCode::INVALID_ARGUMENT for a
+ * certificate without attestation extension.
+ */
+std::vector<ErrorCode> parse_attestation_certificates(
+    const std::vector<hidl_vec<uint8_t>>& certificates, size_t threads,
+    std::vector<AttestationRecordView>* views);
+
 }  // namespace V4_0
 }  // namespace keymaster
 }  // namespace hardware
@@ -17,6 +17,7 @@
 #ifndef SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 #define SYSTEM_SECURITY_KEYSTORE_KM4_AUTHORIZATION_SET_H_
 
+#include <algorithm>
 #include <vector>
 
 #include <keymasterV4_0/keymaster_tags.h>
@@ -43,10 +44,12 @@ class AuthorizationSet {
     AuthorizationSet(){};
 
     // Copy constructor.
-    AuthorizationSet(const AuthorizationSet& other) : data_(other.data_) {}
+    AuthorizationSet(const AuthorizationSet& other)
+        : data_(other.data_), keep_sorted_(other.keep_sorted_) {}
 
     // Move constructor.
-    AuthorizationSet(AuthorizationSet&& other) noexcept : data_(std::move(other.data_)) {}
+    AuthorizationSet(AuthorizationSet&& other) noexcept
+        : data_(std::move(other.data_)), keep_sorted_(other.keep_sorted_) {}
 
     // Constructor from hidl_vec<KeyParameter>
     AuthorizationSet(const hidl_vec<KeyParameter>& other) { *this = other; }
@@ -54,12 +57,14 @@ class AuthorizationSet {
     // Copy assignment.
     AuthorizationSet& operator=(const AuthorizationSet& other) {
         data_ = other.data_;
+        keep_sorted_ = other.keep_sorted_;
         return *this;
     }
 
     // Move assignment.
     AuthorizationSet& operator=(AuthorizationSet&& other) noexcept {
         data_ = std::move(other.data_);
+        keep_sorted_ = other.keep_sorted_;
         return *this;
     }
 
@@ -71,6 +76,7 @@ class AuthorizationSet {
                  * See assignment operator/copy constructor of hidl_vec.*/
                 data_[i] = other[i];
             }
+            if (keep_sorted_) Sort();
         }
         return *this;
     }
@@ -102,6 +108,18 @@ class AuthorizationSet {
      */
     void Sort();
 
+    /**
+     * Sorts the set, and keeps it sorted from then on: entries are inserted in order, and tag
+     * lookups (find, Contains, GetTagCount, GetTagValue) are binary searches instead of scans.
+     * Indices of entries then change as others are added.
+     */
+    void KeepSorted();
+
+    /**
+     * Returns true if KeepSorted() was called on the set, or on the set it was copied from.
+     */
+    bool IsKeptSorted() const { return keep_sorted_; }
+
     /**
      * Sorts the set and removes duplicates (inadvertently duplicating tags is easy to do with the
      * AuthorizationSetBuilder).
@@ -149,14 +167,8 @@ class AuthorizationSet {
     /**
      * Returns the nth element of the set.
      * Like for std::vector::operator[] there is no range check performed. Use of out of range
-     * indices is undefined.
-     */
-    KeyParameter& operator[](int n);
-
-    /**
-     * Returns the nth element of the set.
-     * Like for std::vector::operator[] there is no range check performed. Use of out of range
-     * indices is undefined.
+     * indices is undefined. Entries are read-only, as changing one in place could break the order
+     * of a sorted set; erase it and push_back the new one instead.
      */
     const KeyParameter& operator[](int n) const;
 
@@ -167,8 +179,11 @@ class AuthorizationSet {
 
     template <TagType tag_type, Tag tag, typename ValueT>
     bool Contains(TypedTag<tag_type, tag> ttag, const ValueT& value) const {
-        for (const auto& param : data_) {
-            auto entry = authorizationValue(ttag, param);
+        // Sorted, the entries of the tag are contiguous from the first one.
+        auto i = keep_sorted_ ? data_.begin() + std::max(find(tag), 0) : data_.begin();
+        for (; i != data_.end(); ++i) {
+            if (keep_sorted_ && i->tag != tag) break;
+            auto entry = authorizationValue(ttag, *i);
             if (entry.isOk() && static_cast<ValueT>(entry.value()) == value) return true;
         }
         return false;
@@ -185,8 +200,11 @@ class AuthorizationSet {
         return {};
     }
 
-    void push_back(const KeyParameter& param) { data_.push_back(param); }
-    void push_back(KeyParameter&& param) { data_.push_back(std::move(param)); }
+    void push_back(const KeyParameter& param) { data_.insert(insertPosition(param), param); }
+    void push_back(KeyParameter&& param) {
+        auto pos = insertPosition(param);
+        data_.insert(pos, std::move(param));
+    }
     void push_back(const AuthorizationSet& set) {
         for (auto& entry : set) {
             push_back(entry);
@@ -222,10 +240,38 @@ class AuthorizationSet {
     void Serialize(std::ostream* out) const;
     void Deserialize(std::istream* in);
 
+    /**
+     * Returns the size of the serialized set, or 0 if it cannot be serialized.
+     */
+    size_t SerializedSize() const;
+
+    /**
+     * Serializes the set into [buf, end), in the format of Serialize(std::ostream*). The set is
+     * measured first, then written straight into buf. Returns the end of the written data, or
+     * nullptr if the set cannot be serialized or does not fit.
+     */
+    uint8_t* Serialize(uint8_t* buf, const uint8_t* end) const;
+
+    /**
+     * Replaces the set with the serialized set at the beginning of [data, end). Returns the end of
+     * the serialized set, or nullptr if it is malformed, in which case the set is left empty.
+     */
+    const uint8_t* Deserialize(const uint8_t* data, const uint8_t* end);
+
+    /**
+     * As Deserialize(), but the blob and bignum entries refer to the input instead of copying it.
+     * The input must outlive the set, or the set must be copied, as copies own their blobs.
+     */
+    const uint8_t* DeserializeBorrowed(const uint8_t* data, const uint8_t* end);
+
    private:
     NullOr<const KeyParameter&> GetEntry(Tag tag) const;
 
+    // Where param goes: in order if the set is kept sorted, after the other entries otherwise.
+    std::vector<KeyParameter>::iterator insertPosition(const KeyParameter& param);
+
     std::vector<KeyParameter> data_;
+    bool keep_sorted_ = false;
 };
 
 class AuthorizationSetBuilder : public AuthorizationSet {
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <keymasterV4_0/BufferedOperation.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace support {
+namespace test {
+namespace {
+
+constexpr uint64_t kOperationHandle = 42;
+
+// Consumes the input of update() in whole blocks, up to maxConsumed, and echoes what it consumed
+// as output. finish() echoes its input.
+class FakeDevice : public IKeymasterDevice {
+   public:
+    explicit FakeDevice(bool* destroyed = nullptr) : destroyed_(destroyed) {}
+    ~FakeDevice() {
+        if (destroyed_) *destroyed_ = true;
+    }
+
+    size_t blockSize = 1;
+    size_t maxConsumed = SIZE_MAX;
+    ErrorCode updateError = ErrorCode::OK;
+
+    // The size of the input of each update(), and the input of finish()
+    std::vector<size_t> updateSizes;
+    std::vector<uint8_t> finishInput;
+    bool aborted = false;
+
+    Return<void> update(uint64_t operationHandle, const hidl_vec<KeyParameter>& /* inParams */,
+                        const hidl_vec<uint8_t>& input, const HardwareAuthToken& /* authToken */,
+                        const VerificationToken& /* verificationToken */,
+                        update_cb _hidl_cb) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        updateSizes.push_back(input.size());
+        if (updateError != ErrorCode::OK) {
+            _hidl_cb(updateError, 0, {}, {});
+            return Void();
+        }
+        size_t consumed = std::min(input.size() / blockSize * blockSize, maxConsumed);
+        hidl_vec<uint8_t> output = std::vector<uint8_t>(input.data(), input.data() + consumed);
+        _hidl_cb(ErrorCode::OK, consumed, {}, output);
+        return Void();
+    }
+
+    Return<void> finish(uint64_t operationHandle, const hidl_vec<KeyParameter>& /* inParams */,
+                        const hidl_vec<uint8_t>& input, const hidl_vec<uint8_t>& /* signature */,
+                        const HardwareAuthToken& /* authToken */,
+                        const VerificationToken& /* verificationToken */,
+                        finish_cb _hidl_cb) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        finishInput.assign(input.begin(), input.end());
+        _hidl_cb(ErrorCode::OK, {}, input);
+        return Void();
+    }
+
+    Return<ErrorCode> abort(uint64_t operationHandle) override {
+        EXPECT_EQ(kOperationHandle, operationHandle);
+        aborted = true;
+        return ErrorCode::OK;
+    }
+
+    // Not used by BufferedOperation
+
+    Return<void> getHardwareInfo(getHardwareInfo_cb) override { return Void(); }
+    Return<void> getHmacSharingParameters(getHmacSharingParameters_cb) override { return Void(); }
+    Return<void> computeSharedHmac(const hidl_vec<HmacSharingParameters>&,
+                                   computeSharedHmac_cb) override {
+        return Void();
+    }
+    Return<void> verifyAuthorization(uint64_t, const hidl_vec<KeyParameter>&,
+                                     const HardwareAuthToken&, verifyAuthorization_cb) override {
+        return Void();
+    }
+    Return<ErrorCode> addRngEntropy(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<void> generateKey(const hidl_vec<KeyParameter>&, generateKey_cb) override {
+        return Void();
+    }
+    Return<void> importKey(const hidl_vec<KeyParameter>&, KeyFormat, const hidl_vec<uint8_t>&,
+                           importKey_cb) override {
+        return Void();
+    }
+    Return<void> importWrappedKey(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                  const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                                  uint64_t, uint64_t, importWrappedKey_cb) override {
+        return Void();
+    }
+    Return<void> getKeyCharacteristics(const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                                       const hidl_vec<uint8_t>&,
+                                       getKeyCharacteristics_cb) override {
+        return Void();
+    }
+    Return<void> exportKey(KeyFormat, const hidl_vec<uint8_t>&, const hidl_vec<uint8_t>&,
+                           const hidl_vec<uint8_t>&, exportKey_cb) override {
+        return Void();
+    }
+    Return<void> attestKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                           attestKey_cb) override {
+        return Void();
+    }
+    Return<void> upgradeKey(const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                            upgradeKey_cb) override {
+        return Void();
+    }
+    Return<ErrorCode> deleteKey(const hidl_vec<uint8_t>&) override {
+        return ErrorCode::UNIMPLEMENTED;
+    }
+    Return<ErrorCode> deleteAllKeys() override { return ErrorCode::UNIMPLEMENTED; }
+    Return<ErrorCode> destroyAttestationIds() override { return ErrorCode::UNIMPLEMENTED; }
+    Return<void> begin(KeyPurpose, const hidl_vec<uint8_t>&, const hidl_vec<KeyParameter>&,
+                       const HardwareAuthToken&, begin_cb) override {
+        return Void();
+    }
+
+   private:
+    bool* const destroyed_;
+};
+
+std::vector<uint8_t> sequence(size_t size, uint8_t first = 0) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = first + i;
+    return data;
+}
+
+class BufferedOperationTest : public ::testing::Test {
+   protected:
+    BufferedOperationTest() : device_(new FakeDevice) {}
+
+    std::unique_ptr<BufferedOperation> makeOperation(size_t chunkSize) {
+        return std::make_unique<BufferedOperation>(device_, kOperationHandle,
+                                                   HardwareAuthToken{}, VerificationToken{},
+                                                   chunkSize);
+    }
+
+    sp<FakeDevice> device_;
+};
+
+}  // namespace
+
+TEST_F(BufferedOperationTest, CoalescesSmallUpdates) {
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(100);
+    std::vector<uint8_t> output;
+    for (uint8_t byte : input) {
+        ASSERT_EQ(ErrorCode::OK, operation->update(&byte, 1, &output));
+    }
+    EXPECT_EQ(std::vector<size_t>(6, 16), device_->updateSizes);
+    EXPECT_EQ(4u, operation->buffered());
+    EXPECT_EQ(96u, operation->inputConsumed());
+
+    ASSERT_EQ(ErrorCode::OK, operation->finish(nullptr, 0, {}, &output));
+    EXPECT_EQ(sequence(4, 96), device_->finishInput);
+    EXPECT_EQ(input, output);
+    EXPECT_EQ(100u, operation->inputConsumed());
+    EXPECT_EQ(0u, operation->buffered());
+    EXPECT_EQ(7u, operation->transactionCount());
+}
+
+TEST_F(BufferedOperationTest, SplitsLargeInputIntoChunks) {
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(40);
+    std::vector<uint8_t> output;
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), input.size(), &output));
+    EXPECT_EQ(std::vector<size_t>({16, 16}), device_->updateSizes);
+    EXPECT_EQ(8u, operation->buffered());
+    EXPECT_EQ(sequence(32), output);
+}
+
+TEST_F(BufferedOperationTest, ResendsTheInputTheHalDidNotConsume) {
+    device_->blockSize = 10;
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(48);
+    std::vector<uint8_t> output;
+
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), 16, &output));
+    EXPECT_EQ(std::vector<size_t>({16}), device_->updateSizes);
+    EXPECT_EQ(6u, operation->buffered());
+
+    // The 6 bytes left over go first
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data() + 16, 32, &output));
+    EXPECT_EQ(std::vector<size_t>({16, 16, 16, 16}), device_->updateSizes);
+    EXPECT_EQ(8u, operation->buffered());
+    EXPECT_EQ(sequence(40), output);
+
+    ASSERT_EQ(ErrorCode::OK, operation->finish(nullptr, 0, {}, &output));
+    EXPECT_EQ(input, output);
+}
+
+TEST_F(BufferedOperationTest, StopsWhenTheHalConsumesNothing) {
+    device_->maxConsumed = 0;
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(40);
+    std::vector<uint8_t> output;
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), input.size(), &output));
+    EXPECT_EQ(std::vector<size_t>({16}), device_->updateSizes);
+    EXPECT_EQ(40u, operation->buffered());
+    EXPECT_TRUE(output.empty());
+}
+
+TEST_F(BufferedOperationTest, FinishSendsAtMostOneChunk) {
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(20);
+    std::vector<uint8_t> output;
+
+    ASSERT_EQ(ErrorCode::OK, operation->finish(input.data(), 16, {}, &output));
+    EXPECT_TRUE(device_->updateSizes.empty());
+    EXPECT_EQ(sequence(16), device_->finishInput);
+}
+
+TEST_F(BufferedOperationTest, FinishFlushesTheFullChunksFirst) {
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(20);
+    std::vector<uint8_t> output;
+
+    ASSERT_EQ(ErrorCode::OK, operation->finish(input.data(), input.size(), {}, &output));
+    EXPECT_EQ(std::vector<size_t>({16}), device_->updateSizes);
+    EXPECT_EQ(sequence(4, 16), device_->finishInput);
+    EXPECT_EQ(input, output);
+}
+
+TEST_F(BufferedOperationTest, ReturnsUpdateErrors) {
+    device_->updateError = ErrorCode::INVALID_INPUT_LENGTH;
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(16);
+    std::vector<uint8_t> output;
+
+    EXPECT_EQ(ErrorCode::INVALID_INPUT_LENGTH,
+              operation->update(input.data(), input.size(), &output));
+    EXPECT_EQ(16u, operation->buffered());
+    EXPECT_EQ(0u, operation->inputConsumed());
+}
+
+TEST_F(BufferedOperationTest, AbortDropsTheBufferedInput) {
+    auto operation = makeOperation(16);
+    std::vector<uint8_t> input = sequence(8);
+    std::vector<uint8_t> output;
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), input.size(), &output));
+
+    EXPECT_EQ(ErrorCode::OK, operation->abort());
+    EXPECT_TRUE(device_->aborted);
+    EXPECT_EQ(0u, operation->buffered());
+}
+
+TEST_F(BufferedOperationTest, ClampsTheChunkSize) {
+    std::vector<uint8_t> input = sequence(BufferedOperation::kMaxChunkSize + 1);
+    std::vector<uint8_t> output;
+
+    auto operation = makeOperation(0);
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), 2, &output));
+    EXPECT_EQ(std::vector<size_t>({1, 1}), device_->updateSizes);
+
+    device_->updateSizes.clear();
+    operation = makeOperation(SIZE_MAX);
+    ASSERT_EQ(ErrorCode::OK, operation->update(input.data(), input.size(), &output));
+    EXPECT_EQ(std::vector<size_t>({BufferedOperation::kMaxChunkSize}), device_->updateSizes);
+}
+
+TEST(BufferedOperationDeviceTest, KeepsTheDeviceAlive) {
+    bool destroyed = false;
+    std::unique_ptr<BufferedOperation> operation;
+    {
+        sp<FakeDevice> device = new FakeDevice(&destroyed);
+        operation = std::make_unique<BufferedOperation>(device, kOperationHandle);
+    }
+    EXPECT_FALSE(destroyed);
+
+    std::vector<uint8_t> output;
+    EXPECT_EQ(ErrorCode::OK, operation->finish(nullptr, 0, {}, &output));
+    operation.reset();
+    EXPECT_TRUE(destroyed);
+}
+
+}  // namespace test
+}  // namespace support
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,382 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <initializer_list>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+#include <openssl/x509.h>
+
+#include <keymasterV4_0/attestation_record.h>
+#include <keymasterV4_0/openssl_utils.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+using AuthList = AttestationRecordView::AuthList;
+
+const Bytes kChallenge = {'c', 'h', 'a', 'l'};
+const Bytes kUniqueId = {'i', 'd'};
+const Bytes kApplicationId = {'a', 'p', 'p'};
+const Bytes kVerifiedBootKey = {0x01, 0x02, 0x03};
+const Bytes kVerifiedBootHash = {0x04, 0x05};
+
+// The DER identifier octets of a tag number of the given class and form.
+Bytes identifier(uint8_t classAndForm, uint32_t number) {
+    if (number < 31) return {static_cast<uint8_t>(classAndForm | number)};
+    Bytes base128;
+    for (; number > 0; number >>= 7) {
+        base128.insert(base128.begin(), static_cast<uint8_t>((number & 0x7f) | 0x80));
+    }
+    base128.back() &= 0x7f;
+    base128.insert(base128.begin(), static_cast<uint8_t>(classAndForm | 0x1f));
+    return base128;
+}
+
+Bytes tlv(const Bytes& identifier, const Bytes& contents) {
+    Bytes der = identifier;
+    size_t length = contents.size();
+    if (length < 0x80) {
+        der.push_back(length);
+    } else if (length <= 0xff) {
+        der.insert(der.end(), {0x81, static_cast<uint8_t>(length)});
+    } else {
+        der.insert(der.end(), {0x82, static_cast<uint8_t>(length >> 8),
+                               static_cast<uint8_t>(length)});
+    }
+    der.insert(der.end(), contents.begin(), contents.end());
+    return der;
+}
+
+Bytes concat(std::initializer_list<Bytes> elements) {
+    Bytes der;
+    for (const Bytes& element : elements) der.insert(der.end(), element.begin(), element.end());
+    return der;
+}
+
+Bytes sequence(std::initializer_list<Bytes> elements) {
+    return tlv({0x30}, concat(elements));
+}
+
+Bytes set(std::initializer_list<Bytes> elements) {
+    return tlv({0x31}, concat(elements));
+}
+
+Bytes octets(const Bytes& contents) {
+    return tlv({0x04}, contents);
+}
+
+// A non-negative INTEGER (0x02) or ENUMERATED (0x0a), minimally encoded.
+Bytes integer(uint64_t value, uint8_t type = 0x02) {
+    Bytes contents;
+    do {
+        contents.insert(contents.begin(), static_cast<uint8_t>(value));
+        value >>= 8;
+    } while (value > 0);
+    if (contents[0] & 0x80) contents.insert(contents.begin(), 0);
+    return tlv({type}, contents);
+}
+
+Bytes enumerated(uint64_t value) {
+    return integer(value, 0x0a);
+}
+
+// An authorization list entry: the value in an EXPLICIT tag numbered by the masked tag.
+Bytes entry(Tag tag, const Bytes& value) {
+    return tlv(identifier(0xa0, static_cast<uint32_t>(tag) & 0x0FFFFFFF), value);
+}
+
+Bytes softwareEnforced() {
+    return sequence({
+            entry(Tag::PURPOSE, set({integer(2), integer(3)})),
+            entry(Tag::ALGORITHM, integer(3)),
+            entry(Tag::APPLICATION_ID, octets(kApplicationId)),
+    });
+}
+
+Bytes teeEnforced() {
+    return sequence({
+            entry(Tag::ROOT_OF_TRUST,
+                  sequence({octets(kVerifiedBootKey), tlv({0x01}, {0xff}),
+                            enumerated(KM_VERIFIED_BOOT_SELF_SIGNED), octets(kVerifiedBootHash)})),
+    });
+}
+
+Bytes keyDescription(const Bytes& attestationVersion = integer(3),
+                     const Bytes& keymasterVersion = integer(4),
+                     const Bytes& softwareList = softwareEnforced(),
+                     const Bytes& teeList = teeEnforced()) {
+    return sequence({
+            attestationVersion,
+            enumerated(static_cast<uint32_t>(SecurityLevel::TRUSTED_ENVIRONMENT)),
+            keymasterVersion,
+            enumerated(static_cast<uint32_t>(SecurityLevel::STRONGBOX)),
+            octets(kChallenge),
+            octets(kUniqueId),
+            softwareList,
+            teeList,
+    });
+}
+
+Bytes toBytes(const hidl_vec<uint8_t>& vec) {
+    return Bytes(vec.data(), vec.data() + vec.size());
+}
+
+// A self-signed certificate, with the attestation extension if record is not empty.
+Bytes certificate(const Bytes& record) {
+    EVP_PKEY_Ptr key(EVP_PKEY_new());
+    EC_KEY* ecKey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+    EXPECT_TRUE(ecKey != nullptr && EC_KEY_generate_key(ecKey));
+    EXPECT_TRUE(EVP_PKEY_assign_EC_KEY(key.get(), ecKey));
+
+    X509_Ptr x509(X509_new());
+    EXPECT_TRUE(X509_set_version(x509.get(), 2 /* version 3 */));
+    EXPECT_TRUE(ASN1_INTEGER_set(X509_get_serialNumber(x509.get()), 1));
+    X509_NAME* name = X509_get_subject_name(x509.get());
+    EXPECT_TRUE(X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                           reinterpret_cast<const uint8_t*>("test"), -1, -1, 0));
+    EXPECT_TRUE(X509_set_issuer_name(x509.get(), name));
+    EXPECT_TRUE(X509_gmtime_adj(X509_get_notBefore(x509.get()), 0));
+    EXPECT_TRUE(X509_gmtime_adj(X509_get_notAfter(x509.get()), 60 * 60));
+    EXPECT_TRUE(X509_set_pubkey(x509.get(), key.get()));
+
+    if (!record.empty()) {
+        ASN1_OBJECT_Ptr oid(OBJ_txt2obj(kAttestionRecordOid, 1 /* dotted string format */));
+        ASN1_OCTET_STRING* data = ASN1_OCTET_STRING_new();
+        EXPECT_TRUE(ASN1_OCTET_STRING_set(data, record.data(), record.size()));
+        X509_EXTENSION* extension = X509_EXTENSION_create_by_OBJ(nullptr, oid.get(), 0, data);
+        EXPECT_TRUE(extension != nullptr && X509_add_ext(x509.get(), extension, -1));
+        X509_EXTENSION_free(extension);
+        ASN1_OCTET_STRING_free(data);
+    }
+    EXPECT_TRUE(X509_sign(x509.get(), key.get(), EVP_sha256()));
+
+    int length = i2d_X509(x509.get(), nullptr);
+    EXPECT_GT(length, 0);
+    Bytes der(length);
+    uint8_t* p = der.data();
+    EXPECT_EQ(length, i2d_X509(x509.get(), &p));
+    return der;
+}
+
+}  // namespace
+
+TEST(AttestationRecordViewTest, ReadsTheKeyDescription) {
+    Bytes record = keyDescription();
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    uint32_t version = 0;
+    SecurityLevel securityLevel = SecurityLevel::SOFTWARE;
+    EXPECT_EQ(ErrorCode::OK, view.attestationVersion(&version));
+    EXPECT_EQ(3u, version);
+    EXPECT_EQ(ErrorCode::OK, view.attestationSecurityLevel(&securityLevel));
+    EXPECT_EQ(SecurityLevel::TRUSTED_ENVIRONMENT, securityLevel);
+    EXPECT_EQ(ErrorCode::OK, view.keymasterVersion(&version));
+    EXPECT_EQ(4u, version);
+    EXPECT_EQ(ErrorCode::OK, view.keymasterSecurityLevel(&securityLevel));
+    EXPECT_EQ(SecurityLevel::STRONGBOX, securityLevel);
+
+    hidl_vec<uint8_t> bytes;
+    EXPECT_EQ(ErrorCode::OK, view.attestationChallenge(&bytes));
+    EXPECT_EQ(kChallenge, toBytes(bytes));
+    // Not copied out of the record
+    EXPECT_GE(bytes.data(), record.data());
+    EXPECT_LT(bytes.data(), record.data() + record.size());
+    EXPECT_EQ(ErrorCode::OK, view.uniqueId(&bytes));
+    EXPECT_EQ(kUniqueId, toBytes(bytes));
+}
+
+TEST(AttestationRecordViewTest, ReadsTheAuthorizationLists) {
+    Bytes record = keyDescription();
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    EXPECT_TRUE(view.hasTag(AuthList::SOFTWARE_ENFORCED, Tag::ALGORITHM));
+    EXPECT_FALSE(view.hasTag(AuthList::TEE_ENFORCED, Tag::ALGORITHM));
+    EXPECT_FALSE(view.hasTag(AuthList::SOFTWARE_ENFORCED, Tag::KEY_SIZE));
+
+    uint64_t value = 0;
+    EXPECT_EQ(ErrorCode::OK, view.getInteger(AuthList::SOFTWARE_ENFORCED, Tag::ALGORITHM, &value));
+    EXPECT_EQ(3u, value);
+    EXPECT_EQ(ErrorCode::INVALID_TAG,
+              view.getInteger(AuthList::SOFTWARE_ENFORCED, Tag::KEY_SIZE, &value));
+
+    std::vector<uint64_t> values;
+    EXPECT_EQ(ErrorCode::OK, view.getIntegers(AuthList::SOFTWARE_ENFORCED, Tag::PURPOSE, &values));
+    EXPECT_EQ(std::vector<uint64_t>({2, 3}), values);
+
+    hidl_vec<uint8_t> bytes;
+    EXPECT_EQ(ErrorCode::OK,
+              view.getBytes(AuthList::SOFTWARE_ENFORCED, Tag::APPLICATION_ID, &bytes));
+    EXPECT_EQ(kApplicationId, toBytes(bytes));
+}
+
+TEST(AttestationRecordViewTest, ReadsTheRootOfTrust) {
+    Bytes record = keyDescription();
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    hidl_vec<uint8_t> key, hash;
+    keymaster_verified_boot_t state = KM_VERIFIED_BOOT_FAILED;
+    bool locked = false;
+    ASSERT_EQ(ErrorCode::OK, view.rootOfTrust(&key, &state, &locked, &hash));
+    EXPECT_EQ(kVerifiedBootKey, toBytes(key));
+    EXPECT_EQ(KM_VERIFIED_BOOT_SELF_SIGNED, state);
+    EXPECT_TRUE(locked);
+    EXPECT_EQ(kVerifiedBootHash, toBytes(hash));
+}
+
+TEST(AttestationRecordViewTest, RejectsTruncatedRecords) {
+    Bytes record = keyDescription();
+    for (size_t size = 0; size < record.size(); ++size) {
+        SCOPED_TRACE(size);
+        AttestationRecordView view;
+        EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.parse(record.data(), size));
+
+        // Nothing is read from a view that failed to parse
+        uint32_t version;
+        hidl_vec<uint8_t> bytes;
+        EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.attestationVersion(&version));
+        EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.attestationChallenge(&bytes));
+        EXPECT_FALSE(view.hasTag(AuthList::SOFTWARE_ENFORCED, Tag::ALGORITHM));
+    }
+}
+
+TEST(AttestationRecordViewTest, RejectsFieldsOfTheWrongType) {
+    // The attestation version as an OCTET STRING
+    Bytes record = keyDescription(octets({3}));
+    AttestationRecordView view;
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.parse(record.data(), record.size()));
+}
+
+TEST(AttestationRecordViewTest, RejectsVersionsAbove32Bits) {
+    Bytes record = keyDescription(integer(uint64_t(1) << 32), integer(UINT32_MAX));
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    uint32_t version = 0;
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.attestationVersion(&version));
+    EXPECT_EQ(ErrorCode::OK, view.keymasterVersion(&version));
+    EXPECT_EQ(UINT32_MAX, version);
+}
+
+TEST(AttestationRecordViewTest, RejectsMalformedIntegers) {
+    const Bytes malformed[] = {
+            tlv({0x02}, {}),                                // empty
+            tlv({0x02}, {0xff}),                            // negative
+            tlv({0x02}, {0x00, 0x01}),                      // not minimally encoded
+            tlv({0x02}, {0x01, 0, 0, 0, 0, 0, 0, 0, 0}),  // above 64 bits
+    };
+    for (const Bytes& version : malformed) {
+        Bytes record = keyDescription(version);
+        AttestationRecordView view;
+        ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+        uint32_t value;
+        EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, view.attestationVersion(&value));
+    }
+}
+
+TEST(AttestationRecordViewTest, RejectsMalformedTagValues) {
+    Bytes record = keyDescription(integer(3), integer(4), sequence({
+            entry(Tag::PURPOSE, integer(2)),
+            entry(Tag::ALGORITHM, octets({3})),
+            entry(Tag::APPLICATION_ID, integer(1)),
+    }), sequence({
+            entry(Tag::ROOT_OF_TRUST, sequence({octets(kVerifiedBootKey)})),
+    }));
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    uint64_t value;
+    std::vector<uint64_t> values;
+    hidl_vec<uint8_t> bytes;
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR,
+              view.getIntegers(AuthList::SOFTWARE_ENFORCED, Tag::PURPOSE, &values));
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR,
+              view.getInteger(AuthList::SOFTWARE_ENFORCED, Tag::ALGORITHM, &value));
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR,
+              view.getBytes(AuthList::SOFTWARE_ENFORCED, Tag::APPLICATION_ID, &bytes));
+
+    hidl_vec<uint8_t> key, hash;
+    keymaster_verified_boot_t state;
+    bool locked;
+    EXPECT_EQ(ErrorCode::INVALID_ARGUMENT, view.rootOfTrust(&key, &state, &locked, &hash));
+}
+
+TEST(AttestationRecordViewTest, StopsAtACorruptAuthorizationList) {
+    // The second entry claims more bytes than the list holds
+    Bytes list = concat({entry(Tag::PURPOSE, set({integer(2)})), identifier(0xa0, 2), {0x05}});
+    Bytes record = keyDescription(integer(3), integer(4), tlv({0x30}, list));
+    AttestationRecordView view;
+    ASSERT_EQ(ErrorCode::OK, view.parse(record.data(), record.size()));
+
+    EXPECT_TRUE(view.hasTag(AuthList::SOFTWARE_ENFORCED, Tag::PURPOSE));
+    EXPECT_FALSE(view.hasTag(AuthList::SOFTWARE_ENFORCED, Tag::ALGORITHM));
+}
+
+TEST(AttestationRecordViewTest, ParsesTheAttestationCertificates) {
+    std::vector<AttestationRecordView> views;
+    std::vector<ErrorCode> errors;
+    {
+        std::vector<hidl_vec<uint8_t>> certificates = {
+                certificate(keyDescription()),
+                certificate({}),
+                Bytes{0x30, 0x03, 0x02, 0x01, 0x01},
+                certificate(keyDescription(integer(5))),
+        };
+        errors = parse_attestation_certificates(certificates, 2, &views);
+    }
+    // The views own their records, so they outlive the certificates.
+    ASSERT_EQ(4u, errors.size());
+    ASSERT_EQ(4u, views.size());
+    EXPECT_EQ(ErrorCode::OK, errors[0]);
+    EXPECT_EQ(ErrorCode::INVALID_ARGUMENT, errors[1]);
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, errors[2]);
+    EXPECT_EQ(ErrorCode::OK, errors[3]);
+
+    uint32_t version = 0;
+    EXPECT_EQ(ErrorCode::OK, views[0].attestationVersion(&version));
+    EXPECT_EQ(3u, version);
+    EXPECT_EQ(ErrorCode::OK, views[3].attestationVersion(&version));
+    EXPECT_EQ(5u, version);
+    hidl_vec<uint8_t> bytes;
+    EXPECT_EQ(ErrorCode::OK, views[0].attestationChallenge(&bytes));
+    EXPECT_EQ(kChallenge, toBytes(bytes));
+    EXPECT_EQ(ErrorCode::UNKNOWN_ERROR, views[1].attestationVersion(&version));
+}
+
+TEST(AttestationRecordViewTest, ParsesNoCertificates) {
+    std::vector<AttestationRecordView> views(1);
+    EXPECT_TRUE(parse_attestation_certificates({}, 4, &views).empty());
+    EXPECT_TRUE(views.empty());
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
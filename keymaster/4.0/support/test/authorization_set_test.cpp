@@ -0,0 +1,337 @@
+/*
+ * Copyright 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <keymasterV4_0/authorization_set.h>
+
+namespace android {
+namespace hardware {
+namespace keymaster {
+namespace V4_0 {
+namespace test {
+namespace {
+
+const char kApplicationId[] = "application id";
+const size_t kApplicationIdSize = sizeof(kApplicationId) - 1;
+
+// Offsets in the serialized single blob set built by blobSet()
+const size_t kBlobOffset = sizeof(uint32_t);
+const size_t kElementCountOffset = kBlobOffset + kApplicationIdSize;
+const size_t kBlobTagOffset = kElementCountOffset + 2 * sizeof(uint32_t);
+const size_t kBlobLengthOffset = kBlobTagOffset + sizeof(uint32_t);
+const size_t kBlobIndirectOffset = kBlobLengthOffset + sizeof(uint32_t);
+
+AuthorizationSet blobSet() {
+    return AuthorizationSetBuilder().Authorization(TAG_APPLICATION_ID, kApplicationId,
+                                                   kApplicationIdSize);
+}
+
+AuthorizationSet mixedSet() {
+    return AuthorizationSetBuilder()
+            .RsaKey(2048, 65537)
+            .Authorization(TAG_NO_AUTH_REQUIRED)
+            .Authorization(TAG_APPLICATION_ID, kApplicationId, kApplicationIdSize)
+            .Authorization(TAG_APPLICATION_DATA, hidl_vec<uint8_t>());
+}
+
+std::vector<uint8_t> serialize(const AuthorizationSet& set) {
+    std::vector<uint8_t> buffer(set.SerializedSize());
+    EXPECT_EQ(buffer.data() + buffer.size(),
+              set.Serialize(buffer.data(), buffer.data() + buffer.size()));
+    return buffer;
+}
+
+// Repeated and out of order tags
+AuthorizationSet unorderedSet() {
+    return AuthorizationSetBuilder()
+            .Authorization(TAG_APPLICATION_ID, kApplicationId, kApplicationIdSize)
+            .Digest(Digest::SHA_2_256)
+            .Authorization(TAG_PURPOSE, KeyPurpose::SIGN)
+            .Authorization(TAG_KEY_SIZE, 256)
+            .Digest(Digest::NONE)
+            .Authorization(TAG_PURPOSE, KeyPurpose::VERIFY)
+            .Authorization(TAG_NO_AUTH_REQUIRED);
+}
+
+const Tag kLookedUpTags[] = {Tag::PURPOSE,         Tag::DIGEST,         Tag::KEY_SIZE,
+                             Tag::NO_AUTH_REQUIRED, Tag::APPLICATION_ID, Tag::ALGORITHM};
+
+bool isOrdered(const AuthorizationSet& set) {
+    for (size_t i = 1; i < set.size(); ++i) {
+        if (set[i].tag < set[i - 1].tag) return false;
+    }
+    return true;
+}
+
+void write32(std::vector<uint8_t>* buffer, size_t offset, uint32_t value) {
+    memcpy(buffer->data() + offset, &value, sizeof(value));
+}
+
+void expectEqual(const AuthorizationSet& expected, const AuthorizationSet& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_TRUE(expected[i] == actual[i]) << "at " << i;
+    }
+}
+
+// Deserializes buffer with both buffer versions, which must fail and leave the set empty.
+void expectMalformed(const std::vector<uint8_t>& buffer) {
+    const uint8_t* end = buffer.data() + buffer.size();
+    AuthorizationSet set = blobSet();
+    EXPECT_EQ(nullptr, set.Deserialize(buffer.data(), end));
+    EXPECT_TRUE(set.empty());
+    set = blobSet();
+    EXPECT_EQ(nullptr, set.DeserializeBorrowed(buffer.data(), end));
+    EXPECT_TRUE(set.empty());
+}
+
+}  // namespace
+
+TEST(AuthorizationSetTest, SerializeRoundTrip) {
+    AuthorizationSet set = mixedSet();
+    std::vector<uint8_t> buffer = serialize(set);
+
+    AuthorizationSet deserialized;
+    EXPECT_EQ(buffer.data() + buffer.size(),
+              deserialized.Deserialize(buffer.data(), buffer.data() + buffer.size()));
+    expectEqual(set, deserialized);
+}
+
+TEST(AuthorizationSetTest, SerializeMatchesStream) {
+    AuthorizationSet set = mixedSet();
+    std::vector<uint8_t> buffer = serialize(set);
+
+    std::stringstream stream;
+    set.Serialize(&stream);
+    EXPECT_EQ(std::string(buffer.begin(), buffer.end()), stream.str());
+
+    AuthorizationSet deserialized;
+    deserialized.Deserialize(&stream);
+    EXPECT_TRUE(stream.good());
+    expectEqual(set, deserialized);
+}
+
+TEST(AuthorizationSetTest, SerializeFailsWhenItDoesNotFit) {
+    AuthorizationSet set = mixedSet();
+    std::vector<uint8_t> buffer(set.SerializedSize() - 1);
+    EXPECT_EQ(nullptr, set.Serialize(buffer.data(), buffer.data() + buffer.size()));
+}
+
+TEST(AuthorizationSetTest, DeserializeStopsAtTheEndOfTheSet) {
+    std::vector<uint8_t> buffer = serialize(mixedSet());
+    size_t size = buffer.size();
+    buffer.resize(size + 16, 0xff);
+
+    AuthorizationSet set;
+    EXPECT_EQ(buffer.data() + size, set.Deserialize(buffer.data(), buffer.data() + buffer.size()));
+    expectEqual(mixedSet(), set);
+}
+
+TEST(AuthorizationSetTest, DeserializeTruncated) {
+    std::vector<uint8_t> buffer = serialize(mixedSet());
+    for (size_t size = 0; size < buffer.size(); ++size) {
+        SCOPED_TRACE(size);
+        expectMalformed(std::vector<uint8_t>(buffer.begin(), buffer.begin() + size));
+    }
+}
+
+TEST(AuthorizationSetTest, DeserializeTruncatedStream) {
+    std::vector<uint8_t> buffer = serialize(mixedSet());
+    std::stringstream stream(std::string(buffer.begin(), buffer.end() - 1));
+
+    AuthorizationSet set;
+    set.Deserialize(&stream);
+    EXPECT_FALSE(stream.good());
+    EXPECT_TRUE(set.empty());
+}
+
+TEST(AuthorizationSetTest, DeserializeBlobPastTheIndirectData) {
+    std::vector<uint8_t> buffer = serialize(blobSet());
+    ASSERT_EQ(kBlobIndirectOffset + sizeof(uint32_t), buffer.size());
+
+    std::vector<uint8_t> offset_past_end = buffer;
+    write32(&offset_past_end, kBlobIndirectOffset, kApplicationIdSize + 1);
+    expectMalformed(offset_past_end);
+
+    std::vector<uint8_t> length_past_end = buffer;
+    write32(&length_past_end, kBlobLengthOffset, kApplicationIdSize + 1);
+    expectMalformed(length_past_end);
+
+    // offset + length overflows 32 bits
+    std::vector<uint8_t> length_overflow = buffer;
+    write32(&length_overflow, kBlobIndirectOffset, 1);
+    write32(&length_overflow, kBlobLengthOffset, 0xffffffff);
+    expectMalformed(length_overflow);
+}
+
+TEST(AuthorizationSetTest, DeserializeOversizedElementCount) {
+    std::vector<uint8_t> buffer = serialize(blobSet());
+
+    write32(&buffer, kElementCountOffset, 2);
+    expectMalformed(buffer);
+
+    // Must fail before allocating that many entries
+    write32(&buffer, kElementCountOffset, 0xffffffff);
+    expectMalformed(buffer);
+}
+
+TEST(AuthorizationSetTest, DeserializeUnknownTag) {
+    std::vector<uint8_t> buffer = serialize(blobSet());
+    write32(&buffer, kBlobTagOffset, static_cast<uint32_t>(TagType::BYTES) | 9999);
+    expectMalformed(buffer);
+}
+
+TEST(AuthorizationSetTest, DeserializeBorrowedRefersToTheInput) {
+    std::vector<uint8_t> buffer = serialize(blobSet());
+
+    AuthorizationSet borrowed;
+    EXPECT_EQ(buffer.data() + buffer.size(),
+              borrowed.DeserializeBorrowed(buffer.data(), buffer.data() + buffer.size()));
+    ASSERT_EQ(1u, borrowed.size());
+    expectEqual(blobSet(), borrowed);
+    EXPECT_EQ(buffer.data() + kBlobOffset, &borrowed[0].blob[0]);
+
+    // A copy owns its blob
+    AuthorizationSet copy = borrowed;
+    EXPECT_NE(&borrowed[0].blob[0], &copy[0].blob[0]);
+    buffer[kBlobOffset] = 'A';
+    EXPECT_EQ('A', borrowed[0].blob[0]);
+    expectEqual(blobSet(), copy);
+}
+
+TEST(AuthorizationSetTest, EntriesAreReadOnly) {
+    static_assert(std::is_same<decltype(std::declval<AuthorizationSet&>()[0]),
+                               const KeyParameter&>::value,
+                  "changing an entry in place could break the order of a sorted set");
+}
+
+TEST(AuthorizationSetTest, KeepSortedKeepsTheOrder) {
+    AuthorizationSet set = unorderedSet();
+    ASSERT_FALSE(isOrdered(set));
+    EXPECT_FALSE(set.IsKeptSorted());
+
+    set.KeepSorted();
+    EXPECT_TRUE(set.IsKeptSorted());
+    EXPECT_TRUE(isOrdered(set));
+
+    set.push_back(TAG_ALGORITHM, Algorithm::EC);
+    set.push_back(TAG_PURPOSE, KeyPurpose::ENCRYPT);
+    set.push_back(mixedSet());
+    EXPECT_TRUE(isOrdered(set));
+    EXPECT_EQ(unorderedSet().size() + 2 + mixedSet().size(), set.size());
+
+    ASSERT_TRUE(set.erase(0));
+    set.push_back(TAG_KEY_SIZE, 128);
+    EXPECT_TRUE(isOrdered(set));
+}
+
+TEST(AuthorizationSetTest, SortedLookupsMatchTheScans) {
+    AuthorizationSet unsorted = unorderedSet();
+    AuthorizationSet sorted = unsorted;
+    sorted.KeepSorted();
+
+    for (Tag tag : kLookedUpTags) {
+        SCOPED_TRACE(toString(tag));
+        EXPECT_EQ(unsorted.Contains(tag), sorted.Contains(tag));
+        EXPECT_EQ(unsorted.GetTagCount(tag), sorted.GetTagCount(tag));
+
+        size_t found = 0;
+        for (int pos = -1; (pos = sorted.find(tag, pos)) != -1; ++found) {
+            EXPECT_EQ(tag, sorted[pos].tag);
+        }
+        EXPECT_EQ(sorted.GetTagCount(tag), found);
+    }
+
+    EXPECT_EQ(2u, sorted.GetTagCount(Tag::PURPOSE));
+    EXPECT_EQ(0u, sorted.GetTagCount(Tag::ALGORITHM));
+    EXPECT_TRUE(sorted.Contains(TAG_DIGEST, Digest::NONE));
+    EXPECT_TRUE(sorted.Contains(TAG_DIGEST, Digest::SHA_2_256));
+    EXPECT_FALSE(sorted.Contains(TAG_DIGEST, Digest::MD5));
+    EXPECT_TRUE(sorted.Contains(TAG_PURPOSE, KeyPurpose::VERIFY));
+    EXPECT_FALSE(sorted.Contains(TAG_PURPOSE, KeyPurpose::DECRYPT));
+
+    auto keySize = sorted.GetTagValue(TAG_KEY_SIZE);
+    ASSERT_TRUE(keySize.isOk());
+    EXPECT_EQ(256u, keySize.value());
+    EXPECT_FALSE(sorted.GetTagValue(TAG_ALGORITHM).isOk());
+}
+
+TEST(AuthorizationSetTest, CopiesKeepTheSortedMode) {
+    AuthorizationSet sorted = unorderedSet();
+    sorted.KeepSorted();
+
+    AuthorizationSet copy = sorted;
+    EXPECT_TRUE(copy.IsKeptSorted());
+    AuthorizationSet moved = std::move(copy);
+    EXPECT_TRUE(moved.IsKeptSorted());
+    moved.push_back(TAG_ALGORITHM, Algorithm::AES);
+    EXPECT_TRUE(isOrdered(moved));
+
+    AuthorizationSet assigned;
+    assigned = sorted;
+    EXPECT_TRUE(assigned.IsKeptSorted());
+    assigned = unorderedSet();
+    EXPECT_FALSE(assigned.IsKeptSorted());
+}
+
+TEST(AuthorizationSetTest, SortedSetSortsWhatItReads) {
+    AuthorizationSet unsorted = unorderedSet();
+    std::vector<uint8_t> buffer = serialize(unsorted);
+
+    AuthorizationSet deserialized;
+    deserialized.KeepSorted();
+    EXPECT_EQ(buffer.data() + buffer.size(),
+              deserialized.Deserialize(buffer.data(), buffer.data() + buffer.size()));
+    EXPECT_EQ(unsorted.size(), deserialized.size());
+    EXPECT_TRUE(isOrdered(deserialized));
+
+    AuthorizationSet assigned;
+    assigned.KeepSorted();
+    assigned = unsorted.hidl_data();
+    EXPECT_EQ(unsorted.size(), assigned.size());
+    EXPECT_TRUE(isOrdered(assigned));
+}
+
+TEST(AuthorizationSetTest, SortedUnionAndDeduplicate) {
+    AuthorizationSet sorted = unorderedSet();
+    sorted.KeepSorted();
+    AuthorizationSet expected = unorderedSet();
+    expected.Union(mixedSet());
+
+    sorted.Union(mixedSet());
+    EXPECT_TRUE(isOrdered(sorted));
+    expectEqual(expected, sorted);
+
+    // Already there
+    sorted.push_back(TAG_PURPOSE, KeyPurpose::SIGN);
+    sorted.Deduplicate();
+    expectEqual(expected, sorted);
+}
+
+}  // namespace test
+}  // namespace V4_0
+}  // namespace keymaster
+}  // namespace hardware
+}  // namespace android
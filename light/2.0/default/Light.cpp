@@ -44,18 +44,35 @@ static_assert(BRIGHTNESS_MODE_LOW_PERSISTENCE ==
     "Brightness::LOW_PERSISTENCE must match legacy value.");
 
 Light::Light(std::map<Type, light_device_t*> &&lights)
-  : mLights(std::move(lights)) {}
-
-// Methods from ::android::hardware::light::V2_0::ILight follow.
-Return<Status> Light::setLight(Type type, const LightState& state)  {
-    auto it = mLights.find(type);
+  : mLights(std::move(lights)) {
+    for (auto const& pair : mLights) {
+        mSlots[pair.first] = std::make_unique<LightSlot>(pair.second);
+    }
+}
 
-    if (it == mLights.end()) {
-        return Status::LIGHT_NOT_SUPPORTED;
+Light::~Light() {
+    if (mBacklightThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mSlots.at(Type::BACKLIGHT)->lock);
+            mExiting = true;
+        }
+        mBacklightCond.notify_one();
+        mBacklightThread.join();
     }
+}
 
-    light_device_t* hwLight = it->second;
+static Status toStatus(int ret) {
+    switch (ret) {
+        case -ENOSYS:
+            return Status::BRIGHTNESS_NOT_SUPPORTED;
+        case 0:
+            return Status::SUCCESS;
+        default:
+            return Status::UNKNOWN;
+    }
+}
 
+Status Light::applyLocked(LightSlot* slot, const LightState& state) {
     light_state_t legacyState {
         .color = state.color,
         .flashMode = static_cast<int>(state.flashMode),
@@ -64,15 +81,70 @@ Return<Status> Light::setLight(Type type, const LightState& state)  {
         .brightnessMode = static_cast<int>(state.brightnessMode),
     };
 
-    int ret = hwLight->set_light(hwLight, &legacyState);
+    slot->status = toStatus(slot->device->set_light(slot->device, &legacyState));
+    // A failed state is not cached, so that setting it again retries.
+    slot->applied = slot->status == Status::SUCCESS;
+    slot->state = state;
+    slot->appliedTime = std::chrono::steady_clock::now();
+    return slot->status;
+}
 
-    switch (ret) {
-        case -ENOSYS:
-            return Status::BRIGHTNESS_NOT_SUPPORTED;
-        case 0:
-            return Status::SUCCESS;
-        default:
-            return Status::UNKNOWN;
+// Methods from ::android::hardware::light::V2_0::ILight follow.
+Return<Status> Light::setLight(Type type, const LightState& state)  {
+    auto it = mSlots.find(type);
+
+    if (it == mSlots.end()) {
+        return Status::LIGHT_NOT_SUPPORTED;
+    }
+
+    LightSlot* slot = it->second.get();
+    std::unique_lock<std::mutex> lock(slot->lock);
+
+    if (type == Type::BACKLIGHT) {
+        if (slot->pending ||
+            std::chrono::steady_clock::now() - slot->appliedTime < kBacklightCoalescePeriod) {
+            if (!mBacklightThread.joinable()) {
+                mBacklightThread = std::thread(&Light::backlightLoop, this);
+            }
+            // Replaces any state pending from earlier in the period, whose callers then return
+            // the status of this one.
+            if (!slot->pending) {
+                slot->pending = std::make_shared<PendingApply>();
+            }
+            slot->pendingState = state;
+            std::shared_ptr<PendingApply> apply = slot->pending;
+            mBacklightCond.notify_one();
+            mBacklightAppliedCond.wait(lock, [&apply] { return apply->done; });
+            return apply->status;
+        }
+    }
+
+    if (slot->applied && slot->state == state) {
+        return Status::SUCCESS;
+    }
+    return applyLocked(slot, state);
+}
+
+void Light::backlightLoop() {
+    LightSlot* slot = mSlots.at(Type::BACKLIGHT).get();
+    std::unique_lock<std::mutex> lock(slot->lock);
+    while (!mExiting) {
+        if (!slot->pending) {
+            mBacklightCond.wait(lock);
+            continue;
+        }
+        auto deadline = slot->appliedTime + kBacklightCoalescePeriod;
+        if (std::chrono::steady_clock::now() < deadline) {
+            mBacklightCond.wait_until(lock, deadline);
+            continue;
+        }
+        std::shared_ptr<PendingApply> apply = std::move(slot->pending);
+        slot->pending = nullptr;
+        if (!slot->applied || !(slot->state == slot->pendingState)) {
+            apply->status = applyLocked(slot, slot->pendingState);
+        }
+        apply->done = true;
+        mBacklightAppliedCond.notify_all();
     }
 }
 
@@ -127,6 +199,16 @@ Return<void> Light::debug(const hidl_handle& handle, const hidl_vec<hidl_string>
         dprintf(fd, "%s,", kLogicalLights.at(type));
     }
     dprintf(fd, ".\n");
+    for (auto const& pair : mSlots) {
+        LightSlot* slot = pair.second.get();
+        std::lock_guard<std::mutex> lock(slot->lock);
+        if (slot->applied) {
+            dprintf(fd, "%s: color 0x%08x flash %d brightness mode %d\n",
+                    kLogicalLights.at(pair.first), slot->state.color,
+                    static_cast<int>(slot->state.flashMode),
+                    static_cast<int>(slot->state.brightnessMode));
+        }
+    }
     fsync(fd);
     return Void();
 }
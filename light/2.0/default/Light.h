@@ -21,7 +21,12 @@
 #include <hardware/lights.h>
 #include <hidl/Status.h>
 #include <hidl/MQDescriptor.h>
+#include <chrono>
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace android {
 namespace hardware {
@@ -40,7 +45,12 @@ using ::android::hardware::hidl_string;
 using ::android::sp;
 
 struct Light : public ILight {
+    // Backlight updates closer than this to the previous one are coalesced: only the last one
+    // of the period is applied, at its end.
+    static constexpr std::chrono::milliseconds kBacklightCoalescePeriod{16};
+
     Light(std::map<Type, light_device_t*> &&lights);
+    ~Light();
 
     Return<Status> setLight(Type type, const LightState& state)  override;
     Return<void> getSupportedTypes(getSupportedTypes_cb _hidl_cb)  override;
@@ -48,7 +58,41 @@ struct Light : public ILight {
     Return<void> debug(const hidl_handle& handle, const hidl_vec<hidl_string>& options) override;
 
    private:
+    // A coalesced backlight apply. Every setLight folded into it waits for it and returns its
+    // status.
+    struct PendingApply {
+        bool done = false;
+        Status status = Status::SUCCESS;
+    };
+
+    // State of one light type. Each has its own lock, so that types are applied independently.
+    struct LightSlot {
+        explicit LightSlot(light_device_t* device) : device(device) {}
+
+        light_device_t* const device;
+        std::mutex lock;
+        // The last state applied to the device and the status it returned.
+        bool applied = false;
+        LightState state;
+        Status status = Status::SUCCESS;
+        std::chrono::steady_clock::time_point appliedTime;
+        // A coalesced backlight state, waiting for the end of its period.
+        std::shared_ptr<PendingApply> pending;
+        LightState pendingState;
+    };
+
+    Status applyLocked(LightSlot* slot, const LightState& state);
+    void backlightLoop();
+
     std::map<Type, light_device_t*> mLights;
+    std::map<Type, std::unique_ptr<LightSlot>> mSlots;
+    // Wakes the backlight thread when a state is coalesced.
+    std::condition_variable mBacklightCond;
+    // Wakes the setLight calls waiting for a coalesced apply.
+    std::condition_variable mBacklightAppliedCond;
+    bool mExiting = false;
+    // Started by the first coalesced backlight update, and guarded by the backlight slot lock.
+    std::thread mBacklightThread;
 };
 
 extern "C" ILight* HIDL_FETCH_ILight(const char* name);
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Light.h"
+
+namespace android {
+namespace hardware {
+namespace light {
+namespace V2_0 {
+namespace implementation {
+namespace {
+
+constexpr std::chrono::seconds kTimeout(5);
+
+// A legacy light device recording the states it is set to. It returns the queued results in
+// order, then 0, and can hold set_light until it is released.
+struct FakeLightDevice {
+    FakeLightDevice() { device.set_light = &FakeLightDevice::setLight; }
+
+    static int setLight(light_device_t* dev, const light_state_t* state) {
+        auto* self = reinterpret_cast<FakeLightDevice*>(dev);
+        std::unique_lock<std::mutex> lock(self->lock);
+        self->colors.push_back(state->color);
+        self->cond.notify_all();
+        self->cond.wait(lock, [self] { return !self->held; });
+        if (self->results.empty()) return 0;
+        int result = self->results.front();
+        self->results.pop_front();
+        return result;
+    }
+
+    std::vector<uint32_t> getColors() {
+        std::lock_guard<std::mutex> lock(this->lock);
+        return colors;
+    }
+
+    bool waitForCalls(size_t count) {
+        std::unique_lock<std::mutex> lock(this->lock);
+        return cond.wait_for(lock, kTimeout, [&] { return colors.size() >= count; });
+    }
+
+    void hold() {
+        std::lock_guard<std::mutex> lock(this->lock);
+        held = true;
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(this->lock);
+        held = false;
+        cond.notify_all();
+    }
+
+    // First, so that the device pointer is the FakeLightDevice pointer
+    light_device_t device = {};
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<uint32_t> colors;
+    std::deque<int> results;
+    bool held = false;
+};
+
+LightState makeState(uint32_t color) {
+    LightState state = {};
+    state.color = color;
+    state.flashMode = Flash::NONE;
+    state.brightnessMode = Brightness::USER;
+    return state;
+}
+
+size_t countThreads() {
+    size_t count = 0;
+    DIR* dir = opendir("/proc/self/task");
+    if (dir == nullptr) return 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+class LightTest : public ::testing::Test {
+   protected:
+    std::unique_ptr<Light> makeLight(Type type) {
+        std::map<Type, light_device_t*> lights;
+        lights[type] = &mDevice.device;
+        return std::make_unique<Light>(std::move(lights));
+    }
+
+    FakeLightDevice mDevice;
+};
+
+TEST_F(LightTest, AppliesChangedStatesOnly) {
+    auto light = makeLight(Type::KEYBOARD);
+
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::KEYBOARD, makeState(0xff0000ff)));
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::KEYBOARD, makeState(0xff0000ff)));
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::KEYBOARD, makeState(0xff00ff00)));
+    // Not coalesced, however close together
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::KEYBOARD, makeState(0xffff0000)));
+    EXPECT_EQ(std::vector<uint32_t>({0xff0000ff, 0xff00ff00, 0xffff0000}), mDevice.getColors());
+}
+
+TEST_F(LightTest, RetriesAFailedState) {
+    auto light = makeLight(Type::BATTERY);
+    mDevice.results = {-ENOSYS, -EIO};
+
+    EXPECT_EQ(Status::BRIGHTNESS_NOT_SUPPORTED,
+              light->setLight(Type::BATTERY, makeState(0xff0000ff)));
+    EXPECT_EQ(Status::UNKNOWN, light->setLight(Type::BATTERY, makeState(0xff0000ff)));
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::BATTERY, makeState(0xff0000ff)));
+    EXPECT_EQ(3u, mDevice.getColors().size());
+}
+
+TEST_F(LightTest, RejectsUnsupportedTypes) {
+    auto light = makeLight(Type::BACKLIGHT);
+
+    EXPECT_EQ(Status::LIGHT_NOT_SUPPORTED, light->setLight(Type::WIFI, makeState(0xffffffff)));
+    EXPECT_TRUE(mDevice.getColors().empty());
+}
+
+TEST_F(LightTest, CoalescedUpdateReturnsTheStatusOfItsOwnApply) {
+    auto light = makeLight(Type::BACKLIGHT);
+    mDevice.results = {0, -ENOSYS};
+
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::BACKLIGHT, makeState(0xff101010)));
+    // Within the period of the first, so applied at its end
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(Status::BRIGHTNESS_NOT_SUPPORTED,
+              light->setLight(Type::BACKLIGHT, makeState(0xff202020)));
+    EXPECT_LE(std::chrono::steady_clock::now() - start, Light::kBacklightCoalescePeriod * 2);
+    EXPECT_EQ(std::vector<uint32_t>({0xff101010, 0xff202020}), mDevice.getColors());
+}
+
+TEST_F(LightTest, CoalescedUpdatesShareTheLastApply) {
+    auto light = makeLight(Type::BACKLIGHT);
+    mDevice.results = {0, -EIO};
+
+    // Held in the device, so that the next two queue up behind it within its period
+    mDevice.hold();
+    std::thread first([&] { light->setLight(Type::BACKLIGHT, makeState(0xff101010)); });
+    ASSERT_TRUE(mDevice.waitForCalls(1));
+
+    Status second = Status::SUCCESS;
+    Status third = Status::SUCCESS;
+    std::thread secondThread(
+            [&] { second = light->setLight(Type::BACKLIGHT, makeState(0xff202020)); });
+    std::thread thirdThread(
+            [&] { third = light->setLight(Type::BACKLIGHT, makeState(0xff303030)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    mDevice.release();
+    first.join();
+    secondThread.join();
+    thirdThread.join();
+
+    EXPECT_EQ(Status::UNKNOWN, second);
+    EXPECT_EQ(Status::UNKNOWN, third);
+    auto colors = mDevice.getColors();
+    ASSERT_EQ(2u, colors.size());
+    EXPECT_TRUE(colors[1] == 0xff202020 || colors[1] == 0xff303030);
+}
+
+TEST_F(LightTest, StartsTheBacklightThreadOnTheFirstCoalescedUpdate) {
+    size_t threads = countThreads();
+    auto light = makeLight(Type::BACKLIGHT);
+    EXPECT_EQ(threads, countThreads());
+
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::BACKLIGHT, makeState(0xff101010)));
+    EXPECT_EQ(threads, countThreads());
+
+    EXPECT_EQ(Status::SUCCESS, light->setLight(Type::BACKLIGHT, makeState(0xff202020)));
+    EXPECT_EQ(threads + 1, countThreads());
+
+    light.reset();
+    EXPECT_EQ(threads, countThreads());
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace light
+}  // namespace hardware
+}  // namespace android
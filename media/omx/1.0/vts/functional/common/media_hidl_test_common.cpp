@@ -35,7 +35,10 @@
 #include <android/hidl/memory/1.0/IMapper.h>
 #include <android/hidl/memory/1.0/IMemory.h>
 
+#include <algorithm>
 #include <atomic>
+#include <iostream>
+#include <string>
 #include <variant>
 
 using ::android::hardware::graphics::common::V1_0::BufferUsage;
@@ -57,6 +60,7 @@ using ::android::hardware::hidl_string;
 using ::android::sp;
 
 #include <VtsHalHidlTargetTestBase.h>
+#include <hal-metrics/Metrics.h>
 #include <hidlmemory/mapping.h>
 #include <media/hardware/HardwareAPI.h>
 #include <media_hidl_test_common.h>
@@ -383,7 +387,8 @@ void allocateBuffer(sp<IOmxNode> omxNode, BufferInfo* buffer, OMX_U32 portIndex,
 // allocate buffers needed on a component port
 void allocatePortBuffers(sp<IOmxNode> omxNode,
                          android::Vector<BufferInfo>* buffArray,
-                         OMX_U32 portIndex, PortMode portMode, bool allocGrap) {
+                         OMX_U32 portIndex, PortMode portMode, bool allocGrap,
+                         BenchmarkStats* stats) {
     android::hardware::media::omx::V1_0::Status status;
     OMX_PARAM_PORTDEFINITIONTYPE portDef;
 
@@ -393,6 +398,7 @@ void allocatePortBuffers(sp<IOmxNode> omxNode,
                           &portDef);
     ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
 
+    int64_t startUs = android::ALooper::GetNowUs();
     for (size_t i = 0; i < portDef.nBufferCountActual; i++) {
         BufferInfo buffer;
         ASSERT_NO_FATAL_FAILURE(allocateBuffer(omxNode, &buffer, portIndex,
@@ -406,6 +412,105 @@ void allocatePortBuffers(sp<IOmxNode> omxNode,
         }
         buffArray->push(buffer);
     }
+    if (stats) {
+        stats->onBuffersAllocated(
+            allocGrap && portMode == PortMode::DYNAMIC_ANW_BUFFER,
+            buffArray->size(), android::ALooper::GetNowUs() - startUs);
+    }
+}
+
+// set the number of buffers of a port, at least the minimum the port takes
+Return<android::hardware::media::omx::V1_0::Status> setPortBufferCount(
+    sp<IOmxNode> omxNode, OMX_U32 portIndex, OMX_U32 count) {
+    android::hardware::media::omx::V1_0::Status status;
+    OMX_PARAM_PORTDEFINITIONTYPE portDef;
+
+    status = getPortParam(omxNode, OMX_IndexParamPortDefinition, portIndex,
+                          &portDef);
+    if (status != ::android::hardware::media::omx::V1_0::Status::OK)
+        return status;
+    portDef.nBufferCountActual = std::max(count, portDef.nBufferCountMin);
+    return setPortParam(omxNode, OMX_IndexParamPortDefinition, portIndex,
+                        &portDef);
+}
+
+void BenchmarkStats::onInputQueued(uint32_t bufferId) {
+    int64_t nowUs = android::ALooper::GetNowUs();
+    if (firstInputUs < 0) firstInputUs = nowUs;
+    inputQueuedUs[bufferId] = nowUs;
+}
+
+void BenchmarkStats::onInputDone(uint32_t bufferId) {
+    auto it = inputQueuedUs.find(bufferId);
+    if (it == inputQueuedUs.end()) return;
+    roundTripUs.push_back(android::ALooper::GetNowUs() - it->second);
+    inputQueuedUs.erase(it);
+}
+
+void BenchmarkStats::onOutputFrame() {
+    lastOutputUs = android::ALooper::GetNowUs();
+    frames++;
+}
+
+void BenchmarkStats::onBuffersAllocated(bool graphic, size_t count,
+                                        int64_t durationUs) {
+    if (graphic) {
+        graphicBuffers += count;
+        graphicAllocUs += durationUs;
+    } else {
+        byteBuffers += count;
+        byteAllocUs += durationUs;
+    }
+}
+
+void BenchmarkStats::report(const char* name) {
+    std::string prefix(name);
+    double fps = 0;
+    if (frames > 0 && lastOutputUs > firstInputUs) {
+        fps = frames * 1000000.0 / (lastOutputUs - firstInputUs);
+    }
+    std::cout << "[ BENCHMARK] " << name << ": " << frames << " frames, "
+              << fps << " fps\n";
+    ::testing::Test::RecordProperty(prefix + "_frames",
+                                    static_cast<int>(frames));
+    ::testing::Test::RecordProperty(prefix + "_fps", std::to_string(fps));
+
+    if (!roundTripUs.empty()) {
+        std::sort(roundTripUs.begin(), roundTripUs.end());
+        int64_t totalUs = 0;
+        for (int64_t us : roundTripUs) totalUs += us;
+        int64_t meanUs = totalUs / static_cast<int64_t>(roundTripUs.size());
+        int64_t p50Us = android::hardware::metrics::percentile(roundTripUs, 50);
+        int64_t p99Us = android::hardware::metrics::percentile(roundTripUs, 99);
+        int64_t maxUs = roundTripUs.back();
+        std::cout << "[ BENCHMARK] " << name << ": input round trip mean "
+                  << meanUs << "us, p50 " << p50Us << "us, p99 " << p99Us
+                  << "us, max " << maxUs << "us\n";
+        ::testing::Test::RecordProperty(prefix + "_round_trip_mean_ns",
+                                        std::to_string(meanUs * 1000));
+        ::testing::Test::RecordProperty(prefix + "_round_trip_p50_ns",
+                                        std::to_string(p50Us * 1000));
+        ::testing::Test::RecordProperty(prefix + "_round_trip_p99_ns",
+                                        std::to_string(p99Us * 1000));
+    }
+
+    if (byteBuffers > 0) {
+        int64_t perBufferUs = byteAllocUs / static_cast<int64_t>(byteBuffers);
+        std::cout << "[ BENCHMARK] " << name << ": " << byteBuffers
+                  << " byte buffers allocated, " << perBufferUs
+                  << "us per buffer\n";
+        ::testing::Test::RecordProperty(prefix + "_byte_alloc_us",
+                                        std::to_string(perBufferUs));
+    }
+    if (graphicBuffers > 0) {
+        int64_t perBufferUs =
+            graphicAllocUs / static_cast<int64_t>(graphicBuffers);
+        std::cout << "[ BENCHMARK] " << name << ": " << graphicBuffers
+                  << " graphic buffers allocated, " << perBufferUs
+                  << "us per buffer\n";
+        ::testing::Test::RecordProperty(prefix + "_graphic_alloc_us",
+                                        std::to_string(perBufferUs));
+    }
 }
 
 // State Transition : Loaded -> Idle
@@ -415,7 +520,8 @@ void changeStateLoadedtoIdle(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                              android::Vector<BufferInfo>* iBuffer,
                              android::Vector<BufferInfo>* oBuffer,
                              OMX_U32 kPortIndexInput, OMX_U32 kPortIndexOutput,
-                             PortMode* portMode, bool allocGrap) {
+                             PortMode* portMode, bool allocGrap,
+                             BenchmarkStats* stats) {
     android::hardware::media::omx::V1_0::Status status;
     Message msg;
     PortMode defaultPortMode[2], *pm;
@@ -444,7 +550,7 @@ void changeStateLoadedtoIdle(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
 
     // allocate buffers on input port
     ASSERT_NO_FATAL_FAILURE(allocatePortBuffers(
-        omxNode, iBuffer, kPortIndexInput, pm[0], allocGrap));
+        omxNode, iBuffer, kPortIndexInput, pm[0], allocGrap, stats));
 
     // Dont switch states until the ports are populated
     if (portDefOutput.nBufferCountActual) {
@@ -454,7 +560,7 @@ void changeStateLoadedtoIdle(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
 
     // allocate buffers on output port
     ASSERT_NO_FATAL_FAILURE(allocatePortBuffers(
-        omxNode, oBuffer, kPortIndexOutput, pm[1], allocGrap));
+        omxNode, oBuffer, kPortIndexOutput, pm[1], allocGrap, stats));
 
     // As the ports are populated, check if the state transition is complete
     status = observer->dequeueMessage(&msg, DEFAULT_TIMEOUT, iBuffer, oBuffer);
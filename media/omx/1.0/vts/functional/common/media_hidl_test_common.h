@@ -23,6 +23,9 @@
 
 #include <getopt.h>
 
+#include <map>
+#include <vector>
+
 #include <android/hardware/graphics/allocator/2.0/IAllocator.h>
 #include <android/hardware/graphics/allocator/3.0/IAllocator.h>
 #include <android/hardware/graphics/common/1.0/types.h>
@@ -119,6 +122,31 @@ struct FrameData {
     uint32_t timestamp;
 };
 
+/*
+ * Measurements of a benchmark run: frames per second, round trip of each
+ * input buffer from emptyBuffer() to EMPTY_BUFFER_DONE, and cost of buffer
+ * allocation by kind. Times are in microseconds, from ALooper::GetNowUs().
+ */
+struct BenchmarkStats {
+    void onInputQueued(uint32_t bufferId);
+    void onInputDone(uint32_t bufferId);
+    void onOutputFrame();
+    void onBuffersAllocated(bool graphic, size_t count, int64_t durationUs);
+    // Prints the results, and records them as test properties prefixed with
+    // name.
+    void report(const char* name);
+
+    int64_t firstInputUs = -1;
+    int64_t lastOutputUs = -1;
+    uint32_t frames = 0;
+    std::map<uint32_t, int64_t> inputQueuedUs;
+    std::vector<int64_t> roundTripUs;
+    size_t byteBuffers = 0;
+    int64_t byteAllocUs = 0;
+    size_t graphicBuffers = 0;
+    int64_t graphicAllocUs = 0;
+};
+
 /*
  * Handle Callback functions EmptythisBuffer(), FillthisBuffer(),
  * EventHandler()
@@ -349,14 +377,19 @@ void allocatePortBuffers(sp<IOmxNode> omxNode,
                          android::Vector<BufferInfo>* buffArray,
                          OMX_U32 portIndex,
                          PortMode portMode = PortMode::PRESET_BYTE_BUFFER,
-                         bool allocGrap = false);
+                         bool allocGrap = false,
+                         BenchmarkStats* stats = nullptr);
+
+Return<android::hardware::media::omx::V1_0::Status> setPortBufferCount(
+    sp<IOmxNode> omxNode, OMX_U32 portIndex, OMX_U32 count);
 
 void changeStateLoadedtoIdle(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                              android::Vector<BufferInfo>* iBuffer,
                              android::Vector<BufferInfo>* oBuffer,
                              OMX_U32 kPortIndexInput, OMX_U32 kPortIndexOutput,
                              PortMode* portMode = nullptr,
-                             bool allocGrap = false);
+                             bool allocGrap = false,
+                             BenchmarkStats* stats = nullptr);
 
 void changeStateIdletoLoaded(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                              android::Vector<BufferInfo>* iBuffer,
@@ -408,7 +441,8 @@ class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
    public:
     virtual void registerTestServices() override { registerTestService<IOmx>(); }
 
-    ComponentTestEnvironment() : res("/sdcard/media/") {}
+    ComponentTestEnvironment()
+        : res("/sdcard/media/"), benchDepth(0), benchWidth(0), benchHeight(0) {}
 
     void setComponent(const char* _component) { component = _component; }
 
@@ -424,15 +458,29 @@ class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
 
     const hidl_string getRes() const { return res; }
 
+    // Benchmark tests only run with a pipeline depth, in buffers per port.
+    uint32_t getBenchDepth() const { return benchDepth; }
+
+    // Stream of the benchmark tests in the resource directory, in place of
+    // the default stream of the component, and for raw streams its frame size.
+    const hidl_string getBenchStream() const { return benchStream; }
+
+    uint32_t getBenchWidth() const { return benchWidth; }
+
+    uint32_t getBenchHeight() const { return benchHeight; }
+
     int initFromOptions(int argc, char** argv) {
         static struct option options[] = {{"component", required_argument, 0, 'C'},
                                           {"role", required_argument, 0, 'R'},
                                           {"res", required_argument, 0, 'P'},
+                                          {"bench-depth", required_argument, 0, 'B'},
+                                          {"bench-stream", required_argument, 0, 'S'},
+                                          {"bench-size", required_argument, 0, 'Z'},
                                           {0, 0, 0, 0}};
 
         while (true) {
             int index = 0;
-            int c = getopt_long(argc, argv, "C:R:P:", options, &index);
+            int c = getopt_long(argc, argv, "C:R:P:B:S:Z:", options, &index);
             if (c == -1) {
                 break;
             }
@@ -447,6 +495,18 @@ class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
                 case 'P':
                     setRes(optarg);
                     break;
+                case 'B':
+                    benchDepth = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'S':
+                    benchStream = optarg;
+                    break;
+                case 'Z':
+                    if (sscanf(optarg, "%ux%u", &benchWidth, &benchHeight) !=
+                        2) {
+                        benchWidth = benchHeight = 0;
+                    }
+                    break;
                 case '?':
                     break;
             }
@@ -459,7 +519,13 @@ class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
                     "test options are:\n\n"
                     "-C, --component: OMX component to test\n"
                     "-R, --role: OMX component Role\n"
-                    "-P, --res: Resource files directory location\n",
+                    "-P, --res: Resource files directory location\n"
+                    "-B, --bench-depth: Run the benchmark tests with this many "
+                    "buffers per port\n"
+                    "-S, --bench-stream: Stream of the benchmark tests in the "
+                    "resource directory\n"
+                    "-Z, --bench-size: Frame size of a raw benchmark stream, "
+                    "as <width>x<height>\n",
                     argv[optind ?: 1], argv[0]);
             return 2;
         }
@@ -471,6 +537,10 @@ class ComponentTestEnvironment : public ::testing::VtsHalHidlTargetTestEnvBase {
     hidl_string component;
     hidl_string role;
     hidl_string res;
+    uint32_t benchDepth;
+    hidl_string benchStream;
+    uint32_t benchWidth;
+    uint32_t benchHeight;
 };
 
 #endif  // MEDIA_HIDL_TEST_COMMON_H
@@ -145,6 +145,7 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
         timestampDevTest = false;
         isSecure = false;
         portSettingsChange = false;
+        benchStats = nullptr;
         size_t suffixLen = strlen(".secure");
         if (strlen(gEnv->getComponent().c_str()) >= suffixLen) {
             isSecure =
@@ -188,6 +189,7 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
             }
             if (msg.data.extendedBufferData.rangeLength != 0) {
                 framesReceived += 1;
+                if (benchStats) benchStats->onOutputFrame();
                 // For decoder components current timestamp always exceeds
                 // previous timestamp
                 EXPECT_GE(msg.data.extendedBufferData.timestampUs, timestampUs);
@@ -234,6 +236,8 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
                 }
 #endif
             }
+        } else if (msg.type == Message::Type::EMPTY_BUFFER_DONE) {
+            if (benchStats && buffer) benchStats->onInputDone(buffer->id);
         } else if (msg.type == Message::Type::EVENT) {
             if (msg.data.eventData.event == OMX_EventPortSettingsChanged) {
                 if ((msg.data.eventData.data2 == OMX_IndexParamPortDefinition ||
@@ -269,6 +273,7 @@ class VideoDecHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     bool timestampDevTest;
     bool isSecure;
     bool portSettingsChange;
+    BenchmarkStats* benchStats;
 
    protected:
     static void description(const std::string& description) {
@@ -543,7 +548,7 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                    OMX_U32 kPortIndexInput, OMX_U32 kPortIndexOutput,
                    std::ifstream& eleStream, android::Vector<FrameData>* Info,
                    int offset, int range, PortMode oPortMode,
-                   bool signalEOS = true) {
+                   bool signalEOS = true, BenchmarkStats* stats = nullptr) {
     android::hardware::media::omx::V1_0::Status status;
     Message msg;
     size_t index;
@@ -586,6 +591,7 @@ void decodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
             ASSERT_NO_FATAL_FAILURE(dispatchInputBuffer(
                 omxNode, iBuffer, index, (*Info)[frameID].bytesCount, flags,
                 (*Info)[frameID].timestamp));
+            if (stats) stats->onInputQueued((*iBuffer)[index].id);
             frameID++;
             iQueued = true;
         }
@@ -859,6 +865,132 @@ TEST_F(VideoDecHidlTest, DecodeTest) {
                                                     kPortIndexOutput));
 }
 
+// decode throughput, input buffer round trip and buffer allocation cost, at
+// the pipeline depth given with --bench-depth
+TEST_F(VideoDecHidlTest, DecodeBenchmark) {
+    description("Measures decode throughput and latency");
+    if (disableTest) return;
+    if (gEnv->getBenchDepth() == 0) {
+        std::cout << "[   INFO   ] Benchmark disabled, run with "
+                     "--bench-depth\n";
+        return;
+    }
+    android::hardware::media::omx::V1_0::Status status;
+    uint32_t kPortIndexInput = 0, kPortIndexOutput = 1;
+    status = setRole(omxNode, gEnv->getRole().c_str());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    OMX_PORT_PARAM_TYPE params;
+    status = getParam(omxNode, OMX_IndexParamVideoInit, &params);
+    if (status == ::android::hardware::media::omx::V1_0::Status::OK) {
+        ASSERT_EQ(params.nPorts, 2U);
+        kPortIndexInput = params.nStartPortNumber;
+        kPortIndexOutput = kPortIndexInput + 1;
+    }
+    char mURL[512], info[512];
+    strcpy(mURL, gEnv->getRes().c_str());
+    strcpy(info, gEnv->getRes().c_str());
+    if (gEnv->getBenchStream().empty()) {
+        GetURLForComponent(compName, mURL, info);
+    } else {
+        // The frame info of a stream sits next to it, with a .info extension.
+        std::string stream(gEnv->getBenchStream().c_str());
+        strcat(mURL, stream.c_str());
+        strcat(info, stream.substr(0, stream.rfind('.')).c_str());
+        strcat(info, ".info");
+    }
+
+    std::ifstream eleStream, eleInfo;
+
+    eleInfo.open(info);
+    ASSERT_EQ(eleInfo.is_open(), true);
+    android::Vector<FrameData> Info;
+    int bytesCount = 0, maxBytesCount = 0;
+    uint32_t flags = 0;
+    uint32_t timestamp = 0;
+    while (1) {
+        if (!(eleInfo >> bytesCount)) break;
+        eleInfo >> flags;
+        eleInfo >> timestamp;
+        Info.push_back({bytesCount, flags, timestamp});
+        if (maxBytesCount < bytesCount) maxBytesCount = bytesCount;
+    }
+    eleInfo.close();
+
+    maxBytesCount = ALIGN_POWER_OF_TWO(maxBytesCount, 10);
+    status = setPortBufferSize(omxNode, kPortIndexInput, maxBytesCount);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+
+    // set port mode
+    portMode[0] = PortMode::PRESET_BYTE_BUFFER;
+    portMode[1] = PortMode::DYNAMIC_ANW_BUFFER;
+    status = omxNode->setPortMode(kPortIndexInput, portMode[0]);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    status = omxNode->setPortMode(kPortIndexOutput, portMode[1]);
+    if (status != ::android::hardware::media::omx::V1_0::Status::OK) {
+        portMode[1] = PortMode::PRESET_BYTE_BUFFER;
+        status = omxNode->setPortMode(kPortIndexOutput, portMode[1]);
+        ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    }
+
+    // set Port Params
+    uint32_t nFrameWidth, nFrameHeight, xFramerate;
+    getInputChannelInfo(omxNode, kPortIndexInput, &nFrameWidth, &nFrameHeight,
+                        &xFramerate);
+    OMX_COLOR_FORMATTYPE eColorFormat = OMX_COLOR_FormatUnused;
+    getDefaultColorFormat(omxNode, kPortIndexOutput, portMode[1],
+                          &eColorFormat);
+    ASSERT_NE(eColorFormat, OMX_COLOR_FormatUnused);
+    status =
+        setVideoPortFormat(omxNode, kPortIndexOutput, OMX_VIDEO_CodingUnused,
+                           eColorFormat, xFramerate);
+    EXPECT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    setDefaultPortParam(omxNode, kPortIndexOutput, OMX_VIDEO_CodingUnused,
+                        eColorFormat, nFrameWidth, nFrameHeight, 0, xFramerate);
+
+    // The output port depth only holds until the component reconfigures the
+    // port for the stream.
+    status =
+        setPortBufferCount(omxNode, kPortIndexInput, gEnv->getBenchDepth());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    status =
+        setPortBufferCount(omxNode, kPortIndexOutput, gEnv->getBenchDepth());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+
+    android::Vector<BufferInfo> iBuffer, oBuffer;
+    BenchmarkStats stats;
+    benchStats = &stats;
+
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(changeStateLoadedtoIdle(
+        omxNode, observer, &iBuffer, &oBuffer, kPortIndexInput,
+        kPortIndexOutput, portMode, true, &stats));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoExecute(omxNode, observer));
+
+    eleStream.open(mURL, std::ifstream::binary);
+    ASSERT_EQ(eleStream.is_open(), true);
+    ASSERT_NO_FATAL_FAILURE(decodeNFrames(
+        omxNode, observer, &iBuffer, &oBuffer, kPortIndexInput,
+        kPortIndexOutput, eleStream, &Info, 0, (int)Info.size(), portMode[1],
+        true, &stats));
+    eleStream.close();
+    ASSERT_NO_FATAL_FAILURE(
+        waitOnInputConsumption(omxNode, observer, &iBuffer, &oBuffer,
+                               kPortIndexInput, kPortIndexOutput, portMode[1]));
+    ASSERT_NO_FATAL_FAILURE(testEOS(
+        omxNode, observer, &iBuffer, &oBuffer, false, eosFlag, portMode,
+        portReconfiguration, kPortIndexInput, kPortIndexOutput, nullptr));
+    benchStats = nullptr;
+    stats.report("decode");
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(
+        changeStateExecutetoIdle(omxNode, observer, &iBuffer, &oBuffer));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoLoaded(omxNode, observer, &iBuffer,
+                                                    &oBuffer, kPortIndexInput,
+                                                    kPortIndexOutput));
+}
+
 // Test for adaptive playback support
 TEST_F(VideoDecHidlTest, AdaptivePlaybackTest) {
     description("Tests for Adaptive Playback support");
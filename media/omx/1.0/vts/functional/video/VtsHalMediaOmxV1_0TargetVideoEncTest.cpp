@@ -157,6 +157,7 @@ class VideoEncHidlTest : public ::testing::VtsHalHidlTargetTestBase {
         producer = nullptr;
         source = nullptr;
         isSecure = false;
+        benchStats = nullptr;
         size_t suffixLen = strlen(".secure");
         if (strlen(gEnv->getComponent().c_str()) >= suffixLen) {
             isSecure =
@@ -190,6 +191,9 @@ class VideoEncHidlTest : public ::testing::VtsHalHidlTargetTestBase {
                 eosFlag = true;
             }
             if (msg.data.extendedBufferData.rangeLength != 0) {
+                if (benchStats && (msg.data.extendedBufferData.flags &
+                                   OMX_BUFFERFLAG_CODECCONFIG) == 0)
+                    benchStats->onOutputFrame();
                 // Test if current timestamp is among the list of queued
                 // timestamps
                 if (timestampDevTest && ((msg.data.extendedBufferData.flags &
@@ -232,6 +236,8 @@ class VideoEncHidlTest : public ::testing::VtsHalHidlTargetTestBase {
                 }
 #endif
             }
+        } else if (msg.type == Message::Type::EMPTY_BUFFER_DONE) {
+            if (benchStats && buffer) benchStats->onInputDone(buffer->id);
         }
     }
 
@@ -258,6 +264,7 @@ class VideoEncHidlTest : public ::testing::VtsHalHidlTargetTestBase {
     bool isSecure;
     sp<IGraphicBufferProducer> producer;
     sp<IGraphicBufferSource> source;
+    BenchmarkStats* benchStats;
 
    protected:
     static void description(const std::string& description) {
@@ -1054,6 +1061,7 @@ void encodeNFrames(sp<IOmxNode> omxNode, sp<CodecObserver> observer,
                 if (signalEOS && (nFrames == 1)) flags |= OMX_BUFFERFLAG_EOS;
                 ASSERT_NO_FATAL_FAILURE(dispatchInputBuffer(
                     omxNode, iBuffer, index, bytesCount, flags, timestamp));
+                if (stats) stats->onInputQueued((*iBuffer)[index].id);
                 if (timestampUslist) timestampUslist->push_back(timestamp);
                 timestamp += timestampIncr;
                 nFrames--;
@@ -1292,6 +1300,123 @@ TEST_F(VideoEncHidlTest, EncodeTest) {
                                                     kPortIndexOutput));
 }
 
+// encode throughput, input buffer round trip and buffer allocation cost, at
+// the pipeline depth given with --bench-depth
+TEST_F(VideoEncHidlTest, EncodeBenchmark) {
+    description("Measures encode throughput and latency");
+    if (disableTest) return;
+    if (gEnv->getBenchDepth() == 0) {
+        std::cout << "[   INFO   ] Benchmark disabled, run with "
+                     "--bench-depth\n";
+        return;
+    }
+    android::hardware::media::omx::V1_0::Status status;
+    uint32_t kPortIndexInput = 0, kPortIndexOutput = 1;
+    status = setRole(omxNode, gEnv->getRole().c_str());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    OMX_PORT_PARAM_TYPE params;
+    status = getParam(omxNode, OMX_IndexParamVideoInit, &params);
+    if (status == ::android::hardware::media::omx::V1_0::Status::OK) {
+        ASSERT_EQ(params.nPorts, 2U);
+        kPortIndexInput = params.nStartPortNumber;
+        kPortIndexOutput = kPortIndexInput + 1;
+    }
+    char mURL[512];
+    strcpy(mURL, gEnv->getRes().c_str());
+    uint32_t nFrameWidth = 352;
+    uint32_t nFrameHeight = 288;
+    if (gEnv->getBenchStream().empty()) {
+        GetURLForComponent(mURL);
+    } else {
+        ASSERT_NE(gEnv->getBenchWidth(), 0U) << "Missing --bench-size";
+        strcat(mURL, gEnv->getBenchStream().c_str());
+        nFrameWidth = gEnv->getBenchWidth();
+        nFrameHeight = gEnv->getBenchHeight();
+    }
+    int bytesCount = (nFrameWidth * nFrameHeight * 3) >> 1;
+
+    std::ifstream eleStream;
+    eleStream.open(mURL, std::ifstream::binary | std::ifstream::ate);
+    ASSERT_EQ(eleStream.is_open(), true);
+    uint32_t nFrames = eleStream.tellg() / bytesCount;
+    eleStream.seekg(0);
+    ASSERT_GT(nFrames, 0U);
+
+    // Configure input port
+    uint32_t xFramerate = (30U << 16);
+    OMX_COLOR_FORMATTYPE eColorFormat = OMX_COLOR_FormatUnused;
+    OMX_VIDEO_PARAM_PORTFORMATTYPE portFormat;
+    portFormat.nIndex = 0;
+    while (1) {
+        status = getPortParam(omxNode, OMX_IndexParamVideoPortFormat,
+                              kPortIndexInput, &portFormat);
+        if (status != ::android::hardware::media::omx::V1_0::Status::OK) break;
+        if (OMX_COLOR_FormatYUV420SemiPlanar == portFormat.eColorFormat ||
+            OMX_COLOR_FormatYUV420Planar == portFormat.eColorFormat) {
+            eColorFormat = portFormat.eColorFormat;
+            break;
+        }
+        portFormat.nIndex++;
+        if (portFormat.nIndex == 512) break;
+    }
+    ASSERT_NE(eColorFormat, OMX_COLOR_FormatUnused);
+    setupRAWPort(omxNode, kPortIndexInput, nFrameWidth, nFrameHeight, 0,
+                 xFramerate, eColorFormat);
+
+    // Configure output port
+    uint32_t nBitRate = 512000;
+    ASSERT_NO_FATAL_FAILURE(
+        setDefaultPortParam(omxNode, kPortIndexOutput, eCompressionFormat,
+                            nFrameWidth, nFrameHeight, nBitRate, xFramerate));
+    setRefreshPeriod(omxNode, kPortIndexOutput, 0);
+
+    // set port mode
+    PortMode portMode[2];
+    portMode[0] = portMode[1] = PortMode::PRESET_BYTE_BUFFER;
+    status = omxNode->setPortMode(kPortIndexInput, portMode[0]);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    status = omxNode->setPortMode(kPortIndexOutput, portMode[1]);
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+
+    status =
+        setPortBufferCount(omxNode, kPortIndexInput, gEnv->getBenchDepth());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+    status =
+        setPortBufferCount(omxNode, kPortIndexOutput, gEnv->getBenchDepth());
+    ASSERT_EQ(status, ::android::hardware::media::omx::V1_0::Status::OK);
+
+    android::Vector<BufferInfo> iBuffer, oBuffer;
+    BenchmarkStats stats;
+    benchStats = &stats;
+
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(changeStateLoadedtoIdle(
+        omxNode, observer, &iBuffer, &oBuffer, kPortIndexInput,
+        kPortIndexOutput, portMode, false, &stats));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoExecute(omxNode, observer));
+
+    ASSERT_NO_FATAL_FAILURE(encodeNFrames(
+        omxNode, observer, kPortIndexInput, kPortIndexOutput, &iBuffer,
+        &oBuffer, nFrames, xFramerate, bytesCount, eleStream, nullptr, true,
+        false, nullptr, nullptr, &stats));
+    eleStream.close();
+    ASSERT_NO_FATAL_FAILURE(
+        waitOnInputConsumption(omxNode, observer, &iBuffer, &oBuffer));
+    ASSERT_NO_FATAL_FAILURE(
+        testEOS(omxNode, observer, &iBuffer, &oBuffer, false, eosFlag));
+    benchStats = nullptr;
+    stats.report("encode");
+
+    // set state to idle
+    ASSERT_NO_FATAL_FAILURE(
+        changeStateExecutetoIdle(omxNode, observer, &iBuffer, &oBuffer));
+    // set state to executing
+    ASSERT_NO_FATAL_FAILURE(changeStateIdletoLoaded(omxNode, observer, &iBuffer,
+                                                    &oBuffer, kPortIndexInput,
+                                                    kPortIndexOutput));
+}
+
 // test raw stream encode (input is ANW buffers)
 TEST_F(VideoEncHidlTest, EncodeTestBufferMetaModes) {
     description("Test Encode Input buffer metamodes");
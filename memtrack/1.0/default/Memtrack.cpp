@@ -16,6 +16,9 @@
 
 #define LOG_TAG "android.hardware.memtrack@1.0-impl"
 
+#include <algorithm>
+#include <vector>
+
 #include <log/log.h>
 
 #include <hardware/hardware.h>
@@ -38,35 +41,40 @@ Memtrack::~Memtrack() {
     delete(mModule);
 }
 
+// Records the legacy buffer starts with; enough for most HALs in one call.
+static constexpr size_t kInitialLegacyRecords = 8;
+
 Return<void> Memtrack::getMemory(int32_t pid, MemtrackType type,
         getMemory_cb _hidl_cb)  {
     hidl_vec<MemtrackRecord> records;
-    size_t temp = 0;
-    size_t *size = &temp;
-    int ret = 0;
 
     if (mModule->getMemory == nullptr)
     {
         _hidl_cb(MemtrackStatus::SUCCESS, records);
         return Void();
     }
-    ret = mModule->getMemory(mModule, pid, static_cast<memtrack_type>(type),
-            NULL, size);
+
+    // The module fills in at most *size records and returns the number available in *size, so
+    // a preallocated buffer saves parsing its accounting source a second time when they fit.
+    std::vector<memtrack_record> legacy_records(kInitialLegacyRecords);
+    size_t size = legacy_records.size();
+    int ret = mModule->getMemory(mModule, pid, static_cast<memtrack_type>(type),
+            legacy_records.data(), &size);
+    if (ret == 0 && size > legacy_records.size())
+    {
+        legacy_records.resize(size);
+        ret = mModule->getMemory(mModule, pid, static_cast<memtrack_type>(type),
+                legacy_records.data(), &size);
+        size = std::min(size, legacy_records.size());
+    }
     if (ret == 0)
     {
-        memtrack_record *legacy_records = new memtrack_record[*size];
-        ret = mModule->getMemory(mModule, pid,
-                static_cast<memtrack_type>(type), legacy_records, size);
-        if (ret == 0)
+        records.resize(size);
+        for(size_t i = 0; i < size; i++)
         {
-            records.resize(*size);
-            for(size_t i = 0; i < *size; i++)
-            {
-                records[i].sizeInBytes = legacy_records[i].size_in_bytes;
-                records[i].flags = legacy_records[i].flags;
-            }
+            records[i].sizeInBytes = legacy_records[i].size_in_bytes;
+            records[i].flags = legacy_records[i].flags;
         }
-        delete[] legacy_records;
     }
     _hidl_cb(MemtrackStatus::SUCCESS, records);
     return Void();
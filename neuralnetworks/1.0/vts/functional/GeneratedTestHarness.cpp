@@ -33,8 +33,12 @@
 #include <android/hardware/neuralnetworks/1.2/IPreparedModelCallback.h>
 #include <android/hidl/allocator/1.0/IAllocator.h>
 #include <android/hidl/memory/1.0/IMemory.h>
+#include <hal-metrics/Metrics.h>
 #include <hidlmemory/mapping.h>
+#include <chrono>
+#include <iomanip>
 #include <iostream>
+#include <numeric>
 
 namespace android {
 namespace hardware {
@@ -420,6 +424,164 @@ void EvaluatePreparedModel(sp<V1_2::IPreparedModel>& preparedModel,
     }
 }
 
+static uint32_t gBenchmarkIterations = 0;
+
+void SetBenchmarkIterations(uint32_t iterations) {
+    gBenchmarkIterations = iterations;
+}
+
+// Creates a request for the example with fully specified outputs, and loads its inputs. Returns a
+// request without pools on failure.
+static Request CreateBenchmarkRequest(const MixedTypedExample& example) {
+    const uint32_t INPUT = 0;
+    const uint32_t OUTPUT = 1;
+    const MixedTyped& inputs = example.operands.first;
+    const MixedTyped& golden = example.operands.second;
+
+    std::vector<RequestArgument> inputs_info, outputs_info;
+    uint32_t inputSize = 0, outputSize = 0;
+    for_all(inputs, [&inputs_info, &inputSize](int index, auto, auto s) {
+        if (inputs_info.size() <= static_cast<size_t>(index)) inputs_info.resize(index + 1);
+        RequestArgument arg = {
+                .location = {.poolIndex = INPUT, .offset = 0, .length = static_cast<uint32_t>(s)},
+                .dimensions = {},
+        };
+        RequestArgument arg_empty = {
+                .hasNoValue = true,
+        };
+        inputs_info[index] = s ? arg : arg_empty;
+        inputSize += s;
+    });
+    for_all(golden, [&outputs_info, &outputSize](int index, auto, auto s) {
+        if (outputs_info.size() <= static_cast<size_t>(index)) outputs_info.resize(index + 1);
+        RequestArgument arg = {
+                .location = {.poolIndex = OUTPUT, .offset = 0, .length = static_cast<uint32_t>(s)},
+                .dimensions = {},
+        };
+        outputs_info[index] = arg;
+        outputSize += s;
+    });
+    // Compute the offsets in the order of the operand indexes, as EvaluatePreparedModel does
+    for (auto* info : {&inputs_info, &outputs_info}) {
+        size_t offset = 0;
+        for (auto& i : *info) {
+            if (!i.hasNoValue) i.location.offset = offset;
+            offset += i.location.length;
+        }
+    }
+
+    std::vector<hidl_memory> pools = {nn::allocateSharedMemory(inputSize),
+                                      nn::allocateSharedMemory(outputSize)};
+    sp<IMemory> inputMemory = mapMemory(pools[INPUT]);
+    if (pools[INPUT].size() == 0 || pools[OUTPUT].size() == 0 || inputMemory == nullptr) {
+        ADD_FAILURE() << "failed to allocate the benchmark request pools";
+        return {};
+    }
+    char* inputPtr = reinterpret_cast<char*>(static_cast<void*>(inputMemory->getPointer()));
+    inputMemory->update();
+    for_all(inputs, [&inputs_info, inputPtr](int index, auto p, auto s) {
+        char* begin = (char*)p;
+        std::copy(begin, begin + s, inputPtr + inputs_info[index].location.offset);
+    });
+    inputMemory->commit();
+
+    return {.inputs = inputs_info, .outputs = outputs_info, .pools = pools};
+}
+
+static void ReportLatencies(const std::string& executor, std::vector<int64_t>* latenciesNs) {
+    std::sort(latenciesNs->begin(), latenciesNs->end());
+    auto percentileNs = [latenciesNs](double percent) {
+        return ::android::hardware::metrics::percentile(*latenciesNs, percent);
+    };
+    const int64_t totalNs = std::accumulate(latenciesNs->begin(), latenciesNs->end(), int64_t(0));
+    const int64_t inferencesPerSecond =
+            totalNs > 0 ? latenciesNs->size() * int64_t(1000000000) / totalNs : 0;
+
+    std::cout << "[          ]   " << std::left << std::setw(15) << executor
+              << " p50 " << percentileNs(50) / 1000 << " us, p90 " << percentileNs(90) / 1000
+              << " us, p99 " << percentileNs(99) / 1000 << " us, " << inferencesPerSecond
+              << " inferences/s" << std::endl;
+    ::testing::Test::RecordProperty(executor + "_p50_ns", std::to_string(percentileNs(50)));
+    ::testing::Test::RecordProperty(executor + "_p99_ns", std::to_string(percentileNs(99)));
+    ::testing::Test::RecordProperty(executor + "_inferences_per_second",
+                                    static_cast<int>(inferencesPerSecond));
+}
+
+// Times gBenchmarkIterations executions of the first example with each execution path. The
+// asynchronous and synchronous paths pass the request pools with every execution, so the driver
+// maps them every time. The burst path is timed with the memory slots cached by the driver, and
+// with the slots freed after every execution.
+static void BenchmarkPreparedModel(const sp<V1_2::IPreparedModel>& preparedModel,
+                                   const std::vector<MixedTypedExample>& examples) {
+    if (examples.empty()) {
+        return;
+    }
+    const Request request = CreateBenchmarkRequest(examples.front());
+    if (request.pools.size() == 0) {
+        return;
+    }
+
+    std::vector<int64_t> latenciesNs;
+    latenciesNs.reserve(gBenchmarkIterations);
+    auto timeExecutions = [&latenciesNs](const std::string& executor, auto&& execute) {
+        latenciesNs.clear();
+        for (uint32_t i = 0; i < gBenchmarkIterations; ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            const ErrorStatus status = execute();
+            const auto end = std::chrono::steady_clock::now();
+            if (status != ErrorStatus::NONE) {
+                ADD_FAILURE() << executor << " execution failed: " << toString(status);
+                return;
+            }
+            latenciesNs.push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        ReportLatencies(executor, &latenciesNs);
+    };
+
+    timeExecutions("asynchronous", [&preparedModel, &request] {
+        sp<ExecutionCallback> callback = new ExecutionCallback();
+        Return<ErrorStatus> launchStatus =
+                preparedModel->execute_1_2(request, MeasureTiming::NO, callback);
+        if (!launchStatus.isOk() || static_cast<ErrorStatus>(launchStatus) != ErrorStatus::NONE) {
+            return ErrorStatus::GENERAL_FAILURE;
+        }
+        callback->wait();
+        return callback->getStatus();
+    });
+
+    timeExecutions("synchronous", [&preparedModel, &request] {
+        ErrorStatus result = ErrorStatus::GENERAL_FAILURE;
+        Return<void> ret = preparedModel->executeSynchronously(
+                request, MeasureTiming::NO,
+                [&result](ErrorStatus error, const hidl_vec<OutputShape>&, const Timing&) {
+                    result = error;
+                });
+        return ret.isOk() ? result : ErrorStatus::GENERAL_FAILURE;
+    });
+
+    const std::shared_ptr<::android::nn::ExecutionBurstController> controller =
+            CreateBurst(preparedModel);
+    ASSERT_NE(nullptr, controller.get());
+    std::vector<intptr_t> keys(request.pools.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = reinterpret_cast<intptr_t>(&request.pools[i]);
+    }
+
+    timeExecutions("burst", [&controller, &request, &keys] {
+        return std::get<0>(controller->compute(request, MeasureTiming::NO, keys));
+    });
+
+    timeExecutions("burst_uncached", [&controller, &request, &keys] {
+        const ErrorStatus status =
+                std::get<0>(controller->compute(request, MeasureTiming::NO, keys));
+        for (intptr_t key : keys) {
+            controller->freeMemory(key);
+        }
+        return status;
+    });
+}
+
 static void getPreparedModel(sp<PreparedModelCallback> callback,
                              sp<V1_0::IPreparedModel>* preparedModel) {
     *preparedModel = callback->getPreparedModel();
@@ -577,6 +739,9 @@ void Execute(const sp<V1_2::IDevice>& device, std::function<V1_2::Model(void)> c
     }
     EvaluatePreparedModel(preparedModel, is_ignored, examples,
                           model.relaxComputationFloat32toFloat16, testDynamicOutputShape);
+    if (gBenchmarkIterations > 0 && !::testing::Test::HasFailure()) {
+        BenchmarkPreparedModel(preparedModel, examples);
+    }
 }
 
 }  // namespace generated_tests
@@ -48,6 +48,10 @@ void Execute(const sp<V1_2::IDevice>& device, std::function<V1_2::Model(void)> c
              std::function<bool(int)> is_ignored, const std::vector<MixedTypedExample>& examples,
              bool testDynamicOutputShape = false);
 
+// When non-zero, Execute() on a V1_2 device also times that many executions of the first example
+// with each of the asynchronous, synchronous and burst paths, once the results have been checked.
+void SetBenchmarkIterations(uint32_t iterations);
+
 }  // namespace generated_tests
 
 }  // namespace neuralnetworks
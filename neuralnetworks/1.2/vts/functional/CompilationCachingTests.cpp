@@ -23,9 +23,13 @@
 #include <hidlmemory/mapping.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <random>
+#include <thread>
 
 #include "Callbacks.h"
 #include "GeneratedTestHarness.h"
@@ -1409,6 +1413,175 @@ TEST_P(CompilationCachingSecurityTest, WrongToken) {
 INSTANTIATE_TEST_CASE_P(TestCompilationCaching, CompilationCachingSecurityTest,
                         ::testing::Combine(kOperandTypeChoices, ::testing::Range(0U, 10U)));
 
+#ifdef NN_TEST_BENCHMARK
+
+// Times the preparation of models: what compilation caching saves on the driver, and how the driver
+// scales when several models are prepared at the same time. Only built into the benchmark test.
+class CompilationCachingBenchmark : public CompilationCachingTest {
+  protected:
+    static constexpr uint32_t kIterations = 10;
+    // Number of models an application typically prepares when it starts.
+    static constexpr uint32_t kNumConcurrentModels = 6;
+
+    // The cache files and token of one model, so that several models can be cached at once.
+    struct ModelCache {
+        std::vector<std::vector<std::string>> modelFiles;
+        std::vector<std::vector<std::string>> dataFiles;
+        uint8_t token[static_cast<uint32_t>(Constant::BYTE_SIZE_OF_CACHE_TOKEN)];
+    };
+
+    ModelCache createModelCache(uint32_t index) {
+        ModelCache cache;
+        const std::string suffix = "_" + std::to_string(index);
+        for (uint32_t i = 0; i < mNumModelCache; i++) {
+            cache.modelFiles.push_back({mCacheDir + "model" + std::to_string(i) + suffix});
+        }
+        for (uint32_t i = 0; i < mNumDataCache; i++) {
+            cache.dataFiles.push_back({mCacheDir + "data" + std::to_string(i) + suffix});
+        }
+        std::fill(std::begin(cache.token), std::end(cache.token), static_cast<uint8_t>(index + 1));
+        return cache;
+    }
+
+    // Compiles the model and saves it to the cache. Returns the time it took in nanoseconds, or -1
+    // on failure. Safe to call from several threads.
+    int64_t timePrepareModel(const Model& model, const ModelCache& cache) {
+        hidl_vec<hidl_handle> modelCache, dataCache;
+        createCacheHandles(cache.modelFiles, AccessMode::READ_WRITE, &modelCache);
+        createCacheHandles(cache.dataFiles, AccessMode::READ_WRITE, &dataCache);
+        sp<PreparedModelCallback> preparedModelCallback = new PreparedModelCallback();
+        hidl_array<uint8_t, sizeof(cache.token)> cacheToken(cache.token);
+
+        const auto start = std::chrono::steady_clock::now();
+        Return<ErrorStatus> prepareLaunchStatus =
+                device->prepareModel_1_2(model, ExecutionPreference::FAST_SINGLE_ANSWER, modelCache,
+                                         dataCache, cacheToken, preparedModelCallback);
+        if (!prepareLaunchStatus.isOk() ||
+            static_cast<ErrorStatus>(prepareLaunchStatus) != ErrorStatus::NONE) {
+            return -1;
+        }
+        preparedModelCallback->wait();
+        const auto end = std::chrono::steady_clock::now();
+        return preparedModelCallback->getStatus() == ErrorStatus::NONE ? elapsedNs(start, end) : -1;
+    }
+
+    // Same as timePrepareModel, from the cache saved by it.
+    int64_t timePrepareModelFromCache(const ModelCache& cache) {
+        hidl_vec<hidl_handle> modelCache, dataCache;
+        createCacheHandles(cache.modelFiles, AccessMode::READ_WRITE, &modelCache);
+        createCacheHandles(cache.dataFiles, AccessMode::READ_WRITE, &dataCache);
+        sp<PreparedModelCallback> preparedModelCallback = new PreparedModelCallback();
+        hidl_array<uint8_t, sizeof(cache.token)> cacheToken(cache.token);
+
+        const auto start = std::chrono::steady_clock::now();
+        Return<ErrorStatus> prepareLaunchStatus = device->prepareModelFromCache(
+                modelCache, dataCache, cacheToken, preparedModelCallback);
+        if (!prepareLaunchStatus.isOk() ||
+            static_cast<ErrorStatus>(prepareLaunchStatus) != ErrorStatus::NONE) {
+            return -1;
+        }
+        preparedModelCallback->wait();
+        const auto end = std::chrono::steady_clock::now();
+        return preparedModelCallback->getStatus() == ErrorStatus::NONE ? elapsedNs(start, end) : -1;
+    }
+
+    // Runs prepare(i) for every model in turn, then for all of them at once from as many threads,
+    // and reports both wall times.
+    template <typename Prepare>
+    void timeConcurrentPreparation(const std::string& name, Prepare prepare) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < kNumConcurrentModels; i++) {
+            ASSERT_GE(prepare(i), 0) << name << " preparation failed";
+        }
+        const int64_t serialNs = elapsedNs(start, std::chrono::steady_clock::now());
+
+        std::atomic_bool failed(false);
+        std::vector<std::thread> threads;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < kNumConcurrentModels; i++) {
+            threads.emplace_back([&prepare, &failed, i] {
+                if (prepare(i) < 0) failed = true;
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        const int64_t concurrentNs = elapsedNs(start, std::chrono::steady_clock::now());
+        ASSERT_FALSE(failed) << name << " concurrent preparation failed";
+
+        std::cout << "[          ]   " << name << ": " << kNumConcurrentModels << " models in "
+                  << serialNs / 1000000 << " ms serially, " << concurrentNs / 1000000
+                  << " ms concurrently, speedup x" << static_cast<double>(serialNs) / concurrentNs
+                  << std::endl;
+        RecordProperty(name + "_serial_ms", static_cast<int>(serialNs / 1000000));
+        RecordProperty(name + "_concurrent_ms", static_cast<int>(concurrentNs / 1000000));
+    }
+
+    static int64_t elapsedNs(std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    static int64_t medianMs(std::vector<int64_t> latenciesNs) {
+        std::sort(latenciesNs.begin(), latenciesNs.end());
+        return latenciesNs[latenciesNs.size() / 2] / 1000000;
+    }
+};
+
+TEST_P(CompilationCachingBenchmark, ColdVersusWarmPreparation) {
+    const std::vector<std::pair<std::string, Model>> models = {
+            {"mobilenet", createTestModel()},
+            {"add_chain", createLargeTestModel(OperationType::ADD, kLargeModelSize)},
+    };
+    for (const auto& [name, model] : models) {
+        if (checkEarlyTermination(model)) continue;
+        const ModelCache cache = createModelCache(0);
+
+        std::vector<int64_t> coldNs, warmNs;
+        for (uint32_t i = 0; i < kIterations; i++) {
+            const int64_t cold = timePrepareModel(model, cache);
+            ASSERT_GE(cold, 0) << name << " preparation failed";
+            coldNs.push_back(cold);
+            if (mIsCachingSupported) {
+                const int64_t warm = timePrepareModelFromCache(cache);
+                ASSERT_GE(warm, 0) << name << " preparation from cache failed";
+                warmNs.push_back(warm);
+            }
+        }
+
+        std::cout << "[          ]   " << name << ": cold prepareModel_1_2 " << medianMs(coldNs)
+                  << " ms";
+        RecordProperty(name + "_cold_ms", static_cast<int>(medianMs(coldNs)));
+        if (mIsCachingSupported) {
+            std::cout << ", warm prepareModelFromCache " << medianMs(warmNs) << " ms";
+            RecordProperty(name + "_warm_ms", static_cast<int>(medianMs(warmNs)));
+        }
+        std::cout << std::endl;
+    }
+}
+
+TEST_P(CompilationCachingBenchmark, ConcurrentPreparation) {
+    const Model testModel = createTestModel();
+    if (checkEarlyTermination(testModel)) return;
+    std::vector<ModelCache> caches;
+    for (uint32_t i = 0; i < kNumConcurrentModels; i++) {
+        caches.push_back(createModelCache(i));
+    }
+
+    timeConcurrentPreparation("cold", [this, &testModel, &caches](uint32_t i) {
+        return timePrepareModel(testModel, caches[i]);
+    });
+    if (mIsCachingSupported && !HasFailure()) {
+        timeConcurrentPreparation("warm", [this, &caches](uint32_t i) {
+            return timePrepareModelFromCache(caches[i]);
+        });
+    }
+}
+
+INSTANTIATE_TEST_CASE_P(TestCompilationCaching, CompilationCachingBenchmark, kOperandTypeChoices);
+
+#endif  // NN_TEST_BENCHMARK
+
 }  // namespace functional
 }  // namespace vts
 }  // namespace V1_2
@@ -21,6 +21,9 @@
 #include <android-base/logging.h>
 
 #include "Callbacks.h"
+#include "GeneratedTestHarness.h"
+
+#include <string>
 
 namespace android {
 namespace hardware {
@@ -168,6 +171,23 @@ namespace android::hardware::neuralnetworks::V1_0 {
 using android::hardware::neuralnetworks::V1_2::vts::functional::NeuralnetworksHidlEnvironment;
 
 int main(int argc, char** argv) {
+#ifdef NN_TEST_BENCHMARK
+    // Strip "--benchmark_iterations=N" before the arguments are parsed by the test environment
+    uint32_t benchmarkIterations = 100;
+    const std::string kIterationsFlag = "--benchmark_iterations=";
+    int newArgc = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]).compare(0, kIterationsFlag.size(), kIterationsFlag) == 0) {
+            benchmarkIterations = std::stoul(argv[i] + kIterationsFlag.size());
+        } else {
+            argv[newArgc++] = argv[i];
+        }
+    }
+    argc = newArgc;
+    android::hardware::neuralnetworks::generated_tests::SetBenchmarkIterations(
+            benchmarkIterations);
+#endif  // NN_TEST_BENCHMARK
+
     ::testing::AddGlobalTestEnvironment(NeuralnetworksHidlEnvironment::getInstance());
     ::testing::InitGoogleTest(&argc, argv);
     NeuralnetworksHidlEnvironment::getInstance()->init(&argc, argv);
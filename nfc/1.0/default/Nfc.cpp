@@ -13,8 +13,15 @@ namespace V1_0 {
 namespace implementation {
 
 sp<INfcClientCallback> Nfc::mCallback = nullptr;
+// Defined before the receive metrics, which it holds.
+::android::hardware::metrics::Registry Nfc::mMetrics("nfc");
+::android::hardware::metrics::Histogram* Nfc::mRxLatency = Nfc::mMetrics.histogram("rx_latency");
+::android::hardware::metrics::Counter* Nfc::mRxBytes = Nfc::mMetrics.counter("rx_bytes");
 
-Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
+Nfc::Nfc(nfc_nci_device_t* device)
+    : mDevice(device),
+      mTxLatency(mMetrics.histogram("tx_latency")),
+      mTxBytes(mMetrics.counter("tx_bytes")) {}
 
 // Methods from ::android::hardware::nfc::V1_0::INfc follow.
 ::android::hardware::Return<NfcStatus> Nfc::open(const sp<INfcClientCallback>& clientCallback)  {
@@ -32,7 +39,23 @@ Nfc::Nfc(nfc_nci_device_t* device) : mDevice(device) {}
     if (mDevice == nullptr) {
         return -1;
     }
-    return mDevice->write(mDevice, data.size(), &data[0]);
+    int ret;
+    {
+        ::android::hardware::metrics::ScopedTimer timer(mTxLatency);
+        ret = mDevice->write(mDevice, data.size(), &data[0]);
+    }
+    mTxBytes->increment(data.size());
+    mMetrics.maybeTraceHistograms();
+    return ret;
+}
+
+::android::hardware::Return<void> Nfc::debug(const hidl_handle& handle,
+                                             const hidl_vec<hidl_string>& /* options */) {
+    if (handle == nullptr || handle->numFds < 1) {
+        return Void();
+    }
+    mMetrics.dump(handle->data[0]);
+    return Void();
 }
 
 ::android::hardware::Return<NfcStatus> Nfc::coreInitialized(const hidl_vec<uint8_t>& data)  {
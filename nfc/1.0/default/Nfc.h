@@ -5,6 +5,8 @@
 #include <hidl/Status.h>
 #include <hardware/hardware.h>
 #include <hardware/nfc.h>
+#include <hal-metrics/Metrics.h>
+
 namespace android {
 namespace hardware {
 namespace nfc {
@@ -15,6 +17,7 @@ using ::android::hardware::nfc::V1_0::INfc;
 using ::android::hardware::nfc::V1_0::INfcClientCallback;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
 using ::android::sp;
@@ -30,6 +33,10 @@ struct Nfc : public INfc, public hidl_death_recipient {
     ::android::hardware::Return<NfcStatus> controlGranted() override;
     ::android::hardware::Return<NfcStatus> powerCycle() override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    ::android::hardware::Return<void> debug(const hidl_handle& handle,
+                                            const hidl_vec<hidl_string>& options) override;
+
     static void eventCallback(uint8_t event, uint8_t status) {
         if (mCallback != nullptr) {
             auto ret = mCallback->sendEvent((::android::hardware::nfc::V1_0::NfcEvent)event,
@@ -43,10 +50,15 @@ struct Nfc : public INfc, public hidl_death_recipient {
         hidl_vec<uint8_t> data;
         data.setToExternal(p_data, data_len);
         if (mCallback != nullptr) {
-            auto ret = mCallback->sendData(data);
-            if (!ret.isOk()) {
-                ALOGW("Failed to call back into NFC process.");
+            {
+                ::android::hardware::metrics::ScopedTimer timer(mRxLatency);
+                auto ret = mCallback->sendData(data);
+                if (!ret.isOk()) {
+                    ALOGW("Failed to call back into NFC process.");
+                }
             }
+            mRxBytes->increment(data_len);
+            mMetrics.maybeTraceHistograms();
         }
     }
 
@@ -57,7 +69,13 @@ struct Nfc : public INfc, public hidl_death_recipient {
 
    private:
     static sp<INfcClientCallback> mCallback;
+    // NCI write and receive latencies and bytes, dumped by debug().
+    static ::android::hardware::metrics::Registry mMetrics;
+    static ::android::hardware::metrics::Histogram* mRxLatency;
+    static ::android::hardware::metrics::Counter*   mRxBytes;
     const nfc_nci_device_t*       mDevice;
+    ::android::hardware::metrics::Histogram* mTxLatency;
+    ::android::hardware::metrics::Counter*   mTxBytes;
 };
 
 extern "C" INfc* HIDL_FETCH_INfc(const char* name);
@@ -22,8 +22,12 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <algorithm>
 #include <exception>
 #include <thread>
@@ -43,7 +47,14 @@ constexpr char kIioDirRoot[] = "/sys/bus/iio/devices/";
 constexpr char kDeviceName[] = "pm_device_name";
 constexpr char kDeviceType[] = "iio:device";
 constexpr uint32_t MAX_SAMPLING_RATE = 10;
+constexpr size_t MAX_STREAM_SESSIONS = 4;
+// State residencies are collected again once older than this
+constexpr auto kResidencyCacheMaxAge = std::chrono::milliseconds(500);
+// How long a request waits for the providers
+constexpr auto kResidencyCollectTimeout = std::chrono::milliseconds(500);
 constexpr uint64_t WRITE_TIMEOUT_NS = 1000000000;
+// sysfs attributes are at most a page long
+constexpr size_t kEnergyValueBufferSize = 4096;
 
 void PowerStats::findIioPowerMonitorNodes() {
     struct dirent* ent;
@@ -165,12 +176,120 @@ int PowerStats::parseIioEnergyNode(std::string devName) {
     return ret;
 }
 
+void PowerStats::openIioEnergyNodes() {
+    std::vector<EnergyNode> nodes(mPm.devicePaths.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        nodes[i].fileName = mPm.devicePaths[i] + "/energy_value";
+        const char* fileName = nodes[i].fileName.c_str();
+        nodes[i].fd.reset(TEMP_FAILURE_RETRY(open(fileName, O_RDONLY | O_CLOEXEC)));
+        if (nodes[i].fd < 0) {
+            ALOGW("Error opening file: %s, reopening it on every sample", fileName);
+            return;
+        }
+    }
+    mPm.energyNodes = std::move(nodes);
+}
+
+// Parses a decimal number like strtoull does: leading whitespace is skipped, parsing stops at the
+// first character that is not a digit, and ULLONG_MAX is returned on overflow.
+static uint64_t parseUint64(const char* pos, const char* end) {
+    while (pos != end && isspace(*pos)) {
+        pos++;
+    }
+    uint64_t value = 0;
+    for (; pos != end && *pos >= '0' && *pos <= '9'; pos++) {
+        uint64_t digit = *pos - '0';
+        if (value > (ULLONG_MAX - digit) / 10) {
+            return ULLONG_MAX;
+        }
+        value = value * 10 + digit;
+    }
+    return value;
+}
+
+int32_t PowerStats::lineRailIndex(EnergyNode* node, size_t line, const char* name,
+                                  size_t length) {
+    if (line < node->lineRails.size()) {
+        const auto& rail = node->lineRails[line];
+        if (rail.first.size() == length && memcmp(rail.first.data(), name, length) == 0) {
+            return rail.second;
+        }
+    } else {
+        node->lineRails.resize(line + 1);
+    }
+    // First time this line is read, or the rails changed order
+    auto& rail = node->lineRails[line];
+    rail.first.assign(name, length);
+    auto it = mPm.railsInfo.find(rail.first);
+    rail.second = it != mPm.railsInfo.end() ? it->second.index : -1;
+    return rail.second;
+}
+
+// Same as parseIioEnergyNode, without reopening the node or allocating: this runs for every
+// sample of streamEnergyData.
+int PowerStats::sampleIioEnergyNode(EnergyNode* node) {
+    char buffer[kEnergyValueBufferSize];
+    ssize_t size = TEMP_FAILURE_RETRY(pread(node->fd, buffer, sizeof(buffer), 0));
+    if (size < 0) {
+        ALOGE("Error reading file: %s", node->fileName.c_str());
+        return -1;
+    }
+
+    const char* pos = buffer;
+    const char* const end = buffer + size;
+    uint64_t timestamp = 0;
+    bool timestampRead = false;
+    size_t line = 0;
+    while (pos != end) {
+        const char* lineEnd = static_cast<const char*>(memchr(pos, '\n', end - pos));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        const char* comma = static_cast<const char*>(memchr(pos, ',', lineEnd - pos));
+        bool twoWords = comma != nullptr && memchr(comma + 1, ',', lineEnd - comma - 1) == nullptr;
+        if (timestampRead == false) {
+            if (comma == nullptr) {
+                timestamp = parseUint64(pos, lineEnd);
+                if (timestamp == 0 || timestamp == ULLONG_MAX) {
+                    ALOGW("Potentially wrong timestamp: %" PRIu64, timestamp);
+                }
+                timestampRead = true;
+            }
+        } else if (twoWords) {
+            int32_t index = lineRailIndex(node, line++, pos, comma - pos);
+            if (index >= 0) {
+                mPm.reading[index].index = index;
+                mPm.reading[index].timestamp = timestamp;
+                mPm.reading[index].energy = parseUint64(comma + 1, lineEnd);
+                if (mPm.reading[index].energy == ULLONG_MAX) {
+                    ALOGW("Potentially wrong energy value: %" PRIu64, mPm.reading[index].energy);
+                }
+            }
+        } else {
+            ALOGW("Unexpected format in file: %s", node->fileName.c_str());
+            return -1;
+        }
+        pos = lineEnd == end ? end : lineEnd + 1;
+    }
+    return 0;
+}
+
 Status PowerStats::parseIioEnergyNodes() {
     Status ret = Status::SUCCESS;
     if (mPm.hwEnabled == false) {
         return Status::NOT_SUPPORTED;
     }
 
+    for (auto& node : mPm.energyNodes) {
+        if (sampleIioEnergyNode(&node) < 0) {
+            ALOGE("Error in parsing power stats");
+            return Status::FILESYSTEM_ERROR;
+        }
+    }
+    if (!mPm.energyNodes.empty()) {
+        return ret;
+    }
+
     for (const auto& devicePath : mPm.devicePaths) {
         if (parseIioEnergyNode(devicePath) < 0) {
             ALOGE("Error in parsing power stats");
@@ -189,6 +308,29 @@ PowerStats::PowerStats() {
     } else {
         mPm.hwEnabled = true;
         mPm.reading.resize(numRails);
+        openIioEnergyNodes();
+    }
+}
+
+PowerStats::~PowerStats() {
+    {
+        std::lock_guard<std::mutex> _lock(mStreamLock);
+        mStreamExit = true;
+    }
+    mStreamCond.notify_one();
+    if (mStreamThread.joinable()) {
+        mStreamThread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> _lock(mResidencyCacheLock);
+        mResidencyExit = true;
+    }
+    mResidencyCond.notify_all();
+    for (auto& entry : mResidencyCache) {
+        if (entry.second.worker.joinable()) {
+            entry.second.worker.join();
+        }
     }
 }
 
@@ -247,48 +389,115 @@ Return<void> PowerStats::getEnergyData(const hidl_vec<uint32_t>& railIndices,
 
 Return<void> PowerStats::streamEnergyData(uint32_t timeMs, uint32_t samplingRate,
                                           streamEnergyData_cb _hidl_cb) {
-    std::lock_guard<std::mutex> _lock(mPm.mLock);
-    if (mPm.fmqSynchronized != nullptr) {
-        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+    uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
+    if (mPm.hwEnabled == false) {
+        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::NOT_SUPPORTED);
         return Void();
     }
-    uint32_t sps = std::min(samplingRate, MAX_SAMPLING_RATE);
-    uint32_t numSamples = timeMs * sps / 1000;
-    mPm.fmqSynchronized.reset(new (std::nothrow) MessageQueueSync(MAX_QUEUE_SIZE, true));
-    if (mPm.fmqSynchronized == nullptr || mPm.fmqSynchronized->isValid() == false) {
-        mPm.fmqSynchronized = nullptr;
-        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+    if (sps == 0) {
+        _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INVALID_INPUT);
         return Void();
     }
-    std::thread pollThread = std::thread([this, sps, numSamples]() {
-        uint64_t sleepTimeUs = 1000000 / sps;
-        uint32_t currSamples = 0;
-        while (currSamples < numSamples) {
-            mPm.mLock.lock();
-            if (parseIioEnergyNodes() == Status::SUCCESS) {
-                mPm.fmqSynchronized->writeBlocking(&mPm.reading[0], mPm.reading.size(),
-                                                   WRITE_TIMEOUT_NS);
-                mPm.mLock.unlock();
-                currSamples++;
-                if (usleep(sleepTimeUs) < 0) {
-                    ALOGW("Sleep interrupted");
-                    break;
-                }
-            } else {
-                mPm.mLock.unlock();
-                break;
+    uint32_t numSamples = uint64_t(timeMs) * sps / 1000;
+
+    auto session = std::make_shared<StreamSession>();
+    {
+        std::lock_guard<std::mutex> _lock(mStreamLock);
+        if (mStreamSessions.size() >= MAX_STREAM_SESSIONS) {
+            _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+            return Void();
+        }
+        session->fmq.reset(new (std::nothrow) MessageQueueSync(MAX_QUEUE_SIZE, true));
+        if (session->fmq == nullptr || session->fmq->isValid() == false) {
+            _hidl_cb(MessageQueueSync::Descriptor(), 0, 0, Status::INSUFFICIENT_RESOURCES);
+            return Void();
+        }
+        session->period = std::chrono::microseconds(1000000 / sps);
+        session->deadline = std::chrono::steady_clock::now();
+        session->samplesLeft = numSamples;
+        if (numSamples > 0) {
+            mStreamSessions.push_back(session);
+            if (!mStreamThread.joinable()) {
+                mStreamThread = std::thread(&PowerStats::streamLoop, this);
             }
+            mStreamCond.notify_one();
         }
-        mPm.mLock.lock();
-        mPm.fmqSynchronized = nullptr;
-        mPm.mLock.unlock();
-        return;
-    });
-    pollThread.detach();
-    _hidl_cb(*(mPm.fmqSynchronized)->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
+    }
+    _hidl_cb(*session->fmq->getDesc(), numSamples, mPm.reading.size(), Status::SUCCESS);
     return Void();
 }
 
+void PowerStats::streamLoop() {
+    std::vector<EnergyData> reading;
+    std::vector<std::shared_ptr<StreamSession>> dueSessions;
+    std::unique_lock<std::mutex> lock(mStreamLock);
+    while (!mStreamExit) {
+        if (mStreamSessions.empty()) {
+            mStreamCond.wait(lock);
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto nextDeadline = mStreamSessions[0]->deadline;
+        for (const auto& session : mStreamSessions) {
+            nextDeadline = std::min(nextDeadline, session->deadline);
+        }
+        if (now < nextDeadline) {
+            // Also woken by a new session, whose first sample is due right away
+            mStreamCond.wait_until(lock, nextDeadline);
+            continue;
+        }
+
+        dueSessions.clear();
+        for (const auto& session : mStreamSessions) {
+            if (session->deadline > now) continue;
+            dueSessions.push_back(session);
+            session->samplesLeft--;
+            // The next deadline follows from the previous one rather than from now, so the time
+            // spent sampling does not accumulate. A session that fell behind is not sampled
+            // twice in a row to catch up, its samples are just spread over a longer time.
+            do {
+                session->deadline += session->period;
+            } while (session->deadline <= now);
+        }
+        lock.unlock();
+
+        // One sample serves all the due sessions. It is copied out so that writing it to the
+        // queues does not hold up getEnergyData.
+        Status status;
+        {
+            std::lock_guard<std::mutex> _lock(mPm.mLock);
+            status = parseIioEnergyNodes();
+            if (status == Status::SUCCESS) {
+                reading = mPm.reading;
+            }
+        }
+        for (const auto& session : dueSessions) {
+            if (status != Status::SUCCESS) {
+                session->failed = true;
+            } else if (session->fmq->availableToWrite() < reading.size()) {
+                // Never wait for a slow reader, as that would delay the other sessions: its
+                // sample is dropped instead. This thread is the only writer, so the space
+                // checked here is still there for the write below, which then does not block.
+                if (session->droppedSamples++ == 0) {
+                    ALOGW("Energy data queue full, dropping samples");
+                }
+            } else if (!session->fmq->writeBlocking(reading.data(), reading.size(),
+                                                    WRITE_TIMEOUT_NS)) {
+                ALOGW("Failed to write energy data, ending the stream");
+                session->failed = true;
+            }
+        }
+
+        lock.lock();
+        mStreamSessions.erase(std::remove_if(mStreamSessions.begin(), mStreamSessions.end(),
+                                             [](const std::shared_ptr<StreamSession>& session) {
+                                                 return session->failed ||
+                                                        session->samplesLeft == 0;
+                                             }),
+                              mStreamSessions.end());
+    }
+}
+
 uint32_t PowerStats::addPowerEntity(const std::string& name, PowerEntityType type) {
     uint32_t id = mPowerEntityInfos.size();
     mPowerEntityInfos.push_back({id, name, type});
@@ -350,6 +559,61 @@ Return<void> PowerStats::getPowerEntityStateInfo(const hidl_vec<uint32_t>& power
     return Void();
 }
 
+// Must be called with mResidencyCacheLock held. Moves the pending collection of the entry, if it is
+// done, to its results.
+static void cacheResidencies(ResidencyCacheEntry* entry) {
+    if (!entry->pending.valid() ||
+        entry->pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    entry->last = entry->pending.get();
+    entry->pending = {};
+}
+
+// Runs the collections requested for the provider, one at a time, until the PowerStats is
+// destroyed. The results are cached by whoever gets them first.
+void PowerStats::residencyLoop(std::shared_ptr<IStateResidencyDataProvider> provider) {
+    std::unique_lock<std::mutex> lock(mResidencyCacheLock);
+    ResidencyCacheEntry& entry = mResidencyCache[provider.get()];
+    while (!mResidencyExit) {
+        if (entry.request == nullptr) {
+            mResidencyCond.wait(lock);
+            continue;
+        }
+        auto promise = std::move(entry.request);
+        entry.request = nullptr;
+        lock.unlock();
+
+        auto collection = std::make_shared<ResidencyCollection>();
+        collection->ok = provider->getResults(collection->results);
+        collection->collectedAt = std::chrono::steady_clock::now();
+        promise->set_value(collection);
+
+        lock.lock();
+    }
+}
+
+// Must be called with mResidencyCacheLock held. Returns the collection running for the provider,
+// requesting it from the worker of the provider if there is none.
+std::shared_future<std::shared_ptr<const ResidencyCollection>> PowerStats::collectResidencies(
+        const std::shared_ptr<IStateResidencyDataProvider>& provider) {
+    ResidencyCacheEntry& entry = mResidencyCache[provider.get()];
+    if (entry.pending.valid()) {
+        return entry.pending;
+    }
+
+    // A worker per provider, so that the providers are still collected concurrently, and a stuck
+    // provider holds up its own worker only, not the caller beyond its deadline. As a provider
+    // has at most one pending collection, there are never more threads than providers.
+    entry.request = std::make_shared<std::promise<std::shared_ptr<const ResidencyCollection>>>();
+    entry.pending = entry.request->get_future().share();
+    if (!entry.worker.joinable()) {
+        entry.worker = std::thread(&PowerStats::residencyLoop, this, provider);
+    }
+    mResidencyCond.notify_all();
+    return entry.pending;
+}
+
 Return<void> PowerStats::getPowerEntityStateResidencyData(
         const hidl_vec<uint32_t>& powerEntityIds, getPowerEntityStateResidencyData_cb _hidl_cb) {
     // If not configured, return NOT_SUPPORTED
@@ -367,13 +631,10 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
         return getPowerEntityStateResidencyData(ids, _hidl_cb);
     }
 
-    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> stateResidencies;
-    std::vector<PowerEntityStateResidencyResult> results;
-    results.reserve(powerEntityIds.size());
-
-    // return results for only the given powerEntityIds
+    // Find the providers of the given powerEntityIds, each one once
     bool invalidInput = false;
     bool filesystemError = false;
+    std::vector<std::shared_ptr<IStateResidencyDataProvider>> providers;
     for (auto id : powerEntityIds) {
         auto dataProvider = mStateResidencyDataProviders.find(id);
         // skip if the given powerEntityId does not have an associated StateResidencyDataProvider
@@ -381,17 +642,65 @@ Return<void> PowerStats::getPowerEntityStateResidencyData(
             invalidInput = true;
             continue;
         }
+        if (std::find(providers.begin(), providers.end(), dataProvider->second) ==
+            providers.end()) {
+            providers.push_back(dataProvider->second);
+        }
+    }
 
-        // get the results if we have not already done so.
-        if (stateResidencies.find(id) == stateResidencies.end()) {
-            if (!dataProvider->second->getResults(stateResidencies)) {
-                filesystemError = true;
+    // Collect the results of the providers whose cached results are no longer fresh, all at
+    // once, so that the slowest provider rather than the sum of them bounds the latency.
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<const ResidencyCollection>> collections(providers.size());
+    std::vector<std::shared_future<std::shared_ptr<const ResidencyCollection>>> pending(
+            providers.size());
+    {
+        std::lock_guard<std::mutex> _lock(mResidencyCacheLock);
+        for (size_t i = 0; i < providers.size(); i++) {
+            ResidencyCacheEntry& entry = mResidencyCache[providers[i].get()];
+            // Also picks up a collection that finished after its caller timed out
+            cacheResidencies(&entry);
+            const auto& last = entry.last;
+            if (last != nullptr && last->ok && now - last->collectedAt < kResidencyCacheMaxAge) {
+                collections[i] = last;
+            } else {
+                pending[i] = collectResidencies(providers[i]);
             }
         }
+    }
+    auto deadline = now + kResidencyCollectTimeout;
+    for (size_t i = 0; i < providers.size(); i++) {
+        if (!pending[i].valid()) continue;
+        bool ready = pending[i].wait_until(deadline) == std::future_status::ready;
+        std::lock_guard<std::mutex> _lock(mResidencyCacheLock);
+        ResidencyCacheEntry& entry = mResidencyCache[providers[i].get()];
+        if (ready) {
+            collections[i] = pending[i].get();
+            cacheResidencies(&entry);
+            continue;
+        }
+        // Fall back to the last results, however old, and report the provider as failed
+        LOG(WARNING) << "Timed out collecting state residencies";
+        collections[i] = entry.last;
+        filesystemError = true;
+    }
+
+    // return results for only the given powerEntityIds
+    std::vector<PowerEntityStateResidencyResult> results;
+    results.reserve(powerEntityIds.size());
+    for (auto id : powerEntityIds) {
+        auto dataProvider = mStateResidencyDataProviders.find(id);
+        if (dataProvider == mStateResidencyDataProviders.end()) continue;
+        size_t i = std::find(providers.begin(), providers.end(), dataProvider->second) -
+                   providers.begin();
+        if (collections[i] == nullptr) continue;
+        if (!collections[i]->ok) {
+            filesystemError = true;
+        }
 
         // append results
-        auto stateResidency = stateResidencies.find(id);
-        if (stateResidency != stateResidencies.end()) {
+        auto stateResidency = collections[i]->results.find(id);
+        if (stateResidency != collections[i]->results.end()) {
             results.emplace_back(stateResidency->second);
         }
     }
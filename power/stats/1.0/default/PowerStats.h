@@ -17,10 +17,15 @@
 #ifndef ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 #define ANDROID_HARDWARE_POWERSTATS_V1_0_POWERSTATS_H
 
+#include <android-base/unique_fd.h>
 #include <android/hardware/power/stats/1.0/IPowerStats.h>
 #include <fmq/MessageQueue.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <thread>
 #include <unordered_map>
 
 namespace android {
@@ -52,13 +57,35 @@ struct RailData {
     uint32_t samplingRate;
 };
 
+// An energy_value node kept open for sampling.
+struct EnergyNode {
+    std::string fileName;
+    android::base::unique_fd fd;
+    // The rail of each line of the node, resolved the first time the line is read: the rails are
+    // listed in the same order on every read. The index is -1 for a rail that is not reported.
+    std::vector<std::pair<std::string, int32_t>> lineRails;
+};
+
 struct OnDeviceMmt {
     std::mutex mLock;
     bool hwEnabled;
     std::vector<std::string> devicePaths;
     std::map<std::string, RailData> railsInfo;
+    // One per device path, empty if any of them could not be opened
+    std::vector<EnergyNode> energyNodes;
     std::vector<EnergyData> reading;
-    std::unique_ptr<MessageQueueSync> fmqSynchronized;
+};
+
+// A streamEnergyData request, sampled by the stream thread until it has all its samples.
+struct StreamSession {
+    std::unique_ptr<MessageQueueSync> fmq;
+    std::chrono::steady_clock::duration period;
+    // When the next sample is due
+    std::chrono::steady_clock::time_point deadline;
+    uint32_t samplesLeft;
+    // Samples not written because the reader had not made room for them
+    uint32_t droppedSamples = 0;
+    bool failed = false;
 };
 
 class IStateResidencyDataProvider {
@@ -69,9 +96,29 @@ class IStateResidencyDataProvider {
     virtual std::vector<PowerEntityStateSpace> getStateSpaces() = 0;
 };
 
+// The results of one IStateResidencyDataProvider::getResults call.
+struct ResidencyCollection {
+    bool ok;
+    std::chrono::steady_clock::time_point collectedAt;
+    std::unordered_map<uint32_t, PowerEntityStateResidencyResult> results;
+};
+
+struct ResidencyCacheEntry {
+    // The latest collection, reused while it is fresh
+    std::shared_ptr<const ResidencyCollection> last;
+    // The collection running for the provider, if any. There is at most one at a time, as a
+    // provider may not expect concurrent calls, and a collection that times out keeps running.
+    std::shared_future<std::shared_ptr<const ResidencyCollection>> pending;
+    // The collection that worker has yet to start, if any
+    std::shared_ptr<std::promise<std::shared_ptr<const ResidencyCollection>>> request;
+    // Collects the results of the provider, started by its first collection
+    std::thread worker;
+};
+
 struct PowerStats : public IPowerStats {
    public:
     PowerStats();
+    ~PowerStats();
     uint32_t addPowerEntity(const std::string& name, PowerEntityType type);
     void addStateResidencyDataProvider(std::shared_ptr<IStateResidencyDataProvider> p);
     // Methods from ::android::hardware::power::stats::V1_0::IPowerStats follow.
@@ -95,11 +142,30 @@ struct PowerStats : public IPowerStats {
     void findIioPowerMonitorNodes();
     size_t parsePowerRails();
     int parseIioEnergyNode(std::string devName);
+    void openIioEnergyNodes();
+    int sampleIioEnergyNode(EnergyNode* node);
+    int32_t lineRailIndex(EnergyNode* node, size_t line, const char* name, size_t length);
     Status parseIioEnergyNodes();
+    void streamLoop();
+    void residencyLoop(std::shared_ptr<IStateResidencyDataProvider> provider);
+    std::shared_future<std::shared_ptr<const ResidencyCollection>> collectResidencies(
+            const std::shared_ptr<IStateResidencyDataProvider>& provider);
     std::vector<PowerEntityInfo> mPowerEntityInfos;
     std::unordered_map<uint32_t, PowerEntityStateSpace> mPowerEntityStateSpaces;
     std::unordered_map<uint32_t, std::shared_ptr<IStateResidencyDataProvider>>
             mStateResidencyDataProviders;
+    std::mutex mResidencyCacheLock;
+    std::condition_variable mResidencyCond;
+    std::unordered_map<IStateResidencyDataProvider*, ResidencyCacheEntry> mResidencyCache;
+    bool mResidencyExit = false;
+
+    // Guards the stream sessions, which are sampled by mStreamThread. It is started by the first
+    // streamEnergyData call and then serves all of them.
+    std::mutex mStreamLock;
+    std::condition_variable mStreamCond;
+    std::vector<std::shared_ptr<StreamSession>> mStreamSessions;
+    std::thread mStreamThread;
+    bool mStreamExit = false;
 };
 
 }  // namespace implementation
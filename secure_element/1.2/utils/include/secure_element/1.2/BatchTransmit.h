@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_SECURE_ELEMENT_V1_2_BATCHTRANSMIT_H
+#define ANDROID_HARDWARE_SECURE_ELEMENT_V1_2_BATCHTRANSMIT_H
+
+#include <hidl/HidlSupport.h>
+
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace secure_element {
+namespace V1_2 {
+
+// Whether the status word of an APDU response is 9000.
+inline bool isSuccessResponse(const hidl_vec<uint8_t>& response) {
+    size_t size = response.size();
+    return size >= 2 && response[size - 2] == 0x90 && response[size - 1] == 0x00;
+}
+
+// Reference implementation of ISecureElement::transmitBatch for a HAL whose transport sends one
+// APDU at a time. transmit sends one command and returns its response, empty when communicating
+// with the secure element fails, as ISecureElement::transmit does. The commands are sent back to
+// back within the HAL, which saves the client a binder round trip per APDU:
+//
+//   Return<void> SecureElement::transmitBatch(const hidl_vec<hidl_vec<uint8_t>>& commands,
+//                                             bool stopOnFailure, transmitBatch_cb _hidl_cb) {
+//       _hidl_cb(V1_2::transmitBatch(commands, stopOnFailure, [this](const auto& command) {
+//           return transmitApdu(command);
+//       }));
+//       return Void();
+//   }
+template <typename Transmit>
+hidl_vec<hidl_vec<uint8_t>> transmitBatch(const hidl_vec<hidl_vec<uint8_t>>& commands,
+                                          bool stopOnFailure, Transmit transmit) {
+    std::vector<hidl_vec<uint8_t>> responses;
+    responses.reserve(commands.size());
+    for (const auto& command : commands) {
+        responses.push_back(transmit(command));
+        const hidl_vec<uint8_t>& response = responses.back();
+        if (response.size() == 0 || (stopOnFailure && !isSuccessResponse(response))) {
+            break;
+        }
+    }
+    return responses;
+}
+
+}  // namespace V1_2
+}  // namespace secure_element
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SECURE_ELEMENT_V1_2_BATCHTRANSMIT_H
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <string>
+
+#define LOG_TAG "secure_element_hidl_hal_test"
+#include <android-base/logging.h>
+
+#include <android/hardware/secure_element/1.0/types.h>
+#include <android/hardware/secure_element/1.1/ISecureElementHalCallback.h>
+#include <android/hardware/secure_element/1.2/ISecureElement.h>
+#include <secure_element/1.2/BatchTransmit.h>
+
+#include <VtsHalHidlTargetCallbackBase.h>
+#include <VtsHalHidlTargetTestBase.h>
+#include <VtsHalHidlTargetTestEnvBase.h>
+
+using ::android::sp;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::secure_element::V1_0::LogicalChannelResponse;
+using ::android::hardware::secure_element::V1_0::SecureElementStatus;
+using ::android::hardware::secure_element::V1_1::ISecureElementHalCallback;
+using ::android::hardware::secure_element::V1_2::ISecureElement;
+using ::android::hardware::secure_element::V1_2::isSuccessResponse;
+using ::testing::VtsHalHidlTargetTestEnvBase;
+
+#define DATA_APDU \
+    { 0x00, 0x08, 0x00, 0x00, 0x00 }
+// The test applet answers an instruction it does not support with a status word other than 9000.
+#define UNSUPPORTED_APDU \
+    { 0x00, 0xFE, 0x00, 0x00, 0x00 }
+#define ANDROID_TEST_AID                                                                          \
+    {                                                                                             \
+        0xA0, 0x00, 0x00, 0x04, 0x76, 0x41, 0x6E, 0x64, 0x72, 0x6F, 0x69, 0x64, 0x43, 0x54, 0x53, \
+            0x31                                                                                  \
+    }
+
+constexpr char kCallbackNameOnStateChange[] = "onStateChange";
+constexpr size_t kBenchmarkApduCount = 32;
+
+class SecureElementCallbackArgs {
+   public:
+    bool state_;
+    hidl_string reason_;
+};
+
+class SecureElementHalCallback
+    : public ::testing::VtsHalHidlTargetCallbackBase<SecureElementCallbackArgs>,
+      public ISecureElementHalCallback {
+   public:
+    virtual ~SecureElementHalCallback() = default;
+
+    Return<void> onStateChange_1_1(bool state, const hidl_string& reason) override {
+        SecureElementCallbackArgs args;
+        args.state_ = state;
+        args.reason_ = reason;
+        NotifyFromCallback(kCallbackNameOnStateChange, args);
+        return Void();
+    };
+
+    Return<void> onStateChange(__attribute__((unused)) bool state) override { return Void(); }
+};
+
+class SecureElementHidlEnvironment : public VtsHalHidlTargetTestEnvBase {
+   public:
+    // get the test environment singleton
+    static SecureElementHidlEnvironment* Instance() {
+        static SecureElementHidlEnvironment* instance = new SecureElementHidlEnvironment;
+        return instance;
+    }
+
+    virtual void registerTestServices() override { registerTestService<ISecureElement>(); }
+
+   private:
+    SecureElementHidlEnvironment() {}
+
+    GTEST_DISALLOW_COPY_AND_ASSIGN_(SecureElementHidlEnvironment);
+};
+
+class SecureElementHidlTest : public ::testing::VtsHalHidlTargetTestBase {
+   public:
+    virtual void SetUp() override {
+        std::string serviceName =
+                SecureElementHidlEnvironment::Instance()->getServiceName<ISecureElement>("eSE1");
+        LOG(INFO) << "get service with name:" << serviceName;
+        ASSERT_FALSE(serviceName.empty());
+        se_ = ::testing::VtsHalHidlTargetTestBase::getService<ISecureElement>(serviceName);
+        ASSERT_NE(se_, nullptr);
+
+        se_cb_ = new SecureElementHalCallback();
+        ASSERT_NE(se_cb_, nullptr);
+        se_->init_1_1(se_cb_);
+        auto res = se_cb_->WaitForCallback(kCallbackNameOnStateChange);
+        EXPECT_TRUE(res.no_timeout);
+        EXPECT_TRUE(res.args->state_);
+        EXPECT_NE(res.args->reason_, "");
+    }
+
+    // Opens a logical channel to the test applet, returns its number.
+    uint8_t openTestChannel() {
+        SecureElementStatus statusReturned = SecureElementStatus::FAILED;
+        uint8_t channelNumber = 0;
+        se_->openLogicalChannel(ANDROID_TEST_AID, 0x00,
+                                [&](LogicalChannelResponse response, SecureElementStatus status) {
+                                    statusReturned = status;
+                                    channelNumber = response.channelNumber;
+                                });
+        EXPECT_EQ(SecureElementStatus::SUCCESS, statusReturned);
+        EXPECT_LE(1, channelNumber);
+        return channelNumber;
+    }
+
+    hidl_vec<hidl_vec<uint8_t>> transmitBatch(const hidl_vec<hidl_vec<uint8_t>>& commands,
+                                              bool stopOnFailure) {
+        hidl_vec<hidl_vec<uint8_t>> responses;
+        se_->transmitBatch(commands, stopOnFailure,
+                           [&responses](const hidl_vec<hidl_vec<uint8_t>>& res) {
+                               responses = res;
+                           });
+        return responses;
+    }
+
+    sp<ISecureElement> se_;
+    sp<SecureElementHalCallback> se_cb_;
+};
+
+static hidl_vec<uint8_t> onChannel(std::vector<uint8_t> command, uint8_t channelNumber) {
+    command[0] |= channelNumber;
+    return command;
+}
+
+/*
+ * transmitBatch:
+ * Every command of the batch gets its response, with status word 9000
+ */
+TEST_F(SecureElementHidlTest, transmitBatch) {
+    uint8_t channelNumber = openTestChannel();
+    hidl_vec<hidl_vec<uint8_t>> commands(4);
+    for (auto& command : commands) {
+        command = onChannel(DATA_APDU, channelNumber);
+    }
+    hidl_vec<hidl_vec<uint8_t>> responses = transmitBatch(commands, true);
+    ASSERT_EQ(commands.size(), responses.size());
+    for (const auto& response : responses) {
+        EXPECT_LE((unsigned int)3, response.size());
+        EXPECT_TRUE(isSuccessResponse(response));
+    }
+    EXPECT_EQ(SecureElementStatus::SUCCESS, se_->closeChannel(channelNumber));
+}
+
+/*
+ * transmitBatchStopOnFailure:
+ * A batch stops after a failed command only when asked to
+ */
+TEST_F(SecureElementHidlTest, transmitBatchStopOnFailure) {
+    uint8_t channelNumber = openTestChannel();
+    hidl_vec<hidl_vec<uint8_t>> commands = {onChannel(DATA_APDU, channelNumber),
+                                            onChannel(UNSUPPORTED_APDU, channelNumber),
+                                            onChannel(DATA_APDU, channelNumber)};
+
+    hidl_vec<hidl_vec<uint8_t>> responses = transmitBatch(commands, true);
+    ASSERT_EQ(2u, responses.size());
+    EXPECT_TRUE(isSuccessResponse(responses[0]));
+    EXPECT_LE((unsigned int)2, responses[1].size());
+    EXPECT_FALSE(isSuccessResponse(responses[1]));
+
+    responses = transmitBatch(commands, false);
+    ASSERT_EQ(3u, responses.size());
+    EXPECT_FALSE(isSuccessResponse(responses[1]));
+    EXPECT_TRUE(isSuccessResponse(responses[2]));
+    EXPECT_EQ(SecureElementStatus::SUCCESS, se_->closeChannel(channelNumber));
+}
+
+/*
+ * transmitBatchBenchmark:
+ * Compares the time per APDU of single transmits to that of a batch
+ */
+TEST_F(SecureElementHidlTest, transmitBatchBenchmark) {
+    uint8_t channelNumber = openTestChannel();
+    hidl_vec<uint8_t> command = onChannel(DATA_APDU, channelNumber);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kBenchmarkApduCount; i++) {
+        se_->transmit(command, [](const hidl_vec<uint8_t>& response) {
+            EXPECT_TRUE(isSuccessResponse(response));
+        });
+    }
+    auto singleDuration = std::chrono::steady_clock::now() - start;
+
+    hidl_vec<hidl_vec<uint8_t>> commands(kBenchmarkApduCount);
+    for (auto& batchCommand : commands) {
+        batchCommand = command;
+    }
+    start = std::chrono::steady_clock::now();
+    hidl_vec<hidl_vec<uint8_t>> responses = transmitBatch(commands, true);
+    auto batchDuration = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(kBenchmarkApduCount, responses.size());
+
+    auto singleUs =
+            std::chrono::duration_cast<std::chrono::microseconds>(singleDuration).count() /
+            static_cast<int64_t>(kBenchmarkApduCount);
+    auto batchUs = std::chrono::duration_cast<std::chrono::microseconds>(batchDuration).count() /
+                   static_cast<int64_t>(kBenchmarkApduCount);
+    LOG(INFO) << "per APDU: " << singleUs << "us with transmit, " << batchUs
+              << "us with transmitBatch";
+    RecordProperty("transmit_us_per_apdu", std::to_string(singleUs));
+    RecordProperty("transmit_batch_us_per_apdu", std::to_string(batchUs));
+    EXPECT_EQ(SecureElementStatus::SUCCESS, se_->closeChannel(channelNumber));
+}
+
+int main(int argc, char** argv) {
+    ::testing::AddGlobalTestEnvironment(SecureElementHidlEnvironment::Instance());
+    ::testing::InitGoogleTest(&argc, argv);
+    SecureElementHidlEnvironment::Instance()->init(&argc, argv);
+    int status = RUN_ALL_TESTS();
+    return status;
+}
@@ -56,7 +56,9 @@ static Result ResultFromStatus(status_t err) {
 Sensors::Sensors()
     : mInitCheck(NO_INIT),
       mSensorModule(nullptr),
-      mSensorDevice(nullptr) {
+      mSensorDevice(nullptr),
+      mPollBuffer(new sensors_event_t[kPollMaxBufferSize]),
+      mPollEvents(new Event[kPollMaxBufferSize]) {
     status_t err = OK;
     if (UseMultiHal()) {
         mSensorModule = ::get_multi_hal_module_info();
@@ -162,36 +164,33 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
     hidl_vec<Event> out;
     hidl_vec<SensorInfo> dynamicSensorsAdded;
 
-    std::unique_ptr<sensors_event_t[]> data;
-    int err = android::NO_ERROR;
-
-    { // scope of reentry lock
-
-        // This enforces a single client, meaning that a maximum of one client can call poll().
-        // If this function is re-entred, it means that we are stuck in a state that may prevent
-        // the system from proceeding normally.
-        //
-        // Exit and let the system restart the sensor-hal-implementation hidl service.
-        //
-        // This function must not call _hidl_cb(...) or return until there is no risk of blocking.
-        std::unique_lock<std::mutex> lock(mPollLock, std::try_to_lock);
-        if(!lock.owns_lock()){
-            // cannot get the lock, hidl service will go into deadlock if it is not restarted.
-            // This is guaranteed to not trigger in passthrough mode.
-            LOG(ERROR) <<
-                    "ISensors::poll() re-entry. I do not know what to do except killing myself.";
-            ::exit(-1);
-        }
+    // This enforces a single client, meaning that a maximum of one client can call poll().
+    // If this function is re-entred, it means that we are stuck in a state that may prevent
+    // the system from proceeding normally.
+    //
+    // Exit and let the system restart the sensor-hal-implementation hidl service.
+    //
+    // This function must not call _hidl_cb(...) or return until there is no risk of blocking.
+    //
+    // The lock is held until _hidl_cb(...) returns, since the poll buffers are reused by the
+    // next call.
+    std::unique_lock<std::mutex> lock(mPollLock, std::try_to_lock);
+    if(!lock.owns_lock()){
+        // cannot get the lock, hidl service will go into deadlock if it is not restarted.
+        // This is guaranteed to not trigger in passthrough mode.
+        LOG(ERROR) <<
+                "ISensors::poll() re-entry. I do not know what to do except killing myself.";
+        ::exit(-1);
+    }
 
-        if (maxCount <= 0) {
-            err = android::BAD_VALUE;
-        } else {
-            int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
-            data.reset(new sensors_event_t[bufferSize]);
-            err = mSensorDevice->poll(
-                    reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
-                    data.get(), bufferSize);
-        }
+    int err = android::NO_ERROR;
+    if (maxCount <= 0) {
+        err = android::BAD_VALUE;
+    } else {
+        int bufferSize = maxCount <= kPollMaxBufferSize ? maxCount : kPollMaxBufferSize;
+        err = mSensorDevice->poll(
+                reinterpret_cast<sensors_poll_device_t *>(mSensorDevice),
+                mPollBuffer.get(), bufferSize);
     }
 
     if (err < 0) {
@@ -201,31 +200,15 @@ Return<void> Sensors::poll(int32_t maxCount, poll_cb _hidl_cb) {
 
     const size_t count = (size_t)err;
 
-    for (size_t i = 0; i < count; ++i) {
-        if (data[i].type != SENSOR_TYPE_DYNAMIC_SENSOR_META) {
-            continue;
-        }
+    std::vector<SensorInfo> dynamicSensors;
+    convertFromSensorEvents(count, mPollBuffer.get(), mPollEvents.get(), &dynamicSensors);
 
-        const dynamic_sensor_meta_event_t *dyn = &data[i].dynamic_sensor_meta;
-
-        if (!dyn->connected) {
-            continue;
-        }
-
-        CHECK(dyn->sensor != nullptr);
-        CHECK_EQ(dyn->sensor->handle, dyn->handle);
-
-        SensorInfo info;
-        convertFromSensor(*dyn->sensor, &info);
-
-        size_t numDynamicSensors = dynamicSensorsAdded.size();
-        dynamicSensorsAdded.resize(numDynamicSensors + 1);
-        dynamicSensorsAdded[numDynamicSensors] = info;
+    // Hand the persistent buffer out without copying it
+    out.setToExternal(mPollEvents.get(), count);
+    if (!dynamicSensors.empty()) {
+        dynamicSensorsAdded = dynamicSensors;
     }
 
-    out.resize(count);
-    convertFromSensorEvents(err, data.get(), &out);
-
     _hidl_cb(Result::OK, out, dynamicSensorsAdded);
 
     return Void();
@@ -332,12 +315,50 @@ Return<void> Sensors::configDirectReport(
 void Sensors::convertFromSensorEvents(
         size_t count,
         const sensors_event_t *srcArray,
-        hidl_vec<Event> *dstVec) {
+        Event *dstArray,
+        std::vector<SensorInfo> *dynamicSensorsAdded) {
+    // Sensor types whose payload is a plain vec3, converted inline. Everything else, including
+    // meta data and dynamic sensor events, goes through convertFromSensorEvent().
+    constexpr uint32_t kVec3SensorTypeMask =
+            (1u << SENSOR_TYPE_ACCELEROMETER) |
+            (1u << SENSOR_TYPE_MAGNETIC_FIELD) |
+            (1u << SENSOR_TYPE_ORIENTATION) |
+            (1u << SENSOR_TYPE_GYROSCOPE) |
+            (1u << SENSOR_TYPE_GRAVITY) |
+            (1u << SENSOR_TYPE_LINEAR_ACCELERATION);
+
     for (size_t i = 0; i < count; ++i) {
         const sensors_event_t &src = srcArray[i];
-        Event *dst = &(*dstVec)[i];
+        Event *dst = &dstArray[i];
+
+        const uint32_t type = static_cast<uint32_t>(src.type);
+        if (type < 32 && (kVec3SensorTypeMask & (1u << type)) != 0) {
+            dst->sensorHandle = src.sensor;
+            dst->sensorType = static_cast<SensorType>(src.type);
+            dst->timestamp = src.timestamp;
+            dst->u.vec3.x = src.acceleration.x;
+            dst->u.vec3.y = src.acceleration.y;
+            dst->u.vec3.z = src.acceleration.z;
+            dst->u.vec3.status = static_cast<SensorStatus>(src.acceleration.status);
+            continue;
+        }
 
         convertFromSensorEvent(src, dst);
+
+        if (src.type == SENSOR_TYPE_DYNAMIC_SENSOR_META) {
+            const dynamic_sensor_meta_event_t *dyn = &src.dynamic_sensor_meta;
+
+            if (!dyn->connected) {
+                continue;
+            }
+
+            CHECK(dyn->sensor != nullptr);
+            CHECK_EQ(dyn->sensor->handle, dyn->handle);
+
+            SensorInfo info;
+            convertFromSensor(*dyn->sensor, &info);
+            dynamicSensorsAdded->push_back(info);
+        }
     }
 }
 
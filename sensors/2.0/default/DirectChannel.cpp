@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirectChannel.h"
+
+#include <log/log.h>
+#include <sensors/convert.h>
+#include <sys/mman.h>
+
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::sensors::V1_0::SensorsEventFormatOffset;
+using ::android::hardware::sensors::V1_0::SharedMemFormat;
+using ::android::hardware::sensors::V1_0::SharedMemType;
+using ::android::hardware::sensors::V1_0::implementation::convertToSensorEvent;
+
+static constexpr size_t kRecordSize = static_cast<size_t>(SensorsEventFormatOffset::TOTAL_LENGTH);
+static_assert(sizeof(sensors_event_t) == kRecordSize, "sensors_event_t does not match the format");
+
+std::unique_ptr<DirectChannel> DirectChannel::create(const SharedMemInfo& mem) {
+    // Mapping gralloc buffers would need the mapper HAL, only ashmem is supported
+    if (mem.type != SharedMemType::ASHMEM || mem.format != SharedMemFormat::SENSORS_EVENT) {
+        return nullptr;
+    }
+    const native_handle_t* handle = mem.memoryHandle.getNativeHandle();
+    if (handle == nullptr || handle->numFds < 1 || mem.size < kRecordSize) {
+        return nullptr;
+    }
+
+    void* base = mmap(nullptr, mem.size, PROT_READ | PROT_WRITE, MAP_SHARED, handle->data[0], 0);
+    if (base == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        return nullptr;
+    }
+    // The memory has to be all 0 once the channel is registered
+    memset(base, 0, mem.size);
+    return std::unique_ptr<DirectChannel>(new DirectChannel(static_cast<uint8_t*>(base), mem.size));
+}
+
+DirectChannel::DirectChannel(uint8_t* base, size_t size)
+    : mBase(base), mSize(size), mWriteOffset(0), mCounter(0) {}
+
+DirectChannel::~DirectChannel() {
+    munmap(mBase, mSize);
+}
+
+void DirectChannel::write(const Event& event, int32_t reportToken) {
+    sensors_event_t record;
+    convertToSensorEvent(event, &record);
+    record.version = kRecordSize;
+    record.sensor = reportToken;
+
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    if (mWriteOffset + kRecordSize > mSize) {
+        mWriteOffset = 0;
+    }
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+    uint8_t* dst = mBase + mWriteOffset;
+    mWriteOffset += kRecordSize;
+
+    // Readers check the counter to tell whether a record is complete, so it is cleared while the
+    // record is written and only published, with release semantics, once the rest is in place
+    uint32_t* counter = reinterpret_cast<uint32_t*>(
+            dst + static_cast<size_t>(SensorsEventFormatOffset::ATOMIC_COUNTER));
+    __atomic_store_n(counter, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    record.reserved0 = 0;
+    memcpy(dst, &record, kRecordSize);
+    __atomic_store_n(counter, mCounter, __ATOMIC_RELEASE);
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_DIRECT_CHANNEL_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_DIRECT_CHANNEL_H
+
+#include <android/hardware/sensors/1.0/types.h>
+
+#include <memory>
+#include <mutex>
+
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::SharedMemInfo;
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * A direct report channel backed by an ashmem region. Events are written to it as an array of
+ * sensors_event_t records, see SensorsEventFormatOffset, without going through the Event FMQ.
+ */
+class DirectChannel {
+   public:
+    /**
+     * Maps the memory described by mem, returns nullptr if it is not supported or invalid
+     */
+    static std::unique_ptr<DirectChannel> create(const SharedMemInfo& mem);
+    ~DirectChannel();
+
+    /**
+     * Writes the event as the next record, on behalf of the report with the given token
+     */
+    void write(const Event& event, int32_t reportToken);
+
+   private:
+    DirectChannel(uint8_t* base, size_t size);
+
+    uint8_t* const mBase;
+    const size_t mSize;
+
+    // Guards the write position and the counter
+    std::mutex mWriteLock;
+    size_t mWriteOffset;
+
+    /**
+     * Incremented with every record written, readers use it to find the newest records. Zero is
+     * never written, since it marks a record that was never written.
+     */
+    uint32_t mCounter;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_DIRECT_CHANNEL_H
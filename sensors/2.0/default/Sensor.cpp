@@ -18,6 +18,7 @@
 
 #include <utils/SystemClock.h>
 
+#include <algorithm>
 #include <cmath>
 
 namespace android {
@@ -28,51 +29,51 @@ namespace implementation {
 
 using ::android::hardware::sensors::V1_0::MetaDataEventType;
 using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorFlagShift;
 using ::android::hardware::sensors::V1_0::SensorStatus;
 
 static constexpr float kDefaultMaxDelayUs = 10 * 1000 * 1000;
+// Size of the in-HAL FIFO of the continuous sensors
+static constexpr uint32_t kDefaultFifoEventCount = 300;
+// Flags of the sensors that can report to ashmem direct channels, at up to RateLevel::VERY_FAST
+static constexpr uint32_t kDirectReportFlags =
+        static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM) |
+        (static_cast<uint32_t>(RateLevel::VERY_FAST)
+         << static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT));
 
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
       mLastSampleTimeNs(0),
+      mMaxReportLatencyNs(0),
+      mFifoStartNs(0),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
-Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
-}
+Sensor::~Sensor() {}
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int32_t samplingPeriodNs) {
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelay * 1000) {
         samplingPeriodNs = mSensorInfo.minDelay * 1000;
     } else if (samplingPeriodNs > mSensorInfo.maxDelay * 1000) {
         samplingPeriodNs = mSensorInfo.maxDelay * 1000;
     }
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
-        mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
-    }
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mSamplingPeriodNs = samplingPeriodNs;
+    mMaxReportLatencyNs = maxReportLatencyNs > 0 ? maxReportLatencyNs : 0;
 }
 
 void Sensor::activate(bool enable) {
-    if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
-        mIsEnabled = enable;
-        mWaitCV.notify_all();
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mIsEnabled = enable;
+    if (!enable) {
+        // Batched events are not reported once the sensor is disabled
+        mFifo.clear();
     }
 }
 
@@ -85,52 +86,148 @@ Result Sensor::flush() {
 
     // Note: If a sensor supports batching, write all of the currently batched events for the sensor
     // to the Event FMQ prior to writing the flush complete event.
+    std::vector<Event> evs;
+    {
+        std::unique_lock<std::mutex> lock(mRunMutex);
+        drainFifoLocked(&evs);
+    }
+
     Event ev;
     ev.sensorHandle = mSensorInfo.sensorHandle;
     ev.sensorType = SensorType::META_DATA;
     ev.u.meta.what = MetaDataEventType::META_DATA_FLUSH_COMPLETE;
-    std::vector<Event> evs{ev};
+    evs.push_back(ev);
     mCallback->postEvents(evs, isWakeUpSensor());
 
     return Result::OK;
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
+int64_t Sensor::sample(int64_t nowNs, int64_t slackNs, std::vector<Event>* events) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    if (isSamplingLocked() && nowNs + slackNs >= mLastSampleTimeNs + mSamplingPeriodNs) {
+        mLastSampleTimeNs = nowNs;
+        sampleLocked(nowNs, slackNs, events);
+    }
+    sampleDirectReportsLocked(nowNs, slackNs);
+    return getNextSampleTimeNsLocked();
 }
 
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
-
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_REALTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
+void Sensor::sampleLocked(int64_t nowNs, int64_t slackNs, std::vector<Event>* events) {
+    if (!isBatchingLocked()) {
+        drainFifoLocked(events);
+        readEvents(events);
+        return;
+    }
+
+    mReadBuffer.clear();
+    readEvents(&mReadBuffer);
+    for (const Event& event : mReadBuffer) {
+        if (mFifo.size() >= mSensorInfo.fifoMaxEventCount) {
+            if (isWakeUpSensor()) {
+                drainFifoLocked(events);
+            } else {
+                mFifo.pop_front();
             }
+        }
+        if (mFifo.empty()) {
+            mFifoStartNs = nowNs;
+        }
+        mFifo.push_back(event);
+    }
+    if (!mFifo.empty() && nowNs + slackNs >= mFifoStartNs + mMaxReportLatencyNs) {
+        drainFifoLocked(events);
+    }
+}
 
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+void Sensor::sampleDirectReportsLocked(int64_t nowNs, int64_t slackNs) {
+    if (mMode != OperationMode::NORMAL) {
+        return;
+    }
+    for (DirectReport& report : mDirectReports) {
+        if (nowNs + slackNs >= report.lastSampleTimeNs + report.periodNs) {
+            report.lastSampleTimeNs = nowNs;
+            mReadBuffer.clear();
+            readEvents(&mReadBuffer);
+            for (const Event& event : mReadBuffer) {
+                report.channel->write(event, report.token);
+            }
         }
     }
 }
 
+int32_t Sensor::configDirectReport(const std::shared_ptr<DirectChannel>& channel, int64_t periodNs,
+                                   int32_t newToken) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    for (auto iter = mDirectReports.begin(); iter != mDirectReports.end(); ++iter) {
+        if (iter->channel == channel) {
+            int32_t token = iter->token;
+            if (periodNs > 0) {
+                iter->periodNs = periodNs;
+            } else {
+                mDirectReports.erase(iter);
+            }
+            return token;
+        }
+    }
+    if (periodNs > 0) {
+        mDirectReports.push_back({channel, newToken, periodNs, 0 /* lastSampleTimeNs */});
+    }
+    return newToken;
+}
+
+void Sensor::stopDirectReports(const DirectChannel* channel) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mDirectReports.erase(std::remove_if(mDirectReports.begin(), mDirectReports.end(),
+                                        [channel](const DirectReport& report) {
+                                            return report.channel.get() == channel;
+                                        }),
+                         mDirectReports.end());
+}
+
+bool Sensor::supportsDirectReport(RateLevel rate) const {
+    uint32_t maxRate =
+            (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::MASK_DIRECT_REPORT)) >>
+            static_cast<uint32_t>(SensorFlagShift::DIRECT_REPORT);
+    return (mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::DIRECT_CHANNEL_ASHMEM)) &&
+           static_cast<uint32_t>(rate) <= maxRate;
+}
+
+bool Sensor::isBatchingLocked() const {
+    return mMaxReportLatencyNs > 0 && mSensorInfo.fifoMaxEventCount > 0;
+}
+
+void Sensor::drainFifoLocked(std::vector<Event>* events) {
+    events->insert(events->end(), mFifo.begin(), mFifo.end());
+    mFifo.clear();
+}
+
+int64_t Sensor::getNextSampleTimeNs() {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    return getNextSampleTimeNsLocked();
+}
+
+bool Sensor::isSamplingLocked() const {
+    return mIsEnabled && mMode == OperationMode::NORMAL;
+}
+
+int64_t Sensor::getNextSampleTimeNsLocked() {
+    int64_t nextSampleTime = isSamplingLocked() ? mLastSampleTimeNs + mSamplingPeriodNs : -1;
+    if (mMode == OperationMode::NORMAL) {
+        for (const DirectReport& report : mDirectReports) {
+            int64_t reportTime = report.lastSampleTimeNs + report.periodNs;
+            if (nextSampleTime < 0 || reportTime < nextSampleTime) {
+                nextSampleTime = reportTime;
+            }
+        }
+    }
+    return nextSampleTime;
+}
+
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP);
 }
 
-std::vector<Event> Sensor::readEvents() {
-    std::vector<Event> events;
+void Sensor::readEvents(std::vector<Event>* events) {
     Event event;
     event.sensorHandle = mSensorInfo.sensorHandle;
     event.sensorType = mSensorInfo.type;
@@ -139,16 +236,12 @@ std::vector<Event> Sensor::readEvents() {
     event.u.vec3.y = 0;
     event.u.vec3.z = 0;
     event.u.vec3.status = SensorStatus::ACCURACY_HIGH;
-    events.push_back(event);
-    return events;
+    events->push_back(event);
 }
 
 void Sensor::setOperationMode(OperationMode mode) {
-    if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
-        mMode = mode;
-        mWaitCV.notify_all();
-    }
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mMode = mode;
 }
 
 bool Sensor::supportsDataInjection() const {
@@ -176,23 +269,26 @@ OnChangeSensor::OnChangeSensor(ISensorsEventCallback* callback)
 void OnChangeSensor::activate(bool enable) {
     Sensor::activate(enable);
     if (!enable) {
+        std::unique_lock<std::mutex> lock(mRunMutex);
         mPreviousEventSet = false;
     }
 }
 
-std::vector<Event> OnChangeSensor::readEvents() {
-    std::vector<Event> events = Sensor::readEvents();
-    std::vector<Event> outputEvents;
+void OnChangeSensor::readEvents(std::vector<Event>* events) {
+    // Only keep the new events that differ from the previous one, in place
+    size_t firstNewEvent = events->size();
+    Sensor::readEvents(events);
 
-    for (auto iter = events.begin(); iter != events.end(); ++iter) {
-        Event ev = *iter;
+    size_t outputEnd = firstNewEvent;
+    for (size_t i = firstNewEvent; i < events->size(); ++i) {
+        const Event& ev = (*events)[i];
         if (ev.u.vec3 != mPreviousEvent.u.vec3 || !mPreviousEventSet) {
-            outputEvents.push_back(ev);
             mPreviousEvent = ev;
             mPreviousEventSet = true;
+            (*events)[outputEnd++] = ev;
         }
     }
-    return outputEvents;
+    events->resize(outputEnd);
 }
 
 AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback) : Sensor(callback) {
@@ -207,10 +303,10 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.power = 0.001f;          // mA
     mSensorInfo.minDelay = 20 * 1000;    // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION);
+    mSensorInfo.flags = static_cast<uint32_t>(SensorFlagBits::DATA_INJECTION) | kDirectReportFlags;
 };
 
 PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
@@ -226,8 +322,8 @@ PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* call
     mSensorInfo.power = 0.001f;       // mA
     mSensorInfo.minDelay = 100 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -245,8 +341,8 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.power = 0.001f;       // mA
     mSensorInfo.minDelay = 20 * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -302,10 +398,10 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelay = 2.5f * 1000;  // microseconds
     mSensorInfo.maxDelay = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kDefaultFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kDefaultFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = 0;
+    mSensorInfo.flags = kDirectReportFlags;
 };
 
 AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
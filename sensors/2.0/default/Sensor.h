@@ -17,16 +17,18 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_H
 
+#include "DirectChannel.h"
+
 #include <android/hardware/sensors/1.0/types.h>
 
-#include <condition_variable>
+#include <deque>
 #include <memory>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 using ::android::hardware::sensors::V1_0::Event;
 using ::android::hardware::sensors::V1_0::OperationMode;
+using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
 using ::android::hardware::sensors::V1_0::SensorInfo;
 using ::android::hardware::sensors::V1_0::SensorType;
@@ -41,6 +43,8 @@ class ISensorsEventCallback {
    public:
     virtual ~ISensorsEventCallback(){};
     virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
+    // Writes all of the events at once, numWakeUpEvents of which come from WAKE_UP sensors
+    virtual void postEventBatch(const std::vector<Event>& events, size_t numWakeUpEvents) = 0;
 };
 
 class Sensor {
@@ -49,7 +53,7 @@ class Sensor {
     virtual ~Sensor();
 
     const SensorInfo& getSensorInfo() const;
-    void batch(int32_t samplingPeriodNs);
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
     virtual void activate(bool enable);
     Result flush();
 
@@ -57,22 +61,68 @@ class Sensor {
     bool supportsDataInjection() const;
     Result injectEvent(const Event& event);
 
-   protected:
-    void run();
-    virtual std::vector<Event> readEvents();
-    static void startThread(Sensor* sensor);
+    /**
+     * Appends the events of a sample to events if one is due within slackNs of nowNs. Returns the
+     * time at which the next sample is due, or -1 if the sensor is not sampling. Times are on the
+     * SensorScheduler clock.
+     */
+    int64_t sample(int64_t nowNs, int64_t slackNs, std::vector<Event>* events);
+    int64_t getNextSampleTimeNs();
+
+    /**
+     * Starts or updates the report of this sensor to the direct channel at the given period, or
+     * stops it if the period is 0. Returns the token of the report, newToken if it is a new one.
+     */
+    int32_t configDirectReport(const std::shared_ptr<DirectChannel>& channel, int64_t periodNs,
+                               int32_t newToken);
+    void stopDirectReports(const DirectChannel* channel);
+    bool supportsDirectReport(RateLevel rate) const;
 
     bool isWakeUpSensor();
 
+   protected:
+    virtual void readEvents(std::vector<Event>* events);
+    bool isSamplingLocked() const;
+    int64_t getNextSampleTimeNsLocked();
+    void sampleLocked(int64_t nowNs, int64_t slackNs, std::vector<Event>* events);
+    void sampleDirectReportsLocked(int64_t nowNs, int64_t slackNs);
+
+    /**
+     * Whether samples are held in the FIFO rather than reported right away
+     */
+    bool isBatchingLocked() const;
+    void drainFifoLocked(std::vector<Event>* events);
+
     bool mIsEnabled;
     int64_t mSamplingPeriodNs;
     int64_t mLastSampleTimeNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
+    /**
+     * In-HAL FIFO of batched events, holding up to mSensorInfo.fifoMaxEventCount events. It is
+     * drained once the oldest event has waited for mMaxReportLatencyNs, or on flush(). When it is
+     * full, a WAKE_UP sensor reports it right away while any other sensor drops its oldest event,
+     * so that non-wakeup data never wakes up the AP.
+     */
+    int64_t mMaxReportLatencyNs;
+    std::deque<Event> mFifo;
+    int64_t mFifoStartNs;
+    std::vector<Event> mReadBuffer;
+
+    /**
+     * Reports to direct channels, sampled on their own schedule whether the sensor is enabled or
+     * not. Their events never go to the FIFO or the Event FMQ.
+     */
+    struct DirectReport {
+        std::shared_ptr<DirectChannel> channel;
+        int32_t token;
+        int64_t periodNs;
+        int64_t lastSampleTimeNs;
+    };
+    std::vector<DirectReport> mDirectReports;
+
+    // Guards the sampling state, which is read by the SensorScheduler thread
     std::mutex mRunMutex;
-    std::thread mRunThread;
 
     ISensorsEventCallback* mCallback;
 
@@ -86,7 +136,7 @@ class OnChangeSensor : public Sensor {
     virtual void activate(bool enable) override;
 
    protected:
-    virtual std::vector<Event> readEvents() override;
+    virtual void readEvents(std::vector<Event>* events) override;
 
    protected:
     Event mPreviousEvent;
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SensorScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+SensorScheduler::SensorScheduler(ISensorsEventCallback* callback)
+    : mCallback(callback), mStopThread(false) {
+    mRunThread = std::thread(&SensorScheduler::run, this);
+}
+
+SensorScheduler::~SensorScheduler() {
+    stop();
+}
+
+void SensorScheduler::stop() {
+    {
+        std::unique_lock<std::mutex> lock(mLock);
+        mStopThread = true;
+        mWaitCV.notify_all();
+    }
+    if (mRunThread.joinable()) {
+        mRunThread.join();
+    }
+}
+
+int64_t SensorScheduler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+void SensorScheduler::reschedule(Sensor* sensor) {
+    int64_t nextSampleTime = sensor->getNextSampleTimeNs();
+
+    std::unique_lock<std::mutex> lock(mLock);
+    uint64_t generation = ++mGenerations[sensor];
+    if (nextSampleTime >= 0) {
+        pushDeadlineLocked(nextSampleTime, sensor, generation);
+    }
+    mWaitCV.notify_all();
+}
+
+void SensorScheduler::pushDeadlineLocked(int64_t timeNs, Sensor* sensor, uint64_t generation) {
+    mDeadlines.push_back({timeNs, sensor, generation});
+    std::push_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<Deadline>());
+}
+
+void SensorScheduler::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+
+    while (!mStopThread) {
+        if (mDeadlines.empty()) {
+            mWaitCV.wait(lock);
+            continue;
+        }
+
+        int64_t nowNs = now();
+        if (mDeadlines.front().timeNs > nowNs) {
+            mWaitCV.wait_for(lock, std::chrono::nanoseconds(mDeadlines.front().timeNs - nowNs));
+            continue;
+        }
+
+        // Collect every sensor that is due, dropping the deadlines superseded by a reschedule
+        mDueSensors.clear();
+        while (!mDeadlines.empty() && mDeadlines.front().timeNs <= nowNs + kAlignmentWindowNs) {
+            std::pop_heap(mDeadlines.begin(), mDeadlines.end(), std::greater<Deadline>());
+            const Deadline& deadline = mDeadlines.back();
+            if (mGenerations[deadline.sensor] == deadline.generation) {
+                mDueSensors.push_back(deadline);
+            }
+            mDeadlines.pop_back();
+        }
+        lock.unlock();
+
+        mEventBatch.clear();
+        size_t numWakeUpEvents = 0;
+        for (Deadline& due : mDueSensors) {
+            size_t numEvents = mEventBatch.size();
+            due.timeNs = due.sensor->sample(nowNs, kAlignmentWindowNs, &mEventBatch);
+            if (due.sensor->isWakeUpSensor()) {
+                numWakeUpEvents += mEventBatch.size() - numEvents;
+            }
+        }
+        if (!mEventBatch.empty()) {
+            mCallback->postEventBatch(mEventBatch, numWakeUpEvents);
+        }
+
+        lock.lock();
+        for (const Deadline& due : mDueSensors) {
+            // A reschedule while sampling already pushed the up to date deadline
+            if (due.timeNs >= 0 && mGenerations[due.sensor] == due.generation) {
+                pushDeadlineLocked(due.timeNs, due.sensor, due.generation);
+            }
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
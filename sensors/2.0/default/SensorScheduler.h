@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_SCHEDULER_H
+#define ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_SCHEDULER_H
+
+#include "Sensor.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * Samples all of the active sensors from a single thread. The sensors are kept in a heap ordered by
+ * the time of their next sample, so that every sensor that is due is sampled in the same wakeup and
+ * their events are posted as one batch.
+ */
+class SensorScheduler {
+   public:
+    SensorScheduler(ISensorsEventCallback* callback);
+    ~SensorScheduler();
+
+    /**
+     * Must be called whenever the sampling state of the sensor (enabled, sampling period or
+     * operation mode) changes
+     */
+    void reschedule(Sensor* sensor);
+
+    /**
+     * Stops the scheduler thread. No events are posted once this returns.
+     */
+    void stop();
+
+    /**
+     * The clock that the sample times are based on
+     */
+    static int64_t now();
+
+   private:
+    /**
+     * Sensors due within this window of each other are sampled in the same wakeup. Sampling them
+     * at the same time also aligns their following samples when they run at the same rate.
+     */
+    static constexpr int64_t kAlignmentWindowNs = 1000 * 1000;
+
+    struct Deadline {
+        int64_t timeNs;
+        Sensor* sensor;
+        uint64_t generation;
+
+        bool operator>(const Deadline& other) const { return timeNs > other.timeNs; }
+    };
+
+    void run();
+    void pushDeadlineLocked(int64_t timeNs, Sensor* sensor, uint64_t generation);
+
+    ISensorsEventCallback* mCallback;
+
+    std::mutex mLock;
+    std::condition_variable mWaitCV;
+    bool mStopThread;
+
+    /**
+     * Min-heap of the next sample time of the sensors
+     */
+    std::vector<Deadline> mDeadlines;
+
+    /**
+     * Bumped on every reschedule, so that deadlines pushed before it are ignored
+     */
+    std::map<Sensor*, uint64_t> mGenerations;
+
+    /**
+     * Only used by the scheduler thread, reused from one wakeup to the next
+     */
+    std::vector<Deadline> mDueSensors;
+    std::vector<Event> mEventBatch;
+
+    std::thread mRunThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_SENSORS_V2_0_SENSOR_SCHEDULER_H
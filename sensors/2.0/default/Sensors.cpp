@@ -19,6 +19,8 @@
 #include <android/hardware/sensors/2.0/types.h>
 #include <log/log.h>
 
+#include <algorithm>
+
 namespace android {
 namespace hardware {
 namespace sensors {
@@ -30,6 +32,7 @@ using ::android::hardware::sensors::V1_0::OperationMode;
 using ::android::hardware::sensors::V1_0::RateLevel;
 using ::android::hardware::sensors::V1_0::Result;
 using ::android::hardware::sensors::V1_0::SharedMemInfo;
+using ::android::hardware::sensors::V1_0::SharedMemType;
 using ::android::hardware::sensors::V2_0::SensorTimeout;
 using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
 
@@ -37,8 +40,12 @@ constexpr const char* kWakeLockName = "SensorsHAL_WAKEUP";
 
 Sensors::Sensors()
     : mEventQueueFlag(nullptr),
+      mScheduler(this /* callback */),
       mNextHandle(1),
-      mOutstandingWakeUpEvents(0),
+      mNextDirectChannelHandle(1),
+      mNextDirectReportToken(1),
+      mWakeUpEventsWritten(0),
+      mWakeUpEventsHandled(0),
       mReadWakeLockQueueRun(false),
       mAutoReleaseWakeLockTime(0),
       mHasWakeLock(false) {
@@ -54,9 +61,9 @@ Sensors::Sensors()
 }
 
 Sensors::~Sensors() {
+    mScheduler.stop();
+    stopReadWakeLockThread();
     deleteEventFlag();
-    mReadWakeLockQueueRun = false;
-    mWakeLockThread.join();
 }
 
 // Methods from ::android::hardware::sensors::V2_0::ISensors follow.
@@ -75,6 +82,7 @@ Return<void> Sensors::getSensorsList(getSensorsList_cb _hidl_cb) {
 Return<Result> Sensors::setOperationMode(OperationMode mode) {
     for (auto sensor : mSensors) {
         sensor.second->setOperationMode(mode);
+        mScheduler.reschedule(sensor.second.get());
     }
     return Result::OK;
 }
@@ -83,6 +91,7 @@ Return<Result> Sensors::activate(int32_t sensorHandle, bool enabled) {
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
         sensor->second->activate(enabled);
+        mScheduler.reschedule(sensor->second.get());
         return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -97,13 +106,11 @@ Return<Result> Sensors::initialize(
     // Ensure that all sensors are disabled
     for (auto sensor : mSensors) {
         sensor.second->activate(false /* enable */);
+        mScheduler.reschedule(sensor.second.get());
     }
 
     // Stop the Wake Lock thread if it is currently running
-    if (mReadWakeLockQueueRun.load()) {
-        mReadWakeLockQueueRun = false;
-        mWakeLockThread.join();
-    }
+    stopReadWakeLockThread();
 
     // Save a reference to the callback
     mCallback = sensorsCallback;
@@ -138,10 +145,11 @@ Return<Result> Sensors::initialize(
 }
 
 Return<Result> Sensors::batch(int32_t sensorHandle, int64_t samplingPeriodNs,
-                              int64_t /* maxReportLatencyNs */) {
+                              int64_t maxReportLatencyNs) {
     auto sensor = mSensors.find(sensorHandle);
     if (sensor != mSensors.end()) {
-        sensor->second->batch(samplingPeriodNs);
+        sensor->second->batch(samplingPeriodNs, maxReportLatencyNs);
+        mScheduler.reschedule(sensor->second.get());
         return Result::OK;
     }
     return Result::BAD_VALUE;
@@ -164,65 +172,164 @@ Return<Result> Sensors::injectSensorData(const Event& event) {
     return Result::BAD_VALUE;
 }
 
-Return<void> Sensors::registerDirectChannel(const SharedMemInfo& /* mem */,
+Return<void> Sensors::registerDirectChannel(const SharedMemInfo& mem,
                                             registerDirectChannel_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+    if (mem.type != SharedMemType::ASHMEM) {
+        // Mapping gralloc buffers would need the graphics mapper HAL
+        _hidl_cb(Result::INVALID_OPERATION, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    std::shared_ptr<DirectChannel> channel = DirectChannel::create(mem);
+    if (channel == nullptr) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* channelHandle */);
+        return Return<void>();
+    }
+
+    int32_t channelHandle;
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        channelHandle = mNextDirectChannelHandle++;
+        mDirectChannels[channelHandle] = channel;
+    }
+    _hidl_cb(Result::OK, channelHandle);
     return Return<void>();
 }
 
-Return<Result> Sensors::unregisterDirectChannel(int32_t /* channelHandle */) {
-    return Result::INVALID_OPERATION;
+Return<Result> Sensors::unregisterDirectChannel(int32_t channelHandle) {
+    std::shared_ptr<DirectChannel> channel;
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        auto iter = mDirectChannels.find(channelHandle);
+        if (iter == mDirectChannels.end()) {
+            return Result::BAD_VALUE;
+        }
+        channel = iter->second;
+        mDirectChannels.erase(iter);
+    }
+
+    // The region stays mapped until no sensor references the channel anymore
+    for (auto& sensor : mSensors) {
+        sensor.second->stopDirectReports(channel.get());
+        mScheduler.reschedule(sensor.second.get());
+    }
+    return Result::OK;
 }
 
-Return<void> Sensors::configDirectReport(int32_t /* sensorHandle */, int32_t /* channelHandle */,
-                                         RateLevel /* rate */, configDirectReport_cb _hidl_cb) {
-    _hidl_cb(Result::INVALID_OPERATION, 0 /* reportToken */);
+Return<void> Sensors::configDirectReport(int32_t sensorHandle, int32_t channelHandle,
+                                         RateLevel rate, configDirectReport_cb _hidl_cb) {
+    std::shared_ptr<DirectChannel> channel;
+    {
+        std::lock_guard<std::mutex> lock(mDirectChannelLock);
+        auto iter = mDirectChannels.find(channelHandle);
+        if (iter != mDirectChannels.end()) {
+            channel = iter->second;
+        }
+    }
+    if (channel == nullptr) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
+        return Return<void>();
+    }
+
+    if (sensorHandle == -1) {
+        // Only stopping all the reports on the channel is allowed without a sensor
+        if (rate != RateLevel::STOP) {
+            _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
+            return Return<void>();
+        }
+        for (auto& sensor : mSensors) {
+            sensor.second->stopDirectReports(channel.get());
+            mScheduler.reschedule(sensor.second.get());
+        }
+        _hidl_cb(Result::OK, -1 /* reportToken */);
+        return Return<void>();
+    }
+
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor == mSensors.end() || !sensor->second->supportsDirectReport(rate)) {
+        _hidl_cb(Result::BAD_VALUE, -1 /* reportToken */);
+        return Return<void>();
+    }
+
+    int64_t periodNs = 0;
+    switch (rate) {
+        case RateLevel::NORMAL:
+            periodNs = 20 * 1000 * 1000;  // 50Hz
+            break;
+        case RateLevel::FAST:
+            periodNs = 5 * 1000 * 1000;  // 200Hz
+            break;
+        case RateLevel::VERY_FAST:
+            periodNs = 1250 * 1000;  // 800Hz
+            break;
+        case RateLevel::STOP:
+            break;
+    }
+
+    int32_t reportToken = sensor->second->configDirectReport(channel, periodNs,
+                                                             mNextDirectReportToken++);
+    mScheduler.reschedule(sensor->second.get());
+    _hidl_cb(Result::OK, rate == RateLevel::STOP ? -1 : reportToken);
     return Return<void>();
 }
 
 void Sensors::postEvents(const std::vector<Event>& events, bool wakeup) {
+    postEventBatch(events, wakeup ? events.size() : 0);
+}
+
+void Sensors::postEventBatch(const std::vector<Event>& events, size_t numWakeUpEvents) {
     std::lock_guard<std::mutex> lock(mWriteLock);
+    if (numWakeUpEvents > 0) {
+        // Keep track of the number of outstanding WAKE_UP events in order to properly hold a wake
+        // lock until the framework has secured a wake lock. The events are counted before they
+        // are written, so that the Wake Lock thread does not release the wake lock meanwhile, and
+        // the wake lock is held before the framework can see them.
+        mAutoReleaseWakeLockTime = ::android::uptimeMillis() +
+                                   static_cast<uint32_t>(SensorTimeout::WAKE_LOCK_SECONDS) * 1000;
+        mWakeUpEventsWritten += numWakeUpEvents;
+        if (!mHasWakeLock) {
+            acquireWakeLock();
+        }
+    }
+
     if (mEventQueue->write(events.data(), events.size())) {
         mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
-
-        if (wakeup) {
-            // Keep track of the number of outstanding WAKE_UP events in order to properly hold
-            // a wake lock until the framework has secured a wake lock
-            updateWakeLock(events.size(), 0 /* eventsHandled */);
-        }
+    } else if (numWakeUpEvents > 0) {
+        // The Wake Lock thread releases the wake lock, if nothing else is outstanding
+        mWakeUpEventsWritten -= numWakeUpEvents;
     }
 }
 
-void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
+void Sensors::acquireWakeLock() {
     std::lock_guard<std::mutex> lock(mWakeLockLock);
-    int32_t newVal = mOutstandingWakeUpEvents + eventsWritten - eventsHandled;
-    if (newVal < 0) {
-        mOutstandingWakeUpEvents = 0;
-    } else {
-        mOutstandingWakeUpEvents = newVal;
+    if (!mHasWakeLock && acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakeLockName) == 0) {
+        mHasWakeLock = true;
     }
+}
 
-    if (eventsWritten > 0) {
-        // Update the time at which the last WAKE_UP event was sent
-        mAutoReleaseWakeLockTime = ::android::uptimeMillis() +
-                                   static_cast<uint32_t>(SensorTimeout::WAKE_LOCK_SECONDS) * 1000;
-    }
+void Sensors::updateWakeLock(uint32_t eventsHandled) {
+    std::lock_guard<std::mutex> lock(mWakeLockLock);
+    uint64_t eventsWritten = mWakeUpEventsWritten;
+    mWakeUpEventsHandled = std::min(mWakeUpEventsHandled + eventsHandled, eventsWritten);
 
-    if (!mHasWakeLock && mOutstandingWakeUpEvents > 0 &&
-        acquire_wake_lock(PARTIAL_WAKE_LOCK, kWakeLockName) == 0) {
-        mHasWakeLock = true;
-    } else if (mHasWakeLock) {
+    if (mHasWakeLock) {
         // Check if the wake lock should be released automatically if
         // SensorTimeout::WAKE_LOCK_SECONDS has elapsed since the last WAKE_UP event was written to
         // the Wake Lock FMQ.
         if (::android::uptimeMillis() > mAutoReleaseWakeLockTime) {
             ALOGD("No events read from wake lock FMQ for %d seconds, auto releasing wake lock",
                   SensorTimeout::WAKE_LOCK_SECONDS);
-            mOutstandingWakeUpEvents = 0;
+            mWakeUpEventsHandled = eventsWritten;
         }
 
-        if (mOutstandingWakeUpEvents == 0 && release_wake_lock(kWakeLockName) == 0) {
+        if (mWakeUpEventsHandled == eventsWritten) {
+            // A writer that still saw the wake lock as held counted its WAKE_UP events before
+            // this store, so it shows up in the check below and the wake lock is kept. One that
+            // sees it released waits for mWakeLockLock and acquires it again.
             mHasWakeLock = false;
+            if (mWakeUpEventsWritten != eventsWritten || release_wake_lock(kWakeLockName) != 0) {
+                mHasWakeLock = true;
+            }
         }
     }
 }
@@ -230,6 +337,7 @@ void Sensors::updateWakeLock(int32_t eventsWritten, int32_t eventsHandled) {
 void Sensors::readWakeLockFMQ() {
     while (mReadWakeLockQueueRun.load()) {
         constexpr int64_t kReadTimeoutNs = 500 * 1000 * 1000;  // 500 ms
+
         uint32_t eventsHandled = 0;
 
         // Read events from the Wake Lock FMQ. Timeout after a reasonable amount of time to ensure
@@ -237,7 +345,18 @@ void Sensors::readWakeLockFMQ() {
         mWakeLockQueue->readBlocking(&eventsHandled, 1 /* count */, 0 /* readNotification */,
                                      static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN),
                                      kReadTimeoutNs);
-        updateWakeLock(0 /* eventsWritten */, eventsHandled);
+        uint32_t count = 0;
+        while (mWakeLockQueue->read(&count)) {
+            eventsHandled += count;
+        }
+        updateWakeLock(eventsHandled);
+    }
+}
+
+void Sensors::stopReadWakeLockThread() {
+    if (mReadWakeLockQueueRun.load()) {
+        mReadWakeLockQueueRun = false;
+        mWakeLockThread.join();
     }
 }
 
@@ -17,7 +17,9 @@
 #ifndef ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 #define ANDROID_HARDWARE_SENSORS_V2_0_SENSORS_H
 
+#include "DirectChannel.h"
 #include "Sensor.h"
+#include "SensorScheduler.h"
 
 #include <android/hardware/sensors/2.0/ISensors.h>
 #include <fmq/MessageQueue.h>
@@ -26,6 +28,7 @@
 #include <hidl/Status.h>
 
 #include <atomic>
+#include <map>
 #include <memory>
 #include <thread>
 
@@ -85,6 +88,8 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
 
     void postEvents(const std::vector<Event>& events, bool wakeup) override;
 
+    void postEventBatch(const std::vector<Event>& events, size_t numWakeUpEvents) override;
+
    private:
     /**
      * Add a new sensor
@@ -109,9 +114,22 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     static void startReadWakeLockThread(Sensors* sensors);
 
     /**
-     * Responsible for acquiring and releasing a wake lock when there are unhandled WAKE_UP events
+     * Acquires the wake lock on the write path, when WAKE_UP events are written while it is not
+     * held
+     */
+    void acquireWakeLock();
+
+    /**
+     * Responsible for releasing the wake lock once the framework has handled every WAKE_UP event.
+     * Only called from the Wake Lock thread, the write path only updates the atomic counters while
+     * the wake lock is held.
      */
-    void updateWakeLock(int32_t eventsWritten, int32_t eventsHandled);
+    void updateWakeLock(uint32_t eventsHandled);
+
+    /**
+     * Stop and join the Wake Lock thread if it is running, which takes up to one read timeout
+     */
+    void stopReadWakeLockThread();
 
     using EventMessageQueue = MessageQueue<Event, kSynchronizedReadWrite>;
     using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
@@ -141,25 +159,46 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
      */
     std::map<int32_t, std::shared_ptr<Sensor>> mSensors;
 
+    /**
+     * Samples the sensors in the map above. Stopped before the sensors are destroyed.
+     */
+    SensorScheduler mScheduler;
+
     /**
      * The next available sensor handle
      */
     int32_t mNextHandle;
 
+    /**
+     * The registered direct channels, by channel handle
+     */
+    std::map<int32_t, std::shared_ptr<DirectChannel>> mDirectChannels;
+    std::mutex mDirectChannelLock;
+    int32_t mNextDirectChannelHandle;
+
+    /**
+     * The next available direct report token, tokens are unique across sensors and channels
+     */
+    int32_t mNextDirectReportToken;
+
     /**
      * Lock to protect writes to the FMQs
      */
     std::mutex mWriteLock;
 
     /**
-     * Lock to protect acquiring and releasing the wake lock
+     * Lock to serialize acquiring and releasing the wake lock, only taken on the write path when
+     * the wake lock is not held
      */
     std::mutex mWakeLockLock;
 
     /**
-     * Track the number of WAKE_UP events that have not been handled by the framework
+     * Total number of WAKE_UP events written to the Event FMQ, and handled by the framework. The
+     * difference is the number of outstanding WAKE_UP events. mWakeUpEventsHandled is only
+     * accessed by the Wake Lock thread.
      */
-    uint32_t mOutstandingWakeUpEvents;
+    std::atomic<uint64_t> mWakeUpEventsWritten;
+    uint64_t mWakeUpEventsHandled;
 
     /**
      * A thread to read the Wake Lock FMQ
@@ -174,12 +213,12 @@ struct Sensors : public ISensors, public ISensorsEventCallback {
     /**
      * Track the time when the wake lock should automatically be released
      */
-    int64_t mAutoReleaseWakeLockTime;
+    std::atomic<int64_t> mAutoReleaseWakeLockTime;
 
     /**
-     * Flag to indicate if a wake lock has been acquired
+     * Flag to indicate if a wake lock has been acquired, only written under mWakeLockLock
      */
-    bool mHasWakeLock;
+    std::atomic_bool mHasWakeLock;
 };
 
 }  // namespace implementation
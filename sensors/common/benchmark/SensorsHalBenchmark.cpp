@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorsHalBenchmark"
+
+// Measures the event path of the sensors HAL, from the sensor timestamp to this process:
+// ISensors::poll() for 1.0, and the Event FMQ for 2.0. Run it against the 2.0 mock service
+// (android.hardware.sensors@2.0-service.mock) to benchmark the HAL with synthetic sensors.
+//
+// Both HAL versions support a single client, so the framework has to be stopped ("adb shell stop")
+// while this runs, as for the VTS tests.
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <android/hardware/sensors/1.0/ISensors.h>
+#include <android/hardware/sensors/2.0/ISensors.h>
+#include <android/hardware/sensors/2.0/types.h>
+#include <benchmark/benchmark.h>
+#include <fmq/EventFlag.h>
+#include <fmq/MessageQueue.h>
+#include <hal-metrics/Metrics.h>
+#include <utils/SystemClock.h>
+
+namespace android {
+namespace hardware {
+namespace sensors {
+
+namespace {
+
+using ::android::hardware::EventFlag;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::kSynchronizedReadWrite;
+using ::android::hardware::MessageQueue;
+using ::android::hardware::Return;
+using ::android::hardware::sensors::V1_0::Event;
+using ::android::hardware::sensors::V1_0::Result;
+using ::android::hardware::sensors::V1_0::SensorFlagBits;
+using ::android::hardware::sensors::V1_0::SensorInfo;
+using ::android::hardware::sensors::V2_0::EventQueueFlagBits;
+using ::android::hardware::sensors::V2_0::ISensorsCallback;
+using ::android::hardware::sensors::V2_0::WakeLockQueueFlagBits;
+
+using EventMessageQueue = MessageQueue<Event, kSynchronizedReadWrite>;
+using WakeLockMessageQueue = MessageQueue<uint32_t, kSynchronizedReadWrite>;
+
+constexpr size_t kMaxEventCount = 256;
+constexpr int64_t kWaitTimeoutNs = 1000 * 1000 * 1000;  // 1 s
+
+// Wake lock of the 2.0 default HAL, counted in the kernel wakeup sources
+constexpr char kWakeLockName[] = "SensorsHAL_WAKEUP";
+constexpr char kWakeupSourcesPath[] = "/sys/kernel/debug/wakeup_sources";
+
+// Returns the number of times the HAL wake lock was acquired, or -1 if it cannot be read
+int64_t readWakeLockActiveCount() {
+    std::string content;
+    if (!base::ReadFileToString(kWakeupSourcesPath, &content)) {
+        return -1;
+    }
+    for (const std::string& line : base::Split(content, "\n")) {
+        std::vector<std::string> fields = base::Tokenize(line, " \t");
+        // Columns are: name active_count event_count ...
+        if (fields.size() > 1 && fields[0] == kWakeLockName) {
+            return std::stoll(fields[1]);
+        }
+    }
+    return -1;
+}
+
+// Returns the user and system CPU time of the process, or -1 if it cannot be read
+int64_t readProcessCpuTimeNs(pid_t pid) {
+    std::string stat;
+    if (!base::ReadFileToString("/proc/" + std::to_string(pid) + "/stat", &stat)) {
+        return -1;
+    }
+    // The command name may contain spaces, the fields that follow start with field 3 (state)
+    size_t commEnd = stat.rfind(')');
+    if (commEnd == std::string::npos) {
+        return -1;
+    }
+    std::vector<std::string> fields = base::Split(stat.substr(commEnd + 2), " ");
+    if (fields.size() < 13) {
+        return -1;
+    }
+    // utime and stime are fields 14 and 15, in clock ticks
+    int64_t ticks = std::stoll(fields[11]) + std::stoll(fields[12]);
+    return ticks * 1000000000LL / sysconf(_SC_CLK_TCK);
+}
+
+int64_t selfCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Collects the timestamp to reader latency of the events of the benchmarked sensors, and the CPU
+// time and wake lock acquisitions over the run
+class EventStats {
+   public:
+    EventStats(pid_t halPid, const std::vector<SensorInfo>& sensors)
+        : mHalPid(halPid),
+          mHalStartNs(readProcessCpuTimeNs(halPid)),
+          mSelfStartNs(selfCpuTimeNs()),
+          mWakeLockStartCount(readWakeLockActiveCount()) {
+        for (const SensorInfo& sensor : sensors) {
+            mHandles.insert(sensor.sensorHandle);
+        }
+        mLatencies.reserve(1 << 16);
+    }
+
+    void add(const Event& event, int64_t nowNs) {
+        if (mHandles.count(event.sensorHandle) != 0) {
+            mLatencies.push_back(nowNs - event.timestamp);
+        }
+    }
+
+    void report(benchmark::State& state) {
+        int64_t events = mLatencies.size();
+        state.SetItemsProcessed(events);
+        if (events == 0) {
+            return;
+        }
+
+        std::sort(mLatencies.begin(), mLatencies.end());
+        state.counters["p50_ns"] = metrics::percentile(mLatencies, 50);
+        state.counters["p99_ns"] = metrics::percentile(mLatencies, 99);
+
+        // CPU time per 1000 events in microseconds, which is the CPU time per event in nanoseconds
+        int64_t halEndNs = readProcessCpuTimeNs(mHalPid);
+        if (mHalStartNs >= 0 && halEndNs >= 0) {
+            state.counters["hal_cpu_us_per_1k"] =
+                    static_cast<double>(halEndNs - mHalStartNs) / events;
+        }
+        state.counters["client_cpu_us_per_1k"] =
+                static_cast<double>(selfCpuTimeNs() - mSelfStartNs) / events;
+
+        int64_t wakeLockEndCount = readWakeLockActiveCount();
+        if (mWakeLockStartCount >= 0 && wakeLockEndCount >= 0) {
+            state.counters["wake_lock_acquisitions"] = wakeLockEndCount - mWakeLockStartCount;
+        }
+    }
+
+   private:
+    const pid_t mHalPid;
+    const int64_t mHalStartNs;
+    const int64_t mSelfStartNs;
+    const int64_t mWakeLockStartCount;
+    std::set<int32_t> mHandles;
+    std::vector<int64_t> mLatencies;
+};
+
+bool isWakeUpSensor(const SensorInfo& sensor) {
+    return (sensor.flags & static_cast<uint32_t>(SensorFlagBits::WAKE_UP)) != 0;
+}
+
+// Both ISensors versions share the methods used below, but not a base interface
+template <typename ISensorsType>
+pid_t getHalPid(const sp<ISensorsType>& sensors) {
+    pid_t pid = -1;
+    sensors->getDebugInfo([&](const auto& info) { pid = info.pid; });
+    return pid;
+}
+
+template <typename ISensorsType>
+std::vector<SensorInfo> getSensorsList(const sp<ISensorsType>& sensors) {
+    std::vector<SensorInfo> list;
+    sensors->getSensorsList([&](const hidl_vec<SensorInfo>& sensorList) { list = sensorList; });
+    return list;
+}
+
+// Activates up to the requested number of continuous sensors at the requested rate, without
+// batching. The benchmark arguments are: sampling period (us), sensor count, wake up sensors.
+template <typename ISensorsType>
+std::vector<SensorInfo> activateSensors(const sp<ISensorsType>& sensors,
+                                        const std::vector<SensorInfo>& list,
+                                        benchmark::State& state) {
+    const int64_t samplingPeriodNs = state.range(0) * 1000;
+    const size_t count = state.range(1);
+    const bool wakeUp = state.range(2) != 0;
+
+    std::vector<SensorInfo> activated;
+    for (const SensorInfo& sensor : list) {
+        if (activated.size() == count) {
+            break;
+        }
+        uint32_t reportingMode =
+                sensor.flags & static_cast<uint32_t>(SensorFlagBits::MASK_REPORTING_MODE);
+        if (sensor.minDelay <= 0 || reportingMode != 0 /* CONTINUOUS_MODE */ ||
+            isWakeUpSensor(sensor) != wakeUp) {
+            continue;
+        }
+
+        int64_t periodNs = std::max(samplingPeriodNs, sensor.minDelay * 1000LL);
+        if (sensors->batch(sensor.sensorHandle, periodNs, 0 /* maxReportLatencyNs */) ==
+                    Result::OK &&
+            sensors->activate(sensor.sensorHandle, true /* enabled */) == Result::OK) {
+            activated.push_back(sensor);
+        }
+    }
+
+    if (activated.empty()) {
+        state.SkipWithError("No matching continuous sensor");
+    }
+    return activated;
+}
+
+template <typename ISensorsType>
+void deactivateSensors(const sp<ISensorsType>& sensors, const std::vector<SensorInfo>& activated) {
+    for (const SensorInfo& sensor : activated) {
+        sensors->activate(sensor.sensorHandle, false /* enabled */);
+    }
+}
+
+struct SensorsCallback : ISensorsCallback {
+    Return<void> onDynamicSensorsConnected(const hidl_vec<SensorInfo>& /* sensorInfos */) {
+        return Return<void>();
+    }
+
+    Return<void> onDynamicSensorsDisconnected(const hidl_vec<int32_t>& /* sensorHandles */) {
+        return Return<void>();
+    }
+};
+
+void BM_Poll_1_0(benchmark::State& state) {
+    sp<V1_0::ISensors> sensors = V1_0::ISensors::getService();
+    if (sensors == nullptr) {
+        state.SkipWithError("No sensors 1.0 service");
+        return;
+    }
+
+    std::vector<SensorInfo> activated = activateSensors(sensors, getSensorsList(sensors), state);
+    if (activated.empty()) {
+        return;
+    }
+
+    EventStats stats(getHalPid(sensors), activated);
+    for (auto _ : state) {
+        sensors->poll(kMaxEventCount, [&](Result result, const hidl_vec<Event>& events,
+                                          const hidl_vec<SensorInfo>& /* dynamicSensorsAdded */) {
+            int64_t nowNs = elapsedRealtimeNano();
+            if (result == Result::OK) {
+                for (const Event& event : events) {
+                    stats.add(event, nowNs);
+                }
+            }
+        });
+    }
+
+    deactivateSensors(sensors, activated);
+    stats.report(state);
+}
+
+void BM_Fmq_2_0(benchmark::State& state) {
+    sp<V2_0::ISensors> sensors = V2_0::ISensors::getService();
+    if (sensors == nullptr) {
+        state.SkipWithError("No sensors 2.0 service");
+        return;
+    }
+
+    auto eventQueue =
+            std::make_unique<EventMessageQueue>(kMaxEventCount, true /* configureEventFlagWord */);
+    auto wakeLockQueue = std::make_unique<WakeLockMessageQueue>(kMaxEventCount,
+                                                                true /* configureEventFlagWord */);
+    EventFlag* eventQueueFlag = nullptr;
+    EventFlag* wakeLockQueueFlag = nullptr;
+    EventFlag::createEventFlag(eventQueue->getEventFlagWord(), &eventQueueFlag);
+    EventFlag::createEventFlag(wakeLockQueue->getEventFlagWord(), &wakeLockQueueFlag);
+    if (eventQueueFlag == nullptr || wakeLockQueueFlag == nullptr ||
+        sensors->initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(),
+                            new SensorsCallback()) != Result::OK) {
+        state.SkipWithError("Failed to initialize the sensors 2.0 service");
+        EventFlag::deleteEventFlag(&eventQueueFlag);
+        EventFlag::deleteEventFlag(&wakeLockQueueFlag);
+        return;
+    }
+
+    std::vector<SensorInfo> list = getSensorsList(sensors);
+    std::set<int32_t> wakeUpHandles;
+    for (const SensorInfo& sensor : list) {
+        if (isWakeUpSensor(sensor)) {
+            wakeUpHandles.insert(sensor.sensorHandle);
+        }
+    }
+
+    std::vector<SensorInfo> activated = activateSensors(sensors, list, state);
+    std::vector<Event> events(kMaxEventCount);
+    EventStats stats(getHalPid(sensors), activated);
+    if (!activated.empty()) {
+        for (auto _ : state) {
+            size_t availableEvents = eventQueue->availableToRead();
+            if (availableEvents == 0) {
+                uint32_t eventFlagState = 0;
+                eventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
+                                     &eventFlagState, kWaitTimeoutNs);
+                availableEvents = eventQueue->availableToRead();
+            }
+
+            size_t eventsToRead = std::min(availableEvents, events.size());
+            if (eventsToRead == 0 || !eventQueue->read(events.data(), eventsToRead)) {
+                continue;
+            }
+            eventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ));
+
+            int64_t nowNs = elapsedRealtimeNano();
+            uint32_t wakeUpEvents = 0;
+            for (size_t i = 0; i < eventsToRead; i++) {
+                stats.add(events[i], nowNs);
+                if (wakeUpHandles.count(events[i].sensorHandle) != 0) {
+                    wakeUpEvents++;
+                }
+            }
+
+            // Acknowledge the WAKE_UP events as the framework does, so that the HAL can release
+            // its wake lock
+            if (wakeUpEvents > 0 && wakeLockQueue->write(&wakeUpEvents)) {
+                wakeLockQueueFlag->wake(static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
+            }
+        }
+        deactivateSensors(sensors, activated);
+    }
+
+    stats.report(state);
+    EventFlag::deleteEventFlag(&eventQueueFlag);
+    EventFlag::deleteEventFlag(&wakeLockQueueFlag);
+}
+
+void SensorArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"period_us", "sensors", "wake_up"});
+    for (int64_t periodUs : {20000, 5000, 1250}) {
+        for (int64_t count : {1, 4}) {
+            for (int64_t wakeUp : {0, 1}) {
+                b->Args({periodUs, count, wakeUp});
+            }
+        }
+    }
+}
+
+BENCHMARK(BM_Poll_1_0)->Apply(SensorArgs)->UseRealTime()->MinTime(2.0);
+BENCHMARK(BM_Fmq_2_0)->Apply(SensorArgs)->UseRealTime()->MinTime(2.0);
+
+}  // namespace
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
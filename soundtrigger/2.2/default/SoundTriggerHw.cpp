@@ -21,6 +21,8 @@
 #include <android/hidl/allocator/1.0/IAllocator.h>
 #include <android/log.h>
 #include <hidlmemory/mapping.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <utility>
 
 using android::hardware::hidl_memory;
@@ -467,7 +469,10 @@ void SoundTriggerHw::convertSoundModelEventFromHal(
 void SoundTriggerHw::convertPhaseRecognitionEventFromHal(
     V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent* event,
     const struct sound_trigger_phrase_recognition_event* halEvent) {
-    event->phraseExtras.resize(halEvent->num_phrases);
+    // resize() reallocates even to the same size
+    if (event->phraseExtras.size() != halEvent->num_phrases) {
+        event->phraseExtras.resize(halEvent->num_phrases);
+    }
     for (unsigned int i = 0; i < halEvent->num_phrases; i++) {
         convertPhraseRecognitionExtraFromHal(&event->phraseExtras[i], &halEvent->phrase_extras[i]);
     }
@@ -503,7 +508,9 @@ void SoundTriggerHw::convertPhraseRecognitionExtraFromHal(
     extra->recognitionModes = halExtra->recognition_modes;
     extra->confidenceLevel = halExtra->confidence_level;
 
-    extra->levels.resize(halExtra->num_levels);
+    if (extra->levels.size() != halExtra->num_levels) {
+        extra->levels.resize(halExtra->num_levels);
+    }
     for (unsigned int i = 0; i < halExtra->num_levels; i++) {
         extra->levels[i].userId = halExtra->levels[i].user_id;
         extra->levels[i].levelPercent = halExtra->levels[i].level;
@@ -512,18 +519,21 @@ void SoundTriggerHw::convertPhraseRecognitionExtraFromHal(
 
 void SoundTriggerHw::SoundModelClient_2_0::recognitionCallback(
     struct sound_trigger_recognition_event* halEvent) {
+    nsecs_t halCallbackTime = systemTime();
+    AutoMutex lock(mEventLock);
     if (halEvent->type == SOUND_MODEL_TYPE_KEYPHRASE) {
-        V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent event;
+        V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent& event = mPhraseEvent;
         convertPhaseRecognitionEventFromHal(
             &event, reinterpret_cast<sound_trigger_phrase_recognition_event*>(halEvent));
         event.common.model = mId;
         mCallback->phraseRecognitionCallback(event, mCookie);
     } else {
-        V2_0::ISoundTriggerHwCallback::RecognitionEvent event;
+        V2_0::ISoundTriggerHwCallback::RecognitionEvent& event = mEvent;
         convertRecognitionEventFromHal(&event, halEvent);
         event.model = mId;
         mCallback->recognitionCallback(event, mCookie);
     }
+    recordDelivery(halCallbackTime);
 }
 
 void SoundTriggerHw::SoundModelClient_2_0::soundModelCallback(
@@ -560,18 +570,32 @@ std::pair<bool, sp<IMemory>> memoryAsVector(const hidl_memory& m, hidl_vec<uint8
     return std::make_pair(false, memory);
 }
 
+// Returns the ashmem allocator, looked up once rather than for every event, and again
+// after a transport error in case it died.
+sp<IAllocator> getAshmemAllocator(bool lookUpAgain = false) {
+    static Mutex lock;
+    static sp<IAllocator> allocator;
+    AutoMutex l(lock);
+    if (allocator == 0 || lookUpAgain) {
+        allocator = IAllocator::getService("ashmem");
+    }
+    return allocator;
+}
+
 // Moves the data from the vector into allocated shared memory,
 // emptying the vector.
 // It is assumed that the passed hidl_memory is a null object, so it's
 // not reset if the vector is empty.
 // The caller needs to keep the returned sp<IMemory> as long as
 // the data is needed.
+// Every event gets a region of its own: the client keeps its fd, and may
+// still read it, after the callback returns.
 std::pair<bool, sp<IMemory>> moveVectorToMemory(hidl_vec<uint8_t>* v, hidl_memory* mem) {
     sp<IMemory> memory;
     if (v->size() == 0) {
         return std::make_pair(true, memory);
     }
-    sp<IAllocator> ashmem = IAllocator::getService("ashmem");
+    sp<IAllocator> ashmem = getAshmemAllocator();
     if (ashmem == 0) {
         ALOGE("Failed to retrieve ashmem allocator service");
         return std::make_pair(false, memory);
@@ -581,13 +605,17 @@ std::pair<bool, sp<IMemory>> moveVectorToMemory(hidl_vec<uint8_t>* v, hidl_memor
         success = s;
         if (success) *mem = m;
     });
+    if (!r.isOk()) {
+        getAshmemAllocator(true /* lookUpAgain */);
+    }
     if (r.isOk() && success) {
         memory = hardware::mapMemory(*mem);
         if (memory != 0) {
             memory->update();
             memcpy(memory->getPointer(), v->data(), v->size());
             memory->commit();
-            v->resize(0);
+            // Unlike resize(0), does not allocate an empty buffer
+            v->setToExternal(nullptr, 0);
             return std::make_pair(true, memory);
         } else {
             ALOGE("Failed to map allocated ashmem");
@@ -652,8 +680,10 @@ Return<int32_t> SoundTriggerHw::startRecognition_2_1(
 
 void SoundTriggerHw::SoundModelClient_2_1::recognitionCallback(
     struct sound_trigger_recognition_event* halEvent) {
+    nsecs_t halCallbackTime = systemTime();
+    AutoMutex lock(mEventLock);
     if (halEvent->type == SOUND_MODEL_TYPE_KEYPHRASE) {
-        V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent event_2_0;
+        V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent& event_2_0 = mPhraseEvent;
         convertPhaseRecognitionEventFromHal(
             &event_2_0, reinterpret_cast<sound_trigger_phrase_recognition_event*>(halEvent));
         event_2_0.common.model = mId;
@@ -675,6 +705,7 @@ void SoundTriggerHw::SoundModelClient_2_1::recognitionCallback(
             mCallback->recognitionCallback_2_1(event, mCookie);
         }
     }
+    recordDelivery(halCallbackTime);
 }
 
 void SoundTriggerHw::SoundModelClient_2_1::soundModelCallback(
@@ -719,6 +750,24 @@ Return<int32_t> SoundTriggerHw::getModelState(int32_t modelHandle) {
 
 // Methods from ::android::hidl::base::V1_0::IBase follow.
 
+Return<void> SoundTriggerHw::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* args */) {
+    if (fd == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    int out = fd->data[0];
+
+    AutoMutex lock(mLock);
+    dprintf(out, "Recognition event delivery, by model:\n");
+    for (size_t i = 0; i < mClients.size(); i++) {
+        SoundModelClient::DeliveryStats stats = mClients.valueAt(i)->getDeliveryStats();
+        dprintf(out, "  model %d: %" PRIu64 " events, avg %" PRId64 " us, max %" PRId64 " us\n",
+                mClients.keyAt(i), stats.numEvents,
+                stats.numEvents ? stats.totalLatencyNs / 1000 / (int64_t)stats.numEvents : 0,
+                stats.maxLatencyNs / 1000);
+    }
+    return Void();
+}
+
 ISoundTriggerHw* HIDL_FETCH_ISoundTriggerHw(const char* /* name */) {
     return new SoundTriggerHw();
 }
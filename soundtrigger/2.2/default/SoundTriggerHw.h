@@ -17,6 +17,7 @@
 #ifndef ANDROID_HARDWARE_SOUNDTRIGGER_V2_2_SOUNDTRIGGERHW_H
 #define ANDROID_HARDWARE_SOUNDTRIGGER_V2_2_SOUNDTRIGGERHW_H
 
+#include <algorithm>
 #include <android/hardware/soundtrigger/2.0/ISoundTriggerHw.h>
 #include <android/hardware/soundtrigger/2.0/ISoundTriggerHwCallback.h>
 #include <android/hardware/soundtrigger/2.2/ISoundTriggerHw.h>
@@ -26,6 +27,7 @@
 #include <stdatomic.h>
 #include <system/sound_trigger.h>
 #include <utils/KeyedVector.h>
+#include <utils/Timers.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -84,6 +86,9 @@ struct SoundTriggerHw : public ISoundTriggerHw {
     // Methods from V2_2::ISoundTriggerHw follow.
     Return<int32_t> getModelState(int32_t modelHandle) override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& args) override;
+
     SoundTriggerHw();
 
     // Copied from hardware/interfaces/soundtrigger/2.0/default/SoundTriggerHalImpl.h
@@ -100,10 +105,40 @@ struct SoundTriggerHw : public ISoundTriggerHw {
         virtual void recognitionCallback(struct sound_trigger_recognition_event* halEvent) = 0;
         virtual void soundModelCallback(struct sound_trigger_model_event* halEvent) = 0;
 
+        // Time taken to deliver the recognition events, from the HAL callback until the
+        // client callback returns
+        struct DeliveryStats {
+            uint64_t numEvents = 0;
+            nsecs_t totalLatencyNs = 0;
+            nsecs_t maxLatencyNs = 0;
+        };
+        DeliveryStats getDeliveryStats() {
+            AutoMutex lock(mStatsLock);
+            return mDeliveryStats;
+        }
+
        protected:
+        void recordDelivery(nsecs_t halCallbackTime) {
+            nsecs_t latency = systemTime() - halCallbackTime;
+            AutoMutex lock(mStatsLock);
+            mDeliveryStats.numEvents++;
+            mDeliveryStats.totalLatencyNs += latency;
+            mDeliveryStats.maxLatencyNs = std::max(mDeliveryStats.maxLatencyNs, latency);
+        }
+
         const uint32_t mId;
         sound_model_handle_t mHalHandle;
         V2_0::ISoundTriggerHwCallback::CallbackCookie mCookie;
+
+        // The recognition events are converted into these rather than into new ones, so
+        // that their phrase extras are only allocated when their count changes.
+        Mutex mEventLock;
+        V2_0::ISoundTriggerHwCallback::RecognitionEvent mEvent;
+        V2_0::ISoundTriggerHwCallback::PhraseRecognitionEvent mPhraseEvent;
+
+       private:
+        Mutex mStatsLock;
+        DeliveryStats mDeliveryStats;
     };
 
    protected:
@@ -2,6 +2,10 @@
 
 #include "Benchmark.h"
 
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <hidlmemory/mapping.h>
+#include <unistd.h>
+
 namespace android {
 namespace hardware {
 namespace tests {
@@ -16,6 +20,39 @@ Return<void> Benchmark::sendVec(
     return Void();
 }
 
+Return<uint64_t> Benchmark::receiveVec(const hidl_vec<uint8_t>& data) {
+    return data.size();
+}
+
+Return<uint64_t> Benchmark::sendMemory(const hidl_memory& mem, bool map) {
+    if (map) {
+        sp<::android::hidl::memory::V1_0::IMemory> memory = mapMemory(mem);
+        if (memory == nullptr) {
+            return 0;
+        }
+        volatile uint8_t* data = static_cast<uint8_t*>(static_cast<void*>(memory->getPointer()));
+        size_t pageSize = static_cast<size_t>(getpagesize());
+        for (size_t offset = 0; offset < mem.size(); offset += pageSize) {
+            (void)data[offset];
+        }
+    }
+    return mem.size();
+}
+
+Return<uint32_t> Benchmark::sendHandle(const hidl_handle& h) {
+    const native_handle_t* handle = h.getNativeHandle();
+    return handle != nullptr ? static_cast<uint32_t>(handle->numFds) : 0;
+}
+
+Return<void> Benchmark::sendOneway(const hidl_vec<uint8_t>& /* data */) {
+    mOnewayCount++;
+    return Void();
+}
+
+Return<uint64_t> Benchmark::takeOnewayCount() {
+    return mOnewayCount.exchange(0);
+}
+
 IBenchmark* HIDL_FETCH_IBenchmark(const char* /* name */) {
     return new Benchmark();
 }
@@ -4,6 +4,8 @@
 #include <android/hardware/tests/libhwbinder/1.0/IBenchmark.h>
 #include <hidl/Status.h>
 
+#include <atomic>
+
 namespace android {
 namespace hardware {
 namespace tests {
@@ -13,10 +15,20 @@ namespace implementation {
 
 using ::android::hardware::tests::libhwbinder::V1_0::IBenchmark;
 using ::android::hardware::Return;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
 using ::android::hardware::hidl_vec;
 
 struct Benchmark : public IBenchmark {
   virtual Return<void> sendVec(const hidl_vec<uint8_t>& data, sendVec_cb _hidl_cb)  override;
+  virtual Return<uint64_t> receiveVec(const hidl_vec<uint8_t>& data) override;
+  virtual Return<uint64_t> sendMemory(const hidl_memory& mem, bool map) override;
+  virtual Return<uint32_t> sendHandle(const hidl_handle& h) override;
+  virtual Return<void> sendOneway(const hidl_vec<uint8_t>& data) override;
+  virtual Return<uint64_t> takeOnewayCount() override;
+
+ private:
+  std::atomic<uint64_t> mOnewayCount{0};
 };
 
 extern "C" IBenchmark* HIDL_FETCH_IBenchmark(const char* name);
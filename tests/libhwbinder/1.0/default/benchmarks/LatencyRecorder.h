@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <hal-metrics/Metrics.h>
+
+// Times each iteration of a benchmark, to report percentiles along with the mean, and the
+// jitter as the distance from the median to the 99th percentile. The counters of the threads
+// of a multithreaded benchmark are averaged.
+class LatencyRecorder {
+   public:
+    explicit LatencyRecorder(benchmark::State& state) : mState(state) {
+        mSamples.reserve(1 << 16);
+    }
+
+    ~LatencyRecorder() {
+        if (mSamples.empty()) return;
+        std::sort(mSamples.begin(), mSamples.end());
+        for (int percent : {50, 90, 99}) {
+            report("p" + std::to_string(percent) + "_ns", at(percent));
+        }
+        report("max_ns", mSamples.back());
+        report("jitter_ns", at(99) - at(50));
+    }
+
+    void begin() { mBegin = std::chrono::steady_clock::now(); }
+
+    void end() {
+        auto latency = std::chrono::steady_clock::now() - mBegin;
+        mSamples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    }
+
+   private:
+    int64_t at(int percent) const {
+        return ::android::hardware::metrics::percentile(mSamples, percent);
+    }
+
+    void report(const std::string& name, int64_t ns) {
+        mState.counters[name] =
+                benchmark::Counter(static_cast<double>(ns), benchmark::Counter::kAvgThreads);
+    }
+
+    benchmark::State& mState;
+    std::chrono::steady_clock::time_point mBegin;
+    std::vector<int64_t> mSamples;
+};
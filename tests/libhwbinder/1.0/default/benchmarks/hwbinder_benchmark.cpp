@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures HwBinder transactions against a Benchmark server forked at startup:
+//  - round trip and one way latency over payload sizes from 0 to 1 MiB,
+//  - shared memory and native handle passing,
+//  - one way throughput,
+//  - scaling with the number of client threads, against --server_threads server threads.
+// Latency percentiles are reported as counters. With --pin_cpus, the server is pinned to CPU 0
+// and each client thread to its own CPU after it.
+
+#define LOG_TAG "libhwbinder_benchmark"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/tests/libhwbinder/1.0/IBenchmark.h>
+#include <android/hidl/allocator/1.0/IAllocator.h>
+#include <benchmark/benchmark.h>
+#include <hidl/HidlTransportSupport.h>
+#include <hidl/ServiceManagement.h>
+#include <log/log.h>
+
+#include "../Benchmark.h"
+#include "LatencyRecorder.h"
+
+using ::android::sp;
+using ::android::hardware::configureRpcThreadpool;
+using ::android::hardware::hidl_handle;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::joinRpcThreadpool;
+using ::android::hardware::tests::libhwbinder::V1_0::IBenchmark;
+using ::android::hardware::tests::libhwbinder::V1_0::implementation::Benchmark;
+using ::android::hidl::allocator::V1_0::IAllocator;
+
+namespace {
+
+constexpr char kServiceName[] = "hwbinder-benchmark";
+constexpr int64_t kMaxPayload = 1 << 20;
+// How long the server may take to handle the one way calls still queued after a run.
+constexpr std::chrono::seconds kOnewayDrainTimeout(5);
+
+size_t gServerThreads = 1;
+bool gPinCpus = false;
+sp<IBenchmark> gService;
+
+void pinToCpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % sysconf(_SC_NPROCESSORS_CONF), &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        ALOGW("Could not pin to CPU %d", cpu);
+    }
+}
+
+void startThread(benchmark::State& state) {
+    if (gPinCpus) {
+        pinToCpu(state.thread_index + 1);
+    }
+}
+
+void BM_sendVec(benchmark::State& state) {
+    startThread(state);
+    hidl_vec<uint8_t> data(static_cast<size_t>(state.range(0)));
+    std::fill(data.begin(), data.end(), 0xa5);
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        gService->sendVec(data, [](const auto& /* data */) {});
+        recorder.end();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_sendVec)->Arg(0)->RangeMultiplier(4)->Range(4, kMaxPayload);
+
+void BM_receiveVec(benchmark::State& state) {
+    startThread(state);
+    hidl_vec<uint8_t> data(static_cast<size_t>(state.range(0)));
+    std::fill(data.begin(), data.end(), 0xa5);
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        gService->receiveVec(data);
+        recorder.end();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_receiveVec)->Arg(0)->RangeMultiplier(4)->Range(4, kMaxPayload);
+
+// Small transactions from client threads sharing the server thread pool
+void BM_sendVecScaling(benchmark::State& state) {
+    startThread(state);
+    hidl_vec<uint8_t> data(static_cast<size_t>(state.range(0)));
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        gService->sendVec(data, [](const auto& /* data */) {});
+        recorder.end();
+    }
+}
+BENCHMARK(BM_sendVecScaling)->Arg(64)->Arg(4096)->ThreadRange(1, 16)->UseRealTime();
+
+void BM_sendMemory(benchmark::State& state) {
+    startThread(state);
+    sp<IAllocator> ashmem = IAllocator::getService("ashmem");
+    if (ashmem == nullptr) {
+        state.SkipWithError("No ashmem allocator");
+        return;
+    }
+    hidl_memory memory;
+    bool allocated = false;
+    ashmem->allocate(static_cast<uint64_t>(state.range(0)), [&](bool success, const auto& mem) {
+        allocated = success;
+        memory = mem;
+    });
+    if (!allocated) {
+        state.SkipWithError("Could not allocate shared memory");
+        return;
+    }
+
+    bool map = state.range(1) != 0;
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        gService->sendMemory(memory, map);
+        recorder.end();
+    }
+}
+BENCHMARK(BM_sendMemory)->RangeMultiplier(16)->Ranges({{4096, kMaxPayload}, {0, 1}});
+
+void BM_sendHandle(benchmark::State& state) {
+    startThread(state);
+    int numFds = static_cast<int>(state.range(0));
+    native_handle_t* handle = native_handle_create(numFds, 0);
+    for (int i = 0; i < numFds; i++) {
+        handle->data[i] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    hidl_handle hidlHandle(handle);
+
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        gService->sendHandle(hidlHandle);
+        recorder.end();
+    }
+
+    native_handle_close(handle);
+    native_handle_delete(handle);
+}
+BENCHMARK(BM_sendHandle)->Arg(0)->Arg(1)->Arg(4)->Arg(16);
+
+// Returns once the server has handled |expected| one way calls, or false after
+// kOnewayDrainTimeout. A sync call is not ordered after the one way calls still queued on the
+// node, so a single takeOnewayCount may miss some of them.
+bool drainOneway(uint64_t expected) {
+    auto deadline = std::chrono::steady_clock::now() + kOnewayDrainTimeout;
+    uint64_t received = 0;
+    while (true) {
+        received += gService->takeOnewayCount();
+        if (received >= expected) return received == expected;
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// One way calls block once the server's async buffer is full, so this measures the rate at
+// which the server drains them.
+void BM_sendOneway(benchmark::State& state) {
+    startThread(state);
+    hidl_vec<uint8_t> data(static_cast<size_t>(state.range(0)));
+    gService->takeOnewayCount();
+    for (auto _ : state) {
+        gService->sendOneway(data);
+    }
+    if (!drainOneway(static_cast<uint64_t>(state.iterations()))) {
+        state.SkipWithError("Lost one way calls");
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sendOneway)->Arg(0)->RangeMultiplier(8)->Range(64, 64 << 10);
+
+[[noreturn]] void runServer() {
+    if (gPinCpus) {
+        pinToCpu(0);
+    }
+    configureRpcThreadpool(gServerThreads, true /* callerWillJoin */);
+    sp<IBenchmark> service = new Benchmark();
+    if (service->registerAsService(kServiceName) != ::android::OK) {
+        ALOGE("Could not register the benchmark service");
+        exit(EXIT_FAILURE);
+    }
+    joinRpcThreadpool();
+    exit(EXIT_FAILURE);
+}
+
+// Removes the options of this benchmark from argv, leaving the ones of the benchmark library.
+void parseOptions(int* argc, char** argv) {
+    const std::string serverThreads = "--server_threads=";
+    int kept = 1;
+    for (int i = 1; i < *argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, serverThreads.size(), serverThreads) == 0) {
+            gServerThreads = std::max(1, atoi(arg.c_str() + serverThreads.size()));
+        } else if (arg == "--pin_cpus") {
+            gPinCpus = true;
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    *argc = kept;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    parseOptions(&argc, argv);
+    ::benchmark::Initialize(&argc, argv);
+
+    // The test interface is not in the device manifest
+    ::android::hardware::details::setTrebleTestingOverride(true);
+
+    pid_t server = fork();
+    if (server == 0) {
+        runServer();
+    }
+
+    gService = IBenchmark::getService(kServiceName);
+    if (gService == nullptr) {
+        ALOGE("Could not get the benchmark service");
+        kill(server, SIGKILL);
+        return EXIT_FAILURE;
+    }
+
+    ::benchmark::RunSpecifiedBenchmarks();
+
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    return EXIT_SUCCESS;
+}
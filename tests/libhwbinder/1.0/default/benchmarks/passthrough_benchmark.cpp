@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the same IScheduleTest implementation loaded passthrough, in process from its
+// -impl library, and binderized, in a server forked at startup. The first argument of each
+// benchmark is the mode: 0 for passthrough, 1 for binderized. It measures:
+//  - call latency, with percentiles,
+//  - jitter, as the spread of the percentiles, while every CPU runs a busy thread,
+//  - whether a SCHED_FIFO caller's priority reaches the thread running the call; this needs
+//    the permission to use SCHED_FIFO, and is skipped otherwise.
+
+#define LOG_TAG "hwbinder_passthrough_benchmark"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/tests/libhwbinder/1.0/IScheduleTest.h>
+#include <benchmark/benchmark.h>
+#include <hidl/HidlTransportSupport.h>
+#include <hidl/ServiceManagement.h>
+#include <log/log.h>
+
+#include "../ScheduleTest.h"
+#include "LatencyRecorder.h"
+
+using ::android::sp;
+using ::android::hardware::configureRpcThreadpool;
+using ::android::hardware::joinRpcThreadpool;
+using ::android::hardware::tests::libhwbinder::V1_0::IScheduleTest;
+using ::android::hardware::tests::libhwbinder::V1_0::implementation::ScheduleTest;
+
+namespace {
+
+constexpr char kServiceName[] = "hwbinder-passthrough-benchmark";
+constexpr int kFifoPriority = 50;
+
+sp<IScheduleTest> gService[2];
+
+sp<IScheduleTest> serviceFor(benchmark::State& state) {
+    return gService[state.range(0) != 0 ? 1 : 0];
+}
+
+// The caller status of IScheduleTest::send: priority in the high half, CPU in the low half.
+uint32_t callerStatus() {
+    struct sched_param param;
+    int policy;
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    return (static_cast<uint32_t>(param.sched_priority) << 16) |
+           (static_cast<uint32_t>(sched_getcpu()) & 0xffff);
+}
+
+// Keeps every CPU busy with a SCHED_OTHER thread while alive.
+class CpuLoad {
+   public:
+    CpuLoad() {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < cpus; i++) {
+            mThreads.emplace_back([this] {
+                volatile uint64_t spins = 0;
+                while (!mStop.load(std::memory_order_relaxed)) {
+                    spins = spins + 1;
+                }
+            });
+        }
+    }
+
+    ~CpuLoad() {
+        mStop = true;
+        for (auto& thread : mThreads) {
+            thread.join();
+        }
+    }
+
+   private:
+    std::atomic<bool> mStop{false};
+    std::vector<std::thread> mThreads;
+};
+
+void BM_call(benchmark::State& state) {
+    sp<IScheduleTest> test = serviceFor(state);
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        test->send(0, callerStatus());
+        recorder.end();
+    }
+}
+BENCHMARK(BM_call)->Arg(0)->Arg(1);
+
+void BM_callUnderLoad(benchmark::State& state) {
+    sp<IScheduleTest> test = serviceFor(state);
+    CpuLoad load;
+    LatencyRecorder recorder(state);
+    for (auto _ : state) {
+        recorder.begin();
+        test->send(0, callerStatus());
+        recorder.end();
+    }
+}
+BENCHMARK(BM_callUnderLoad)->Arg(0)->Arg(1)->UseRealTime();
+
+// Counts the calls that ran at a priority other than the caller's, and the ones that ran on
+// another CPU, under the same load as BM_callUnderLoad.
+void BM_fifoCallUnderLoad(benchmark::State& state) {
+    sp<IScheduleTest> test = serviceFor(state);
+    struct sched_param param = {};
+    param.sched_priority = kFifoPriority;
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+        state.SkipWithError("Could not switch to SCHED_FIFO");
+        return;
+    }
+    uint64_t priorityMisses = 0;
+    uint64_t cpuMigrations = 0;
+    {
+        CpuLoad load;
+        LatencyRecorder recorder(state);
+        for (auto _ : state) {
+            recorder.begin();
+            uint32_t result = test->send(0, callerStatus());
+            recorder.end();
+            priorityMisses += result >> 16;
+            cpuMigrations += result & 0xffff;
+        }
+    }
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    state.counters["priority_misses"] = static_cast<double>(priorityMisses);
+    state.counters["cpu_migrations"] = static_cast<double>(cpuMigrations);
+}
+BENCHMARK(BM_fifoCallUnderLoad)->Arg(0)->Arg(1)->UseRealTime();
+
+[[noreturn]] void runServer() {
+    configureRpcThreadpool(1, true /* callerWillJoin */);
+    sp<IScheduleTest> service = new ScheduleTest();
+    if (service->registerAsService(kServiceName) != ::android::OK) {
+        ALOGE("Could not register the benchmark service");
+        exit(EXIT_FAILURE);
+    }
+    joinRpcThreadpool();
+    exit(EXIT_FAILURE);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+
+    // The test interface is not in the device manifest
+    ::android::hardware::details::setTrebleTestingOverride(true);
+
+    pid_t server = fork();
+    if (server == 0) {
+        runServer();
+    }
+
+    gService[0] = IScheduleTest::getService(true /* getStub */);
+    if (gService[0] == nullptr) {
+        // The -impl library is not installed; the implementation linked in is the same code.
+        ALOGW("Could not load the passthrough implementation, using the linked one");
+        gService[0] = new ScheduleTest();
+    }
+    gService[1] = IScheduleTest::getService(kServiceName);
+    if (gService[1] == nullptr) {
+        ALOGE("Could not get the benchmark service");
+        kill(server, SIGKILL);
+        return EXIT_FAILURE;
+    }
+
+    ::benchmark::RunSpecifiedBenchmarks();
+
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of passing shared memory to a HAL, over sizes from 4 KiB to 16 MiB:
+//  - mapping and unmapping a hidl_memory in process,
+//  - the page faults of the first touch of a mapping, against touching a mapping kept around,
+//  - sending a hidl_memory that the server maps on every call (fillMemory), against only
+//    sending it (haveSomeMemory), and against writing through a mapping cached by the caller,
+//  - sending a MemoryBlock that refers to memory registered once through an IMemoryToken.
+// The server is a MemoryTest forked at startup.
+
+#define LOG_TAG "memory_benchmark"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <android/hardware/tests/memory/1.0/IMemoryTest.h>
+#include <android/hidl/allocator/1.0/IAllocator.h>
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <benchmark/benchmark.h>
+#include <hidl/HidlTransportSupport.h>
+#include <hidl/ServiceManagement.h>
+#include <hidlmemory/mapping.h>
+#include <log/log.h>
+
+#include "../MemoryTest.h"
+
+using ::android::sp;
+using ::android::hardware::configureRpcThreadpool;
+using ::android::hardware::hidl_memory;
+using ::android::hardware::joinRpcThreadpool;
+using ::android::hardware::mapMemory;
+using ::android::hardware::tests::memory::V1_0::IMemoryTest;
+using ::android::hardware::tests::memory::V1_0::implementation::Memory;
+using ::android::hidl::allocator::V1_0::IAllocator;
+using ::android::hidl::memory::block::V1_0::MemoryBlock;
+using ::android::hidl::memory::token::V1_0::IMemoryToken;
+using ::android::hidl::memory::V1_0::IMemory;
+
+namespace {
+
+constexpr char kServiceName[] = "memory-benchmark";
+constexpr int64_t kMinSize = 4 << 10;
+constexpr int64_t kMaxSize = 16 << 20;
+
+sp<IMemoryTest> gService;
+
+bool allocate(benchmark::State& state, hidl_memory* memory) {
+    sp<IAllocator> ashmem = IAllocator::getService("ashmem");
+    if (ashmem == nullptr) {
+        state.SkipWithError("No ashmem allocator");
+        return false;
+    }
+    bool allocated = false;
+    ashmem->allocate(static_cast<uint64_t>(state.range(0)), [&](bool success, const auto& mem) {
+        allocated = success;
+        *memory = mem;
+    });
+    if (!allocated) {
+        state.SkipWithError("Could not allocate shared memory");
+    }
+    return allocated;
+}
+
+// Writes a byte to every page, faulting the pages in on a fresh mapping.
+void touchPages(const sp<IMemory>& memory) {
+    uint8_t* data = static_cast<uint8_t*>(static_cast<void*>(memory->getPointer()));
+    size_t pageSize = static_cast<size_t>(getpagesize());
+    for (size_t i = 0; i < memory->getSize(); i += pageSize) {
+        data[i] = static_cast<uint8_t>(i);
+    }
+    benchmark::ClobberMemory();
+}
+
+void BM_mapUnmap(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    for (auto _ : state) {
+        sp<IMemory> mapped = mapMemory(memory);
+        if (mapped == nullptr) {
+            state.SkipWithError("Could not map shared memory");
+            return;
+        }
+        benchmark::DoNotOptimize(mapped->getPointer());
+    }
+}
+BENCHMARK(BM_mapUnmap)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+// The difference with BM_touchCachedMapping is the cost of the page faults.
+void BM_mapAndTouch(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    for (auto _ : state) {
+        sp<IMemory> mapped = mapMemory(memory);
+        if (mapped == nullptr) {
+            state.SkipWithError("Could not map shared memory");
+            return;
+        }
+        touchPages(mapped);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_mapAndTouch)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+void BM_touchCachedMapping(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    sp<IMemory> mapped = mapMemory(memory);
+    if (mapped == nullptr) {
+        state.SkipWithError("Could not map shared memory");
+        return;
+    }
+    for (auto _ : state) {
+        touchPages(mapped);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_touchCachedMapping)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+// Transport only: the server does not map the memory.
+void BM_sendMemory(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    for (auto _ : state) {
+        gService->haveSomeMemory(memory, [](const auto& /* mem */) {});
+    }
+}
+BENCHMARK(BM_sendMemory)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+// The server maps, fills and unmaps the memory on every call.
+void BM_fillMemory(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    uint8_t filler = 0;
+    for (auto _ : state) {
+        gService->fillMemory(memory, filler++);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_fillMemory)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+// What fillMemory would cost with the mapping cached: the fill alone.
+void BM_fillCachedMapping(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    sp<IMemory> mapped = mapMemory(memory);
+    if (mapped == nullptr) {
+        state.SkipWithError("Could not map shared memory");
+        return;
+    }
+    uint8_t* data = static_cast<uint8_t*>(static_cast<void*>(mapped->getPointer()));
+    uint8_t filler = 0;
+    for (auto _ : state) {
+        mapped->update();
+        memset(data, filler++, mapped->getSize());
+        mapped->commit();
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_fillCachedMapping)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+// The memory is registered with the server once; each call only carries the token.
+void BM_sendMemoryBlock(benchmark::State& state) {
+    hidl_memory memory;
+    if (!allocate(state, &memory)) return;
+    gService->set(memory);
+    sp<IMemoryToken> token = gService->get();
+    if (token == nullptr) {
+        state.SkipWithError("Could not register shared memory");
+        return;
+    }
+    MemoryBlock block = {token, static_cast<uint64_t>(state.range(0)), 0};
+    for (auto _ : state) {
+        gService->haveSomeMemoryBlock(block, [](const auto& /* blk */) {});
+    }
+}
+BENCHMARK(BM_sendMemoryBlock)->RangeMultiplier(16)->Range(kMinSize, kMaxSize);
+
+[[noreturn]] void runServer() {
+    configureRpcThreadpool(1, true /* callerWillJoin */);
+    sp<IMemoryTest> service = new Memory();
+    if (service->registerAsService(kServiceName) != ::android::OK) {
+        ALOGE("Could not register the memory benchmark service");
+        exit(EXIT_FAILURE);
+    }
+    joinRpcThreadpool();
+    exit(EXIT_FAILURE);
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+
+    // The test interface is not in the device manifest
+    ::android::hardware::details::setTrebleTestingOverride(true);
+
+    pid_t server = fork();
+    if (server == 0) {
+        runServer();
+    }
+
+    gService = IMemoryTest::getService(kServiceName);
+    if (gService == nullptr) {
+        ALOGE("Could not get the memory benchmark service");
+        kill(server, SIGKILL);
+        return EXIT_FAILURE;
+    }
+
+    ::benchmark::RunSpecifiedBenchmarks();
+
+    kill(server, SIGKILL);
+    waitpid(server, nullptr, 0);
+    return EXIT_SUCCESS;
+}
@@ -15,8 +15,12 @@
  */
 
 #include "BenchmarkMsgQ.h"
+#include <string.h>
+#include <time.h>
+#include <chrono>
 #include <iostream>
 #include <thread>
+#include <vector>
 #include <fmq/MessageQueue.h>
 
 namespace android {
@@ -26,12 +30,35 @@ namespace msgq {
 namespace V1_0 {
 namespace implementation {
 
+static constexpr size_t kNumElementsInQueue = 16 * 1024;
+// Bounds each transfer of an experiment, so that a client that went away does not leave the
+// thread blocked
+static constexpr int64_t kBlockingTimeoutNs = 1000 * 1000 * 1000;
+
+// Retries tryOnce until it succeeds, for at most kBlockingTimeoutNs
+template <typename F>
+static bool spinWithTimeout(F tryOnce) {
+    auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::nanoseconds(kBlockingTimeoutNs);
+    while (!tryOnce()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int64_t threadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
 // Methods from ::android::hardware::tests::msgq::V1_0::IBenchmarkMsgQ follow.
 Return<void> BenchmarkMsgQ::configureClientInboxSyncReadWrite(
         configureClientInboxSyncReadWrite_cb _hidl_cb) {
-    static constexpr size_t kNumElementsInQueue = 16 * 1024;
     mFmqOutbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
-               kSynchronizedReadWrite>(kNumElementsInQueue);
+               kSynchronizedReadWrite>(kNumElementsInQueue, true /* configureEventFlagWord */);
     if (mFmqOutbox == nullptr) {
         _hidl_cb(false /* ret */, android::hardware::MQDescriptorSync<uint8_t>(
                 std::vector<android::hardware::GrantorDescriptor>(),
@@ -45,9 +72,8 @@ Return<void> BenchmarkMsgQ::configureClientInboxSyncReadWrite(
 
 Return<void> BenchmarkMsgQ::configureClientOutboxSyncReadWrite(
         configureClientOutboxSyncReadWrite_cb _hidl_cb) {
-    static constexpr size_t kNumElementsInQueue = 16 * 1024;
     mFmqInbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
-              kSynchronizedReadWrite>(kNumElementsInQueue);
+              kSynchronizedReadWrite>(kNumElementsInQueue, true /* configureEventFlagWord */);
     if ((mFmqInbox == nullptr) || (mFmqInbox->isValid() == false)) {
         _hidl_cb(false /* ret */, android::hardware::MQDescriptorSync<uint8_t>(
                 std::vector<android::hardware::GrantorDescriptor>(),
@@ -111,6 +137,59 @@ Return<void> BenchmarkMsgQ::sendTimeData(const hidl_vec<int64_t>& clientRcvTimeA
     return Void();
 }
 
+Return<void> BenchmarkMsgQ::configureClientInboxUnsync(configureClientInboxUnsync_cb _hidl_cb) {
+    // The writer of a running experiment may still be using the queue
+    if (mServiceCpuTimeNs.load() < 0) {
+        _hidl_cb(false /* ret */, android::hardware::MQDescriptorUnsync<uint8_t>(
+                std::vector<android::hardware::GrantorDescriptor>(),
+                nullptr /* nhandle */, 0 /* size */));
+        return Void();
+    }
+    delete mFmqUnsyncOutbox;
+    mFmqUnsyncOutbox = new (std::nothrow) android::hardware::MessageQueue<uint8_t,
+              kUnsynchronizedWrite>(kNumElementsInQueue);
+    if ((mFmqUnsyncOutbox == nullptr) || (mFmqUnsyncOutbox->isValid() == false)) {
+        _hidl_cb(false /* ret */, android::hardware::MQDescriptorUnsync<uint8_t>(
+                std::vector<android::hardware::GrantorDescriptor>(),
+                nullptr /* nhandle */, 0 /* size */));
+    } else {
+        _hidl_cb(true /* ret */, *mFmqUnsyncOutbox->getDesc());
+    }
+
+    return Void();
+}
+
+bool BenchmarkMsgQ::startExperiment() {
+    int64_t done = mServiceCpuTimeNs.load();
+    return done >= 0 && mServiceCpuTimeNs.compare_exchange_strong(done, -1);
+}
+
+Return<bool> BenchmarkMsgQ::benchmarkPingPongMode(uint32_t numIter, uint32_t packetSize,
+                                                  TransferMode mode) {
+    if (mFmqInbox == nullptr || mFmqOutbox == nullptr || packetSize == 0 ||
+        packetSize > kNumElementsInQueue || !startExperiment()) {
+        return false;
+    }
+    std::thread(QueuePairReadWriteMode, mFmqInbox, mFmqOutbox, numIter, packetSize, mode,
+                &mServiceCpuTimeNs).detach();
+    return true;
+}
+
+Return<bool> BenchmarkMsgQ::benchmarkServiceWriteUnsync(uint32_t numIter, uint32_t packetSize,
+                                                        uint32_t intervalNs) {
+    if (mFmqUnsyncOutbox == nullptr || packetSize < sizeof(int64_t) ||
+        packetSize > kNumElementsInQueue || !startExperiment()) {
+        return false;
+    }
+    std::thread(UnsyncQueueWriter, mFmqUnsyncOutbox, numIter, packetSize, intervalNs,
+                &mServiceCpuTimeNs).detach();
+    return true;
+}
+
+Return<int64_t> BenchmarkMsgQ::getServiceCpuTime() {
+    return mServiceCpuTimeNs.load();
+}
+
 template <MQFlavor flavor>
 void BenchmarkMsgQ::QueueWriter(android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
                                 int64_t* mTimeData,
@@ -144,6 +223,74 @@ void BenchmarkMsgQ::QueuePairReadWrite(
     }
 }
 
+void BenchmarkMsgQ::QueuePairReadWriteMode(
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+        android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+        uint32_t numIter, uint32_t packetSize, TransferMode mode,
+        std::atomic<int64_t>* cpuTimeNs) {
+    using Queue = android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>;
+    std::vector<uint8_t> data(packetSize);
+    int64_t startCpuTime = threadCpuTimeNs();
+
+    for (uint32_t numRoundTrips = 0; numRoundTrips < numIter; numRoundTrips++) {
+        bool ok = true;
+        switch (mode) {
+            case TransferMode::SPIN:
+                ok = spinWithTimeout([&] { return mFmqInbox->read(data.data(), packetSize); }) &&
+                     spinWithTimeout([&] { return mFmqOutbox->write(data.data(), packetSize); });
+                break;
+            case TransferMode::BLOCKING:
+                ok = mFmqInbox->readBlocking(data.data(), packetSize, kBlockingTimeoutNs) &&
+                     mFmqOutbox->writeBlocking(data.data(), packetSize, kBlockingTimeoutNs);
+                break;
+            case TransferMode::ZERO_COPY: {
+                Queue::MemTransaction readTx;
+                Queue::MemTransaction writeTx;
+                ok = spinWithTimeout([&] { return mFmqInbox->beginRead(packetSize, &readTx); }) &&
+                     spinWithTimeout(
+                             [&] { return mFmqOutbox->beginWrite(packetSize, &writeTx); });
+                if (!ok) break;
+                auto first = readTx.getFirstRegion();
+                auto second = readTx.getSecondRegion();
+                writeTx.copyTo(first.getAddress(), 0, first.getLength());
+                if (second.getLength() > 0) {
+                    writeTx.copyTo(second.getAddress(), first.getLength(), second.getLength());
+                }
+                mFmqOutbox->commitWrite(packetSize);
+                mFmqInbox->commitRead(packetSize);
+                break;
+            }
+            default:
+                ok = false;
+                break;
+        }
+        if (!ok) break;
+    }
+
+    cpuTimeNs->store(threadCpuTimeNs() - startCpuTime);
+}
+
+void BenchmarkMsgQ::UnsyncQueueWriter(
+        android::hardware::MessageQueue<uint8_t, kUnsynchronizedWrite>* mFmqOutbox,
+        uint32_t numIter, uint32_t packetSize, uint32_t intervalNs,
+        std::atomic<int64_t>* cpuTimeNs) {
+    std::vector<uint8_t> data(packetSize);
+    int64_t startCpuTime = threadCpuTimeNs();
+    auto nextWrite = std::chrono::steady_clock::now();
+
+    for (uint32_t numWrites = 0; numWrites < numIter; numWrites++) {
+        // Sleeping rather than spinning keeps the CPU time down to the cost of the writes
+        std::this_thread::sleep_until(nextWrite);
+        int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+        memcpy(data.data(), &now, sizeof(now));
+        // An unsynchronized write only fails if the packet is larger than the queue
+        mFmqOutbox->write(data.data(), packetSize);
+        nextWrite += std::chrono::nanoseconds(intervalNs);
+    }
+
+    cpuTimeNs->store(threadCpuTimeNs() - startCpuTime);
+}
+
 IBenchmarkMsgQ* HIDL_FETCH_IBenchmarkMsgQ(const char* /* name */) {
     return new BenchmarkMsgQ();
 }
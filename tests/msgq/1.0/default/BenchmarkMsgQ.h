@@ -21,6 +21,7 @@
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 #include <fmq/MessageQueue.h>
+#include <atomic>
 
 namespace android {
 namespace hardware {
@@ -41,6 +42,7 @@ using ::android::hardware::Void;
 using ::android::sp;
 
 using android::hardware::kSynchronizedReadWrite;
+using android::hardware::kUnsynchronizedWrite;
 using android::hardware::MQFlavor;
 
 struct BenchmarkMsgQ : public IBenchmarkMsgQ {
@@ -62,6 +64,12 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
     Return<void> benchmarkPingPong(uint32_t numIter) override;
     Return<void> benchmarkServiceWriteClientRead(uint32_t numIter) override;
     Return<void> sendTimeData(const hidl_vec<int64_t>& timeData) override;
+    Return<void> configureClientInboxUnsync(configureClientInboxUnsync_cb _hidl_cb) override;
+    Return<bool> benchmarkPingPongMode(uint32_t numIter, uint32_t packetSize,
+                                       TransferMode mode) override;
+    Return<bool> benchmarkServiceWriteUnsync(uint32_t numIter, uint32_t packetSize,
+                                             uint32_t intervalNs) override;
+    Return<int64_t> getServiceCpuTime() override;
 
      /*
      * This method writes numIter packets into the mFmqOutbox queue
@@ -82,10 +90,35 @@ struct BenchmarkMsgQ : public IBenchmarkMsgQ {
             android::hardware::MessageQueue<uint8_t, flavor>* mFmqOutbox,
             uint32_t numIter);
 
+    /*
+     * Same as QueuePairReadWrite, with packets of packetSize bytes moved as
+     * described by mode. The CPU time of the thread is stored in cpuTimeNs
+     * once done.
+     */
+    static void QueuePairReadWriteMode(
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox,
+            android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox,
+            uint32_t numIter, uint32_t packetSize, TransferMode mode,
+            std::atomic<int64_t>* cpuTimeNs);
+
+    /*
+     * Writes numIter timestamped packets into the unsynchronized queue at a
+     * fixed rate, and stores the CPU time of the thread in cpuTimeNs once done.
+     */
+    static void UnsyncQueueWriter(
+            android::hardware::MessageQueue<uint8_t, kUnsynchronizedWrite>* mFmqOutbox,
+            uint32_t numIter, uint32_t packetSize, uint32_t intervalNs,
+            std::atomic<int64_t>* cpuTimeNs);
+
 private:
+    // Starts an experiment, unless one is still running
+    bool startExperiment();
+
     android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqInbox;
     android::hardware::MessageQueue<uint8_t, kSynchronizedReadWrite>* mFmqOutbox;
     int64_t* mTimeData;
+    android::hardware::MessageQueue<uint8_t, kUnsynchronizedWrite>* mFmqUnsyncOutbox = nullptr;
+    std::atomic<int64_t> mServiceCpuTimeNs{0};
 };
 
 extern "C" IBenchmarkMsgQ* HIDL_FETCH_IBenchmarkMsgQ(const char* name);
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Client of the IBenchmarkMsgQ service, run as a matrix of google-benchmark cases:
+//  - ping-pong over synchronized queues for each TransferMode and packet size,
+//  - one unsynchronized writer and 1 to 8 readers at a fixed rate.
+// Along with latency percentiles, each case reports the CPU time spent per message by the
+// client and the service threads together.
+
+#define LOG_TAG "FMQ_Benchmarks"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/tests/msgq/1.0/IBenchmarkMsgQ.h>
+#include <benchmark/benchmark.h>
+#include <fmq/MessageQueue.h>
+#include <hal-metrics/Metrics.h>
+#include <log/log.h>
+
+using android::sp;
+using android::hardware::kSynchronizedReadWrite;
+using android::hardware::kUnsynchronizedWrite;
+using android::hardware::MessageQueue;
+using android::hardware::MQDescriptorSync;
+using android::hardware::MQDescriptorUnsync;
+using android::hardware::tests::msgq::V1_0::IBenchmarkMsgQ;
+
+using TransferMode = IBenchmarkMsgQ::TransferMode;
+using SyncQueue = MessageQueue<uint8_t, kSynchronizedReadWrite>;
+using UnsyncQueue = MessageQueue<uint8_t, kUnsynchronizedWrite>;
+
+namespace {
+
+constexpr int64_t kPingPongIterations = 10000;
+constexpr uint32_t kUnsyncPackets = 20000;
+constexpr uint32_t kUnsyncIntervalNs = 50 * 1000;
+constexpr int64_t kBlockingTimeoutNs = 1000 * 1000 * 1000;
+
+sp<IBenchmarkMsgQ> gService;
+std::unique_ptr<SyncQueue> gInbox;
+std::unique_ptr<SyncQueue> gOutbox;
+MQDescriptorUnsync<uint8_t> gUnsyncDesc;
+
+int64_t threadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
+// Waits for the service thread of the last experiment to finish, and returns its CPU time.
+int64_t waitForServiceCpuTime() {
+    int64_t cpuTimeNs;
+    while ((cpuTimeNs = gService->getServiceCpuTime()) < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return cpuTimeNs;
+}
+
+void reportPercentiles(benchmark::State& state, std::vector<int64_t>* samples) {
+    if (samples->empty()) return;
+    std::sort(samples->begin(), samples->end());
+    for (int percent : {50, 90, 99}) {
+        state.counters["p" + std::to_string(percent) + "_ns"] =
+                android::hardware::metrics::percentile(*samples, percent);
+    }
+    state.counters["max_ns"] = samples->back();
+}
+
+// Retries tryOnce until it succeeds, for at most kBlockingTimeoutNs, as the service does
+template <typename F>
+bool spinWithTimeout(F tryOnce) {
+    auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::nanoseconds(kBlockingTimeoutNs);
+    while (!tryOnce()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool roundTrip(TransferMode mode, uint8_t* data, uint32_t packetSize) {
+    switch (mode) {
+        case TransferMode::SPIN:
+            return spinWithTimeout([&] { return gOutbox->write(data, packetSize); }) &&
+                   spinWithTimeout([&] { return gInbox->read(data, packetSize); });
+        case TransferMode::BLOCKING:
+            return gOutbox->writeBlocking(data, packetSize, kBlockingTimeoutNs) &&
+                   gInbox->readBlocking(data, packetSize, kBlockingTimeoutNs);
+        case TransferMode::ZERO_COPY: {
+            SyncQueue::MemTransaction tx;
+            if (!spinWithTimeout([&] { return gOutbox->beginWrite(packetSize, &tx); })) {
+                return false;
+            }
+            tx.copyTo(data, 0, packetSize);
+            gOutbox->commitWrite(packetSize);
+            if (!spinWithTimeout([&] { return gInbox->beginRead(packetSize, &tx); })) {
+                return false;
+            }
+            // Only looks at the packet in place, as a consumer of the data would
+            benchmark::DoNotOptimize(*tx.getSlot(packetSize - 1));
+            gInbox->commitRead(packetSize);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Args: mode, packet size
+void BM_PingPong(benchmark::State& state) {
+    auto mode = static_cast<TransferMode>(state.range(0));
+    auto packetSize = static_cast<uint32_t>(state.range(1));
+    std::vector<uint8_t> data(packetSize);
+    std::vector<int64_t> samples;
+    samples.reserve(kPingPongIterations);
+
+    if (!gService->benchmarkPingPongMode(kPingPongIterations, packetSize, mode)) {
+        state.SkipWithError("Could not start the service");
+        return;
+    }
+
+    int64_t startCpuTime = threadCpuTimeNs();
+    for (auto _ : state) {
+        auto begin = std::chrono::steady_clock::now();
+        if (!roundTrip(mode, data.data(), packetSize)) {
+            state.SkipWithError("Round trip timed out");
+            break;
+        }
+        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count());
+    }
+    int64_t clientCpuTime = threadCpuTimeNs() - startCpuTime;
+    int64_t serviceCpuTime = waitForServiceCpuTime();
+
+    // Two messages per round trip
+    state.counters["cpu_ns_per_msg"] =
+            static_cast<double>(clientCpuTime + serviceCpuTime) / (2 * state.iterations());
+    reportPercentiles(state, &samples);
+    state.SetBytesProcessed(state.iterations() * packetSize * 2);
+}
+BENCHMARK(BM_PingPong)
+        ->ArgNames({"mode", "packet"})
+        ->ArgsProduct({{static_cast<int64_t>(TransferMode::SPIN),
+                        static_cast<int64_t>(TransferMode::BLOCKING),
+                        static_cast<int64_t>(TransferMode::ZERO_COPY)},
+                       {8, 64, 256, 1024, 4096}})
+        ->Iterations(kPingPongIterations);
+
+struct ReaderResult {
+    uint64_t received = 0;
+    uint64_t overflows = 0;
+    int64_t cpuTimeNs = 0;
+    std::vector<int64_t> latencies;
+};
+
+void readUnsync(uint32_t packetSize, const std::atomic<bool>* done, ReaderResult* result) {
+    UnsyncQueue queue(gUnsyncDesc, false /* resetPointers */);
+    std::vector<uint8_t> data(packetSize);
+    int64_t startCpuTime = threadCpuTimeNs();
+
+    while (!done->load() || queue.availableToRead() >= packetSize) {
+        if (queue.availableToRead() < packetSize) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!queue.read(data.data(), packetSize)) {
+            // The writer lapped this reader, which lost its position and starts over
+            result->overflows++;
+            continue;
+        }
+        int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+        int64_t written;
+        memcpy(&written, data.data(), sizeof(written));
+        result->latencies.push_back(now - written);
+        result->received++;
+    }
+    result->cpuTimeNs = threadCpuTimeNs() - startCpuTime;
+}
+
+// Args: readers, packet size
+void BM_UnsyncReaders(benchmark::State& state) {
+    auto readers = static_cast<size_t>(state.range(0));
+    auto packetSize = static_cast<uint32_t>(state.range(1));
+
+    for (auto _ : state) {
+        std::atomic<bool> done(false);
+        std::vector<ReaderResult> results(readers);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < readers; i++) {
+            threads.emplace_back(readUnsync, packetSize, &done, &results[i]);
+        }
+
+        if (!gService->benchmarkServiceWriteUnsync(kUnsyncPackets, packetSize,
+                                                   kUnsyncIntervalNs)) {
+            state.SkipWithError("Could not start the service");
+        }
+        int64_t serviceCpuTime = waitForServiceCpuTime();
+        done = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        uint64_t received = 0;
+        uint64_t overflows = 0;
+        int64_t cpuTime = serviceCpuTime;
+        std::vector<int64_t> latencies;
+        for (auto& result : results) {
+            received += result.received;
+            overflows += result.overflows;
+            cpuTime += result.cpuTimeNs;
+            latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+        }
+        state.counters["received"] = received;
+        state.counters["overflows"] = overflows;
+        state.counters["cpu_ns_per_msg"] =
+                received > 0 ? static_cast<double>(cpuTime) / received : 0;
+        reportPercentiles(state, &latencies);
+    }
+}
+BENCHMARK(BM_UnsyncReaders)
+        ->ArgNames({"readers", "packet"})
+        ->ArgsProduct({{1, 2, 4, 8}, {64, 1024}})
+        ->Iterations(1)
+        ->Unit(benchmark::kMillisecond)
+        ->UseRealTime();
+
+bool setUp() {
+    gService = IBenchmarkMsgQ::getService();
+    if (gService == nullptr) {
+        ALOGE("Could not get the benchmark service");
+        return false;
+    }
+
+    bool ok = false;
+    gService->configureClientInboxSyncReadWrite(
+            [&ok](bool ret, const MQDescriptorSync<uint8_t>& in) {
+                ok = ret;
+                if (ret) gInbox = std::make_unique<SyncQueue>(in);
+            });
+    if (!ok || !gInbox->isValid()) return false;
+
+    gService->configureClientOutboxSyncReadWrite(
+            [&ok](bool ret, const MQDescriptorSync<uint8_t>& out) {
+                ok = ret;
+                if (ret) gOutbox = std::make_unique<SyncQueue>(out);
+            });
+    if (!ok || !gOutbox->isValid()) return false;
+
+    gService->configureClientInboxUnsync([&ok](bool ret, const MQDescriptorUnsync<uint8_t>& in) {
+        ok = ret;
+        if (ret) gUnsyncDesc = in;
+    });
+    return ok;
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+    ::benchmark::Initialize(&argc, argv);
+    if (!setUp()) {
+        ALOGE("Could not set up the benchmark queues");
+        return EXIT_FAILURE;
+    }
+    ::benchmark::RunSpecifiedBenchmarks();
+    return EXIT_SUCCESS;
+}
@@ -81,6 +81,35 @@ static const CpuUsage kCpuUsage = {
         .isOnline = true,
 };
 
+Thermal::Thermal() {
+    monitor_ = std::make_unique<ThermalMonitor>(
+            [this](const Temperature_2_0& temperature) { sendThermalChangedCallback(temperature); });
+    monitor_->start();
+}
+
+void Thermal::sendThermalChangedCallback(const Temperature_2_0& temperature) {
+    std::lock_guard<std::mutex> _lock(thermal_callback_mutex_);
+    LOG(INFO) << "Sending notification:"
+              << " Type: " << android::hardware::thermal::V2_0::toString(temperature.type)
+              << " Name: " << temperature.name << " CurrentValue: " << temperature.value
+              << " ThrottlingStatus: "
+              << android::hardware::thermal::V2_0::toString(temperature.throttlingStatus);
+    callbacks_.erase(
+        std::remove_if(callbacks_.begin(), callbacks_.end(),
+                       [&](const CallbackSetting& c) {
+                           if (c.is_filter_type && c.type != temperature.type) {
+                               return false;
+                           }
+                           auto ret = c.callback->notifyThrottling(temperature);
+                           if (!ret.isOk() && ret.isDeadObject()) {
+                               LOG(ERROR) << "Dropping a dead callback from ThermalHAL";
+                               return true;
+                           }
+                           return false;
+                       }),
+        callbacks_.end());
+}
+
 // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
 Return<void> Thermal::getTemperatures(getTemperatures_cb _hidl_cb) {
     ThermalStatus status;
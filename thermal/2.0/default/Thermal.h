@@ -17,10 +17,14 @@
 #ifndef ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_H
 #define ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_H
 
+#include <memory>
+
 #include <android/hardware/thermal/2.0/IThermal.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
 
+#include "ThermalMonitor.h"
+
 namespace android {
 namespace hardware {
 namespace thermal {
@@ -55,6 +59,8 @@ struct CallbackSetting {
 
 class Thermal : public IThermal {
    public:
+    Thermal();
+
     // Methods from ::android::hardware::thermal::V1_0::IThermal follow.
     Return<void> getTemperatures(getTemperatures_cb _hidl_cb) override;
     Return<void> getCpuUsages(getCpuUsages_cb _hidl_cb) override;
@@ -75,8 +81,13 @@ class Thermal : public IThermal {
                                           getCurrentCoolingDevices_cb _hidl_cb) override;
 
    private:
+    // Calls notifyThrottling on every callback registered for the type of temperature.
+    void sendThermalChangedCallback(const Temperature_2_0& temperature);
+
     std::mutex thermal_callback_mutex_;
     std::vector<CallbackSetting> callbacks_;
+    // Declared last so that it stops before the callbacks are destroyed.
+    std::unique_ptr<ThermalMonitor> monitor_;
 };
 
 }  // namespace implementation
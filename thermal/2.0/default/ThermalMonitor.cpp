@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.thermal@2.0-service-mock"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+#include <cutils/uevent.h>
+
+#include "ThermalMonitor.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::base::ParseInt;
+using ::android::base::ReadFileToString;
+using ::android::base::Trim;
+
+namespace {
+
+constexpr size_t kUeventMsgLen = 2048;
+constexpr size_t kMaxTripPoints = 32;
+
+ThrottlingSeverity tripTypeToSeverity(const std::string& trip_type, bool* ok) {
+    *ok = true;
+    if (trip_type == "active") return ThrottlingSeverity::LIGHT;
+    if (trip_type == "passive") return ThrottlingSeverity::SEVERE;
+    if (trip_type == "hot") return ThrottlingSeverity::CRITICAL;
+    if (trip_type == "critical") return ThrottlingSeverity::SHUTDOWN;
+    *ok = false;
+    return ThrottlingSeverity::NONE;
+}
+
+TemperatureType zoneTypeToTemperatureType(const std::string& zone_type) {
+    if (zone_type.find("cpu") != std::string::npos) return TemperatureType::CPU;
+    if (zone_type.find("gpu") != std::string::npos) return TemperatureType::GPU;
+    if (zone_type.find("battery") != std::string::npos) return TemperatureType::BATTERY;
+    if (zone_type.find("skin") != std::string::npos) return TemperatureType::SKIN;
+    return TemperatureType::UNKNOWN;
+}
+
+// Reads a millidegree Celsius value from a sysfs node and converts it to degrees Celsius.
+bool readMilliCelsius(const std::string& path, float* value) {
+    std::string content;
+    int milli;
+    if (!ReadFileToString(path, &content) || !ParseInt(Trim(content), &milli)) {
+        return false;
+    }
+    *value = milli / 1000.0f;
+    return true;
+}
+
+}  // namespace
+
+ThermalMonitor::ThermalMonitor(const NotifyCallback& notify) : notify_(notify) {}
+
+ThermalMonitor::~ThermalMonitor() {
+    if (thread_.joinable()) {
+        eventfd_write(stop_fd_, 1);
+        thread_.join();
+    }
+}
+
+bool ThermalMonitor::loadZone(const std::string& path, const std::string& dir_name, Zone* zone) {
+    std::string zone_type;
+    if (!ReadFileToString(path + "/type", &zone_type)) {
+        return false;
+    }
+    zone_type = Trim(zone_type);
+
+    zone->thresholds.fill(NAN);
+    zone->hysteresis.fill(kDefaultHysteresis);
+    bool has_trip = false;
+    for (size_t i = 0; i < kMaxTripPoints; ++i) {
+        std::string prefix = path + "/trip_point_" + std::to_string(i);
+        std::string trip_type;
+        float trip_temp;
+        if (!ReadFileToString(prefix + "_type", &trip_type)) break;
+        if (!readMilliCelsius(prefix + "_temp", &trip_temp)) continue;
+
+        bool ok;
+        size_t severity = static_cast<size_t>(tripTypeToSeverity(Trim(trip_type), &ok));
+        if (!ok) continue;
+        // Keep the lowest trip point of each severity.
+        if (!std::isnan(zone->thresholds[severity]) && zone->thresholds[severity] <= trip_temp) {
+            continue;
+        }
+        zone->thresholds[severity] = trip_temp;
+        float hyst;
+        if (readMilliCelsius(prefix + "_hyst", &hyst) && hyst > 0) {
+            zone->hysteresis[severity] = hyst;
+        }
+        has_trip = true;
+    }
+    if (!has_trip) {
+        return false;
+    }
+
+    zone->temp_fd.reset(TEMP_FAILURE_RETRY(open((path + "/temp").c_str(), O_RDONLY | O_CLOEXEC)));
+    if (zone->temp_fd < 0) {
+        PLOG(WARNING) << "Cannot open " << path << "/temp";
+        return false;
+    }
+
+    zone->dir_name = dir_name;
+    zone->temperature.type = zoneTypeToTemperatureType(zone_type);
+    zone->temperature.name = zone_type;
+    zone->temperature.value = NAN;
+    zone->temperature.throttlingStatus = ThrottlingSeverity::NONE;
+    return true;
+}
+
+bool ThermalMonitor::start(const std::string& thermal_root) {
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(thermal_root.c_str()), closedir);
+    if (dir == nullptr) {
+        PLOG(WARNING) << "Cannot open " << thermal_root;
+        return false;
+    }
+    while (struct dirent* entry = readdir(dir.get())) {
+        std::string name = entry->d_name;
+        if (!android::base::StartsWith(name, "thermal_zone")) continue;
+        Zone zone;
+        if (loadZone(thermal_root + "/" + name, name, &zone)) {
+            zones_.push_back(std::move(zone));
+        }
+    }
+    if (zones_.empty()) {
+        LOG(INFO) << "No thermal zone with trip points under " << thermal_root;
+        return false;
+    }
+
+    stop_fd_.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (stop_fd_ < 0) {
+        PLOG(ERROR) << "Cannot create stop eventfd";
+        zones_.clear();
+        return false;
+    }
+    uevent_fd_.reset(uevent_open_socket(64 * 1024, true));
+    if (uevent_fd_ < 0) {
+        // Polling alone still works, only slower to react far from the trip points.
+        LOG(WARNING) << "Cannot open uevent socket; thermal zones are polled only";
+    } else {
+        fcntl(uevent_fd_, F_SETFL, O_NONBLOCK);
+    }
+
+    LOG(INFO) << "Monitoring " << zones_.size() << " thermal zone(s)";
+    thread_ = std::thread(&ThermalMonitor::threadLoop, this);
+    return true;
+}
+
+bool ThermalMonitor::readZone(Zone* zone, std::chrono::steady_clock::time_point now) {
+    char buf[32];
+    ssize_t n = TEMP_FAILURE_RETRY(pread(zone->temp_fd, buf, sizeof(buf), 0));
+    int milli;
+    if (n <= 0 || !ParseInt(Trim(std::string(buf, n)), &milli)) {
+        LOG(WARNING) << "Cannot read temperature of " << zone->dir_name;
+        zone->next_read = now + kIdlePollInterval;
+        return false;
+    }
+    float temp = milli / 1000.0f;
+    zone->temperature.value = temp;
+
+    // Highest severity whose trip point has been reached, and highest severity still held by
+    // the hysteresis band below its trip point.
+    size_t hot = 0;
+    size_t held = 0;
+    for (size_t s = 1; s < kNumSeverities; ++s) {
+        if (std::isnan(zone->thresholds[s])) continue;
+        if (temp >= zone->thresholds[s]) hot = s;
+        if (temp >= zone->thresholds[s] - zone->hysteresis[s]) held = s;
+    }
+    size_t current = static_cast<size_t>(zone->temperature.throttlingStatus);
+    size_t next = std::max(hot, std::min(current, held));
+
+    bool near = next > 0;
+    for (size_t s = next + 1; s < kNumSeverities && !near; ++s) {
+        if (!std::isnan(zone->thresholds[s])) {
+            near = temp >= zone->thresholds[s] - kNearMargin;
+            break;
+        }
+    }
+    zone->next_read = now + (near ? kNearPollInterval : kIdlePollInterval);
+
+    if (next == current) return false;
+    zone->temperature.throttlingStatus = static_cast<ThrottlingSeverity>(next);
+    LOG(INFO) << zone->dir_name << " (" << zone->temperature.name << ") at " << temp
+              << "C: throttling " << toString(static_cast<ThrottlingSeverity>(current)) << " -> "
+              << toString(zone->temperature.throttlingStatus);
+    return true;
+}
+
+void ThermalMonitor::handleUevents(std::chrono::steady_clock::time_point now) {
+    char msg[kUeventMsgLen + 2];
+    ssize_t n;
+    while ((n = uevent_kernel_multicast_recv(uevent_fd_, msg, kUeventMsgLen)) > 0) {
+        if (n >= static_cast<ssize_t>(kUeventMsgLen)) continue;  // overflow -- discard
+        msg[n] = '\0';
+        msg[n + 1] = '\0';
+
+        bool thermal = false;
+        std::string dev_name;
+        for (const char* cp = msg; *cp; cp += strlen(cp) + 1) {
+            if (!strcmp(cp, "SUBSYSTEM=thermal")) {
+                thermal = true;
+            } else if (!strncmp(cp, "DEVPATH=", strlen("DEVPATH="))) {
+                const char* slash = strrchr(cp, '/');
+                dev_name = slash ? slash + 1 : cp + strlen("DEVPATH=");
+            }
+        }
+        if (!thermal) continue;
+        for (auto& zone : zones_) {
+            if (zone.dir_name == dev_name) zone.next_read = now;
+        }
+    }
+}
+
+void ThermalMonitor::threadLoop() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto& zone : zones_) zone.next_read = now;
+
+    while (true) {
+        now = std::chrono::steady_clock::now();
+        for (auto& zone : zones_) {
+            if (zone.next_read <= now && readZone(&zone, now)) {
+                notify_(zone.temperature);
+            }
+        }
+
+        auto next_read = std::min_element(zones_.begin(), zones_.end(),
+                                          [](const Zone& a, const Zone& b) {
+                                              return a.next_read < b.next_read;
+                                          })
+                                 ->next_read;
+        auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_read - std::chrono::steady_clock::now());
+
+        struct pollfd fds[2] = {
+                {stop_fd_.get(), POLLIN, 0},
+                {uevent_fd_.get(), POLLIN, 0},
+        };
+        int ret = TEMP_FAILURE_RETRY(poll(fds, uevent_fd_ >= 0 ? 2 : 1,
+                                          std::max<int>(0, static_cast<int>(timeout.count()))));
+        if (ret < 0) {
+            PLOG(ERROR) << "poll failed; stop monitoring thermal zones";
+            return;
+        }
+        if (fds[0].revents & POLLIN) return;
+        if (uevent_fd_ >= 0 && (fds[1].revents & POLLIN)) {
+            handleUevents(std::chrono::steady_clock::now());
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
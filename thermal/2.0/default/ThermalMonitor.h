@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
+#define ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <android/hardware/thermal/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+
+using Temperature_2_0 = ::android::hardware::thermal::V2_0::Temperature;
+
+// Watches the trip points of the sysfs thermal zones and reports throttling severity changes.
+//
+// Zones are re-read when the kernel sends a thermal uevent for them. Besides that, zones close
+// to a trip point (or already throttling) are polled every kNearPollInterval and all other zones
+// every kIdlePollInterval. A zone only drops to a lower severity once its temperature falls
+// below the trip point by the trip hysteresis.
+class ThermalMonitor {
+   public:
+    using NotifyCallback = std::function<void(const Temperature_2_0&)>;
+
+    static constexpr std::chrono::milliseconds kNearPollInterval{1000};
+    static constexpr std::chrono::milliseconds kIdlePollInterval{30000};
+    // A zone within this many degrees Celsius of its next trip point counts as near.
+    static constexpr float kNearMargin = 5.0;
+    // Used for trip points that do not report a hysteresis.
+    static constexpr float kDefaultHysteresis = 2.0;
+
+    explicit ThermalMonitor(const NotifyCallback& notify);
+    ~ThermalMonitor();
+
+    // Starts monitoring the thermal zones under thermal_root. Returns false if no zone has
+    // usable trip points, in which case nothing is monitored.
+    bool start(const std::string& thermal_root = "/sys/class/thermal");
+
+   private:
+    static constexpr size_t kNumSeverities = static_cast<size_t>(ThrottlingSeverity::SHUTDOWN) + 1;
+
+    struct Zone {
+        std::string dir_name;  // e.g. thermal_zone0
+        Temperature_2_0 temperature;
+        android::base::unique_fd temp_fd;
+        // Trip temperatures and hysteresis in degrees Celsius, indexed by severity; NAN if the
+        // zone has no trip point for that severity.
+        std::array<float, kNumSeverities> thresholds;
+        std::array<float, kNumSeverities> hysteresis;
+        std::chrono::steady_clock::time_point next_read;
+    };
+
+    bool loadZone(const std::string& path, const std::string& dir_name, Zone* zone);
+    // Reads the zone temperature and schedules the next read. Returns true if the throttling
+    // severity changed.
+    bool readZone(Zone* zone, std::chrono::steady_clock::time_point now);
+    // Marks the zones named in the pending thermal uevents for an immediate read.
+    void handleUevents(std::chrono::steady_clock::time_point now);
+    void threadLoop();
+
+    NotifyCallback notify_;
+    std::vector<Zone> zones_;
+    android::base::unique_fd uevent_fd_;
+    android::base::unique_fd stop_fd_;
+    std::thread thread_;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_THERMAL_V2_0_THERMAL_MONITOR_H
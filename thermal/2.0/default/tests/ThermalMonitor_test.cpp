@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "ThermalMonitor.h"
+
+namespace android {
+namespace hardware {
+namespace thermal {
+namespace V2_0 {
+namespace implementation {
+namespace {
+
+using ::android::base::WriteStringToFile;
+
+constexpr std::chrono::seconds kTimeout(5);
+
+// Records the temperatures reported by the monitor
+class Recorder {
+   public:
+    void onNotify(const Temperature_2_0& temperature) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mTemperatures.push_back(temperature);
+        mCond.notify_all();
+    }
+
+    std::vector<Temperature_2_0> waitFor(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        EXPECT_TRUE(mCond.wait_for(lock, kTimeout, [&] { return mTemperatures.size() >= count; }));
+        return mTemperatures;
+    }
+
+    std::vector<Temperature_2_0> temperatures() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mTemperatures;
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<Temperature_2_0> mTemperatures;
+};
+
+// A fake /sys/class/thermal. Temperatures are in millidegrees Celsius, as in sysfs.
+class ThermalMonitorTest : public ::testing::Test {
+   protected:
+    std::string addZone(const std::string& name, const std::string& type, int temp) {
+        std::string path = std::string(mRoot.path) + "/" + name;
+        EXPECT_EQ(0, mkdir(path.c_str(), 0755));
+        EXPECT_TRUE(WriteStringToFile(type + "\n", path + "/type"));
+        setTemperature(name, temp);
+        return path;
+    }
+
+    void addTripPoint(const std::string& name, int index, const std::string& type, int temp,
+                      int hyst = -1) {
+        std::string prefix = std::string(mRoot.path) + "/" + name + "/trip_point_" +
+                             std::to_string(index);
+        EXPECT_TRUE(WriteStringToFile(type + "\n", prefix + "_type"));
+        EXPECT_TRUE(WriteStringToFile(std::to_string(temp) + "\n", prefix + "_temp"));
+        if (hyst >= 0) {
+            EXPECT_TRUE(WriteStringToFile(std::to_string(hyst) + "\n", prefix + "_hyst"));
+        }
+    }
+
+    // Rewrites the file in place, as the monitor keeps it open
+    void setTemperature(const std::string& name, int temp) {
+        EXPECT_TRUE(WriteStringToFile(std::to_string(temp) + "\n",
+                                      std::string(mRoot.path) + "/" + name + "/temp"));
+    }
+
+    bool start() { return mMonitor.start(mRoot.path); }
+
+    TemporaryDir mRoot;
+    Recorder mRecorder;
+    ThermalMonitor mMonitor{[this](const Temperature_2_0& t) { mRecorder.onNotify(t); }};
+};
+
+TEST_F(ThermalMonitorTest, ReportsTheSeverityOfTheLowestTripPointOfEachType) {
+    addZone("thermal_zone0", "cpu-0", 42000);
+    addTripPoint("thermal_zone0", 0, "active", 45000);
+    addTripPoint("thermal_zone0", 1, "active", 40000);
+    addTripPoint("thermal_zone0", 2, "fan", 30000);
+    addTripPoint("thermal_zone0", 3, "passive", 60000);
+    ASSERT_TRUE(start());
+
+    auto temperatures = mRecorder.waitFor(1);
+    ASSERT_EQ(1u, temperatures.size());
+    EXPECT_EQ(TemperatureType::CPU, temperatures[0].type);
+    EXPECT_EQ("cpu-0", std::string(temperatures[0].name));
+    EXPECT_FLOAT_EQ(42.0f, temperatures[0].value);
+    EXPECT_EQ(ThrottlingSeverity::LIGHT, temperatures[0].throttlingStatus);
+}
+
+TEST_F(ThermalMonitorTest, GoesUpAtTheTripPointAndDownBelowTheHysteresis) {
+    addZone("thermal_zone0", "skin", 56000);
+    addTripPoint("thermal_zone0", 0, "passive", 60000, 5000);
+    addTripPoint("thermal_zone0", 1, "critical", 90000);
+    // Near the trip point, so polled every kNearPollInterval
+    ASSERT_TRUE(start());
+
+    setTemperature("thermal_zone0", 61000);
+    auto temperatures = mRecorder.waitFor(1);
+    ASSERT_EQ(1u, temperatures.size());
+    EXPECT_EQ(TemperatureType::SKIN, temperatures[0].type);
+    EXPECT_EQ(ThrottlingSeverity::SEVERE, temperatures[0].throttlingStatus);
+
+    // Below the trip point, but within its hysteresis band
+    setTemperature("thermal_zone0", 57000);
+    std::this_thread::sleep_for(ThermalMonitor::kNearPollInterval * 5 / 2);
+    EXPECT_EQ(1u, mRecorder.temperatures().size());
+
+    setTemperature("thermal_zone0", 54000);
+    temperatures = mRecorder.waitFor(2);
+    ASSERT_EQ(2u, temperatures.size());
+    EXPECT_EQ(ThrottlingSeverity::NONE, temperatures[1].throttlingStatus);
+    EXPECT_FLOAT_EQ(54.0f, temperatures[1].value);
+}
+
+TEST_F(ThermalMonitorTest, StepsThroughTheSeverities) {
+    addZone("thermal_zone0", "gpu", 50000);
+    addTripPoint("thermal_zone0", 0, "active", 50000);
+    addTripPoint("thermal_zone0", 1, "passive", 60000);
+    addTripPoint("thermal_zone0", 2, "hot", 70000);
+    ASSERT_TRUE(start());
+    ASSERT_EQ(ThrottlingSeverity::LIGHT, mRecorder.waitFor(1).back().throttlingStatus);
+
+    setTemperature("thermal_zone0", 72000);
+    ASSERT_EQ(ThrottlingSeverity::CRITICAL, mRecorder.waitFor(2).back().throttlingStatus);
+
+    // Within the default hysteresis of the hot trip point only
+    setTemperature("thermal_zone0", 65000);
+    ASSERT_EQ(ThrottlingSeverity::SEVERE, mRecorder.waitFor(3).back().throttlingStatus);
+}
+
+TEST_F(ThermalMonitorTest, StartFailsWithoutUsableTripPoints) {
+    addZone("thermal_zone0", "cpu", 40000);
+    addTripPoint("thermal_zone0", 0, "fan", 30000);
+    addZone("thermal_zone1", "battery", 30000);
+    // Not a thermal zone
+    addZone("cooling_device0", "fan", 0);
+    addTripPoint("cooling_device0", 0, "passive", 60000);
+
+    EXPECT_FALSE(start());
+}
+
+TEST_F(ThermalMonitorTest, StartFailsWithoutTheThermalRoot) {
+    EXPECT_FALSE(mMonitor.start(std::string(mRoot.path) + "/missing"));
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace thermal
+}  // namespace hardware
+}  // namespace android
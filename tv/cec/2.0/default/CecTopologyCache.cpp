@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.cec@2.0-impl"
+#include <android-base/logging.h>
+
+#include <string>
+
+#include "CecTopologyCache.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+
+// Physical address of a device that has not reported one yet.
+static constexpr CecPhysicalAddress kUnknownPhysicalAddress = 0xFFFF;
+
+bool CecTopologyCache::onMessage(const CecMessage& message, CecTopologyEvent* event) {
+    const hidl_vec<uint8_t>& body = message.body;
+    if (body.size() == 0 || message.initiator == CecLogicalAddress::UNREGISTERED ||
+        message.initiator == CecLogicalAddress::BROADCAST) {
+        return false;
+    }
+    auto opcode = static_cast<CecMessageType>(body[0]);
+    // Shortest body of each message, opcode included
+    size_t minSize;
+    switch (opcode) {
+        case CecMessageType::REPORT_PHYSICAL_ADDRESS:
+        case CecMessageType::DEVICE_VENDOR_ID:
+            minSize = 4;
+            break;
+        case CecMessageType::SET_OSD_NAME:
+            minSize = 1;
+            break;
+        case CecMessageType::CEC_VERSION:
+        case CecMessageType::REPORT_POWER_STATUS:
+            minSize = 2;
+            break;
+        default:
+            return false;
+    }
+    // A truncated message says nothing about the device, not even that it's there
+    if (body.size() < minSize) return false;
+
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mDevices.find(message.initiator);
+    if (it == mDevices.end()) {
+        CecDeviceInfo info = {};
+        info.logicalAddress = message.initiator;
+        info.physicalAddress = kUnknownPhysicalAddress;
+        info.powerState = CecPowerState::UNKNOWN;
+        it = mDevices.emplace(message.initiator, info).first;
+    }
+    CecDeviceInfo& info = it->second;
+
+    switch (opcode) {
+        case CecMessageType::REPORT_PHYSICAL_ADDRESS: {
+            auto physicalAddress = static_cast<CecPhysicalAddress>((body[1] << 8) | body[2]);
+            info.devceType = static_cast<CecDeviceType>(body[3]);
+            if (physicalAddress == info.physicalAddress) return false;
+            event->eventType = info.physicalAddress == kUnknownPhysicalAddress
+                                       ? CecTopologyEventType::DEVICE_ADDED
+                                       : CecTopologyEventType::DEVICE_UPDATED;
+            event->logicalAddress = message.initiator;
+            event->physicalAddress = physicalAddress;
+            event->isHostDevice = false;
+            info.physicalAddress = physicalAddress;
+            return true;
+        }
+        case CecMessageType::DEVICE_VENDOR_ID:
+            info.vendorId = (body[1] << 16) | (body[2] << 8) | body[3];
+            return false;
+        case CecMessageType::SET_OSD_NAME:
+            info.osdName =
+                    std::string(reinterpret_cast<const char*>(body.data()) + 1, body.size() - 1);
+            return false;
+        case CecMessageType::CEC_VERSION:
+            info.version = static_cast<CecVersion>(body[1]);
+            return false;
+        case CecMessageType::REPORT_POWER_STATUS:
+            info.powerState = static_cast<CecPowerState>(body[1]);
+            return false;
+        default:
+            return false;
+    }
+}
+
+std::vector<CecTopologyEvent> CecTopologyCache::onHotplug() {
+    std::vector<CecTopologyEvent> events;
+    std::lock_guard<std::mutex> lock(mLock);
+    for (const auto& device : mDevices) {
+        if (device.second.physicalAddress == kUnknownPhysicalAddress) continue;
+        events.push_back({.eventType = CecTopologyEventType::DEVICE_REMOVED,
+                          .logicalAddress = device.first,
+                          .physicalAddress = device.second.physicalAddress,
+                          .isHostDevice = false});
+    }
+    mDevices.clear();
+    mPortInfoValid = false;
+    mPortInfos.resize(0);
+    return events;
+}
+
+bool CecTopologyCache::getDeviceInfo(CecLogicalAddress logicalAddress, CecDeviceInfo* info) {
+    std::lock_guard<std::mutex> lock(mLock);
+    auto it = mDevices.find(logicalAddress);
+    if (it == mDevices.end()) return false;
+    *info = it->second;
+    return true;
+}
+
+bool CecTopologyCache::getPortInfo(hidl_vec<HdmiPortInfo>* portInfos) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mPortInfoValid) return false;
+    *portInfos = mPortInfos;
+    return true;
+}
+
+void CecTopologyCache::setPortInfo(const hidl_vec<HdmiPortInfo>& portInfos) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mPortInfos = portInfos;
+    mPortInfoValid = true;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_CEC_V2_0_CECTOPOLOGYCACHE_H
+#define ANDROID_HARDWARE_TV_CEC_V2_0_CECTOPOLOGYCACHE_H
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <android/hardware/tv/cec/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::tv::cec::V2_0::CecDeviceInfo;
+using ::android::hardware::tv::cec::V2_0::CecLogicalAddress;
+using ::android::hardware::tv::cec::V2_0::CecMessage;
+using ::android::hardware::tv::cec::V2_0::CecPhysicalAddress;
+using ::android::hardware::tv::cec::V2_0::CecTopologyEvent;
+using ::android::hardware::tv::cec::V2_0::HdmiPortInfo;
+
+/**
+ * Device information of the CEC network, built from the messages other devices broadcast
+ * or answer with: REPORT_PHYSICAL_ADDRESS, DEVICE_VENDOR_ID, SET_OSD_NAME, CEC_VERSION and
+ * REPORT_POWER_STATUS. Also keeps the port information of the driver. Everything is dropped
+ * on hotplug, since the topology may have changed.
+ *
+ * Message bodies start with the opcode, as exchanged with the legacy HAL.
+ */
+class CecTopologyCache {
+   public:
+    // Updates the cache from a received message. Returns true and fills *event if the message
+    // added a device or changed its physical address.
+    bool onMessage(const CecMessage& message, CecTopologyEvent* event);
+    // Returns the topology events for the devices dropped from the cache.
+    std::vector<CecTopologyEvent> onHotplug();
+
+    // Returns false if nothing is known about the device.
+    bool getDeviceInfo(CecLogicalAddress logicalAddress, CecDeviceInfo* info);
+
+    bool getPortInfo(hidl_vec<HdmiPortInfo>* portInfos);
+    void setPortInfo(const hidl_vec<HdmiPortInfo>& portInfos);
+
+   private:
+    std::mutex mLock;
+    std::map<CecLogicalAddress, CecDeviceInfo> mDevices;
+    bool mPortInfoValid = false;
+    hidl_vec<HdmiPortInfo> mPortInfos;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_CEC_V2_0_CECTOPOLOGYCACHE_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "android.hardware.tv.cec@2.0-impl"
+#include <android-base/logging.h>
+
+#include <future>
+
+#include "CecTransmitQueue.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+
+CecTransmitQueue::CecTransmitQueue(const Sender& sender) : mSender(sender) {
+    mThread = std::thread(&CecTransmitQueue::threadLoop, this);
+}
+
+CecTransmitQueue::~CecTransmitQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mCond.notify_one();
+    mThread.join();
+}
+
+CecTransmitQueue::Priority CecTransmitQueue::priorityOf(const CecMessage& message) {
+    // A message without opcode is a polling message.
+    if (message.body.size() == 0) {
+        return Priority::POLLING;
+    }
+    switch (static_cast<CecMessageType>(message.body[0])) {
+        case CecMessageType::USER_CONTROL_PRESSED:
+        case CecMessageType::USER_CONTROL_RELEASED:
+        case CecMessageType::VENDOR_REMOTE_BUTTON_DOWN:
+        case CecMessageType::VENDOR_REMOTE_BUTTON_UP:
+            return Priority::USER_CONTROL;
+        default:
+            return Priority::NORMAL;
+    }
+}
+
+void CecTransmitQueue::enqueueLocked(Entry&& entry) {
+    mQueues[static_cast<int>(priorityOf(entry.message))].push_back(std::move(entry));
+}
+
+void CecTransmitQueue::submit(const CecMessage& message, const Completion& completion) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        enqueueLocked({message, completion, 0, std::chrono::steady_clock::time_point()});
+    }
+    mCond.notify_one();
+}
+
+SendMessageResult CecTransmitQueue::send(const CecMessage& message) {
+    std::promise<SendMessageResult> result;
+    std::future<SendMessageResult> future = result.get_future();
+    submit(message, [&result](SendMessageResult r) { result.set_value(r); });
+    return future.get();
+}
+
+bool CecTransmitQueue::takeReadyLocked(std::chrono::steady_clock::time_point now,
+                                       std::vector<Entry>* batch,
+                                       std::chrono::steady_clock::time_point* wakeUp) {
+    *wakeUp = std::chrono::steady_clock::time_point::max();
+    for (int priority = 0; priority < 3; ++priority) {
+        auto& queue = mQueues[priority];
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->notBefore > now) {
+                *wakeUp = std::min(*wakeUp, it->notBefore);
+                ++it;
+                continue;
+            }
+            batch->push_back(std::move(*it));
+            it = queue.erase(it);
+            // Only polling messages are batched; anything else goes alone so that a user
+            // control message queued meanwhile is next.
+            if (static_cast<Priority>(priority) != Priority::POLLING) {
+                return true;
+            }
+        }
+        if (!batch->empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CecTransmitQueue::threadLoop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExiting) {
+        std::vector<Entry> batch;
+        std::chrono::steady_clock::time_point wakeUp;
+        if (!takeReadyLocked(std::chrono::steady_clock::now(), &batch, &wakeUp)) {
+            if (wakeUp == std::chrono::steady_clock::time_point::max()) {
+                mCond.wait(lock);
+            } else {
+                mCond.wait_until(lock, wakeUp);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        std::vector<Entry> retries;
+        for (auto& entry : batch) {
+            SendMessageResult result = mSender(entry.message);
+            if (result == SendMessageResult::BUSY && entry.retries < kMaxBusyRetries) {
+                entry.retries++;
+                entry.notBefore = std::chrono::steady_clock::now() + kBusyRetryDelay;
+                retries.push_back(std::move(entry));
+                continue;
+            }
+            if (entry.completion) {
+                entry.completion(result);
+            }
+        }
+        lock.lock();
+
+        for (auto& entry : retries) {
+            LOG(DEBUG) << "CEC bus busy, retry " << entry.retries << " of " << kMaxBusyRetries;
+            enqueueLocked(std::move(entry));
+        }
+    }
+
+    // Fail whatever is still queued so that no caller waits forever.
+    for (auto& queue : mQueues) {
+        for (auto& entry : queue) {
+            if (entry.completion) {
+                entry.completion(SendMessageResult::FAIL);
+            }
+        }
+        queue.clear();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_TV_CEC_V2_0_CECTRANSMITQUEUE_H
+#define ANDROID_HARDWARE_TV_CEC_V2_0_CECTRANSMITQUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <android/hardware/tv/cec/2.0/types.h>
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+
+using ::android::hardware::tv::cec::V2_0::CecMessage;
+using ::android::hardware::tv::cec::V2_0::SendMessageResult;
+
+/**
+ * Serializes CEC transmissions on a worker thread.
+ *
+ * Messages are transmitted by priority, FIFO within a priority. All polling messages queued
+ * when the worker picks one are transmitted back to back in the same pass. A transmission
+ * that fails with BUSY (lost arbitration) is queued again after a short delay, up to
+ * kMaxBusyRetries times; the legacy HAL already retries NACKs itself.
+ */
+class CecTransmitQueue {
+   public:
+    enum class Priority { USER_CONTROL, NORMAL, POLLING };
+
+    using Sender = std::function<SendMessageResult(const CecMessage&)>;
+    using Completion = std::function<void(SendMessageResult)>;
+
+    static constexpr int kMaxBusyRetries = 2;
+    static constexpr std::chrono::milliseconds kBusyRetryDelay{50};
+
+    explicit CecTransmitQueue(const Sender& sender);
+    ~CecTransmitQueue();
+
+    static Priority priorityOf(const CecMessage& message);
+
+    // Queues message and returns; completion is called on the worker thread.
+    void submit(const CecMessage& message, const Completion& completion);
+    // Queues message and waits for its result.
+    SendMessageResult send(const CecMessage& message);
+
+   private:
+    struct Entry {
+        CecMessage message;
+        Completion completion;
+        int retries;
+        std::chrono::steady_clock::time_point notBefore;
+    };
+
+    void enqueueLocked(Entry&& entry);
+    // Moves the entries to transmit in the next pass to batch. Returns false if none is ready
+    // yet, and sets *wakeUp to when one will be.
+    bool takeReadyLocked(std::chrono::steady_clock::time_point now, std::vector<Entry>* batch,
+                         std::chrono::steady_clock::time_point* wakeUp);
+    void threadLoop();
+
+    Sender mSender;
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::deque<Entry> mQueues[3];
+    bool mExiting = false;
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+
+#endif  // ANDROID_HARDWARE_TV_CEC_V2_0_CECTRANSMITQUEUE_H
@@ -267,7 +267,10 @@ static_assert(HDMI_OPTION_SYSTEM_CEC_CONTROL == static_cast<int>(OptionKey::SYST
 
 sp<IHdmiCecCallback> HdmiCec::mCallback = nullptr;
 
-HdmiCec::HdmiCec(hdmi_cec_device_t* device) : mDevice(device) {}
+HdmiCec::HdmiCec(hdmi_cec_device_t* device)
+    : mDevice(device),
+      mTransmitQueue(std::make_unique<CecTransmitQueue>(
+              [this](const CecMessage& message) { return sendLegacyMessage(message); })) {}
 
 // Methods from ::android::hardware::tv::cec::V2_0::IHdmiCec follow.
 Return<Result> HdmiCec::addDeviceType(CecDeviceType deviceType) {
@@ -309,18 +312,21 @@ Return<void> HdmiCec::setRcProfile(CecDeviceType deviceType, const CecRcProfile&
 Return<void> HdmiCec::readDeviceInfo(CecLogicalAddress logicalAddress,
                                      CecPhysicalAddress physicalAddress,
                                      const readDeviceInfo_cb _hidl_cb) {
-    // TODO implement
-    CecDeviceInfo deviceInfo;
+    CecDeviceInfo deviceInfo = {};
 
-    if (logicalAddress == CecLogicalAddress::TV) {
+    if (logicalAddress >= CecLogicalAddress::UNREGISTERED) {
+        _hidl_cb(Result::FAILURE_INVALID_ARGS, deviceInfo);
+    } else if (!mTopologyCache.getDeviceInfo(logicalAddress, &deviceInfo) ||
+               deviceInfo.physicalAddress != physicalAddress) {
+        // Not reported by the device yet, or reported for another physical address.
+        _hidl_cb(Result::FAILURE_INVALID_STATE, CecDeviceInfo{});
+    } else {
         _hidl_cb(Result::SUCCESS, deviceInfo);
-        if (physicalAddress) {
-        }
     }
     return Void();
 }
 
-Return<SendMessageResult> HdmiCec::sendMessage(const CecMessage& message) {
+SendMessageResult HdmiCec::sendLegacyMessage(const CecMessage& message) {
     cec_message_t legacyMessage{
             .initiator = static_cast<cec_logical_address_t>(message.initiator),
             .destination = static_cast<cec_logical_address_t>(message.destination),
@@ -332,6 +338,20 @@ Return<SendMessageResult> HdmiCec::sendMessage(const CecMessage& message) {
     return static_cast<SendMessageResult>(mDevice->send_message(mDevice, &legacyMessage));
 }
 
+Return<SendMessageResult> HdmiCec::sendMessage(const CecMessage& message) {
+    return mTransmitQueue->send(message);
+}
+
+Return<void> HdmiCec::sendMessageAsync(const CecMessage& message, uint32_t sequence) {
+    mTransmitQueue->submit(message, [sequence](SendMessageResult result) {
+        sp<IHdmiCecCallback> callback = mCallback;
+        if (callback != nullptr) {
+            callback->onSendMessageResult(sequence, result);
+        }
+    });
+    return Void();
+}
+
 Return<void> HdmiCec::setCallback(const sp<IHdmiCecCallback>& callback) {
     if (mCallback != nullptr) {
         mCallback->unlinkToDeath(this);
@@ -341,7 +361,7 @@ Return<void> HdmiCec::setCallback(const sp<IHdmiCecCallback>& callback) {
     if (callback != nullptr) {
         mCallback = callback;
         mCallback->linkToDeath(this, 0 /*cookie*/);
-        mDevice->register_event_callback(mDevice, eventCallback, nullptr);
+        mDevice->register_event_callback(mDevice, eventCallback, this);
     }
     return Void();
 }
@@ -350,6 +370,10 @@ Return<void> HdmiCec::getPortInfo(getPortInfo_cb _hidl_cb) {
     struct hdmi_port_info* legacyPorts;
     int numPorts;
     hidl_vec<HdmiPortInfo> portInfos;
+    if (mTopologyCache.getPortInfo(&portInfos)) {
+        _hidl_cb(portInfos);
+        return Void();
+    }
     mDevice->get_port_info(mDevice, &legacyPorts, &numPorts);
     portInfos.resize(numPorts);
     for (int i = 0; i < numPorts; ++i) {
@@ -359,6 +383,7 @@ Return<void> HdmiCec::getPortInfo(getPortInfo_cb _hidl_cb) {
                         .arcSupported = legacyPorts[i].arc_supported != 0,
                         .physicalAddress = legacyPorts[i].physical_address};
     }
+    mTopologyCache.setPortInfo(portInfos);
     _hidl_cb(portInfos);
     return Void();
 }
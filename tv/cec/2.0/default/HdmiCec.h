@@ -18,6 +18,7 @@
 #define ANDROID_HARDWARE_TV_CEC_V2_0_HDMICEC_H
 
 #include <algorithm>
+#include <memory>
 
 #include <android/hardware/tv/cec/2.0/IHdmiCec.h>
 #include <hardware/hardware.h>
@@ -25,6 +26,9 @@
 #include <hidl/Status.h>
 
 #include <hidl/MQDescriptor.h>
+
+#include "CecTopologyCache.h"
+#include "CecTransmitQueue.h"
 namespace android {
 namespace hardware {
 namespace tv {
@@ -63,6 +67,7 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
                                 CecPhysicalAddress physicalAddress,
                                 const readDeviceInfo_cb _hidl_cb) override;
     Return<SendMessageResult> sendMessage(const CecMessage& message) override;
+    Return<void> sendMessageAsync(const CecMessage& message, uint32_t sequence) override;
     Return<void> setCallback(const sp<IHdmiCecCallback>& callback) override;
     Return<void> getPortInfo(getPortInfo_cb _hidl_cb) override;
     Return<void> setOption(OptionKey key, bool value) override;
@@ -70,7 +75,8 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     Return<void> enableAudioReturnChannel(HdmiPortId portId, bool enable) override;
     Return<bool> isConnected(HdmiPortId portId) override;
 
-    static void eventCallback(const hdmi_event_t* event, void* /* arg */) {
+    static void eventCallback(const hdmi_event_t* event, void* arg) {
+        HdmiCec* hdmiCec = static_cast<HdmiCec*>(arg);
         if (mCallback != nullptr && event != nullptr) {
             if (event->type == HDMI_EVENT_CEC_MESSAGE) {
                 size_t length =
@@ -83,12 +89,24 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
                 for (size_t i = 0; i < length; ++i) {
                     cecMessage.body[i] = static_cast<uint8_t>(event->cec.body[i]);
                 }
+                CecTopologyEvent topologyEvent;
+                bool topologyChanged =
+                        hdmiCec != nullptr &&
+                        hdmiCec->mTopologyCache.onMessage(cecMessage, &topologyEvent);
                 mCallback->onCecMessage(cecMessage);
+                if (topologyChanged) {
+                    mCallback->onTopologyEvent(topologyEvent);
+                }
             } else if (event->type == HDMI_EVENT_HOT_PLUG) {
                 HotplugEvent hotplugEvent{
                         .connected = event->hotplug.connected > 0,
                         .portId = static_cast<HdmiPortId>(event->hotplug.port_id)};
                 mCallback->onHotplugEvent(hotplugEvent);
+                if (hdmiCec != nullptr) {
+                    for (const auto& topologyEvent : hdmiCec->mTopologyCache.onHotplug()) {
+                        mCallback->onTopologyEvent(topologyEvent);
+                    }
+                }
             }
         }
     }
@@ -99,8 +117,12 @@ struct HdmiCec : public IHdmiCec, public hidl_death_recipient {
     }
 
    private:
+    SendMessageResult sendLegacyMessage(const CecMessage& message);
+
     static sp<IHdmiCecCallback> mCallback;
     const hdmi_cec_device_t* mDevice;
+    CecTopologyCache mTopologyCache;
+    std::unique_ptr<CecTransmitQueue> mTransmitQueue;
 };
 
 extern "C" IHdmiCec* HIDL_FETCH_IHdmiCec(const char* name);
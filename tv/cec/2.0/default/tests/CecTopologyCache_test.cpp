@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "CecTopologyCache.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+namespace {
+
+CecMessage makeMessage(CecLogicalAddress initiator, CecMessageType opcode,
+                       std::vector<uint8_t> operands) {
+    CecMessage message;
+    message.initiator = initiator;
+    message.destination = CecLogicalAddress::BROADCAST;
+    operands.insert(operands.begin(), static_cast<uint8_t>(opcode));
+    message.body = operands;
+    return message;
+}
+
+CecMessage reportPhysicalAddress(CecLogicalAddress initiator, CecPhysicalAddress address) {
+    return makeMessage(initiator, CecMessageType::REPORT_PHYSICAL_ADDRESS,
+                       {static_cast<uint8_t>(address >> 8), static_cast<uint8_t>(address & 0xFF),
+                        static_cast<uint8_t>(CecDeviceType::PLAYBACK)});
+}
+
+void expectEvent(const CecTopologyEvent& event, CecTopologyEventType type,
+                 CecLogicalAddress logicalAddress, CecPhysicalAddress physicalAddress) {
+    EXPECT_EQ(type, event.eventType);
+    EXPECT_EQ(logicalAddress, event.logicalAddress);
+    EXPECT_EQ(physicalAddress, event.physicalAddress);
+    EXPECT_FALSE(event.isHostDevice);
+}
+
+TEST(CecTopologyCacheTest, ReportsAddedAndUpdatedDevices) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::PLAYBACK_1, 0x1000),
+                                &event));
+    expectEvent(event, CecTopologyEventType::DEVICE_ADDED, CecLogicalAddress::PLAYBACK_1, 0x1000);
+
+    // The same address again is not news
+    EXPECT_FALSE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::PLAYBACK_1, 0x1000),
+                                 &event));
+
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::PLAYBACK_1, 0x2000),
+                                &event));
+    expectEvent(event, CecTopologyEventType::DEVICE_UPDATED, CecLogicalAddress::PLAYBACK_1,
+                0x2000);
+
+    CecDeviceInfo info = {};
+    ASSERT_TRUE(cache.getDeviceInfo(CecLogicalAddress::PLAYBACK_1, &info));
+    EXPECT_EQ(CecLogicalAddress::PLAYBACK_1, info.logicalAddress);
+    EXPECT_EQ(0x2000, info.physicalAddress);
+    EXPECT_EQ(CecDeviceType::PLAYBACK, info.devceType);
+}
+
+TEST(CecTopologyCacheTest, AddsADeviceKnownBeforeItsAddress) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(CecLogicalAddress::TUNER_1, CecMessageType::CEC_VERSION,
+                        {static_cast<uint8_t>(CecVersion::V_2_0)}),
+            &event));
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::TUNER_1, 0x1100),
+                                &event));
+    expectEvent(event, CecTopologyEventType::DEVICE_ADDED, CecLogicalAddress::TUNER_1, 0x1100);
+}
+
+TEST(CecTopologyCacheTest, KeepsTheReportedDeviceInfo) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+    const auto device = CecLogicalAddress::RECORDER_1;
+
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(device, CecMessageType::DEVICE_VENDOR_ID, {0x00, 0x80, 0x45}), &event));
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(device, CecMessageType::SET_OSD_NAME, {'R', 'e', 'c'}), &event));
+    EXPECT_FALSE(cache.onMessage(makeMessage(device, CecMessageType::CEC_VERSION,
+                                             {static_cast<uint8_t>(CecVersion::V_1_4)}),
+                                 &event));
+    EXPECT_FALSE(cache.onMessage(makeMessage(device, CecMessageType::REPORT_POWER_STATUS,
+                                             {static_cast<uint8_t>(CecPowerState::STANDBY)}),
+                                 &event));
+
+    CecDeviceInfo info = {};
+    ASSERT_TRUE(cache.getDeviceInfo(device, &info));
+    EXPECT_EQ(0x008045u, info.vendorId);
+    EXPECT_EQ("Rec", std::string(info.osdName));
+    EXPECT_EQ(CecVersion::V_1_4, info.version);
+    EXPECT_EQ(CecPowerState::STANDBY, info.powerState);
+    // Not reported yet
+    EXPECT_EQ(0xFFFF, info.physicalAddress);
+}
+
+TEST(CecTopologyCacheTest, RejectsShortBodies) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+    const auto device = CecLogicalAddress::PLAYBACK_2;
+
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(device, CecMessageType::REPORT_PHYSICAL_ADDRESS, {0x10, 0x00}), &event));
+    EXPECT_FALSE(
+            cache.onMessage(makeMessage(device, CecMessageType::DEVICE_VENDOR_ID, {0x00}), &event));
+    EXPECT_FALSE(cache.onMessage(makeMessage(device, CecMessageType::CEC_VERSION, {}), &event));
+    EXPECT_FALSE(
+            cache.onMessage(makeMessage(device, CecMessageType::REPORT_POWER_STATUS, {}), &event));
+    CecMessage empty = makeMessage(device, CecMessageType::CEC_VERSION, {});
+    empty.body.resize(0);
+    EXPECT_FALSE(cache.onMessage(empty, &event));
+
+    // None of them made the device known
+    CecDeviceInfo info = {};
+    EXPECT_FALSE(cache.getDeviceInfo(device, &info));
+}
+
+TEST(CecTopologyCacheTest, IgnoresUnrelatedMessagesAndUnregisteredInitiators) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(CecLogicalAddress::PLAYBACK_1, CecMessageType::GIVE_PHYSICAL_ADDRESS, {}),
+            &event));
+    EXPECT_FALSE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::UNREGISTERED, 0x1000),
+                                 &event));
+
+    CecDeviceInfo info = {};
+    EXPECT_FALSE(cache.getDeviceInfo(CecLogicalAddress::PLAYBACK_1, &info));
+    EXPECT_FALSE(cache.getDeviceInfo(CecLogicalAddress::UNREGISTERED, &info));
+}
+
+TEST(CecTopologyCacheTest, HotplugRemovesTheDevicesWithAnAddress) {
+    CecTopologyCache cache;
+    CecTopologyEvent event = {};
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::PLAYBACK_1, 0x1000),
+                                &event));
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::TUNER_1, 0x2000),
+                                &event));
+    // Known, but without an address, so never reported as added
+    EXPECT_FALSE(cache.onMessage(
+            makeMessage(CecLogicalAddress::RECORDER_1, CecMessageType::REPORT_POWER_STATUS,
+                        {static_cast<uint8_t>(CecPowerState::ON)}),
+            &event));
+    cache.setPortInfo(hidl_vec<HdmiPortInfo>(1));
+
+    auto events = cache.onHotplug();
+    ASSERT_EQ(2u, events.size());
+    expectEvent(events[0], CecTopologyEventType::DEVICE_REMOVED, CecLogicalAddress::TUNER_1,
+                0x2000);
+    expectEvent(events[1], CecTopologyEventType::DEVICE_REMOVED, CecLogicalAddress::PLAYBACK_1,
+                0x1000);
+
+    CecDeviceInfo info = {};
+    EXPECT_FALSE(cache.getDeviceInfo(CecLogicalAddress::PLAYBACK_1, &info));
+    EXPECT_FALSE(cache.getDeviceInfo(CecLogicalAddress::RECORDER_1, &info));
+    hidl_vec<HdmiPortInfo> portInfos;
+    EXPECT_FALSE(cache.getPortInfo(&portInfos));
+    EXPECT_TRUE(cache.onHotplug().empty());
+
+    // Devices reporting again are added back
+    ASSERT_TRUE(cache.onMessage(reportPhysicalAddress(CecLogicalAddress::PLAYBACK_1, 0x1000),
+                                &event));
+    EXPECT_EQ(CecTopologyEventType::DEVICE_ADDED, event.eventType);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
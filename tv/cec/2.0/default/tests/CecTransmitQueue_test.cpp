@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "CecTransmitQueue.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace cec {
+namespace V2_0 {
+namespace implementation {
+namespace {
+
+constexpr std::chrono::seconds kTimeout(5);
+
+// The messages are told apart by their destination
+CecMessage makeMessage(CecLogicalAddress destination, std::vector<uint8_t> body) {
+    CecMessage message;
+    message.initiator = CecLogicalAddress::TV;
+    message.destination = destination;
+    message.body = body;
+    return message;
+}
+
+CecMessage userControl(CecLogicalAddress destination) {
+    return makeMessage(destination,
+                       {static_cast<uint8_t>(CecMessageType::USER_CONTROL_PRESSED), 0x41});
+}
+
+CecMessage normal(CecLogicalAddress destination) {
+    return makeMessage(destination, {static_cast<uint8_t>(CecMessageType::GIVE_PHYSICAL_ADDRESS)});
+}
+
+CecMessage polling(CecLogicalAddress destination) {
+    return makeMessage(destination, {});
+}
+
+// Records the destination of each transmission. The first one is held until release(), so
+// that the messages queued meanwhile are all waiting when the worker picks the next one.
+class FakeBus {
+   public:
+    SendMessageResult send(const CecMessage& message) {
+        std::function<void()> onSend;
+        SendMessageResult result = SendMessageResult::SUCCESS;
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mSent.push_back(message.destination);
+            mCond.notify_all();
+            mCond.wait(lock, [this] { return mReleased; });
+            auto busy = mBusyCount.find(message.destination);
+            if (busy != mBusyCount.end() && busy->second > 0) {
+                busy->second--;
+                result = SendMessageResult::BUSY;
+            }
+            std::swap(onSend, mOnSend[message.destination]);
+        }
+        if (onSend) {
+            onSend();
+        }
+        return result;
+    }
+
+    void waitForSends(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        ASSERT_TRUE(mCond.wait_for(lock, kTimeout, [&] { return mSent.size() >= count; }));
+    }
+
+    void release() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mReleased = true;
+        mCond.notify_all();
+    }
+
+    // The next count transmissions to destination fail with BUSY.
+    void setBusy(CecLogicalAddress destination, int count) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mBusyCount[destination] = count;
+    }
+
+    // Runs onSend on the worker thread once the transmission to destination is done.
+    void onSend(CecLogicalAddress destination, const std::function<void()>& onSend) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mOnSend[destination] = onSend;
+    }
+
+    std::vector<CecLogicalAddress> sent() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mSent;
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    bool mReleased = false;
+    std::vector<CecLogicalAddress> mSent;
+    std::map<CecLogicalAddress, int> mBusyCount;
+    std::map<CecLogicalAddress, std::function<void()>> mOnSend;
+};
+
+// Collects the results of the submitted messages by destination.
+class Results {
+   public:
+    CecTransmitQueue::Completion forMessage(CecLogicalAddress destination) {
+        return [this, destination](SendMessageResult result) {
+            std::lock_guard<std::mutex> lock(mLock);
+            mResults[destination] = result;
+            mCond.notify_all();
+        };
+    }
+
+    void waitFor(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        ASSERT_TRUE(mCond.wait_for(lock, kTimeout, [&] { return mResults.size() >= count; }));
+    }
+
+    SendMessageResult get(CecLogicalAddress destination) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mResults.at(destination);
+    }
+
+   private:
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::map<CecLogicalAddress, SendMessageResult> mResults;
+};
+
+class CecTransmitQueueTest : public ::testing::Test {
+   protected:
+    CecTransmitQueueTest()
+        : mQueue([this](const CecMessage& message) { return mBus.send(message); }) {}
+
+    // Submits a message and waits for the worker to hold it in the bus.
+    void blockBus() {
+        mQueue.submit(normal(CecLogicalAddress::BROADCAST),
+                      mResults.forMessage(CecLogicalAddress::BROADCAST));
+        mBus.waitForSends(1);
+    }
+
+    void submit(const CecMessage& message) {
+        mQueue.submit(message, mResults.forMessage(message.destination));
+    }
+
+    FakeBus mBus;
+    Results mResults;
+    CecTransmitQueue mQueue;
+};
+
+TEST(CecTransmitQueuePriorityTest, PriorityOf) {
+    EXPECT_EQ(CecTransmitQueue::Priority::USER_CONTROL,
+              CecTransmitQueue::priorityOf(userControl(CecLogicalAddress::PLAYBACK_1)));
+    EXPECT_EQ(CecTransmitQueue::Priority::NORMAL,
+              CecTransmitQueue::priorityOf(normal(CecLogicalAddress::PLAYBACK_1)));
+    EXPECT_EQ(CecTransmitQueue::Priority::POLLING,
+              CecTransmitQueue::priorityOf(polling(CecLogicalAddress::PLAYBACK_1)));
+}
+
+TEST_F(CecTransmitQueueTest, TransmitsByPriorityThenInOrder) {
+    blockBus();
+    submit(polling(CecLogicalAddress::PLAYBACK_1));
+    submit(normal(CecLogicalAddress::RECORDER_1));
+    submit(userControl(CecLogicalAddress::TUNER_1));
+    submit(normal(CecLogicalAddress::RECORDER_2));
+    submit(polling(CecLogicalAddress::PLAYBACK_2));
+    submit(userControl(CecLogicalAddress::TUNER_2));
+    mBus.release();
+    mResults.waitFor(7);
+
+    std::vector<CecLogicalAddress> expected = {
+            CecLogicalAddress::BROADCAST, CecLogicalAddress::TUNER_1,
+            CecLogicalAddress::TUNER_2,   CecLogicalAddress::RECORDER_1,
+            CecLogicalAddress::RECORDER_2, CecLogicalAddress::PLAYBACK_1,
+            CecLogicalAddress::PLAYBACK_2};
+    EXPECT_EQ(expected, mBus.sent());
+    EXPECT_EQ(SendMessageResult::SUCCESS, mResults.get(CecLogicalAddress::PLAYBACK_2));
+}
+
+TEST_F(CecTransmitQueueTest, BatchesQueuedPollingMessages) {
+    blockBus();
+    submit(polling(CecLogicalAddress::PLAYBACK_1));
+    submit(polling(CecLogicalAddress::PLAYBACK_2));
+    // Queued while the first polling message is on the bus, so after the whole batch
+    mBus.onSend(CecLogicalAddress::PLAYBACK_1,
+                [this] { submit(userControl(CecLogicalAddress::TUNER_1)); });
+    mBus.release();
+    mResults.waitFor(4);
+
+    std::vector<CecLogicalAddress> expected = {
+            CecLogicalAddress::BROADCAST, CecLogicalAddress::PLAYBACK_1,
+            CecLogicalAddress::PLAYBACK_2, CecLogicalAddress::TUNER_1};
+    EXPECT_EQ(expected, mBus.sent());
+}
+
+TEST_F(CecTransmitQueueTest, DoesNotBatchOtherMessages) {
+    blockBus();
+    submit(normal(CecLogicalAddress::RECORDER_1));
+    submit(normal(CecLogicalAddress::RECORDER_2));
+    // Queued while the first normal message is on the bus, so before the second one
+    mBus.onSend(CecLogicalAddress::RECORDER_1,
+                [this] { submit(userControl(CecLogicalAddress::TUNER_1)); });
+    mBus.release();
+    mResults.waitFor(4);
+
+    std::vector<CecLogicalAddress> expected = {
+            CecLogicalAddress::BROADCAST, CecLogicalAddress::RECORDER_1,
+            CecLogicalAddress::TUNER_1, CecLogicalAddress::RECORDER_2};
+    EXPECT_EQ(expected, mBus.sent());
+}
+
+TEST_F(CecTransmitQueueTest, RetriesWhenBusy) {
+    mBus.setBusy(CecLogicalAddress::PLAYBACK_1, CecTransmitQueue::kMaxBusyRetries);
+    mBus.release();
+    auto start = std::chrono::steady_clock::now();
+
+    EXPECT_EQ(SendMessageResult::SUCCESS, mQueue.send(normal(CecLogicalAddress::PLAYBACK_1)));
+    EXPECT_EQ(static_cast<size_t>(CecTransmitQueue::kMaxBusyRetries + 1), mBus.sent().size());
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              CecTransmitQueue::kMaxBusyRetries * CecTransmitQueue::kBusyRetryDelay);
+}
+
+TEST_F(CecTransmitQueueTest, ReportsBusyAfterTheLastRetry) {
+    mBus.setBusy(CecLogicalAddress::PLAYBACK_1, CecTransmitQueue::kMaxBusyRetries + 1);
+    mBus.release();
+
+    EXPECT_EQ(SendMessageResult::BUSY, mQueue.send(normal(CecLogicalAddress::PLAYBACK_1)));
+    EXPECT_EQ(static_cast<size_t>(CecTransmitQueue::kMaxBusyRetries + 1), mBus.sent().size());
+}
+
+TEST_F(CecTransmitQueueTest, RetryDoesNotHoldBackOtherMessages) {
+    mBus.setBusy(CecLogicalAddress::PLAYBACK_1, 1);
+    blockBus();
+    submit(normal(CecLogicalAddress::PLAYBACK_1));
+    submit(polling(CecLogicalAddress::PLAYBACK_2));
+    mBus.release();
+    mResults.waitFor(3);
+
+    // The polling message goes while the busy one waits for its retry
+    std::vector<CecLogicalAddress> expected = {
+            CecLogicalAddress::BROADCAST, CecLogicalAddress::PLAYBACK_1,
+            CecLogicalAddress::PLAYBACK_2, CecLogicalAddress::PLAYBACK_1};
+    EXPECT_EQ(expected, mBus.sent());
+    EXPECT_EQ(SendMessageResult::SUCCESS, mResults.get(CecLogicalAddress::PLAYBACK_1));
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace cec
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
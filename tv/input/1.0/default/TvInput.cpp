@@ -16,9 +16,16 @@
 
 #define LOG_TAG "android.hardware.tv.input@1.0-service"
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "TvInput.h"
 
+using ::android::base::StringAppendF;
+
 namespace android {
 namespace hardware {
 namespace tv {
@@ -59,12 +66,24 @@ static_assert(TV_INPUT_EVENT_STREAM_CONFIGURATIONS_CHANGED == static_cast<int>(
 
 sp<ITvInputCallback> TvInput::mCallback = nullptr;
 
-TvInput::TvInput(tv_input_device_t* device) : mDevice(device) {
+constexpr std::chrono::milliseconds TvInput::kWarmStreamTimeout;
+
+TvInput::TvInput(tv_input_device_t* device, std::chrono::milliseconds warmStreamTimeout)
+    : mDevice(device), mWarmStreamTimeout(warmStreamTimeout) {
     mCallbackOps.notify = &TvInput::notify;
 }
 
 TvInput::~TvInput() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mExiting = true;
+    }
+    mWarmCond.notify_one();
+    if (mWarmThread.joinable()) {
+        mWarmThread.join();
+    }
     if (mDevice != nullptr) {
+        closeWarmStreams(-1, StreamKey(-1, -1));
         free(mDevice);
     }
 }
@@ -73,12 +92,23 @@ TvInput::~TvInput() {
 Return<void> TvInput::setCallback(const sp<ITvInputCallback>& callback)  {
     mCallback = callback;
     if (mCallback != nullptr) {
-        mDevice->initialize(mDevice, &mCallbackOps, nullptr);
+        mDevice->initialize(mDevice, &mCallbackOps, this);
     }
     return Void();
 }
 
 Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigurations_cb cb)  {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mConfigCache.find(deviceId);
+        if (it != mConfigCache.end()) {
+            cb(Result::OK, it->second);
+            return Void();
+        }
+        generation = mConfigGeneration;
+    }
+
     int32_t configCount = 0;
     const tv_stream_config_t* configs = nullptr;
     int ret = mDevice->get_stream_configurations(mDevice, deviceId, &configCount, &configs);
@@ -96,6 +126,11 @@ Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigu
                 ++pos;
             }
         }
+        std::lock_guard<std::mutex> lock(mLock);
+        // A change notified during the query may not be reflected in the result.
+        if (mCallback != nullptr && generation == mConfigGeneration) {
+            mConfigCache[deviceId] = tvStreamConfigs;
+        }
     } else if (ret == -EINVAL) {
         res = Result::INVALID_ARGUMENTS;
     }
@@ -104,15 +139,43 @@ Return<void> TvInput::getStreamConfigurations(int32_t deviceId, getStreamConfigu
 }
 
 Return<void> TvInput::openStream(int32_t deviceId, int32_t streamId, openStream_cb cb)  {
+    auto start = std::chrono::steady_clock::now();
+    StreamKey key(deviceId, streamId);
+    // Switching to another stream of the device releases the ones kept warm.
+    closeWarmStreams(deviceId, key);
+    native_handle_t* warmSidebandStream = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mStreams.find(key);
+        if (it != mStreams.end() && it->second.warm) {
+            it->second.warm = false;
+            warmSidebandStream = it->second.sidebandStream;
+            recordSwitchLocked(deviceId, start, true);
+        }
+    }
+    if (warmSidebandStream != nullptr) {
+        cb(Result::OK, warmSidebandStream);
+        return Void();
+    }
+
     tv_stream_t stream;
     stream.stream_id = streamId;
     int ret = mDevice->open_stream(mDevice, deviceId, &stream);
+    if (ret == -EBUSY) {
+        // The hardware may be held by streams kept warm on other devices.
+        closeWarmStreams(-1, key);
+        stream.stream_id = streamId;
+        ret = mDevice->open_stream(mDevice, deviceId, &stream);
+    }
     Result res = Result::UNKNOWN;
     native_handle_t* sidebandStream = nullptr;
     if (ret == 0) {
         if (isSupportedStreamType(stream.type)) {
             res = Result::OK;
             sidebandStream = stream.sideband_stream_source_handle;
+            std::lock_guard<std::mutex> lock(mLock);
+            mStreams[key] = {sidebandStream, false};
+            recordSwitchLocked(deviceId, start, false);
         }
     } else {
         if (ret == -EBUSY) {
@@ -128,6 +191,35 @@ Return<void> TvInput::openStream(int32_t deviceId, int32_t streamId, openStream_
 }
 
 Return<Result> TvInput::closeStream(int32_t deviceId, int32_t streamId)  {
+    StreamKey key(deviceId, streamId);
+    bool keptWarm = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mStreams.find(key);
+        if (it != mStreams.end()) {
+            if (it->second.warm) {
+                // Already closed as far as the client is concerned.
+                return Result::INVALID_STATE;
+            }
+            if (mStaleDevices.count(deviceId) == 0) {
+                it->second.warm = true;
+                it->second.warmUntil = std::chrono::steady_clock::now() + mWarmStreamTimeout;
+                if (!mWarmThread.joinable()) {
+                    mWarmThread = std::thread(&TvInput::warmStreamLoop, this);
+                }
+                mWarmCond.notify_one();
+                keptWarm = true;
+            } else {
+                eraseStreamLocked(it);
+            }
+        }
+    }
+    if (keptWarm) {
+        // Only the latest closed stream is worth keeping: the one the user may switch back to.
+        closeWarmStreams(-1, key);
+        return Result::OK;
+    }
+
     int ret = mDevice->close_stream(mDevice, deviceId, streamId);
     Result res = Result::UNKNOWN;
     if (ret == 0) {
@@ -140,9 +232,148 @@ Return<Result> TvInput::closeStream(int32_t deviceId, int32_t streamId)  {
     return res;
 }
 
+Return<void> TvInput::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /* options */) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        return Void();
+    }
+    std::string out;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        StringAppendF(&out, "cached stream configurations: %zu devices\n", mConfigCache.size());
+        for (const auto& entry : mStreams) {
+            StringAppendF(&out, "stream %d/%d: %s\n", entry.first.first, entry.first.second,
+                          entry.second.warm ? "warm" : "open");
+        }
+        for (const auto& entry : mSwitchStats) {
+            const SwitchStats& stats = entry.second;
+            StringAppendF(&out,
+                          "device %d: %" PRIu64 " opens (%" PRIu64 " warm), last %lld us, "
+                          "mean %lld us, max %lld us\n",
+                          entry.first, stats.opens, stats.warmOpens,
+                          static_cast<long long>(stats.last.count()),
+                          static_cast<long long>(stats.total.count() / stats.opens),
+                          static_cast<long long>(stats.max.count()));
+        }
+    }
+    write(fd->data[0], out.c_str(), out.size());
+    return Void();
+}
+
+void TvInput::onStreamsChanged(int32_t deviceId) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mConfigCache.erase(deviceId);
+    mConfigGeneration++;
+    for (const auto& entry : mStreams) {
+        if (entry.first.first == deviceId) {
+            mStaleDevices.insert(deviceId);
+            break;
+        }
+    }
+}
+
+void TvInput::closeWarmStreams(int32_t deviceId, const StreamKey& keep) {
+    std::vector<StreamKey> toClose;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto it = mStreams.begin(); it != mStreams.end();) {
+            int32_t device = it->first.first;
+            bool close = it->second.warm &&
+                         (mStaleDevices.count(device) != 0 ||
+                          (it->first != keep && (deviceId == -1 || device == deviceId)));
+            if (close) {
+                toClose.push_back(it->first);
+                it = eraseStreamLocked(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    closeLegacyStreams(toClose);
+}
+
+void TvInput::closeLegacyStreams(const std::vector<StreamKey>& keys) {
+    for (const StreamKey& key : keys) {
+        int ret = mDevice->close_stream(mDevice, key.first, key.second);
+        if (ret != 0) {
+            LOG(WARNING) << "Failed to close warm stream " << key.second << " of device "
+                         << key.first << ": " << ret;
+        }
+    }
+}
+
+void TvInput::warmStreamLoop() {
+    std::vector<StreamKey> expired;
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mExiting) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = std::chrono::steady_clock::time_point::max();
+        expired.clear();
+        for (auto it = mStreams.begin(); it != mStreams.end();) {
+            if (it->second.warm && it->second.warmUntil <= now) {
+                expired.push_back(it->first);
+                it = eraseStreamLocked(it);
+                continue;
+            }
+            if (it->second.warm) {
+                next = std::min(next, it->second.warmUntil);
+            }
+            ++it;
+        }
+        if (!expired.empty()) {
+            lock.unlock();
+            closeLegacyStreams(expired);
+            lock.lock();
+            continue;
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            mWarmCond.wait(lock);
+        } else {
+            mWarmCond.wait_until(lock, next);
+        }
+    }
+}
+
+std::map<TvInput::StreamKey, TvInput::OpenStream>::iterator TvInput::eraseStreamLocked(
+        std::map<StreamKey, OpenStream>::iterator it) {
+    int32_t deviceId = it->first.first;
+    it = mStreams.erase(it);
+    // The device is fresh again once none of its streams predates the change.
+    bool hasStreams = false;
+    for (const auto& entry : mStreams) {
+        if (entry.first.first == deviceId) {
+            hasStreams = true;
+            break;
+        }
+    }
+    if (!hasStreams) {
+        mStaleDevices.erase(deviceId);
+    }
+    return it;
+}
+
+void TvInput::recordSwitchLocked(int32_t deviceId, std::chrono::steady_clock::time_point start,
+        bool warm) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+    SwitchStats& stats = mSwitchStats[deviceId];
+    stats.opens++;
+    if (warm) {
+        stats.warmOpens++;
+    }
+    stats.total += elapsed;
+    stats.max = std::max(stats.max, elapsed);
+    stats.last = elapsed;
+}
+
 // static
 void TvInput::notify(struct tv_input_device* __unused, tv_input_event_t* event,
-        void* __unused) {
+        void* data) {
+    if (data != nullptr && event != nullptr &&
+            (event->type == TV_INPUT_EVENT_STREAM_CONFIGURATIONS_CHANGED ||
+             event->type == TV_INPUT_EVENT_DEVICE_AVAILABLE ||
+             event->type == TV_INPUT_EVENT_DEVICE_UNAVAILABLE)) {
+        static_cast<TvInput*>(data)->onStreamsChanged(event->device_info.device_id);
+    }
     if (mCallback != nullptr && event != nullptr) {
         // Capturing is no longer supported.
         if (event->type >= TV_INPUT_EVENT_CAPTURE_SUCCEEDED) {
@@ -16,6 +16,15 @@
 #ifndef ANDROID_HARDWARE_TV_INPUT_V1_0_TVINPUT_H
 #define ANDROID_HARDWARE_TV_INPUT_V1_0_TVINPUT_H
 
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include <android/hardware/tv/input/1.0/ITvInput.h>
 #include <hidl/Status.h>
 #include <hardware/tv_input.h>
@@ -37,12 +46,17 @@ using ::android::hardware::tv::input::V1_0::TvInputEvent;
 using ::android::hardware::tv::input::V1_0::TvStreamConfig;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
+using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_vec;
 using ::android::hardware::hidl_string;
 using ::android::sp;
 
 struct TvInput : public ITvInput {
-    TvInput(tv_input_device_t* device);
+    // How long a closed stream is kept warm before it is closed in the legacy device.
+    static constexpr std::chrono::milliseconds kWarmStreamTimeout{5000};
+
+    TvInput(tv_input_device_t* device,
+            std::chrono::milliseconds warmStreamTimeout = kWarmStreamTimeout);
     ~TvInput();
     Return<void> setCallback(const sp<ITvInputCallback>& callback)  override;
     Return<void> getStreamConfigurations(int32_t deviceId,
@@ -50,17 +64,66 @@ struct TvInput : public ITvInput {
     Return<void> openStream(int32_t deviceId, int32_t streamId,
             openStream_cb _hidl_cb)  override;
     Return<Result> closeStream(int32_t deviceId, int32_t streamId)  override;
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
 
     static void notify(struct tv_input_device* __unused, tv_input_event_t* event,
-            void* __unused);
+            void* data);
     static uint32_t getSupportedConfigCount(uint32_t configCount,
             const tv_stream_config_t* configs);
     static bool isSupportedStreamType(int type);
 
     private:
+    using StreamKey = std::pair<int32_t, int32_t>;  // deviceId, streamId
+
+    // A stream opened in the legacy device. A closed stream is kept open there, warm, and is
+    // handed out again with the same sideband handle when it is reopened. At most one stream is
+    // warm at a time, and only until warmUntil.
+    struct OpenStream {
+        native_handle_t* sidebandStream;
+        bool warm;
+        std::chrono::steady_clock::time_point warmUntil;
+    };
+
+    // Time taken by openStream, per device.
+    struct SwitchStats {
+        uint64_t opens = 0;
+        uint64_t warmOpens = 0;
+        std::chrono::microseconds total{0};
+        std::chrono::microseconds max{0};
+        std::chrono::microseconds last{0};
+    };
+
+    // Drops the cached configurations of a device, and stops reusing its warm streams.
+    void onStreamsChanged(int32_t deviceId);
+    // Closes the warm streams of deviceId other than keep and those of stale devices, or all
+    // warm streams other than keep when deviceId is -1.
+    void closeWarmStreams(int32_t deviceId, const StreamKey& keep);
+    void closeLegacyStreams(const std::vector<StreamKey>& keys);
+    // Closes the warm streams as they expire, until the TvInput is destroyed.
+    void warmStreamLoop();
+    std::map<StreamKey, OpenStream>::iterator eraseStreamLocked(
+            std::map<StreamKey, OpenStream>::iterator it);
+    void recordSwitchLocked(int32_t deviceId, std::chrono::steady_clock::time_point start,
+            bool warm);
+
     static sp<ITvInputCallback> mCallback;
     tv_input_callback_ops_t mCallbackOps;
     tv_input_device_t* mDevice;
+    const std::chrono::milliseconds mWarmStreamTimeout;
+
+    // Never held across calls into mDevice, which may notify from within them.
+    std::mutex mLock;
+    // Only filled while a callback is set, as the legacy device reports changes through it.
+    std::map<int32_t, hidl_vec<TvStreamConfig>> mConfigCache;
+    uint64_t mConfigGeneration = 0;
+    std::map<StreamKey, OpenStream> mStreams;
+    // Devices whose streams changed since their warm streams were opened.
+    std::set<int32_t> mStaleDevices;
+    std::map<int32_t, SwitchStats> mSwitchStats;
+    // Started by the first stream kept warm.
+    std::thread mWarmThread;
+    std::condition_variable mWarmCond;
+    bool mExiting = false;
 };
 
 extern "C" ITvInput* HIDL_FETCH_ITvInput(const char* name);
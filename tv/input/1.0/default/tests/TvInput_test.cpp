@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <cutils/native_handle.h>
+
+#include "TvInput.h"
+
+namespace android {
+namespace hardware {
+namespace tv {
+namespace input {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using StreamKey = std::pair<int32_t, int32_t>;
+
+constexpr std::chrono::seconds kTimeout(5);
+constexpr std::chrono::milliseconds kShortWarmTimeout(100);
+
+// Records the streams opened and closed in the legacy device. Its callbacks are plain function
+// pointers, so there is a single instance at a time.
+class FakeDevice {
+   public:
+    FakeDevice() { sInstance = this; }
+
+    ~FakeDevice() {
+        for (const auto& handle : mHandles) {
+            native_handle_delete(handle.second);
+        }
+        sInstance = nullptr;
+    }
+
+    // A new device each time, as TvInput frees the device it is given.
+    tv_input_device_t* device() {
+        auto device = static_cast<tv_input_device_t*>(calloc(1, sizeof(tv_input_device_t)));
+        device->open_stream = &FakeDevice::openStream;
+        device->close_stream = &FakeDevice::closeStream;
+        return device;
+    }
+
+    std::vector<StreamKey> opened() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mOpened;
+    }
+
+    std::vector<StreamKey> closed() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mClosed;
+    }
+
+    void waitForCloses(size_t count) {
+        std::unique_lock<std::mutex> lock(mLock);
+        ASSERT_TRUE(mCond.wait_for(lock, kTimeout, [&] { return mClosed.size() >= count; }));
+    }
+
+   private:
+    static int openStream(struct tv_input_device* /* dev */, int deviceId, tv_stream_t* stream) {
+        FakeDevice* self = sInstance;
+        std::lock_guard<std::mutex> lock(self->mLock);
+        StreamKey key(deviceId, stream->stream_id);
+        self->mOpened.push_back(key);
+        native_handle_t*& handle = self->mHandles[key];
+        if (handle == nullptr) {
+            handle = native_handle_create(0, 0);
+        }
+        stream->type = TV_STREAM_TYPE_INDEPENDENT_VIDEO_SOURCE;
+        stream->sideband_stream_source_handle = handle;
+        return 0;
+    }
+
+    static int closeStream(struct tv_input_device* /* dev */, int deviceId, int streamId) {
+        FakeDevice* self = sInstance;
+        std::lock_guard<std::mutex> lock(self->mLock);
+        self->mClosed.emplace_back(deviceId, streamId);
+        self->mCond.notify_all();
+        return 0;
+    }
+
+    static FakeDevice* sInstance;
+
+    std::mutex mLock;
+    std::condition_variable mCond;
+    std::vector<StreamKey> mOpened;
+    std::vector<StreamKey> mClosed;
+    std::map<StreamKey, native_handle_t*> mHandles;
+};
+
+FakeDevice* FakeDevice::sInstance = nullptr;
+
+class TvInputTest : public ::testing::Test {
+   protected:
+    void createInput(std::chrono::milliseconds warmStreamTimeout) {
+        mInput = new TvInput(mDevice.device(), warmStreamTimeout);
+    }
+
+    void SetUp() override { createInput(TvInput::kWarmStreamTimeout); }
+
+    Result open(int32_t deviceId, int32_t streamId) {
+        Result result = Result::UNKNOWN;
+        mInput->openStream(deviceId, streamId,
+                           [&](Result res, const hidl_handle&) { result = res; });
+        return result;
+    }
+
+    Result close(int32_t deviceId, int32_t streamId) {
+        return mInput->closeStream(deviceId, streamId);
+    }
+
+    void notifyChanged(int32_t deviceId) {
+        tv_input_event_t event = {};
+        event.type = TV_INPUT_EVENT_STREAM_CONFIGURATIONS_CHANGED;
+        event.device_info.device_id = deviceId;
+        TvInput::notify(nullptr, &event, mInput.get());
+    }
+
+    FakeDevice mDevice;
+    sp<TvInput> mInput;
+};
+
+TEST_F(TvInputTest, ReopensAWarmStreamWithoutTheDevice) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(Result::OK, close(1, 10));
+    EXPECT_TRUE(mDevice.closed().empty());
+
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.opened());
+}
+
+TEST_F(TvInputTest, ClosingAWarmStreamAgainFails) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(Result::OK, close(1, 10));
+    EXPECT_EQ(Result::INVALID_STATE, close(1, 10));
+}
+
+TEST_F(TvInputTest, KeepsOneWarmStreamAcrossDevices) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    ASSERT_EQ(Result::OK, open(2, 20));
+    EXPECT_EQ(Result::OK, close(1, 10));
+    EXPECT_TRUE(mDevice.closed().empty());
+
+    // Keeping the second one warm releases the first
+    EXPECT_EQ(Result::OK, close(2, 20));
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+}
+
+TEST_F(TvInputTest, OpeningAnotherStreamOfTheDeviceClosesItsWarmStream) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(Result::OK, close(1, 10));
+
+    ASSERT_EQ(Result::OK, open(1, 11));
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+}
+
+TEST_F(TvInputTest, ClosesTheWarmStreamAfterTheTimeout) {
+    mInput.clear();
+    createInput(kShortWarmTimeout);
+    ASSERT_EQ(Result::OK, open(1, 10));
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(Result::OK, close(1, 10));
+
+    mDevice.waitForCloses(1);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, kShortWarmTimeout);
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+
+    // Reopening goes to the device again
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(2u, mDevice.opened().size());
+}
+
+TEST_F(TvInputTest, StaleStreamIsNotKeptWarm) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    notifyChanged(1);
+
+    EXPECT_EQ(Result::OK, close(1, 10));
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+}
+
+TEST_F(TvInputTest, StaleWarmStreamIsNotReused) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(Result::OK, close(1, 10));
+    notifyChanged(1);
+
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+    EXPECT_EQ(2u, mDevice.opened().size());
+
+    // The device is fresh again, so the new stream can be kept warm
+    EXPECT_EQ(Result::OK, close(1, 10));
+    EXPECT_EQ(1u, mDevice.closed().size());
+}
+
+TEST_F(TvInputTest, DestructionClosesTheWarmStream) {
+    ASSERT_EQ(Result::OK, open(1, 10));
+    EXPECT_EQ(Result::OK, close(1, 10));
+
+    mInput.clear();
+    EXPECT_EQ(std::vector<StreamKey>({{1, 10}}), mDevice.closed());
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace input
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
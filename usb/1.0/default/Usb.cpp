@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <assert.h>
+#include <chrono>
 #include <dirent.h>
 #include <iostream>
 #include <fstream>
@@ -24,6 +25,7 @@
 
 #include <cutils/uevent.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <utils/Errors.h>
 #include <utils/StrongPointer.h>
 
@@ -82,39 +84,6 @@ std::string convertRoletoString(PortRole role) {
     return "none";
 }
 
-Return<void> Usb::switchRole(const hidl_string& portName,
-        const PortRole& newRole) {
-    std::string filename = appendRoleNodeHelper(std::string(portName.c_str()),
-        newRole.type);
-    std::ofstream file(filename);
-    std::string written;
-
-    ALOGI("filename write: %s role:%d", filename.c_str(), newRole.role);
-
-    if (file.is_open()) {
-        file << convertRoletoString(newRole).c_str();
-        file.close();
-        if (!readFile(filename, written)) {
-            ALOGI("written: %s", written.c_str());
-            if (written == convertRoletoString(newRole)) {
-                ALOGI("Role switch successfull");
-                Return<void> ret =
-                    mCallback->notifyRoleSwitchStatus(portName, newRole,
-                    Status::SUCCESS);
-                if (!ret.isOk())
-                    ALOGE("RoleSwitchStatus error %s",
-                        ret.description().c_str());
-            }
-        }
-    }
-
-    Return<void> ret = mCallback->notifyRoleSwitchStatus(portName, newRole, Status::ERROR);
-    if (!ret.isOk())
-        ALOGE("RoleSwitchStatus error %s", ret.description().c_str());
-
-    return Void();
-}
-
 Status getCurrentRoleHelper(std::string portName,
         PortRoleType type, uint32_t &currentRole)  {
     std::string filename;
@@ -299,11 +268,37 @@ done:
     return Status::ERROR;
 }
 
+Status Usb::refreshPortStatus(hidl_vec<PortStatus>* currentPortStatus) {
+    Status status = getPortStatusHelper(*currentPortStatus);
+
+    std::lock_guard<std::mutex> lock(mStatusLock);
+    mStatus = *currentPortStatus;
+    mStatusResult = status;
+    return status;
+}
+
+void Usb::setPortStatusCacheValid(bool valid, int wakeFd) {
+    std::lock_guard<std::mutex> lock(mStatusLock);
+    mStatusValid = valid;
+    mWakeFd = wakeFd;
+}
+
+Status Usb::getPortStatus(hidl_vec<PortStatus>* currentPortStatus) {
+    {
+        std::lock_guard<std::mutex> lock(mStatusLock);
+        if (mStatusValid) {
+            *currentPortStatus = mStatus;
+            return mStatusResult;
+        }
+    }
+    return getPortStatusHelper(*currentPortStatus);
+}
+
 Return<void> Usb::queryPortStatus() {
     hidl_vec<PortStatus> currentPortStatus;
     Status status;
 
-    status = getPortStatusHelper(currentPortStatus);
+    status = getPortStatus(&currentPortStatus);
     Return<void> ret = mCallback->notifyPortStatusChange(currentPortStatus,
        status);
     if (!ret.isOk())
@@ -311,46 +306,177 @@ Return<void> Usb::queryPortStatus() {
 
     return Void();
 }
+
+// Upper bound for a role switch to be confirmed by a dual_role_usb uevent.
+static constexpr std::chrono::milliseconds kRoleSwitchTimeout{3000};
+
+static bool portHasRole(const hidl_vec<PortStatus>& portStatus,
+        const std::string& portName, const PortRole& role) {
+    for (const auto& port : portStatus) {
+        if (port.portName != portName)
+            continue;
+        switch (role.type) {
+            case PortRoleType::DATA_ROLE:
+                return static_cast<uint32_t>(port.currentDataRole) == role.role;
+            case PortRoleType::POWER_ROLE:
+                return static_cast<uint32_t>(port.currentPowerRole) == role.role;
+            default:
+                return static_cast<uint32_t>(port.currentMode) == role.role;
+        }
+    }
+    return false;
+}
+
+static Status readBackRole(const std::string& filename, const PortRole& role) {
+    std::string written;
+    if (!readFile(filename, written)) {
+        ALOGI("written: %s", written.c_str());
+        if (written == convertRoletoString(role))
+            return Status::SUCCESS;
+    }
+    return Status::ERROR;
+}
+
+static void notifyRoleSwitch(const sp<IUsbCallback>& callback, const hidl_string& portName,
+        const PortRole& role, Status status) {
+    if (status == Status::SUCCESS)
+        ALOGI("Role switch successfull");
+    if (callback == NULL)
+        return;
+    Return<void> ret = callback->notifyRoleSwitchStatus(portName, role, status);
+    if (!ret.isOk())
+        ALOGE("RoleSwitchStatus error %s", ret.description().c_str());
+}
+
+Return<void> Usb::switchRole(const hidl_string& portName,
+        const PortRole& newRole) {
+    std::string filename = appendRoleNodeHelper(std::string(portName.c_str()),
+        newRole.type);
+    std::ofstream file(filename);
+    Status status = Status::ERROR;
+
+    ALOGI("filename write: %s role:%d", filename.c_str(), newRole.role);
+
+    if (file.is_open()) {
+        file << convertRoletoString(newRole).c_str();
+        file.close();
+
+        // The role takes a while to change, so leave it to the uevent thread to report the
+        // result, once a uevent confirms the new role or after kRoleSwitchTimeout.
+        {
+            std::lock_guard<std::mutex> lock(mStatusLock);
+            if (mStatusValid) {
+                mRoleSwitches.push_back({portName, newRole, filename,
+                        std::chrono::steady_clock::now() + kRoleSwitchTimeout});
+                uint64_t wake = 1;
+                if (write(mWakeFd, &wake, sizeof(wake)) != sizeof(wake))
+                    ALOGE("failed to wake the uevent thread; errno=%d", errno);
+                return Void();
+            }
+        }
+
+        status = readBackRole(filename, newRole);
+    }
+
+    notifyRoleSwitch(mCallback, portName, newRole, status);
+    return Void();
+}
+
+int Usb::reportRoleSwitches(bool flush) {
+    std::vector<PendingRoleSwitch> confirmed;
+    std::vector<PendingRoleSwitch> expired;
+    int timeout = -1;
+    {
+        std::lock_guard<std::mutex> lock(mStatusLock);
+        auto now = std::chrono::steady_clock::now();
+        auto it = mRoleSwitches.begin();
+        while (it != mRoleSwitches.end()) {
+            if (portHasRole(mStatus, it->portName, it->role)) {
+                confirmed.push_back(std::move(*it));
+            } else if (flush || it->deadline <= now) {
+                expired.push_back(std::move(*it));
+            } else {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        it->deadline - now).count() + 1;
+                if (timeout == -1 || left < timeout)
+                    timeout = left;
+                ++it;
+                continue;
+            }
+            it = mRoleSwitches.erase(it);
+        }
+    }
+
+    sp<IUsbCallback> callback = mCallback;
+    for (const auto& roleSwitch : confirmed) {
+        notifyRoleSwitch(callback, roleSwitch.portName, roleSwitch.role, Status::SUCCESS);
+    }
+    for (const auto& roleSwitch : expired) {
+        notifyRoleSwitch(callback, roleSwitch.portName, roleSwitch.role,
+                readBackRole(roleSwitch.filename, roleSwitch.role));
+    }
+    return timeout;
+}
+
 struct data {
     int uevent_fd;
+    int wake_fd;
     android::hardware::usb::V1_0::implementation::Usb *usb;
 };
 
-static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
-    char msg[UEVENT_MSG_LEN + 2];
+static void wake_event(uint32_t /*epevents*/, struct data *payload) {
+    uint64_t wakes;
+
+    /* Only wakes up the thread to pick up the new role switches. */
+    if (read(payload->wake_fd, &wakes, sizeof(wakes)) == -1)
+        ALOGE("failed to read the wake eventfd; errno=%d", errno);
+}
+
+static bool is_dual_role_uevent(char *msg, int n) {
     char *cp;
-    int n;
 
-    n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN);
-    if (n <= 0)
-        return;
     if (n >= UEVENT_MSG_LEN)   /* overflow -- discard */
-        return;
+        return false;
 
     msg[n] = '\0';
     msg[n + 1] = '\0';
     cp = msg;
 
     while (*cp) {
-        if (!strcmp(cp, "SUBSYSTEM=dual_role_usb")) {
-            ALOGE("uevent received %s", cp);
-            if (payload->usb->mCallback != NULL) {
-                hidl_vec<PortStatus> currentPortStatus;
-                Status status = getPortStatusHelper(currentPortStatus);
-                Return<void> ret =
-                    payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
-                if (!ret.isOk())
-                    ALOGE("error %s", ret.description().c_str());
-            }
-            break;
-        }
+        if (!strcmp(cp, "SUBSYSTEM=dual_role_usb"))
+            return true;
         /* advance to after the next \0 */
         while (*cp++);
     }
+    return false;
+}
+
+static void uevent_event(uint32_t /*epevents*/, struct data *payload) {
+    char msg[UEVENT_MSG_LEN + 2];
+    bool changed = false;
+    int n;
+
+    /* Drain the socket so that a burst of uevents refreshes the status once. */
+    while ((n = uevent_kernel_multicast_recv(payload->uevent_fd, msg, UEVENT_MSG_LEN)) > 0) {
+        if (is_dual_role_uevent(msg, n))
+            changed = true;
+    }
+    if (!changed)
+        return;
+
+    ALOGI("dual_role_usb uevent received");
+    hidl_vec<PortStatus> currentPortStatus;
+    Status status = payload->usb->refreshPortStatus(&currentPortStatus);
+    if (payload->usb->mCallback != NULL) {
+        Return<void> ret =
+            payload->usb->mCallback->notifyPortStatusChange(currentPortStatus, status);
+        if (!ret.isOk())
+            ALOGE("error %s", ret.description().c_str());
+    }
 }
 
 void* work(void* param) {
-    int epoll_fd, uevent_fd;
+    int epoll_fd = -1, uevent_fd, wake_fd = -1;
     struct epoll_event ev;
     int nevents = 0;
     struct data payload;
@@ -365,6 +491,7 @@ void* work(void* param) {
     }
 
     payload.uevent_fd = uevent_fd;
+    payload.wake_fd = -1;
     payload.usb = (android::hardware::usb::V1_0::implementation::Usb *)param;
 
     fcntl(uevent_fd, F_SETFL, O_NONBLOCK);
@@ -383,10 +510,33 @@ void* work(void* param) {
         goto error;
     }
 
+    wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd == -1) {
+        ALOGE("eventfd failed; errno=%d", errno);
+        goto error;
+    }
+    payload.wake_fd = wake_fd;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = (void *)wake_event;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == -1) {
+        ALOGE("epoll_ctl failed; errno=%d", errno);
+        goto error;
+    }
+
+    /* Fill the cache; from now on only dual_role_usb uevents refresh it. */
+    {
+        hidl_vec<PortStatus> currentPortStatus;
+        payload.usb->refreshPortStatus(&currentPortStatus);
+        payload.usb->setPortStatusCacheValid(true, wake_fd);
+    }
+
     while (!destroyThread) {
         struct epoll_event events[64];
+        /* Also wakes up when the next role switch times out. */
+        int timeout = payload.usb->reportRoleSwitches(false);
 
-        nevents = epoll_wait(epoll_fd, events, 64, -1);
+        nevents = epoll_wait(epoll_fd, events, 64, timeout);
         if (nevents == -1) {
             if (errno == EINTR)
                 continue;
@@ -403,8 +553,13 @@ void* work(void* param) {
 
     ALOGI("exiting worker thread");
 error:
+    payload.usb->setPortStatusCacheValid(false, -1);
+    payload.usb->reportRoleSwitches(true);
     close(uevent_fd);
 
+    if (wake_fd >= 0)
+        close(wake_fd);
+
     if (epoll_fd >= 0)
         close(epoll_fd);
 
@@ -1,6 +1,11 @@
 #ifndef ANDROID_HARDWARE_USB_V1_0_USB_H
 #define ANDROID_HARDWARE_USB_V1_0_USB_H
 
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <android/hardware/usb/1.0/IUsb.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
@@ -37,10 +42,39 @@ struct Usb : public IUsb {
     Return<void> setCallback(const sp<IUsbCallback>& callback) override;
     Return<void> queryPortStatus() override;
 
+    // Re-reads the port status from sysfs into the cache.
+    Status refreshPortStatus(hidl_vec<PortStatus>* currentPortStatus);
+    // Marks the cache valid or not. It is only kept up to date while the uevent thread runs,
+    // which is woken through wakeFd when a role switch is pending.
+    void setPortStatusCacheValid(bool valid, int wakeFd);
+    // Reports the pending role switches that the cache confirms, and those that timed out, or
+    // all of them when flush is set, after reading their node back. Returns the time in ms
+    // until the next timeout, or -1 if no role switch is pending. Called by the uevent thread.
+    int reportRoleSwitches(bool flush);
+
     sp<IUsbCallback> mCallback;
     private:
+        // Returns the cached port status, reading sysfs only if the cache is not valid.
+        Status getPortStatus(hidl_vec<PortStatus>* currentPortStatus);
+
         pthread_t mPoll;
         pthread_mutex_t mLock = PTHREAD_MUTEX_INITIALIZER;
+
+        // A role written to its node, waiting for a uevent to confirm it.
+        struct PendingRoleSwitch {
+            hidl_string portName;
+            PortRole role;
+            std::string filename;
+            std::chrono::steady_clock::time_point deadline;
+        };
+
+        // Port status cache, refreshed on dual_role_usb uevents.
+        std::mutex mStatusLock;
+        bool mStatusValid = false;
+        int mWakeFd = -1;
+        Status mStatusResult = Status::ERROR;
+        hidl_vec<PortStatus> mStatus;
+        std::vector<PendingRoleSwitch> mRoleSwitches;
 };
 
 }  // namespace implementation
@@ -29,7 +29,7 @@ namespace implementation {
 static constexpr uint32_t MS_PER_S = 1000;
 static constexpr uint32_t NS_PER_MS = 1000000;
 
-Vibrator::Vibrator() {
+Vibrator::Vibrator() : mEffects(compileEffects()) {
     sigevent se{};
     se.sigev_notify = SIGEV_THREAD;
     se.sigev_value.sival_ptr = this;
@@ -107,27 +107,19 @@ Return<void> Vibrator::perform_1_3(Effect effect, EffectStrength strength, perfo
 // Private methods follow.
 
 Return<void> Vibrator::perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb) {
-    uint8_t amplitude;
-    uint32_t ms;
-    Status status = Status::OK;
-
-    ALOGI("Perform: Effect %s\n", effectToName(effect).c_str());
-
-    amplitude = strengthToAmplitude(strength, &status);
-    if (status != Status::OK) {
-        _hidl_cb(status, 0);
+    auto it = mEffects.find({effect, strength});
+    if (it == mEffects.end()) {
+        _hidl_cb(Status::UNSUPPORTED_OPERATION, 0);
         return Void();
     }
-    setAmplitude(amplitude);
+    const Waveform& waveform = it->second;
 
-    ms = effectToMs(effect, &status);
-    if (status != Status::OK) {
-        _hidl_cb(status, 0);
-        return Void();
-    }
-    status = activate(ms);
+    ALOGI("Perform: Effect %s\n", waveform.name.c_str());
 
-    _hidl_cb(status, ms);
+    setAmplitude(waveform.amplitude);
+    Status status = activate(waveform.ms);
+
+    _hidl_cb(status, waveform.ms);
 
     return Void();
 }
@@ -257,6 +249,21 @@ uint32_t Vibrator::effectToMs(Effect effect, Status* status) {
     return 0;
 }
 
+std::map<std::pair<Effect, EffectStrength>, Vibrator::Waveform> Vibrator::compileEffects() {
+    std::map<std::pair<Effect, EffectStrength>, Waveform> effects;
+    for (Effect effect : hidl_enum_range<Effect>()) {
+        for (EffectStrength strength : hidl_enum_range<EffectStrength>()) {
+            Status status = Status::OK;
+            uint8_t amplitude = strengthToAmplitude(strength, &status);
+            uint32_t ms = effectToMs(effect, &status);
+            if (status == Status::OK) {
+                effects[{effect, strength}] = {effectToName(effect), amplitude, ms};
+            }
+        }
+    }
+    return effects;
+}
+
 uint8_t Vibrator::strengthToAmplitude(EffectStrength strength, Status* status) {
     switch (strength) {
         case EffectStrength::LIGHT:
@@ -16,6 +16,10 @@
 #ifndef ANDROID_HARDWARE_VIBRATOR_V1_3_VIBRATOR_H
 #define ANDROID_HARDWARE_VIBRATOR_V1_3_VIBRATOR_H
 
+#include <map>
+#include <string>
+#include <utility>
+
 #include <android/hardware/vibrator/1.3/IVibrator.h>
 #include <hidl/Status.h>
 
@@ -54,6 +58,13 @@ class Vibrator : public IVibrator {
     Return<void> perform_1_3(Effect effect, EffectStrength strength, perform_cb _hidl_cb) override;
 
   private:
+    // Playback of an effect at a strength, computed once at startup.
+    struct Waveform {
+        std::string name;
+        uint8_t amplitude;
+        uint32_t ms;
+    };
+
     Return<void> perform(Effect effect, EffectStrength strength, perform_cb _hidl_cb);
     template <typename T>
     Return<void> perform(T effect, EffectStrength strength, perform_cb _hidl_cb);
@@ -65,6 +76,7 @@ class Vibrator : public IVibrator {
     static const std::string effectToName(Effect effect);
     static uint32_t effectToMs(Effect effect, Status* status);
     static uint8_t strengthToAmplitude(EffectStrength strength, Status* status);
+    static std::map<std::pair<Effect, EffectStrength>, Waveform> compileEffects();
 
   private:
     bool mEnabled{false};
@@ -72,6 +84,8 @@ class Vibrator : public IVibrator {
     bool mExternalControl{false};
     std::mutex mMutex;
     timer_t mTimer{nullptr};
+    // Supported effect and strength pairs only.
+    const std::map<std::pair<Effect, EffectStrength>, Waveform> mEffects;
 };
 }  // namespace implementation
 }  // namespace V1_3
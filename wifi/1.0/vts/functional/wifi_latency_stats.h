@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+// Latency samples of one phase of a benchmark, e.g. the association of a
+// connect cycle. Benchmarks log toString() of each phase, so that runs on
+// different firmware drops can be compared from their logs.
+class LatencyStats {
+   public:
+    void add(std::chrono::steady_clock::duration latency) {
+        count_++;
+        total_ += latency;
+        min_ = count_ == 1 ? latency : std::min(min_, latency);
+        max_ = std::max(max_, latency);
+    }
+
+    uint32_t count() const { return count_; }
+
+    std::string toString() const {
+        std::ostringstream out;
+        out << count_ << " samples";
+        if (count_ > 0) {
+            out << ", min " << toMs(min_) << "ms mean " << toMs(total_) / count_
+                << "ms max " << toMs(max_) << "ms";
+        }
+        return out.str();
+    }
+
+   private:
+    static double toMs(std::chrono::steady_clock::duration duration) {
+        return std::chrono::duration<double, std::milli>(duration).count();
+    }
+
+    uint32_t count_ = 0;
+    std::chrono::steady_clock::duration total_{0};
+    std::chrono::steady_clock::duration min_{0};
+    std::chrono::steady_clock::duration max_{0};
+};
@@ -41,7 +41,9 @@ LOCAL_CFLAGS += -Wno-error=implicit-fallthrough
 LOCAL_SRC_FILES := \
     hidl_struct_util.cpp \
     hidl_sync_util.cpp \
+    nan_indication_coalescer.cpp \
     ringbuffer.cpp \
+    ringbuffer_writer.cpp \
     wifi.cpp \
     wifi_ap_iface.cpp \
     wifi_chip.cpp \
@@ -69,7 +71,11 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.1 \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3
+LOCAL_STATIC_LIBRARIES := \
+    android.hardware.common@metrics-lib
 LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+LOCAL_EXPORT_STATIC_LIBRARY_HEADERS := \
+    android.hardware.common@metrics-lib
 include $(BUILD_STATIC_LIBRARY)
 
 ###
@@ -97,7 +103,8 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3
 LOCAL_STATIC_LIBRARIES := \
-    android.hardware.wifi@1.0-service-lib
+    android.hardware.wifi@1.0-service-lib \
+    android.hardware.common@metrics-lib
 LOCAL_INIT_RC := android.hardware.wifi@1.0-service.rc
 include $(BUILD_EXECUTABLE)
 
@@ -128,7 +135,8 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3
 LOCAL_STATIC_LIBRARIES := \
-    android.hardware.wifi@1.0-service-lib
+    android.hardware.wifi@1.0-service-lib \
+    android.hardware.common@metrics-lib
 LOCAL_INIT_RC := android.hardware.wifi@1.0-service-lazy.rc
 include $(BUILD_EXECUTABLE)
 
@@ -147,7 +155,9 @@ LOCAL_SRC_FILES := \
     tests/mock_wifi_iface_util.cpp \
     tests/mock_wifi_legacy_hal.cpp \
     tests/mock_wifi_mode_controller.cpp \
+    tests/nan_indication_coalescer_unit_tests.cpp \
     tests/ringbuffer_unit_tests.cpp \
+    tests/ringbuffer_writer_unit_tests.cpp \
     tests/wifi_ap_iface_unit_tests.cpp \
     tests/wifi_nan_iface_unit_tests.cpp \
     tests/wifi_chip_unit_tests.cpp \
@@ -155,7 +165,8 @@ LOCAL_SRC_FILES := \
 LOCAL_STATIC_LIBRARIES := \
     libgmock \
     libgtest \
-    android.hardware.wifi@1.0-service-lib
+    android.hardware.wifi@1.0-service-lib \
+    android.hardware.common@metrics-lib
 LOCAL_SHARED_LIBRARIES := \
     libbase \
     libcutils \
@@ -171,3 +182,37 @@ LOCAL_SHARED_LIBRARIES := \
     android.hardware.wifi@1.2 \
     android.hardware.wifi@1.3
 include $(BUILD_NATIVE_TEST)
+
+###
+### android.hardware.wifi HIDL method overhead benchmarks.
+###
+include $(CLEAR_VARS)
+LOCAL_MODULE := android.hardware.wifi@1.0-service-benchmarks
+LOCAL_PROPRIETARY_MODULE := true
+LOCAL_CPPFLAGS := -Wall -Werror -Wextra
+LOCAL_SRC_FILES := \
+    tests/mock_interface_tool.cpp \
+    tests/mock_wifi_feature_flags.cpp \
+    tests/mock_wifi_iface_util.cpp \
+    tests/mock_wifi_mode_controller.cpp \
+    tests/wifi_hal_benchmark.cpp
+LOCAL_STATIC_LIBRARIES := \
+    libgmock \
+    libgtest \
+    android.hardware.wifi@1.0-service-lib \
+    android.hardware.common@metrics-lib
+LOCAL_SHARED_LIBRARIES := \
+    libbase \
+    libcutils \
+    libhidlbase \
+    libhidltransport \
+    liblog \
+    libnl \
+    libutils \
+    libwifi-hal \
+    libwifi-system-iface \
+    android.hardware.wifi@1.0 \
+    android.hardware.wifi@1.1 \
+    android.hardware.wifi@1.2 \
+    android.hardware.wifi@1.3
+include $(BUILD_NATIVE_BENCHMARK)
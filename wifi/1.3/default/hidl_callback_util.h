@@ -17,6 +17,7 @@
 #ifndef HIDL_CALLBACK_UTIL_H_
 #define HIDL_CALLBACK_UTIL_H_
 
+#include <mutex>
 #include <set>
 
 #include <hidl/HidlSupport.h>
@@ -57,7 +58,8 @@ namespace implementation {
 namespace hidl_callback_util {
 template <typename CallbackType>
 // Provides a class to manage callbacks for the various HIDL interfaces and
-// handle the death of the process hosting each callback.
+// handle the death of the process hosting each callback. The callbacks may be
+// read from the legacy HAL event loop thread, hence the lock.
 class HidlCallbackHandler {
    public:
     HidlCallbackHandler()
@@ -71,6 +73,7 @@ class HidlCallbackHandler {
         // (callback proxy's raw pointer) to track the death of individual
         // clients.
         uint64_t cookie = reinterpret_cast<uint64_t>(cb.get());
+        std::lock_guard<std::mutex> lock(mutex_);
         if (cb_set_.find(cb) != cb_set_.end()) {
             LOG(WARNING) << "Duplicate death notification registration";
             return true;
@@ -83,13 +86,16 @@ class HidlCallbackHandler {
         return true;
     }
 
-    const std::set<android::sp<CallbackType>>& getCallbacks() {
+    // Returns a copy, so the callbacks can be invoked without the lock held.
+    std::set<android::sp<CallbackType>> getCallbacks() {
+        std::lock_guard<std::mutex> lock(mutex_);
         return cb_set_;
     }
 
     // Death notification for callbacks.
     void onObjectDeath(uint64_t cookie) {
         CallbackType* cb = reinterpret_cast<CallbackType*>(cookie);
+        std::lock_guard<std::mutex> lock(mutex_);
         const auto& iter = cb_set_.find(cb);
         if (iter == cb_set_.end()) {
             LOG(ERROR) << "Unknown callback death notification received";
@@ -100,6 +106,7 @@ class HidlCallbackHandler {
     }
 
     void invalidate() {
+        std::lock_guard<std::mutex> lock(mutex_);
         for (const sp<CallbackType>& cb : cb_set_) {
             if (!cb->unlinkToDeath(death_handler_)) {
                 LOG(ERROR) << "Failed to deregister death notification";
@@ -109,6 +116,7 @@ class HidlCallbackHandler {
     }
 
    private:
+    std::mutex mutex_;
     std::set<sp<CallbackType>> cb_set_;
     sp<HidlDeathHandler<CallbackType>> death_handler_;
 
@@ -44,6 +44,8 @@ Return<void> validateAndCall(
     ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&)>& hidl_cb, Args&&... args) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
+    const hidl_sync_util::LockHoldTimer lock_timer(
+        hidl_sync_util::LockId::kGlobal);
     if (obj->isValid()) {
         hidl_cb((obj->*work)(std::forward<Args>(args)...));
     } else {
@@ -60,6 +62,9 @@ Return<void> validateAndCallWithLock(
     ObjT* obj, WifiStatusCode status_code_if_invalid, WorkFuncT&& work,
     const std::function<void(const WifiStatus&)>& hidl_cb, Args&&... args) {
     auto lock = hidl_sync_util::acquireGlobalLock();
+    // Includes the time |work| releases the lock for.
+    const hidl_sync_util::LockHoldTimer lock_timer(
+        hidl_sync_util::LockId::kGlobal);
     if (obj->isValid()) {
         hidl_cb((obj->*work)(&lock, std::forward<Args>(args)...));
     } else {
@@ -76,6 +81,8 @@ Return<void> validateAndCall(
     const std::function<void(const WifiStatus&, ReturnT)>& hidl_cb,
     Args&&... args) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
+    const hidl_sync_util::LockHoldTimer lock_timer(
+        hidl_sync_util::LockId::kGlobal);
     if (obj->isValid()) {
         const auto& ret_pair = (obj->*work)(std::forward<Args>(args)...);
         const WifiStatus& status = std::get<0>(ret_pair);
@@ -97,6 +104,8 @@ Return<void> validateAndCall(
     const std::function<void(const WifiStatus&, ReturnT1, ReturnT2)>& hidl_cb,
     Args&&... args) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
+    const hidl_sync_util::LockHoldTimer lock_timer(
+        hidl_sync_util::LockId::kGlobal);
     if (obj->isValid()) {
         const auto& ret_tuple = (obj->*work)(std::forward<Args>(args)...);
         const WifiStatus& status = std::get<0>(ret_tuple);
@@ -531,13 +531,13 @@ bool convertLegacyIeToHidl(
     }
     *hidl_ie = {};
     hidl_ie->id = legacy_ie.id;
-    hidl_ie->data =
-        std::vector<uint8_t>(legacy_ie.data, legacy_ie.data + legacy_ie.len);
+    hidl_ie->data.resize(legacy_ie.len);
+    memcpy(hidl_ie->data.data(), legacy_ie.data, legacy_ie.len);
     return true;
 }
 
 bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
-                               std::vector<WifiInformationElement>* hidl_ies) {
+                               hidl_vec<WifiInformationElement>* hidl_ies) {
     if (!ie_blob || !hidl_ies) {
         return false;
     }
@@ -547,7 +547,9 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
     const uint8_t* next_ie = ies_begin;
     using wifi_ie = legacy_hal::wifi_information_element;
     constexpr size_t kIeHeaderLen = sizeof(wifi_ie);
+    // Count the IEs first so that |hidl_ies| is only allocated once.
     // Each IE should atleast have the header (i.e |id| & |len| fields).
+    size_t num_ies = 0;
     while (next_ie + kIeHeaderLen <= ies_end) {
         const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
         uint32_t curr_ie_len = kIeHeaderLen + legacy_ie.len;
@@ -557,13 +559,7 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
                        << ", IEs End: " << (void*)ies_end;
             break;
         }
-        WifiInformationElement hidl_ie;
-        if (!convertLegacyIeToHidl(legacy_ie, &hidl_ie)) {
-            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
-                       << ", len: " << legacy_ie.len;
-            break;
-        }
-        hidl_ies->push_back(std::move(hidl_ie));
+        num_ies++;
         next_ie += curr_ie_len;
     }
     // Check if the blob has been fully consumed.
@@ -571,6 +567,18 @@ bool convertLegacyIeBlobToHidl(const uint8_t* ie_blob, uint32_t ie_blob_len,
         LOG(ERROR) << "Failed to fully parse IE blob. Next IE: "
                    << (void*)next_ie << ", IEs End: " << (void*)ies_end;
     }
+    hidl_ies->resize(num_ies);
+    next_ie = ies_begin;
+    for (size_t ie_idx = 0; ie_idx < num_ies; ie_idx++) {
+        const wifi_ie& legacy_ie = (*reinterpret_cast<const wifi_ie*>(next_ie));
+        if (!convertLegacyIeToHidl(legacy_ie, &(*hidl_ies)[ie_idx])) {
+            LOG(ERROR) << "Error converting IE. Id: " << legacy_ie.id
+                       << ", len: " << legacy_ie.len;
+            hidl_ies->resize(ie_idx);
+            break;
+        }
+        next_ie += kIeHeaderLen + legacy_ie.len;
+    }
     return true;
 }
 
@@ -582,10 +590,10 @@ bool convertLegacyGscanResultToHidl(
     }
     *hidl_scan_result = {};
     hidl_scan_result->timeStampInUs = legacy_scan_result.ts;
-    hidl_scan_result->ssid = std::vector<uint8_t>(
-        legacy_scan_result.ssid,
-        legacy_scan_result.ssid + strnlen(legacy_scan_result.ssid,
-                                          sizeof(legacy_scan_result.ssid) - 1));
+    const size_t ssid_len = strnlen(legacy_scan_result.ssid,
+                                    sizeof(legacy_scan_result.ssid) - 1);
+    hidl_scan_result->ssid.resize(ssid_len);
+    memcpy(hidl_scan_result->ssid.data(), legacy_scan_result.ssid, ssid_len);
     memcpy(hidl_scan_result->bssid.data(), legacy_scan_result.bssid,
            hidl_scan_result->bssid.size());
     hidl_scan_result->frequency = legacy_scan_result.channel;
@@ -593,13 +601,12 @@ bool convertLegacyGscanResultToHidl(
     hidl_scan_result->beaconPeriodInMs = legacy_scan_result.beacon_period;
     hidl_scan_result->capability = legacy_scan_result.capability;
     if (has_ie_data) {
-        std::vector<WifiInformationElement> ies;
         if (!convertLegacyIeBlobToHidl(
                 reinterpret_cast<const uint8_t*>(legacy_scan_result.ie_data),
-                legacy_scan_result.ie_length, &ies)) {
+                legacy_scan_result.ie_length,
+                &hidl_scan_result->informationElements)) {
             return false;
         }
-        hidl_scan_result->informationElements = std::move(ies);
     }
     return true;
 }
@@ -623,18 +630,16 @@ bool convertLegacyCachedGscanResultsToHidl(
 
     CHECK(legacy_cached_scan_result.num_results >= 0 &&
           legacy_cached_scan_result.num_results <= MAX_AP_CACHE_PER_SCAN);
-    std::vector<StaScanResult> hidl_scan_results;
+    // The results are converted in place, cached results never carry IEs.
+    hidl_scan_data->results.resize(legacy_cached_scan_result.num_results);
     for (int32_t result_idx = 0;
          result_idx < legacy_cached_scan_result.num_results; result_idx++) {
-        StaScanResult hidl_scan_result;
         if (!convertLegacyGscanResultToHidl(
                 legacy_cached_scan_result.results[result_idx], false,
-                &hidl_scan_result)) {
+                &hidl_scan_data->results[result_idx])) {
             return false;
         }
-        hidl_scan_results.push_back(hidl_scan_result);
     }
-    hidl_scan_data->results = std::move(hidl_scan_results);
     return true;
 }
 
@@ -646,13 +651,14 @@ bool convertLegacyVectorOfCachedGscanResultsToHidl(
         return false;
     }
     *hidl_scan_datas = {};
-    for (const auto& legacy_cached_scan_result : legacy_cached_scan_results) {
-        StaScanData hidl_scan_data;
-        if (!convertLegacyCachedGscanResultsToHidl(legacy_cached_scan_result,
-                                                   &hidl_scan_data)) {
+    hidl_scan_datas->resize(legacy_cached_scan_results.size());
+    for (size_t scan_idx = 0; scan_idx < legacy_cached_scan_results.size();
+         scan_idx++) {
+        if (!convertLegacyCachedGscanResultsToHidl(
+                legacy_cached_scan_results[scan_idx],
+                &(*hidl_scan_datas)[scan_idx])) {
             return false;
         }
-        hidl_scan_datas->push_back(hidl_scan_data);
     }
     return true;
 }
@@ -2481,13 +2487,12 @@ bool convertHidlVectorOfRttConfigToLegacy(
     if (!legacy_configs) {
         return false;
     }
-    *legacy_configs = {};
-    for (const auto& hidl_config : hidl_configs) {
-        legacy_hal::wifi_rtt_config legacy_config;
-        if (!convertHidlRttConfigToLegacy(hidl_config, &legacy_config)) {
+    legacy_configs->resize(hidl_configs.size());
+    for (size_t i = 0; i < hidl_configs.size(); i++) {
+        if (!convertHidlRttConfigToLegacy(hidl_configs[i],
+                                          &(*legacy_configs)[i])) {
             return false;
         }
-        legacy_configs->push_back(legacy_config);
     }
     return true;
 }
@@ -2667,17 +2672,18 @@ bool convertLegacyRttResultToHidl(
 
 bool convertLegacyVectorOfRttResultToHidl(
     const std::vector<const legacy_hal::wifi_rtt_result*>& legacy_results,
-    std::vector<RttResult>* hidl_results) {
+    hidl_vec<RttResult>* hidl_results) {
     if (!hidl_results) {
         return false;
     }
-    *hidl_results = {};
-    for (const auto legacy_result : legacy_results) {
-        RttResult hidl_result;
-        if (!convertLegacyRttResultToHidl(*legacy_result, &hidl_result)) {
+    if (hidl_results->size() != legacy_results.size()) {
+        hidl_results->resize(legacy_results.size());
+    }
+    for (size_t i = 0; i < legacy_results.size(); i++) {
+        if (!convertLegacyRttResultToHidl(*legacy_results[i],
+                                          &(*hidl_results)[i])) {
             return false;
         }
-        hidl_results->push_back(hidl_result);
     }
     return true;
 }
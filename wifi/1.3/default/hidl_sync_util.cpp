@@ -14,10 +14,38 @@
  * limitations under the License.
  */
 
+
+#include <array>
+
 #include "hidl_sync_util.h"
 
 namespace {
+using android::hardware::wifi::V1_3::implementation::hidl_sync_util::LockId;
+
+constexpr size_t kNumLocks = static_cast<size_t>(LockId::kNumLocks);
+constexpr const char* kLockNames[kNumLocks] = {
+    "global", "chip", "sta_iface", "nan", "rtt", "ringbuffer"};
+
+// The hold time histogram of every lock, named "<lock>_hold".
+struct LockMetrics {
+    LockMetrics() {
+        for (size_t i = 0; i < kNumLocks; i++) {
+            hold[i] = registry.histogram(std::string(kLockNames[i]) + "_hold");
+        }
+    }
+
+    android::hardware::metrics::Registry registry{"wifi.lock"};
+    std::array<android::hardware::metrics::Histogram*, kNumLocks> hold;
+};
+
 std::recursive_mutex g_mutex;
+// Only the subsystem entries are used, the global lock is |g_mutex|.
+std::array<std::recursive_mutex, kNumLocks> g_subsystem_mutexes;
+
+LockMetrics& getLockMetrics() {
+    static LockMetrics metrics;
+    return metrics;
+}
 }  // namespace
 
 namespace android {
@@ -31,6 +59,21 @@ std::unique_lock<std::recursive_mutex> acquireGlobalLock() {
     return std::unique_lock<std::recursive_mutex>{g_mutex};
 }
 
+LockHoldTimer::LockHoldTimer(LockId id)
+    : histogram_(getLockMetrics().hold[static_cast<size_t>(id)]),
+      start_(std::chrono::steady_clock::now()) {}
+
+LockHoldTimer::~LockHoldTimer() {
+    histogram_->record(std::chrono::steady_clock::now() - start_);
+    // Only takes the registry lock, which is a leaf as well.
+    getLockMetrics().registry.maybeTraceHistograms();
+}
+
+SubsystemLock::SubsystemLock(LockId id)
+    : lock_(g_subsystem_mutexes[static_cast<size_t>(id)]), timer_(id) {}
+
+std::string dumpLockStats() { return getLockMetrics().registry.toString(); }
+
 }  // namespace hidl_sync_util
 }  // namespace implementation
 }  // namespace V1_3
@@ -14,13 +14,21 @@
  * limitations under the License.
  */
 
+
 #ifndef HIDL_SYNC_UTIL_H_
 #define HIDL_SYNC_UTIL_H_
 
+#include <chrono>
 #include <mutex>
+#include <string>
+
+#include <android-base/macros.h>
+#include <hal-metrics/Metrics.h>
 
 // Utility that provides a global lock to synchronize access between
-// the HIDL thread and the legacy HAL's event loop.
+// the HIDL thread and the legacy HAL's event loop, and finer grained locks for
+// the state touched by the legacy HAL's asynchronous callbacks. See
+// THREADING.README for the lock order.
 namespace android {
 namespace hardware {
 namespace wifi {
@@ -28,6 +36,51 @@ namespace V1_3 {
 namespace implementation {
 namespace hidl_sync_util {
 std::unique_lock<std::recursive_mutex> acquireGlobalLock();
+
+enum class LockId {
+    kGlobal,
+    // Subsystem locks, acquired with |SubsystemLock|.
+    kChip,
+    kStaIface,
+    kNan,
+    kRtt,
+    kRingbuffer,
+    kNumLocks
+};
+
+// Records the time between its construction and destruction in the hold time
+// histogram of the lock |id|.
+class LockHoldTimer {
+   public:
+    explicit LockHoldTimer(LockId id);
+    ~LockHoldTimer();
+
+   private:
+    ::android::hardware::metrics::Histogram* histogram_;
+    std::chrono::steady_clock::time_point start_;
+
+    DISALLOW_COPY_AND_ASSIGN(LockHoldTimer);
+};
+
+// Holds the lock of one subsystem for the scope of the object. Subsystem
+// locks are leaves: nothing else may be locked, and no callback may be
+// invoked, while holding one.
+class SubsystemLock {
+   public:
+    explicit SubsystemLock(LockId id);
+    ~SubsystemLock() = default;
+
+   private:
+    std::lock_guard<std::recursive_mutex> lock_;
+    // Destroyed before |lock_| is released.
+    LockHoldTimer timer_;
+
+    DISALLOW_COPY_AND_ASSIGN(SubsystemLock);
+};
+
+// Returns the number of acquisitions and the hold time distribution of every
+// lock.
+std::string dumpLockStats();
 }  // namespace hidl_sync_util
 }  // namespace implementation
 }  // namespace V1_3
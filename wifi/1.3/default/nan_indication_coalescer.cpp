@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <sstream>
+
+#include <android-base/logging.h>
+
+#include "nan_indication_coalescer.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+NanIndicationCoalescer::NanIndicationCoalescer(
+    std::chrono::milliseconds window)
+    : window_(window), state_(std::make_shared<State>()) {}
+
+NanIndicationCoalescer::~NanIndicationCoalescer() {
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        state_->stopping = true;
+        state_->pending.clear();
+    }
+    state_->cv.notify_all();
+    if (!thread_.joinable()) {
+        return;
+    }
+    // A delivery may drop the last reference to the iface that owns us.
+    if (thread_.get_id() == std::this_thread::get_id()) {
+        thread_.detach();
+    } else {
+        thread_.join();
+    }
+}
+
+bool NanIndicationCoalescer::isCoalescing() const {
+    return window_.count() > 0;
+}
+
+void NanIndicationCoalescer::postMatch(uint8_t session_id, uint32_t peer_id,
+                                       Clock::time_point arrival,
+                                       Delivery delivery) {
+    post({true, session_id, peer_id, arrival, std::move(delivery)});
+}
+
+void NanIndicationCoalescer::postFollowup(Clock::time_point arrival,
+                                          Delivery delivery) {
+    post({false, 0, 0, arrival, std::move(delivery)});
+}
+
+void NanIndicationCoalescer::post(Indication indication) {
+    if (!isCoalescing()) {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (indication.is_match) {
+                state_->num_matches++;
+            } else {
+                state_->num_followups++;
+            }
+        }
+        std::vector<Indication> indications;
+        indications.push_back(std::move(indication));
+        deliver(state_.get(), &indications);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->stopping) {
+            return;
+        }
+        if (indication.is_match) {
+            state_->num_matches++;
+            for (auto& pending : state_->pending) {
+                if (pending.is_match &&
+                    pending.session_id == indication.session_id &&
+                    pending.peer_id == indication.peer_id) {
+                    // Keep the position (and arrival time) of the first one,
+                    // the content of the latest.
+                    pending.delivery = std::move(indication.delivery);
+                    state_->num_duplicates++;
+                    return;
+                }
+            }
+        } else {
+            state_->num_followups++;
+        }
+        if (state_->pending.empty()) {
+            state_->batch_deadline = Clock::now() + window_;
+        }
+        state_->pending.push_back(std::move(indication));
+        // The thread is only started once there is something to deliver.
+        if (!thread_.joinable()) {
+            thread_ = std::thread(&NanIndicationCoalescer::threadLoop, state_);
+        }
+    }
+    state_->cv.notify_all();
+}
+
+void NanIndicationCoalescer::flush() {
+    if (!isCoalescing()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->batch_deadline = Clock::now();
+    state_->cv.notify_all();
+    state_->cv.wait(lock, [this] {
+        return state_->stopping ||
+               (state_->pending.empty() && !state_->delivering);
+    });
+}
+
+void NanIndicationCoalescer::clear() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->pending.clear();
+    state_->cv.notify_all();
+}
+
+std::string NanIndicationCoalescer::dumpStats() {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::ostringstream ss;
+    ss << "  coalescing window: " << window_.count() << "ms\n"
+       << "  matches: " << state_->num_matches
+       << ", duplicates dropped: " << state_->num_duplicates
+       << ", followups: " << state_->num_followups << "\n"
+       << "  delivered: " << state_->num_delivered
+       << " in batches: " << state_->num_batches << "\n";
+    if (state_->num_delivered > 0) {
+        ss << "  latency avg: "
+           << duration_cast<microseconds>(state_->total_latency).count() /
+                  state_->num_delivered
+           << "us, max: "
+           << duration_cast<microseconds>(state_->max_latency).count()
+           << "us\n";
+    }
+    return ss.str();
+}
+
+void NanIndicationCoalescer::threadLoop(std::shared_ptr<State> state) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        state->cv.wait(lock, [&state] {
+            return !state->pending.empty() || state->stopping;
+        });
+        if (state->stopping) {
+            break;
+        }
+        // Let the burst build up; |batch_deadline| moves up on a flush.
+        state->cv.wait_until(lock, state->batch_deadline, [&state] {
+            return state->stopping || state->pending.empty() ||
+                   Clock::now() >= state->batch_deadline;
+        });
+        if (state->stopping) {
+            break;
+        }
+        if (state->pending.empty()) {
+            continue;
+        }
+        std::vector<Indication> batch = std::move(state->pending);
+        state->pending.clear();
+        state->delivering = true;
+        lock.unlock();
+
+        deliver(state.get(), &batch);
+        // Destroy the closures, and with them possibly the iface, unlocked.
+        batch.clear();
+
+        lock.lock();
+        state->delivering = false;
+        state->cv.notify_all();
+    }
+}
+
+void NanIndicationCoalescer::deliver(State* state,
+                                     std::vector<Indication>* indications) {
+    Clock::duration total_latency = Clock::duration::zero();
+    Clock::duration max_latency = Clock::duration::zero();
+    for (auto& indication : *indications) {
+        const Clock::duration latency = Clock::now() - indication.arrival;
+        total_latency += latency;
+        max_latency = std::max(max_latency, latency);
+        indication.delivery();
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->num_batches++;
+    state->num_delivered += indications->size();
+    state->total_latency += total_latency;
+    state->max_latency = std::max(state->max_latency, max_latency);
+}
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
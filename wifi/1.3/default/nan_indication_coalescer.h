@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NAN_INDICATION_COALESCER_H_
+#define NAN_INDICATION_COALESCER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+/**
+ * Batches the NAN discovery indications (matches and followups) that arrive
+ * within |window| of each other and delivers them from a background thread in
+ * a single pass.
+ *
+ * A match from a peer that already has a match pending for the same discovery
+ * session replaces the pending one in place, so the framework only sees the
+ * latest. Followups carry distinct payloads and are never dropped. Indications
+ * are delivered in the order they first arrived.
+ *
+ * With a zero |window| every indication is delivered right away on the
+ * caller's thread; only the latency statistics are kept in that mode.
+ */
+class NanIndicationCoalescer {
+   public:
+    using Clock = std::chrono::steady_clock;
+    // Invokes the HIDL callbacks for one indication.
+    using Delivery = std::function<void()>;
+
+    explicit NanIndicationCoalescer(std::chrono::milliseconds window);
+    // Drops the indications that are still pending.
+    ~NanIndicationCoalescer();
+
+    bool isCoalescing() const;
+    // |arrival| is when the indication was received from the legacy HAL.
+    void postMatch(uint8_t session_id, uint32_t peer_id,
+                   Clock::time_point arrival, Delivery delivery);
+    void postFollowup(Clock::time_point arrival, Delivery delivery);
+    // Delivers the pending indications before returning.
+    void flush();
+    // Drops the pending indications.
+    void clear();
+    std::string dumpStats();
+
+   private:
+    struct Indication {
+        bool is_match;
+        uint8_t session_id;
+        uint32_t peer_id;
+        Clock::time_point arrival;
+        Delivery delivery;
+    };
+    // Shared with the thread, which may outlive the coalescer when the last
+    // reference to the iface is dropped from a delivery.
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Indication> pending;
+        Clock::time_point batch_deadline;
+        bool delivering = false;
+        bool stopping = false;
+        uint64_t num_matches = 0;
+        uint64_t num_followups = 0;
+        uint64_t num_duplicates = 0;
+        uint64_t num_batches = 0;
+        uint64_t num_delivered = 0;
+        Clock::duration total_latency = Clock::duration::zero();
+        Clock::duration max_latency = Clock::duration::zero();
+    };
+
+    static void threadLoop(std::shared_ptr<State> state);
+    static void deliver(State* state, std::vector<Indication>* indications);
+    void post(Indication indication);
+
+    const std::chrono::milliseconds window_;
+    std::shared_ptr<State> state_;
+    std::thread thread_;
+
+    DISALLOW_COPY_AND_ASSIGN(NanIndicationCoalescer);
+};
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+#endif  // NAN_INDICATION_COALESCER_H_
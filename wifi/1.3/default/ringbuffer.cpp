@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
+#include <algorithm>
+
 #include <android-base/logging.h>
 
 #include "ringbuffer.h"
@@ -24,7 +28,8 @@ namespace wifi {
 namespace V1_3 {
 namespace implementation {
 
-Ringbuffer::Ringbuffer(size_t maxSize) : size_(0), maxSize_(maxSize) {}
+Ringbuffer::Ringbuffer(size_t maxSize)
+    : head_(0), size_(0), maxSize_(maxSize) {}
 
 void Ringbuffer::append(const std::vector<uint8_t>& input) {
     if (input.size() == 0) {
@@ -35,18 +40,46 @@ void Ringbuffer::append(const std::vector<uint8_t>& input) {
                   << " bytes is dropped";
         return;
     }
-    data_.push_back(input);
-    size_ += input.size() * sizeof(input[0]);
-    while (size_ > maxSize_) {
-        size_ -= data_.front().size() * sizeof(data_.front()[0]);
-        data_.pop_front();
+    if (buffer_.empty()) {
+        buffer_.resize(maxSize_);
     }
+    while (size_ + input.size() > maxSize_) {
+        head_ = (head_ + record_sizes_.front()) % maxSize_;
+        size_ -= record_sizes_.front();
+        record_sizes_.pop_front();
+    }
+    const size_t tail = (head_ + size_) % maxSize_;
+    const size_t first = std::min(input.size(), maxSize_ - tail);
+    memcpy(buffer_.data() + tail, input.data(), first);
+    memcpy(buffer_.data(), input.data() + first, input.size() - first);
+    record_sizes_.push_back(input.size());
+    size_ += input.size();
 }
 
-const std::list<std::vector<uint8_t>>& Ringbuffer::getData() const {
-    return data_;
+std::vector<std::vector<uint8_t>> Ringbuffer::getData() const {
+    std::vector<std::vector<uint8_t>> records;
+    records.reserve(record_sizes_.size());
+    size_t offset = head_;
+    for (size_t record_size : record_sizes_) {
+        const size_t first = std::min(record_size, maxSize_ - offset);
+        std::vector<uint8_t> record(buffer_.begin() + offset,
+                                    buffer_.begin() + offset + first);
+        record.insert(record.end(), buffer_.begin(),
+                      buffer_.begin() + (record_size - first));
+        records.push_back(std::move(record));
+        offset = (offset + record_size) % maxSize_;
+    }
+    return records;
 }
 
+std::array<Ringbuffer::Segment, 2> Ringbuffer::getSegments() const {
+    const size_t first = std::min(size_, maxSize_ - head_);
+    return {{{buffer_.data() + head_, first},
+             {buffer_.data(), size_ - first}}};
+}
+
+bool Ringbuffer::empty() const { return size_ == 0; }
+
 }  // namespace implementation
 }  // namespace V1_3
 }  // namespace wifi
@@ -17,7 +17,8 @@
 #ifndef RINGBUFFER_H_
 #define RINGBUFFER_H_
 
-#include <list>
+#include <array>
+#include <deque>
 #include <vector>
 
 namespace android {
@@ -28,18 +29,36 @@ namespace implementation {
 
 /**
  * Ringbuffer object used to store debug data.
+ *
+ * Records are stored back to back in a single byte ring of |maxSize| bytes,
+ * allocated on the first append. Record lengths are kept on the side so that
+ * the stored bytes can be dumped as is.
  */
 class Ringbuffer {
    public:
+    // Contiguous piece of the stored data.
+    struct Segment {
+        const uint8_t* data;
+        size_t size;
+    };
+
     explicit Ringbuffer(size_t maxSize);
 
     // Appends the data buffer and deletes from the front until buffer is
     // within |maxSize_|.
     void append(const std::vector<uint8_t>& input);
-    const std::list<std::vector<uint8_t>>& getData() const;
+    // Returns a copy of the stored records, oldest first.
+    std::vector<std::vector<uint8_t>> getData() const;
+    // Returns the stored bytes, oldest first, as at most two segments. The
+    // second segment is empty unless the data wraps around the end of the
+    // ring.
+    std::array<Segment, 2> getSegments() const;
+    bool empty() const;
 
    private:
-    std::list<std::vector<uint8_t>> data_;
+    std::vector<uint8_t> buffer_;
+    std::deque<size_t> record_sizes_;
+    size_t head_;
     size_t size_;
     size_t maxSize_;
 };
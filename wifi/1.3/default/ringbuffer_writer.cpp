@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+
+#include "ringbuffer_writer.h"
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+RingbufferWriter::RingbufferWriter(WriteFunction write_function)
+    : write_function_(std::move(write_function)),
+      has_pending_(false),
+      writing_(false),
+      last_write_ok_(true),
+      stopping_(false) {}
+
+RingbufferWriter::~RingbufferWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void RingbufferWriter::post(Snapshot snapshot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = std::move(snapshot);
+        has_pending_ = true;
+        // The thread is only started once there is something to write.
+        if (!thread_.joinable()) {
+            thread_ = std::thread(&RingbufferWriter::threadLoop, this);
+        }
+    }
+    cv_.notify_all();
+}
+
+bool RingbufferWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !has_pending_ && !writing_; });
+    return last_write_ok_;
+}
+
+void RingbufferWriter::threadLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this] { return has_pending_ || stopping_; });
+        if (!has_pending_) {
+            break;
+        }
+        Snapshot snapshot = std::move(pending_);
+        pending_.clear();
+        has_pending_ = false;
+        writing_ = true;
+        lock.unlock();
+
+        const bool ok = write_function_(snapshot);
+        if (!ok) {
+            LOG(ERROR) << "Error writing ring buffer files to flash";
+        }
+
+        lock.lock();
+        writing_ = false;
+        last_write_ok_ = ok;
+        cv_.notify_all();
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
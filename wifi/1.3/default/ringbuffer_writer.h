@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RINGBUFFER_WRITER_H_
+#define RINGBUFFER_WRITER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+/**
+ * Writes snapshots of the debug ring buffers from a background thread, so
+ * that HIDL calls don't wait on the flash.
+ *
+ * At most one snapshot is pending at any time: a newer snapshot replaces one
+ * that has not been picked up by the thread yet, since it holds the same
+ * data or more.
+ */
+class RingbufferWriter {
+   public:
+    // Ring name and the bytes stored in that ring.
+    using Snapshot = std::vector<std::pair<std::string, std::vector<uint8_t>>>;
+    using WriteFunction = std::function<bool(const Snapshot&)>;
+
+    explicit RingbufferWriter(WriteFunction write_function);
+    // Writes the pending snapshot, if any, before returning.
+    ~RingbufferWriter();
+
+    // Queues |snapshot| for writing and returns immediately.
+    void post(Snapshot snapshot);
+    // Waits until every posted snapshot is written. Returns false if the last
+    // write failed.
+    bool flush();
+
+   private:
+    void threadLoop();
+
+    WriteFunction write_function_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    Snapshot pending_;
+    bool has_pending_;
+    bool writing_;
+    bool last_write_ok_;
+    bool stopping_;
+
+    DISALLOW_COPY_AND_ASSIGN(RingbufferWriter);
+};
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+#endif  // RINGBUFFER_WRITER_H_
@@ -50,10 +50,14 @@ int main(int /*argc*/, char** argv) {
 
     const auto iface_tool =
         std::make_shared<android::wifi_system::InterfaceTool>();
+    const auto legacy_hal = std::make_shared<WifiLegacyHal>(iface_tool);
+    // Resolve the vendor function table while waiting for the first
+    // IWifi::start(), which is mostly right after a lazy launch.
+    legacy_hal->initializeAsync();
     // Setup hwbinder service
     android::sp<android::hardware::wifi::V1_3::IWifi> service =
         new android::hardware::wifi::V1_3::implementation::Wifi(
-            iface_tool, std::make_shared<WifiLegacyHal>(iface_tool),
+            iface_tool, legacy_hal,
             std::make_shared<WifiModeController>(),
             std::make_shared<WifiIfaceUtil>(iface_tool),
             std::make_shared<WifiFeatureFlags>());
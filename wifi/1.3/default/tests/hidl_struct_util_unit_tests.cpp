@@ -289,6 +289,78 @@ TEST_F(HidlStructUtilTest, CanConvertLegacyFeaturesToHidl) {
                   HidlChipCaps::DEBUG_MEMORY_DRIVER_DUMP,
               hidle_caps);
 }
+
+TEST_F(HidlStructUtilTest, CanConvertLegacyGscanResultWithIesToHidl) {
+    // An SSID IE followed by an empty vendor specific IE.
+    const std::vector<uint8_t> ies = {0, 3, 'a', 'b', 'c', 221, 0};
+    std::vector<uint8_t> legacy_storage(sizeof(legacy_hal::wifi_scan_result) +
+                                        ies.size());
+    auto* legacy_scan_result =
+        reinterpret_cast<legacy_hal::wifi_scan_result*>(legacy_storage.data());
+    strcpy(legacy_scan_result->ssid, "abc");
+    legacy_scan_result->ie_length = ies.size();
+    memcpy(legacy_scan_result->ie_data, ies.data(), ies.size());
+
+    StaScanResult hidl_scan_result;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_scan_result, true, &hidl_scan_result));
+    EXPECT_EQ(std::vector<uint8_t>({'a', 'b', 'c'}),
+              std::vector<uint8_t>(hidl_scan_result.ssid));
+    ASSERT_EQ(2u, hidl_scan_result.informationElements.size());
+    EXPECT_EQ(0u, hidl_scan_result.informationElements[0].id);
+    EXPECT_EQ(std::vector<uint8_t>({'a', 'b', 'c'}),
+              std::vector<uint8_t>(
+                  hidl_scan_result.informationElements[0].data));
+    EXPECT_EQ(221u, hidl_scan_result.informationElements[1].id);
+    EXPECT_EQ(0u, hidl_scan_result.informationElements[1].data.size());
+
+    // Cached results are converted without their IEs.
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_scan_result, false, &hidl_scan_result));
+    EXPECT_EQ(0u, hidl_scan_result.informationElements.size());
+}
+
+TEST_F(HidlStructUtilTest, TruncatedIeIsDroppedFromLegacyGscanResult) {
+    const std::vector<uint8_t> ies = {0, 1, 'a', 221, 5, 'b'};
+    std::vector<uint8_t> legacy_storage(sizeof(legacy_hal::wifi_scan_result) +
+                                        ies.size());
+    auto* legacy_scan_result =
+        reinterpret_cast<legacy_hal::wifi_scan_result*>(legacy_storage.data());
+    legacy_scan_result->ie_length = ies.size();
+    memcpy(legacy_scan_result->ie_data, ies.data(), ies.size());
+
+    StaScanResult hidl_scan_result;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyGscanResultToHidl(
+        *legacy_scan_result, true, &hidl_scan_result));
+    ASSERT_EQ(1u, hidl_scan_result.informationElements.size());
+    EXPECT_EQ(0u, hidl_scan_result.informationElements[0].id);
+}
+
+TEST_F(HidlStructUtilTest, RttResultBufferIsReusedForSameBatchSize) {
+    legacy_hal::wifi_rtt_result legacy_results[2] = {};
+    legacy_results[0].distance_mm = 1000;
+    legacy_results[1].distance_mm = 2000;
+    const std::vector<const legacy_hal::wifi_rtt_result*> batch = {
+        &legacy_results[0], &legacy_results[1]};
+
+    hidl_vec<RttResult> hidl_results;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfRttResultToHidl(
+        batch, &hidl_results));
+    ASSERT_EQ(2u, hidl_results.size());
+    const RttResult* buffer = hidl_results.data();
+
+    legacy_results[0].distance_mm = 3000;
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfRttResultToHidl(
+        batch, &hidl_results));
+    EXPECT_EQ(buffer, hidl_results.data());
+    EXPECT_EQ(3000, hidl_results[0].distanceInMm);
+    EXPECT_EQ(2000, hidl_results[1].distanceInMm);
+
+    ASSERT_TRUE(hidl_struct_util::convertLegacyVectorOfRttResultToHidl(
+        {batch[1]}, &hidl_results));
+    ASSERT_EQ(1u, hidl_results.size());
+    EXPECT_EQ(2000, hidl_results[0].distanceInMm);
+}
 }  // namespace implementation
 }  // namespace V1_3
 }  // namespace wifi
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+
+#include "nan_indication_coalescer.h"
+
+using testing::ElementsAre;
+using testing::Test;
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+class NanIndicationCoalescerTest : public Test {
+   public:
+    NanIndicationCoalescer::Delivery record(int value) {
+        return [this, value]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            delivered_.push_back(value);
+        };
+    }
+
+    std::vector<int> delivered() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return delivered_;
+    }
+
+    const NanIndicationCoalescer::Clock::time_point now_ =
+        NanIndicationCoalescer::Clock::now();
+    std::mutex mutex_;
+    std::vector<int> delivered_;
+};
+
+TEST_F(NanIndicationCoalescerTest, DeliversRightAwayWithoutWindow) {
+    NanIndicationCoalescer coalescer(std::chrono::milliseconds(0));
+    EXPECT_FALSE(coalescer.isCoalescing());
+    coalescer.postMatch(1, 2, now_, record(1));
+    coalescer.postMatch(1, 2, now_, record(2));
+    coalescer.postFollowup(now_, record(3));
+    EXPECT_THAT(delivered(), ElementsAre(1, 2, 3));
+}
+
+TEST_F(NanIndicationCoalescerTest, HoldsIndicationsForTheWindow) {
+    NanIndicationCoalescer coalescer(std::chrono::hours(1));
+    EXPECT_TRUE(coalescer.isCoalescing());
+    coalescer.postMatch(1, 2, now_, record(1));
+    coalescer.postFollowup(now_, record(2));
+    EXPECT_TRUE(delivered().empty());
+    coalescer.flush();
+    EXPECT_THAT(delivered(), ElementsAre(1, 2));
+}
+
+TEST_F(NanIndicationCoalescerTest, DeliversOnceTheWindowElapses) {
+    NanIndicationCoalescer coalescer(std::chrono::milliseconds(1));
+    coalescer.postMatch(1, 2, now_, record(1));
+    for (int i = 0; i < 1000 && delivered().empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_THAT(delivered(), ElementsAre(1));
+}
+
+TEST_F(NanIndicationCoalescerTest, RepeatedMatchReplacesPendingOne) {
+    NanIndicationCoalescer coalescer(std::chrono::hours(1));
+    coalescer.postMatch(1, 2, now_, record(1));
+    coalescer.postMatch(1, 3, now_, record(2));
+    coalescer.postMatch(2, 2, now_, record(3));
+    coalescer.postMatch(1, 2, now_, record(4));
+    coalescer.flush();
+    EXPECT_THAT(delivered(), ElementsAre(4, 2, 3));
+}
+
+TEST_F(NanIndicationCoalescerTest, FollowupsAreNotDeduplicated) {
+    NanIndicationCoalescer coalescer(std::chrono::hours(1));
+    coalescer.postFollowup(now_, record(1));
+    coalescer.postFollowup(now_, record(2));
+    coalescer.flush();
+    EXPECT_THAT(delivered(), ElementsAre(1, 2));
+}
+
+TEST_F(NanIndicationCoalescerTest, ClearDropsPendingIndications) {
+    NanIndicationCoalescer coalescer(std::chrono::hours(1));
+    coalescer.postMatch(1, 2, now_, record(1));
+    coalescer.clear();
+    coalescer.flush();
+    EXPECT_TRUE(delivered().empty());
+}
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
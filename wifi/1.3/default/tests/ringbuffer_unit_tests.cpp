@@ -90,6 +90,30 @@ TEST_F(RingbufferTest, OversizedAppendDoesNotDropExistingData) {
     ASSERT_EQ(1u, buffer_.getData().size());
     EXPECT_EQ(input, buffer_.getData().front());
 }
+
+TEST_F(RingbufferTest, RecordsWrapAroundBufferEnd) {
+    const std::vector<uint8_t> input(maxBufferSize_ / 2 + 1, '0');
+    const std::vector<uint8_t> input2(maxBufferSize_ / 2 + 1, '1');
+    const std::vector<uint8_t> input3 = {'2', '3', '4'};
+    buffer_.append(input);
+    buffer_.append(input2);
+    buffer_.append(input3);
+    ASSERT_EQ(2u, buffer_.getData().size());
+    EXPECT_EQ(input2, buffer_.getData().front());
+    EXPECT_EQ(input3, buffer_.getData().back());
+}
+
+TEST_F(RingbufferTest, SegmentsCoverStoredDataInOrder) {
+    const std::vector<uint8_t> input(maxBufferSize_ / 2 + 1, '0');
+    const std::vector<uint8_t> input2(maxBufferSize_ / 2 + 1, '1');
+    buffer_.append(input);
+    buffer_.append(input2);
+    std::vector<uint8_t> dumped;
+    for (const auto& segment : buffer_.getSegments()) {
+        dumped.insert(dumped.end(), segment.data, segment.data + segment.size);
+    }
+    EXPECT_EQ(input2, dumped);
+}
 }  // namespace implementation
 }  // namespace V1_3
 }  // namespace wifi
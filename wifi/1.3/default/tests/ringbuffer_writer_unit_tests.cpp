@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+
+#include "ringbuffer_writer.h"
+
+using testing::Test;
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+
+class RingbufferWriterTest : public Test {
+   public:
+    bool write(const RingbufferWriter::Snapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        written_.push_back(snapshot);
+        return write_result_;
+    }
+
+    std::mutex mutex_;
+    std::vector<RingbufferWriter::Snapshot> written_;
+    bool write_result_ = true;
+};
+
+TEST_F(RingbufferWriterTest, FlushWithoutPostSucceeds) {
+    RingbufferWriter writer(
+        [this](const RingbufferWriter::Snapshot& s) { return write(s); });
+    EXPECT_TRUE(writer.flush());
+    EXPECT_TRUE(written_.empty());
+}
+
+TEST_F(RingbufferWriterTest, PostedSnapshotIsWritten) {
+    const RingbufferWriter::Snapshot snapshot = {{"ring", {'0', '1'}}};
+    RingbufferWriter writer(
+        [this](const RingbufferWriter::Snapshot& s) { return write(s); });
+    writer.post(snapshot);
+    EXPECT_TRUE(writer.flush());
+    ASSERT_EQ(1u, written_.size());
+    EXPECT_EQ(snapshot, written_.back());
+}
+
+TEST_F(RingbufferWriterTest, FlushReportsWriteFailure) {
+    write_result_ = false;
+    RingbufferWriter writer(
+        [this](const RingbufferWriter::Snapshot& s) { return write(s); });
+    writer.post({{"ring", {'0'}}});
+    EXPECT_FALSE(writer.flush());
+}
+
+TEST_F(RingbufferWriterTest, PendingSnapshotIsWrittenOnDestruction) {
+    const RingbufferWriter::Snapshot snapshot = {{"ring", {'0'}}};
+    {
+        RingbufferWriter writer(
+            [this](const RingbufferWriter::Snapshot& s) { return write(s); });
+        writer.post(snapshot);
+    }
+    ASSERT_FALSE(written_.empty());
+    EXPECT_EQ(snapshot, written_.back());
+}
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
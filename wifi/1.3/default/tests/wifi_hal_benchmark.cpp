@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the overhead the HAL adds to the HIDL methods (locking,
+// validateAndCall and the struct conversions), with the legacy HAL function
+// table resolved to wifi_legacy_hal_stubs. The few entries the measured
+// methods depend on are replaced by fakes that hand back canned data, so that
+// the conversions run too.
+//
+// Every benchmark takes two arguments: the rate (events per second) at which
+// a thread playing the legacy HAL event loop injects gscan full results and
+// ring buffer data, and whether it holds the global lock while doing so, as
+// the legacy HAL used to before the subsystem locks.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#include <android-base/logging.h>
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+
+#undef NAN  // This is weird, NAN is defined in bionic/libc/include/math.h:38
+#include "hidl_sync_util.h"
+#include "wifi_chip.h"
+#include "wifi_nan_iface.h"
+#include "wifi_sta_iface.h"
+
+#include "mock_interface_tool.h"
+#include "mock_wifi_feature_flags.h"
+#include "mock_wifi_iface_util.h"
+#include "mock_wifi_mode_controller.h"
+
+using testing::NiceMock;
+
+namespace android {
+namespace hardware {
+namespace wifi {
+namespace V1_3 {
+namespace implementation {
+namespace {
+constexpr char kIfaceName[] = "wlan0";
+constexpr char kRingName[] = "benchmark_ring";
+constexpr uint32_t kNumRings = 4;
+constexpr size_t kRingDataSize = 256;
+
+// Handlers the HAL hands to the fake legacy HAL functions.
+legacy_hal::wifi_request_id gscan_id;
+legacy_hal::wifi_scan_result_handler gscan_handler;
+legacy_hal::wifi_ring_buffer_data_handler ring_buffer_handler;
+
+void overrideStubs(legacy_hal::wifi_hal_fn* fn) {
+    fn->wifi_get_supported_feature_set = [](legacy_hal::wifi_interface_handle,
+                                            legacy_hal::feature_set* set) {
+        *set = WIFI_FEATURE_INFRA | WIFI_FEATURE_GSCAN |
+               WIFI_FEATURE_LINK_LAYER_STATS | WIFI_FEATURE_RSSI_MONITOR;
+        return legacy_hal::WIFI_SUCCESS;
+    };
+    fn->wifi_get_logger_supported_feature_set =
+        [](legacy_hal::wifi_interface_handle, unsigned int* support) {
+            *support = legacy_hal::WIFI_LOGGER_MEMORY_DUMP_SUPPORTED;
+            return legacy_hal::WIFI_SUCCESS;
+        };
+    fn->wifi_get_ring_buffers_status =
+        [](legacy_hal::wifi_interface_handle, uint32_t* num_rings,
+           legacy_hal::wifi_ring_buffer_status* status) {
+            *num_rings = kNumRings;
+            for (uint32_t i = 0; i < kNumRings; i++) {
+                status[i] = {};
+                snprintf(reinterpret_cast<char*>(status[i].name),
+                         sizeof(status[i].name), "ring%u", i);
+                status[i].ring_buffer_byte_size = 1024 * 1024;
+            }
+            return legacy_hal::WIFI_SUCCESS;
+        };
+    fn->wifi_set_log_handler =
+        [](legacy_hal::wifi_request_id, legacy_hal::wifi_interface_handle,
+           legacy_hal::wifi_ring_buffer_data_handler handler) {
+            ring_buffer_handler = handler;
+            return legacy_hal::WIFI_SUCCESS;
+        };
+    fn->wifi_start_logging = [](legacy_hal::wifi_interface_handle, uint32_t,
+                                uint32_t, uint32_t, uint32_t, char*) {
+        return legacy_hal::WIFI_SUCCESS;
+    };
+    fn->wifi_start_gscan = [](legacy_hal::wifi_request_id id,
+                              legacy_hal::wifi_interface_handle,
+                              legacy_hal::wifi_scan_cmd_params,
+                              legacy_hal::wifi_scan_result_handler handler) {
+        gscan_id = id;
+        gscan_handler = handler;
+        return legacy_hal::WIFI_SUCCESS;
+    };
+    fn->wifi_get_link_stats =
+        [](legacy_hal::wifi_request_id id, legacy_hal::wifi_interface_handle,
+           legacy_hal::wifi_stats_result_handler handler) {
+            legacy_hal::wifi_iface_stat iface_stat = {};
+            iface_stat.beacon_rx = 100;
+            iface_stat.rssi_mgmt = -50;
+            legacy_hal::wifi_radio_stat radio_stat = {};
+            radio_stat.on_time = 1000;
+            radio_stat.tx_time = 100;
+            handler.on_link_stats_results(id, &iface_stat, 1, &radio_stat);
+            return legacy_hal::WIFI_SUCCESS;
+        };
+    fn->wifi_nan_register_handler = [](legacy_hal::wifi_interface_handle,
+                                       legacy_hal::NanCallbackHandler) {
+        return legacy_hal::WIFI_SUCCESS;
+    };
+    fn->wifi_nan_get_capabilities = [](legacy_hal::transaction_id,
+                                       legacy_hal::wifi_interface_handle) {
+        return legacy_hal::WIFI_SUCCESS;
+    };
+}
+
+// The HAL objects, shared by all the benchmarks.
+class HalObjects {
+   public:
+    static HalObjects& get() {
+        static HalObjects* objects = new HalObjects();
+        return *objects;
+    }
+
+    sp<WifiChip> chip;
+    sp<WifiStaIface> sta_iface;
+    sp<WifiNanIface> nan_iface;
+
+   private:
+    HalObjects() {
+        // Every call has to reach the (fake) driver.
+        property_set("vendor.wifi.link_layer_stats_cache_ms", "0");
+        CHECK_EQ(legacy_hal::WIFI_SUCCESS,
+                 legacy_hal_->initializeWithStubs(overrideStubs));
+        chip = new WifiChip(0, legacy_hal_, mode_controller_, iface_util_,
+                            feature_flags_);
+        sta_iface = new WifiStaIface(kIfaceName, legacy_hal_, iface_util_);
+        nan_iface = new WifiNanIface(kIfaceName, legacy_hal_, iface_util_);
+
+        chip->startLoggingToDebugRingBuffer(
+            kRingName, WifiDebugRingBufferVerboseLevel::DEFAULT, 0, 0,
+            [](const WifiStatus& status) {
+                CHECK(status.code == WifiStatusCode::SUCCESS);
+            });
+        sta_iface->startBackgroundScan(
+            1, {}, [](const WifiStatus& status) {
+                CHECK(status.code == WifiStatusCode::SUCCESS);
+            });
+    }
+
+    std::shared_ptr<NiceMock<wifi_system::MockInterfaceTool>> iface_tool_{
+        new NiceMock<wifi_system::MockInterfaceTool>};
+    std::shared_ptr<legacy_hal::WifiLegacyHal> legacy_hal_{
+        new legacy_hal::WifiLegacyHal(iface_tool_)};
+    std::shared_ptr<NiceMock<mode_controller::MockWifiModeController>>
+        mode_controller_{new NiceMock<mode_controller::MockWifiModeController>};
+    std::shared_ptr<NiceMock<iface_util::MockWifiIfaceUtil>> iface_util_{
+        new NiceMock<iface_util::MockWifiIfaceUtil>(iface_tool_)};
+    std::shared_ptr<NiceMock<feature_flags::MockWifiFeatureFlags>>
+        feature_flags_{new NiceMock<feature_flags::MockWifiFeatureFlags>};
+};
+
+// Plays the legacy HAL event loop thread: alternately delivers a gscan full
+// result and ring buffer data, |rate| times per second in total.
+class EventInjector {
+   public:
+    EventInjector(int64_t rate, bool hold_global_lock)
+        : hold_global_lock_(hold_global_lock), stopping_(false) {
+        if (rate <= 0) {
+            return;
+        }
+        thread_ = std::thread([this, rate]() {
+            const auto period = std::chrono::nanoseconds(1000000000 / rate);
+            auto next = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; !stopping_; i++) {
+                injectEvent(i % 2 == 0);
+                next += period;
+                std::this_thread::sleep_until(next);
+            }
+        });
+    }
+
+    ~EventInjector() {
+        stopping_ = true;
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    uint64_t numEvents() const { return num_events_; }
+
+   private:
+    void injectEvent(bool scan_result) {
+        std::unique_lock<std::recursive_mutex> lock;
+        if (hold_global_lock_) {
+            lock = hidl_sync_util::acquireGlobalLock();
+        }
+        if (scan_result) {
+            legacy_hal::wifi_scan_result result = {};
+            strcpy(result.ssid, "benchmark");
+            result.rssi = -60;
+            gscan_handler.on_full_scan_result(gscan_id, &result, 1);
+        } else {
+            char data[kRingDataSize] = {};
+            legacy_hal::wifi_ring_buffer_status status = {};
+            strcpy(reinterpret_cast<char*>(status.name), kRingName);
+            ring_buffer_handler.on_ring_buffer_data(
+                const_cast<char*>(kRingName), data, sizeof(data), &status);
+        }
+        num_events_++;
+    }
+
+    const bool hold_global_lock_;
+    std::atomic<bool> stopping_;
+    std::atomic<uint64_t> num_events_{0};
+    std::thread thread_;
+};
+
+// Runs |call| in the benchmark loop while events are being injected.
+template <typename Call>
+void runWithEvents(benchmark::State& state, Call call) {
+    HalObjects::get();
+    EventInjector injector(state.range(0), state.range(1) != 0);
+    for (auto _ : state) {
+        call();
+    }
+    state.counters["events"] = injector.numEvents();
+}
+
+void EventArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"event_rate", "event_holds_global_lock"});
+    b->Args({0, 0});
+    for (int64_t rate : {1000, 10000, 100000}) {
+        b->Args({rate, 0});
+        b->Args({rate, 1});
+    }
+}
+}  // namespace
+
+void BM_GlobalLock(benchmark::State& state) {
+    runWithEvents(state, []() {
+        const auto lock = hidl_sync_util::acquireGlobalLock();
+        benchmark::DoNotOptimize(lock.owns_lock());
+    });
+}
+BENCHMARK(BM_GlobalLock)->Apply(EventArgs);
+
+void BM_SubsystemLock(benchmark::State& state) {
+    runWithEvents(state, []() {
+        const hidl_sync_util::SubsystemLock lock(
+            hidl_sync_util::LockId::kStaIface);
+    });
+}
+BENCHMARK(BM_SubsystemLock)->Apply(EventArgs);
+
+// validateAndCall with the cheapest worker function.
+void BM_StaIface_getName(benchmark::State& state) {
+    const auto& sta_iface = HalObjects::get().sta_iface;
+    runWithEvents(state, [&sta_iface]() {
+        sta_iface->getName([](const WifiStatus&, const hidl_string& name) {
+            benchmark::DoNotOptimize(name.size());
+        });
+    });
+}
+BENCHMARK(BM_StaIface_getName)->Apply(EventArgs);
+
+void BM_StaIface_getCapabilities(benchmark::State& state) {
+    const auto& sta_iface = HalObjects::get().sta_iface;
+    runWithEvents(state, [&sta_iface]() {
+        sta_iface->getCapabilities([](const WifiStatus&, uint32_t caps) {
+            benchmark::DoNotOptimize(caps);
+        });
+    });
+}
+BENCHMARK(BM_StaIface_getCapabilities)->Apply(EventArgs);
+
+void BM_StaIface_getLinkLayerStats(benchmark::State& state) {
+    const auto& sta_iface = HalObjects::get().sta_iface;
+    runWithEvents(state, [&sta_iface]() {
+        sta_iface->getLinkLayerStats_1_3(
+            [](const WifiStatus&, const V1_3::StaLinkLayerStats& stats) {
+                benchmark::DoNotOptimize(stats.timeStampInMs);
+            });
+    });
+}
+BENCHMARK(BM_StaIface_getLinkLayerStats)->Apply(EventArgs);
+
+void BM_Chip_getCapabilities(benchmark::State& state) {
+    const auto& chip = HalObjects::get().chip;
+    runWithEvents(state, [&chip]() {
+        chip->getCapabilities_1_3([](const WifiStatus&, uint32_t caps) {
+            benchmark::DoNotOptimize(caps);
+        });
+    });
+}
+BENCHMARK(BM_Chip_getCapabilities)->Apply(EventArgs);
+
+void BM_Chip_getDebugRingBuffersStatus(benchmark::State& state) {
+    const auto& chip = HalObjects::get().chip;
+    runWithEvents(state, [&chip]() {
+        chip->getDebugRingBuffersStatus(
+            [](const WifiStatus&,
+               const hidl_vec<WifiDebugRingBufferStatus>& status) {
+                benchmark::DoNotOptimize(status.size());
+            });
+    });
+}
+BENCHMARK(BM_Chip_getDebugRingBuffersStatus)->Apply(EventArgs);
+
+void BM_NanIface_getCapabilitiesRequest(benchmark::State& state) {
+    const auto& nan_iface = HalObjects::get().nan_iface;
+    runWithEvents(state, [&nan_iface]() {
+        nan_iface->getCapabilitiesRequest(1, [](const WifiStatus& status) {
+            benchmark::DoNotOptimize(status.code);
+        });
+    });
+}
+BENCHMARK(BM_NanIface_getCapabilitiesRequest)->Apply(EventArgs);
+
+}  // namespace implementation
+}  // namespace V1_3
+}  // namespace wifi
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -16,6 +16,8 @@
 
 #include <fcntl.h>
 
+#include <sstream>
+
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <cutils/properties.h>
@@ -41,6 +43,7 @@ constexpr size_t kMaxBufferSizeBytes = 1024 * 1024 * 3;
 constexpr uint32_t kMaxRingBufferFileAgeSeconds = 60 * 60 * 10;
 constexpr uint32_t kMaxRingBufferFileNum = 20;
 constexpr char kTombstoneFolderPath[] = "/data/vendor/tombstones/wifi/";
+constexpr char kHalStatsFileName[] = "hal_stats";
 constexpr char kActiveWlanIfaceNameProperty[] = "wifi.active.interface";
 constexpr char kNoActiveWlanIfaceNamePropertyValue[] = "";
 constexpr unsigned kMaxWlanIfaces = 5;
@@ -302,6 +305,54 @@ std::vector<char> makeCharVec(const std::string& str) {
     return vec;
 }
 
+// Writes the lock statistics and |chip_stats| to the tombstone dir, so that
+// they are part of the archive produced by |WifiChip::debug|.
+bool writeHalStatsFile(const std::string& chip_stats) {
+    const std::string file_path =
+        std::string(kTombstoneFolderPath) + kHalStatsFileName;
+    const int fd = open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                        S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        PLOG(ERROR) << "Failed to create " << file_path;
+        return false;
+    }
+    unique_fd file_auto_closer(fd);
+    const std::string stats =
+        android::hardware::wifi::V1_3::implementation::hidl_sync_util::
+            dumpLockStats() +
+        chip_stats;
+    if (write(fd, stats.data(), stats.size()) == -1) {
+        PLOG(ERROR) << "Error writing to file";
+        return false;
+    }
+    return true;
+}
+
+// Writes each ring of |snapshot| to its own file in the tombstone dir. Runs on
+// the |RingbufferWriter| thread.
+bool writeRingbufferSnapshotToFiles(
+    const android::hardware::wifi::V1_3::implementation::RingbufferWriter::
+        Snapshot& snapshot) {
+    if (!removeOldFilesInternal()) {
+        LOG(ERROR) << "Error occurred while deleting old tombstone files";
+        return false;
+    }
+    for (const auto& item : snapshot) {
+        const std::string file_path_raw =
+            kTombstoneFolderPath + item.first + "XXXXXXXXXX";
+        const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
+        if (dump_fd == -1) {
+            PLOG(ERROR) << "create file failed";
+            return false;
+        }
+        unique_fd file_auto_closer(dump_fd);
+        if (write(dump_fd, item.second.data(), item.second.size()) == -1) {
+            PLOG(ERROR) << "Error writing to file";
+        }
+    }
+    return true;
+}
+
 }  // namespace
 
 namespace android {
@@ -325,7 +376,8 @@ WifiChip::WifiChip(
       is_valid_(true),
       current_mode_id_(feature_flags::chip_mode_ids::kInvalid),
       modes_(feature_flags.lock()->getChipModes()),
-      debug_ring_buffer_cb_registered_(false) {
+      debug_ring_buffer_cb_registered_(false),
+      ringbuffer_writer_(writeRingbufferSnapshotToFiles) {
     setActiveWlanIfaceNameProperty(kNoActiveWlanIfaceNamePropertyValue);
 }
 
@@ -607,9 +659,15 @@ Return<void> WifiChip::debug(const hidl_handle& handle,
                              const hidl_vec<hidl_string>&) {
     if (handle != nullptr && handle->numFds >= 1) {
         int fd = handle->data[0];
-        if (!writeRingbufferFilesInternal()) {
+        // The archive needs the files on flash, wait for them.
+        if (!writeRingbufferFilesInternal() || !ringbuffer_writer_.flush()) {
             LOG(ERROR) << "Error writing files to flash";
         }
+        std::string chip_stats = dumpStageTimings();
+        for (const auto& nan_iface : nan_ifaces_) {
+            chip_stats += nan_iface->dumpIndicationStats();
+        }
+        writeHalStatsFile(chip_stats);
         uint32_t n_error = cpioArchiveFilesInDir(fd, kTombstoneFolderPath);
         if (n_error != 0) {
             LOG(ERROR) << n_error << " errors occured in cpio function";
@@ -802,6 +860,7 @@ WifiChip::requestFirmwareDebugDumpInternal() {
 }
 
 std::pair<WifiStatus, sp<IWifiApIface>> WifiChip::createApIfaceInternal() {
+    const auto start = std::chrono::steady_clock::now();
     if (!canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(IfaceType::AP)) {
         return {createWifiStatus(WifiStatusCode::ERROR_NOT_AVAILABLE), {}};
     }
@@ -815,6 +874,8 @@ std::pair<WifiStatus, sp<IWifiApIface>> WifiChip::createApIfaceInternal() {
         }
     }
     setActiveWlanIfaceNameProperty(getFirstActiveWlanIfaceName());
+    create_iface_timings_[IfaceType::AP] =
+        std::chrono::steady_clock::now() - start;
     return {createWifiStatus(WifiStatusCode::SUCCESS), iface};
 }
 
@@ -856,6 +917,7 @@ WifiStatus WifiChip::removeApIfaceInternal(const std::string& ifname) {
 }
 
 std::pair<WifiStatus, sp<IWifiNanIface>> WifiChip::createNanIfaceInternal() {
+    const auto start = std::chrono::steady_clock::now();
     if (!canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(IfaceType::NAN)) {
         return {createWifiStatus(WifiStatusCode::ERROR_NOT_AVAILABLE), {}};
     }
@@ -868,6 +930,8 @@ std::pair<WifiStatus, sp<IWifiNanIface>> WifiChip::createNanIfaceInternal() {
             LOG(ERROR) << "Failed to invoke onIfaceAdded callback";
         }
     }
+    create_iface_timings_[IfaceType::NAN] =
+        std::chrono::steady_clock::now() - start;
     return {createWifiStatus(WifiStatusCode::SUCCESS), iface};
 }
 
@@ -903,6 +967,7 @@ WifiStatus WifiChip::removeNanIfaceInternal(const std::string& ifname) {
 }
 
 std::pair<WifiStatus, sp<IWifiP2pIface>> WifiChip::createP2pIfaceInternal() {
+    const auto start = std::chrono::steady_clock::now();
     if (!canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(IfaceType::P2P)) {
         return {createWifiStatus(WifiStatusCode::ERROR_NOT_AVAILABLE), {}};
     }
@@ -914,6 +979,8 @@ std::pair<WifiStatus, sp<IWifiP2pIface>> WifiChip::createP2pIfaceInternal() {
             LOG(ERROR) << "Failed to invoke onIfaceAdded callback";
         }
     }
+    create_iface_timings_[IfaceType::P2P] =
+        std::chrono::steady_clock::now() - start;
     return {createWifiStatus(WifiStatusCode::SUCCESS), iface};
 }
 
@@ -949,6 +1016,7 @@ WifiStatus WifiChip::removeP2pIfaceInternal(const std::string& ifname) {
 }
 
 std::pair<WifiStatus, sp<IWifiStaIface>> WifiChip::createStaIfaceInternal() {
+    const auto start = std::chrono::steady_clock::now();
     if (!canCurrentModeSupportIfaceOfTypeWithCurrentIfaces(IfaceType::STA)) {
         return {createWifiStatus(WifiStatusCode::ERROR_NOT_AVAILABLE), {}};
     }
@@ -961,6 +1029,8 @@ std::pair<WifiStatus, sp<IWifiStaIface>> WifiChip::createStaIfaceInternal() {
         }
     }
     setActiveWlanIfaceNameProperty(getFirstActiveWlanIfaceName());
+    create_iface_timings_[IfaceType::STA] =
+        std::chrono::steady_clock::now() - start;
     return {createWifiStatus(WifiStatusCode::SUCCESS), iface};
 }
 
@@ -1045,8 +1115,12 @@ WifiStatus WifiChip::startLoggingToDebugRingBufferInternal(
                 std::underlying_type<WifiDebugRingBufferVerboseLevel>::type>(
                 verbose_level),
             max_interval_in_sec, min_data_size_in_bytes);
-    ringbuffer_map_.insert(std::pair<std::string, Ringbuffer>(
-        ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+    {
+        const hidl_sync_util::SubsystemLock lock(
+            hidl_sync_util::LockId::kRingbuffer);
+        ringbuffer_map_.insert(std::pair<std::string, Ringbuffer>(
+            ring_name, Ringbuffer(kMaxBufferSizeBytes)));
+    }
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
@@ -1163,6 +1237,8 @@ WifiStatus WifiChip::selectTxPowerScenarioInternal_1_2(
 WifiStatus WifiChip::handleChipConfiguration(
     /* NONNULL */ std::unique_lock<std::recursive_mutex>* lock,
     ChipModeId mode_id) {
+    configure_stage_timings_.clear();
+    auto stage_start = std::chrono::steady_clock::now();
     // If the chip is already configured in a different mode, stop
     // the legacy HAL and then start it after firmware mode change.
     if (isValidModeId(current_mode_id_)) {
@@ -1176,6 +1252,7 @@ WifiStatus WifiChip::handleChipConfiguration(
                        << legacyErrorToString(legacy_status);
             return createWifiStatusFromLegacyError(legacy_status);
         }
+        recordConfigureStage("stop_legacy_hal", &stage_start);
     }
     // Firmware mode change not needed for V2 devices.
     bool success = true;
@@ -1187,12 +1264,14 @@ WifiStatus WifiChip::handleChipConfiguration(
     if (!success) {
         return createWifiStatus(WifiStatusCode::ERROR_UNKNOWN);
     }
+    recordConfigureStage("change_firmware_mode", &stage_start);
     legacy_hal::wifi_error legacy_status = legacy_hal_.lock()->start();
     if (legacy_status != legacy_hal::WIFI_SUCCESS) {
         LOG(ERROR) << "Failed to start legacy HAL: "
                    << legacyErrorToString(legacy_status);
         return createWifiStatusFromLegacyError(legacy_status);
     }
+    recordConfigureStage("start_legacy_hal", &stage_start);
     // Every time the HAL is restarted, we need to register the
     // radio mode change callback.
     WifiStatus status = registerRadioModeChangeCallback();
@@ -1200,6 +1279,7 @@ WifiStatus WifiChip::handleChipConfiguration(
         // This probably is not a critical failure?
         LOG(ERROR) << "Failed to register radio mode change callback";
     }
+    recordConfigureStage("register_radio_mode_change_callback", &stage_start);
     // Extract and save the version information into property.
     std::pair<WifiStatus, IWifiChip::ChipDebugInfo> version_info;
     version_info = WifiChip::requestChipDebugInfoInternal();
@@ -1209,6 +1289,7 @@ WifiStatus WifiChip::handleChipConfiguration(
         property_set("vendor.wlan.driver.version",
                      version_info.second.driverDescription.c_str());
     }
+    recordConfigureStage("request_chip_debug_info", &stage_start);
 
     return createWifiStatus(WifiStatusCode::SUCCESS);
 }
@@ -1234,6 +1315,8 @@ WifiStatus WifiChip::registerDebugRingBufferCallback() {
                 LOG(ERROR) << "Error converting ring buffer status";
                 return;
             }
+            const hidl_sync_util::SubsystemLock lock(
+                hidl_sync_util::LockId::kRingbuffer);
             const auto& target = shared_ptr_this->ringbuffer_map_.find(name);
             if (target != shared_ptr_this->ringbuffer_map_.end()) {
                 Ringbuffer& cur_buffer = target->second;
@@ -1509,32 +1592,59 @@ std::string WifiChip::allocateStaIfaceName() {
     return allocateApOrStaIfaceName(0);
 }
 
-bool WifiChip::writeRingbufferFilesInternal() {
-    if (!removeOldFilesInternal()) {
-        LOG(ERROR) << "Error occurred while deleting old tombstone files";
-        return false;
+void WifiChip::recordConfigureStage(
+    const char* stage, std::chrono::steady_clock::time_point* stage_start) {
+    const auto now = std::chrono::steady_clock::now();
+    configure_stage_timings_.emplace_back(stage, now - *stage_start);
+    *stage_start = now;
+}
+
+std::string WifiChip::dumpStageTimings() {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    std::ostringstream ss;
+    ss << "Last chip configuration:\n";
+    for (const auto& stage : configure_stage_timings_) {
+        ss << "  " << stage.first << ": "
+           << duration_cast<microseconds>(stage.second).count() << "us\n";
     }
-    // write ringbuffers to file
-    for (const auto& item : ringbuffer_map_) {
-        const Ringbuffer& cur_buffer = item.second;
-        if (cur_buffer.getData().empty()) {
-            continue;
-        }
-        const std::string file_path_raw =
-            kTombstoneFolderPath + item.first + "XXXXXXXXXX";
-        const int dump_fd = mkstemp(makeCharVec(file_path_raw).data());
-        if (dump_fd == -1) {
-            PLOG(ERROR) << "create file failed";
-            return false;
-        }
-        unique_fd file_auto_closer(dump_fd);
-        for (const auto& cur_block : cur_buffer.getData()) {
-            if (write(dump_fd, cur_block.data(),
-                      sizeof(cur_block[0]) * cur_block.size()) == -1) {
-                PLOG(ERROR) << "Error writing to file";
+    ss << "Last iface creation:\n";
+    for (const auto& iface : create_iface_timings_) {
+        ss << "  " << toString(iface.first) << ": "
+           << duration_cast<microseconds>(iface.second).count() << "us\n";
+    }
+    ss << "Last ring buffer snapshot: "
+       << duration_cast<microseconds>(ringbuffer_snapshot_timing_).count()
+       << "us, " << ringbuffer_snapshot_size_ << " bytes\n";
+    return ss.str();
+}
+
+bool WifiChip::writeRingbufferFilesInternal() {
+    // Only the copy of the rings is done here, the files are written by
+    // |ringbuffer_writer_| without holding up the HIDL thread.
+    const auto start = std::chrono::steady_clock::now();
+    RingbufferWriter::Snapshot snapshot;
+    size_t snapshot_size = 0;
+    {
+        const hidl_sync_util::SubsystemLock lock(
+            hidl_sync_util::LockId::kRingbuffer);
+        for (const auto& item : ringbuffer_map_) {
+            const Ringbuffer& cur_buffer = item.second;
+            if (cur_buffer.empty()) {
+                continue;
+            }
+            std::vector<uint8_t> data;
+            for (const auto& segment : cur_buffer.getSegments()) {
+                data.insert(data.end(), segment.data,
+                            segment.data + segment.size);
             }
+            snapshot_size += data.size();
+            snapshot.emplace_back(item.first, std::move(data));
         }
     }
+    ringbuffer_snapshot_timing_ = std::chrono::steady_clock::now() - start;
+    ringbuffer_snapshot_size_ = snapshot_size;
+    ringbuffer_writer_.post(std::move(snapshot));
     return true;
 }
 
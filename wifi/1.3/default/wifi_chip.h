@@ -17,6 +17,8 @@
 #ifndef WIFI_CHIP_H_
 #define WIFI_CHIP_H_
 
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <map>
 
@@ -25,6 +27,7 @@
 
 #include "hidl_callback_util.h"
 #include "ringbuffer.h"
+#include "ringbuffer_writer.h"
 #include "wifi_ap_iface.h"
 #include "wifi_feature_flags.h"
 #include "wifi_legacy_hal.h"
@@ -246,6 +249,11 @@ class WifiChip : public V1_3::IWifiChip {
     std::string allocateApIfaceName();
     std::string allocateStaIfaceName();
     bool writeRingbufferFilesInternal();
+    // Adds the time since |stage_start| to the timings of the current chip
+    // configuration and moves |stage_start| to now.
+    void recordConfigureStage(
+        const char* stage, std::chrono::steady_clock::time_point* stage_start);
+    std::string dumpStageTimings();
 
     ChipId chip_id_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
@@ -258,7 +266,8 @@ class WifiChip : public V1_3::IWifiChip {
     std::vector<sp<WifiStaIface>> sta_ifaces_;
     std::vector<sp<WifiRttController>> rtt_controllers_;
     std::map<std::string, Ringbuffer> ringbuffer_map_;
-    bool is_valid_;
+    // Read from the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     // Members pertaining to chip configuration.
     uint32_t current_mode_id_;
     std::vector<IWifiChip::ChipMode> modes_;
@@ -266,6 +275,18 @@ class WifiChip : public V1_3::IWifiChip {
     // registration mechanism. Use this to check if we have already
     // registered a callback.
     bool debug_ring_buffer_cb_registered_;
+    // Writes the ring buffer files off the HIDL thread.
+    RingbufferWriter ringbuffer_writer_;
+    // Duration of each step of the last mode configuration and of the last
+    // creation of each iface type, reported by |debug|.
+    std::vector<std::pair<const char*, std::chrono::steady_clock::duration>>
+        configure_stage_timings_;
+    std::map<IfaceType, std::chrono::steady_clock::duration>
+        create_iface_timings_;
+    // Duration and size of the last copy of the ring buffers for writing,
+    // which holds the ring buffer lock; also reported by |debug|.
+    std::chrono::steady_clock::duration ringbuffer_snapshot_timing_{0};
+    size_t ringbuffer_snapshot_size_ = 0;
     hidl_callback_util::HidlCallbackHandler<V1_2::IWifiChipEventCallback>
         event_cb_handler_;
 
@@ -53,11 +53,33 @@ namespace wifi {
 namespace V1_3 {
 namespace implementation {
 namespace legacy_hal {
+using hidl_sync_util::LockId;
+using hidl_sync_util::SubsystemLock;
+
+// The asynchronous callbacks only hold the lock of their subsystem while
+// reading the std::function, which is invoked with no lock held.
+template <typename CallbackT>
+CallbackT getCallback(LockId lock_id, const CallbackT& callback) {
+    const SubsystemLock lock(lock_id);
+    return callback;
+}
+
+// Same as |getCallback| for callbacks which must only fire once.
+template <typename CallbackT>
+CallbackT takeCallback(LockId lock_id, CallbackT& callback) {
+    const SubsystemLock lock(lock_id);
+    CallbackT taken = std::move(callback);
+    callback = nullptr;
+    return taken;
+}
+
 // Legacy HAL functions accept "C" style function pointers, so use global
 // functions to pass to the legacy HAL function and store the corresponding
 // std::function methods to be invoked.
 //
-// Callback to be invoked once |stop| is complete
+// Callback to be invoked once |stop| is complete. Unlike the other
+// asynchronous callbacks, it is invoked with the global lock held since
+// |stop| waits for it on that lock.
 std::function<void(wifi_handle handle)> on_stop_complete_internal_callback;
 void onAsyncStopComplete(wifi_handle handle) {
     const auto lock = hidl_sync_util::acquireGlobalLock();
@@ -88,9 +110,10 @@ void onSyncFirmwareMemoryDump(char* buffer, int buffer_size) {
 std::function<void(wifi_request_id, wifi_scan_event)>
     on_gscan_event_internal_callback;
 void onAsyncGscanEvent(wifi_request_id id, wifi_scan_event event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_gscan_event_internal_callback) {
-        on_gscan_event_internal_callback(id, event);
+    const auto callback =
+        getCallback(LockId::kStaIface, on_gscan_event_internal_callback);
+    if (callback) {
+        callback(id, event);
     }
 }
 
@@ -99,9 +122,10 @@ std::function<void(wifi_request_id, wifi_scan_result*, uint32_t)>
     on_gscan_full_result_internal_callback;
 void onAsyncGscanFullResult(wifi_request_id id, wifi_scan_result* result,
                             uint32_t buckets_scanned) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_gscan_full_result_internal_callback) {
-        on_gscan_full_result_internal_callback(id, result, buckets_scanned);
+    const auto callback =
+        getCallback(LockId::kStaIface, on_gscan_full_result_internal_callback);
+    if (callback) {
+        callback(id, result, buckets_scanned);
     }
 }
 
@@ -121,9 +145,10 @@ std::function<void((wifi_request_id, uint8_t*, int8_t))>
     on_rssi_threshold_breached_internal_callback;
 void onAsyncRssiThresholdBreached(wifi_request_id id, uint8_t* bssid,
                                   int8_t rssi) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_rssi_threshold_breached_internal_callback) {
-        on_rssi_threshold_breached_internal_callback(id, bssid, rssi);
+    const auto callback = getCallback(
+        LockId::kStaIface, on_rssi_threshold_breached_internal_callback);
+    if (callback) {
+        callback(id, bssid, rssi);
     }
 }
 
@@ -132,10 +157,10 @@ std::function<void(char*, char*, int, wifi_ring_buffer_status*)>
     on_ring_buffer_data_internal_callback;
 void onAsyncRingBufferData(char* ring_name, char* buffer, int buffer_size,
                            wifi_ring_buffer_status* status) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_ring_buffer_data_internal_callback) {
-        on_ring_buffer_data_internal_callback(ring_name, buffer, buffer_size,
-                                              status);
+    const auto callback =
+        getCallback(LockId::kRingbuffer, on_ring_buffer_data_internal_callback);
+    if (callback) {
+        callback(ring_name, buffer, buffer_size, status);
     }
 }
 
@@ -144,9 +169,10 @@ std::function<void(wifi_request_id, char*, int, int)>
     on_error_alert_internal_callback;
 void onAsyncErrorAlert(wifi_request_id id, char* buffer, int buffer_size,
                        int err_code) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_error_alert_internal_callback) {
-        on_error_alert_internal_callback(id, buffer, buffer_size, err_code);
+    const auto callback =
+        getCallback(LockId::kChip, on_error_alert_internal_callback);
+    if (callback) {
+        callback(id, buffer, buffer_size, err_code);
     }
 }
 
@@ -155,9 +181,10 @@ std::function<void(wifi_request_id, uint32_t, wifi_mac_info*)>
     on_radio_mode_change_internal_callback;
 void onAsyncRadioModeChange(wifi_request_id id, uint32_t num_macs,
                             wifi_mac_info* mac_infos) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_radio_mode_change_internal_callback) {
-        on_radio_mode_change_internal_callback(id, num_macs, mac_infos);
+    const auto callback =
+        getCallback(LockId::kChip, on_radio_mode_change_internal_callback);
+    if (callback) {
+        callback(id, num_macs, mac_infos);
     }
 }
 
@@ -167,10 +194,10 @@ std::function<void(wifi_request_id, unsigned num_results,
     on_rtt_results_internal_callback;
 void onAsyncRttResults(wifi_request_id id, unsigned num_results,
                        wifi_rtt_result* rtt_results[]) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_rtt_results_internal_callback) {
-        on_rtt_results_internal_callback(id, num_results, rtt_results);
-        on_rtt_results_internal_callback = nullptr;
+    const auto callback =
+        takeCallback(LockId::kRtt, on_rtt_results_internal_callback);
+    if (callback) {
+        callback(id, num_results, rtt_results);
     }
 }
 
@@ -181,9 +208,10 @@ void onAsyncRttResults(wifi_request_id id, unsigned num_results,
 std::function<void(transaction_id, const NanResponseMsg&)>
     on_nan_notify_response_user_callback;
 void onAysncNanNotifyResponse(transaction_id id, NanResponseMsg* msg) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_notify_response_user_callback && msg) {
-        on_nan_notify_response_user_callback(id, *msg);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_notify_response_user_callback);
+    if (callback && msg) {
+        callback(id, *msg);
     }
 }
 
@@ -196,139 +224,155 @@ void onAysncNanEventPublishReplied(NanPublishRepliedInd* /* event */) {
 std::function<void(const NanPublishTerminatedInd&)>
     on_nan_event_publish_terminated_user_callback;
 void onAysncNanEventPublishTerminated(NanPublishTerminatedInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_publish_terminated_user_callback && event) {
-        on_nan_event_publish_terminated_user_callback(*event);
+    const auto callback = getCallback(
+        LockId::kNan, on_nan_event_publish_terminated_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanMatchInd&)> on_nan_event_match_user_callback;
 void onAysncNanEventMatch(NanMatchInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_match_user_callback && event) {
-        on_nan_event_match_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_match_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanMatchExpiredInd&)>
     on_nan_event_match_expired_user_callback;
 void onAysncNanEventMatchExpired(NanMatchExpiredInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_match_expired_user_callback && event) {
-        on_nan_event_match_expired_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_match_expired_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanSubscribeTerminatedInd&)>
     on_nan_event_subscribe_terminated_user_callback;
 void onAysncNanEventSubscribeTerminated(NanSubscribeTerminatedInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_subscribe_terminated_user_callback && event) {
-        on_nan_event_subscribe_terminated_user_callback(*event);
+    const auto callback = getCallback(
+        LockId::kNan, on_nan_event_subscribe_terminated_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanFollowupInd&)> on_nan_event_followup_user_callback;
 void onAysncNanEventFollowup(NanFollowupInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_followup_user_callback && event) {
-        on_nan_event_followup_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_followup_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanDiscEngEventInd&)>
     on_nan_event_disc_eng_event_user_callback;
 void onAysncNanEventDiscEngEvent(NanDiscEngEventInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_disc_eng_event_user_callback && event) {
-        on_nan_event_disc_eng_event_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_disc_eng_event_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanDisabledInd&)> on_nan_event_disabled_user_callback;
 void onAysncNanEventDisabled(NanDisabledInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_disabled_user_callback && event) {
-        on_nan_event_disabled_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_disabled_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanTCAInd&)> on_nan_event_tca_user_callback;
 void onAysncNanEventTca(NanTCAInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_tca_user_callback && event) {
-        on_nan_event_tca_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_tca_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanBeaconSdfPayloadInd&)>
     on_nan_event_beacon_sdf_payload_user_callback;
 void onAysncNanEventBeaconSdfPayload(NanBeaconSdfPayloadInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_beacon_sdf_payload_user_callback && event) {
-        on_nan_event_beacon_sdf_payload_user_callback(*event);
+    const auto callback = getCallback(
+        LockId::kNan, on_nan_event_beacon_sdf_payload_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanDataPathRequestInd&)>
     on_nan_event_data_path_request_user_callback;
 void onAysncNanEventDataPathRequest(NanDataPathRequestInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_request_user_callback && event) {
-        on_nan_event_data_path_request_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_data_path_request_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 std::function<void(const NanDataPathConfirmInd&)>
     on_nan_event_data_path_confirm_user_callback;
 void onAysncNanEventDataPathConfirm(NanDataPathConfirmInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_confirm_user_callback && event) {
-        on_nan_event_data_path_confirm_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_data_path_confirm_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanDataPathEndInd&)>
     on_nan_event_data_path_end_user_callback;
 void onAysncNanEventDataPathEnd(NanDataPathEndInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_data_path_end_user_callback && event) {
-        on_nan_event_data_path_end_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_data_path_end_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanTransmitFollowupInd&)>
     on_nan_event_transmit_follow_up_user_callback;
 void onAysncNanEventTransmitFollowUp(NanTransmitFollowupInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_transmit_follow_up_user_callback && event) {
-        on_nan_event_transmit_follow_up_user_callback(*event);
+    const auto callback = getCallback(
+        LockId::kNan, on_nan_event_transmit_follow_up_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanRangeRequestInd&)>
     on_nan_event_range_request_user_callback;
 void onAysncNanEventRangeRequest(NanRangeRequestInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_range_request_user_callback && event) {
-        on_nan_event_range_request_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_range_request_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanRangeReportInd&)>
     on_nan_event_range_report_user_callback;
 void onAysncNanEventRangeReport(NanRangeReportInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_range_report_user_callback && event) {
-        on_nan_event_range_report_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_range_report_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 
 std::function<void(const NanDataPathScheduleUpdateInd&)>
     on_nan_event_schedule_update_user_callback;
 void onAsyncNanEventScheduleUpdate(NanDataPathScheduleUpdateInd* event) {
-    const auto lock = hidl_sync_util::acquireGlobalLock();
-    if (on_nan_event_schedule_update_user_callback && event) {
-        on_nan_event_schedule_update_user_callback(*event);
+    const auto callback =
+        getCallback(LockId::kNan, on_nan_event_schedule_update_user_callback);
+    if (callback && event) {
+        callback(*event);
     }
 }
 // End of the free-standing "C" style callbacks.
@@ -338,9 +382,15 @@ WifiLegacyHal::WifiLegacyHal(
     : global_handle_(nullptr),
       awaiting_event_loop_termination_(false),
       is_started_(false),
+      is_func_table_initialized_(false),
       iface_tool_(iface_tool) {}
 
 wifi_error WifiLegacyHal::initialize() {
+    // The function table outlives stop(), there is no need to resolve it
+    // again every time the HAL is restarted.
+    if (is_func_table_initialized_) {
+        return WIFI_SUCCESS;
+    }
     LOG(DEBUG) << "Initialize legacy HAL";
     // TODO: Add back the HAL Tool if we need to. All we need from the HAL tool
     // for now is this function call which we can directly call.
@@ -352,10 +402,31 @@ wifi_error WifiLegacyHal::initialize() {
     wifi_error status = init_wifi_vendor_hal_func_table(&global_func_table_);
     if (status != WIFI_SUCCESS) {
         LOG(ERROR) << "Failed to initialize legacy hal function table";
+        return status;
     }
+    is_func_table_initialized_ = true;
     return status;
 }
 
+void WifiLegacyHal::initializeAsync() {
+    std::thread([this]() {
+        const auto lock = hidl_sync_util::acquireGlobalLock();
+        initialize();
+    }).detach();
+}
+
+wifi_error WifiLegacyHal::initializeWithStubs(
+    const std::function<void(wifi_hal_fn*)>& override_fn) {
+    if (!initHalFuncTableWithStubs(&global_func_table_)) {
+        LOG(ERROR)
+            << "Failed to initialize legacy hal function table with stubs";
+        return WIFI_ERROR_UNKNOWN;
+    }
+    override_fn(&global_func_table_);
+    is_func_table_initialized_ = true;
+    return WIFI_SUCCESS;
+}
+
 wifi_error WifiLegacyHal::start() {
     // Ensure that we're starting in a good state.
     CHECK(global_func_table_.wifi_initialize && !global_handle_ &&
@@ -532,6 +603,7 @@ wifi_error WifiLegacyHal::startGscan(
     const std::function<void(wifi_request_id)>& on_failure_user_callback,
     const on_gscan_results_callback& on_results_user_callback,
     const on_gscan_full_result_callback& on_full_result_user_callback) {
+    const SubsystemLock lock(LockId::kStaIface);
     // If there is already an ongoing background scan, reject new scan requests.
     if (on_gscan_event_internal_callback ||
         on_gscan_full_result_internal_callback) {
@@ -549,8 +621,16 @@ wifi_error WifiLegacyHal::startGscan(
                 case WIFI_SCAN_THRESHOLD_PERCENT: {
                     wifi_error status;
                     std::vector<wifi_cached_scan_results> cached_scan_results;
-                    std::tie(status, cached_scan_results) =
-                        getGscanCachedResults(iface_name);
+                    {
+                        // This calls back into the legacy HAL, so it is
+                        // serialized with the HIDL methods by the global lock
+                        // like they are. The user callback is invoked after
+                        // it is released.
+                        const auto global_lock =
+                            hidl_sync_util::acquireGlobalLock();
+                        std::tie(status, cached_scan_results) =
+                            getGscanCachedResults(iface_name);
+                    }
                     if (status == WIFI_SUCCESS) {
                         on_results_user_callback(id, cached_scan_results);
                         return;
@@ -559,11 +639,13 @@ wifi_error WifiLegacyHal::startGscan(
                 }
                 // Fall through if failed. Failure to retrieve cached scan
                 // results should trigger a background scan failure.
-                case WIFI_SCAN_FAILED:
+                case WIFI_SCAN_FAILED: {
                     on_failure_user_callback(id);
+                    const SubsystemLock lock(LockId::kStaIface);
                     on_gscan_event_internal_callback = nullptr;
                     on_gscan_full_result_internal_callback = nullptr;
                     return;
+                }
             }
             LOG(FATAL) << "Unexpected gscan event received: " << event;
         };
@@ -590,6 +672,7 @@ wifi_error WifiLegacyHal::startGscan(
 
 wifi_error WifiLegacyHal::stopGscan(const std::string& iface_name,
                                     wifi_request_id id) {
+    const SubsystemLock lock(LockId::kStaIface);
     // If there is no an ongoing background scan, reject stop requests.
     // TODO(b/32337212): This needs to be handled by the HIDL object because we
     // need to return the NOT_STARTED error code.
@@ -712,6 +795,7 @@ wifi_error WifiLegacyHal::startRssiMonitoring(
     int8_t min_rssi,
     const on_rssi_threshold_breached_callback&
         on_threshold_breached_user_callback) {
+    const SubsystemLock lock(LockId::kStaIface);
     if (on_rssi_threshold_breached_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -738,6 +822,7 @@ wifi_error WifiLegacyHal::startRssiMonitoring(
 
 wifi_error WifiLegacyHal::stopRssiMonitoring(const std::string& iface_name,
                                              wifi_request_id id) {
+    const SubsystemLock lock(LockId::kStaIface);
     if (!on_rssi_threshold_breached_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -909,6 +994,7 @@ std::pair<wifi_error, WakeReasonStats> WifiLegacyHal::getWakeReasonStats(
 wifi_error WifiLegacyHal::registerRingBufferCallbackHandler(
     const std::string& iface_name,
     const on_ring_buffer_data_callback& on_user_data_callback) {
+    const SubsystemLock lock(LockId::kRingbuffer);
     if (on_ring_buffer_data_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -932,6 +1018,7 @@ wifi_error WifiLegacyHal::registerRingBufferCallbackHandler(
 
 wifi_error WifiLegacyHal::deregisterRingBufferCallbackHandler(
     const std::string& iface_name) {
+    const SubsystemLock lock(LockId::kRingbuffer);
     if (!on_ring_buffer_data_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -971,6 +1058,7 @@ wifi_error WifiLegacyHal::getRingBufferData(const std::string& iface_name,
 wifi_error WifiLegacyHal::registerErrorAlertCallbackHandler(
     const std::string& iface_name,
     const on_error_alert_callback& on_user_alert_callback) {
+    const SubsystemLock lock(LockId::kChip);
     if (on_error_alert_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -996,6 +1084,7 @@ wifi_error WifiLegacyHal::registerErrorAlertCallbackHandler(
 
 wifi_error WifiLegacyHal::deregisterErrorAlertCallbackHandler(
     const std::string& iface_name) {
+    const SubsystemLock lock(LockId::kChip);
     if (!on_error_alert_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -1007,6 +1096,7 @@ wifi_error WifiLegacyHal::deregisterErrorAlertCallbackHandler(
 wifi_error WifiLegacyHal::registerRadioModeChangeCallbackHandler(
     const std::string& iface_name,
     const on_radio_mode_change_callback& on_user_change_callback) {
+    const SubsystemLock lock(LockId::kChip);
     if (on_radio_mode_change_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -1043,6 +1133,7 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
     const std::string& iface_name, wifi_request_id id,
     const std::vector<wifi_rtt_config>& rtt_configs,
     const on_rtt_results_callback& on_results_user_callback) {
+    const SubsystemLock lock(LockId::kRtt);
     if (on_rtt_results_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -1055,6 +1146,7 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
                 return;
             }
             std::vector<const wifi_rtt_result*> rtt_results_vec;
+            rtt_results_vec.reserve(num_results);
             std::copy_if(rtt_results, rtt_results + num_results,
                          back_inserter(rtt_results_vec),
                          [](wifi_rtt_result* rtt_result) {
@@ -1076,6 +1168,7 @@ wifi_error WifiLegacyHal::startRttRangeRequest(
 wifi_error WifiLegacyHal::cancelRttRangeRequest(
     const std::string& iface_name, wifi_request_id id,
     const std::vector<std::array<uint8_t, 6>>& mac_addrs) {
+    const SubsystemLock lock(LockId::kRtt);
     if (!on_rtt_results_internal_callback) {
         return WIFI_ERROR_NOT_AVAILABLE;
     }
@@ -1145,6 +1238,7 @@ wifi_error WifiLegacyHal::setRttLcr(const std::string& iface_name,
 
 wifi_error WifiLegacyHal::nanRegisterCallbackHandlers(
     const std::string& iface_name, const NanCallbackHandlers& user_callbacks) {
+    const SubsystemLock lock(LockId::kNan);
     on_nan_notify_response_user_callback = user_callbacks.on_notify_response;
     on_nan_event_publish_terminated_user_callback =
         user_callbacks.on_event_publish_terminated;
@@ -1420,14 +1514,27 @@ void WifiLegacyHal::invalidate() {
     iface_name_to_handle_.clear();
     on_driver_memory_dump_internal_callback = nullptr;
     on_firmware_memory_dump_internal_callback = nullptr;
-    on_gscan_event_internal_callback = nullptr;
-    on_gscan_full_result_internal_callback = nullptr;
     on_link_layer_stats_result_internal_callback = nullptr;
-    on_rssi_threshold_breached_internal_callback = nullptr;
-    on_ring_buffer_data_internal_callback = nullptr;
-    on_error_alert_internal_callback = nullptr;
-    on_radio_mode_change_internal_callback = nullptr;
-    on_rtt_results_internal_callback = nullptr;
+    {
+        const SubsystemLock lock(LockId::kStaIface);
+        on_gscan_event_internal_callback = nullptr;
+        on_gscan_full_result_internal_callback = nullptr;
+        on_rssi_threshold_breached_internal_callback = nullptr;
+    }
+    {
+        const SubsystemLock lock(LockId::kRingbuffer);
+        on_ring_buffer_data_internal_callback = nullptr;
+    }
+    {
+        const SubsystemLock lock(LockId::kChip);
+        on_error_alert_internal_callback = nullptr;
+        on_radio_mode_change_internal_callback = nullptr;
+    }
+    {
+        const SubsystemLock lock(LockId::kRtt);
+        on_rtt_results_internal_callback = nullptr;
+    }
+    const SubsystemLock lock(LockId::kNan);
     on_nan_notify_response_user_callback = nullptr;
     on_nan_event_publish_terminated_user_callback = nullptr;
     on_nan_event_match_user_callback = nullptr;
@@ -173,8 +173,18 @@ class WifiLegacyHal {
     WifiLegacyHal(const std::weak_ptr<wifi_system::InterfaceTool> iface_tool);
     virtual ~WifiLegacyHal() = default;
 
-    // Initialize the legacy HAL function table.
+    // Initialize the legacy HAL function table. Only the first successful call
+    // does any work.
     virtual wifi_error initialize();
+    // Initialize the legacy HAL function table from a background thread, so
+    // that it is ready by the time the first |start| arrives. Must only be
+    // used if the object lives until the process exits.
+    void initializeAsync();
+    // Initialize the legacy HAL function table with the stubs only, and let
+    // |override_fn| replace some of them, instead of loading the vendor HAL.
+    // Meant for the benchmarks, which run without a driver.
+    wifi_error initializeWithStubs(
+        const std::function<void(wifi_hal_fn*)>& override_fn);
     // Start the legacy HAL and the event looper thread.
     virtual wifi_error start();
     // Deinitialize the legacy HAL and wait for the event loop thread to exit
@@ -391,6 +401,8 @@ class WifiLegacyHal {
     std::condition_variable_any stop_wait_cv_;
     // Flag to indicate if the legacy HAL has been started.
     bool is_started_;
+    // Flag to indicate if |global_func_table_| has been resolved.
+    bool is_func_table_initialized_;
     std::weak_ptr<wifi_system::InterfaceTool> iface_tool_;
 };
 
@@ -15,6 +15,7 @@
  */
 
 #include <android-base/logging.h>
+#include <cutils/properties.h>
 
 #include "hidl_return_util.h"
 #include "hidl_struct_util.h"
@@ -28,6 +29,14 @@ namespace V1_3 {
 namespace implementation {
 using hidl_return_util::validateAndCall;
 
+namespace {
+// Window over which match and followup indications are batched, 0 delivers
+// each one as it arrives.
+constexpr char kIndicationCoalesceMsProperty[] =
+    "vendor.wifi.nan_indication_coalesce_ms";
+constexpr int32_t kDefaultIndicationCoalesceMs = 0;
+}  // namespace
+
 WifiNanIface::WifiNanIface(
     const std::string& ifname,
     const std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal,
@@ -35,7 +44,9 @@ WifiNanIface::WifiNanIface(
     : ifname_(ifname),
       legacy_hal_(legacy_hal),
       iface_util_(iface_util),
-      is_valid_(true) {
+      is_valid_(true),
+      indication_coalescer_(std::chrono::milliseconds(property_get_int32(
+          kIndicationCoalesceMsProperty, kDefaultIndicationCoalesceMs))) {
     // Register all the callbacks here. these should be valid for the lifetime
     // of the object. Whenever the mode changes legacy HAL will remove
     // all of these callbacks.
@@ -321,23 +332,35 @@ WifiNanIface::WifiNanIface(
 
     callback_handlers.on_event_match =
         [weak_ptr_this](const legacy_hal::NanMatchInd& msg) {
+            const auto arrival = NanIndicationCoalescer::Clock::now();
             const auto shared_ptr_this = weak_ptr_this.promote();
             if (!shared_ptr_this.get() || !shared_ptr_this->isValid()) {
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            NanMatchInd hidl_struct;
+            auto hidl_struct = std::make_shared<NanMatchInd>();
             if (!hidl_struct_util::convertLegacyNanMatchIndToHidl(
-                    msg, &hidl_struct)) {
+                    msg, hidl_struct.get())) {
                 LOG(ERROR) << "Failed to convert nan capabilities response";
                 return;
             }
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
-                if (!callback->eventMatch(hidl_struct).isOk()) {
-                    LOG(ERROR) << "Failed to invoke the callback";
-                }
-            }
+            const uint8_t session_id = hidl_struct->discoverySessionId;
+            const uint32_t peer_id = hidl_struct->peerId;
+            shared_ptr_this->indication_coalescer_.postMatch(
+                session_id, peer_id, arrival, [weak_ptr_this, hidl_struct]() {
+                    const auto shared_ptr_this = weak_ptr_this.promote();
+                    if (!shared_ptr_this.get() ||
+                        !shared_ptr_this->isValid()) {
+                        return;
+                    }
+                    for (const auto& callback :
+                         shared_ptr_this->getEventCallbacks()) {
+                        if (!callback->eventMatch(*hidl_struct).isOk()) {
+                            LOG(ERROR) << "Failed to invoke the callback";
+                        }
+                    }
+                });
         };
 
     callback_handlers.on_event_match_expired =
@@ -359,23 +382,36 @@ WifiNanIface::WifiNanIface(
 
     callback_handlers.on_event_followup =
         [weak_ptr_this](const legacy_hal::NanFollowupInd& msg) {
+            const auto arrival = NanIndicationCoalescer::Clock::now();
             const auto shared_ptr_this = weak_ptr_this.promote();
             if (!shared_ptr_this.get() || !shared_ptr_this->isValid()) {
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            NanFollowupReceivedInd hidl_struct;
+            auto hidl_struct = std::make_shared<NanFollowupReceivedInd>();
             if (!hidl_struct_util::convertLegacyNanFollowupIndToHidl(
-                    msg, &hidl_struct)) {
+                    msg, hidl_struct.get())) {
                 LOG(ERROR) << "Failed to convert nan capabilities response";
                 return;
             }
 
-            for (const auto& callback : shared_ptr_this->getEventCallbacks()) {
-                if (!callback->eventFollowupReceived(hidl_struct).isOk()) {
-                    LOG(ERROR) << "Failed to invoke the callback";
-                }
-            }
+            // Queued behind any pending match, so that the framework already
+            // knows the peer.
+            shared_ptr_this->indication_coalescer_.postFollowup(
+                arrival, [weak_ptr_this, hidl_struct]() {
+                    const auto shared_ptr_this = weak_ptr_this.promote();
+                    if (!shared_ptr_this.get() ||
+                        !shared_ptr_this->isValid()) {
+                        return;
+                    }
+                    for (const auto& callback :
+                         shared_ptr_this->getEventCallbacks()) {
+                        if (!callback->eventFollowupReceived(*hidl_struct)
+                                 .isOk()) {
+                            LOG(ERROR) << "Failed to invoke the callback";
+                        }
+                    }
+                });
         };
 
     callback_handlers.on_event_transmit_follow_up =
@@ -531,6 +567,7 @@ void WifiNanIface::invalidate() {
     legacy_hal_.lock()->nanDataInterfaceDelete(ifname_, 0xFFFD, "aware_data1");
     iface_util_.lock()->unregisterIfaceEventHandlers(ifname_);
     legacy_hal_.reset();
+    indication_coalescer_.clear();
     event_cb_handler_.invalidate();
     event_cb_handler_1_2_.invalidate();
     is_valid_ = false;
@@ -540,6 +577,11 @@ bool WifiNanIface::isValid() { return is_valid_; }
 
 std::string WifiNanIface::getName() { return ifname_; }
 
+std::string WifiNanIface::dumpIndicationStats() {
+    return "NAN iface " + ifname_ + " indications:\n" +
+           indication_coalescer_.dumpStats();
+}
+
 std::set<sp<V1_0::IWifiNanIfaceEventCallback>>
 WifiNanIface::getEventCallbacks() {
     return event_cb_handler_.getCallbacks();
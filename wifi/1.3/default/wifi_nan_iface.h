@@ -17,11 +17,14 @@
 #ifndef WIFI_NAN_IFACE_H_
 #define WIFI_NAN_IFACE_H_
 
+#include <atomic>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiNanIfaceEventCallback.h>
 #include <android/hardware/wifi/1.2/IWifiNanIface.h>
 
 #include "hidl_callback_util.h"
+#include "nan_indication_coalescer.h"
 #include "wifi_iface_util.h"
 #include "wifi_legacy_hal.h"
 
@@ -44,6 +47,8 @@ class WifiNanIface : public V1_2::IWifiNanIface {
     void invalidate();
     bool isValid();
     std::string getName();
+    // Counters and delivery latency of the match and followup indications.
+    std::string dumpIndicationStats();
 
     // HIDL methods exposed.
     Return<void> getName(getName_cb hidl_status_cb) override;
@@ -150,11 +155,14 @@ class WifiNanIface : public V1_2::IWifiNanIface {
     std::string ifname_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::weak_ptr<iface_util::WifiIfaceUtil> iface_util_;
-    bool is_valid_;
+    // Read from the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     hidl_callback_util::HidlCallbackHandler<V1_0::IWifiNanIfaceEventCallback>
         event_cb_handler_;
     hidl_callback_util::HidlCallbackHandler<V1_2::IWifiNanIfaceEventCallback>
         event_cb_handler_1_2_;
+    // Declared last so that pending deliveries are dropped first on teardown.
+    NanIndicationCoalescer indication_coalescer_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiNanIface);
 };
@@ -38,7 +38,10 @@ WifiRttController::WifiRttController(
 
 void WifiRttController::invalidate() {
     legacy_hal_.reset();
-    event_callbacks_.clear();
+    {
+        const hidl_sync_util::SubsystemLock lock(hidl_sync_util::LockId::kRtt);
+        event_callbacks_.clear();
+    }
     is_valid_ = false;
 }
 
@@ -46,6 +49,7 @@ bool WifiRttController::isValid() { return is_valid_; }
 
 std::vector<sp<IWifiRttControllerEventCallback>>
 WifiRttController::getEventCallbacks() {
+    const hidl_sync_util::SubsystemLock lock(hidl_sync_util::LockId::kRtt);
     return event_callbacks_;
 }
 
@@ -138,16 +142,23 @@ WifiRttController::getBoundIfaceInternal() {
 WifiStatus WifiRttController::registerEventCallbackInternal(
     const sp<IWifiRttControllerEventCallback>& callback) {
     // TODO(b/31632518): remove the callback when the client is destroyed
+    const hidl_sync_util::SubsystemLock lock(hidl_sync_util::LockId::kRtt);
     event_callbacks_.emplace_back(callback);
     return createWifiStatus(WifiStatusCode::SUCCESS);
 }
 
 WifiStatus WifiRttController::rangeRequestInternal(
     uint32_t cmd_id, const std::vector<RttConfig>& rtt_configs) {
-    std::vector<legacy_hal::wifi_rtt_config> legacy_configs;
-    if (!hidl_struct_util::convertHidlVectorOfRttConfigToLegacy(
-            rtt_configs, &legacy_configs)) {
-        return createWifiStatus(WifiStatusCode::ERROR_INVALID_ARGS);
+    // Continuous ranging re-sends the same responders with every request, only
+    // convert them when they change.
+    if (rtt_configs != resident_rtt_configs_) {
+        resident_rtt_configs_.clear();
+        if (!hidl_struct_util::convertHidlVectorOfRttConfigToLegacy(
+                rtt_configs, &resident_legacy_rtt_configs_)) {
+            resident_legacy_rtt_configs_.clear();
+            return createWifiStatus(WifiStatusCode::ERROR_INVALID_ARGS);
+        }
+        resident_rtt_configs_ = rtt_configs;
     }
     android::wp<WifiRttController> weak_ptr_this(this);
     const auto& on_results_callback =
@@ -159,7 +170,7 @@ WifiStatus WifiRttController::rangeRequestInternal(
                 LOG(ERROR) << "Callback invoked on an invalid object";
                 return;
             }
-            std::vector<RttResult> hidl_results;
+            hidl_vec<RttResult>& hidl_results = shared_ptr_this->rtt_results_;
             if (!hidl_struct_util::convertLegacyVectorOfRttResultToHidl(
                     results, &hidl_results)) {
                 LOG(ERROR) << "Failed to convert rtt results to HIDL structs";
@@ -171,7 +182,8 @@ WifiStatus WifiRttController::rangeRequestInternal(
         };
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->startRttRangeRequest(
-            ifname_, cmd_id, legacy_configs, on_results_callback);
+            ifname_, cmd_id, resident_legacy_rtt_configs_,
+            on_results_callback);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
@@ -17,6 +17,8 @@
 #ifndef WIFI_RTT_CONTROLLER_H_
 #define WIFI_RTT_CONTROLLER_H_
 
+#include <atomic>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiIface.h>
 #include <android/hardware/wifi/1.0/IWifiRttController.h>
@@ -92,7 +94,14 @@ class WifiRttController : public V1_0::IWifiRttController {
     sp<IWifiIface> bound_iface_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::vector<sp<IWifiRttControllerEventCallback>> event_callbacks_;
-    bool is_valid_;
+    // Read from the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
+    // Configs of the last range request and their legacy conversion.
+    std::vector<RttConfig> resident_rtt_configs_;
+    std::vector<legacy_hal::wifi_rtt_config> resident_legacy_rtt_configs_;
+    // Results handed to the callbacks, reused from one batch to the next.
+    // Only accessed from the legacy HAL event loop thread.
+    hidl_vec<RttResult> rtt_results_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiRttController);
 };
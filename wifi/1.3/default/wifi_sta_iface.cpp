@@ -15,6 +15,7 @@
  */
 
 #include <android-base/logging.h>
+#include <cutils/properties.h>
 
 #include "hidl_return_util.h"
 #include "hidl_struct_util.h"
@@ -28,6 +29,14 @@ namespace V1_3 {
 namespace implementation {
 using hidl_return_util::validateAndCall;
 
+namespace {
+// How long link layer stats fetched from the driver are handed out for, so
+// that the framework's pollers share one driver query.
+constexpr char kLinkLayerStatsCacheMsProperty[] =
+    "vendor.wifi.link_layer_stats_cache_ms";
+constexpr int32_t kDefaultLinkLayerStatsCacheMs = 500;
+}  // namespace
+
 WifiStaIface::WifiStaIface(
     const std::string& ifname,
     const std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal,
@@ -35,7 +44,11 @@ WifiStaIface::WifiStaIface(
     : ifname_(ifname),
       legacy_hal_(legacy_hal),
       iface_util_(iface_util),
-      is_valid_(true) {
+      is_valid_(true),
+      link_layer_stats_cache_window_(std::chrono::milliseconds(
+          property_get_int32(kLinkLayerStatsCacheMsProperty,
+                             kDefaultLinkLayerStatsCacheMs))),
+      has_cached_link_layer_stats_(false) {
     // Turn on DFS channel usage for STA iface.
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->setDfsFlag(ifname_, true);
@@ -452,12 +465,14 @@ WifiStatus WifiStaIface::stopBackgroundScanInternal(uint32_t cmd_id) {
 }
 
 WifiStatus WifiStaIface::enableLinkLayerStatsCollectionInternal(bool debug) {
+    has_cached_link_layer_stats_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->enableLinkLayerStats(ifname_, debug);
     return createWifiStatusFromLegacyError(legacy_status);
 }
 
 WifiStatus WifiStaIface::disableLinkLayerStatsCollectionInternal() {
+    has_cached_link_layer_stats_ = false;
     legacy_hal::wifi_error legacy_status =
         legacy_hal_.lock()->disableLinkLayerStats(ifname_);
     return createWifiStatusFromLegacyError(legacy_status);
@@ -470,6 +485,12 @@ WifiStaIface::getLinkLayerStatsInternal() {
 
 std::pair<WifiStatus, V1_3::StaLinkLayerStats>
 WifiStaIface::getLinkLayerStatsInternal_1_3() {
+    const auto now = std::chrono::steady_clock::now();
+    if (has_cached_link_layer_stats_ &&
+        now - cached_link_layer_stats_time_ < link_layer_stats_cache_window_) {
+        return {createWifiStatus(WifiStatusCode::SUCCESS),
+                cached_link_layer_stats_};
+    }
     legacy_hal::wifi_error legacy_status;
     legacy_hal::LinkLayerStats legacy_stats;
     std::tie(legacy_status, legacy_stats) =
@@ -482,6 +503,9 @@ WifiStaIface::getLinkLayerStatsInternal_1_3() {
                                                              &hidl_stats)) {
         return {createWifiStatus(WifiStatusCode::ERROR_UNKNOWN), {}};
     }
+    cached_link_layer_stats_ = hidl_stats;
+    cached_link_layer_stats_time_ = now;
+    has_cached_link_layer_stats_ = true;
     return {createWifiStatus(WifiStatusCode::SUCCESS), hidl_stats};
 }
 
@@ -17,6 +17,9 @@
 #ifndef WIFI_STA_IFACE_H_
 #define WIFI_STA_IFACE_H_
 
+#include <atomic>
+#include <chrono>
+
 #include <android-base/macros.h>
 #include <android/hardware/wifi/1.0/IWifiStaIfaceEventCallback.h>
 #include <android/hardware/wifi/1.3/IWifiStaIface.h>
@@ -163,9 +166,16 @@ class WifiStaIface : public V1_3::IWifiStaIface {
     std::string ifname_;
     std::weak_ptr<legacy_hal::WifiLegacyHal> legacy_hal_;
     std::weak_ptr<iface_util::WifiIfaceUtil> iface_util_;
-    bool is_valid_;
+    // Read from the legacy HAL event loop thread.
+    std::atomic<bool> is_valid_;
     hidl_callback_util::HidlCallbackHandler<IWifiStaIfaceEventCallback>
         event_cb_handler_;
+    // Last link layer stats returned, reused for
+    // |link_layer_stats_cache_window_|.
+    const std::chrono::steady_clock::duration link_layer_stats_cache_window_;
+    V1_3::StaLinkLayerStats cached_link_layer_stats_;
+    std::chrono::steady_clock::time_point cached_link_layer_stats_time_;
+    bool has_cached_link_layer_stats_;
 
     DISALLOW_COPY_AND_ASSIGN(WifiStaIface);
 };
@@ -22,10 +22,13 @@
 
 #include "wifi_hidl_call_util.h"
 #include "wifi_hidl_test_utils.h"
+#include "wifi_latency_stats.h"
 
 using ::android::sp;
 using ::android::hardware::wifi::V1_0::ChipModeId;
 using ::android::hardware::wifi::V1_0::IfaceType;
+using ::android::hardware::wifi::V1_0::WifiDebugRingBufferStatus;
+using ::android::hardware::wifi::V1_0::WifiDebugRingBufferVerboseLevel;
 using ::android::hardware::wifi::V1_0::WifiStatusCode;
 using ::android::hardware::wifi::V1_3::IWifiChip;
 
@@ -34,6 +37,10 @@ constexpr IWifiChip::LatencyMode kLatencyModeNormal =
     IWifiChip::LatencyMode::NORMAL;
 
 constexpr IWifiChip::LatencyMode kLatencyModeLow = IWifiChip::LatencyMode::LOW;
+
+constexpr uint32_t kRingBufferMaxInterval = 5;
+constexpr uint32_t kRingBufferMinDataSize = 1024;
+constexpr int kRingBufferFlushCount = 20;
 };  // namespace
 
 /**
@@ -116,3 +123,34 @@ TEST_F(WifiChipHidlTest, GetCapabilities_1_3) {
     }
     EXPECT_NE(0u, status_and_caps.second);
 }
+
+/*
+ * FlushRingBufferToFile
+ * Starts verbose logging to all the debug ring buffers, then logs how long
+ * kRingBufferFlushCount flushes take.
+ */
+TEST_F(WifiChipHidlTest, FlushRingBufferToFile) {
+    configureChipForIfaceType(IfaceType::STA, true);
+    const auto& status_and_rings =
+        HIDL_INVOKE(wifi_chip_, getDebugRingBuffersStatus);
+    if (status_and_rings.first.code == WifiStatusCode::ERROR_NOT_SUPPORTED) {
+        return;
+    }
+    ASSERT_EQ(WifiStatusCode::SUCCESS, status_and_rings.first.code);
+    for (const WifiDebugRingBufferStatus& ring : status_and_rings.second) {
+        const auto& status =
+            HIDL_INVOKE(wifi_chip_, startLoggingToDebugRingBuffer,
+                        ring.ringName, WifiDebugRingBufferVerboseLevel::VERBOSE,
+                        kRingBufferMaxInterval, kRingBufferMinDataSize);
+        EXPECT_EQ(WifiStatusCode::SUCCESS, status.code);
+    }
+
+    LatencyStats flush;
+    for (int i = 0; i < kRingBufferFlushCount; i++) {
+        auto start = std::chrono::steady_clock::now();
+        const auto& status = HIDL_INVOKE(wifi_chip_, flushRingBufferToFile);
+        ASSERT_EQ(WifiStatusCode::SUCCESS, status.code);
+        flush.add(std::chrono::steady_clock::now() - start);
+    }
+    LOG(INFO) << "flushRingBufferToFile: " << flush.toString();
+}
@@ -24,6 +24,7 @@
 #include "hostapd_hidl_call_util.h"
 #include "hostapd_hidl_test_utils.h"
 #include "hostapd_hidl_test_utils_1_1.h"
+#include "wifi_latency_stats.h"
 
 using ::android::sp;
 using ::android::hardware::hidl_string;
@@ -40,6 +41,7 @@ constexpr unsigned char kNwSsid[] = {'t', 'e', 's', 't', '1',
 constexpr char kNwPassphrase[] = "test12345";
 constexpr int kIfaceChannel = 6;
 constexpr int kIfaceInvalidChannel = 567;
+constexpr int kAccessPointCycles = 10;
 }  // namespace
 
 class HostapdHidlTest : public ::testing::VtsHalHidlTargetTestBase {
@@ -280,3 +282,26 @@ TEST_F(HostapdHidlTest, AddInvalidPskAccessPointWithoutAcs) {
                     getInvalidPskNwParams());
     EXPECT_NE(HostapdStatusCode::SUCCESS, status.code);
 }
+
+/**
+ * Adds & then removes an access point with PSK network config & ACS disabled,
+ * kAccessPointCycles times, and logs how long both take.
+ */
+TEST_F(HostapdHidlTest, AccessPointCycles) {
+    LatencyStats add, remove;
+    for (int cycle = 0; cycle < kAccessPointCycles; cycle++) {
+        auto start = std::chrono::steady_clock::now();
+        auto status = HIDL_INVOKE(hostapd_, addAccessPoint_1_1,
+                                  getIfaceParamsWithoutAcs(), getPskNwParams());
+        ASSERT_EQ(HostapdStatusCode::SUCCESS, status.code);
+        add.add(std::chrono::steady_clock::now() - start);
+
+        start = std::chrono::steady_clock::now();
+        status =
+            HIDL_INVOKE(hostapd_, removeAccessPoint, getPrimaryWlanIfaceName());
+        ASSERT_EQ(HostapdStatusCode::SUCCESS, status.code);
+        remove.add(std::chrono::steady_clock::now() - start);
+    }
+    LOG(INFO) << "addAccessPoint: " << add.toString();
+    LOG(INFO) << "removeAccessPoint: " << remove.toString();
+}
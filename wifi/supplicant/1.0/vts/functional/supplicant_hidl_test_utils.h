@@ -25,6 +25,9 @@
 
 #include <getopt.h>
 
+#include <cstdlib>
+#include <string>
+
 #include <VtsHalHidlTargetTestEnvBase.h>
 
 // Used to stop the android wifi framework before every test.
@@ -61,26 +64,51 @@ class WifiSupplicantHidlEnvironment
    public:
     // Whether P2P feature is supported on the device.
     bool isP2pOn = true;
+    // Access point the connect benchmark connects to; the benchmark is skipped
+    // when no SSID is given. An empty passphrase selects an open network.
+    std::string apSsid;
+    std::string apPassphrase;
+    // Number of connect/disconnect cycles of the connect benchmark.
+    int connectCycles = 10;
 
     void usage(char* me, char* arg) {
         fprintf(stderr,
                 "unrecognized option: %s\n\n"
                 "usage: %s <gtest options> <test options>\n\n"
                 "test options are:\n\n"
-                "-P, --p2p_on: Whether P2P feature is supported\n",
+                "-P, --p2p_on: Whether P2P feature is supported\n"
+                "-s, --ap_ssid <ssid>: SSID of the test AP of the connect "
+                "benchmark\n"
+                "-k, --ap_passphrase <passphrase>: WPA2 passphrase of the "
+                "test AP, open if not given\n"
+                "-c, --connect_cycles <count>: Connect cycles of the connect "
+                "benchmark (default 10)\n",
                 arg, me);
     }
 
     int initFromOptions(int argc, char** argv) {
-        static struct option options[] = {{"p2p_off", no_argument, 0, 'P'},
-                                          {0, 0, 0, 0}};
+        static struct option options[] = {
+            {"p2p_off", no_argument, 0, 'P'},
+            {"ap_ssid", required_argument, 0, 's'},
+            {"ap_passphrase", required_argument, 0, 'k'},
+            {"connect_cycles", required_argument, 0, 'c'},
+            {0, 0, 0, 0}};
 
         int c;
-        while ((c = getopt_long(argc, argv, "P", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "Ps:k:c:", options, NULL)) >= 0) {
             switch (c) {
                 case 'P':
                     isP2pOn = false;
                     break;
+                case 's':
+                    apSsid = optarg;
+                    break;
+                case 'k':
+                    apPassphrase = optarg;
+                    break;
+                case 'c':
+                    connectCycles = atoi(optarg);
+                    break;
                 default:
                     usage(argv[0], argv[optind]);
                     return 2;
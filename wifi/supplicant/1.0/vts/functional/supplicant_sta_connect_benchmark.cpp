@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/logging.h>
+
+#include <VtsHalHidlTargetTestBase.h>
+
+#include <android/hardware/wifi/supplicant/1.0/ISupplicantStaIface.h>
+#include <android/hardware/wifi/supplicant/1.0/ISupplicantStaNetwork.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
+#include "supplicant_hidl_call_util.h"
+#include "supplicant_hidl_test_utils.h"
+#include "wifi_latency_stats.h"
+
+using ::android::sp;
+using ::android::hardware::hidl_array;
+using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::wifi::supplicant::V1_0::ISupplicantStaIface;
+using ::android::hardware::wifi::supplicant::V1_0::ISupplicantStaIfaceCallback;
+using ::android::hardware::wifi::supplicant::V1_0::ISupplicantStaNetwork;
+using ::android::hardware::wifi::supplicant::V1_0::SupplicantStatusCode;
+
+extern WifiSupplicantHidlEnvironment* gEnv;
+
+namespace {
+using State = ISupplicantStaIfaceCallback::State;
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::seconds kConnectTimeout(60);
+constexpr std::chrono::seconds kDisconnectTimeout(10);
+}  // namespace
+
+/*
+ * Records when the iface first entered each state since the last reset().
+ */
+class StateRecordingCallback : public ISupplicantStaIfaceCallback {
+   public:
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entered_.clear();
+    }
+
+    // Returns false if |state| was not entered within |timeout|.
+    bool waitForState(State state, std::chrono::seconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [&] {
+            return entered_.find(state) != entered_.end();
+        });
+    }
+
+    // Returns false if |state| was not entered since the last reset().
+    bool enteredAt(State state, Clock::time_point* time) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entered_.find(state);
+        if (it == entered_.end()) {
+            return false;
+        }
+        *time = it->second;
+        return true;
+    }
+
+    Return<void> onStateChanged(
+        ISupplicantStaIfaceCallback::State newState,
+        const hidl_array<uint8_t, 6>& /*bssid */, uint32_t /* id */,
+        const hidl_vec<uint8_t>& /* ssid */) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entered_.emplace(newState, Clock::now());
+        cv_.notify_all();
+        return Void();
+    }
+
+    Return<void> onNetworkAdded(uint32_t /* id */) override { return Void(); }
+    Return<void> onNetworkRemoved(uint32_t /* id */) override { return Void(); }
+    Return<void> onAnqpQueryDone(
+        const hidl_array<uint8_t, 6>& /* bssid */,
+        const ISupplicantStaIfaceCallback::AnqpData& /* data */,
+        const ISupplicantStaIfaceCallback::Hs20AnqpData& /* hs20Data */)
+        override {
+        return Void();
+    }
+    Return<void> onHs20IconQueryDone(
+        const hidl_array<uint8_t, 6>& /* bssid */,
+        const hidl_string& /* fileName */,
+        const hidl_vec<uint8_t>& /* data */) override {
+        return Void();
+    }
+    Return<void> onHs20SubscriptionRemediation(
+        const hidl_array<uint8_t, 6>& /* bssid */,
+        ISupplicantStaIfaceCallback::OsuMethod /* osuMethod */,
+        const hidl_string& /* url*/) override {
+        return Void();
+    }
+    Return<void> onHs20DeauthImminentNotice(
+        const hidl_array<uint8_t, 6>& /* bssid */, uint32_t /* reasonCode */,
+        uint32_t /* reAuthDelayInSec */,
+        const hidl_string& /* url */) override {
+        return Void();
+    }
+    Return<void> onDisconnected(const hidl_array<uint8_t, 6>& /* bssid */,
+                                bool /* locallyGenerated */,
+                                ISupplicantStaIfaceCallback::ReasonCode
+                                /* reasonCode */) override {
+        return Void();
+    }
+    Return<void> onAssociationRejected(
+        const hidl_array<uint8_t, 6>& /* bssid */,
+        ISupplicantStaIfaceCallback::StatusCode /* statusCode */,
+        bool /*timedOut */) override {
+        return Void();
+    }
+    Return<void> onAuthenticationTimeout(
+        const hidl_array<uint8_t, 6>& /* bssid */) override {
+        return Void();
+    }
+    Return<void> onBssidChanged(
+        ISupplicantStaIfaceCallback::BssidChangeReason /* reason */,
+        const hidl_array<uint8_t, 6>& /* bssid */) override {
+        return Void();
+    }
+    Return<void> onEapFailure() override { return Void(); }
+    Return<void> onWpsEventSuccess() override { return Void(); }
+    Return<void> onWpsEventFail(
+        const hidl_array<uint8_t, 6>& /* bssid */,
+        ISupplicantStaIfaceCallback::WpsConfigError /* configError */,
+        ISupplicantStaIfaceCallback::WpsErrorIndication /* errorInd */)
+        override {
+        return Void();
+    }
+    Return<void> onWpsEventPbcOverlap() override { return Void(); }
+    Return<void> onExtRadioWorkStart(uint32_t /* id */) override {
+        return Void();
+    }
+    Return<void> onExtRadioWorkTimeout(uint32_t /* id*/) override {
+        return Void();
+    }
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<State, Clock::time_point> entered_;
+};
+
+/*
+ * Times connect cycles to the test AP given with --ap_ssid, split into the
+ * phases the iface reports through onStateChanged. Skipped without a test AP.
+ */
+class SupplicantStaConnectBenchmark
+    : public ::testing::VtsHalHidlTargetTestBase {
+   public:
+    virtual void SetUp() override {
+        startSupplicantAndWaitForHidlService();
+        sta_iface_ = getSupplicantStaIface();
+        ASSERT_NE(sta_iface_.get(), nullptr);
+        callback_ = new StateRecordingCallback();
+        EXPECT_EQ(SupplicantStatusCode::SUCCESS,
+                  HIDL_INVOKE(sta_iface_, registerCallback, callback_).code);
+    }
+
+    virtual void TearDown() override { stopSupplicant(); }
+
+   protected:
+    // Adds the test AP as a new network, or returns null on failure.
+    sp<ISupplicantStaNetwork> addTestApNetwork() {
+        const auto& status_and_network = HIDL_INVOKE(sta_iface_, addNetwork);
+        if (status_and_network.first.code != SupplicantStatusCode::SUCCESS) {
+            return nullptr;
+        }
+        sp<ISupplicantStaNetwork> network =
+            ISupplicantStaNetwork::castFrom(status_and_network.second);
+        if (network.get() == nullptr) {
+            return nullptr;
+        }
+
+        const std::string& ssid = gEnv->apSsid;
+        if (HIDL_INVOKE(network, setSsid,
+                        std::vector<uint8_t>(ssid.begin(), ssid.end()))
+                .code != SupplicantStatusCode::SUCCESS) {
+            return nullptr;
+        }
+        if (gEnv->apPassphrase.empty()) {
+            if (HIDL_INVOKE(network, setKeyMgmt,
+                            static_cast<uint32_t>(
+                                ISupplicantStaNetwork::KeyMgmtMask::NONE))
+                    .code != SupplicantStatusCode::SUCCESS) {
+                return nullptr;
+            }
+        } else {
+            if (HIDL_INVOKE(network, setKeyMgmt,
+                            static_cast<uint32_t>(
+                                ISupplicantStaNetwork::KeyMgmtMask::WPA_PSK))
+                        .code != SupplicantStatusCode::SUCCESS ||
+                HIDL_INVOKE(network, setPskPassphrase, gEnv->apPassphrase)
+                        .code != SupplicantStatusCode::SUCCESS) {
+                return nullptr;
+            }
+        }
+        return network;
+    }
+
+    // Adds the time from |from| to the first of |to| to |stats|, if the iface
+    // went through both.
+    void addPhase(Clock::time_point from, std::initializer_list<State> to,
+                  LatencyStats* stats) {
+        for (State state : to) {
+            Clock::time_point time;
+            if (callback_->enteredAt(state, &time)) {
+                stats->add(time - from);
+                return;
+            }
+        }
+    }
+
+    void addPhase(State from, std::initializer_list<State> to,
+                  LatencyStats* stats) {
+        Clock::time_point time;
+        if (callback_->enteredAt(from, &time)) {
+            addPhase(time, to, stats);
+        }
+    }
+
+    sp<ISupplicantStaIface> sta_iface_;
+    sp<StateRecordingCallback> callback_;
+};
+
+/*
+ * ConnectCycles
+ * Connects to and disconnects from the test AP --connect_cycles times. The
+ * phases are:
+ * - scan: from select() to the start of authentication, or of association
+ *   with drivers that do their own authentication;
+ * - auth: authentication;
+ * - assoc: association;
+ * - handshake: from association to completion, i.e. the 4-way and group
+ *   handshakes, if any;
+ * - connect: from select() to completion;
+ * - disconnect: from disconnect() to the iface being disconnected.
+ */
+TEST_F(SupplicantStaConnectBenchmark, ConnectCycles) {
+    if (gEnv->apSsid.empty()) {
+        LOG(INFO) << "No test AP given with --ap_ssid, skipping";
+        return;
+    }
+
+    LatencyStats scan, auth, assoc, handshake, connect, disconnect;
+    for (int cycle = 0; cycle < gEnv->connectCycles; cycle++) {
+        sp<ISupplicantStaNetwork> network = addTestApNetwork();
+        ASSERT_NE(network.get(), nullptr);
+        const auto& status_and_id = HIDL_INVOKE(network, getId);
+        ASSERT_EQ(SupplicantStatusCode::SUCCESS, status_and_id.first.code);
+
+        callback_->reset();
+        Clock::time_point start = Clock::now();
+        ASSERT_EQ(SupplicantStatusCode::SUCCESS,
+                  HIDL_INVOKE(network, select).code);
+        ASSERT_TRUE(callback_->waitForState(State::COMPLETED, kConnectTimeout))
+            << "cycle " << cycle << " did not connect";
+        addPhase(start, {State::AUTHENTICATING, State::ASSOCIATING}, &scan);
+        addPhase(State::AUTHENTICATING, {State::ASSOCIATING}, &auth);
+        addPhase(State::ASSOCIATING, {State::ASSOCIATED}, &assoc);
+        addPhase(State::ASSOCIATED, {State::COMPLETED}, &handshake);
+        addPhase(start, {State::COMPLETED}, &connect);
+
+        callback_->reset();
+        start = Clock::now();
+        ASSERT_EQ(SupplicantStatusCode::SUCCESS,
+                  HIDL_INVOKE(sta_iface_, disconnect).code);
+        EXPECT_TRUE(
+            callback_->waitForState(State::DISCONNECTED, kDisconnectTimeout));
+        addPhase(start, {State::DISCONNECTED}, &disconnect);
+
+        EXPECT_EQ(SupplicantStatusCode::SUCCESS,
+                  HIDL_INVOKE(sta_iface_, removeNetwork, status_and_id.second)
+                      .code);
+    }
+
+    LOG(INFO) << "scan: " << scan.toString();
+    LOG(INFO) << "auth: " << auth.toString();
+    LOG(INFO) << "assoc: " << assoc.toString();
+    LOG(INFO) << "handshake: " << handshake.toString();
+    LOG(INFO) << "connect: " << connect.toString();
+    LOG(INFO) << "disconnect: " << disconnect.toString();
+}